@@ -0,0 +1,162 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * arm_selection.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Work out which chromosome arm a contig lies on from its name.
+ * This is used both by the pipeline and by polymarker_build_homoeologs
+ * so that both assign the same arms.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_ARM_SELECTION_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_ARM_SELECTION_HPP_
+
+#include <string>
+
+#include "polymarker_service.h"
+
+
+/**
+ * The rules that an ArmSelector can use, matching the arm selection
+ * functions of polymarker.rb
+ */
+enum ArmSelectionRule
+{
+	/** The third underscore-separated part of the name, as used by arm_selection_embl. */
+	ASR_EMBL,
+
+	/** The first two characters of the name, as used by arm_selection_first_two. */
+	ASR_FIRST_TWO,
+
+	/** The second underscore-separated part of the name before any colon, as used by arm_selection_morex. */
+	ASR_MOREX,
+
+	/** The whole of the name, as used by scaffold. */
+	ASR_SCAFFOLD,
+
+	/** A field of the name split on a given separator, as given by "separator,field". */
+	ASR_FIELD
+};
+
+
+/**
+ * Gets the chromosome arm of each contig using one of the arm selection
+ * rules of polymarker.rb
+ *
+ * The rule is parsed once by SetRule and selecting an arm only scans the
+ * contig's name, returning the part of it that is the arm rather than
+ * making a copy, so it can be called for every hit without allocating.
+ */
+class POLYMARKER_SERVICE_LOCAL ArmSelector
+{
+public:
+	/**
+	 * Create an ArmSelector that uses arm_selection_embl.
+	 */
+	ArmSelector ();
+
+	/**
+	 * Set the rule to use.
+	 *
+	 * @param rule_s One of "arm_selection_embl", "arm_selection_first_two",
+	 * "arm_selection_morex" or "scaffold", or a custom rule of the form
+	 * "separator,field" where field is the 0-based index of the part of the
+	 * name to use, counting back from the end if it is negative.
+	 * @return <code>true</code> if the rule was set, <code>false</code> if
+	 * it is not valid in which case the current rule is kept.
+	 */
+	bool SetRule (const char *rule_s);
+
+	/**
+	 * Get the rule that is being used.
+	 *
+	 * @return The rule, as passed to SetRule.
+	 */
+	const char *GetRule () const;
+
+	/**
+	 * Get the chromosome arm of a contig.
+	 *
+	 * @param contig_s The name of the contig. This does not need to be NUL-terminated.
+	 * @param contig_length The length of the name.
+	 * @param arm_ss This will be set to point to the start of the arm, which
+	 * is either within contig_s or is AS_UNKNOWN_ARM_S.
+	 * @return The length of the arm.
+	 */
+	size_t Select (const char *contig_s, size_t contig_length, const char **arm_ss) const;
+
+	/**
+	 * Get the chromosome arm of a contig.
+	 *
+	 * @param contig_r The name of the contig.
+	 * @param arm_r This will be set to the arm. As arms are short, reusing
+	 * the same string for each call does not need any allocations.
+	 */
+	void Select (const std :: string &contig_r, std :: string &arm_r) const;
+
+	/** The arm given to contigs whose arm cannot be found. */
+	static const char * const AS_UNKNOWN_ARM_S;
+
+	static const char * const AS_EMBL_S;
+	static const char * const AS_FIRST_TWO_S;
+	static const char * const AS_MOREX_S;
+	static const char * const AS_SCAFFOLD_S;
+
+private:
+	ArmSelectionRule as_rule;
+
+	std :: string as_rule_name;
+
+	/** The separator for ASR_FIELD rules. */
+	std :: string as_separator;
+
+	/** The index of the field for ASR_FIELD rules. */
+	int32 as_field;
+
+	static size_t SelectEmbl (const char *contig_s, size_t contig_length, const char **arm_ss);
+
+	static size_t SelectField (const char *contig_s, size_t contig_length, const char *separator_s, size_t separator_length, int32 field, const char **arm_ss);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Check whether an arm selection rule is valid.
+ *
+ * This is simply a C-wrapper function around ArmSelector::SetRule().
+ *
+ * @param rule_s The rule to check.
+ * @return <code>true</code> if the rule is valid, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool IsValidArmSelection (const char *rule_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_ARM_SELECTION_HPP_ */
@@ -26,8 +26,14 @@
 #ifndef SERVER_SRC_SERVICES_POLYMARKER_INCLUDE_SYSTEM_POLYMARKER_TOOL_HPP_
 #define SERVER_SRC_SERVICES_POLYMARKER_INCLUDE_SYSTEM_POLYMARKER_TOOL_HPP_
 
+#include <condition_variable>
+#include <mutex>
+
+#include <sys/types.h>
+
 #include "polymarker_tool.hpp"
 #include "temp_file.hpp"
+#include "async_task.h"
 
 
 class POLYMARKER_SERVICE_LOCAL AsyncSystemPolymarkerTool : public PolymarkerTool
@@ -59,6 +65,39 @@ public:
 
 	virtual PolymarkerToolType GetToolType () const;
 
+	virtual bool RunInDirectory (const char *dir_s, char **error_ss);
+
+	/**
+	 * Send the job to the service's PolymarkerWorkerPool and wait for it
+	 * to finish. This is called from within the AsyncTask.
+	 */
+	void RunOnWorkerPool ();
+
+	/**
+	 * Start the job's process, register it with the service's
+	 * PolymarkerProcessMonitor and wait for it to exit. This is called
+	 * from within the AsyncTask.
+	 */
+	void RunMonitored ();
+
+	/**
+	 * Called by the PolymarkerProcessMonitor for each new line in the
+	 * job's status.txt.
+	 *
+	 * @param line_s The new status line.
+	 */
+	void StatusLineWritten (const char *line_s);
+
+	/**
+	 * Called by the PolymarkerProcessMonitor when the job's process exits.
+	 *
+	 * @param exited_flag <code>true</code> if the exit code is known.
+	 * @param exit_code The exit code of the process.
+	 */
+	void ProcessExited (bool exited_flag, int exit_code);
+
+	virtual bool Cancel ();
+
 
 protected:
 	const char *aspt_executable_s;
@@ -72,6 +111,14 @@ protected:
 
 	bool SetExecutable (const PolymarkerServiceData *data_p);
 
+	bool SetWorkerTask (const PolymarkerServiceData *data_p);
+
+	bool SetMonitoredTask (const PolymarkerServiceData *data_p);
+
+	bool AddSharedInputs (ByteBuffer *buffer_p);
+
+	const char *WaitForProcess (pid_t pid, bool monitored_flag, const char *cgroup_dir_s);
+
 
 private:
 	static uint32 SPT_NUM_ARGS;
@@ -79,9 +126,44 @@ private:
 	static const char * const ASPT_ASYNC_S;
 	static const char * const ASPT_LOGFILE_S;
 	static const char * const ASPT_EXECUTABLE_S;
+	static const char * const ASPT_CANCELLED_S;
+	static const char * const ASPT_TIMED_OUT_S;
+	static const char * const ASPT_CPU_LIMIT_S;
+
+	/** The number of seconds between asking a process to stop and killing it. */
+	static const uint32 ASPT_KILL_GRACE_PERIOD;
+
+	/** The number of seconds between checks of a job's CPU usage in its cgroup. */
+	static const uint32 ASPT_CPU_CHECK_PERIOD;
 
 	char *aspt_async_logfile_s;
 	SystemAsyncTask *aspt_task_p;
+
+	/**
+	 * If the service has a PolymarkerWorkerPool, this is the task used
+	 * to hand the job to it rather than running a new process.
+	 */
+	AsyncTask *aspt_worker_task_p;
+
+	/**
+	 * If the service has a PolymarkerProcessMonitor, this is the task
+	 * that starts the job's process and waits to be told that it has
+	 * finished.
+	 */
+	AsyncTask *aspt_monitored_task_p;
+
+	std :: mutex aspt_exit_mutex;
+
+	std :: condition_variable aspt_exit_cond;
+
+	bool aspt_process_exited_flag;
+
+	bool aspt_exit_code_known_flag;
+
+	int aspt_exit_code;
+
+	/** Has the job been cancelled? */
+	bool aspt_cancel_requested_flag;
 };
 
 
@@ -0,0 +1,349 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * exonerate_parser.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A table of aligner hits stored column by column and a parser
+ * that fills it from exonerate's output as the output arrives.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_EXONERATE_PARSER_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_EXONERATE_PARSER_HPP_
+
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "arm_selection.hpp"
+
+
+/**
+ * A hit from the aligner for one of the markers.
+ *
+ * The coordinates use exonerate's in-between, 0-based system.
+ */
+struct POLYMARKER_SERVICE_LOCAL PolymarkerHit
+{
+	std :: string ph_query_id;
+	uint32 ph_query_start;
+	uint32 ph_query_end;
+	char ph_query_strand;
+
+	std :: string ph_target_id;
+	uint64 ph_target_start;
+	uint64 ph_target_end;
+	char ph_target_strand;
+
+	int32 ph_score;
+	double ph_identity;
+	uint32 ph_query_length;
+	uint64 ph_target_length;
+
+	/** The orientation of any introns in the alignment. */
+	std :: string ph_gene_orientation;
+
+	/** The vulgar string describing the alignment. */
+	std :: string ph_vulgar;
+
+	/** The chromosome that the target contig belongs to. */
+	std :: string ph_chromosome;
+};
+
+
+/**
+ * The hits from the aligner, stored as a column for each value rather
+ * than as a PolymarkerHit for each hit.
+ *
+ * The query and target ids are stored once each, however many hits
+ * they have, and each row refers to them by index. The vulgar strings
+ * are all stored in a single buffer. The rows of each query are also
+ * recorded so that the hits of a marker can be found without scanning
+ * every hit.
+ *
+ * If an ArmSelector has been set, the arm of each target is worked out
+ * the first time that the target is added rather than for every hit.
+ */
+class POLYMARKER_SERVICE_LOCAL ExonerateHitTable
+{
+public:
+	ExonerateHitTable ();
+
+	/**
+	 * Set the rule used to work out the arm of each target.
+	 *
+	 * @param selector_p The ArmSelector to use. This must stay valid for as long
+	 * as hits are added to the table, and should be set before any are.
+	 */
+	void SetArmSelector (const ArmSelector *selector_p);
+
+	/**
+	 * Get the number of hits.
+	 *
+	 * @return The number of hits.
+	 */
+	size_t GetNumHits () const;
+
+	/**
+	 * Remove all of the hits.
+	 */
+	void Clear ();
+
+	/**
+	 * Add a hit.
+	 *
+	 * @param hit_r The hit to add. Its ph_chromosome is ignored.
+	 * @return The row of the new hit.
+	 */
+	size_t AddHit (const PolymarkerHit &hit_r);
+
+	/**
+	 * Add a copy of a hit from another table.
+	 *
+	 * @param table_r The table to copy the hit from.
+	 * @param row The row of the hit in table_r.
+	 * @return The row of the new hit.
+	 */
+	size_t AddHit (const ExonerateHitTable &table_r, size_t row);
+
+	/**
+	 * Copy a hit into a PolymarkerHit.
+	 *
+	 * @param row The row of the hit.
+	 * @param hit_r The PolymarkerHit to copy the values into. If an ArmSelector
+	 * has been set, ph_chromosome is set to the arm of the target. Otherwise it
+	 * is left unchanged.
+	 */
+	void GetHit (size_t row, PolymarkerHit &hit_r) const;
+
+	/**
+	 * Get the id of the query of a hit.
+	 *
+	 * @param row The row of the hit.
+	 * @return The query id.
+	 */
+	const std :: string &GetQueryId (size_t row) const;
+
+	/**
+	 * Get the id of the target of a hit.
+	 *
+	 * @param row The row of the hit.
+	 * @return The target id.
+	 */
+	const std :: string &GetTargetId (size_t row) const;
+
+	/**
+	 * Get the arm of the target of a hit.
+	 *
+	 * @param row The row of the hit.
+	 * @return The arm or an empty string if no ArmSelector has been set.
+	 */
+	const std :: string &GetArm (size_t row) const;
+
+	/**
+	 * Move a hit from the window of a contig that it was found in to
+	 * the contig itself.
+	 *
+	 * @param row The row of the hit.
+	 * @param target_id_r The id of the contig.
+	 * @param offset The position of the start of the window in the contig.
+	 * @param target_length The length of the contig.
+	 */
+	void MoveTarget (size_t row, const std :: string &target_id_r, uint64 offset, uint64 target_length);
+
+	/**
+	 * Get the hits of a query.
+	 *
+	 * @param query_id_r The query id.
+	 * @return The rows of the query's hits in the order that they were added.
+	 */
+	const std :: vector <uint32> &GetQueryHits (const std :: string &query_id_r) const;
+
+private:
+	friend class ExonerateParser;
+
+	/* The columns of the hits */
+	std :: vector <uint32> eht_query_ids;
+	std :: vector <uint32> eht_query_starts;
+	std :: vector <uint32> eht_query_ends;
+	std :: vector <char> eht_query_strands;
+	std :: vector <uint32> eht_target_ids;
+	std :: vector <uint64> eht_target_starts;
+	std :: vector <uint64> eht_target_ends;
+	std :: vector <char> eht_target_strands;
+	std :: vector <int32> eht_scores;
+	std :: vector <float> eht_identities;
+	std :: vector <uint32> eht_query_lengths;
+	std :: vector <uint64> eht_target_lengths;
+	std :: vector <char> eht_gene_orientations;
+	std :: vector <uint64> eht_vulgar_offsets;
+	std :: vector <uint32> eht_vulgar_lengths;
+
+	/** The vulgar strings of every hit, one after another. */
+	std :: string eht_vulgars;
+
+	/** The query and target ids. */
+	std :: vector <std :: string> eht_names;
+
+	/** The indexes into eht_names of the ids with each hash. */
+	std :: unordered_multimap <uint64, uint32> eht_name_ids;
+
+	/** The index into eht_arms of the arm of each id used as a target. */
+	std :: vector <uint32> eht_name_arms;
+
+	/** The rows of the hits of each id used as a query. */
+	std :: vector <std :: vector <uint32> > eht_query_rows;
+
+	std :: vector <std :: string> eht_arms;
+
+	std :: map <std :: string, uint32> eht_arm_ids;
+
+	const ArmSelector *eht_arm_selector_p;
+
+	size_t AddRow (uint32 query_id, uint32 query_start, uint32 query_end, char query_strand,
+		uint32 target_id, uint64 target_start, uint64 target_end, char target_strand,
+		int32 score, double identity, uint32 query_length, uint64 target_length,
+		char gene_orientation, const char *vulgar_s, size_t vulgar_length);
+
+	uint32 AddName (const char *name_s, size_t length);
+
+	uint32 FindName (const char *name_s, size_t length) const;
+
+	uint32 AddTarget (const char *name_s, size_t length);
+};
+
+
+/**
+ * This is called for each hit that an ExonerateParser adds to its
+ * ExonerateHitTable, with the row of the hit and the line of the
+ * aligner's output that it came from. The line includes its newline
+ * unless it was the last line and didn't have one. Returning
+ * <code>false</code> stops the parsing.
+ */
+typedef std :: function <bool (size_t row, const char *line_s, size_t line_length)> ExonerateHitCallback;
+
+
+/**
+ * A parser for the lines written by exonerate when it is run with
+ *
+ * --ryo 'RESULT:\t%S\t%pi\t%ql\t%tl\t%g\t%V\n'
+ *
+ * which adds each hit to an ExonerateHitTable. The values are read in
+ * place from the output, rather than each line being copied and split
+ * up, and hits at or below the minimum identity are rejected before
+ * their ids are looked at.
+ *
+ * The output can be given in blocks of any size, so a hit can be used
+ * as soon as its line has been read from the aligner rather than once
+ * the aligner has finished.
+ */
+class POLYMARKER_SERVICE_LOCAL ExonerateParser
+{
+public:
+	/**
+	 * Create an ExonerateParser.
+	 *
+	 * @param table_r The table to add the hits to.
+	 */
+	ExonerateParser (ExonerateHitTable &table_r);
+
+	/**
+	 * Only keep hits whose identity is greater than a given value.
+	 *
+	 * @param min_identity The identity, as a percentage, that hits
+	 * must be greater than. The default is to keep every hit.
+	 */
+	void SetMinIdentity (double min_identity);
+
+	/**
+	 * Set the function that is called for each hit that is kept.
+	 *
+	 * @param callback The function to call.
+	 */
+	void SetCallback (ExonerateHitCallback callback);
+
+	/**
+	 * Parse the next block of the output. Any partial line at the end of the
+	 * block is kept until the rest of it is given.
+	 *
+	 * @param data_s The block of output.
+	 * @param length The length of the block.
+	 * @return <code>false</code> if the callback stopped the parsing,
+	 * <code>true</code> otherwise.
+	 */
+	bool Parse (const char *data_s, size_t length);
+
+	/**
+	 * Parse any partial line left at the end of the output.
+	 *
+	 * @return <code>false</code> if the callback stopped the parsing,
+	 * <code>true</code> otherwise.
+	 */
+	bool Finish ();
+
+	/**
+	 * Parse the whole of a file by memory-mapping it.
+	 *
+	 * @param filename_s The file to parse.
+	 * @return <code>true</code> if the file was parsed successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool ParseFile (const char *filename_s);
+
+	/**
+	 * Parse the output of a pipe, such as one opened by popen, as it is
+	 * written. This returns once the other end of the pipe has been closed.
+	 *
+	 * @param in_f The stream to read from. This must not have been read
+	 * with any of the stdio functions.
+	 * @return <code>true</code> if the stream was parsed successfully,
+	 * <code>false</code> upon error or if the callback stopped the parsing.
+	 */
+	bool ParseStream (FILE *in_f);
+
+	/**
+	 * Get the number of lines that were hits, whether or not they were kept.
+	 *
+	 * @return The number of hit lines.
+	 */
+	uint64 GetNumHitLines () const;
+
+private:
+	ExonerateHitTable &ep_table_r;
+
+	double ep_min_identity;
+
+	bool ep_filter_flag;
+
+	ExonerateHitCallback ep_callback;
+
+	/** The start of a line whose end hasn't been given yet. */
+	std :: string ep_partial_line;
+
+	uint64 ep_num_hit_lines;
+
+	bool ParseLine (const char *line_s, size_t length, size_t line_length);
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_EXONERATE_PARSER_HPP_ */
@@ -0,0 +1,319 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * fasta_file.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Random access to the sequences of an indexed fasta file.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_FASTA_FILE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_FASTA_FILE_HPP_
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "polymarker_service.h"
+#include "packed_sequence_format.h"
+
+
+/**
+ * A single entry from a samtools-style .fai index.
+ */
+struct POLYMARKER_SERVICE_LOCAL FastaIndexEntry
+{
+	/** The name of the contig. */
+	std :: string fie_name;
+
+	/** The number of bases in the contig. */
+	uint64 fie_length;
+
+	/** The offset within the fasta file of the first base of the contig. */
+	uint64 fie_offset;
+
+	/** The number of bases on each line. */
+	uint32 fie_line_bases;
+
+	/** The number of bytes on each line including the line ending. */
+	uint32 fie_line_width;
+};
+
+
+/**
+ * A read-only view of a region of a contig within a memory-mapped
+ * fasta file or packed sequence file. No bases are copied, each one is
+ * read directly from the mapping, so the view is only valid while the
+ * FastaFile or PackedSequenceFile that it came from exists.
+ *
+ * A region can also view bases that have already been decoded into
+ * memory, such as those held by a RegionCache, in which case it keeps
+ * them alive for as long as it exists.
+ */
+class POLYMARKER_SERVICE_LOCAL FastaRegion
+{
+public:
+	FastaRegion ();
+
+	/**
+	 * Create a FastaRegion that views a decoded sequence.
+	 *
+	 * @param seq_p The bases of the region.
+	 */
+	explicit FastaRegion (const std :: shared_ptr <const std :: string> &seq_p);
+
+	/**
+	 * Get the number of bases in the region.
+	 *
+	 * @return The number of bases.
+	 */
+	size_t size () const
+	{
+		return (size_t) (fr_end - fr_start);
+	}
+
+	/**
+	 * Get a base from the region.
+	 *
+	 * @param i The 0-based position of the base within the region.
+	 * @return The base.
+	 */
+	char operator [] (size_t i) const
+	{
+		const uint64 pos = fr_start + i;
+
+		if (fr_packed_p)
+			{
+				return GetPackedBase (pos);
+			}
+		else if (fr_decoded_p)
+			{
+				return fr_data_s [pos];
+			}
+
+		return fr_data_s [(pos / fr_entry_p -> fie_line_bases) * fr_entry_p -> fie_line_width + (pos % fr_entry_p -> fie_line_bases)];
+	}
+
+	/**
+	 * Append the bases of the region to a string.
+	 *
+	 * @param seq_r The string to append to.
+	 */
+	void AppendTo (std :: string &seq_r) const;
+
+	/**
+	 * Write the bases of the region to a file as a single line.
+	 *
+	 * @param out_f The file to write to.
+	 * @return <code>true</code> if the bases were written successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Write (FILE *out_f) const;
+
+private:
+	friend class FastaFile;
+	friend class PackedSequenceFile;
+
+	/** The first byte of the contig in a mapped fasta file. */
+	const char *fr_data_s;
+
+	const FastaIndexEntry *fr_entry_p;
+
+	/** The first byte of the contig in a mapped packed sequence file. */
+	const uint8 *fr_packed_p;
+
+	/** The runs of Ns of a packed contig that overlap the region. */
+	const PackedNRun *fr_n_runs_p;
+
+	uint64 fr_num_n_runs;
+
+	uint64 fr_start;
+
+	uint64 fr_end;
+
+	/** The decoded bases that fr_data_s points to, if the region isn't in a mapped file. */
+	std :: shared_ptr <const std :: string> fr_decoded_p;
+
+	char GetPackedBase (uint64 pos) const
+	{
+		for (uint64 i = 0; i < fr_num_n_runs; ++ i)
+			{
+				if ((pos >= fr_n_runs_p [i].pnr_start) && (pos - fr_n_runs_p [i].pnr_start < fr_n_runs_p [i].pnr_length))
+					{
+						return 'N';
+					}
+			}
+
+		return PACKED_SEQUENCE_BASES_S [(fr_packed_p [pos >> 2] >> (6 - ((pos & 3) << 1))) & 3];
+	}
+
+	void DecodePacked (uint64 from, uint64 to, char *buffer_s) const;
+};
+
+
+/**
+ * A fasta file along with its .fai index that allows
+ * regions of any contig to be fetched.
+ *
+ * The fasta file is memory-mapped read-only so that regions can be
+ * read without copying them and the pages are shared by every job,
+ * and every process, that reads the same file.
+ *
+ * If the .fai file does not exist, the index will be
+ * built in memory by scanning the fasta file.
+ */
+class POLYMARKER_SERVICE_LOCAL FastaFile
+{
+public:
+	/**
+	 * Create a FastaFile.
+	 *
+	 * @param fasta_filename_s The fasta file to open.
+	 */
+	FastaFile (const char *fasta_filename_s);
+
+	~FastaFile ();
+
+	/**
+	 * Open the fasta file and load its index entries.
+	 *
+	 * @return <code>true</code> if the file was opened and indexed successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Load ();
+
+	/**
+	 * Get the index entry for a given contig.
+	 *
+	 * @param contig_s The name of the contig.
+	 * @return The entry or <code>0</code> if the contig is not in the index.
+	 */
+	const FastaIndexEntry *GetEntry (const char *contig_s) const;
+
+	/**
+	 * Fetch a region of a contig.
+	 *
+	 * @param contig_s The name of the contig.
+	 * @param start The 0-based position of the first base to get.
+	 * @param end The 0-based position one past the last base to get.
+	 * @param seq_r Where the bases will be stored.
+	 * @return <code>true</code> if the region was fetched successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool FetchRegion (const char *contig_s, uint64 start, uint64 end, std :: string &seq_r) const;
+
+	/**
+	 * Get a view of a region of a contig without copying its bases.
+	 *
+	 * @param contig_s The name of the contig.
+	 * @param start The 0-based position of the first base to get.
+	 * @param end The 0-based position one past the last base to get. This
+	 * is clipped to the length of the contig.
+	 * @param region_r The FastaRegion to set.
+	 * @return <code>true</code> if the region was set successfully,
+	 * <code>false</code> if the contig is not in the index.
+	 */
+	bool GetRegion (const char *contig_s, uint64 start, uint64 end, FastaRegion &region_r) const;
+
+	/**
+	 * Get the number of contigs in the index.
+	 *
+	 * @return The number of contigs.
+	 */
+	size_t GetNumContigs () const;
+
+	/**
+	 * Get the name of a contig.
+	 *
+	 * @param index The index of the contig, in the order that they are in the file.
+	 * @return The name of the contig.
+	 */
+	const char *GetContigName (size_t index) const;
+
+	/**
+	 * Get the number of bases in a contig.
+	 *
+	 * @param index The index of the contig, in the order that they are in the file.
+	 * @return The number of bases.
+	 */
+	uint64 GetContigLength (size_t index) const;
+
+	/**
+	 * Get the filename of the underlying fasta file.
+	 *
+	 * @return The filename.
+	 */
+	const char *GetFilename () const;
+
+	/**
+	 * Get the loaded FastaFile for a given fasta file that is shared by the
+	 * whole process. The first call for each file maps it and loads its index,
+	 * any later calls return the same FastaFile.
+	 *
+	 * @param fasta_filename_s The fasta file.
+	 * @return The FastaFile or an empty pointer if it could not be loaded.
+	 */
+	static std :: shared_ptr <const FastaFile> GetShared (const char *fasta_filename_s);
+
+private:
+	std :: string ff_filename;
+
+	const char *ff_data_s;
+
+	size_t ff_data_size;
+
+	std :: vector <FastaIndexEntry> ff_entries;
+
+	std :: unordered_map <std :: string, size_t> ff_entries_map;
+
+	bool LoadIndex (const char *fai_filename_s);
+
+	bool BuildIndex ();
+
+	void AddEntry (const FastaIndexEntry &entry_r);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load a fasta file into the FastaFiles shared by the whole process
+ * so that jobs against it do not need to load it themselves.
+ *
+ * This is simply a C-wrapper function around FastaFile::GetShared().
+ *
+ * @param fasta_filename_s The fasta file.
+ * @return <code>true</code> if the fasta file is loaded, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool LoadSharedFastaFile (const char *fasta_filename_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_FASTA_FILE_HPP_ */
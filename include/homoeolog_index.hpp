@@ -0,0 +1,154 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * homoeolog_index.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The precomputed chromosome arms and homoeologs of the contigs
+ * of a database.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "homoeolog_index_format.hpp"
+
+
+/**
+ * A homoeolog index file, as written by polymarker_build_homoeologs,
+ * that is memory-mapped read-only.
+ *
+ * Once the best contig for a marker has been found, its homoeologs
+ * can be read straight from here rather than being worked out from
+ * the marker's hits on each of the other chromosomes.
+ */
+class POLYMARKER_SERVICE_LOCAL HomoeologIndex
+{
+public:
+	/**
+	 * Create a HomoeologIndex.
+	 *
+	 * @param filename_s The homoeolog index file to open.
+	 */
+	HomoeologIndex (const char *filename_s);
+
+	~HomoeologIndex ();
+
+	/**
+	 * Map the file and check that its contents are valid.
+	 *
+	 * @return <code>true</code> if the file was loaded successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Load ();
+
+	/**
+	 * Find a contig in the index.
+	 *
+	 * @param contig_r The name of the contig.
+	 * @return The contig's entry or <code>0</code> if it is not in the index.
+	 */
+	const HomoeologContig *FindContig (const std :: string &contig_r) const;
+
+	/**
+	 * Get the homoeologs of a contig.
+	 *
+	 * @param contig_p The contig's entry, as returned by FindContig.
+	 * @param homoeologs_r The names of the other contigs in the contig's
+	 * group will be appended to this.
+	 * @return The number of homoeologs that were found.
+	 */
+	size_t GetHomoeologs (const HomoeologContig *contig_p, std :: vector <const char *> &homoeologs_r) const;
+
+	/**
+	 * Get the arm selection rule that the arms of the contigs were
+	 * found with.
+	 *
+	 * @return The rule, in the form used by ArmSelector::SetRule().
+	 */
+	const char *GetArmSelection () const;
+
+	/**
+	 * Get the filename of the underlying homoeolog index file.
+	 *
+	 * @return The filename.
+	 */
+	const char *GetFilename () const;
+
+	/**
+	 * Get the loaded HomoeologIndex for a given file that is shared by
+	 * the whole process. The first call for each file maps it, any later
+	 * calls return the same HomoeologIndex.
+	 *
+	 * @param filename_s The homoeolog index file.
+	 * @return The HomoeologIndex or an empty pointer if it could not be loaded.
+	 */
+	static std :: shared_ptr <const HomoeologIndex> GetShared (const char *filename_s);
+
+private:
+	std :: string hi_filename;
+
+	const uint8 *hi_data_p;
+
+	size_t hi_data_size;
+
+	const HomoeologIndexHeader *hi_header_p;
+
+	const HomoeologContig *hi_contigs_p;
+
+	const HomoeologGroup *hi_groups_p;
+
+	const uint32 *hi_members_p;
+
+	const char *hi_names_s;
+
+	bool CheckLayout ();
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load a homoeolog index into the HomoeologIndexes shared by the whole
+ * process so that jobs against it do not need to load it themselves.
+ *
+ * This is simply a C-wrapper function around HomoeologIndex::GetShared().
+ *
+ * @param filename_s The homoeolog index file.
+ * @return <code>true</code> if the index is loaded, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool LoadSharedHomoeologIndex (const char *filename_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_HPP_ */
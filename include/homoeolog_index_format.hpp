@@ -0,0 +1,134 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * homoeolog_index_format.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The on-disk layout of a homoeolog index, which stores the
+ * chromosome arm of every contig of a database along with the groups
+ * of homoeologous contigs that were found by polymarker_build_homoeologs.
+ *
+ * A homoeolog index file is laid out as
+ *
+ * - A HomoeologIndexHeader.
+ * - A HomoeologContig for each contig, sorted by name.
+ * - A HomoeologGroup for each group.
+ * - The members of every group, each as the index of a HomoeologContig.
+ * - The NUL-terminated names of the contigs.
+ *
+ * All of the values are in the byte order of the machine that wrote
+ * the file.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_FORMAT_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_FORMAT_HPP_
+
+#include "typedefs.h"
+
+
+/** The bytes at the start of every homoeolog index file. */
+#define HOMOEOLOG_INDEX_MAGIC_S "PMKHOMO"
+
+/** The current version of the format. */
+#define HOMOEOLOG_INDEX_VERSION (1)
+
+/** The value of hc_group for a contig that has no homoeologs. */
+#define HOMOEOLOG_NO_GROUP (0xFFFFFFFFu)
+
+/** The size of the buffer that holds each contig's arm, including its terminating NUL. */
+#define HOMOEOLOG_ARM_SIZE (20)
+
+/** The size of the buffer that holds the arm selection rule, including its terminating NUL. */
+#define HOMOEOLOG_RULE_SIZE (32)
+
+
+/**
+ * The header at the start of a homoeolog index file.
+ */
+struct HomoeologIndexHeader
+{
+	/** This is HOMOEOLOG_INDEX_MAGIC_S including its terminating NUL. */
+	char hih_magic_s [8];
+
+	/** The version of the format. */
+	uint32 hih_version;
+
+	/** Padding to keep the offsets aligned. */
+	uint32 hih_reserved;
+
+	/** The arm selection rule that the arms of the contigs were found with. */
+	char hih_arm_selection_s [HOMOEOLOG_RULE_SIZE];
+
+	/** The number of contigs. */
+	uint64 hih_num_contigs;
+
+	/** The number of HomoeologGroups. */
+	uint64 hih_num_groups;
+
+	/** The number of members of all of the groups. */
+	uint64 hih_num_members;
+
+	/** The offset of the HomoeologContigs from the start of the file. */
+	uint64 hih_contigs_offset;
+
+	/** The offset of the HomoeologGroups from the start of the file. */
+	uint64 hih_groups_offset;
+
+	/** The offset of the group members from the start of the file. */
+	uint64 hih_members_offset;
+
+	/** The offset of the contig names from the start of the file. */
+	uint64 hih_names_offset;
+
+	/** The size of the whole file, used to detect truncated files. */
+	uint64 hih_file_size;
+};
+
+
+/**
+ * An entry in the contig table of a homoeolog index.
+ */
+struct HomoeologContig
+{
+	/** The offset of the contig's name from the start of the names. */
+	uint64 hc_name_offset;
+
+	/** The index of the contig's HomoeologGroup or HOMOEOLOG_NO_GROUP. */
+	uint32 hc_group;
+
+	/** The chromosome arm of the contig. */
+	char hc_arm_s [HOMOEOLOG_ARM_SIZE];
+};
+
+
+/**
+ * A group of contigs, each on a different chromosome arm, that are
+ * homoeologous to each other.
+ */
+struct HomoeologGroup
+{
+	/** The index of the group's first member in the group members. */
+	uint32 hg_first_member;
+
+	/** The number of contigs in the group. */
+	uint32 hg_num_members;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_HOMOEOLOG_INDEX_FORMAT_HPP_ */
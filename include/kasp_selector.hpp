@@ -0,0 +1,230 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * kasp_selector.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Choose the best KASP primers for each marker from the primer3
+ * results as they are read and write the primers files.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_KASP_SELECTOR_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_KASP_SELECTOR_HPP_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "primer3_engine.hpp"
+#include "json_util.h"
+
+
+struct PolymarkerMarker;
+
+
+/**
+ * The scores used to choose between the primer pairs of a marker, in
+ * place of the scoring tables of polymarker.rb's KASPContainer. The pair
+ * with the highest score is chosen and, if more than one pair has it,
+ * the one with the shortest product.
+ */
+struct POLYMARKER_SERVICE_LOCAL KASPScores
+{
+	/** The score of a pair whose common primer ends on a base specific to the target chromosome. */
+	int32 ks_chromosome_specific;
+
+	/** The score of a pair whose common primer ends on a base shared with only some of the homoeologs. */
+	int32 ks_chromosome_semispecific;
+
+	/** The score of a pair whose common primer isn't specific. */
+	int32 ks_chromosome_nonspecific;
+
+	/** The score added for each base of the pair's product. */
+	int32 ks_product_size;
+
+	/**
+	 * Create the KASPScores of the genome_specific table, which is
+	 * used unless the database sets another.
+	 */
+	KASPScores ();
+
+	/**
+	 * Set the scores from a database's configuration.
+	 *
+	 * @param scores_p Either the name of a built-in table, "genome_specific"
+	 * or "het_dels", or an object with an optional "table" giving the
+	 * built-in table to start from and any of "chromosome_specific",
+	 * "chromosome_semispecific", "chromosome_nonspecific" and "product_size"
+	 * to override its scores.
+	 * @return <code>true</code> if the scores were set, <code>false</code> if
+	 * they are not valid in which case the current scores are kept.
+	 */
+	bool SetFromJSON (const json_t *scores_p);
+
+	/**
+	 * Set the scores to one of the built-in tables.
+	 *
+	 * @param table_s "genome_specific" or "het_dels".
+	 * @return <code>true</code> if the table was found, <code>false</code>
+	 * otherwise in which case the current scores are kept.
+	 */
+	bool SetTable (const char *table_s);
+
+	/**
+	 * Get the score for a type of primer pair.
+	 *
+	 * @param type_c One of the KASPSelector type codes.
+	 * @return The score.
+	 */
+	int32 GetTypeScore (char type_c) const;
+};
+
+
+/**
+ * Pairs up the primer3 results for the two alleles of each marker as they
+ * arrive, in any order, and keeps only the best scoring pair for each
+ * marker so that the results don't all need to be held at once.
+ *
+ * The results are matched using the SEQUENCE_IDs made by MakeId.
+ */
+class POLYMARKER_SERVICE_LOCAL KASPSelector
+{
+public:
+	/**
+	 * Create a KASPSelector that uses the genome_specific scores.
+	 */
+	KASPSelector ();
+
+	/**
+	 * Set the scores to choose the pairs with.
+	 *
+	 * @param scores_r The KASPScores.
+	 */
+	void SetScores (const KASPScores &scores_r);
+
+	/**
+	 * Discard any pairs and start choosing them for a new set of markers.
+	 *
+	 * @param num_markers The number of markers.
+	 */
+	void Reset (size_t num_markers);
+
+	/**
+	 * Add a primer3 result. If the result for the other allele has already
+	 * been added, the pair is scored against the best so far for its marker.
+	 *
+	 * @param result_r The result, which may be moved from.
+	 */
+	void AddResult (Primer3Result &result_r);
+
+	/**
+	 * Write the chosen primers of every marker to primers.csv and the
+	 * oligos to order, with the KASP tails added to the allele-specific
+	 * primers, to primers_to_order.csv in a single pass.
+	 *
+	 * @param markers_r The markers, in the same order as the indexes given
+	 * to MakeId.
+	 * @param primers_filename_r The filename of primers.csv.
+	 * @param order_filename_r The filename of primers_to_order.csv.
+	 * @return <code>true</code> if both files were written successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Write (const std :: vector <PolymarkerMarker> &markers_r, const std :: string &primers_filename_r, const std :: string &order_filename_r) const;
+
+	/**
+	 * Make the SEQUENCE_ID of a primer3 record.
+	 *
+	 * @param marker_index The index of the marker.
+	 * @param forward_flag <code>true</code> if the allele-specific primer is
+	 * the left primer, <code>false</code> if it is the right one.
+	 * @param type_c The type of the common primer.
+	 * @param first_allele_flag <code>true</code> for the first allele,
+	 * <code>false</code> for the second.
+	 * @param common_pos The position that the common primer is forced to
+	 * end at or -1 if it isn't.
+	 * @return The id.
+	 */
+	static std :: string MakeId (size_t marker_index, bool forward_flag, char type_c, bool first_allele_flag, int32 common_pos);
+
+	/** A common primer that ends on a base specific to the target chromosome. */
+	static const char KS_TYPE_SPECIFIC_C;
+
+	/** A common primer that ends on a base shared with only some of the homoeologs. */
+	static const char KS_TYPE_SEMISPECIFIC_C;
+
+	/** A common primer that isn't specific. */
+	static const char KS_TYPE_NONSPECIFIC_C;
+
+private:
+	/** The best pair of a marker so far. */
+	struct Candidate
+	{
+		Primer3Result c_first;
+
+		Primer3Result c_second;
+
+		char c_type;
+
+		bool c_forward_flag;
+
+		int32 c_score;
+
+		int32 c_product_size;
+
+		bool c_set_flag;
+
+		Candidate () : c_type ('\0'), c_forward_flag (false), c_score (0), c_product_size (0), c_set_flag (false) {}
+	};
+
+	KASPScores ks_scores;
+
+	std :: vector <Candidate> ks_candidates;
+
+	/** The results waiting for their other allele, by their id with the allele removed. */
+	std :: unordered_map <std :: string, Primer3Result> ks_pending;
+
+	void AddPair (size_t marker_index, bool forward_flag, char type_c, Primer3Result &first_r, Primer3Result &second_r);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Check whether a database's KASP scores are valid.
+ *
+ * This is simply a C-wrapper function around KASPScores::SetFromJSON().
+ *
+ * @param scores_p The scores to check.
+ * @return <code>true</code> if the scores are valid, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool IsValidKASPScores (const json_t *scores_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_KASP_SELECTOR_HPP_ */
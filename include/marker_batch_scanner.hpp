@@ -0,0 +1,184 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * marker_batch_scanner.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Find where every marker of a job lies in a genome that has
+ * no minimizer index with a single pass over the genome.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_MARKER_BATCH_SCANNER_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_MARKER_BATCH_SCANNER_HPP_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "minimizer_index.hpp"
+
+
+/**
+ * A minimizer that a marker shares with the genome.
+ */
+struct POLYMARKER_SERVICE_LOCAL MarkerAnchor
+{
+	/** The index of the marker. */
+	uint32 ma_marker;
+
+	/** The index of the minimizer's hash in the MarkerBatchScanner's table. */
+	uint32 ma_hash_index;
+
+	/** Where the minimizer lies in the genome. */
+	SeedAnchor ma_anchor;
+};
+
+
+/**
+ * The anchors found by one of the threads scanning the genome.
+ */
+struct POLYMARKER_SERVICE_LOCAL MarkerScanHits
+{
+	MarkerScanHits ();
+
+	/** The anchors of every marker. */
+	std :: vector <MarkerAnchor> msh_anchors;
+
+	/**
+	 * The number of times that each of the markers' minimizers has been
+	 * seen, which stops going up once it is known to be a repeat.
+	 */
+	std :: vector <uint32> msh_counts;
+};
+
+
+/**
+ * The minimizers of all of the markers of a job, held in a single
+ * hash table, so that the genome can be read once and each of its
+ * minimizers looked up against every marker at the same time rather
+ * than the genome being searched once for each marker.
+ *
+ * The same minimizers and chaining are used as for a MinimizerIndex,
+ * so the windows that are found are the ones that a minimizer index
+ * built with the same k and w would give.
+ */
+class POLYMARKER_SERVICE_LOCAL MarkerBatchScanner
+{
+public:
+	/**
+	 * Create a MarkerBatchScanner.
+	 *
+	 * @param k The length of the k-mers.
+	 * @param w The number of consecutive k-mers that each minimizer is chosen from.
+	 * @param max_occurrences Minimizers that occur more than this many
+	 * times in the genome are repeats and are ignored.
+	 */
+	MarkerBatchScanner (uint32 k, uint32 w, uint32 max_occurrences);
+
+	/**
+	 * Add the minimizers of a marker.
+	 *
+	 * @param seq_r The sequence of the marker.
+	 * @return The index of the marker.
+	 */
+	size_t AddMarker (const std :: string &seq_r);
+
+	/**
+	 * Build the hash table once all of the markers have been added. This
+	 * must be called before the genome is scanned.
+	 */
+	void Prepare ();
+
+	/**
+	 * Get the number of bases that a region has to extend past each end of
+	 * the part of a contig that is being scanned so that the minimizers
+	 * near the ends are the same as if the whole contig were scanned.
+	 *
+	 * @return The number of bases.
+	 */
+	uint32 GetOverlap () const;
+
+	/**
+	 * Find the minimizers of part of a contig that the markers share.
+	 * This only reads the MarkerBatchScanner so it can be called on
+	 * several threads at once, each with its own MarkerScanHits.
+	 *
+	 * @param bases_s The bases of the region, which covers from start - GetOverlap ()
+	 * to end + GetOverlap (), clipped to the ends of the contig.
+	 * @param length The number of bases in bases_s.
+	 * @param bases_start The 0-based position in the contig of the first base of bases_s.
+	 * @param contig The index of the contig.
+	 * @param start The 0-based position of the first base of the part being scanned.
+	 * @param end The 0-based position one past the last base of the part being scanned.
+	 * @param hits_r The MarkerScanHits to add the anchors to.
+	 */
+	void ScanRegion (const char *bases_s, size_t length, uint64 bases_start, uint32 contig, uint64 start, uint64 end, MarkerScanHits &hits_r) const;
+
+	/**
+	 * Chain the anchors of each marker, once the whole genome has been
+	 * scanned, into the windows that it is likely to align to.
+	 *
+	 * @param hits_r The MarkerScanHits of every thread. Their anchors are
+	 * cleared as they are used.
+	 * @param margin The number of bases to add to each end of a window.
+	 * @param set_contig_r This is called to set the sw_contig and
+	 * sw_contig_length of a window from the index of its contig.
+	 * @param windows_r The windows of each marker, by the marker's index.
+	 */
+	void FindWindows (std :: vector <MarkerScanHits> &hits_r, uint32 margin, const std :: function <void (uint32 contig, SeedWindow &window_r)> &set_contig_r, std :: vector <std :: vector <SeedWindow> > &windows_r) const;
+
+private:
+	/**
+	 * A minimizer of one of the markers.
+	 */
+	struct MarkerMinimizer
+	{
+		uint64 mm_hash;
+		uint32 mm_marker;
+		uint32 mm_strand;
+		uint64 mm_position;
+	};
+
+	uint32 mbs_k;
+
+	uint32 mbs_w;
+
+	uint32 mbs_max_occurrences;
+
+	/** The length of each marker. */
+	std :: vector <uint64> mbs_marker_lengths;
+
+	/** The minimizers of every marker, sorted by hash once Prepare has been called. */
+	std :: vector <MarkerMinimizer> mbs_minimizers;
+
+	/** The index in mbs_minimizers of the first minimizer with each distinct hash, followed by the number of minimizers. */
+	std :: vector <uint32> mbs_hash_starts;
+
+	/** The distinct hashes in an open-addressed table whose size is a power of 2. */
+	std :: vector <uint64> mbs_table_hashes;
+
+	/** The index of each hash in mbs_table_hashes plus 1, or 0 if the slot is empty. */
+	std :: vector <uint32> mbs_table_indexes;
+
+	uint32 FindHash (uint64 hash) const;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_MARKER_BATCH_SCANNER_HPP_ */
@@ -0,0 +1,196 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * minimizer_index.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief An index of the minimizers of a genome that is used to find
+ * where each marker is likely to align before running the aligner.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_INDEX_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_INDEX_HPP_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "minimizer_sketch.hpp"
+
+
+/**
+ * A region of a contig that a marker's minimizers place it in.
+ */
+struct POLYMARKER_SERVICE_LOCAL SeedWindow
+{
+	/** The name of the contig. */
+	std :: string sw_contig;
+
+	/** The number of bases in the contig. */
+	uint64 sw_contig_length;
+
+	/** The 0-based position of the first base of the window. */
+	uint64 sw_start;
+
+	/** The 0-based position one past the last base of the window. */
+	uint64 sw_end;
+
+	/** The number of the marker's minimizers that fall on the same diagonals in the window. */
+	uint32 sw_num_seeds;
+};
+
+
+/**
+ * A minimizer that a query shares with the genome, along with the
+ * diagonal that it lies on.
+ */
+struct POLYMARKER_SERVICE_LOCAL SeedAnchor
+{
+	/** The index of the contig that the minimizer is in. */
+	uint32 sa_contig;
+
+	/** 0 if the query and the contig are on the same strand, 1 if not. */
+	uint32 sa_strand;
+
+	/**
+	 * The position in the contig where the start of the query would lie or,
+	 * for anchors on the reverse strand, where the end of the query would lie.
+	 */
+	int64 sa_diagonal;
+};
+
+
+/**
+ * A minimizer index file, as written by polymarker_build_minimizers,
+ * that is memory-mapped read-only.
+ *
+ * Looking a marker up gives the windows of the contigs where its
+ * minimizers fall on nearby diagonals, so the aligner only needs to be
+ * run against those windows rather than against the whole genome.
+ */
+class POLYMARKER_SERVICE_LOCAL MinimizerIndex
+{
+public:
+	/**
+	 * Create a MinimizerIndex.
+	 *
+	 * @param filename_s The minimizer index file to open.
+	 */
+	MinimizerIndex (const char *filename_s);
+
+	~MinimizerIndex ();
+
+	/**
+	 * Map the file and check that its contents are valid.
+	 *
+	 * @return <code>true</code> if the file was loaded successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Load ();
+
+	/**
+	 * Find the windows of the genome that a sequence is likely to align to.
+	 *
+	 * @param query_r The sequence to look up.
+	 * @param max_occurrences Minimizers that occur more than this many times
+	 * in the genome are repeats and are ignored.
+	 * @param margin The number of bases to add to each end of a window.
+	 * @param windows_r The windows found for the sequence will be appended to this.
+	 * @return The number of windows that were found.
+	 */
+	size_t FindWindows (const std :: string &query_r, uint32 max_occurrences, uint32 margin, std :: vector <SeedWindow> &windows_r) const;
+
+	/**
+	 * Get the filename of the underlying minimizer index file.
+	 *
+	 * @return The filename.
+	 */
+	const char *GetFilename () const;
+
+	/**
+	 * Chain the anchors of a query that lie on nearby diagonals of the
+	 * same contig and strand into windows. Only the chains with enough
+	 * anchors are kept and, if there are too many, those with the most.
+	 *
+	 * @param anchors_r The anchors of the query. These will be sorted.
+	 * @param query_length The length of the query.
+	 * @param margin The number of bases to add to each end of a window.
+	 * @param set_contig_r This is called to set the sw_contig and
+	 * sw_contig_length of a window from the index of its contig.
+	 * @param windows_r The windows will be appended to this.
+	 * @return The number of windows that were found.
+	 */
+	static size_t ChainAnchors (std :: vector <SeedAnchor> &anchors_r, uint64 query_length, uint32 margin, const std :: function <void (uint32 contig, SeedWindow &window_r)> &set_contig_r, std :: vector <SeedWindow> &windows_r);
+
+	/**
+	 * Get the loaded MinimizerIndex for a given file that is shared by
+	 * the whole process. The first call for each file maps it, any later
+	 * calls return the same MinimizerIndex.
+	 *
+	 * @param filename_s The minimizer index file.
+	 * @return The MinimizerIndex or an empty pointer if it could not be loaded.
+	 */
+	static std :: shared_ptr <const MinimizerIndex> GetShared (const char *filename_s);
+
+private:
+	std :: string mi_filename;
+
+	const uint8 *mi_data_p;
+
+	size_t mi_data_size;
+
+	const MinimizerIndexHeader *mi_header_p;
+
+	const MinimizerContig *mi_contigs_p;
+
+	const MinimizerEntry *mi_entries_p;
+
+	const char *mi_names_s;
+
+	bool CheckLayout ();
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load a minimizer index into the MinimizerIndexes shared by the whole
+ * process so that jobs against it do not need to load it themselves.
+ *
+ * This is simply a C-wrapper function around MinimizerIndex::GetShared().
+ *
+ * @param filename_s The minimizer index file.
+ * @return <code>true</code> if the index is loaded, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool LoadSharedMinimizerIndex (const char *filename_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_INDEX_HPP_ */
@@ -0,0 +1,293 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * minimizer_sketch.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The minimizers of a sequence and the on-disk layout of a
+ * minimizer index. This is used both by polymarker_build_minimizers
+ * when it builds an index and by the MinimizerIndex that searches it,
+ * so that both pick exactly the same minimizers.
+ *
+ * A minimizer index file is laid out as
+ *
+ * - A MinimizerIndexHeader.
+ * - A MinimizerContig for each contig.
+ * - The MinimizerEntries of every contig, sorted by hash.
+ * - The NUL-terminated names of the contigs.
+ *
+ * All of the values are in the byte order of the machine that wrote
+ * the file.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_SKETCH_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_SKETCH_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "typedefs.h"
+
+
+/** The bytes at the start of every minimizer index file. */
+#define MINIMIZER_INDEX_MAGIC_S "PMKMINI"
+
+/** The current version of the format. */
+#define MINIMIZER_INDEX_VERSION (1)
+
+/** The largest k-mer length that fits into the 64-bit codes. */
+#define MINIMIZER_MAX_K (31)
+
+/** The largest contig position that can be stored in a MinimizerEntry. */
+#define MINIMIZER_MAX_POSITION (0x7FFFFFFFu)
+
+
+/**
+ * The header at the start of a minimizer index file.
+ */
+struct MinimizerIndexHeader
+{
+	/** This is MINIMIZER_INDEX_MAGIC_S including its terminating NUL. */
+	char mih_magic_s [8];
+
+	/** The version of the format. */
+	uint32 mih_version;
+
+	/** The length of the k-mers. */
+	uint32 mih_k;
+
+	/** The number of consecutive k-mers that each minimizer is chosen from. */
+	uint32 mih_w;
+
+	/** Padding to keep the offsets aligned. */
+	uint32 mih_reserved;
+
+	/** The number of contigs. */
+	uint64 mih_num_contigs;
+
+	/** The number of MinimizerEntries. */
+	uint64 mih_num_entries;
+
+	/** The offset of the MinimizerContigs from the start of the file. */
+	uint64 mih_contigs_offset;
+
+	/** The offset of the MinimizerEntries from the start of the file. */
+	uint64 mih_entries_offset;
+
+	/** The offset of the contig names from the start of the file. */
+	uint64 mih_names_offset;
+
+	/** The size of the whole file, used to detect truncated files. */
+	uint64 mih_file_size;
+};
+
+
+/**
+ * An entry in the contig table of a minimizer index.
+ */
+struct MinimizerContig
+{
+	/** The offset of the contig's name from the start of the names. */
+	uint64 mc_name_offset;
+
+	/** The number of bases in the contig. */
+	uint64 mc_length;
+};
+
+
+/**
+ * An occurrence of a minimizer in the genome.
+ */
+struct MinimizerEntry
+{
+	/** The hash of the minimizer. */
+	uint64 me_hash;
+
+	/** The index of the contig in the contig table. */
+	uint32 me_contig;
+
+	/**
+	 * The 0-based position of the first base of the k-mer in the
+	 * contig shifted left by 1, with the lowest bit set if the
+	 * minimizer is on the reverse strand.
+	 */
+	uint32 me_position_strand;
+};
+
+
+/**
+ * A minimizer of a sequence.
+ */
+struct MinimizerSeed
+{
+	/** The hash of the canonical k-mer. */
+	uint64 ms_hash;
+
+	/** The 0-based position of the first base of the k-mer. */
+	uint64 ms_position;
+
+	/** 0 if the forward k-mer is the canonical one, 1 if its reverse complement is. */
+	uint32 ms_strand;
+};
+
+
+/*
+ * An invertible integer hash so that minimizers are spread evenly
+ * rather than favouring low-complexity k-mers such as AAAA...
+ */
+inline uint64 HashMinimizerKmer (uint64 key, uint64 mask)
+{
+	key = (~key + (key << 21)) & mask;
+	key = key ^ (key >> 24);
+	key = ((key + (key << 3)) + (key << 8)) & mask;
+	key = key ^ (key >> 14);
+	key = ((key + (key << 2)) + (key << 4)) & mask;
+	key = key ^ (key >> 28);
+	key = (key + (key << 31)) & mask;
+
+	return key;
+}
+
+
+inline uint32 GetMinimizerBaseCode (char c)
+{
+	switch (c)
+		{
+			case 'A':
+			case 'a':
+				return 0;
+
+			case 'C':
+			case 'c':
+				return 1;
+
+			case 'G':
+			case 'g':
+				return 2;
+
+			case 'T':
+			case 't':
+				return 3;
+
+			default:
+				return 4;
+		}
+}
+
+
+/**
+ * Find the (w,k)-minimizers of a sequence. Each minimizer is the canonical
+ * k-mer with the smallest hash in a window of w consecutive k-mers, and
+ * k-mers containing anything other than A, C, G or T are skipped.
+ *
+ * @param seq_s The sequence.
+ * @param length The number of bases in seq_s.
+ * @param k The length of the k-mers, at most MINIMIZER_MAX_K.
+ * @param w The number of k-mers in each window.
+ * @param callback_r This is called with a const MinimizerSeed &
+ * for each minimizer in order of position.
+ */
+template <typename Callback> void SketchMinimizers (const char *seq_s, size_t length, uint32 k, uint32 w, Callback &callback_r)
+{
+	const uint64 mask = (((uint64) 1) << (2 * k)) - 1;
+	const uint32 shift = 2 * (k - 1);
+	std :: vector <MinimizerSeed> window (w);
+	MinimizerSeed empty;
+	uint64 forward = 0;
+	uint64 reverse = 0;
+	uint32 num_valid_bases = 0;
+	uint32 num_kmers = 0;
+	size_t window_index = 0;
+	size_t min_index = 0;
+	uint64 last_position = (uint64) -1;
+
+	empty.ms_hash = (uint64) -1;
+	empty.ms_position = 0;
+	empty.ms_strand = 0;
+
+	window.assign (w, empty);
+
+	for (size_t i = 0; i < length; ++ i)
+		{
+			const uint32 code = GetMinimizerBaseCode (seq_s [i]);
+			MinimizerSeed seed = empty;
+
+			if (code < 4)
+				{
+					forward = ((forward << 2) | code) & mask;
+					reverse = (reverse >> 2) | (((uint64) (3 - code)) << shift);
+
+					if (++ num_valid_bases < k)
+						{
+							continue;
+						}
+
+					/* Palindromic k-mers have no strand so they are skipped */
+					if (forward != reverse)
+						{
+							seed.ms_strand = (forward < reverse) ? 0 : 1;
+							seed.ms_hash = HashMinimizerKmer (seed.ms_strand ? reverse : forward, mask);
+							seed.ms_position = i + 1 - k;
+						}
+				}
+			else
+				{
+					/* Start again after the ambiguous base */
+					num_valid_bases = 0;
+					num_kmers = 0;
+					window.assign (w, empty);
+					min_index = window_index;
+					continue;
+				}
+
+			if (min_index == window_index)
+				{
+					/* The old minimum is leaving the window so find the new one */
+					window [window_index] = seed;
+
+					for (size_t j = 0; j < w; ++ j)
+						{
+							if (window [j].ms_hash < window [min_index].ms_hash)
+								{
+									min_index = j;
+								}
+						}
+				}
+			else
+				{
+					window [window_index] = seed;
+
+					if (seed.ms_hash <= window [min_index].ms_hash)
+						{
+							min_index = window_index;
+						}
+				}
+
+			if ((++ num_kmers >= w) && (window [min_index].ms_hash != empty.ms_hash) && (window [min_index].ms_position != last_position))
+				{
+					callback_r (window [min_index]);
+					last_position = window [min_index].ms_position;
+				}
+
+			window_index = (window_index + 1) % w;
+		}
+}
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_MINIMIZER_SKETCH_HPP_ */
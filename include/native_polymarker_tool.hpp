@@ -0,0 +1,95 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * native_polymarker_tool.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A PolymarkerTool that runs the pipeline within the
+ * server process rather than spawning polymarker_grassroots.rb.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_NATIVE_POLYMARKER_TOOL_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_NATIVE_POLYMARKER_TOOL_HPP_
+
+#include <atomic>
+
+#include "polymarker_tool.hpp"
+#include "polymarker_pipeline.hpp"
+#include "async_task.h"
+
+
+class POLYMARKER_SERVICE_LOCAL NativePolymarkerTool : public PolymarkerTool
+{
+public:
+	NativePolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p);
+
+	NativePolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p, const json_t *root_p);
+
+	virtual ~NativePolymarkerTool ();
+
+	virtual bool PreRun ();
+
+	virtual bool PostRun ();
+
+	virtual char *GetLog ();
+
+	virtual char *GetResults (PolymarkerFormatter *formatter_p);
+
+	virtual OperationStatus Run ();
+
+	virtual OperationStatus GetStatus (bool update_flag);
+
+	virtual bool ParseParameters (const ParameterSet * const param_set_p);
+
+	virtual PolymarkerToolType GetToolType () const;
+
+	virtual bool RunInDirectory (const char *dir_s, char **error_ss);
+
+	virtual bool Cancel ();
+
+	virtual bool Resume (PolymarkerCheckpoint *checkpoint_p);
+
+	/**
+	 * Run the pipeline and update the status of the ServiceJob. This
+	 * is called from within the AsyncTask.
+	 */
+	void RunPipeline ();
+
+protected:
+	PolymarkerPipelineConfig nt_config;
+
+	Primer3Prefs *nt_prefs_p;
+
+	AsyncTask *nt_task_p;
+
+	/** The error message from the last run, if any. */
+	std :: string nt_error;
+
+	/** Set to stop the pipeline before its next stage. */
+	std :: atomic <bool> nt_cancelled_flag;
+
+	/** The checkpoint of an interrupted run that is being resumed. */
+	PolymarkerCheckpoint *nt_checkpoint_p;
+
+private:
+	void Init (const PolymarkerServiceData *data_p);
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_NATIVE_POLYMARKER_TOOL_HPP_ */
@@ -0,0 +1,237 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * oligo_thermodynamics.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The nearest-neighbour melting temperatures and free energies
+ * of batches of oligos, calculated the same way as primer3 does.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_HPP_
+
+#include <vector>
+
+#include "polymarker_service.h"
+
+
+/**
+ * The reaction conditions, which default to primer3's.
+ */
+struct POLYMARKER_SERVICE_LOCAL OligoConditions
+{
+	/** The concentration of the oligos in nM, primer3's PRIMER_DNA_CONC. */
+	double oc_dna_conc;
+
+	/** The concentration of monovalent cations in mM, primer3's PRIMER_SALT_MONOVALENT. */
+	double oc_monovalent_conc;
+
+	/** The concentration of divalent cations in mM, primer3's PRIMER_SALT_DIVALENT. */
+	double oc_divalent_conc;
+
+	/** The concentration of dNTPs in mM, primer3's PRIMER_DNTP_CONC. */
+	double oc_dntp_conc;
+
+	OligoConditions ();
+};
+
+
+/**
+ * The values calculated for a single oligo.
+ */
+struct POLYMARKER_SERVICE_LOCAL OligoThermodynamics
+{
+	/** The melting temperature in degrees Celsius, primer3's PRIMER_LEFT_0_TM. */
+	double ot_tm;
+
+	/** The free energy of the oligo binding to its complement at 37C in kcal/mol. */
+	double ot_delta_g;
+
+	/**
+	 * The stability of the last 5 bases at the 3' end of the oligo,
+	 * primer3's PRIMER_LEFT_0_END_STABILITY, which is the negative of
+	 * their free energy in kcal/mol.
+	 */
+	double ot_end_stability;
+
+	/**
+	 * Could the values be calculated? They can't be for oligos that have
+	 * any bases other than A, C, G or T or whose lengths are not between
+	 * 2 and OligoBatch::OB_MAX_LENGTH.
+	 */
+	bool ot_valid_flag;
+};
+
+
+/**
+ * A batch of oligos stored by position, in blocks of consecutive oligos,
+ * so that the same stack of every oligo in a block can be looked up at
+ * once.
+ */
+class POLYMARKER_SERVICE_LOCAL OligoBatch
+{
+public:
+	OligoBatch ();
+
+	/**
+	 * Remove all of the oligos, keeping the memory for the next batch.
+	 */
+	void Clear ();
+
+	/**
+	 * Add an oligo to the batch.
+	 *
+	 * @param oligo_s The oligo's bases.
+	 * @param length The number of bases in oligo_s.
+	 * @return The index of the oligo in the batch.
+	 */
+	size_t Add (const char *oligo_s, size_t length);
+
+	/**
+	 * Get the number of oligos in the batch.
+	 *
+	 * @return The number of oligos.
+	 */
+	size_t GetNumOligos () const;
+
+	/**
+	 * The longest oligo that the values can be calculated for. primer3
+	 * itself only uses the nearest-neighbour model for oligos of up to
+	 * 36 bases.
+	 */
+	static const uint32 OB_MAX_LENGTH = 64;
+
+	/** The number of oligos in each block. */
+	static const uint32 OB_BLOCK_SIZE = 32;
+
+private:
+	friend class OligoThermodynamicsCalculator;
+
+	/*
+	 * Stack p of the oligo in lane l of block b is at
+	 * ((b * (OB_MAX_LENGTH - 1) + p) * OB_BLOCK_SIZE + l).
+	 */
+	std :: vector <uint8> ob_stacks;
+
+	/* The number of stacks in the longest oligo of each block */
+	std :: vector <uint8> ob_block_max_stacks;
+
+	/* For each oligo, its length or 0 if it can't be used */
+	std :: vector <uint8> ob_lengths;
+
+	std :: vector <uint8> ob_first_bases;
+
+	std :: vector <uint8> ob_last_bases;
+
+	/* Is each oligo its own reverse complement? */
+	std :: vector <uint8> ob_symmetric;
+};
+
+
+/**
+ * Calculate the melting temperatures and free energies of batches of
+ * oligos using SantaLucia's 1998 unified nearest-neighbour parameters
+ * and salt correction, which are primer3's defaults.
+ *
+ * Each value is the same as primer3's as the stacks are summed as integers
+ * in the same units before the same formula is applied to them. The sums
+ * are done using AVX2 or SSE4.1, whichever is the newest that the CPU
+ * supports.
+ */
+class POLYMARKER_SERVICE_LOCAL OligoThermodynamicsCalculator
+{
+public:
+	/**
+	 * Create an OligoThermodynamicsCalculator.
+	 *
+	 * @param conditions_r The reaction conditions.
+	 */
+	OligoThermodynamicsCalculator (const OligoConditions &conditions_r);
+
+	/**
+	 * Calculate the values for every oligo in a batch. This can be called
+	 * from any number of threads at the same time.
+	 *
+	 * @param batch_r The oligos.
+	 * @param values_r This will be resized to the number of oligos in the
+	 * batch and the values for each will be stored at its index.
+	 */
+	void Calculate (const OligoBatch &batch_r, std :: vector <OligoThermodynamics> &values_r) const;
+
+	/**
+	 * Get the free energy of the most stable hairpin that an oligo can
+	 * fold into, at 37C in kcal/mol.
+	 *
+	 * The hairpin's stem is a run of Watson-Crick pairs, with no bulges or
+	 * internal mismatches, closing a loop of at least 3 bases. Its free
+	 * energy is the sum of the stem's stacks, SantaLucia and Hicks' 2004
+	 * penalty for the loop and the terminal AT penalty for the open end of
+	 * the stem. This is a quick estimate to screen candidates with rather
+	 * than primer3's thermodynamic alignment, which also allows for bulges,
+	 * internal loops and dangling ends.
+	 *
+	 * @param oligo_s The oligo's bases.
+	 * @param length The number of bases in oligo_s.
+	 * @return The free energy, which is negative, or 0 if the oligo has no
+	 * hairpin that is more stable than the unfolded oligo.
+	 */
+	static double GetHairpinDeltaG (const char *oligo_s, size_t length);
+
+	/**
+	 * Get the free energy of the most stable duplex that two oligos can
+	 * form, at 37C in kcal/mol. Passing the same oligo twice gives its
+	 * self dimer.
+	 *
+	 * The duplex is the most stable run of Watson-Crick pairs in any
+	 * ungapped antiparallel alignment of the oligos. Its free energy is
+	 * worked out in the same way as OligoThermodynamics::ot_delta_g, so
+	 * an oligo paired with its own reverse complement gives the same value.
+	 * Like GetHairpinDeltaG (), this is an estimate for screening
+	 * candidates rather than primer3's thermodynamic alignment.
+	 *
+	 * @param oligo_a_s The first oligo's bases.
+	 * @param length_a The number of bases in oligo_a_s.
+	 * @param oligo_b_s The second oligo's bases.
+	 * @param length_b The number of bases in oligo_b_s.
+	 * @return The free energy, which is negative, or 0 if the oligos have
+	 * no duplex that is more stable than the separate oligos.
+	 */
+	static double GetDimerDeltaG (const char *oligo_a_s, size_t length_a, const char *oligo_b_s, size_t length_b);
+
+	/**
+	 * Get the name of the instruction set that the stacks are summed with.
+	 *
+	 * @return The name, e.g. "avx2".
+	 */
+	static const char *GetKernelName ();
+
+private:
+	/* The salt correction to the entropy of each stack in cal/K/mol */
+	double otc_salt_correction;
+
+	/* R ln (C / 4), where C is the concentration of the oligos in M */
+	double otc_concentration_term;
+
+	/* R ln (C), which is used for oligos that are their own reverse complement */
+	double otc_symmetric_concentration_term;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_HPP_ */
@@ -0,0 +1,145 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * oligo_thermodynamics_kernel.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The pass that sums the nearest-neighbour stacks of a batch of
+ * oligos, written once against a small set of vector operations so that
+ * it can be compiled for each instruction set that is chosen between at
+ * run time.
+ *
+ * This is included by translation units that are compiled for different
+ * instruction sets, so it must not use anything from the standard library
+ * that could be instantiated in one of them and then shared with the others.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_KERNEL_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_KERNEL_HPP_
+
+#include "typedefs.h"
+
+
+/**
+ * The code of a stack past the end of an oligo. As it has its top bit
+ * set, a byte shuffle looks it up as 0.
+ */
+#define NN_STACK_PADDING (0x80)
+
+/** The number of different stacks, each coded as 4 * first base + second base. */
+#define NN_NUM_STACKS (16)
+
+
+/**
+ * The stacks of a batch of oligos and the arrays that their sums are
+ * written to.
+ *
+ * The stacks are stored by position so that a vector of them holds the
+ * same stack of consecutive oligos, which are then looked up and summed
+ * together. Each table holds the amount that each stack is above the
+ * smallest value in the table so that it fits in a byte and the sums of
+ * oligos of up to 255 bases fit in 16 bits.
+ */
+struct NearestNeighbourInput
+{
+	/**
+	 * The code of stack p of oligo i is at (p * nni_stride + i), with
+	 * NN_STACK_PADDING for the stacks past the end of each oligo and
+	 * for the oligos past nni_num_oligos up to nni_stride.
+	 */
+	const uint8 *nni_stacks_p;
+
+	/** The number of oligos, rounded up to a multiple of the widest vector. */
+	uint32 nni_num_oligos;
+
+	uint32 nni_stride;
+
+	/** The number of stacks in the longest oligo. */
+	uint32 nni_max_stacks;
+
+	const uint8 *nni_enthalpy_table_p;
+
+	const uint8 *nni_entropy_table_p;
+
+	const uint8 *nni_free_energy_table_p;
+
+	/** The sums for each oligo, each of which must have nni_stride elements. */
+	uint16 *nni_enthalpy_sums_p;
+
+	uint16 *nni_entropy_sums_p;
+
+	uint16 *nni_free_energy_sums_p;
+};
+
+
+template <typename Ops> void SumNearestNeighbourKernel (const NearestNeighbourInput *input_p)
+{
+	typedef typename Ops :: Table Table;
+	typedef typename Ops :: Codes Codes;
+	typedef typename Ops :: Sums Sums;
+
+	const Table enthalpy_table = Ops :: LoadTable (input_p -> nni_enthalpy_table_p);
+	const Table entropy_table = Ops :: LoadTable (input_p -> nni_entropy_table_p);
+	const Table free_energy_table = Ops :: LoadTable (input_p -> nni_free_energy_table_p);
+
+	for (uint32 i = 0; i < input_p -> nni_num_oligos; i += Ops :: WIDTH)
+		{
+			const uint8 *stacks_p = input_p -> nni_stacks_p + i;
+			Sums enthalpy_low = Ops :: Zero ();
+			Sums enthalpy_high = Ops :: Zero ();
+			Sums entropy_low = Ops :: Zero ();
+			Sums entropy_high = Ops :: Zero ();
+			Sums free_energy_low = Ops :: Zero ();
+			Sums free_energy_high = Ops :: Zero ();
+
+			for (uint32 p = 0; p < input_p -> nni_max_stacks; ++ p, stacks_p += input_p -> nni_stride)
+				{
+					const Codes codes = Ops :: LoadCodes (stacks_p);
+
+					Ops :: Accumulate (Ops :: Lookup (enthalpy_table, codes), enthalpy_low, enthalpy_high);
+					Ops :: Accumulate (Ops :: Lookup (entropy_table, codes), entropy_low, entropy_high);
+					Ops :: Accumulate (Ops :: Lookup (free_energy_table, codes), free_energy_low, free_energy_high);
+				}
+
+			Ops :: StoreSums (input_p -> nni_enthalpy_sums_p + i, enthalpy_low, enthalpy_high);
+			Ops :: StoreSums (input_p -> nni_entropy_sums_p + i, entropy_low, entropy_high);
+			Ops :: StoreSums (input_p -> nni_free_energy_sums_p + i, free_energy_low, free_energy_high);
+		}
+}
+
+
+#if defined (__x86_64__) || defined (__i386__)
+
+/** Are there vector versions of the summing pass for this platform? */
+#define NN_HAVE_X86_KERNELS (1)
+
+/**
+ * The summing pass using SSE4.1, which does 16 oligos at a time.
+ */
+void SumNearestNeighbourSSE41 (const NearestNeighbourInput *input_p);
+
+/**
+ * The summing pass using AVX2, which does 32 oligos at a time.
+ */
+void SumNearestNeighbourAVX2 (const NearestNeighbourInput *input_p);
+
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_OLIGO_THERMODYNAMICS_KERNEL_HPP_ */
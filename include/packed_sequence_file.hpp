@@ -0,0 +1,173 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * packed_sequence_file.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Random access to the sequences of a genome stored with
+ * 2 bits per base.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FILE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FILE_HPP_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "polymarker_service.h"
+#include "packed_sequence_format.h"
+#include "fasta_file.hpp"
+
+
+/**
+ * A packed sequence file, as written by polymarker_pack_fasta, that
+ * allows regions of any contig to be fetched.
+ *
+ * The file is memory-mapped read-only and, as it is a quarter of the
+ * size of the fasta file that it was built from, a whole genome can be
+ * kept in memory. Any soft-masking in the fasta file is not kept so all
+ * of the bases are returned in upper case and any base other than A, C,
+ * G or T is returned as N.
+ */
+class POLYMARKER_SERVICE_LOCAL PackedSequenceFile
+{
+public:
+	/**
+	 * Create a PackedSequenceFile.
+	 *
+	 * @param filename_s The packed sequence file to open.
+	 */
+	PackedSequenceFile (const char *filename_s);
+
+	~PackedSequenceFile ();
+
+	/**
+	 * Map the file and check that its contents are valid.
+	 *
+	 * @return <code>true</code> if the file was loaded successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Load ();
+
+	/**
+	 * Get the entry in the contig offset table for a given contig.
+	 *
+	 * @param contig_s The name of the contig.
+	 * @return The entry or <code>0</code> if the contig is not in the file.
+	 */
+	const PackedContig *GetContig (const char *contig_s) const;
+
+	/**
+	 * Get a view of a region of a contig without copying its bases.
+	 *
+	 * @param contig_s The name of the contig.
+	 * @param start The 0-based position of the first base to get.
+	 * @param end The 0-based position one past the last base to get. This
+	 * is clipped to the length of the contig.
+	 * @param region_r The FastaRegion to set.
+	 * @return <code>true</code> if the region was set successfully,
+	 * <code>false</code> if the contig is not in the file.
+	 */
+	bool GetRegion (const char *contig_s, uint64 start, uint64 end, FastaRegion &region_r) const;
+
+	/**
+	 * Get the number of contigs in the file.
+	 *
+	 * @return The number of contigs.
+	 */
+	size_t GetNumContigs () const;
+
+	/**
+	 * Get the name of a contig.
+	 *
+	 * @param index The index of the contig, in the order that they are in the file.
+	 * @return The name of the contig.
+	 */
+	const char *GetContigName (size_t index) const;
+
+	/**
+	 * Get the number of bases in a contig.
+	 *
+	 * @param index The index of the contig, in the order that they are in the file.
+	 * @return The number of bases.
+	 */
+	uint64 GetContigLength (size_t index) const;
+
+	/**
+	 * Get the filename of the underlying packed sequence file.
+	 *
+	 * @return The filename.
+	 */
+	const char *GetFilename () const;
+
+	/**
+	 * Get the loaded PackedSequenceFile for a given file that is shared by
+	 * the whole process. The first call for each file maps it, any later
+	 * calls return the same PackedSequenceFile.
+	 *
+	 * @param filename_s The packed sequence file.
+	 * @return The PackedSequenceFile or an empty pointer if it could not be loaded.
+	 */
+	static std :: shared_ptr <const PackedSequenceFile> GetShared (const char *filename_s);
+
+private:
+	std :: string psf_filename;
+
+	const uint8 *psf_data_p;
+
+	size_t psf_data_size;
+
+	const PackedSequenceHeader *psf_header_p;
+
+	const PackedContig *psf_contigs_p;
+
+	const PackedNRun *psf_n_runs_p;
+
+	std :: unordered_map <std :: string, size_t> psf_contigs_map;
+
+	bool CheckLayout ();
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load a packed sequence file into the PackedSequenceFiles shared by the
+ * whole process so that jobs against it do not need to load it themselves.
+ *
+ * This is simply a C-wrapper function around PackedSequenceFile::GetShared().
+ *
+ * @param filename_s The packed sequence file.
+ * @return <code>true</code> if the file is loaded, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool LoadSharedPackedSequenceFile (const char *filename_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FILE_HPP_ */
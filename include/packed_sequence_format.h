@@ -0,0 +1,129 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * packed_sequence_format.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The on-disk layout of a packed sequence file which stores
+ * each base of a genome in 2 bits.
+ *
+ * A packed sequence file is laid out as
+ *
+ * - A PackedSequenceHeader.
+ * - The bases of each contig, 4 to a byte with the first base in the
+ * highest 2 bits and each contig starting on a new byte.
+ * - The PackedNRuns of every contig, each contig's runs in order.
+ * - A PackedContig for each contig.
+ * - The NUL-terminated names of the contigs.
+ *
+ * All of the values are in the byte order of the machine that wrote
+ * the file and each block after the bases starts on an 8-byte boundary.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FORMAT_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FORMAT_H_
+
+#include "typedefs.h"
+
+
+/** The bytes at the start of every packed sequence file. */
+#define PACKED_SEQUENCE_MAGIC_S "PMKPACK"
+
+/** The current version of the format. */
+#define PACKED_SEQUENCE_VERSION (1)
+
+/** The bases that each 2-bit code stands for. */
+#define PACKED_SEQUENCE_BASES_S "ACGT"
+
+
+/**
+ * The header at the start of a packed sequence file.
+ */
+typedef struct PackedSequenceHeader
+{
+	/** This is PACKED_SEQUENCE_MAGIC_S including its terminating NUL. */
+	char psh_magic_s [8];
+
+	/** The version of the format. */
+	uint32 psh_version;
+
+	/** Padding to keep the offsets aligned. */
+	uint32 psh_reserved;
+
+	/** The number of contigs. */
+	uint64 psh_num_contigs;
+
+	/** The offset of the packed bases from the start of the file. */
+	uint64 psh_bases_offset;
+
+	/** The offset of the PackedNRuns from the start of the file. */
+	uint64 psh_n_runs_offset;
+
+	/** The total number of PackedNRuns. */
+	uint64 psh_num_n_runs;
+
+	/** The offset of the PackedContigs from the start of the file. */
+	uint64 psh_contigs_offset;
+
+	/** The offset of the contig names from the start of the file. */
+	uint64 psh_names_offset;
+
+	/** The size of the whole file, used to detect truncated files. */
+	uint64 psh_file_size;
+} PackedSequenceHeader;
+
+
+/**
+ * A run of bases that are not one of A, C, G or T. These are
+ * stored as A in the packed bases and returned as N.
+ */
+typedef struct PackedNRun
+{
+	/** The 0-based position of the first base of the run within its contig. */
+	uint64 pnr_start;
+
+	/** The number of bases in the run. */
+	uint64 pnr_length;
+} PackedNRun;
+
+
+/**
+ * An entry in the contig offset table.
+ */
+typedef struct PackedContig
+{
+	/** The offset of the contig's name from the start of the names. */
+	uint64 pc_name_offset;
+
+	/** The number of bases in the contig. */
+	uint64 pc_length;
+
+	/** The offset of the contig's first base from the start of the packed bases. */
+	uint64 pc_bases_offset;
+
+	/** The index of the contig's first PackedNRun. */
+	uint64 pc_first_n_run;
+
+	/** The number of PackedNRuns that the contig has. */
+	uint64 pc_num_n_runs;
+} PackedContig;
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_PACKED_SEQUENCE_FORMAT_H_ */
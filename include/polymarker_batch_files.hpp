@@ -0,0 +1,114 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_batch_files.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Merge the markers of the jobs in a batch into a single
+ * markers_list and split the results of the batch's run back to each job.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCH_FILES_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCH_FILES_HPP_
+
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+
+
+/**
+ * The files of a batched pipeline run. Each marker name in the batch's
+ * markers_list is prefixed by the index of its job within the batch so
+ * that the rows of the results can be given back to the job that they
+ * came from.
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerBatchFiles
+{
+public:
+	/**
+	 * Create the PolymarkerBatchFiles for a batch.
+	 *
+	 * @param batch_dir_s The directory that the batch will be run in.
+	 */
+	PolymarkerBatchFiles (const char *batch_dir_s);
+
+	/**
+	 * Add the next job of the batch.
+	 *
+	 * @param job_dir_s The job's directory, which contains its markers_list
+	 * and where its share of the results will be written.
+	 */
+	void AddJobDirectory (const char *job_dir_s);
+
+	/**
+	 * Merge the markers_list of each job into the batch directory's.
+	 *
+	 * @return <code>true</code> if the markers were written successfully, <code>
+	 * false</code> otherwise.
+	 */
+	bool WriteMarkers () const;
+
+	/**
+	 * Give each job the rows of primers.csv, and of primers_to_order.csv if
+	 * the run wrote one, and the sections of the exons file for its own
+	 * markers, with the batch prefixes removed. The batch's status.txt is
+	 * appended to each job's.
+	 *
+	 * @return <code>true</code> if the results were split successfully, <code>
+	 * false</code> otherwise.
+	 */
+	bool SplitResults () const;
+
+	/** The prefix used for the marker names of the job at a given index in a batch. */
+	static std :: string GetMarkerPrefix (size_t index);
+
+	/**
+	 * Read the non-empty lines of a file.
+	 *
+	 * @param dir_s The directory containing the file.
+	 * @param filename_s The name of the file.
+	 * @param lines_r The vector that the lines will be appended to.
+	 * @return <code>true</code> if the file was read, <code>false</code> otherwise.
+	 */
+	static bool ReadLines (const char *dir_s, const char *filename_s, std :: vector <std :: string> &lines_r);
+
+	/**
+	 * Split a markers_list line into its gene, optional chromosome
+	 * and sequence.
+	 *
+	 * @param line_r The line to split.
+	 * @param fields_r The vector that the fields will be appended to.
+	 */
+	static void SplitMarkerLine (const std :: string &line_r, std :: vector <std :: string> &fields_r);
+
+	static const char * const PBF_MARKERS_LIST_S;
+	static const char * const PBF_PRIMERS_S;
+	static const char * const PBF_PRIMERS_TO_ORDER_S;
+	static const char * const PBF_EXONS_S;
+	static const char * const PBF_STATUS_S;
+
+private:
+	std :: string pbf_batch_dir;
+
+	std :: vector <std :: string> pbf_job_dirs;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCH_FILES_HPP_ */
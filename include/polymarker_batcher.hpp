@@ -0,0 +1,250 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_batcher.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Merge the markers from PolymarkerServiceJobs that arrive close
+ * together into a single pipeline run.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCHER_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCHER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "polymarker_tool.hpp"
+#include "async_task.h"
+
+
+/**
+ * A set of PolymarkerServiceJobs that will be run together.
+ */
+struct POLYMARKER_SERVICE_LOCAL PolymarkerBatch
+{
+	/** The key shared by all of the jobs in this batch. */
+	std :: string pb_key;
+
+	/** The jobs in this batch. */
+	std :: vector <PolymarkerServiceJob *> pb_jobs;
+
+	/** When the batch stops accepting jobs if it has not filled up before then. */
+	std :: chrono :: steady_clock :: time_point pb_deadline;
+
+	/** Has the batch stopped accepting jobs? */
+	bool pb_closed_flag;
+
+	/** Has the batch finished running, or failed to start, so that it can be freed? */
+	bool pb_finished_flag;
+
+	/** Has the service that runs the batch been freed before the batch started? */
+	bool pb_released_flag;
+
+	/** The task that runs the batch once it has been given a slot to run in. */
+	AsyncTask *pb_task_p;
+
+	/**
+	 * The PolymarkerServiceData of the first job's service, whose
+	 * AsyncTasksManager, working directory and PolymarkerScheduler the
+	 * batch uses.
+	 */
+	const PolymarkerServiceData *pb_data_p;
+
+	/**
+	 * For each job from a different service to pb_data_p's, a task in the
+	 * AsyncTasksManager of the job's service that is run once the job has
+	 * been completed, so that the service is not freed before then. The
+	 * entries for the other jobs are <code>NULL</code>.
+	 */
+	std :: vector <AsyncTask *> pb_hold_tasks;
+
+	/** The PolymarkerBatcher that this batch belongs to. */
+	class PolymarkerBatcher *pb_batcher_p;
+};
+
+
+/**
+ * The PolymarkerBatcher collects jobs that use the same PolymarkerSequence,
+ * aligner and Primer3Prefs. After the batching window has elapsed, or the
+ * batch is full, their markers are merged into one markers_list and the
+ * pipeline is run once. The results are then split back to each job by
+ * marker.
+ *
+ * A single timer thread closes the batches whose windows have elapsed, so
+ * a batch only uses a thread from the AsyncTasksManager once it runs.
+ *
+ * Each request is given its own PolymarkerService, so there is a single
+ * PolymarkerBatcher for the process which all of them share, see
+ * GetSharedPolymarkerBatcher ().
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerBatcher
+{
+public:
+	/**
+	 * Create a PolymarkerBatcher.
+	 *
+	 * @param window_ms The number of milliseconds to wait for other jobs
+	 * to join a batch after its first job arrives.
+	 * @param max_batch_size The maximum number of jobs in a batch.
+	 */
+	PolymarkerBatcher (uint32 window_ms, uint32 max_batch_size);
+
+	~PolymarkerBatcher ();
+
+	/**
+	 * Add a job, whose parameters have already been parsed, to a batch.
+	 *
+	 * @param job_p The PolymarkerServiceJob to add.
+	 * @param param_set_p The ParameterSet that the job was created from.
+	 * @return <code>true</code> if the job was added successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool AddJob (PolymarkerServiceJob *job_p, const ParameterSet *param_set_p);
+
+	/**
+	 * Run a batch and complete its jobs. This is called from within the
+	 * batch's AsyncTask.
+	 *
+	 * @param batch_p The PolymarkerBatch to run.
+	 */
+	void RunBatch (PolymarkerBatch *batch_p);
+
+	/**
+	 * Start the AsyncTask of a closed batch.
+	 *
+	 * @param batch_p The PolymarkerBatch to start.
+	 * @return <code>true</code> if the batch was started, <code>false</code> if
+	 * the batcher or the batch's service has been stopped or the task could
+	 * not be run. All of the batch's jobs have been failed in that case.
+	 */
+	bool StartBatch (PolymarkerBatch *batch_p);
+
+	/**
+	 * Stop the timer thread and fail the jobs of any batches that are still
+	 * open. Batches that are waiting for the PolymarkerScheduler will fail when
+	 * they are given a slot. This is called when the last service using the
+	 * PolymarkerBatcher is freed and calling it more than once has no effect.
+	 */
+	void Stop ();
+
+	/**
+	 * Stop using a service's PolymarkerServiceData. Its batches that have
+	 * not started will fail rather than run and its jobs' hold tasks are
+	 * freed. This must be called before the service's AsyncTasksManager is
+	 * freed.
+	 *
+	 * @param data_p The PolymarkerServiceData that is being freed.
+	 */
+	void ReleaseServiceData (const PolymarkerServiceData *data_p);
+
+private:
+	uint32 pb_window_ms;
+
+	uint32 pb_max_batch_size;
+
+	std :: mutex pb_mutex;
+
+	/** Signalled when a batch is opened or the batcher is stopped. */
+	std :: condition_variable pb_timer_cond;
+
+	/** The thread that closes the batches whose windows have elapsed. */
+	std :: thread pb_timer_thread;
+
+	/** Has Stop () been called? */
+	bool pb_stopped_flag;
+
+	/** The batches that are still accepting jobs, by their key. */
+	std :: map <std :: string, PolymarkerBatch *> pb_open_batches;
+
+	/** All of the batches that have not been freed yet. */
+	std :: list <PolymarkerBatch *> pb_batches;
+
+	void RunTimer ();
+
+	void DispatchBatch (PolymarkerBatch *batch_p);
+
+	void FailBatch (PolymarkerBatch *batch_p, const char *error_s);
+
+	bool GetBatchKey (PolymarkerServiceJob *job_p, const ParameterSet *param_set_p, std :: string &key_r) const;
+
+	void RunHoldTasks (PolymarkerBatch *batch_p);
+
+	void ReapFinishedBatches ();
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the PolymarkerBatcher that is shared by all of the PolymarkerServices
+ * in this process, creating it from the service configuration the first
+ * time if batching has been enabled.
+ *
+ * Each successful call must be matched by a call to ReleaseSharedPolymarkerBatcher ().
+ *
+ * @param data_p The PolymarkerServiceData.
+ * @return The shared PolymarkerBatcher or <code>NULL</code> if batching is
+ * not enabled or upon error.
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerBatcher *GetSharedPolymarkerBatcher (const PolymarkerServiceData *data_p);
+
+
+/**
+ * Stop a service from using the shared PolymarkerBatcher. Once no services
+ * are using it, it is stopped and freed.
+ *
+ * This must be called before the service's AsyncTasksManager is freed.
+ *
+ * @param batcher_p The PolymarkerBatcher from GetSharedPolymarkerBatcher ().
+ * @param data_p The PolymarkerServiceData that is being freed.
+ */
+POLYMARKER_SERVICE_LOCAL void ReleaseSharedPolymarkerBatcher (PolymarkerBatcher *batcher_p, const PolymarkerServiceData *data_p);
+
+
+/**
+ * Add a PolymarkerServiceJob to a PolymarkerBatcher.
+ *
+ * This is simply a C-wrapper function around PolymarkerBatcher::AddJob().
+ *
+ * @param batcher_p The PolymarkerBatcher to use.
+ * @param job_p The PolymarkerServiceJob to add.
+ * @param param_set_p The ParameterSet that the job was created from.
+ * @return <code>true</code> if the job was added successfully, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool AddJobToPolymarkerBatcher (PolymarkerBatcher *batcher_p, PolymarkerServiceJob *job_p, const ParameterSet *param_set_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_BATCHER_HPP_ */
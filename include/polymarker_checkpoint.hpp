@@ -0,0 +1,154 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_checkpoint.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The manifest of the pipeline stages that have been completed
+ * in a job directory so that an interrupted job can be resumed.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_CHECKPOINT_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_CHECKPOINT_HPP_
+
+#include <string>
+
+#include "polymarker_service.h"
+#include "primer3_prefs.h"
+#include "json_util.h"
+
+
+/**
+ * A checkpoint.json in a job directory. Each completed stage records
+ * the file that it wrote along with its size so that a file that was
+ * only partly written when the job was interrupted is not reused.
+ *
+ * Whichever process is running the job holds a lock on checkpoint.lock
+ * for the whole run. As the lock is released when that process exits,
+ * a job whose lock can be taken is no longer running.
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerCheckpoint
+{
+public:
+	/**
+	 * Create a PolymarkerCheckpoint for a job directory. Nothing is
+	 * read or written until Load or Start is called.
+	 *
+	 * @param job_dir_s The job directory.
+	 */
+	PolymarkerCheckpoint (const char *job_dir_s);
+
+	~PolymarkerCheckpoint ();
+
+	/**
+	 * Take the lock that shows that the job is being run.
+	 *
+	 * @return <code>true</code> if the lock was taken, <code>false</code>
+	 * if another run of the job holds it or upon error.
+	 */
+	bool Lock ();
+
+	/**
+	 * Read an existing checkpoint.json.
+	 *
+	 * @return <code>true</code> if the manifest was read successfully,
+	 * <code>false</code> if it does not exist or is invalid.
+	 */
+	bool Load ();
+
+	/**
+	 * Start a new manifest, discarding any existing stages.
+	 *
+	 * @param fasta_filename_s The database that the job runs against.
+	 * @param prefs_p The primer3 settings that the job runs with.
+	 * @return <code>true</code> if the manifest was written successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Start (const char *fasta_filename_s, const Primer3Prefs *prefs_p);
+
+	/**
+	 * Check whether a stage has been completed and its file is intact.
+	 *
+	 * @param stage_s The stage to check.
+	 * @return <code>true</code> if the stage's file can be reused.
+	 */
+	bool IsStageComplete (const char *stage_s) const;
+
+	/**
+	 * Record that a stage has written its file.
+	 *
+	 * @param stage_s The stage that has completed.
+	 * @param filename_s The full path of the file written by the stage.
+	 * @return <code>true</code> if the manifest was updated successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool CompleteStage (const char *stage_s, const char *filename_s);
+
+	/**
+	 * Record that the run has ended, whether or not it succeeded, so that
+	 * it will not be resumed.
+	 *
+	 * @return <code>true</code> if the manifest was updated successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Finish ();
+
+	/**
+	 * Has the run that this manifest belongs to ended?
+	 *
+	 * @return <code>true</code> if the run has ended.
+	 */
+	bool IsFinished () const;
+
+	/**
+	 * Get the database that the job runs against.
+	 *
+	 * @return The fasta filename or <code>0</code> if it is not known.
+	 */
+	const char *GetFastaFilename () const;
+
+	/**
+	 * Copy the primer3 settings that the job was started with.
+	 *
+	 * @param prefs_p The Primer3Prefs to update.
+	 */
+	void GetPrimer3Prefs (Primer3Prefs *prefs_p) const;
+
+	static const char * const PC_SEQUENCES_S;
+	static const char * const PC_ALIGNMENT_S;
+	static const char * const PC_PRIMER3_INPUT_S;
+	static const char * const PC_PRIMER3_OUTPUT_S;
+
+private:
+	std :: string pc_job_dir;
+
+	json_t *pc_manifest_p;
+
+	int pc_lock_fd;
+
+	static const char * const PC_FILENAME_S;
+	static const char * const PC_LOCK_FILENAME_S;
+
+	bool Save ();
+
+	std :: string GetFilename (const char *filename_s) const;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_CHECKPOINT_HPP_ */
@@ -0,0 +1,161 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * polymarker_job_limits.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The time and resource limits for the processes that run
+ * each Polymarker job.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_LIMITS_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_LIMITS_H_
+
+#include <sys/types.h>
+
+#include "polymarker_service.h"
+#include "json_util.h"
+
+
+/**
+ * The limits applied to the process started for each job.
+ */
+typedef struct PolymarkerJobLimits
+{
+	/**
+	 * The number of seconds that a job can run for before it is stopped.
+	 * If this is 0, there is no limit.
+	 */
+	uint32 pjl_wall_clock_limit;
+
+	/**
+	 * The number of seconds of CPU time that a job can use, summed over
+	 * all of its processes, before it is stopped. This is measured from
+	 * the usage in the job's cgroup, so if cgroups are not being used
+	 * it can only be applied to each of the job's processes separately
+	 * as their RLIMIT_CPU. If this is 0, there is no limit.
+	 */
+	uint32 pjl_cpu_limit;
+
+	/**
+	 * A cgroup v2 directory, delegated to the user running the service,
+	 * in which a child cgroup is created for each job. If this is
+	 * <code>NULL</code>, cgroups are not used.
+	 */
+	const char *pjl_cgroup_dir_s;
+
+	/** The value to write to each job's memory.max or <code>NULL</code> to leave it unset. */
+	const char *pjl_memory_max_s;
+
+	/** The value to write to each job's cpu.max or <code>NULL</code> to leave it unset. */
+	const char *pjl_cpu_max_s;
+
+} PolymarkerJobLimits;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Create the PolymarkerJobLimits from the service configuration.
+ *
+ * @param config_p The service configuration.
+ * @return The newly-allocated PolymarkerJobLimits or <code>NULL</code> if no
+ * limits have been configured or upon error.
+ * @memberof PolymarkerJobLimits
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerJobLimits *AllocatePolymarkerJobLimits (const json_t *config_p);
+
+
+/**
+ * Free a PolymarkerJobLimits.
+ *
+ * @param limits_p The PolymarkerJobLimits to free.
+ * @memberof PolymarkerJobLimits
+ */
+POLYMARKER_SERVICE_LOCAL void FreePolymarkerJobLimits (PolymarkerJobLimits *limits_p);
+
+
+/**
+ * Create the cgroup for a job and apply the configured memory and CPU
+ * caps to it.
+ *
+ * @param limits_p The PolymarkerJobLimits.
+ * @param name_s The name of the cgroup, e.g. the job's uuid.
+ * @return The newly-allocated path of the cgroup which should be freed
+ * with FreeCopiedString, or <code>NULL</code> if cgroups are not being
+ * used or upon error.
+ */
+POLYMARKER_SERVICE_LOCAL char *CreatePolymarkerJobCgroup (const PolymarkerJobLimits *limits_p, const char *name_s);
+
+
+/**
+ * Kill anything left in a job's cgroup and remove it.
+ *
+ * @param cgroup_dir_s The path returned by CreatePolymarkerJobCgroup.
+ */
+POLYMARKER_SERVICE_LOCAL void RemovePolymarkerJobCgroup (const char *cgroup_dir_s);
+
+
+/**
+ * Get the CPU time used so far by all of the processes in a job's cgroup.
+ *
+ * @param cgroup_dir_s The path returned by CreatePolymarkerJobCgroup.
+ * @param usage_usec_p Where the number of microseconds of CPU time will be stored.
+ * @return <code>true</code> if the usage was read from the cgroup's cpu.stat,
+ * <code>false</code> otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool GetPolymarkerJobCgroupCpuUsage (const char *cgroup_dir_s, uint64 *usage_usec_p);
+
+
+/**
+ * Start a shell command as the leader of a new process group with the
+ * given limits applied.
+ *
+ * @param command_s The command line to run.
+ * @param limits_p The PolymarkerJobLimits to apply or <code>NULL</code> if there are none.
+ * @param cgroup_dir_s The cgroup to run the process in or <code>NULL</code>. If this
+ * is <code>NULL</code>, the CPU limit is applied to each process as its RLIMIT_CPU,
+ * otherwise it is up to the caller to check the cgroup's usage with
+ * GetPolymarkerJobCgroupCpuUsage.
+ * @return The process id of the new process or -1 upon error.
+ */
+POLYMARKER_SERVICE_LOCAL pid_t SpawnPolymarkerProcess (const char *command_s, const PolymarkerJobLimits *limits_p, const char *cgroup_dir_s);
+
+
+/**
+ * Send a signal to a process started by SpawnPolymarkerProcess and any
+ * processes that it has started.
+ *
+ * @param pid The process id returned by SpawnPolymarkerProcess.
+ * @param sig The signal to send.
+ */
+POLYMARKER_SERVICE_LOCAL void SignalPolymarkerProcess (pid_t pid, int sig);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_LIMITS_H_ */
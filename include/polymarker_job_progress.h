@@ -0,0 +1,202 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * polymarker_job_progress.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Track how far a Polymarker run has got from the stages that
+ * it writes to its status.txt.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_PROGRESS_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_PROGRESS_H_
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "polymarker_service.h"
+#include "json_util.h"
+
+
+/**
+ * The stages of a Polymarker run, in the order that they
+ * are written to status.txt.
+ */
+typedef enum PolymarkerJobStage
+{
+	/** Nothing has been written to status.txt yet. */
+	PJS_NOT_STARTED,
+
+	/** "Loading Reference" */
+	PJS_LOADING_REFERENCE,
+
+	/** "Reading SNPs" */
+	PJS_READING_SNPS,
+
+	/** "Writing sequences to align" */
+	PJS_WRITING_SEQUENCES,
+
+	/** "Searching markers in genome" and loading the fasta indices. */
+	PJS_SEARCHING_MARKERS,
+
+	/** "Reading best alignment on each chromosome" */
+	PJS_READING_ALIGNMENTS,
+
+	/** "Running primer3" and "Ran primer3" */
+	PJS_RUNNING_PRIMER3,
+
+	/** "Selecting best primers" */
+	PJS_SELECTING_PRIMERS,
+
+	/** "DONE" */
+	PJS_DONE,
+
+	/** "ERROR" followed by the error message. */
+	PJS_ERROR,
+
+	/** The number of stages. */
+	PJS_NUM_STAGES
+} PolymarkerJobStage;
+
+
+/**
+ * The progress of a Polymarker run. status.txt is read from where the
+ * previous read stopped so each line is only ever parsed once.
+ */
+typedef struct PolymarkerJobProgress
+{
+	/** The status.txt being read or <code>NULL</code> if it is not known yet. */
+	char *pjp_status_filename_s;
+
+	/** How much of status.txt has already been read. */
+	off_t pjp_offset;
+
+	/** The most recent stage. */
+	PolymarkerJobStage pjp_stage;
+
+	/** When each stage started or 0 if it has not been reached. */
+	time_t pjp_stage_times [PJS_NUM_STAGES];
+
+	/** The message from an ERROR line, if any. */
+	char *pjp_error_s;
+
+	/** The lock so that the progress can be updated from any thread. */
+	pthread_mutex_t pjp_mutex;
+} PolymarkerJobProgress;
+
+
+/**
+ * The callback function called for each complete line read by
+ * ReadNewPolymarkerStatusLines.
+ *
+ * @param data_p The custom data passed to ReadNewPolymarkerStatusLines.
+ * @param line_s The line without its terminating newline.
+ */
+typedef void (*PolymarkerStatusLineCallback) (void *data_p, const char *line_s);
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Allocate a PolymarkerJobProgress.
+ *
+ * @return The new PolymarkerJobProgress or <code>NULL</code> upon error.
+ * @memberof PolymarkerJobProgress
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerJobProgress *AllocatePolymarkerJobProgress (void);
+
+
+/**
+ * Free a PolymarkerJobProgress.
+ *
+ * @param progress_p The PolymarkerJobProgress to free.
+ * @memberof PolymarkerJobProgress
+ */
+POLYMARKER_SERVICE_LOCAL void FreePolymarkerJobProgress (PolymarkerJobProgress *progress_p);
+
+
+/**
+ * Read any lines that have been added to a job's status.txt since
+ * it was last read.
+ *
+ * @param progress_p The PolymarkerJobProgress to update.
+ * @param job_dir_s The job directory containing status.txt.
+ * @return <code>true</code> if the progress is up to date, <code>false</code>
+ * upon error.
+ * @memberof PolymarkerJobProgress
+ */
+POLYMARKER_SERVICE_LOCAL bool UpdatePolymarkerJobProgress (PolymarkerJobProgress *progress_p, const char *job_dir_s);
+
+
+/**
+ * Update the progress from a single status line that has been passed
+ * on by something other than status.txt, such as a worker process or
+ * a watcher of status.txt. A line for an earlier stage than the current
+ * one, e.g. one that UpdatePolymarkerJobProgress has already read, does
+ * not move the progress back.
+ *
+ * @param progress_p The PolymarkerJobProgress to update.
+ * @param line_s The status line, either "<time>,<status>" as in status.txt
+ * or just the status.
+ * @memberof PolymarkerJobProgress
+ */
+POLYMARKER_SERVICE_LOCAL void AddPolymarkerJobStatusLine (PolymarkerJobProgress *progress_p, const char *line_s);
+
+
+/**
+ * Add the current stage, the time spent in each stage so far and the
+ * fraction of the run that has been completed to a JSON object.
+ *
+ * @param progress_p The PolymarkerJobProgress to add.
+ * @param json_p The JSON object to add the progress to.
+ * @return <code>true</code> if the progress was added successfully, <code>false</code>
+ * otherwise.
+ * @memberof PolymarkerJobProgress
+ */
+POLYMARKER_SERVICE_LOCAL bool AddPolymarkerJobProgressToJSON (PolymarkerJobProgress *progress_p, json_t *json_p);
+
+
+/**
+ * Call a function for each complete line that has been appended to a
+ * status file since the given offset. Any partial line at the end of
+ * the file is left until the rest of it has been written.
+ *
+ * @param filename_s The status file.
+ * @param offset_p The offset to start reading from. This is updated to
+ * point after the last complete line.
+ * @param line_fn The function to call for each line.
+ * @param data_p The data to pass to line_fn.
+ * @return <code>true</code> if the file was read or does not exist yet,
+ * <code>false</code> upon error.
+ */
+POLYMARKER_SERVICE_LOCAL bool ReadNewPolymarkerStatusLines (const char *filename_s, off_t *offset_p, PolymarkerStatusLineCallback line_fn, void *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_JOB_PROGRESS_H_ */
@@ -0,0 +1,399 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_pipeline.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The in-process version of the marker list, alignment,
+ * primer3 and KASP selection pipeline that polymarker_grassroots.rb
+ * runs.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PIPELINE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PIPELINE_HPP_
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "polymarker_task_pool.hpp"
+#include "arm_selection.hpp"
+#include "exonerate_parser.hpp"
+#include "minimizer_index.hpp"
+#include "primer3_engine.hpp"
+#include "kasp_selector.hpp"
+#include "primer3_prefs.h"
+
+
+class FastaFile;
+class FastaRegion;
+class PackedSequenceFile;
+class HomoeologIndex;
+class PolymarkerCheckpoint;
+
+
+/**
+ * A marker read from a markers_list file.
+ */
+struct POLYMARKER_SERVICE_LOCAL PolymarkerMarker
+{
+	/** The marker name. */
+	std :: string pm_gene;
+
+	/**
+	 * The target chromosome. This will be empty if the user
+	 * didn't specify one.
+	 */
+	std :: string pm_chromosome;
+
+	/** The sequence with each SNP replaced by its IUPAC ambiguity code. */
+	std :: string pm_template;
+
+	/** The 0-based position of the SNP that the primers are designed for. */
+	uint32 pm_snp_position;
+
+	/** The base of the first allele. */
+	char pm_original;
+
+	/** The base of the second allele. */
+	char pm_snp;
+
+	/** The chromosome of the best hit that the primers are designed against. */
+	std :: string pm_target_chromosome;
+
+	/** The number of contigs that the marker hit. */
+	uint32 pm_total_contigs;
+
+	/** The regions of the hits used to build the mask. */
+	std :: string pm_contig_regions;
+
+	/** Whether the SNP is homoeologous or not. */
+	std :: string pm_snp_type;
+
+	/**
+	 * The mask of informative positions along pm_template. This is empty
+	 * if there were no usable hits for the marker.
+	 */
+	std :: string pm_mask;
+};
+
+
+/**
+ * The values that control how a PolymarkerPipeline runs.
+ */
+struct POLYMARKER_SERVICE_LOCAL PolymarkerPipelineConfig
+{
+	/** The exonerate executable. */
+	std :: string ppc_exonerate_executable;
+
+	/** The exonerate model to use. */
+	std :: string ppc_model;
+
+	/** The primer3_core executable. */
+	std :: string ppc_primer3_executable;
+
+	/** Hits with an identity at or below this are discarded. */
+	double ppc_min_identity;
+
+	/** The number of genomes, e.g. 3 for hexaploid wheat. */
+	uint32 ppc_genomes_count;
+
+	/** Should the sequences of the hit contigs be saved? */
+	bool ppc_extract_found_contigs;
+
+	/**
+	 * When looking markers up in a minimizer index, minimizers that occur
+	 * more than this many times in the genome are ignored.
+	 */
+	uint32 ppc_seed_max_occurrences;
+
+	/** The number of bases added to each end of the windows found in a minimizer index. */
+	uint32 ppc_seed_window_margin;
+
+	/**
+	 * Should the markers found in a minimizer index be aligned against their
+	 * windows with the built-in Smith-Waterman aligner rather than exonerate?
+	 */
+	bool ppc_smith_waterman_flag;
+
+	/**
+	 * For databases without a minimizer index, should the genome be read
+	 * once to find the windows of all of the markers at the same time,
+	 * rather than each marker being aligned against the whole genome?
+	 */
+	bool ppc_batch_search_flag;
+
+	/**
+	 * Should primer3 be called as a library, using the thermodynamic tables
+	 * loaded when the service started, rather than running primer3_core?
+	 * This needs the service to have been built with libprimer3 and
+	 * thermodynamic_parameters_path to be set.
+	 */
+	bool ppc_primer3_library_flag;
+
+	/**
+	 * The number of primer3_core processes that the records of each job
+	 * are split between. If this is greater than 1, primer3 is not called
+	 * as a library.
+	 */
+	uint32 ppc_primer3_threads;
+
+	/**
+	 * Should the primer3 records for which no primer ending at one of
+	 * the forced positions has a melting temperature in primer3's range
+	 * be left out rather than being passed to primer3?
+	 */
+	bool ppc_primer3_prefilter_flag;
+};
+
+
+/**
+ * The steps, and their output files, of the native Polymarker pipeline.
+ *
+ * Each stage writes the same files into the job directory that
+ * polymarker_grassroots.rb does and records its progress to
+ * status.txt in the same format so that the results can be read in
+ * the same way regardless of which PolymarkerTool was used.
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerPipeline
+{
+public:
+	PolymarkerPipeline (const char *job_dir_s, const PolymarkerSequence *seq_p, const PolymarkerPipelineConfig *config_p, const Primer3Prefs *prefs_p);
+
+	~PolymarkerPipeline ();
+
+	/**
+	 * Run all of the stages of the pipeline.
+	 *
+	 * @return <code>true</code> if the pipeline completed successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Run ();
+
+	/**
+	 * Get the error message from a failed run.
+	 *
+	 * @return The error message.
+	 */
+	const char *GetErrorMessage () const;
+
+	/**
+	 * Set the flag that is checked between the stages of the pipeline
+	 * so that a run can be stopped early.
+	 *
+	 * @param cancel_p The flag which is set to <code>true</code> to
+	 * stop the pipeline or <code>0</code> if it can't be cancelled.
+	 */
+	void SetCancelFlag (const std :: atomic <bool> *cancel_p);
+
+	/**
+	 * Set the manifest that each stage is recorded in as it completes.
+	 *
+	 * @param checkpoint_p The PolymarkerCheckpoint to use or <code>0</code>
+	 * to run without one. It must already hold the job's lock.
+	 * @param resume_flag If this is <code>true</code>, the files from the
+	 * stages already recorded in checkpoint_p are reused rather than
+	 * being made again.
+	 */
+	void SetCheckpoint (PolymarkerCheckpoint *checkpoint_p, bool resume_flag);
+
+	/**
+	 * Fill in a PolymarkerPipelineConfig from a service configuration.
+	 *
+	 * @param config_p The PolymarkerPipelineConfig to fill in.
+	 * @param service_config_p The configuration for the Polymarker service.
+	 */
+	static void SetPipelineConfig (PolymarkerPipelineConfig *config_p, const json_t *service_config_p);
+
+	static const char * const PP_MARKERS_LIST_S;
+	static const char * const PP_TO_ALIGN_S;
+	static const char * const PP_CONTIGS_S;
+	static const char * const PP_EXONERATE_S;
+	static const char * const PP_SEEDED_TO_ALIGN_S;
+	static const char * const PP_UNSEEDED_TO_ALIGN_S;
+	static const char * const PP_SEED_WINDOWS_S;
+	static const char * const PP_PRIMER3_INPUT_S;
+	static const char * const PP_PRIMER3_OUTPUT_S;
+	static const char * const PP_EXONS_S;
+	static const char * const PP_PRIMERS_S;
+	static const char * const PP_PRIMERS_TO_ORDER_S;
+	static const char * const PP_STATUS_S;
+
+protected:
+	bool LoadMarkers ();
+
+	bool WriteSequencesToAlign ();
+
+	bool SearchMarkers ();
+
+	bool WritePrimer3Input ();
+
+	bool RunPrimer3 ();
+
+	bool ReadPrimer3Output ();
+
+	bool SelectPrimers ();
+
+	void WriteStatus (const char *status_s);
+
+	bool SetError (const char *message_s);
+
+	bool IsCancelled ();
+
+	bool CanSkipStage (const char *stage_s);
+
+	void CheckRemadeStage (const char *stage_s);
+
+	void CheckpointStage (const char *stage_s, const std :: string &filename_r);
+
+	bool ReadHits (const std :: string &filename_r);
+
+	void AddPrimer3Inputs ();
+
+	void FilterPrimer3Inputs ();
+
+	void UseCachedPrimer3Results ();
+
+	void AddPrimer3Result (Primer3Result &result_r);
+
+	bool WritePrimer3File ();
+
+	bool WritePrimer3Records (const std :: string &filename_r, size_t first_record, size_t last_record) const;
+
+	bool RunPrimer3Process (const std :: string &input_filename_r, const std :: string &output_filename_r) const;
+
+	bool RunPrimer3Shards (const std :: string &input_filename_r, const std :: string &output_filename_r);
+
+	std :: string GetJobFilename (const char *filename_s) const;
+
+private:
+	struct SearchShard;
+
+	std :: string pp_job_dir;
+
+	const PolymarkerSequence *pp_seq_p;
+
+	const PolymarkerPipelineConfig *pp_config_p;
+
+	const Primer3Prefs *pp_prefs_p;
+
+	/** The contigs of the database, shared with every other job against it. */
+	std :: shared_ptr <const FastaFile> pp_contigs;
+
+	/**
+	 * The packed contigs of the database which, if the database has them,
+	 * are used instead of pp_contigs.
+	 */
+	std :: shared_ptr <const PackedSequenceFile> pp_packed_contigs;
+
+	/** The minimizer index of the database or empty if it doesn't have one. */
+	std :: shared_ptr <const MinimizerIndex> pp_seed_index;
+
+	/** The windows of each marker found by ScanGenome, by the marker's index. */
+	std :: vector <std :: vector <SeedWindow> > pp_scanned_windows;
+
+	/** Have the markers' windows been found by ScanGenome rather than in pp_seed_index? */
+	bool pp_scanned_flag;
+
+	/** The homoeolog index of the database or empty if it doesn't have one. */
+	std :: shared_ptr <const HomoeologIndex> pp_homoeolog_index;
+
+	/** The database's rule for getting the arm of each contig for markers that have a chromosome. */
+	ArmSelector pp_arm_selector;
+
+	/** The rule for markers without a chromosome, which is always arm_selection_first_two. */
+	ArmSelector pp_first_two_arm_selector;
+
+	/** The threads that the shards of the genome are searched on. */
+	PolymarkerTaskPool pp_search_pool;
+
+	std :: vector <PolymarkerMarker> pp_markers;
+
+	/** The hits of every marker, with the arm of each target worked out using pp_arm_selector. */
+	ExonerateHitTable pp_hits;
+
+	/** The in-process primer3 or empty if primer3_core is being run instead. */
+	std :: shared_ptr <const Primer3Engine> pp_primer3_engine;
+
+	/** The threads that the shards of the primer3 records are designed on. */
+	PolymarkerTaskPool pp_primer3_pool;
+
+	/** The primer3 records for the masked markers, for both alleles of each. */
+	std :: vector <Primer3Input> pp_primer3_inputs;
+
+	/**
+	 * The primer3 cache key of each of pp_primer3_inputs, by its id, or
+	 * empty if the primer3 cache isn't being used.
+	 */
+	std :: unordered_map <std :: string, std :: string> pp_primer3_cache_keys;
+
+	/** The results of the primer3 records that were found in the primer3 cache rather than designed. */
+	std :: vector <Primer3Result> pp_cached_primer3_results;
+
+	/** Chooses the best primers of each marker as the primer3 results are read. */
+	KASPSelector pp_kasp_selector;
+
+	/** The number of primer3 records in pp_primer3_inputs. */
+	uint32 pp_num_primer3_records;
+
+	std :: string pp_error;
+
+	const std :: atomic <bool> *pp_cancel_p;
+
+	PolymarkerCheckpoint *pp_checkpoint_p;
+
+	/** Are the stages still being reused from an earlier run? */
+	bool pp_resume_flag;
+
+	bool ParseMarkerLine (const char *line_s, PolymarkerMarker &marker_r);
+
+	bool ProjectHit (const PolymarkerHit &hit_r, uint32 query_length, std :: string &projection_r);
+
+	bool GetContigRegion (const std :: string &contig_r, uint64 start, uint64 end, FastaRegion &region_r) const;
+
+	bool GetMappedContigRegion (const std :: string &contig_r, uint64 start, uint64 end, FastaRegion &region_r) const;
+
+	bool ScanGenome ();
+
+	size_t FindMarkerWindows (size_t marker_index, std :: vector <SeedWindow> &windows_r) const;
+
+	bool LocateMarkers (std :: vector <SeedWindow> &windows_r, bool &seeded_flag_r, bool &unseeded_flag_r);
+
+	bool RunAligner (const std :: string &queries_r, const std :: string &targets_r, const std :: vector <SeedWindow> *windows_p, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r);
+
+	bool RunAlignerShard (const std :: string &command_r, const std :: vector <SeedWindow> *windows_p, SearchShard &shard_r);
+
+	bool StreamAligner (const std :: string &command_r, const std :: vector <SeedWindow> *windows_p, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r);
+
+	bool AlignToSeedWindows (FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r, bool &unseeded_flag_r);
+
+	bool KeepShardHits (std :: vector <SearchShard> &shards_r, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r);
+
+	bool KeepHit (size_t row, const char *line_s, size_t line_length, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r);
+
+	bool BuildMask (size_t marker_index, FILE *exons_f);
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PIPELINE_HPP_ */
@@ -0,0 +1,170 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * polymarker_process_monitor.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Watch running Polymarker processes and their status files
+ * so that jobs are updated as soon as anything changes rather than
+ * when they are next polled.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PROCESS_MONITOR_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PROCESS_MONITOR_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "polymarker_service.h"
+
+
+/**
+ * The callback function called for each new line written to a
+ * monitored process's status.txt.
+ *
+ * @param data_p The custom data given when the process was added.
+ * @param line_s The new line without its terminating newline.
+ */
+typedef void (*PolymarkerStatusCallback) (void *data_p, const char *line_s);
+
+
+/**
+ * The callback function called once a monitored process has exited
+ * or when the PolymarkerProcessMonitor is freed before it has.
+ *
+ * @param data_p The custom data given when the process was added.
+ * @param exited_flag <code>true</code> if the process's exit code is
+ * known, <code>false</code> otherwise.
+ * @param exit_code The exit code of the process if exited_flag is
+ * <code>true</code>. If the process was killed by a signal, this is
+ * 128 plus the signal number.
+ */
+typedef void (*PolymarkerExitCallback) (void *data_p, bool exited_flag, int exit_code);
+
+
+/**
+ * A process being watched by a PolymarkerProcessMonitor.
+ */
+typedef struct MonitoredProcess
+{
+	/** The process id. */
+	pid_t mp_pid;
+
+	/** The pidfd which becomes readable when the process exits. */
+	int mp_pidfd;
+
+	/** The inotify watch on the job directory or -1 if there is none. */
+	int mp_watch;
+
+	/** The status.txt within the job directory. */
+	char *mp_status_filename_s;
+
+	/** How much of status.txt has already been read. */
+	off_t mp_status_offset;
+
+	/** The function to call for each new status line. */
+	PolymarkerStatusCallback mp_status_fn;
+
+	/** The function to call when the process exits. */
+	PolymarkerExitCallback mp_exit_fn;
+
+	/** The data to pass to the callback functions. */
+	void *mp_data_p;
+
+	/** The next MonitoredProcess in the list. */
+	struct MonitoredProcess *mp_next_p;
+} MonitoredProcess;
+
+
+/**
+ * A single thread that waits on the pidfds of Polymarker processes
+ * and an inotify instance watching their job directories.
+ */
+typedef struct PolymarkerProcessMonitor
+{
+	/** The epoll instance that the thread waits on. */
+	int ppm_epoll_fd;
+
+	/** The inotify instance for the job directories. */
+	int ppm_inotify_fd;
+
+	/** An eventfd used to tell the thread to stop. */
+	int ppm_stop_fd;
+
+	/** The thread that handles the events. */
+	pthread_t ppm_thread;
+
+	/** The lock guarding ppm_processes_p. */
+	pthread_mutex_t ppm_mutex;
+
+	/** The processes being watched. */
+	MonitoredProcess *ppm_processes_p;
+} PolymarkerProcessMonitor;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Create a PolymarkerProcessMonitor and start its thread.
+ *
+ * @return The new PolymarkerProcessMonitor or <code>NULL</code> if the
+ * system does not support pidfds and inotify or upon error.
+ * @memberof PolymarkerProcessMonitor
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerProcessMonitor *AllocatePolymarkerProcessMonitor (void);
+
+
+/**
+ * Stop a PolymarkerProcessMonitor and free it. The exit callback of any
+ * process still being watched is called with exited_flag set to <code>false</code>.
+ *
+ * @param monitor_p The PolymarkerProcessMonitor to free.
+ * @memberof PolymarkerProcessMonitor
+ */
+POLYMARKER_SERVICE_LOCAL void FreePolymarkerProcessMonitor (PolymarkerProcessMonitor *monitor_p);
+
+
+/**
+ * Start watching a child process and the status.txt in its job directory.
+ *
+ * @param monitor_p The PolymarkerProcessMonitor to use.
+ * @param pid The process id of the child process.
+ * @param job_dir_s The job directory that the process will write its status.txt to.
+ * @param status_fn The function to call for each new status line. This can be <code>NULL</code>.
+ * @param exit_fn The function to call when the process exits.
+ * @param data_p The data to pass to the callback functions.
+ * @return <code>true</code> if the process is being watched, <code>false</code>
+ * otherwise in which case the caller must wait for the process itself.
+ * @memberof PolymarkerProcessMonitor
+ */
+POLYMARKER_SERVICE_LOCAL bool MonitorPolymarkerProcess (PolymarkerProcessMonitor *monitor_p, pid_t pid, const char *job_dir_s, PolymarkerStatusCallback status_fn, PolymarkerExitCallback exit_fn, void *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_PROCESS_MONITOR_H_ */
@@ -0,0 +1,269 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_scheduler.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Limit the number of Polymarker pipelines that run at the
+ * same time.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SCHEDULER_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SCHEDULER_HPP_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "polymarker_service_job.h"
+
+
+/**
+ * The callback function used to start a queued run once the
+ * PolymarkerScheduler has a free slot for it. It must not block
+ * until the run has finished.
+ *
+ * Each job in the run is completed exactly once. If the run starts,
+ * or the function completes any of the jobs itself, it must return
+ * <code>true</code> and then complete all of them. If it returns
+ * <code>false</code>, the PolymarkerScheduler completes them instead.
+ *
+ * @param data_p The custom data given when the run was queued.
+ * @return <code>true</code> if the run was started successfully,
+ * <code>false</code> otherwise.
+ */
+typedef bool (*PolymarkerRunStarter) (void *data_p);
+
+
+/**
+ * A single pipeline run, of one or more PolymarkerServiceJobs, that
+ * is either waiting to start or is running.
+ */
+struct POLYMARKER_SERVICE_LOCAL PolymarkerScheduledRun
+{
+	/** The jobs that this run will complete. */
+	std :: vector <PolymarkerServiceJob *> psr_jobs;
+
+	/** The PolymarkerSequence that the run is against. */
+	const PolymarkerSequence *psr_seq_p;
+
+	/**
+	 * The database that the run is against. Each service has its own
+	 * PolymarkerSequences so the runs are counted by their FASTA file.
+	 */
+	std :: string psr_database;
+
+	/** The PolymarkerServiceData of the service that the run belongs to. */
+	const PolymarkerServiceData *psr_data_p;
+
+	/** The function to call to start the run. */
+	PolymarkerRunStarter psr_start_fn;
+
+	/** The data to pass to psr_start_fn. */
+	void *psr_start_data_p;
+
+	/** The number of jobs in this run that have not completed yet. */
+	size_t psr_num_unfinished_jobs;
+};
+
+
+/**
+ * The PolymarkerScheduler keeps a FIFO queue of pipeline runs for each
+ * PolymarkerJobPriority and only starts them when both the overall
+ * limit and the limit for their PolymarkerSequence allow it. A run is
+ * queued at the highest priority of any of its jobs.
+ *
+ * Each request is given its own PolymarkerService, so there is a single
+ * PolymarkerScheduler for the process which all of them share, see
+ * GetSharedPolymarkerScheduler ().
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerScheduler
+{
+public:
+	/**
+	 * Create a PolymarkerScheduler.
+	 *
+	 * @param max_runs The maximum number of concurrent pipelines. If this is 0,
+	 * there is no limit.
+	 * @param max_runs_per_db The maximum number of concurrent pipelines against
+	 * any PolymarkerSequence that does not set its own limit. If this is 0,
+	 * there is no limit.
+	 */
+	PolymarkerScheduler (uint32 max_runs, uint32 max_runs_per_db);
+
+	~PolymarkerScheduler ();
+
+	/**
+	 * Queue a pipeline run and start it if there is a free slot.
+	 *
+	 * @param jobs The PolymarkerServiceJobs that the run will complete.
+	 * @param seq_p The PolymarkerSequence that the run is against.
+	 * @param start_fn The function to call to start the run.
+	 * @param start_data_p The data to pass to start_fn.
+	 * @param data_p The PolymarkerServiceData of the service that the run belongs to.
+	 * @return <code>true</code> if the run was queued successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool Submit (const std :: vector <PolymarkerServiceJob *> &jobs, const PolymarkerSequence *seq_p, PolymarkerRunStarter start_fn, void *start_data_p, const PolymarkerServiceData *data_p);
+
+	/**
+	 * Mark a running job as complete. Once all of the jobs in a run are
+	 * complete, its slot is freed and any queued runs that can now start are.
+	 *
+	 * @param job_p The PolymarkerServiceJob that has completed. Calling this for
+	 * a job that is not running has no effect.
+	 */
+	void JobCompleted (const PolymarkerServiceJob *job_p);
+
+	/**
+	 * Get the position of a job in the queue.
+	 *
+	 * @param job_p The PolymarkerServiceJob to check.
+	 * @return The position with 1 being the next run to start or 0 if the job
+	 * is not queued.
+	 */
+	uint32 GetQueuePosition (const PolymarkerServiceJob *job_p);
+
+	/**
+	 * Remove a job from the queue before it has started.
+	 *
+	 * @param job_p The PolymarkerServiceJob to remove.
+	 * @return <code>true</code> if the job was removed, <code>false</code> if
+	 * it is not queued or is part of a batch.
+	 */
+	bool RemoveQueuedJob (const PolymarkerServiceJob *job_p);
+
+	/**
+	 * Remove the queued single job runs of a service that is being freed.
+	 * Its batches are failed by the PolymarkerBatcher instead.
+	 *
+	 * @param data_p The PolymarkerServiceData that is being freed.
+	 */
+	void ReleaseServiceData (const PolymarkerServiceData *data_p);
+
+private:
+	uint32 ps_max_runs;
+
+	uint32 ps_max_runs_per_db;
+
+	std :: mutex ps_mutex;
+
+	std :: deque <PolymarkerScheduledRun *> ps_queues [PJP_NUM_PRIORITIES];
+
+	/** The number of runs that have been started and not finished. */
+	uint32 ps_num_running;
+
+	/** The number of running runs against each database, by its FASTA file. */
+	std :: map <std :: string, uint32> ps_num_running_per_db;
+
+	/** The runs for each job that is running. */
+	std :: map <const PolymarkerServiceJob *, PolymarkerScheduledRun *> ps_running_jobs;
+
+	void StartQueuedRuns ();
+
+	bool CanStart (const PolymarkerScheduledRun *run_p) const;
+
+	void MarkAsRunning (PolymarkerScheduledRun *run_p);
+
+	void MarkAsFinished (PolymarkerScheduledRun *run_p);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the PolymarkerScheduler that is shared by all of the PolymarkerServices
+ * in this process, creating it from the service configuration the first
+ * time if any limits on the number of concurrent pipelines have been set.
+ *
+ * Each successful call must be matched by a call to ReleaseSharedPolymarkerScheduler ().
+ *
+ * @param data_p The PolymarkerServiceData with its PolymarkerSequences
+ * already loaded.
+ * @return The shared PolymarkerScheduler or <code>NULL</code> if there are
+ * no limits or upon error.
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerScheduler *GetSharedPolymarkerScheduler (const PolymarkerServiceData *data_p);
+
+
+/**
+ * Stop a service from using the shared PolymarkerScheduler. Once no services
+ * are using it, it is freed.
+ *
+ * @param scheduler_p The PolymarkerScheduler from GetSharedPolymarkerScheduler ().
+ * @param data_p The PolymarkerServiceData that is being freed.
+ */
+POLYMARKER_SERVICE_LOCAL void ReleaseSharedPolymarkerScheduler (PolymarkerScheduler *scheduler_p, const PolymarkerServiceData *data_p);
+
+
+/**
+ * Add a PolymarkerServiceJob, whose parameters have already been parsed,
+ * to the JobsManager as pending and queue it to be run by its PolymarkerTool.
+ *
+ * @param scheduler_p The PolymarkerScheduler to use.
+ * @param job_p The PolymarkerServiceJob to queue.
+ * @return <code>true</code> if the job was queued successfully, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool SchedulePolymarkerServiceJob (PolymarkerScheduler *scheduler_p, PolymarkerServiceJob *job_p);
+
+
+/**
+ * This is simply a C-wrapper function around PolymarkerScheduler::JobCompleted().
+ *
+ * @param scheduler_p The PolymarkerScheduler to use.
+ * @param job_p The PolymarkerServiceJob that has completed.
+ */
+POLYMARKER_SERVICE_LOCAL void PolymarkerScheduledJobCompleted (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p);
+
+
+/**
+ * This is simply a C-wrapper function around PolymarkerScheduler::GetQueuePosition().
+ *
+ * @param scheduler_p The PolymarkerScheduler to use.
+ * @param job_p The PolymarkerServiceJob to check.
+ * @return The position with 1 being the next run to start or 0 if the job
+ * is not queued.
+ */
+POLYMARKER_SERVICE_LOCAL uint32 GetPolymarkerServiceJobQueuePosition (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p);
+
+
+/**
+ * This is simply a C-wrapper function around PolymarkerScheduler::RemoveQueuedJob().
+ *
+ * @param scheduler_p The PolymarkerScheduler to use.
+ * @param job_p The PolymarkerServiceJob to remove.
+ * @return <code>true</code> if the job was removed from the queue, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool RemoveQueuedPolymarkerServiceJob (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SCHEDULER_HPP_ */
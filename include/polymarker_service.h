@@ -93,12 +93,40 @@ typedef enum
 	 */
 	PTT_SYSTEM,
 
+	/**
+	 * Run the marker search, alignment and primer design
+	 * within the server process.
+	 */
+	PTT_NATIVE,
+
 	/** The number of different PolymarkerTools available */
 	PTT_NUM_TYPES
 } PolymarkerToolType;
 
 
 
+/**
+ * The classes of priority that queued PolymarkerServiceJobs can have.
+ * Jobs in a higher class are always started before those in a lower
+ * one and jobs within the same class are started in the order that
+ * they arrived.
+ */
+typedef enum
+{
+	/** Jobs that should be started before any others. */
+	PJP_HIGH,
+
+	/** The default priority */
+	PJP_NORMAL,
+
+	/** Jobs that should only be started when nothing else is waiting. */
+	PJP_LOW,
+
+	/** The number of different priority classes */
+	PJP_NUM_PRIORITIES
+} PolymarkerJobPriority;
+
+
 /**
  * A datatype that stores the information of sequence data
  * that the PolymarkerService can run with.
@@ -111,6 +139,43 @@ typedef struct PolymarkerSequence
 	/** The filename of the fasta file for this sequence. */
 	const char *ps_fasta_filename_s;
 
+	/**
+	 * The filename of a packed sequence file built from the fasta file
+	 * which, if set, is used to fetch regions of the contigs instead of
+	 * the fasta file. This can be <code>NULL</code>.
+	 */
+	const char *ps_packed_filename_s;
+
+	/**
+	 * The filename of a minimizer index built from the fasta file which,
+	 * if set, is used to find where each marker lies so that the aligner
+	 * only needs to search those regions. This can be <code>NULL</code>.
+	 */
+	const char *ps_minimizer_index_filename_s;
+
+	/**
+	 * The filename of a homoeolog index built from the minimizer index
+	 * which, if set, gives the homoeologs of the contig that each marker
+	 * lies on. This can be <code>NULL</code>.
+	 */
+	const char *ps_homoeolog_index_filename_s;
+
+	/**
+	 * The rule used to get the chromosome arm of each contig from its
+	 * name for markers that have a chromosome, in the same form as the
+	 * --arm_selection option of polymarker.rb. If this is <code>NULL</code>,
+	 * arm_selection_embl is used.
+	 */
+	const char *ps_arm_selection_s;
+
+	/**
+	 * The scores that the native tool uses to choose the best KASP primers
+	 * for each marker, either the name of a built-in table or an object
+	 * as taken by KASPScores::SetFromJSON. If this is <code>NULL</code>,
+	 * the genome_specific table is used.
+	 */
+	const json_t *ps_kasp_scores_p;
+
 	/** The description of the database to display to the user. */
 	const char *ps_description_s;
 
@@ -120,6 +185,24 @@ typedef struct PolymarkerSequence
 	 */
 	bool ps_active_flag;
 
+	/**
+	 * The priority class for jobs that run against this sequence.
+	 */
+	PolymarkerJobPriority ps_priority;
+
+	/**
+	 * The maximum number of pipelines that can run against this sequence
+	 * at the same time. If this is 0, the service-wide per-database limit
+	 * is used.
+	 */
+	uint32 ps_max_concurrent_jobs;
+
+	/**
+	 * The number of threads that the native tool searches this sequence
+	 * with, each taking shards of the contigs in turn.
+	 */
+	uint32 ps_search_threads;
+
 } PolymarkerSequence;
 
 
@@ -182,6 +265,50 @@ typedef struct PolymarkerServiceData
 	 */
 	AsyncTasksManager *psd_task_manager_p;
 
+	/**
+	 * If the system-based PolymarkerTool has been configured to use
+	 * persistent workers, this is the pool of them, which is shared by
+	 * every request and so isn't freed with this. Otherwise it is
+	 * <code>NULL</code>.
+	 */
+	struct PolymarkerWorkerPool *psd_worker_pool_p;
+
+	/**
+	 * If the system-based PolymarkerTool starts a process for each job,
+	 * this watches those processes and their status files so that the
+	 * jobs are updated as soon as anything changes. If the system does
+	 * not support it, this is <code>NULL</code>.
+	 */
+	struct PolymarkerProcessMonitor *psd_process_monitor_p;
+
+	/**
+	 * If batching has been enabled, this collects the jobs that
+	 * can share a single pipeline run. It is shared by all of the
+	 * services in the process so that jobs from different requests
+	 * can be merged. Otherwise it is <code>NULL</code>.
+	 */
+	class PolymarkerBatcher *psd_batcher_p;
+
+	/**
+	 * If any limits on the number of concurrent pipelines have been
+	 * configured, this queues the jobs until they can be started. It is
+	 * shared by all of the services in the process so that the limits
+	 * apply across requests. Otherwise it is <code>NULL</code>.
+	 */
+	class PolymarkerScheduler *psd_scheduler_p;
+
+	/**
+	 * The number of threads used to prepare the PolymarkerServiceJobs for
+	 * a request. If this is 0, the number of online CPUs is used.
+	 */
+	uint32 psd_num_preparation_threads;
+
+	/**
+	 * The time and resource limits for the process started for each job.
+	 * If none have been configured, this is <code>NULL</code>.
+	 */
+	struct PolymarkerJobLimits *psd_job_limits_p;
+
 } PolymarkerServiceData;
 
 
@@ -215,6 +342,20 @@ POLYMARKER_PREFIX NamedParameterType PS_SEQUENCE POLYMARKER_STRUCT_VAL ("Sequenc
 POLYMARKER_PREFIX NamedParameterType PS_JOB_IDS POLYMARKER_STRUCT_VAL ("Previous results", PT_LARGE_STRING);
 
 
+/**
+ * The NamedParameterType for the parameter used for cancelling jobs that
+ * are queued or running.
+ */
+POLYMARKER_PREFIX NamedParameterType PS_CANCEL_JOB_IDS POLYMARKER_STRUCT_VAL ("Cancel jobs", PT_LARGE_STRING);
+
+
+/**
+ * The NamedParameterType for the parameter used for setting the priority
+ * that a request's jobs are queued with.
+ */
+POLYMARKER_PREFIX NamedParameterType PS_JOB_PRIORITY POLYMARKER_STRUCT_VAL ("Priority", PT_STRING);
+
+
 /** The constant string for configuring the tool that Polymarker will use. */
 POLYMARKER_PREFIX const char *PS_TOOL_S POLYMARKER_VAL ("tool");
 
@@ -224,6 +365,9 @@ POLYMARKER_PREFIX const char *PS_TOOL_SYSTEM_S POLYMARKER_VAL ("system");
 /** The constant string for denoting that Polymarker will use the web-based tool. */
 POLYMARKER_PREFIX const char *PS_TOOL_WEB_S POLYMARKER_VAL ("web");
 
+/** The constant string for denoting that Polymarker will use the in-process tool. */
+POLYMARKER_PREFIX const char *PS_TOOL_NATIVE_S POLYMARKER_VAL ("native");
+
 /** The constant string for denoting that Polymarker will use the blast aligner. */
 POLYMARKER_PREFIX const char *PS_ALIGNER_BLAST_S POLYMARKER_VAL ("blast");
 
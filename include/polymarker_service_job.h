@@ -45,6 +45,18 @@ typedef struct PolymarkerServiceJob
 	/** The PolymarkerTool used for this PolymarkerServiceJob */
 	PolymarkerTool *psj_tool_p;
 
+	/** The next job in the list of running jobs. */
+	struct PolymarkerServiceJob *psj_next_running_p;
+
+	/** Is this job in the list of running jobs? */
+	bool psj_running_flag;
+
+	/**
+	 * The priority that this job is queued with. This is the priority of its
+	 * PolymarkerSequence unless the request asked for a different one.
+	 */
+	PolymarkerJobPriority psj_priority;
+
 } PolymarkerServiceJob;
 
 
@@ -115,6 +127,27 @@ POLYMARKER_SERVICE_LOCAL json_t *ConvertPolymarkerServiceJobToJSON (Service *ser
 POLYMARKER_SERVICE_LOCAL void PolymarkerServiceJobCompleted (ServiceJob *job_p);
 
 
+/**
+ * Add a PolymarkerServiceJob to the list of running jobs so that it
+ * can be cancelled. It is removed again when it completes.
+ *
+ * @param job_p The PolymarkerServiceJob that is about to start.
+ * @memberof PolymarkerServiceJob
+ */
+POLYMARKER_SERVICE_LOCAL void AddRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p);
+
+
+/**
+ * Cancel a PolymarkerServiceJob. A queued job is removed from the queue
+ * and a running job has its process stopped.
+ *
+ * @param job_id The id of the PolymarkerServiceJob to cancel.
+ * @return <code>true</code> if the job was cancelled, <code>false</code> if
+ * the job is not running or cannot be cancelled.
+ */
+POLYMARKER_SERVICE_LOCAL bool CancelPolymarkerServiceJob (const uuid_t job_id);
+
+
 
 POLYMARKER_SERVICE_LOCAL bool DeterminePolymarkerResult (PolymarkerServiceJob *polymarker_job_p);
 
@@ -0,0 +1,102 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * polymarker_shared_inputs.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The input files that are the same for every job in a request.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SHARED_INPUTS_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SHARED_INPUTS_H_
+
+#include "polymarker_service.h"
+#include "parameter_set.h"
+
+
+/**
+ * The input files for a request, which are written once into the shared
+ * directory within the working directory and named by a hash of their
+ * contents. Each job then links to these rather than writing its own copies.
+ * Once no job directory links to a file any more, it is removed a day later.
+ */
+typedef struct PolymarkerSharedInputs
+{
+	/** The filename of the shared markers_list. */
+	char *psi_markers_filename_s;
+
+	/** Did any of the markers specify a chromosome? */
+	bool psi_has_chromosome_flag;
+
+	/**
+	 * The filename of the shared primer3 preferences. If this is <code>NULL</code>
+	 * then the default primer3 configuration will be used.
+	 */
+	char *psi_primer3_prefs_filename_s;
+
+} PolymarkerSharedInputs;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Parse the markers and primer3 preferences from a request and store them
+ * in the shared directory, reusing any identical files that are already there.
+ *
+ * @param param_set_p The ParameterSet for the request.
+ * @param data_p The PolymarkerServiceData.
+ * @return The newly-allocated PolymarkerSharedInputs or <code>NULL</code> upon error.
+ * @memberof PolymarkerSharedInputs
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerSharedInputs *AllocatePolymarkerSharedInputs (const ParameterSet *param_set_p, const PolymarkerServiceData *data_p);
+
+
+/**
+ * Free a PolymarkerSharedInputs. The shared files are left in place.
+ *
+ * @param inputs_p The PolymarkerSharedInputs to free.
+ * @memberof PolymarkerSharedInputs
+ */
+POLYMARKER_SERVICE_LOCAL void FreePolymarkerSharedInputs (PolymarkerSharedInputs *inputs_p);
+
+
+/**
+ * Make a shared file available within a job directory. A hard link is used
+ * if possible and a symbolic link otherwise.
+ *
+ * @param shared_filename_s The shared file.
+ * @param job_dir_s The job directory.
+ * @param name_s The name that the file should have within the job directory.
+ * @return The newly-allocated full filename within the job directory which
+ * should be freed with FreeCopiedString or <code>NULL</code> upon error.
+ */
+POLYMARKER_SERVICE_LOCAL char *LinkPolymarkerSharedInput (const char *shared_filename_s, const char *job_dir_s, const char *name_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_SHARED_INPUTS_H_ */
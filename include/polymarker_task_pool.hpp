@@ -0,0 +1,155 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_task_pool.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A pool of threads that share out a fixed set of tasks by
+ * stealing them from each other.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_TASK_POOL_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_TASK_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "polymarker_service.h"
+
+
+/**
+ * The function called to run each task.
+ *
+ * @param task_index The index of the task to run.
+ * @param thread_index The index of the thread running the task, from 0
+ * to one less than the number of threads, so that each thread can keep
+ * its own working data.
+ * @return <code>true</code> if the task succeeded, <code>false</code>
+ * otherwise.
+ */
+typedef std :: function <bool (size_t task_index, uint32 thread_index)> PolymarkerTask;
+
+
+/**
+ * A PolymarkerTaskPool runs a batch of tasks on a number of threads and
+ * waits for them all to finish.
+ *
+ * Each thread starts with its own queue of a contiguous block of the tasks
+ * and takes them from the front. Once its queue is empty, it steals tasks
+ * from the back of the other threads' queues, so the threads stay busy
+ * even when some tasks take much longer than others.
+ *
+ * The threads are started by the first batch that needs them and then
+ * wait for the next batch until the pool is destroyed, so a pipeline
+ * that runs several batches only starts them once.
+ */
+class POLYMARKER_SERVICE_LOCAL PolymarkerTaskPool
+{
+public:
+	/**
+	 * Create a PolymarkerTaskPool.
+	 *
+	 * @param num_threads The number of threads, including the calling
+	 * thread, to run the tasks on.
+	 */
+	PolymarkerTaskPool (uint32 num_threads);
+
+	/**
+	 * Stop the pool's threads.
+	 */
+	~PolymarkerTaskPool ();
+
+	/**
+	 * Get the number of threads that the tasks can be run on.
+	 *
+	 * @return The number of threads.
+	 */
+	uint32 GetNumThreads () const;
+
+	/**
+	 * Run a batch of tasks and wait for them to finish. Once a task has
+	 * failed, no further tasks are started.
+	 *
+	 * Only one batch can be run at a time, so this must not be called
+	 * from one of the tasks or from another thread while a batch is
+	 * running.
+	 *
+	 * @param num_tasks The number of tasks.
+	 * @param task_fn The function to run each task.
+	 * @return <code>true</code> if all of the tasks succeeded,
+	 * <code>false</code> otherwise.
+	 */
+	bool Run (size_t num_tasks, const PolymarkerTask &task_fn);
+
+private:
+	struct TaskQueue
+	{
+		std :: mutex tq_mutex;
+		std :: deque <size_t> tq_tasks;
+	};
+
+	uint32 ptp_num_threads;
+
+	/** The threads other than the one calling Run, which is thread 0. */
+	std :: vector <std :: thread> ptp_threads;
+
+	/** The lock guarding the batch and the threads' state. */
+	std :: mutex ptp_mutex;
+
+	/** Signalled when a batch starts or the pool is stopping. */
+	std :: condition_variable ptp_start_cond;
+
+	/** Signalled when the last of the threads has finished its part of a batch. */
+	std :: condition_variable ptp_done_cond;
+
+	/** Incremented for each batch so that the threads can tell a new one has started. */
+	uint64 ptp_batch;
+
+	/** The number of threads that take part in the current batch, including thread 0. */
+	uint32 ptp_num_batch_threads;
+
+	/** The number of the pool's threads that are still working on the current batch. */
+	uint32 ptp_num_busy_threads;
+
+	bool ptp_stop_flag;
+
+	/** The current batch's function and queues. */
+	const PolymarkerTask *ptp_task_fn_p;
+
+	std :: vector <std :: unique_ptr <TaskQueue> > ptp_queues;
+
+	std :: atomic <bool> ptp_failed;
+
+	void StartThreads ();
+
+	void WaitForBatches (uint32 thread_index, uint64 last_batch);
+
+	void RunWorker (uint32 thread_index);
+
+	static bool GetTask (TaskQueue &queue_r, bool own_flag, size_t &task_r);
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_TASK_POOL_HPP_ */
@@ -35,6 +35,9 @@
 
 
 class PolymarkerFormatter;
+struct PolymarkerSharedInputs;
+struct PolymarkerJobProgress;
+class PolymarkerCheckpoint;
 
 /**
  * The base class for the object that will actually run the Polymarker application
@@ -136,6 +139,20 @@ public:
 
 	bool AddSectionToResult (json_t *result_p, const char * const filename_s, const char * const key_s, PolymarkerFormatter *formatter_p);
 
+	/**
+	 * Read any new lines from the job's status.txt to update its progress.
+	 */
+	void UpdateProgress ();
+
+	/**
+	 * Add the latest progress of the job's run to a JSON object.
+	 *
+	 * @param json_p The JSON object to add the progress to.
+	 * @return <code>true</code> if the progress was added successfully, <code>
+	 * false</code> otherwise
+	 */
+	bool AddProgressToJSON (json_t *json_p);
+
 	/**
 	 * Set the PolymarkerSequence that this PolymarkerTool will run against.
 	 *
@@ -143,6 +160,72 @@ public:
 	 */
 	void SetPolymarkerSequence (const PolymarkerSequence *seq_p);
 
+	/**
+	 * Get the PolymarkerSequence that this PolymarkerTool will run against.
+	 *
+	 * @return The PolymarkerSequence.
+	 */
+	const PolymarkerSequence *GetPolymarkerSequence () const;
+
+	/**
+	 * Get the local directory where the results and logging data will be stored.
+	 *
+	 * @return The job directory or <code>0</code> if it has not been set.
+	 */
+	const char *GetJobDirectory () const;
+
+	/**
+	 * Get the PolymarkerServiceData of the PolymarkerService that created this PolymarkerTool.
+	 *
+	 * @return The PolymarkerServiceData.
+	 */
+	const PolymarkerServiceData *GetServiceData () const;
+
+	/**
+	 * Run the pipeline, and wait for it to finish, on a markers_list that has
+	 * already been written to a given directory using the settings of this
+	 * PolymarkerTool. This is used to run the markers from several jobs at once.
+	 *
+	 * @param dir_s The directory containing the markers_list file and where
+	 * the results will be written.
+	 * @param error_ss If the run fails, this will be set to a newly-allocated error
+	 * message which should be freed with FreeCopiedString.
+	 * @return <code>true</code> if the pipeline ran successfully, <code>
+	 * false</code> otherwise
+	 */
+	virtual bool RunInDirectory (const char *dir_s, char **error_ss);
+
+	/**
+	 * Set the input files that have already been written for all of the jobs
+	 * in a request. If these are set, ParseParameters will link to them rather
+	 * than writing its own copies.
+	 *
+	 * @param inputs_p The PolymarkerSharedInputs to use or <code>0</code> to
+	 * write the inputs for this job alone.
+	 */
+	void SetSharedInputs (const PolymarkerSharedInputs *inputs_p);
+
+	/**
+	 * Stop the run of this PolymarkerTool's job. The job is completed, as
+	 * having failed, by the task running it once it has stopped.
+	 *
+	 * @return <code>true</code> if the run is being stopped, <code>false</code>
+	 * if this PolymarkerTool cannot cancel its job.
+	 */
+	virtual bool Cancel ();
+
+	/**
+	 * Run this PolymarkerTool's job again after it was interrupted, reusing
+	 * the stages that had already been completed.
+	 *
+	 * @param checkpoint_p The job's PolymarkerCheckpoint which has been loaded
+	 * and locked. If the job is resumed, this PolymarkerTool takes ownership
+	 * of it.
+	 * @return <code>true</code> if the job has been started again, <code>false</code>
+	 * if this PolymarkerTool cannot resume jobs or upon error.
+	 */
+	virtual bool Resume (PolymarkerCheckpoint *checkpoint_p);
+
 
 	bool SaveJobMetadata () const;
 
@@ -169,11 +252,21 @@ protected:
 	 */
 	const PolymarkerServiceData *pt_service_data_p;
 
+	/**
+	 * The input files shared with the other jobs in the same request, if any.
+	 */
+	const PolymarkerSharedInputs *pt_shared_inputs_p;
+
 	/**
 	 * The local directory where the results and logging data will be stored.
 	 */
 	char *pt_job_dir_s;
 
+	/**
+	 * The stages that the job's run has reached so far.
+	 */
+	PolymarkerJobProgress *pt_progress_p;
+
 	/**
 	 * The key used for specifying the PolymarkerTool's job directory within
 	 * and JSON-based serialisations of a PolymarkerTool.
@@ -28,6 +28,8 @@
 #define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_UTILS_H_
 
 
+#include <stdio.h>
+
 #include "polymarker_service.h"
 #include "linked_list.h"
 
@@ -38,9 +40,11 @@ extern "C"
 #endif
 
 
-POLYMARKER_SERVICE_LOCAL bool CreateMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p);
+POLYMARKER_SERVICE_LOCAL bool CreateMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, bool has_chromosome_param_flag);
+
+POLYMARKER_SERVICE_LOCAL bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, const char *arm_selection_s, ByteBuffer *buffer_p);
 
-POLYMARKER_SERVICE_LOCAL bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, ByteBuffer *buffer_p);
+POLYMARKER_SERVICE_LOCAL bool WriteMarkerList (const ParameterSet *param_set_p, FILE *marker_f, bool *has_chromosome_flag_p);
 
 POLYMARKER_SERVICE_LOCAL const char *GetSequenceParametersGroupName (void);
 
@@ -48,6 +52,15 @@ POLYMARKER_SERVICE_LOCAL const char *GetSequenceParametersGroupName (void);
 POLYMARKER_SERVICE_LOCAL ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, PolymarkerServiceData *polymarker_data_p);
 
 
+/**
+ * Cancel the queued or running jobs with the given ids.
+ *
+ * @param ids_p A LinkedList of StringListNodes with the job ids.
+ * @return The number of jobs that were cancelled.
+ */
+POLYMARKER_SERVICE_LOCAL uint32 CancelPolymarkerServiceJobs (LinkedList *ids_p);
+
+
 #ifdef __cplusplus
 }
 #endif
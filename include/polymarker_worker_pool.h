@@ -0,0 +1,154 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * polymarker_worker_pool.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A pool of long-lived Polymarker processes that jobs can
+ * be sent to without paying the start-up costs each time.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_WORKER_POOL_H_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_WORKER_POOL_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "polymarker_service.h"
+#include "polymarker_job_progress.h"
+
+
+/**
+ * A single Polymarker process running in worker mode.
+ *
+ * The worker reads one job per line from its end of the socket and
+ * replies with any number of "STATUS\t<stage>" lines followed by
+ * either "DONE" or "ERROR\t<message>".
+ */
+typedef struct PolymarkerWorker
+{
+	/** The process id of the worker. */
+	pid_t pw_pid;
+
+	/** Our end of the socket connected to the worker. */
+	int pw_fd;
+
+	/** Is the worker currently running a job? */
+	bool pw_busy_flag;
+
+	/** The number of jobs that this worker has run. */
+	uint32 pw_num_jobs;
+} PolymarkerWorker;
+
+
+/**
+ * The pool of PolymarkerWorkers.
+ */
+typedef struct PolymarkerWorkerPool
+{
+	/** The executable to run in worker mode. */
+	char *pwp_executable_s;
+
+	/** The workers. */
+	PolymarkerWorker *pwp_workers_p;
+
+	/** The number of workers. */
+	uint32 pwp_num_workers;
+
+	/** The lock guarding the busy flags of the workers. */
+	pthread_mutex_t pwp_mutex;
+
+	/** Signalled whenever a worker becomes free. */
+	pthread_cond_t pwp_free_worker_cond;
+} PolymarkerWorkerPool;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Allocate a PolymarkerWorkerPool and start its workers.
+ *
+ * @param executable_s The Polymarker executable. Each worker is started by
+ * running this with the "--worker" argument.
+ * @param num_workers The number of workers to start.
+ * @return The newly-allocated PolymarkerWorkerPool or <code>NULL</code> upon error.
+ * @memberof PolymarkerWorkerPool
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerWorkerPool *AllocatePolymarkerWorkerPool (const char *executable_s, const uint32 num_workers);
+
+
+/**
+ * Get the PolymarkerWorkerPool shared by every request, starting its
+ * workers the first time that this is called. Each request has its own
+ * Service, so the pool is kept for the life of the process rather than
+ * being freed with the request's PolymarkerServiceData, which keeps the
+ * workers warm between requests. The workers exit when the process does
+ * as their end of each socket is then closed.
+ *
+ * @param executable_s The Polymarker executable. Each worker is started by
+ * running this with the "--worker" argument.
+ * @param num_workers The number of workers to start if the pool doesn't
+ * exist yet.
+ * @return The shared PolymarkerWorkerPool or <code>NULL</code> upon error
+ * or if it is already running a different executable.
+ * @memberof PolymarkerWorkerPool
+ */
+POLYMARKER_SERVICE_LOCAL PolymarkerWorkerPool *GetSharedPolymarkerWorkerPool (const char *executable_s, const uint32 num_workers);
+
+
+/**
+ * Stop the workers and free a PolymarkerWorkerPool.
+ *
+ * @param pool_p The PolymarkerWorkerPool to free.
+ * @memberof PolymarkerWorkerPool
+ */
+POLYMARKER_SERVICE_LOCAL void FreePolymarkerWorkerPool (PolymarkerWorkerPool *pool_p);
+
+
+/**
+ * Run a job on the next free worker, waiting for one to become free
+ * if all of them are busy. This blocks until the job has finished.
+ *
+ * @param pool_p The PolymarkerWorkerPool to use.
+ * @param args_s The command line arguments for the job, as they would
+ * be passed to the Polymarker executable.
+ * @param status_fn If this is not <code>NULL</code>, it is called with the
+ * stage from each of the worker's STATUS lines, in the same form as a line
+ * of the job's status.txt, as soon as it is read.
+ * @param status_data_p The custom data to pass to status_fn.
+ * @param error_ss If the job fails and this is not <code>NULL</code>, it will
+ * be set to a newly-allocated copy of the error message which should be freed
+ * with FreeCopiedString.
+ * @return <code>true</code> if the job ran successfully, <code>false</code> otherwise.
+ * @memberof PolymarkerWorkerPool
+ */
+POLYMARKER_SERVICE_LOCAL bool RunJobOnPolymarkerWorkerPool (PolymarkerWorkerPool *pool_p, const char *args_s, PolymarkerStatusLineCallback status_fn, void *status_data_p, char **error_ss);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_POLYMARKER_WORKER_POOL_H_ */
@@ -0,0 +1,235 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * primer3_cache.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief An on-disk cache of primer3 results that is shared by every
+ * job so that templates which have been designed before are not sent
+ * to primer3 again.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_CACHE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_CACHE_HPP_
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "polymarker_service.h"
+#include "primer3_prefs.h"
+#include "primer3_engine.hpp"
+#include "json_util.h"
+
+
+/**
+ * The counters of a Primer3Cache.
+ */
+struct POLYMARKER_SERVICE_LOCAL Primer3CacheStats
+{
+	/** The number of lookups that found their result in the cache. */
+	uint64 pcs_hits;
+
+	/** The number of lookups that did not. */
+	uint64 pcs_misses;
+
+	/** The number of results removed to keep the cache within its capacity. */
+	uint64 pcs_evictions;
+
+	/** The number of results in the cache. */
+	uint64 pcs_num_entries;
+
+	/** The number of bytes used on disk by the results in the cache. */
+	uint64 pcs_size;
+
+	/** The maximum number of bytes that the results in the cache can use. */
+	uint64 pcs_capacity;
+};
+
+
+/**
+ * A least-recently-used cache of primer3 results stored in a directory,
+ * keyed by the template and the primer3 settings that the result was
+ * designed with, with a limit on the total number of bytes that they
+ * can use on disk.
+ *
+ * Each result is a file named after a hash of its key, in a subdirectory
+ * named after the first two digits of the hash. The file holds the key
+ * followed by the result, as primer3 input and output lines, so that
+ * the key can be checked on every lookup and the files can be read
+ * like any other primer3 record. A file's modification time is updated
+ * whenever it is used, so the order in which the results were used
+ * survives the server being restarted.
+ *
+ * All of the methods can be called from any thread and the directory
+ * can be shared by more than one server process, although each only
+ * evicts the results that it knows about.
+ */
+class POLYMARKER_SERVICE_LOCAL Primer3Cache
+{
+public:
+	/**
+	 * Create a Primer3Cache without a directory, so that nothing is
+	 * stored until Open is called.
+	 */
+	Primer3Cache ();
+
+	/**
+	 * Start using a directory, reading the results that are already in
+	 * it and evicting the least recently used ones if they use more than
+	 * the capacity.
+	 *
+	 * @param directory_s The directory, which is created if it doesn't exist.
+	 * @param capacity The capacity in bytes. If this is 0, the cache is
+	 * disabled and the directory is left as it is.
+	 * @return <code>true</code> if the directory can be used, <code>false</code>
+	 * otherwise.
+	 */
+	bool Open (const char *directory_s, size_t capacity);
+
+	/**
+	 * Is the cache storing results?
+	 *
+	 * @return <code>true</code> if a directory has been opened with a
+	 * capacity greater than 0.
+	 */
+	bool IsEnabled () const;
+
+	/**
+	 * Look a result up and, if it is found, mark it as the most recently used.
+	 *
+	 * @param key_r The key made by MakeKey.
+	 * @param result_r The Primer3Result to fill in, apart from its id,
+	 * if the result is found.
+	 * @return <code>true</code> if the result was found, <code>false</code>
+	 * otherwise.
+	 */
+	bool Get (const std :: string &key_r, Primer3Result &result_r);
+
+	/**
+	 * Store a result as the most recently used.
+	 *
+	 * @param key_r The key made by MakeKey.
+	 * @param result_r The result of running primer3 on the key's template.
+	 * @return <code>true</code> if the result was stored, <code>false</code>
+	 * otherwise.
+	 */
+	bool Put (const std :: string &key_r, const Primer3Result &result_r);
+
+	/**
+	 * Get the current counters.
+	 *
+	 * @return The Primer3CacheStats.
+	 */
+	Primer3CacheStats GetStats () const;
+
+	/**
+	 * Make the key for a primer3 record. This holds everything that
+	 * changes what primer3 designs for the record apart from its id.
+	 *
+	 * @param prefs_p The settings that the record inherits.
+	 * @param input_r The record.
+	 * @return The key.
+	 */
+	static std :: string MakeKey (const Primer3Prefs *prefs_p, const Primer3Input &input_r);
+
+	/**
+	 * Get the Primer3Cache that is shared by the whole process.
+	 *
+	 * @return The Primer3Cache.
+	 */
+	static Primer3Cache &GetShared ();
+
+private:
+	/** The hash of each entry along with the number of bytes its file uses. */
+	typedef std :: list <std :: pair <std :: string, size_t> > EntryList;
+
+	std :: string pc_directory;
+
+	/** The entries with the most recently used at the front. */
+	EntryList pc_entries;
+
+	std :: unordered_map <std :: string, EntryList :: iterator> pc_index;
+
+	size_t pc_capacity;
+
+	size_t pc_size;
+
+	uint64 pc_hits;
+
+	uint64 pc_misses;
+
+	uint64 pc_evictions;
+
+	mutable std :: mutex pc_mutex;
+
+	void Load ();
+
+	void Evict (size_t capacity);
+
+	void Touch (const std :: string &hash_r, size_t size);
+
+	std :: string GetEntryFilename (const std :: string &hash_r) const;
+
+	static bool ReadEntry (const std :: string &filename_r, const std :: string &key_r, Primer3Result &result_r);
+
+	static bool WriteEntry (const std :: string &filename_r, const std :: string &key_r, const Primer3Result &result_r, size_t &size_r);
+
+	static std :: string GetHash (const std :: string &key_r);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Open the directory of the Primer3Cache shared by the whole process.
+ *
+ * This is simply a C-wrapper function around Primer3Cache::Open().
+ *
+ * @param directory_s The directory.
+ * @param capacity The capacity in bytes.
+ * @return <code>true</code> if the directory can be used, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool OpenSharedPrimer3Cache (const char *directory_s, size_t capacity);
+
+
+/**
+ * Add the counters of the Primer3Cache shared by the whole process to
+ * a JSON object as a child object called "primer3_cache".
+ *
+ * @param json_p The JSON object to add the counters to.
+ * @return <code>true</code> if the counters were added successfully,
+ * <code>false</code> otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool AddSharedPrimer3CacheStatsToJSON (json_t *json_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_CACHE_HPP_ */
@@ -0,0 +1,215 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * primer3_engine.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Design primers by calling primer3 as a library within the
+ * server process rather than by running primer3_core.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_ENGINE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_ENGINE_HPP_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "primer3_prefs.h"
+
+
+/**
+ * A template to design primers for, equivalent to a primer3
+ * input record.
+ */
+struct POLYMARKER_SERVICE_LOCAL Primer3Input
+{
+	/** The SEQUENCE_ID of the record. */
+	std :: string pi_id;
+
+	/** The SEQUENCE_TEMPLATE of the record. */
+	std :: string pi_template;
+
+	/** The SEQUENCE_FORCE_LEFT_END of the record or -1 if it isn't set. */
+	int32 pi_force_left_end;
+
+	/** The SEQUENCE_FORCE_RIGHT_END of the record or -1 if it isn't set. */
+	int32 pi_force_right_end;
+
+	Primer3Input () : pi_force_left_end (-1), pi_force_right_end (-1) {}
+};
+
+
+/**
+ * The values of a primer3 output record that are used when
+ * choosing the best primers for each marker.
+ */
+struct POLYMARKER_SERVICE_LOCAL Primer3Result
+{
+	/** The SEQUENCE_ID of the record. */
+	std :: string pr_id;
+
+	/** PRIMER_LEFT_0_SEQUENCE */
+	std :: string pr_left;
+
+	/** PRIMER_RIGHT_0_SEQUENCE */
+	std :: string pr_right;
+
+	/** PRIMER_LEFT_0_TM */
+	std :: string pr_left_tm;
+
+	/** PRIMER_RIGHT_0_TM */
+	std :: string pr_right_tm;
+
+	/** PRIMER_PAIR_0_PRODUCT_SIZE */
+	std :: string pr_product_size;
+
+	/** PRIMER_ERROR */
+	std :: string pr_error;
+
+	/** PRIMER_PAIR_NUM_RETURNED */
+	uint32 pr_num_returned;
+
+	Primer3Result () : pr_num_returned (0) {}
+};
+
+
+/**
+ * primer3 linked in as a library.
+ *
+ * primer3 keeps its thermodynamic parameters in global tables, so they
+ * are read once when the Primer3Engine is created and then used by every
+ * job in the process rather than by each run of primer3_core. For the
+ * same reason there is only ever one Primer3Engine and the primer3
+ * calls are made one at a time.
+ *
+ * This is only available if the service was built with HAVE_LIBPRIMER3
+ * defined.
+ */
+class POLYMARKER_SERVICE_LOCAL Primer3Engine
+{
+public:
+	/**
+	 * Create a Primer3Engine.
+	 *
+	 * @param thermodynamic_parameters_path_s The directory of primer3's
+	 * thermodynamic parameter files.
+	 */
+	Primer3Engine (const char *thermodynamic_parameters_path_s);
+
+	~Primer3Engine ();
+
+	/**
+	 * Read the thermodynamic parameters into primer3's tables.
+	 *
+	 * @return <code>true</code> if the parameters were loaded successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Load ();
+
+	/**
+	 * Design the primers for a set of templates.
+	 *
+	 * @param prefs_p The settings that apply to every template.
+	 * @param inputs_r The templates.
+	 * @param results_r The result for each template, in the same order,
+	 * will be appended to this.
+	 * @return <code>true</code> if primer3 was run on every template,
+	 * whether or not it found any primers, <code>false</code> upon error.
+	 */
+	bool Design (const Primer3Prefs *prefs_p, const std :: vector <Primer3Input> &inputs_r, std :: vector <Primer3Result> &results_r) const;
+
+	/**
+	 * Get the directory that the thermodynamic parameters were read from.
+	 *
+	 * @return The directory.
+	 */
+	const char *GetThermodynamicParametersPath () const;
+
+	/**
+	 * Was the service built with primer3 as a library?
+	 *
+	 * @return <code>true</code> if it was.
+	 */
+	static bool IsAvailable ();
+
+	/**
+	 * Get the Primer3Engine shared by the whole process. The first call
+	 * loads the thermodynamic parameters, any later calls with the same
+	 * directory return the same Primer3Engine.
+	 *
+	 * @param thermodynamic_parameters_path_s The directory of primer3's
+	 * thermodynamic parameter files.
+	 * @return The Primer3Engine or an empty pointer if primer3 isn't available,
+	 * the parameters could not be loaded or a different directory has already
+	 * been loaded.
+	 */
+	static std :: shared_ptr <const Primer3Engine> GetShared (const char *thermodynamic_parameters_path_s);
+
+private:
+	std :: string pe_thermodynamic_parameters_path;
+
+	bool pe_loaded_flag;
+
+	/** primer3 isn't reentrant so only one template is designed at a time. */
+	static std :: mutex pe_primer3_mutex;
+
+	static std :: string GetDirectory (const char *path_s);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load primer3's thermodynamic parameters for the whole process so
+ * that jobs do not need to load them themselves.
+ *
+ * This is simply a C-wrapper function around Primer3Engine::GetShared().
+ *
+ * @param thermodynamic_parameters_path_s The directory of primer3's
+ * thermodynamic parameter files.
+ * @return <code>true</code> if the parameters are loaded, <code>false</code>
+ * otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool LoadSharedPrimer3Engine (const char *thermodynamic_parameters_path_s);
+
+
+/**
+ * Has the service been built with libprimer3?
+ *
+ * This is simply a C-wrapper function around Primer3Engine::IsAvailable().
+ *
+ * @return <code>true</code> if primer3 can be called as a library,
+ * <code>false</code> if primer3_core has to be run instead.
+ */
+POLYMARKER_SERVICE_LOCAL bool IsPrimer3LibraryAvailable (void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_ENGINE_HPP_ */
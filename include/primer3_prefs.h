@@ -23,6 +23,8 @@
 #ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_PREFS_H_
 #define SERVICES_POLYMARKER_SERVICE_INCLUDE_PRIMER3_PREFS_H_
 
+#include <stdio.h>
+
 #include "polymarker_service.h"
 
 
@@ -86,6 +88,9 @@ POLYMARKER_SERVICE_LOCAL void FreePrimer3Prefs (Primer3Prefs *prefs_p);
 POLYMARKER_SERVICE_LOCAL char *SavePrimer3Prefs (Primer3Prefs *prefs_p, const char *working_dir_s, const char *job_id_s);
 
 
+POLYMARKER_SERVICE_LOCAL bool WritePrimer3Prefs (const Primer3Prefs *prefs_p, FILE *out_f);
+
+
 POLYMARKER_SERVICE_LOCAL bool AddPrimer3PrefsParameters (ParameterSet *params_p, PolymarkerServiceData *data_p);
 
 
@@ -0,0 +1,211 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * region_cache.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A cache of the contig regions fetched by the native pipelines
+ * that is shared by every job in the process.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_REGION_CACHE_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_REGION_CACHE_HPP_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "polymarker_service.h"
+#include "json_util.h"
+
+
+/**
+ * The counters of a RegionCache.
+ */
+struct POLYMARKER_SERVICE_LOCAL RegionCacheStats
+{
+	/** The number of lookups that found their region in the cache. */
+	uint64 rcs_hits;
+
+	/** The number of lookups that did not. */
+	uint64 rcs_misses;
+
+	/** The number of regions removed to keep the cache within its capacity. */
+	uint64 rcs_evictions;
+
+	/** The number of regions in the cache. */
+	uint64 rcs_num_entries;
+
+	/** The number of bytes used by the regions in the cache. */
+	uint64 rcs_size;
+
+	/** The maximum number of bytes that the regions in the cache can use. */
+	uint64 rcs_capacity;
+};
+
+
+/**
+ * A least-recently-used cache of decoded contig regions, keyed by the
+ * database, contig and range that they were fetched for, with a limit
+ * on the total number of bytes that they can use.
+ *
+ * The regions are held by shared pointers, so a region that is evicted
+ * while a job is still reading it stays valid until that job has
+ * finished with it. All of the methods can be called from any thread.
+ */
+class POLYMARKER_SERVICE_LOCAL RegionCache
+{
+public:
+	/**
+	 * Create an empty RegionCache with a capacity of 0, so that
+	 * nothing is stored until SetCapacity is called.
+	 */
+	RegionCache ();
+
+	/**
+	 * Set the maximum number of bytes that the regions can use, evicting
+	 * the least recently used ones if they now use more.
+	 *
+	 * @param capacity The capacity in bytes. If this is 0, the cache is
+	 * emptied and disabled.
+	 */
+	void SetCapacity (size_t capacity);
+
+	/**
+	 * Is the cache storing regions?
+	 *
+	 * @return <code>true</code> if the cache has a capacity greater than 0.
+	 */
+	bool IsEnabled () const;
+
+	/**
+	 * Can a region of a given size be stored? Regions that would use more
+	 * than an eighth of the capacity aren't stored so that a single large
+	 * contig cannot empty the cache.
+	 *
+	 * @param length The number of bases in the region.
+	 * @return <code>true</code> if the region can be stored.
+	 */
+	bool CanStore (size_t length) const;
+
+	/**
+	 * Look a region up and, if it is found, mark it as the most recently used.
+	 *
+	 * @param key_r The key made by MakeKey.
+	 * @return The region or an empty pointer if it is not in the cache.
+	 */
+	std :: shared_ptr <const std :: string> Get (const std :: string &key_r);
+
+	/**
+	 * Store a region as the most recently used.
+	 *
+	 * @param key_r The key made by MakeKey.
+	 * @param seq_p The bases of the region.
+	 * @return The region now in the cache for this key. If another thread
+	 * stored the same region first, this is the one that it stored.
+	 */
+	std :: shared_ptr <const std :: string> Put (const std :: string &key_r, const std :: shared_ptr <const std :: string> &seq_p);
+
+	/**
+	 * Get the current counters.
+	 *
+	 * @return The RegionCacheStats.
+	 */
+	RegionCacheStats GetStats () const;
+
+	/**
+	 * Make the key for a region.
+	 *
+	 * @param database_s The filename of the database.
+	 * @param contig_r The name of the contig.
+	 * @param start The requested start of the region.
+	 * @param end The requested end of the region.
+	 * @return The key.
+	 */
+	static std :: string MakeKey (const char *database_s, const std :: string &contig_r, uint64 start, uint64 end);
+
+	/**
+	 * Get the RegionCache that is shared by the whole process.
+	 *
+	 * @return The RegionCache.
+	 */
+	static RegionCache &GetShared ();
+
+private:
+	typedef std :: list <std :: pair <std :: string, std :: shared_ptr <const std :: string> > > EntryList;
+
+	/** The entries with the most recently used at the front. */
+	EntryList rc_entries;
+
+	std :: unordered_map <std :: string, EntryList :: iterator> rc_index;
+
+	size_t rc_capacity;
+
+	size_t rc_size;
+
+	uint64 rc_hits;
+
+	uint64 rc_misses;
+
+	uint64 rc_evictions;
+
+	mutable std :: mutex rc_mutex;
+
+	void Evict (size_t capacity);
+
+	static size_t GetEntrySize (const std :: string &key_r, const std :: string &seq_r);
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Set the capacity of the RegionCache shared by the whole process.
+ *
+ * This is simply a C-wrapper function around RegionCache::SetCapacity().
+ *
+ * @param capacity The capacity in bytes.
+ */
+POLYMARKER_SERVICE_LOCAL void SetSharedRegionCacheCapacity (size_t capacity);
+
+
+/**
+ * Add the counters of the RegionCache shared by the whole process to
+ * a JSON object as a child object called "region_cache".
+ *
+ * @param json_p The JSON object to add the counters to.
+ * @return <code>true</code> if the counters were added successfully,
+ * <code>false</code> otherwise.
+ */
+POLYMARKER_SERVICE_LOCAL bool AddSharedRegionCacheStatsToJSON (json_t *json_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_REGION_CACHE_HPP_ */
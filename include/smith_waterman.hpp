@@ -0,0 +1,189 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * smith_waterman.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief A local aligner for placing a marker within the windows of the
+ * genome that its minimizers were found in.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_HPP_
+
+#include <string>
+#include <vector>
+
+#include "polymarker_service.h"
+#include "smith_waterman_kernel.hpp"
+
+
+/**
+ * The scores used by a SmithWatermanAligner and the thresholds that
+ * an alignment must pass for it to be kept.
+ */
+struct POLYMARKER_SERVICE_LOCAL SmithWatermanParameters
+{
+	/** The score for a pair of identical bases. */
+	int32 swp_match;
+
+	/** The penalty for a pair of different bases. */
+	int32 swp_mismatch;
+
+	/** The penalty for the first base of a gap. */
+	int32 swp_gap_open;
+
+	/** The penalty for each further base of a gap. */
+	int32 swp_gap_extend;
+
+	/** Alignments that score less than this are discarded. */
+	int32 swp_min_score;
+
+	/** Alignments with an identity at or below this percentage are discarded. */
+	double swp_min_identity;
+
+	/**
+	 * Create the default SmithWatermanParameters, which use the same scores
+	 * as exonerate's est2genome model.
+	 */
+	SmithWatermanParameters ();
+};
+
+
+/**
+ * A local alignment between a query and a target. The coordinates are
+ * 0-based and half-open, on the strand of the target that was aligned.
+ */
+struct POLYMARKER_SERVICE_LOCAL SmithWatermanAlignment
+{
+	int32 swa_score;
+
+	uint32 swa_query_start;
+
+	uint32 swa_query_end;
+
+	uint32 swa_target_start;
+
+	uint32 swa_target_end;
+
+	/** The number of identical bases. */
+	uint32 swa_matches;
+
+	/** The number of columns in the alignment, including gaps. */
+	uint32 swa_length;
+
+	/** The percentage of the columns that are identical bases. */
+	double swa_identity;
+
+	/** The alignment as a CIGAR string of M, I and D operations. */
+	std :: string swa_cigar;
+
+	/** The alignment as exonerate's vulgar operations of M and G, e.g. "M 120 120 G 0 2 M 80 80". */
+	std :: string swa_vulgar;
+};
+
+
+/**
+ * A Smith-Waterman aligner with affine gap penalties.
+ *
+ * Each alignment is made in two passes. The first fills in the scores
+ * using the widest vector instructions that the CPU supports, chosen when
+ * the first aligner is created. Along with each score it keeps the number
+ * of identical bases and the length of the path that the score came from,
+ * so alignments that fall below the minimum score or identity are rejected
+ * without any further work. Only the alignments that pass are traced back,
+ * over the small part of the matrix that they can lie in, to get their
+ * start positions and operations.
+ *
+ * An aligner keeps its buffers between alignments, so each thread should
+ * use its own.
+ */
+class POLYMARKER_SERVICE_LOCAL SmithWatermanAligner
+{
+public:
+	/**
+	 * Create a SmithWatermanAligner.
+	 *
+	 * @param params_r The scores and thresholds to use.
+	 */
+	SmithWatermanAligner (const SmithWatermanParameters &params_r);
+
+	/**
+	 * Set the sequence that will be aligned by any following calls to Align.
+	 *
+	 * @param query_s The query sequence.
+	 * @param query_length The number of bases in query_s.
+	 */
+	void SetQuery (const char *query_s, size_t query_length);
+
+	/**
+	 * Find the best local alignment of the query against a target.
+	 *
+	 * @param target_s The target sequence.
+	 * @param target_length The number of bases in target_s.
+	 * @param reverse_flag If this is <code>true</code>, the query is aligned
+	 * against the reverse complement of the target.
+	 * @param alignment_r If an alignment passes the thresholds, it will be
+	 * stored here.
+	 * @return <code>true</code> if an alignment passed the thresholds,
+	 * <code>false</code> otherwise.
+	 */
+	bool Align (const char *target_s, size_t target_length, bool reverse_flag, SmithWatermanAlignment &alignment_r);
+
+	/**
+	 * Get the name of the instruction set that the scoring pass uses.
+	 *
+	 * @return The name, e.g. "avx2".
+	 */
+	static const char *GetKernelName ();
+
+private:
+	SmithWatermanParameters swa_params;
+
+	uint32 swa_query_length;
+
+	uint32 swa_target_length;
+
+	/* The codes as 16-bit values for the vector scoring passes */
+	std :: vector <int16> swa_query_codes;
+
+	std :: vector <int16> swa_target_codes;
+
+	std :: vector <int16> swa_buffers;
+
+	/* The scalar scoring pass and the traceback use 32-bit values */
+	std :: vector <int32> swa_wide_query_codes;
+
+	std :: vector <int32> swa_wide_target_codes;
+
+	std :: vector <int32> swa_wide_buffers;
+
+	std :: vector <int32> swa_traceback_scores;
+
+	std :: vector <uint8> swa_traceback_moves;
+
+	void EncodeTarget (const char *target_s, size_t target_length, bool reverse_flag);
+
+	bool Score (SmithWatermanScore &score_r);
+
+	bool TraceBack (const SmithWatermanScore &score_r, SmithWatermanAlignment &alignment_r);
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_HPP_ */
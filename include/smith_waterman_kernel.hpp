@@ -0,0 +1,317 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * smith_waterman_kernel.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The scoring pass of the Smith-Waterman aligner, written once
+ * against a small set of vector operations so that it can be compiled
+ * for each instruction set that the aligner chooses between at run time.
+ *
+ * This is included by translation units that are compiled for different
+ * instruction sets, so it must not use anything from the standard library
+ * that could be instantiated in one of them and then shared with the others.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_KERNEL_HPP_
+#define SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_KERNEL_HPP_
+
+#include "typedefs.h"
+
+
+/** The code of each query position past the end of the query. */
+#define SW_QUERY_PADDING (7)
+
+/** The code of each target position before the start or after the end of the target. */
+#define SW_TARGET_PADDING (6)
+
+/** The code of any base in the target that is not one of A, C, G or T. */
+#define SW_TARGET_UNKNOWN (5)
+
+/** The code of any base in the query that is not one of A, C, G or T. */
+#define SW_QUERY_UNKNOWN (4)
+
+/** The number of arrays, each of SmithWatermanInput::swi_stride elements, in a workspace. */
+#define SW_NUM_BUFFERS (21)
+
+
+/**
+ * The encoded sequences and scores for a single alignment.
+ *
+ * The DP matrix is filled in one anti-diagonal, i + j, at a time so that
+ * all of the cells being worked on at once are independent of each other.
+ * The query codes are stored by query position so that a vector of them
+ * is a run of consecutive cells on the anti-diagonal, and the target codes
+ * are stored reversed so that the matching target positions are consecutive
+ * too.
+ */
+struct SmithWatermanInput
+{
+	/**
+	 * The query codes at positions 1 to swi_query_length, with position 0
+	 * unused and at least one vector of SW_QUERY_PADDING after the end.
+	 */
+	const void *swi_query_p;
+
+	/**
+	 * The target codes where element (swi_query_length + swi_target_length - j)
+	 * holds the code of target position j, for j from 1 to swi_target_length,
+	 * and every other element is SW_TARGET_PADDING. It must have
+	 * (2 * swi_query_length + swi_target_length + the vector width) elements.
+	 */
+	const void *swi_target_p;
+
+	uint32 swi_query_length;
+
+	uint32 swi_target_length;
+
+	/** SW_NUM_BUFFERS arrays, each of swi_stride elements, that will be overwritten. */
+	void *swi_buffers_p;
+
+	/** The number of elements in each of the arrays, at least swi_query_length + 1 + the vector width. */
+	uint32 swi_stride;
+
+	int32 swi_match;
+
+	int32 swi_mismatch;
+
+	int32 swi_gap_open;
+
+	int32 swi_gap_extend;
+};
+
+
+/**
+ * The best local alignment found by the scoring pass.
+ */
+struct SmithWatermanScore
+{
+	int32 sws_score;
+
+	/** The 1-based query position of the last aligned base. */
+	uint32 sws_query_end;
+
+	/** The 1-based target position of the last aligned base. */
+	uint32 sws_target_end;
+
+	/** The number of identical bases along the alignment. */
+	uint32 sws_matches;
+
+	/** The number of columns in the alignment, including gaps. */
+	uint32 sws_length;
+};
+
+
+/*
+ * Each cell carries the number of matches and the length of the path that
+ * its score came from, as well as the score, so that the identity of the best
+ * alignment is known without a traceback. When two predecessors give the
+ * same score, the diagonal is preferred over a gap in the query, which in
+ * turn is preferred over a gap in the target, and a gap that is being
+ * opened is preferred over one that is being extended.
+ */
+template <typename Ops> void ScoreSmithWatermanKernel (const SmithWatermanInput *input_p, SmithWatermanScore *score_p)
+{
+	typedef typename Ops :: Element Element;
+	typedef typename Ops :: Vector Vector;
+
+	const uint32 qlen = input_p -> swi_query_length;
+	const uint32 tlen = input_p -> swi_target_length;
+	const uint32 stride = input_p -> swi_stride;
+	const Element *query_p = (const Element *) input_p -> swi_query_p;
+	const Element *target_p = (const Element *) input_p -> swi_target_p;
+	Element *buffers_p = (Element *) input_p -> swi_buffers_p;
+
+	/* The H scores and their stats for the 2 previous anti-diagonals and the current one */
+	Element *h2_p = buffers_p;
+	Element *h1_p = h2_p + stride;
+	Element *h0_p = h1_p + stride;
+	Element *hm2_p = h0_p + stride;
+	Element *hm1_p = hm2_p + stride;
+	Element *hm0_p = hm1_p + stride;
+	Element *hl2_p = hm0_p + stride;
+	Element *hl1_p = hl2_p + stride;
+	Element *hl0_p = hl1_p + stride;
+
+	/* The E and F scores and their stats for the previous anti-diagonal and the current one */
+	Element *e1_p = hl0_p + stride;
+	Element *e0_p = e1_p + stride;
+	Element *em1_p = e0_p + stride;
+	Element *em0_p = em1_p + stride;
+	Element *el1_p = em0_p + stride;
+	Element *el0_p = el1_p + stride;
+	Element *f1_p = el0_p + stride;
+	Element *f0_p = f1_p + stride;
+	Element *fm1_p = f0_p + stride;
+	Element *fm0_p = fm1_p + stride;
+	Element *fl1_p = fm0_p + stride;
+	Element *fl0_p = fl1_p + stride;
+
+	const Vector zero = Ops :: Set (0);
+	const Vector one = Ops :: Set (1);
+	const Vector negative = Ops :: Set (Ops :: NEGATIVE);
+	const Vector match = Ops :: Set ((Element) (input_p -> swi_match));
+	const Vector mismatch = Ops :: Set ((Element) (- input_p -> swi_mismatch));
+	const Vector gap_open = Ops :: Set ((Element) (input_p -> swi_gap_open));
+	const Vector gap_extend = Ops :: Set ((Element) (input_p -> swi_gap_extend));
+	const Vector query_padding = Ops :: Set (SW_QUERY_PADDING);
+	const Vector target_padding = Ops :: Set (SW_TARGET_PADDING);
+
+	Element best_score = 0;
+	Vector best = zero;
+
+	score_p -> sws_score = 0;
+	score_p -> sws_query_end = 0;
+	score_p -> sws_target_end = 0;
+	score_p -> sws_matches = 0;
+	score_p -> sws_length = 0;
+
+	for (uint32 i = 0; i < stride; ++ i)
+		{
+			h2_p [i] = h1_p [i] = h0_p [i] = 0;
+			hm2_p [i] = hm1_p [i] = hm0_p [i] = 0;
+			hl2_p [i] = hl1_p [i] = hl0_p [i] = 0;
+			e1_p [i] = e0_p [i] = f1_p [i] = f0_p [i] = Ops :: NEGATIVE;
+			em1_p [i] = em0_p [i] = el1_p [i] = el0_p [i] = 0;
+			fm1_p [i] = fm0_p [i] = fl1_p [i] = fl0_p [i] = 0;
+		}
+
+	for (uint32 d = 2; d <= qlen + tlen; ++ d)
+		{
+			const Element *diagonal_target_p = target_p + (qlen + tlen - d);
+			Element *swap_p;
+
+			for (uint32 i = 1; i <= qlen; i += Ops :: WIDTH)
+				{
+					const Vector q = Ops :: Load (query_p + i);
+					const Vector t = Ops :: Load (diagonal_target_p + i);
+					const Vector invalid = Ops :: Or (Ops :: Equal (q, query_padding), Ops :: Equal (t, target_padding));
+					const Vector same = Ops :: Equal (q, t);
+
+					/* Coming from the diagonal */
+					Vector h = Ops :: AddSaturated (Ops :: Load (h2_p + i - 1), Ops :: Select (same, match, mismatch));
+					Vector hm = Ops :: Add (Ops :: Load (hm2_p + i - 1), Ops :: And (same, one));
+					Vector hl = Ops :: Add (Ops :: Load (hl2_p + i - 1), one);
+
+					/* A gap in the query, from the cell to the left */
+					const Vector e_open = Ops :: SubtractSaturated (Ops :: Load (h1_p + i), gap_open);
+					const Vector e_extend = Ops :: SubtractSaturated (Ops :: Load (e1_p + i), gap_extend);
+					const Vector use_e_extend = Ops :: Greater (e_extend, e_open);
+					Vector e = Ops :: Max (e_open, e_extend);
+					Vector em = Ops :: Select (use_e_extend, Ops :: Load (em1_p + i), Ops :: Load (hm1_p + i));
+					Vector el = Ops :: Add (Ops :: Select (use_e_extend, Ops :: Load (el1_p + i), Ops :: Load (hl1_p + i)), one);
+
+					/* A gap in the target, from the cell above */
+					const Vector f_open = Ops :: SubtractSaturated (Ops :: Load (h1_p + i - 1), gap_open);
+					const Vector f_extend = Ops :: SubtractSaturated (Ops :: Load (f1_p + i - 1), gap_extend);
+					const Vector use_f_extend = Ops :: Greater (f_extend, f_open);
+					Vector f = Ops :: Max (f_open, f_extend);
+					Vector fm = Ops :: Select (use_f_extend, Ops :: Load (fm1_p + i - 1), Ops :: Load (hm1_p + i - 1));
+					Vector fl = Ops :: Add (Ops :: Select (use_f_extend, Ops :: Load (fl1_p + i - 1), Ops :: Load (hl1_p + i - 1)), one);
+
+					Vector use;
+					Vector is_zero;
+
+					use = Ops :: Greater (e, h);
+					h = Ops :: Max (h, e);
+					hm = Ops :: Select (use, em, hm);
+					hl = Ops :: Select (use, el, hl);
+
+					use = Ops :: Greater (f, h);
+					h = Ops :: Max (h, f);
+					hm = Ops :: Select (use, fm, hm);
+					hl = Ops :: Select (use, fl, hl);
+
+					/* A local alignment starts again wherever the score would drop to 0 or below */
+					is_zero = Ops :: Or (Ops :: Greater (one, h), invalid);
+					h = Ops :: Select (is_zero, zero, h);
+					hm = Ops :: Select (is_zero, zero, hm);
+					hl = Ops :: Select (is_zero, zero, hl);
+
+					e = Ops :: Select (invalid, negative, e);
+					em = Ops :: Select (invalid, zero, em);
+					el = Ops :: Select (invalid, zero, el);
+					f = Ops :: Select (invalid, negative, f);
+					fm = Ops :: Select (invalid, zero, fm);
+					fl = Ops :: Select (invalid, zero, fl);
+
+					Ops :: Store (h0_p + i, h);
+					Ops :: Store (hm0_p + i, hm);
+					Ops :: Store (hl0_p + i, hl);
+					Ops :: Store (e0_p + i, e);
+					Ops :: Store (em0_p + i, em);
+					Ops :: Store (el0_p + i, el);
+					Ops :: Store (f0_p + i, f);
+					Ops :: Store (fm0_p + i, fm);
+					Ops :: Store (fl0_p + i, fl);
+
+					/* Only look at the individual cells when one of them beats the best so far */
+					if (Ops :: Any (Ops :: Greater (h, best)))
+						{
+							for (uint32 lane = 0; (lane < Ops :: WIDTH) && (i + lane <= qlen); ++ lane)
+								{
+									if (h0_p [i + lane] > best_score)
+										{
+											best_score = h0_p [i + lane];
+											score_p -> sws_score = (int32) best_score;
+											score_p -> sws_query_end = i + lane;
+											score_p -> sws_target_end = d - (i + lane);
+											score_p -> sws_matches = (uint32) hm0_p [i + lane];
+											score_p -> sws_length = (uint32) hl0_p [i + lane];
+										}
+								}
+
+							best = Ops :: Set (best_score);
+						}
+				}
+
+			swap_p = h2_p; h2_p = h1_p; h1_p = h0_p; h0_p = swap_p;
+			swap_p = hm2_p; hm2_p = hm1_p; hm1_p = hm0_p; hm0_p = swap_p;
+			swap_p = hl2_p; hl2_p = hl1_p; hl1_p = hl0_p; hl0_p = swap_p;
+			swap_p = e1_p; e1_p = e0_p; e0_p = swap_p;
+			swap_p = em1_p; em1_p = em0_p; em0_p = swap_p;
+			swap_p = el1_p; el1_p = el0_p; el0_p = swap_p;
+			swap_p = f1_p; f1_p = f0_p; f0_p = swap_p;
+			swap_p = fm1_p; fm1_p = fm0_p; fm0_p = swap_p;
+			swap_p = fl1_p; fl1_p = fl0_p; fl0_p = swap_p;
+		}
+}
+
+
+#if defined (__x86_64__) || defined (__i386__)
+
+/** Are there vector versions of the scoring pass for this platform? */
+#define SW_HAVE_X86_KERNELS (1)
+
+/**
+ * The scoring pass using SSE4.1, which does 8 cells at a time. It
+ * needs the arrays to be of 16-bit values.
+ */
+void ScoreSmithWatermanSSE41 (const SmithWatermanInput *input_p, SmithWatermanScore *score_p);
+
+/**
+ * The scoring pass using AVX2, which does 16 cells at a time. It
+ * needs the arrays to be of 16-bit values.
+ */
+void ScoreSmithWatermanAVX2 (const SmithWatermanInput *input_p, SmithWatermanScore *score_p);
+
+#endif
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_INCLUDE_SMITH_WATERMAN_KERNEL_HPP_ */
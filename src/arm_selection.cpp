@@ -0,0 +1,259 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * arm_selection.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "arm_selection.hpp"
+
+
+const char * const ArmSelector :: AS_UNKNOWN_ARM_S = "U";
+
+const char * const ArmSelector :: AS_EMBL_S = "arm_selection_embl";
+const char * const ArmSelector :: AS_FIRST_TWO_S = "arm_selection_first_two";
+const char * const ArmSelector :: AS_MOREX_S = "arm_selection_morex";
+const char * const ArmSelector :: AS_SCAFFOLD_S = "scaffold";
+
+
+/* The number of characters of the name used by arm_selection_first_two */
+static const size_t S_ARM_LENGTH = 2;
+
+
+ArmSelector :: ArmSelector ()
+	: as_rule (ASR_EMBL),
+		as_rule_name (AS_EMBL_S),
+		as_field (0)
+{
+}
+
+
+const char *ArmSelector :: GetRule () const
+{
+	return as_rule_name.c_str ();
+}
+
+
+bool ArmSelector :: SetRule (const char *rule_s)
+{
+	const char *comma_s = strchr (rule_s, ',');
+	ArmSelectionRule rule = ASR_FIELD;
+
+	if (strcmp (rule_s, AS_EMBL_S) == 0)
+		{
+			rule = ASR_EMBL;
+		}
+	else if (strcmp (rule_s, AS_FIRST_TWO_S) == 0)
+		{
+			rule = ASR_FIRST_TWO;
+		}
+	else if (strcmp (rule_s, AS_MOREX_S) == 0)
+		{
+			rule = ASR_MOREX;
+		}
+	else if (strcmp (rule_s, AS_SCAFFOLD_S) == 0)
+		{
+			rule = ASR_SCAFFOLD;
+		}
+	else if (comma_s && (comma_s != rule_s) && (strchr (comma_s + 1, ',') == NULL))
+		{
+			/* A custom rule, as in polymarker.rb it needs exactly one comma and the field must be a number */
+			char *end_s = NULL;
+			long field;
+
+			errno = 0;
+			field = strtol (comma_s + 1, &end_s, 10);
+
+			if ((end_s == comma_s + 1) || (*end_s != '\0') || (errno != 0) || (field < INT_MIN) || (field > INT_MAX))
+				{
+					return false;
+				}
+
+			as_separator.assign (rule_s, comma_s - rule_s);
+			as_field = (int32) field;
+		}
+	else
+		{
+			return false;
+		}
+
+	as_rule = rule;
+	as_rule_name.assign (rule_s);
+
+	return true;
+}
+
+
+size_t ArmSelector :: Select (const char *contig_s, size_t contig_length, const char **arm_ss) const
+{
+	switch (as_rule)
+		{
+			case ASR_EMBL:
+				return SelectEmbl (contig_s, contig_length, arm_ss);
+
+			case ASR_FIRST_TWO:
+				*arm_ss = contig_s;
+				return std :: min (contig_length, S_ARM_LENGTH);
+
+			case ASR_MOREX:
+				{
+					const char *colon_s = (const char *) memchr (contig_s, ':', contig_length);
+
+					return SelectField (contig_s, colon_s ? (size_t) (colon_s - contig_s) : contig_length, "_", 1, 1, arm_ss);
+				}
+
+			case ASR_SCAFFOLD:
+				*arm_ss = contig_s;
+				return contig_length;
+
+			case ASR_FIELD:
+				return SelectField (contig_s, contig_length, as_separator.data (), as_separator.size (), as_field, arm_ss);
+		}
+
+	*arm_ss = AS_UNKNOWN_ARM_S;
+	return strlen (AS_UNKNOWN_ARM_S);
+}
+
+
+void ArmSelector :: Select (const std :: string &contig_r, std :: string &arm_r) const
+{
+	const char *arm_s = NULL;
+	const size_t length = Select (contig_r.data (), contig_r.size (), &arm_s);
+
+	arm_r.assign (arm_s, length);
+}
+
+
+bool IsValidArmSelection (const char *rule_s)
+{
+	ArmSelector selector;
+
+	return selector.SetRule (rule_s);
+}
+
+
+/*
+ * The same rules as the arm_selection_embl function in
+ * polymarker_grassroots.rb, which splits the name in the same way as
+ * SelectField.
+ */
+size_t ArmSelector :: SelectEmbl (const char *contig_s, size_t contig_length, const char **arm_ss)
+{
+	const char *end_s = contig_s + contig_length;
+	const char *first_s;
+
+	/* Ruby's String#split drops any empty parts at the end */
+	while ((end_s > contig_s) && (* (end_s - 1) == '_'))
+		{
+			-- end_s;
+		}
+
+	first_s = std :: find (contig_s, end_s, '_');
+
+	if (end_s == contig_s)
+		{
+			/* There are no parts at all */
+		}
+	else if (first_s == end_s)
+		{
+			/* There is only one part so use the start of the name */
+			*arm_ss = contig_s;
+			return std :: min ((size_t) (end_s - contig_s), S_ARM_LENGTH);
+		}
+	else
+		{
+			const char *second_s = std :: find (first_s + 1, end_s, '_');
+
+			if (second_s != end_s)
+				{
+					const char *third_end_s = std :: find (second_s + 1, end_s, '_');
+
+					*arm_ss = second_s + 1;
+					return std :: min ((size_t) (third_end_s - *arm_ss), S_ARM_LENGTH);
+				}
+			else if ((first_s - contig_s == 4) && (strncmp (contig_s, "v443", 4) == 0))
+				{
+					*arm_ss = "3B";
+					return 2;
+				}
+		}
+
+	*arm_ss = AS_UNKNOWN_ARM_S;
+	return strlen (AS_UNKNOWN_ARM_S);
+}
+
+
+/*
+ * Get a field in the same way as Ruby's String#split does, so that
+ * any empty fields at the end of the name are dropped.
+ */
+size_t ArmSelector :: SelectField (const char *contig_s, size_t contig_length, const char *separator_s, size_t separator_length, int32 field, const char **arm_ss)
+{
+	const char *end_s = contig_s + contig_length;
+	const char *start_s = contig_s;
+
+	while ((end_s - contig_s >= (ptrdiff_t) separator_length) && (memcmp (end_s - separator_length, separator_s, separator_length) == 0))
+		{
+			end_s -= separator_length;
+		}
+
+	if (end_s > contig_s)
+		{
+			if (field < 0)
+				{
+					int32 num_fields = 1;
+
+					for (const char *sep_s = std :: search (contig_s, end_s, separator_s, separator_s + separator_length); sep_s != end_s; sep_s = std :: search (sep_s + separator_length, end_s, separator_s, separator_s + separator_length))
+						{
+							++ num_fields;
+						}
+
+					field += num_fields;
+				}
+
+			if (field >= 0)
+				{
+					const char *sep_s = std :: search (start_s, end_s, separator_s, separator_s + separator_length);
+
+					while ((field > 0) && (sep_s != end_s))
+						{
+							start_s = sep_s + separator_length;
+							sep_s = std :: search (start_s, end_s, separator_s, separator_s + separator_length);
+							-- field;
+						}
+
+					if (field == 0)
+						{
+							*arm_ss = start_s;
+							return (size_t) (sep_s - start_s);
+						}
+				}
+		}
+
+	*arm_ss = AS_UNKNOWN_ARM_S;
+	return strlen (AS_UNKNOWN_ARM_S);
+}
@@ -24,9 +24,24 @@
  */
 
 
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include <sys/wait.h>
+
 #include "async_system_polymarker_tool.hpp"
+#include "polymarker_shared_inputs.h"
 #include "polymarker_service_job.h"
 #include "polymarker_utils.h"
+#include "polymarker_worker_pool.h"
+#include "polymarker_process_monitor.h"
+#include "polymarker_job_limits.h"
+#include "polymarker_job_progress.h"
 
 #include "string_utils.h"
 #include "jobs_manager.h"
@@ -50,16 +65,41 @@ const char * const AsyncSystemPolymarkerTool :: ASPT_LOGFILE_S = "logfile";
 
 const char * const AsyncSystemPolymarkerTool :: ASPT_EXECUTABLE_S = "executable";
 
+const char * const AsyncSystemPolymarkerTool :: ASPT_CANCELLED_S = "The job was cancelled";
+
+const char * const AsyncSystemPolymarkerTool :: ASPT_TIMED_OUT_S = "The job was stopped for running longer than its time limit";
+
+const char * const AsyncSystemPolymarkerTool :: ASPT_CPU_LIMIT_S = "The job was stopped for using more than its CPU time limit";
+
+const uint32 AsyncSystemPolymarkerTool :: ASPT_KILL_GRACE_PERIOD = 10;
+
+const uint32 AsyncSystemPolymarkerTool :: ASPT_CPU_CHECK_PERIOD = 1;
+
 
 static bool UpdateAsyncPolymarkerServiceJob (struct ServiceJob *job_p);
 
+static void *RunJobOnWorkerPool (void *data_p);
+
+static void *RunMonitoredJob (void *data_p);
+
+static void OnPolymarkerStatusLine (void *data_p, const char *line_s);
+
+static void OnPolymarkerProcessExit (void *data_p, bool exited_flag, int exit_code);
+
 
 
 AsyncSystemPolymarkerTool :: AsyncSystemPolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p)
 : PolymarkerTool (job_p, seq_p, data_p),
 	aspt_executable_s (0),
 	aspt_command_line_args_s (0),
-	aspt_async_logfile_s (0)
+	aspt_async_logfile_s (0),
+	aspt_task_p (0),
+	aspt_worker_task_p (0),
+	aspt_monitored_task_p (0),
+	aspt_process_exited_flag (false),
+	aspt_exit_code_known_flag (false),
+	aspt_exit_code (0),
+	aspt_cancel_requested_flag (false)
 {
 	bool alloc_flag = false;
 	const char *program_name_s = 0;
@@ -73,7 +113,7 @@ AsyncSystemPolymarkerTool :: AsyncSystemPolymarkerTool (PolymarkerServiceJob *jo
 
 			if (aspt_task_p)
 				{
-					alloc_flag = true;
+					alloc_flag = SetWorkerTask (data_p) && SetMonitoredTask (data_p);
 				}
 			else
 				{
@@ -99,6 +139,16 @@ AsyncSystemPolymarkerTool :: ~AsyncSystemPolymarkerTool ()
 			FreeCopiedString (aspt_command_line_args_s);
 		}
 
+	if (aspt_worker_task_p)
+		{
+			FreeAsyncTask (aspt_worker_task_p);
+		}
+
+	if (aspt_monitored_task_p)
+		{
+			FreeAsyncTask (aspt_monitored_task_p);
+		}
+
 	FreeSystemAsyncTask (aspt_task_p);
 }
 
@@ -107,7 +157,13 @@ AsyncSystemPolymarkerTool :: AsyncSystemPolymarkerTool (PolymarkerServiceJob *jo
 	: PolymarkerTool (job_p, seq_p, data_p, root_p),
 		aspt_executable_s (0),
 		aspt_command_line_args_s (0),
-		aspt_task_p (0)
+		aspt_task_p (0),
+		aspt_worker_task_p (0),
+		aspt_monitored_task_p (0),
+		aspt_process_exited_flag (false),
+		aspt_exit_code_known_flag (false),
+		aspt_exit_code (0),
+		aspt_cancel_requested_flag (false)
 {
 	bool alloc_flag = false;
 
@@ -139,7 +195,7 @@ AsyncSystemPolymarkerTool :: AsyncSystemPolymarkerTool (PolymarkerServiceJob *jo
 
 					if (aspt_task_p)
 						{
-							alloc_flag = true;
+							alloc_flag = SetWorkerTask (data_p) && SetMonitoredTask (data_p);
 						}
 					else
 						{
@@ -187,6 +243,66 @@ bool AsyncSystemPolymarkerTool :: SetExecutable (const PolymarkerServiceData *da
 }
 
 
+bool AsyncSystemPolymarkerTool :: SetWorkerTask (const PolymarkerServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (data_p -> psd_worker_pool_p)
+		{
+			success_flag = false;
+			aspt_worker_task_p = AllocateAsyncTask ("AsyncSystemPolymarkerTool worker", data_p -> psd_task_manager_p, true);
+
+			if (aspt_worker_task_p)
+				{
+					if (SetAsyncTaskRunData (aspt_worker_task_p, RunJobOnWorkerPool, this))
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set worker task data for AsyncSystemPolymarkerTool");
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate worker AsyncTask for AsyncSystemPolymarkerTool");
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool AsyncSystemPolymarkerTool :: SetMonitoredTask (const PolymarkerServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if ((data_p -> psd_process_monitor_p) && (! (data_p -> psd_worker_pool_p)))
+		{
+			success_flag = false;
+			aspt_monitored_task_p = AllocateAsyncTask ("AsyncSystemPolymarkerTool monitored", data_p -> psd_task_manager_p, true);
+
+			if (aspt_monitored_task_p)
+				{
+					if (SetAsyncTaskRunData (aspt_monitored_task_p, RunMonitoredJob, this))
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set monitored task data for AsyncSystemPolymarkerTool");
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate monitored AsyncTask for AsyncSystemPolymarkerTool");
+				}
+		}
+
+	return success_flag;
+}
+
+
 PolymarkerToolType AsyncSystemPolymarkerTool :: GetToolType () const
 {
 	return PTT_SYSTEM;
@@ -217,49 +333,56 @@ bool AsyncSystemPolymarkerTool :: ParseParameters (const ParameterSet * const pa
 						{
 							if (AppendStringsToByteBuffer (buffer_p, aspt_executable_s, " --contigs ", pt_seq_p -> ps_fasta_filename_s, " --output ", pt_job_dir_s, " --aligner ", pt_service_data_p -> psd_aligner_s, NULL))
 								{
-									char *markers_filename_s = MakeFilename (pt_job_dir_s, "markers_list");
-
-									if (markers_filename_s)
+									if (pt_shared_inputs_p)
 										{
-											if (CreateAndAddMarkerListFile (markers_filename_s, param_set_p, buffer_p))
-												{
-													char *prefs_file_s = WritePrimer3Config (param_set_p, pt_job_dir_s, pt_service_data_p);
+											success_flag = AddSharedInputs (buffer_p);
+										}
+									else
+										{
+											char *markers_filename_s = MakeFilename (pt_job_dir_s, "markers_list");
 
-													/*
-													 * use a custom primer3 config
-													 */
-													if (prefs_file_s)
+											if (markers_filename_s)
+												{
+													if (CreateAndAddMarkerListFile (markers_filename_s, param_set_p, pt_seq_p -> ps_arm_selection_s, buffer_p))
 														{
-															if (AppendStringsToByteBuffer (buffer_p, " --primer_3_preferences ", prefs_file_s, NULL))
+															char *prefs_file_s = WritePrimer3Config (param_set_p, pt_job_dir_s, pt_service_data_p);
+
+															/*
+															 * use a custom primer3 config
+															 */
+															if (prefs_file_s)
 																{
-																	success_flag = true;
+																	if (AppendStringsToByteBuffer (buffer_p, " --primer_3_preferences ", prefs_file_s, NULL))
+																		{
+																			success_flag = true;
+																		}
+																	else
+																		{
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to append --primer_3_preferences %s to buffer for job %s", prefs_file_s, uuid_s);
+																		}
+
+																	FreeCopiedString (prefs_file_s);
 																}
 															else
 																{
-																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to append --primer_3_preferences %s to buffer for job %s", prefs_file_s, uuid_s);
+																	/*
+																	 * use the default primer3 config
+																	 */
+																	success_flag = true;
 																}
 
-															FreeCopiedString (prefs_file_s);
-														}
+														}		/* if (CreateMarkerListFile (markers_filename_s, param_set_p)) */
 													else
 														{
-															/*
-															 * use the default primer3 config
-															 */
-															success_flag = true;
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "CreateMarkerListFile failed for \"%s\" for job %s", markers_filename_s, uuid_s);
 														}
 
-												}		/* if (CreateMarkerListFile (markers_filename_s, param_set_p)) */
+													FreeCopiedString (markers_filename_s);
+												}		/* if (markers_filename_s) */
 											else
 												{
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "CreateMarkerListFile failed for \"%s\" for job %s", markers_filename_s, uuid_s);
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "MakeFilename failed for \"%s\" and \"markers_list\" for job %s", pt_job_dir_s, uuid_s);
 												}
-
-											FreeCopiedString (markers_filename_s);
-										}		/* if (markers_filename_s) */
-									else
-										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "MakeFilename failed for \"%s\" and \"markers_list\" for job %s", pt_job_dir_s, uuid_s);
 										}
 
 								}		/* if (AppendStringsToByteBuffer (buffer_p, aspt_executable_s, " --contigs ", pt_seq_p -> ps_fasta_filename_s, " --output ", pt_job_dir_s, " --aligner ", pt_service_data_p -> psd_aligner_s, NULL */
@@ -333,7 +456,12 @@ OperationStatus AsyncSystemPolymarkerTool :: Run ()
 
 	if (aspt_command_line_args_s)
 		{
-			if (SetSystemAsyncTaskCommand	(aspt_task_p, aspt_command_line_args_s))
+			/*
+			 * If there is a pool of workers, they are already running so
+			 * the job only needs to be passed to one of them. A monitored
+			 * job starts its own process.
+			 */
+			if ((aspt_worker_task_p) || (aspt_monitored_task_p) || (SetSystemAsyncTaskCommand	(aspt_task_p, aspt_command_line_args_s)))
 				{
 					GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (base_job_p -> sj_service_p);
 					JobsManager *manager_p = GetJobsManager (grassroots_p);
@@ -347,7 +475,22 @@ OperationStatus AsyncSystemPolymarkerTool :: Run ()
 							status = OS_PENDING;
 							SetServiceJobStatus (base_job_p, status);
 
-							if (RunSystemAsyncTask (aspt_task_p))
+							bool started_flag;
+
+							if (aspt_worker_task_p)
+								{
+									started_flag = RunAsyncTask (aspt_worker_task_p);
+								}
+							else if (aspt_monitored_task_p)
+								{
+									started_flag = RunAsyncTask (aspt_monitored_task_p);
+								}
+							else
+								{
+									started_flag = RunSystemAsyncTask (aspt_task_p);
+								}
+
+							if (started_flag)
 								{
 									/*
 									 * The ServiceJob should now only be writeable by the SystemAsyncTask that it is running under.
@@ -405,81 +548,510 @@ OperationStatus AsyncSystemPolymarkerTool :: Run ()
 
 
 
-bool AsyncSystemPolymarkerTool :: AddToJSON (json_t *root_p)
+/*
+ * Link the markers_list and primer3.prefs that were written once for the
+ * whole request into the job directory and add them to the command line.
+ */
+bool AsyncSystemPolymarkerTool :: AddSharedInputs (ByteBuffer *buffer_p)
 {
-	bool success_flag = PolymarkerTool :: AddToJSON (root_p);
+	bool success_flag = false;
+	char *markers_filename_s = LinkPolymarkerSharedInput (pt_shared_inputs_p -> psi_markers_filename_s, pt_job_dir_s, "markers_list");
 
-	if (success_flag)
+	if (markers_filename_s)
 		{
-			if (json_object_set_new (root_p, AsyncSystemPolymarkerTool :: ASPT_ASYNC_S, json_true ()) == 0)
+			bool arm_selection_flag;
+
+			if (! (pt_shared_inputs_p -> psi_has_chromosome_flag))
 				{
-					if (aspt_async_logfile_s)
+					arm_selection_flag = AppendStringsToByteBuffer (buffer_p, " --arm_selection arm_selection_first_two", NULL);
+				}
+			else if (pt_seq_p -> ps_arm_selection_s)
+				{
+					arm_selection_flag = AppendStringsToByteBuffer (buffer_p, " --arm_selection '", pt_seq_p -> ps_arm_selection_s, "'", NULL);
+				}
+			else
+				{
+					arm_selection_flag = true;
+				}
+
+			if (arm_selection_flag && AppendStringsToByteBuffer (buffer_p, " --marker_list ", markers_filename_s, NULL))
+				{
+					if (pt_shared_inputs_p -> psi_primer3_prefs_filename_s)
 						{
-							if (json_object_set_new (root_p, AsyncSystemPolymarkerTool :: ASPT_LOGFILE_S, json_string (aspt_async_logfile_s)) != 0)
+							char *prefs_filename_s = LinkPolymarkerSharedInput (pt_shared_inputs_p -> psi_primer3_prefs_filename_s, pt_job_dir_s, "primer3.prefs");
+
+							if (prefs_filename_s)
 								{
-									success_flag = false;
+									success_flag = AppendStringsToByteBuffer (buffer_p, " --primer_3_preferences ", prefs_filename_s, NULL);
+									FreeCopiedString (prefs_filename_s);
 								}
 						}
+					else
+						{
+							/*
+							 * use the default primer3 config
+							 */
+							success_flag = true;
+						}
 				}
-			else
+
+			FreeCopiedString (markers_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool AsyncSystemPolymarkerTool :: RunInDirectory (const char *dir_s, char **error_ss)
+{
+	bool success_flag = false;
+	const char *error_s = NULL;
+
+	if (aspt_command_line_args_s && pt_job_dir_s)
+		{
+			/*
+			 * Use the same command line but with this job's directory swapped
+			 * for the requested one.
+			 */
+			std :: string command (aspt_command_line_args_s);
+			const std :: string job_dir (pt_job_dir_s);
+			size_t pos = 0;
+			char *prefs_filename_s;
+
+			while ((pos = command.find (job_dir, pos)) != std :: string :: npos)
 				{
-					success_flag = false;
+					command.replace (pos, job_dir.size (), dir_s);
+					pos += strlen (dir_s);
 				}
 
+			/* Take a copy of any custom primer3 config */
+			prefs_filename_s = MakeFilename (pt_job_dir_s, "primer3.prefs");
 
-		}		/* if (success_flag) */
+			if (prefs_filename_s)
+				{
+					char *prefs_s = GetFileContentsAsStringByFilename (prefs_filename_s);
+
+					if (prefs_s)
+						{
+							char *new_prefs_filename_s = MakeFilename (dir_s, "primer3.prefs");
+
+							if (new_prefs_filename_s)
+								{
+									FILE *prefs_f = fopen (new_prefs_filename_s, "w");
+
+									if (prefs_f)
+										{
+											fputs (prefs_s, prefs_f);
+											fclose (prefs_f);
+										}
+
+									FreeCopiedString (new_prefs_filename_s);
+								}
+
+							FreeCopiedString (prefs_s);
+						}
+
+					FreeCopiedString (prefs_filename_s);
+				}
+
+			if (pt_service_data_p -> psd_worker_pool_p)
+				{
+					success_flag = RunJobOnPolymarkerWorkerPool (pt_service_data_p -> psd_worker_pool_p, command.c_str () + strlen (aspt_executable_s), OnPolymarkerStatusLine, this, error_ss);
+				}
+			else
+				{
+					int res = system (command.c_str ());
+
+					if ((res != -1) && (WIFEXITED (res)) && (WEXITSTATUS (res) == 0))
+						{
+							success_flag = true;
+						}
+					else
+						{
+							error_s = "Polymarker failed";
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" returned %d", command.c_str (), res);
+						}
+				}
+		}
 	else
 		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AsyncSystemPolymarkerTool :: AddToJSON failed");
+			error_s = "No command to run";
+		}
+
+	if ((!success_flag) && error_ss && error_s)
+		{
+			*error_ss = CopyToNewString (error_s, 0, false);
 		}
 
 	return success_flag;
 }
 
 
-
-OperationStatus AsyncSystemPolymarkerTool :: GetStatus (bool update_flag)
+void AsyncSystemPolymarkerTool :: RunOnWorkerPool ()
 {
-	OperationStatus status = GetCachedServiceJobStatus (& (pt_service_job_p -> psj_base_job));
+	ServiceJob *base_job_p = & (pt_service_job_p -> psj_base_job);
+	char *error_s = NULL;
 
-/*
-	if (update_flag)
+	/*
+	 * The command line starts with the executable which the workers
+	 * are already running, so only send them its arguments.
+	 */
+	const char *args_s = aspt_command_line_args_s + strlen (aspt_executable_s);
+
+	SetServiceJobStatus (base_job_p, OS_STARTED);
+
+	if (RunJobOnPolymarkerWorkerPool (pt_service_data_p -> psd_worker_pool_p, args_s, OnPolymarkerStatusLine, this, &error_s))
+		{
+			SetServiceJobStatus (base_job_p, OS_SUCCEEDED);
+		}
+	else
 		{
-			JobsManager *manager_p = GetJobsManager ();
-			ServiceJob *job_p = GetServiceJobFromJobsManager (manager_p, bt_job_p -> psj_base_job.sj_id);
+			SetServiceJobStatus (base_job_p, OS_FAILED);
 
-			if (job_p)
+			if (error_s)
 				{
-					status = job_p -> sj_status;
-					SetServiceJobStatus (& (bt_job_p -> psj_base_job), status);
+					if (!AddGeneralErrorMessageToServiceJob (base_job_p, error_s))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", error_s);
+						}
+
+					FreeCopiedString (error_s);
 				}
+		}
+
+	PolymarkerServiceJobCompleted (base_job_p);
+}
+
+
+void AsyncSystemPolymarkerTool :: RunMonitored ()
+{
+	ServiceJob *base_job_p = & (pt_service_job_p -> psj_base_job);
+	const PolymarkerJobLimits *limits_p = pt_service_data_p -> psd_job_limits_p;
+	OperationStatus status = OS_FAILED;
+	std :: string error;
+	bool cancelled_flag;
+
+	{
+		std :: lock_guard <std :: mutex> lock (aspt_exit_mutex);
+
+		aspt_process_exited_flag = false;
+		aspt_exit_code_known_flag = false;
+		aspt_exit_code = 0;
+		cancelled_flag = aspt_cancel_requested_flag;
+	}
+
+	if (cancelled_flag)
+		{
+			error = ASPT_CANCELLED_S;
+		}
+	else
+		{
+			char *cgroup_dir_s = NULL;
+			pid_t pid;
 
-			#if ASYNC_SYSTEM_POLYMARKER_TOOL_DEBUG >= STM_LEVEL_FINE
+			if (limits_p)
 				{
 					char uuid_s [UUID_STRING_BUFFER_SIZE];
 
-					ConvertUUIDToString (bt_job_p -> psj_base_job.sj_id, uuid_s);
-					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Status " INT32_FMT " for uuid %s", status, uuid_s);
+					ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+					cgroup_dir_s = CreatePolymarkerJobCgroup (limits_p, uuid_s);
+				}
+
+			pid = SpawnPolymarkerProcess (aspt_command_line_args_s, limits_p, cgroup_dir_s);
+
+			if (pid > 0)
+				{
+					bool monitored_flag;
+					const char *stopped_s;
+
+					SetServiceJobStatus (base_job_p, OS_STARTED);
+
+					monitored_flag = MonitorPolymarkerProcess (pt_service_data_p -> psd_process_monitor_p, pid, pt_job_dir_s, OnPolymarkerStatusLine, OnPolymarkerProcessExit, this);
+
+					stopped_s = WaitForProcess (pid, monitored_flag, cgroup_dir_s);
+
+					if (stopped_s)
+						{
+							error = stopped_s;
+						}
+					else if (aspt_exit_code_known_flag)
+						{
+							if (aspt_exit_code == 0)
+								{
+									status = OS_SUCCEEDED;
+								}
+							else if (aspt_exit_code == 128 + SIGXCPU)
+								{
+									/* Without a cgroup, the limit is each process' RLIMIT_CPU */
+									error = "The job was stopped for using more than its CPU time limit of " + std :: to_string (limits_p ? limits_p -> pjl_cpu_limit : 0) + " seconds";
+								}
+							else if ((aspt_exit_code == 128 + SIGKILL) && cgroup_dir_s && (limits_p -> pjl_memory_max_s))
+								{
+									error = "The job was killed, it may have used more than its memory limit of ";
+									error.append (limits_p -> pjl_memory_max_s);
+								}
+							else
+								{
+									error = "Polymarker failed";
+								}
+						}
+					else
+						{
+							/*
+							 * The monitor was stopped before the process exited so
+							 * go by whether the results have been written.
+							 */
+							char *primers_filename_s = MakeFilename (pt_job_dir_s, "primers.csv");
+
+							if (primers_filename_s)
+								{
+									if (access (primers_filename_s, R_OK) == 0)
+										{
+											status = OS_SUCCEEDED;
+										}
+
+									FreeCopiedString (primers_filename_s);
+								}
+
+							if (status != OS_SUCCEEDED)
+								{
+									error = "Polymarker failed";
+								}
+						}
+
+					if (status != OS_SUCCEEDED)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" exited with %d, %s", aspt_command_line_args_s, aspt_exit_code, error.c_str ());
+						}
+				}
+			else
+				{
+					status = OS_FAILED_TO_START;
+					error = "Failed to start Polymarker";
+				}
+
+			if (cgroup_dir_s)
+				{
+					RemovePolymarkerJobCgroup (cgroup_dir_s);
+					FreeCopiedString (cgroup_dir_s);
+				}
+		}
+
+	SetServiceJobStatus (base_job_p, status);
+
+	if (!error.empty ())
+		{
+			if (!AddGeneralErrorMessageToServiceJob (base_job_p, error.c_str ()))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", error.c_str ());
 				}
-			#endif
+		}
+
+	PolymarkerServiceJobCompleted (base_job_p);
+}
 
 
-			if ((status == OS_SUCCEEDED) || (status == OS_PARTIALLY_SUCCEEDED) || (status == OS_FINISHED))
+/*
+ * Wait for the job's process to exit, stopping it if the job is cancelled,
+ * runs for too long or, if it is in a cgroup, its processes between them
+ * use more than the CPU time limit. It is sent SIGTERM first and then, if
+ * it hasn't stopped after ASPT_KILL_GRACE_PERIOD seconds, SIGKILL.
+ */
+const char *AsyncSystemPolymarkerTool :: WaitForProcess (pid_t pid, bool monitored_flag, const char *cgroup_dir_s)
+{
+	typedef std :: chrono :: steady_clock Clock;
+
+	const PolymarkerJobLimits *limits_p = pt_service_data_p -> psd_job_limits_p;
+	const uint32 time_limit = limits_p ? limits_p -> pjl_wall_clock_limit : 0;
+	const uint64 cpu_limit_usec = (limits_p && cgroup_dir_s) ? ((uint64) (limits_p -> pjl_cpu_limit)) * 1000000 : 0;
+	const Clock :: time_point deadline = Clock :: now () + std :: chrono :: seconds (time_limit);
+	Clock :: time_point kill_time;
+	const char *stopped_s = NULL;
+	bool killed_flag = false;
+	std :: unique_lock <std :: mutex> lock (aspt_exit_mutex);
+
+	while (!aspt_process_exited_flag)
+		{
+			const Clock :: time_point now = Clock :: now ();
+			Clock :: time_point wake_time = now + std :: chrono :: hours (1);
+
+			if (!monitored_flag)
 				{
-					if (bt_job_p -> psj_base_job.sj_result_p == NULL)
+					/* Nothing will tell us when the process exits so check regularly */
+					int wait_status;
+
+					if (waitpid (pid, &wait_status, WNOHANG) == pid)
 						{
-							if (!DeterminePolymarkerResult (bt_job_p))
+							if (WIFEXITED (wait_status))
+								{
+									aspt_exit_code_known_flag = true;
+									aspt_exit_code = WEXITSTATUS (wait_status);
+								}
+							else if (WIFSIGNALED (wait_status))
 								{
+									aspt_exit_code_known_flag = true;
+									aspt_exit_code = 128 + WTERMSIG (wait_status);
+								}
 
+							aspt_process_exited_flag = true;
+							break;
+						}
+
+					wake_time = now + std :: chrono :: seconds (1);
+				}
+
+			if (!stopped_s)
+				{
+					if (aspt_cancel_requested_flag)
+						{
+							stopped_s = ASPT_CANCELLED_S;
+						}
+					else if ((time_limit > 0) && (now >= deadline))
+						{
+							stopped_s = ASPT_TIMED_OUT_S;
+						}
+					else
+						{
+							if ((time_limit > 0) && (deadline < wake_time))
+								{
+									wake_time = deadline;
+								}
+
+							if (cpu_limit_usec > 0)
+								{
+									uint64 usage_usec;
+
+									if (GetPolymarkerJobCgroupCpuUsage (cgroup_dir_s, &usage_usec) && (usage_usec >= cpu_limit_usec))
+										{
+											stopped_s = ASPT_CPU_LIMIT_S;
+										}
+									else
+										{
+											const Clock :: time_point check_time = now + std :: chrono :: seconds (ASPT_CPU_CHECK_PERIOD);
+
+											if (check_time < wake_time)
+												{
+													wake_time = check_time;
+												}
+										}
 								}
 						}
+
+					if (stopped_s)
+						{
+							SignalPolymarkerProcess (pid, SIGTERM);
+							kill_time = now + std :: chrono :: seconds (ASPT_KILL_GRACE_PERIOD);
+							wake_time = kill_time;
+						}
+				}
+			else if (!killed_flag)
+				{
+					if (now >= kill_time)
+						{
+							SignalPolymarkerProcess (pid, SIGKILL);
+							killed_flag = true;
+						}
+					else if (kill_time < wake_time)
+						{
+							wake_time = kill_time;
+						}
 				}
+
+			aspt_exit_cond.wait_until (lock, wake_time);
 		}
+
+	return stopped_s;
+}
+
+
+bool AsyncSystemPolymarkerTool :: Cancel ()
+{
+	bool cancelled_flag = false;
+
+	/* Only a process that we started ourselves can be stopped */
+	if (aspt_monitored_task_p)
+		{
+			std :: lock_guard <std :: mutex> lock (aspt_exit_mutex);
+
+			aspt_cancel_requested_flag = true;
+			aspt_exit_cond.notify_one ();
+
+			cancelled_flag = true;
+		}
+
+	return cancelled_flag;
+}
+
+
+void AsyncSystemPolymarkerTool :: StatusLineWritten (const char *line_s)
+{
+	#if ASYNC_SYSTEM_POLYMARKER_TOOL_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Status \"%s\" for \"%s\"", line_s, pt_job_dir_s);
+	#endif
+
+	/* The line has already been read so there's no need to read status.txt again */
+	AddPolymarkerJobStatusLine (pt_progress_p, line_s);
+
+	/* Anything in status.txt means that the pipeline is under way */
+	if (GetCachedServiceJobStatus (& (pt_service_job_p -> psj_base_job)) != OS_STARTED)
+		{
+			SetServiceJobStatus (& (pt_service_job_p -> psj_base_job), OS_STARTED);
+		}
+}
+
+
+void AsyncSystemPolymarkerTool :: ProcessExited (bool exited_flag, int exit_code)
+{
+	std :: lock_guard <std :: mutex> lock (aspt_exit_mutex);
+
+	aspt_exit_code_known_flag = exited_flag;
+	aspt_exit_code = exit_code;
+	aspt_process_exited_flag = true;
+
+	aspt_exit_cond.notify_one ();
+}
+
+
+bool AsyncSystemPolymarkerTool :: AddToJSON (json_t *root_p)
+{
+	bool success_flag = PolymarkerTool :: AddToJSON (root_p);
+
+	if (success_flag)
+		{
+			if (json_object_set_new (root_p, AsyncSystemPolymarkerTool :: ASPT_ASYNC_S, json_true ()) == 0)
+				{
+					if (aspt_async_logfile_s)
+						{
+							if (json_object_set_new (root_p, AsyncSystemPolymarkerTool :: ASPT_LOGFILE_S, json_string (aspt_async_logfile_s)) != 0)
+								{
+									success_flag = false;
+								}
+						}
+				}
+			else
+				{
+					success_flag = false;
+				}
+
+
+		}		/* if (success_flag) */
 	else
 		{
-			status = GetCachedServiceJobStatus (& (bt_job_p -> psj_base_job));
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AsyncSystemPolymarkerTool :: AddToJSON failed");
 		}
-*/
+
+	return success_flag;
+}
+
+
+
+OperationStatus AsyncSystemPolymarkerTool :: GetStatus (bool update_flag)
+{
+	/*
+	 * The status is updated by the task running the job as soon as
+	 * anything changes, so the cached value is always current.
+	 */
+	OperationStatus status = GetCachedServiceJobStatus (& (pt_service_job_p -> psj_base_job));
 
 	return status;
 }
@@ -524,3 +1096,35 @@ static bool UpdateAsyncPolymarkerServiceJob (struct ServiceJob *job_p)
 
 	return true;
 }
+
+
+static void *RunJobOnWorkerPool (void *data_p)
+{
+	AsyncSystemPolymarkerTool *tool_p = static_cast <AsyncSystemPolymarkerTool *> (data_p);
+
+	tool_p -> RunOnWorkerPool ();
+
+	return NULL;
+}
+
+
+static void *RunMonitoredJob (void *data_p)
+{
+	AsyncSystemPolymarkerTool *tool_p = static_cast <AsyncSystemPolymarkerTool *> (data_p);
+
+	tool_p -> RunMonitored ();
+
+	return NULL;
+}
+
+
+static void OnPolymarkerStatusLine (void *data_p, const char *line_s)
+{
+	static_cast <AsyncSystemPolymarkerTool *> (data_p) -> StatusLineWritten (line_s);
+}
+
+
+static void OnPolymarkerProcessExit (void *data_p, bool exited_flag, int exit_code)
+{
+	static_cast <AsyncSystemPolymarkerTool *> (data_p) -> ProcessExited (exited_flag, exit_code);
+}
@@ -0,0 +1,666 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * exonerate_parser.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exonerate_parser.hpp"
+
+#include "streams.h"
+
+
+/* The index used for ids that haven't been added and for targets whose arm hasn't been worked out */
+static const uint32 S_NO_ID = 0xFFFFFFFFu;
+
+/* The prefix of each hit line */
+static const char S_RESULT_PREFIX_S [] = "RESULT:\t";
+
+/* The number of bytes read from a pipe at a time */
+static const size_t S_STREAM_BUFFER_SIZE = 65536;
+
+
+static uint64 HashName (const char *name_s, size_t length);
+
+static bool GetNextField (const char **pos_ss, const char *end_s, const char **field_ss, size_t *field_length_p);
+
+static bool ParseUnsignedField (const char *field_s, size_t length, uint64 *value_p);
+
+static bool ParseIntegerField (const char *field_s, size_t length, int32 *value_p);
+
+static bool ParseRealField (const char *field_s, size_t length, double *value_p);
+
+
+/*
+ * EXONERATE HIT TABLE
+ */
+
+ExonerateHitTable :: ExonerateHitTable ()
+	: eht_arm_selector_p (0)
+{
+}
+
+
+void ExonerateHitTable :: SetArmSelector (const ArmSelector *selector_p)
+{
+	eht_arm_selector_p = selector_p;
+}
+
+
+size_t ExonerateHitTable :: GetNumHits () const
+{
+	return eht_query_ids.size ();
+}
+
+
+void ExonerateHitTable :: Clear ()
+{
+	eht_query_ids.clear ();
+	eht_query_starts.clear ();
+	eht_query_ends.clear ();
+	eht_query_strands.clear ();
+	eht_target_ids.clear ();
+	eht_target_starts.clear ();
+	eht_target_ends.clear ();
+	eht_target_strands.clear ();
+	eht_scores.clear ();
+	eht_identities.clear ();
+	eht_query_lengths.clear ();
+	eht_target_lengths.clear ();
+	eht_gene_orientations.clear ();
+	eht_vulgar_offsets.clear ();
+	eht_vulgar_lengths.clear ();
+	eht_vulgars.clear ();
+
+	eht_names.clear ();
+	eht_name_ids.clear ();
+	eht_name_arms.clear ();
+	eht_query_rows.clear ();
+	eht_arms.clear ();
+	eht_arm_ids.clear ();
+}
+
+
+size_t ExonerateHitTable :: AddHit (const PolymarkerHit &hit_r)
+{
+	const uint32 query_id = AddName (hit_r.ph_query_id.data (), hit_r.ph_query_id.size ());
+	const uint32 target_id = AddTarget (hit_r.ph_target_id.data (), hit_r.ph_target_id.size ());
+	const char gene_orientation = hit_r.ph_gene_orientation.empty () ? '.' : hit_r.ph_gene_orientation [0];
+
+	return AddRow (query_id, hit_r.ph_query_start, hit_r.ph_query_end, hit_r.ph_query_strand,
+		target_id, hit_r.ph_target_start, hit_r.ph_target_end, hit_r.ph_target_strand,
+		hit_r.ph_score, hit_r.ph_identity, hit_r.ph_query_length, hit_r.ph_target_length,
+		gene_orientation, hit_r.ph_vulgar.data (), hit_r.ph_vulgar.size ());
+}
+
+
+size_t ExonerateHitTable :: AddHit (const ExonerateHitTable &table_r, size_t row)
+{
+	const std :: string &query_r = table_r.eht_names [table_r.eht_query_ids [row]];
+	const std :: string &target_r = table_r.eht_names [table_r.eht_target_ids [row]];
+	const uint32 query_id = AddName (query_r.data (), query_r.size ());
+	const uint32 target_id = AddTarget (target_r.data (), target_r.size ());
+
+	return AddRow (query_id, table_r.eht_query_starts [row], table_r.eht_query_ends [row], table_r.eht_query_strands [row],
+		target_id, table_r.eht_target_starts [row], table_r.eht_target_ends [row], table_r.eht_target_strands [row],
+		table_r.eht_scores [row], table_r.eht_identities [row], table_r.eht_query_lengths [row], table_r.eht_target_lengths [row],
+		table_r.eht_gene_orientations [row], table_r.eht_vulgars.data () + table_r.eht_vulgar_offsets [row], table_r.eht_vulgar_lengths [row]);
+}
+
+
+void ExonerateHitTable :: GetHit (size_t row, PolymarkerHit &hit_r) const
+{
+	hit_r.ph_query_id = eht_names [eht_query_ids [row]];
+	hit_r.ph_query_start = eht_query_starts [row];
+	hit_r.ph_query_end = eht_query_ends [row];
+	hit_r.ph_query_strand = eht_query_strands [row];
+
+	hit_r.ph_target_id = eht_names [eht_target_ids [row]];
+	hit_r.ph_target_start = eht_target_starts [row];
+	hit_r.ph_target_end = eht_target_ends [row];
+	hit_r.ph_target_strand = eht_target_strands [row];
+
+	hit_r.ph_score = eht_scores [row];
+	hit_r.ph_identity = eht_identities [row];
+	hit_r.ph_query_length = eht_query_lengths [row];
+	hit_r.ph_target_length = eht_target_lengths [row];
+
+	hit_r.ph_gene_orientation.assign (1, eht_gene_orientations [row]);
+	hit_r.ph_vulgar.assign (eht_vulgars, eht_vulgar_offsets [row], eht_vulgar_lengths [row]);
+
+	if (eht_arm_selector_p)
+		{
+			hit_r.ph_chromosome = GetArm (row);
+		}
+}
+
+
+const std :: string &ExonerateHitTable :: GetQueryId (size_t row) const
+{
+	return eht_names [eht_query_ids [row]];
+}
+
+
+const std :: string &ExonerateHitTable :: GetTargetId (size_t row) const
+{
+	return eht_names [eht_target_ids [row]];
+}
+
+
+const std :: string &ExonerateHitTable :: GetArm (size_t row) const
+{
+	static const std :: string s_no_arm;
+	const uint32 arm_id = eht_name_arms [eht_target_ids [row]];
+
+	return (arm_id != S_NO_ID) ? eht_arms [arm_id] : s_no_arm;
+}
+
+
+void ExonerateHitTable :: MoveTarget (size_t row, const std :: string &target_id_r, uint64 offset, uint64 target_length)
+{
+	eht_target_ids [row] = AddTarget (target_id_r.data (), target_id_r.size ());
+	eht_target_starts [row] += offset;
+	eht_target_ends [row] += offset;
+	eht_target_lengths [row] = target_length;
+}
+
+
+const std :: vector <uint32> &ExonerateHitTable :: GetQueryHits (const std :: string &query_id_r) const
+{
+	static const std :: vector <uint32> s_no_rows;
+	const uint32 id = FindName (query_id_r.data (), query_id_r.size ());
+
+	return (id != S_NO_ID) ? eht_query_rows [id] : s_no_rows;
+}
+
+
+size_t ExonerateHitTable :: AddRow (uint32 query_id, uint32 query_start, uint32 query_end, char query_strand,
+	uint32 target_id, uint64 target_start, uint64 target_end, char target_strand,
+	int32 score, double identity, uint32 query_length, uint64 target_length,
+	char gene_orientation, const char *vulgar_s, size_t vulgar_length)
+{
+	const size_t row = eht_query_ids.size ();
+
+	eht_query_ids.push_back (query_id);
+	eht_query_starts.push_back (query_start);
+	eht_query_ends.push_back (query_end);
+	eht_query_strands.push_back (query_strand);
+	eht_target_ids.push_back (target_id);
+	eht_target_starts.push_back (target_start);
+	eht_target_ends.push_back (target_end);
+	eht_target_strands.push_back (target_strand);
+	eht_scores.push_back (score);
+	eht_identities.push_back ((float) identity);
+	eht_query_lengths.push_back (query_length);
+	eht_target_lengths.push_back (target_length);
+	eht_gene_orientations.push_back (gene_orientation);
+	eht_vulgar_offsets.push_back (eht_vulgars.size ());
+	eht_vulgar_lengths.push_back ((uint32) vulgar_length);
+	eht_vulgars.append (vulgar_s, vulgar_length);
+
+	eht_query_rows [query_id].push_back ((uint32) row);
+
+	return row;
+}
+
+
+uint32 ExonerateHitTable :: FindName (const char *name_s, size_t length) const
+{
+	std :: pair <std :: unordered_multimap <uint64, uint32> :: const_iterator, std :: unordered_multimap <uint64, uint32> :: const_iterator> range = eht_name_ids.equal_range (HashName (name_s, length));
+
+	for (std :: unordered_multimap <uint64, uint32> :: const_iterator itr = range.first; itr != range.second; ++ itr)
+		{
+			const std :: string &name_r = eht_names [itr -> second];
+
+			if ((name_r.size () == length) && (memcmp (name_r.data (), name_s, length) == 0))
+				{
+					return itr -> second;
+				}
+		}
+
+	return S_NO_ID;
+}
+
+
+/*
+ * Ids that have been seen before are found by their hash, so the
+ * name is only copied the first time that it is seen.
+ */
+uint32 ExonerateHitTable :: AddName (const char *name_s, size_t length)
+{
+	uint32 id = FindName (name_s, length);
+
+	if (id == S_NO_ID)
+		{
+			id = (uint32) eht_names.size ();
+
+			eht_names.push_back (std :: string (name_s, length));
+			eht_name_ids.insert (std :: make_pair (HashName (name_s, length), id));
+			eht_name_arms.push_back (S_NO_ID);
+			eht_query_rows.push_back (std :: vector <uint32> ());
+		}
+
+	return id;
+}
+
+
+/*
+ * Add the id of a target and, the first time that it is used as a
+ * target, work out its arm.
+ */
+uint32 ExonerateHitTable :: AddTarget (const char *name_s, size_t length)
+{
+	const uint32 id = AddName (name_s, length);
+
+	if (eht_arm_selector_p && (eht_name_arms [id] == S_NO_ID))
+		{
+			const char *arm_s = NULL;
+			const size_t arm_length = eht_arm_selector_p -> Select (name_s, length, &arm_s);
+			const std :: string arm (arm_s, arm_length);
+			std :: map <std :: string, uint32> :: const_iterator itr = eht_arm_ids.find (arm);
+
+			if (itr == eht_arm_ids.end ())
+				{
+					itr = eht_arm_ids.insert (std :: make_pair (arm, (uint32) eht_arms.size ())).first;
+					eht_arms.push_back (arm);
+				}
+
+			eht_name_arms [id] = itr -> second;
+		}
+
+	return id;
+}
+
+
+/*
+ * EXONERATE PARSER
+ */
+
+ExonerateParser :: ExonerateParser (ExonerateHitTable &table_r)
+	: ep_table_r (table_r),
+		ep_min_identity (0.0),
+		ep_filter_flag (false),
+		ep_callback (),
+		ep_partial_line (),
+		ep_num_hit_lines (0)
+{
+}
+
+
+void ExonerateParser :: SetMinIdentity (double min_identity)
+{
+	ep_min_identity = min_identity;
+	ep_filter_flag = true;
+}
+
+
+void ExonerateParser :: SetCallback (ExonerateHitCallback callback)
+{
+	ep_callback = callback;
+}
+
+
+uint64 ExonerateParser :: GetNumHitLines () const
+{
+	return ep_num_hit_lines;
+}
+
+
+bool ExonerateParser :: Parse (const char *data_s, size_t length)
+{
+	const char * const end_s = data_s + length;
+	const char *line_s = data_s;
+
+	while (line_s < end_s)
+		{
+			const char *newline_s = (const char *) memchr (line_s, '\n', end_s - line_s);
+
+			if (!newline_s)
+				{
+					/* Keep the start of the line until the rest of it arrives */
+					ep_partial_line.append (line_s, end_s - line_s);
+					break;
+				}
+
+			if (ep_partial_line.empty ())
+				{
+					if (!ParseLine (line_s, newline_s - line_s, newline_s + 1 - line_s))
+						{
+							return false;
+						}
+				}
+			else
+				{
+					ep_partial_line.append (line_s, newline_s + 1 - line_s);
+
+					if (!ParseLine (ep_partial_line.data (), ep_partial_line.size () - 1, ep_partial_line.size ()))
+						{
+							return false;
+						}
+
+					ep_partial_line.clear ();
+				}
+
+			line_s = newline_s + 1;
+		}
+
+	return true;
+}
+
+
+bool ExonerateParser :: Finish ()
+{
+	bool success_flag = true;
+
+	if (!ep_partial_line.empty ())
+		{
+			success_flag = ParseLine (ep_partial_line.data (), ep_partial_line.size (), ep_partial_line.size ());
+			ep_partial_line.clear ();
+		}
+
+	return success_flag;
+}
+
+
+bool ExonerateParser :: ParseFile (const char *filename_s)
+{
+	bool success_flag = false;
+	int fd = open (filename_s, O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if (fstat (fd, &st) == 0)
+				{
+					if (st.st_size > 0)
+						{
+							void *data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+							if (data_p != MAP_FAILED)
+								{
+									madvise (data_p, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+									success_flag = Parse ((const char *) data_p, (size_t) st.st_size) && Finish ();
+
+									munmap (data_p, (size_t) st.st_size);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map \"%s\", %s", filename_s, strerror (errno));
+								}
+						}
+					else
+						{
+							success_flag = true;
+						}
+				}
+
+			close (fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\", %s", filename_s, strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+bool ExonerateParser :: ParseStream (FILE *in_f)
+{
+	std :: vector <char> buffer (S_STREAM_BUFFER_SIZE);
+	const int fd = fileno (in_f);
+
+	/*
+	 * Read straight from the descriptor rather than with fread, which
+	 * would wait until it had filled the buffer before returning.
+	 */
+	while (true)
+		{
+			const ssize_t num_read = read (fd, buffer.data (), buffer.size ());
+
+			if (num_read > 0)
+				{
+					if (!Parse (buffer.data (), (size_t) num_read))
+						{
+							return false;
+						}
+				}
+			else if (num_read == 0)
+				{
+					return Finish ();
+				}
+			else if (errno != EINTR)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read the aligner's output, %s", strerror (errno));
+					return false;
+				}
+		}
+}
+
+
+/*
+ * The lines are of the form
+ *
+ * RESULT:\t%S\t%pi\t%ql\t%tl\t%g\t%V
+ *
+ * where %S is the sugar line
+ *
+ * query_id query_start query_end query_strand target_id target_start target_end target_strand score
+ *
+ * and the vulgar string is everything after the gene orientation,
+ * including the tab before it. Lines that aren't hits are skipped.
+ */
+bool ExonerateParser :: ParseLine (const char *line_s, size_t length, size_t line_length)
+{
+	const char *end_s = line_s + length;
+	const char *pos_s = line_s + sizeof (S_RESULT_PREFIX_S) - 1;
+	const char *fields_ss [13];
+	size_t field_lengths [13];
+	uint64 query_start;
+	uint64 query_end;
+	uint64 target_start;
+	uint64 target_end;
+	int32 score;
+	double identity;
+	uint64 query_length;
+	uint64 target_length;
+
+	if ((length < sizeof (S_RESULT_PREFIX_S) - 1) || (memcmp (line_s, S_RESULT_PREFIX_S, sizeof (S_RESULT_PREFIX_S) - 1) != 0))
+		{
+			return true;
+		}
+
+	/* Don't include a carriage return in the vulgar string */
+	if ((end_s > pos_s) && (* (end_s - 1) == '\r'))
+		{
+			-- end_s;
+		}
+
+	for (size_t i = 0; i < 13; ++ i)
+		{
+			if (!GetNextField (&pos_s, end_s, fields_ss + i, field_lengths + i))
+				{
+					return true;
+				}
+		}
+
+	++ ep_num_hit_lines;
+
+	/* Check the identity first so that rejected hits cost as little as possible */
+	if (!ParseRealField (fields_ss [9], field_lengths [9], &identity))
+		{
+			return true;
+		}
+
+	if (ep_filter_flag && (identity <= ep_min_identity))
+		{
+			return true;
+		}
+
+	if ((field_lengths [3] != 1) || (field_lengths [7] != 1)
+		|| (!ParseUnsignedField (fields_ss [1], field_lengths [1], &query_start)) || (query_start > UINT32_MAX)
+		|| (!ParseUnsignedField (fields_ss [2], field_lengths [2], &query_end)) || (query_end > UINT32_MAX)
+		|| (!ParseUnsignedField (fields_ss [5], field_lengths [5], &target_start))
+		|| (!ParseUnsignedField (fields_ss [6], field_lengths [6], &target_end))
+		|| (!ParseIntegerField (fields_ss [8], field_lengths [8], &score))
+		|| (!ParseUnsignedField (fields_ss [10], field_lengths [10], &query_length)) || (query_length > UINT32_MAX)
+		|| (!ParseUnsignedField (fields_ss [11], field_lengths [11], &target_length)))
+		{
+			return true;
+		}
+	else
+		{
+			const uint32 query_id = ep_table_r.AddName (fields_ss [0], field_lengths [0]);
+			const uint32 target_id = ep_table_r.AddTarget (fields_ss [4], field_lengths [4]);
+			const size_t row = ep_table_r.AddRow (query_id, (uint32) query_start, (uint32) query_end, *fields_ss [3],
+				target_id, target_start, target_end, *fields_ss [7],
+				score, identity, (uint32) query_length, target_length,
+				*fields_ss [12], pos_s, end_s - pos_s);
+
+			if (ep_callback)
+				{
+					return ep_callback (row, line_s, line_length);
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+/* FNV-1a */
+static uint64 HashName (const char *name_s, size_t length)
+{
+	uint64 hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < length; ++ i)
+		{
+			hash ^= (uint8) name_s [i];
+			hash *= 1099511628211ULL;
+		}
+
+	return hash;
+}
+
+
+static bool GetNextField (const char **pos_ss, const char *end_s, const char **field_ss, size_t *field_length_p)
+{
+	const char *pos_s = *pos_ss;
+	const char *field_s;
+
+	while ((pos_s < end_s) && ((*pos_s == ' ') || (*pos_s == '\t')))
+		{
+			++ pos_s;
+		}
+
+	field_s = pos_s;
+
+	while ((pos_s < end_s) && (*pos_s != ' ') && (*pos_s != '\t'))
+		{
+			++ pos_s;
+		}
+
+	*field_ss = field_s;
+	*field_length_p = pos_s - field_s;
+	*pos_ss = pos_s;
+
+	return (pos_s > field_s);
+}
+
+
+static bool ParseUnsignedField (const char *field_s, size_t length, uint64 *value_p)
+{
+	uint64 value = 0;
+
+	for (size_t i = 0; i < length; ++ i)
+		{
+			const char c = field_s [i];
+
+			if ((c < '0') || (c > '9') || (value > (UINT64_MAX - 9) / 10))
+				{
+					return false;
+				}
+
+			value = (value * 10) + (c - '0');
+		}
+
+	*value_p = value;
+
+	return (length > 0);
+}
+
+
+static bool ParseIntegerField (const char *field_s, size_t length, int32 *value_p)
+{
+	const bool negative_flag = (length > 0) && (*field_s == '-');
+	uint64 value;
+
+	if (negative_flag)
+		{
+			++ field_s;
+			-- length;
+		}
+
+	if (ParseUnsignedField (field_s, length, &value) && (value <= INT32_MAX))
+		{
+			*value_p = negative_flag ? - (int32) value : (int32) value;
+			return true;
+		}
+
+	return false;
+}
+
+
+/*
+ * The identities are short so they are copied to be terminated
+ * for strtod rather than parsed by hand.
+ */
+static bool ParseRealField (const char *field_s, size_t length, double *value_p)
+{
+	char buffer_s [32];
+	char *end_s = NULL;
+
+	if ((length == 0) || (length >= sizeof (buffer_s)))
+		{
+			return false;
+		}
+
+	memcpy (buffer_s, field_s, length);
+	buffer_s [length] = '\0';
+
+	*value_p = strtod (buffer_s, &end_s);
+
+	return (*end_s == '\0');
+}
@@ -0,0 +1,569 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * fasta_file.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fasta_file.hpp"
+
+#include "streams.h"
+
+
+static bool ParseIndexField (const char *&field_s, const char *line_end_s, uint64 &value_r);
+
+
+FastaRegion :: FastaRegion ()
+	: fr_data_s (0),
+		fr_entry_p (0),
+		fr_packed_p (0),
+		fr_n_runs_p (0),
+		fr_num_n_runs (0),
+		fr_start (0),
+		fr_end (0)
+{
+}
+
+
+FastaRegion :: FastaRegion (const std :: shared_ptr <const std :: string> &seq_p)
+	: fr_data_s (seq_p -> data ()),
+		fr_entry_p (0),
+		fr_packed_p (0),
+		fr_n_runs_p (0),
+		fr_num_n_runs (0),
+		fr_start (0),
+		fr_end (seq_p -> size ()),
+		fr_decoded_p (seq_p)
+{
+}
+
+
+void FastaRegion :: AppendTo (std :: string &seq_r) const
+{
+	uint64 pos = fr_start;
+
+	if (fr_packed_p)
+		{
+			const size_t old_size = seq_r.size ();
+
+			seq_r.resize (old_size + size ());
+			DecodePacked (fr_start, fr_end, &seq_r [old_size]);
+
+			return;
+		}
+
+	if (fr_decoded_p)
+		{
+			seq_r.append (fr_data_s + fr_start, size ());
+
+			return;
+		}
+
+	seq_r.reserve (seq_r.size () + size ());
+
+	/* Copy the region a line at a time */
+	while (pos < fr_end)
+		{
+			const uint64 col = pos % fr_entry_p -> fie_line_bases;
+			const uint64 n = std :: min ((uint64) (fr_entry_p -> fie_line_bases - col), fr_end - pos);
+
+			seq_r.append (fr_data_s + (pos / fr_entry_p -> fie_line_bases) * fr_entry_p -> fie_line_width + col, (size_t) n);
+			pos += n;
+		}
+}
+
+
+bool FastaRegion :: Write (FILE *out_f) const
+{
+	uint64 pos = fr_start;
+
+	if (fr_packed_p)
+		{
+			char buffer_s [4096];
+
+			while (pos < fr_end)
+				{
+					const uint64 n = std :: min ((uint64) sizeof (buffer_s), fr_end - pos);
+
+					DecodePacked (pos, pos + n, buffer_s);
+
+					if (fwrite (buffer_s, 1, (size_t) n, out_f) != (size_t) n)
+						{
+							return false;
+						}
+
+					pos += n;
+				}
+
+			return true;
+		}
+
+	if (fr_decoded_p)
+		{
+			return (fwrite (fr_data_s + fr_start, 1, size (), out_f) == size ());
+		}
+
+	while (pos < fr_end)
+		{
+			const uint64 col = pos % fr_entry_p -> fie_line_bases;
+			const uint64 n = std :: min ((uint64) (fr_entry_p -> fie_line_bases - col), fr_end - pos);
+
+			if (fwrite (fr_data_s + (pos / fr_entry_p -> fie_line_bases) * fr_entry_p -> fie_line_width + col, 1, (size_t) n, out_f) != (size_t) n)
+				{
+					return false;
+				}
+
+			pos += n;
+		}
+
+	return true;
+}
+
+
+/*
+ * Unpack the bases from "from" up to "to" and then overwrite any
+ * that are in a run of Ns.
+ */
+void FastaRegion :: DecodePacked (uint64 from, uint64 to, char *buffer_s) const
+{
+	uint64 i;
+
+	for (i = from; i < to; ++ i)
+		{
+			buffer_s [i - from] = PACKED_SEQUENCE_BASES_S [(fr_packed_p [i >> 2] >> (6 - ((i & 3) << 1))) & 3];
+		}
+
+	for (i = 0; i < fr_num_n_runs; ++ i)
+		{
+			const uint64 run_start = std :: max (fr_n_runs_p [i].pnr_start, from);
+			const uint64 run_end = std :: min (fr_n_runs_p [i].pnr_start + fr_n_runs_p [i].pnr_length, to);
+
+			if (run_start < run_end)
+				{
+					memset (buffer_s + (run_start - from), 'N', (size_t) (run_end - run_start));
+				}
+		}
+}
+
+
+FastaFile :: FastaFile (const char *fasta_filename_s)
+	: ff_filename (fasta_filename_s),
+		ff_data_s (0),
+		ff_data_size (0)
+{
+}
+
+
+FastaFile :: ~FastaFile ()
+{
+	if (ff_data_s)
+		{
+			munmap ((void *) ff_data_s, ff_data_size);
+		}
+}
+
+
+const char *FastaFile :: GetFilename () const
+{
+	return ff_filename.c_str ();
+}
+
+
+size_t FastaFile :: GetNumContigs () const
+{
+	return ff_entries.size ();
+}
+
+
+const char *FastaFile :: GetContigName (size_t index) const
+{
+	return ff_entries [index].fie_name.c_str ();
+}
+
+
+uint64 FastaFile :: GetContigLength (size_t index) const
+{
+	return ff_entries [index].fie_length;
+}
+
+
+std :: shared_ptr <const FastaFile> FastaFile :: GetShared (const char *fasta_filename_s)
+{
+	static std :: mutex s_shared_mutex;
+	static std :: map <std :: string, std :: shared_ptr <const FastaFile> > s_shared_files;
+
+	std :: lock_guard <std :: mutex> lock (s_shared_mutex);
+	std :: map <std :: string, std :: shared_ptr <const FastaFile> > :: const_iterator itr = s_shared_files.find (fasta_filename_s);
+
+	if (itr != s_shared_files.end ())
+		{
+			return itr -> second;
+		}
+	else
+		{
+			std :: shared_ptr <FastaFile> file_p (new FastaFile (fasta_filename_s));
+
+			/*
+			 * Failures aren't stored so that a file which is added after the
+			 * server has started can still be loaded.
+			 */
+			if (file_p -> Load ())
+				{
+					s_shared_files [fasta_filename_s] = file_p;
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Mapped \"%s\" with " SIZET_FMT " contigs", fasta_filename_s, file_p -> ff_entries.size ());
+
+					return file_p;
+				}
+		}
+
+	return std :: shared_ptr <const FastaFile> ();
+}
+
+
+bool FastaFile :: Load ()
+{
+	bool success_flag = false;
+	int fd = open (ff_filename.c_str (), O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size > 0))
+				{
+					void *data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+					if (data_p != MAP_FAILED)
+						{
+							std :: string fai_filename (ff_filename);
+
+							ff_data_s = (const char *) data_p;
+							ff_data_size = (size_t) st.st_size;
+
+							/* Regions are fetched from all over the file so don't read ahead */
+							madvise (data_p, ff_data_size, MADV_RANDOM);
+
+							fai_filename.append (".fai");
+
+							if (access (fai_filename.c_str (), R_OK) == 0)
+								{
+									success_flag = LoadIndex (fai_filename.c_str ());
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "No index file \"%s\", building index in memory", fai_filename.c_str ());
+									success_flag = BuildIndex ();
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map fasta file \"%s\", %s", ff_filename.c_str (), strerror (errno));
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Fasta file \"%s\" is empty or cannot be read", ff_filename.c_str ());
+				}
+
+			/* The mapping stays valid after the file is closed */
+			close (fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open fasta file \"%s\"", ff_filename.c_str ());
+		}
+
+	return success_flag;
+}
+
+
+const FastaIndexEntry *FastaFile :: GetEntry (const char *contig_s) const
+{
+	std :: unordered_map <std :: string, size_t> :: const_iterator itr = ff_entries_map.find (contig_s);
+
+	return (itr != ff_entries_map.end ()) ? & (ff_entries [itr -> second]) : 0;
+}
+
+
+bool FastaFile :: GetRegion (const char *contig_s, uint64 start, uint64 end, FastaRegion &region_r) const
+{
+	const FastaIndexEntry *entry_p = GetEntry (contig_s);
+
+	if (entry_p)
+		{
+			if (end > entry_p -> fie_length)
+				{
+					end = entry_p -> fie_length;
+				}
+
+			if (start > end)
+				{
+					start = end;
+				}
+
+			region_r.fr_data_s = ff_data_s + entry_p -> fie_offset;
+			region_r.fr_entry_p = entry_p;
+			region_r.fr_packed_p = 0;
+			region_r.fr_n_runs_p = 0;
+			region_r.fr_num_n_runs = 0;
+			region_r.fr_start = start;
+			region_r.fr_end = end;
+			region_r.fr_decoded_p.reset ();
+
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Entry \"%s\" not found in \"%s\"", contig_s, ff_filename.c_str ());
+
+	return false;
+}
+
+
+bool FastaFile :: FetchRegion (const char *contig_s, uint64 start, uint64 end, std :: string &seq_r) const
+{
+	FastaRegion region;
+
+	seq_r.clear ();
+
+	if (GetRegion (contig_s, start, end, region))
+		{
+			region.AppendTo (seq_r);
+			return true;
+		}
+
+	return false;
+}
+
+
+void FastaFile :: AddEntry (const FastaIndexEntry &entry_r)
+{
+	ff_entries_map [entry_r.fie_name] = ff_entries.size ();
+	ff_entries.push_back (entry_r);
+}
+
+
+/*
+ * The .fai is mapped too rather than being read through stdio. Each
+ * line is
+ *
+ * name\tlength\toffset\tline_bases\tline_width
+ */
+bool FastaFile :: LoadIndex (const char *fai_filename_s)
+{
+	bool success_flag = false;
+	int fai_fd = open (fai_filename_s, O_RDONLY | O_CLOEXEC);
+
+	if (fai_fd != -1)
+		{
+			struct stat st;
+
+			if (fstat (fai_fd, &st) == 0)
+				{
+					if (st.st_size > 0)
+						{
+							void *fai_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fai_fd, 0);
+
+							if (fai_p != MAP_FAILED)
+								{
+									const char *line_s = (const char *) fai_p;
+									const char * const fai_end_s = line_s + st.st_size;
+
+									success_flag = true;
+
+									while (success_flag && (line_s < fai_end_s))
+										{
+											const char *line_end_s = (const char *) memchr (line_s, '\n', fai_end_s - line_s);
+											const char *name_end_s;
+
+											if (!line_end_s)
+												{
+													line_end_s = fai_end_s;
+												}
+
+											name_end_s = (const char *) memchr (line_s, '\t', line_end_s - line_s);
+
+											if (name_end_s)
+												{
+													FastaIndexEntry entry;
+													const char *field_s = name_end_s + 1;
+													uint64 line_bases;
+													uint64 line_width;
+
+													entry.fie_name.assign (line_s, name_end_s);
+
+													if (ParseIndexField (field_s, line_end_s, entry.fie_length) && ParseIndexField (field_s, line_end_s, entry.fie_offset)
+														&& ParseIndexField (field_s, line_end_s, line_bases) && ParseIndexField (field_s, line_end_s, line_width)
+														&& (line_bases > 0) && (line_width >= line_bases))
+														{
+															entry.fie_line_bases = (uint32) line_bases;
+															entry.fie_line_width = (uint32) line_width;
+
+															/* Make sure that the whole contig lies within the mapping */
+															if ((entry.fie_length == 0) || (entry.fie_offset + ((entry.fie_length - 1) / line_bases) * line_width + ((entry.fie_length - 1) % line_bases) < ff_data_size))
+																{
+																	AddEntry (entry);
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" in \"%s\" runs past the end of \"%s\"", entry.fie_name.c_str (), fai_filename_s, ff_filename.c_str ());
+																	success_flag = false;
+																}
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Invalid entry for \"%s\" in \"%s\"", entry.fie_name.c_str (), fai_filename_s);
+															success_flag = false;
+														}
+												}
+											else if ((line_end_s > line_s) && (*line_s != '\r'))
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Invalid line in \"%s\"", fai_filename_s);
+													success_flag = false;
+												}
+
+											line_s = line_end_s + 1;
+										}
+
+									munmap (fai_p, (size_t) st.st_size);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map index file \"%s\", %s", fai_filename_s, strerror (errno));
+								}
+						}
+					else
+						{
+							/* an empty index */
+							success_flag = true;
+						}
+				}
+
+			close (fai_fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open index file \"%s\"", fai_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool FastaFile :: BuildIndex ()
+{
+	const char *line_s = ff_data_s;
+	const char * const data_end_s = ff_data_s + ff_data_size;
+	FastaIndexEntry *entry_p = 0;
+
+	while (line_s < data_end_s)
+		{
+			const char *line_end_s = (const char *) memchr (line_s, '\n', data_end_s - line_s);
+			uint32 line_length;
+
+			line_end_s = line_end_s ? line_end_s + 1 : data_end_s;
+			line_length = (uint32) (line_end_s - line_s);
+
+			if (*line_s == '>')
+				{
+					FastaIndexEntry entry;
+					const char *name_end_s = line_s + 1;
+
+					while ((name_end_s < line_end_s) && (*name_end_s != ' ') && (*name_end_s != '\t') && (*name_end_s != '\n') && (*name_end_s != '\r'))
+						{
+							++ name_end_s;
+						}
+
+					entry.fie_name.assign (line_s + 1, name_end_s);
+					entry.fie_length = 0;
+					entry.fie_offset = (uint64) (line_end_s - ff_data_s);
+					entry.fie_line_bases = 0;
+					entry.fie_line_width = 0;
+
+					AddEntry (entry);
+					entry_p = & (ff_entries.back ());
+				}
+			else if (entry_p)
+				{
+					uint32 num_bases = line_length;
+
+					while ((num_bases > 0) && ((line_s [num_bases - 1] == '\n') || (line_s [num_bases - 1] == '\r')))
+						{
+							-- num_bases;
+						}
+
+					if (entry_p -> fie_line_bases == 0)
+						{
+							entry_p -> fie_line_bases = num_bases;
+							entry_p -> fie_line_width = line_length;
+						}
+
+					entry_p -> fie_length += num_bases;
+				}
+
+			line_s = line_end_s;
+		}
+
+	return true;
+}
+
+
+bool LoadSharedFastaFile (const char *fasta_filename_s)
+{
+	return (FastaFile :: GetShared (fasta_filename_s) != 0);
+}
+
+
+static bool ParseIndexField (const char *&field_s, const char *line_end_s, uint64 &value_r)
+{
+	const char *digit_s = field_s;
+
+	value_r = 0;
+
+	while ((digit_s < line_end_s) && (*digit_s >= '0') && (*digit_s <= '9'))
+		{
+			value_r = (value_r * 10) + (uint64) (*digit_s - '0');
+			++ digit_s;
+		}
+
+	if (digit_s > field_s)
+		{
+			/* Step over the separator */
+			field_s = (digit_s < line_end_s) ? digit_s + 1 : digit_s;
+			return true;
+		}
+
+	return false;
+}
@@ -0,0 +1,266 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * homoeolog_index.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "homoeolog_index.hpp"
+
+#include "streams.h"
+
+
+HomoeologIndex :: HomoeologIndex (const char *filename_s)
+	: hi_filename (filename_s),
+		hi_data_p (0),
+		hi_data_size (0),
+		hi_header_p (0),
+		hi_contigs_p (0),
+		hi_groups_p (0),
+		hi_members_p (0),
+		hi_names_s (0)
+{
+}
+
+
+HomoeologIndex :: ~HomoeologIndex ()
+{
+	if (hi_data_p)
+		{
+			munmap ((void *) hi_data_p, hi_data_size);
+		}
+}
+
+
+const char *HomoeologIndex :: GetFilename () const
+{
+	return hi_filename.c_str ();
+}
+
+
+const char *HomoeologIndex :: GetArmSelection () const
+{
+	return hi_header_p -> hih_arm_selection_s;
+}
+
+
+std :: shared_ptr <const HomoeologIndex> HomoeologIndex :: GetShared (const char *filename_s)
+{
+	static std :: mutex s_shared_mutex;
+	static std :: map <std :: string, std :: shared_ptr <const HomoeologIndex> > s_shared_indexes;
+
+	std :: lock_guard <std :: mutex> lock (s_shared_mutex);
+	std :: map <std :: string, std :: shared_ptr <const HomoeologIndex> > :: const_iterator itr = s_shared_indexes.find (filename_s);
+
+	if (itr != s_shared_indexes.end ())
+		{
+			return itr -> second;
+		}
+	else
+		{
+			std :: shared_ptr <HomoeologIndex> index_p (new HomoeologIndex (filename_s));
+
+			if (index_p -> Load ())
+				{
+					s_shared_indexes [filename_s] = index_p;
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Mapped \"%s\" with " UINT64_FMT " contigs in " UINT64_FMT " homoeolog groups using %s", filename_s, index_p -> hi_header_p -> hih_num_contigs, index_p -> hi_header_p -> hih_num_groups, index_p -> hi_header_p -> hih_arm_selection_s);
+
+					return index_p;
+				}
+		}
+
+	return std :: shared_ptr <const HomoeologIndex> ();
+}
+
+
+bool HomoeologIndex :: Load ()
+{
+	bool success_flag = false;
+	int fd = open (hi_filename.c_str (), O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size >= (off_t) sizeof (HomoeologIndexHeader)))
+				{
+					void *data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+					if (data_p != MAP_FAILED)
+						{
+							hi_data_p = (const uint8 *) data_p;
+							hi_data_size = (size_t) st.st_size;
+
+							/* Each lookup is a binary search so don't read ahead */
+							madvise (data_p, hi_data_size, MADV_RANDOM);
+
+							success_flag = CheckLayout ();
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map homoeolog index \"%s\", %s", hi_filename.c_str (), strerror (errno));
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is too small to be a homoeolog index", hi_filename.c_str ());
+				}
+
+			close (fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open homoeolog index \"%s\"", hi_filename.c_str ());
+		}
+
+	return success_flag;
+}
+
+
+const HomoeologContig *HomoeologIndex :: FindContig (const std :: string &contig_r) const
+{
+	const HomoeologContig * const contigs_end_p = hi_contigs_p + hi_header_p -> hih_num_contigs;
+	const HomoeologContig *contig_p = std :: lower_bound (hi_contigs_p, contigs_end_p, contig_r, [this] (const HomoeologContig &entry_r, const std :: string &name_r) { return (name_r.compare (hi_names_s + entry_r.hc_name_offset) > 0); });
+
+	if ((contig_p < contigs_end_p) && (contig_r.compare (hi_names_s + contig_p -> hc_name_offset) == 0))
+		{
+			return contig_p;
+		}
+
+	return 0;
+}
+
+
+size_t HomoeologIndex :: GetHomoeologs (const HomoeologContig *contig_p, std :: vector <const char *> &homoeologs_r) const
+{
+	size_t num_homoeologs = 0;
+
+	if (contig_p -> hc_group != HOMOEOLOG_NO_GROUP)
+		{
+			const HomoeologGroup *group_p = hi_groups_p + contig_p -> hc_group;
+			const uint32 *member_p = hi_members_p + group_p -> hg_first_member;
+			const uint32 * const members_end_p = member_p + group_p -> hg_num_members;
+			const uint32 this_contig = (uint32) (contig_p - hi_contigs_p);
+
+			for ( ; member_p < members_end_p; ++ member_p)
+				{
+					/* The members aren't all checked when the file is loaded as that would read all of them */
+					if ((*member_p != this_contig) && (*member_p < hi_header_p -> hih_num_contigs))
+						{
+							homoeologs_r.push_back (hi_names_s + hi_contigs_p [*member_p].hc_name_offset);
+							++ num_homoeologs;
+						}
+				}
+		}
+
+	return num_homoeologs;
+}
+
+
+/*
+ * Check that every offset in the file lies within it so that
+ * a lookup can never read past the end of the mapping.
+ */
+bool HomoeologIndex :: CheckLayout ()
+{
+	const HomoeologIndexHeader *header_p = (const HomoeologIndexHeader *) hi_data_p;
+	const uint64 file_size = (uint64) hi_data_size;
+
+	if (memcmp (header_p -> hih_magic_s, HOMOEOLOG_INDEX_MAGIC_S, sizeof (HOMOEOLOG_INDEX_MAGIC_S)) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is not a homoeolog index", hi_filename.c_str ());
+			return false;
+		}
+
+	if (header_p -> hih_version != HOMOEOLOG_INDEX_VERSION)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has version " UINT32_FMT " but only version %d is supported", hi_filename.c_str (), header_p -> hih_version, HOMOEOLOG_INDEX_VERSION);
+			return false;
+		}
+
+	if ((header_p -> hih_file_size != file_size)
+		|| (header_p -> hih_contigs_offset > header_p -> hih_groups_offset)
+		|| (header_p -> hih_groups_offset > header_p -> hih_members_offset)
+		|| (header_p -> hih_members_offset > header_p -> hih_names_offset)
+		|| (header_p -> hih_names_offset >= file_size)
+		|| ((header_p -> hih_contigs_offset % sizeof (uint64)) != 0)
+		|| ((header_p -> hih_groups_offset % sizeof (uint32)) != 0)
+		|| ((header_p -> hih_members_offset % sizeof (uint32)) != 0)
+		|| (header_p -> hih_num_contigs > (header_p -> hih_groups_offset - header_p -> hih_contigs_offset) / sizeof (HomoeologContig))
+		|| (header_p -> hih_num_groups > (header_p -> hih_members_offset - header_p -> hih_groups_offset) / sizeof (HomoeologGroup))
+		|| (header_p -> hih_num_members > (header_p -> hih_names_offset - header_p -> hih_members_offset) / sizeof (uint32))
+		|| (header_p -> hih_arm_selection_s [HOMOEOLOG_RULE_SIZE - 1] != '\0')
+		|| (hi_data_p [file_size - 1] != '\0'))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is truncated or corrupt", hi_filename.c_str ());
+			return false;
+		}
+
+	hi_header_p = header_p;
+	hi_contigs_p = (const HomoeologContig *) (hi_data_p + header_p -> hih_contigs_offset);
+	hi_groups_p = (const HomoeologGroup *) (hi_data_p + header_p -> hih_groups_offset);
+	hi_members_p = (const uint32 *) (hi_data_p + header_p -> hih_members_offset);
+	hi_names_s = (const char *) (hi_data_p + header_p -> hih_names_offset);
+
+	for (uint64 i = 0; i < header_p -> hih_num_contigs; ++ i)
+		{
+			const HomoeologContig *contig_p = hi_contigs_p + i;
+
+			if ((contig_p -> hc_name_offset >= file_size - header_p -> hih_names_offset)
+				|| ((contig_p -> hc_group != HOMOEOLOG_NO_GROUP) && (contig_p -> hc_group >= header_p -> hih_num_groups))
+				|| (contig_p -> hc_arm_s [HOMOEOLOG_ARM_SIZE - 1] != '\0'))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Contig " UINT64_FMT " in \"%s\" is corrupt", i, hi_filename.c_str ());
+					return false;
+				}
+		}
+
+	for (uint64 i = 0; i < header_p -> hih_num_groups; ++ i)
+		{
+			const HomoeologGroup *group_p = hi_groups_p + i;
+
+			if ((uint64) group_p -> hg_first_member + (uint64) group_p -> hg_num_members > header_p -> hih_num_members)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Homoeolog group " UINT64_FMT " in \"%s\" is corrupt", i, hi_filename.c_str ());
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+bool LoadSharedHomoeologIndex (const char *filename_s)
+{
+	return (HomoeologIndex :: GetShared (filename_s) != 0);
+}
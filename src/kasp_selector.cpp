@@ -0,0 +1,375 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * kasp_selector.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "kasp_selector.hpp"
+#include "polymarker_pipeline.hpp"
+
+#include "streams.h"
+
+
+const char KASPSelector :: KS_TYPE_SPECIFIC_C = 'S';
+const char KASPSelector :: KS_TYPE_SEMISPECIFIC_C = 's';
+const char KASPSelector :: KS_TYPE_NONSPECIFIC_C = 'n';
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_ORIGINAL_NAME_S = "A";
+static const char * const S_SNP_IN_S = "B";
+
+/* The tails that the KASP reporter cassettes bind to */
+static const char * const S_FAM_TAIL_S = "GAAGGTGACCAAGTTCATGCT";
+static const char * const S_HEX_TAIL_S = "GAAGGTCGGAGTCAACGGATT";
+
+static const char * const S_GENOME_SPECIFIC_S = "genome_specific";
+static const char * const S_HET_DELS_S = "het_dels";
+
+static const char * const S_TABLE_S = "table";
+static const char * const S_CHROMOSOME_SPECIFIC_S = "chromosome_specific";
+static const char * const S_CHROMOSOME_SEMISPECIFIC_S = "chromosome_semispecific";
+static const char * const S_CHROMOSOME_NONSPECIFIC_S = "chromosome_nonspecific";
+static const char * const S_PRODUCT_SIZE_S = "product_size";
+
+/* The stdio buffer for each of the primers files */
+static const size_t S_OUTPUT_BUFFER_SIZE = 1 << 20;
+
+
+static const char *GetPrimerTypeName (const char type_c);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+KASPScores :: KASPScores ()
+{
+	SetTable (S_GENOME_SPECIFIC_S);
+}
+
+
+bool KASPScores :: SetFromJSON (const json_t *scores_p)
+{
+	if (json_is_string (scores_p))
+		{
+			return SetTable (json_string_value (scores_p));
+		}
+	else if (json_is_object (scores_p))
+		{
+			KASPScores scores (*this);
+			const char *table_s = GetJSONString (scores_p, S_TABLE_S);
+
+			if ((!table_s) || (scores.SetTable (table_s)))
+				{
+					json_int_t value;
+
+					if (GetJSONInteger (scores_p, S_CHROMOSOME_SPECIFIC_S, &value))
+						{
+							scores.ks_chromosome_specific = (int32) value;
+						}
+
+					if (GetJSONInteger (scores_p, S_CHROMOSOME_SEMISPECIFIC_S, &value))
+						{
+							scores.ks_chromosome_semispecific = (int32) value;
+						}
+
+					if (GetJSONInteger (scores_p, S_CHROMOSOME_NONSPECIFIC_S, &value))
+						{
+							scores.ks_chromosome_nonspecific = (int32) value;
+						}
+
+					if (GetJSONInteger (scores_p, S_PRODUCT_SIZE_S, &value))
+						{
+							scores.ks_product_size = (int32) value;
+						}
+
+					*this = scores;
+
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+bool KASPScores :: SetTable (const char *table_s)
+{
+	if (strcmp (table_s, S_GENOME_SPECIFIC_S) == 0)
+		{
+			ks_chromosome_specific = 1000;
+			ks_chromosome_semispecific = 100;
+			ks_chromosome_nonspecific = 0;
+			ks_product_size = 0;
+		}
+	else if (strcmp (table_s, S_HET_DELS_S) == 0)
+		{
+			/* The same as polymarker_grassroots.rb's :het_dels scoring */
+			ks_chromosome_specific = 0;
+			ks_chromosome_semispecific = 1000;
+			ks_chromosome_nonspecific = 100;
+			ks_product_size = 0;
+		}
+	else
+		{
+			return false;
+		}
+
+	return true;
+}
+
+
+int32 KASPScores :: GetTypeScore (char type_c) const
+{
+	switch (type_c)
+		{
+			case KASPSelector :: KS_TYPE_SPECIFIC_C:
+				return ks_chromosome_specific;
+
+			case KASPSelector :: KS_TYPE_SEMISPECIFIC_C:
+				return ks_chromosome_semispecific;
+
+			default:
+				return ks_chromosome_nonspecific;
+		}
+}
+
+
+KASPSelector :: KASPSelector ()
+	: ks_scores (),
+		ks_candidates (),
+		ks_pending ()
+{
+}
+
+
+void KASPSelector :: SetScores (const KASPScores &scores_r)
+{
+	ks_scores = scores_r;
+}
+
+
+void KASPSelector :: Reset (size_t num_markers)
+{
+	ks_candidates.assign (num_markers, Candidate ());
+	ks_pending.clear ();
+}
+
+
+void KASPSelector :: AddResult (Primer3Result &result_r)
+{
+	const char *id_s = result_r.pr_id.c_str ();
+	char *end_s;
+	const size_t marker_index = (size_t) strtoul (id_s, &end_s, 10);
+
+	if ((end_s != id_s) && (*end_s == ':') && (marker_index < ks_candidates.size ()))
+		{
+			/* The id is "marker:orientation:type:allele:common position" */
+			const size_t orientation_pos = (size_t) (end_s - id_s) + 1;
+			const size_t type_pos = orientation_pos + 2;
+			const size_t allele_pos = type_pos + 2;
+
+			if (result_r.pr_id.size () > allele_pos)
+				{
+					std :: string pair_id (result_r.pr_id);
+					std :: unordered_map <std :: string, Primer3Result> :: iterator itr;
+
+					pair_id [allele_pos] = '*';
+					itr = ks_pending.find (pair_id);
+
+					if (itr != ks_pending.end ())
+						{
+							const bool forward_flag = (pair_id [orientation_pos] == 'F');
+							const char type_c = pair_id [type_pos];
+
+							if (result_r.pr_id [allele_pos] == 'A')
+								{
+									AddPair (marker_index, forward_flag, type_c, result_r, itr -> second);
+								}
+							else
+								{
+									AddPair (marker_index, forward_flag, type_c, itr -> second, result_r);
+								}
+
+							ks_pending.erase (itr);
+						}
+					else
+						{
+							ks_pending.emplace (std :: move (pair_id), std :: move (result_r));
+						}
+				}
+		}
+}
+
+
+bool KASPSelector :: Write (const std :: vector <PolymarkerMarker> &markers_r, const std :: string &primers_filename_r, const std :: string &order_filename_r) const
+{
+	bool success_flag = false;
+	FILE *primers_f = fopen (primers_filename_r.c_str (), "w");
+
+	if (primers_f)
+		{
+			FILE *order_f = fopen (order_filename_r.c_str (), "w");
+
+			if (order_f)
+				{
+					setvbuf (primers_f, NULL, _IOFBF, S_OUTPUT_BUFFER_SIZE);
+					setvbuf (order_f, NULL, _IOFBF, S_OUTPUT_BUFFER_SIZE);
+
+					fprintf (primers_f, "Marker,SNP,RegionSize,chromosome,total_contigs,contig_regions,SNP_type,%s,%s,common,primer_type,orientation,%s_TM,%s_TM,common_TM,selected_from,product_size,errors\n",
+						S_ORIGINAL_NAME_S, S_SNP_IN_S, S_ORIGINAL_NAME_S, S_SNP_IN_S);
+					fputs ("Marker,SNP,Oligo,Sequence\n", order_f);
+
+					for (size_t i = 0; i < markers_r.size (); ++ i)
+						{
+							const PolymarkerMarker &marker_r = markers_r [i];
+							const Candidate *candidate_p = (i < ks_candidates.size ()) ? & (ks_candidates [i]) : 0;
+							char snp_s [64];
+
+							snprintf (snp_s, sizeof (snp_s), "%c" UINT32_FMT "%c", marker_r.pm_original, marker_r.pm_snp_position + 1, marker_r.pm_snp);
+
+							fprintf (primers_f, "%s,%s," SIZET_FMT ",%s," UINT32_FMT ",%s,%s,",
+								marker_r.pm_gene.c_str (), snp_s, marker_r.pm_template.size (),
+								marker_r.pm_target_chromosome.c_str (), marker_r.pm_total_contigs, marker_r.pm_contig_regions.c_str (), marker_r.pm_snp_type.c_str ());
+
+							if (candidate_p && (candidate_p -> c_set_flag))
+								{
+									const bool forward_flag = candidate_p -> c_forward_flag;
+									const Primer3Result &first_r = candidate_p -> c_first;
+									const Primer3Result &second_r = candidate_p -> c_second;
+									const char *first_primer_s = forward_flag ? first_r.pr_left.c_str () : first_r.pr_right.c_str ();
+									const char *second_primer_s = forward_flag ? second_r.pr_left.c_str () : second_r.pr_right.c_str ();
+									const char *common_primer_s = forward_flag ? first_r.pr_right.c_str () : first_r.pr_left.c_str ();
+
+									fprintf (primers_f, "%s,%s,%s,%s,%s,%s,%s,%s,exon,%d,\n",
+										first_primer_s,
+										second_primer_s,
+										common_primer_s,
+										GetPrimerTypeName (candidate_p -> c_type),
+										forward_flag ? "forward" : "reverse",
+										forward_flag ? first_r.pr_left_tm.c_str () : first_r.pr_right_tm.c_str (),
+										forward_flag ? second_r.pr_left_tm.c_str () : second_r.pr_right_tm.c_str (),
+										forward_flag ? first_r.pr_right_tm.c_str () : first_r.pr_left_tm.c_str (),
+										candidate_p -> c_product_size);
+
+									/* The first allele is read with FAM and the second with HEX */
+									fprintf (order_f, "%s,%s,%s_%c,%s%s\n", marker_r.pm_gene.c_str (), snp_s, marker_r.pm_gene.c_str (), marker_r.pm_original, S_FAM_TAIL_S, first_primer_s);
+									fprintf (order_f, "%s,%s,%s_%c,%s%s\n", marker_r.pm_gene.c_str (), snp_s, marker_r.pm_gene.c_str (), marker_r.pm_snp, S_HEX_TAIL_S, second_primer_s);
+									fprintf (order_f, "%s,%s,%s_common,%s\n", marker_r.pm_gene.c_str (), snp_s, marker_r.pm_gene.c_str (), common_primer_s);
+								}
+							else
+								{
+									const char *error_s = marker_r.pm_mask.empty () ? "No hit in target chromosome" : "primer3 didn't find a primer pair";
+
+									fprintf (primers_f, ",,,,,,,,,,%s\n", error_s);
+								}
+						}
+
+					if (fclose (order_f) == 0)
+						{
+							success_flag = true;
+						}
+				}
+
+			if (fclose (primers_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+std :: string KASPSelector :: MakeId (size_t marker_index, bool forward_flag, char type_c, bool first_allele_flag, int32 common_pos)
+{
+	char id_s [64];
+
+	snprintf (id_s, sizeof (id_s), SIZET_FMT ":%c:%c:%c:%d", marker_index, forward_flag ? 'F' : 'R', type_c, first_allele_flag ? 'A' : 'B', common_pos);
+
+	return std :: string (id_s);
+}
+
+
+/*
+ * Score a pair of results for the two alleles against the best pair of
+ * their marker so far. Equal pairs are decided by their ids, so the pair
+ * chosen doesn't depend on the order in which the results were added.
+ */
+void KASPSelector :: AddPair (size_t marker_index, bool forward_flag, char type_c, Primer3Result &first_r, Primer3Result &second_r)
+{
+	if ((first_r.pr_num_returned > 0) && (second_r.pr_num_returned > 0))
+		{
+			Candidate &candidate_r = ks_candidates [marker_index];
+			const int32 product_size = (int32) atoi (first_r.pr_product_size.c_str ());
+			const int32 score = ks_scores.GetTypeScore (type_c) + ks_scores.ks_product_size * product_size;
+
+			if ((!candidate_r.c_set_flag) || (score > candidate_r.c_score) ||
+					((score == candidate_r.c_score) && ((product_size < candidate_r.c_product_size) || ((product_size == candidate_r.c_product_size) && (first_r.pr_id < candidate_r.c_first.pr_id)))))
+				{
+					candidate_r.c_first = std :: move (first_r);
+					candidate_r.c_second = std :: move (second_r);
+					candidate_r.c_type = type_c;
+					candidate_r.c_forward_flag = forward_flag;
+					candidate_r.c_score = score;
+					candidate_r.c_product_size = product_size;
+					candidate_r.c_set_flag = true;
+				}
+		}
+}
+
+
+bool IsValidKASPScores (const json_t *scores_p)
+{
+	KASPScores scores;
+
+	return scores.SetFromJSON (scores_p);
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static const char *GetPrimerTypeName (const char type_c)
+{
+	switch (type_c)
+		{
+			case KASPSelector :: KS_TYPE_SPECIFIC_C:
+				return "chromosome_specific";
+
+			case KASPSelector :: KS_TYPE_SEMISPECIFIC_C:
+				return "chromosome_semispecific";
+
+			default:
+				return "chromosome_nonspecific";
+		}
+}
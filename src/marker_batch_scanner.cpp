@@ -0,0 +1,235 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * marker_batch_scanner.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+
+#include "marker_batch_scanner.hpp"
+#include "minimizer_sketch.hpp"
+
+
+/* The value returned by FindHash for a hash that none of the markers have */
+static const uint32 S_NO_HASH = 0xFFFFFFFFu;
+
+
+MarkerScanHits :: MarkerScanHits ()
+	: msh_anchors (),
+		msh_counts ()
+{
+}
+
+
+MarkerBatchScanner :: MarkerBatchScanner (uint32 k, uint32 w, uint32 max_occurrences)
+	: mbs_k (k),
+		mbs_w (w),
+		mbs_max_occurrences (max_occurrences),
+		mbs_marker_lengths (),
+		mbs_minimizers (),
+		mbs_hash_starts (),
+		mbs_table_hashes (),
+		mbs_table_indexes ()
+{
+}
+
+
+size_t MarkerBatchScanner :: AddMarker (const std :: string &seq_r)
+{
+	const uint32 marker_index = (uint32) mbs_marker_lengths.size ();
+
+	auto add_minimizer = [this, marker_index] (const MinimizerSeed &seed_r)
+		{
+			MarkerMinimizer minimizer;
+
+			minimizer.mm_hash = seed_r.ms_hash;
+			minimizer.mm_marker = marker_index;
+			minimizer.mm_strand = seed_r.ms_strand;
+			minimizer.mm_position = seed_r.ms_position;
+
+			mbs_minimizers.push_back (minimizer);
+		};
+
+	SketchMinimizers (seq_r.data (), seq_r.size (), mbs_k, mbs_w, add_minimizer);
+
+	mbs_marker_lengths.push_back ((uint64) seq_r.size ());
+
+	return marker_index;
+}
+
+
+void MarkerBatchScanner :: Prepare ()
+{
+	size_t table_size = 16;
+
+	std :: sort (mbs_minimizers.begin (), mbs_minimizers.end (), [] (const MarkerMinimizer &a_r, const MarkerMinimizer &b_r)
+		{
+			return (a_r.mm_hash != b_r.mm_hash) ? (a_r.mm_hash < b_r.mm_hash) : ((a_r.mm_marker != b_r.mm_marker) ? (a_r.mm_marker < b_r.mm_marker) : (a_r.mm_position < b_r.mm_position));
+		});
+
+	mbs_hash_starts.clear ();
+
+	for (size_t i = 0; i < mbs_minimizers.size (); ++ i)
+		{
+			if ((i == 0) || (mbs_minimizers [i].mm_hash != mbs_minimizers [i - 1].mm_hash))
+				{
+					mbs_hash_starts.push_back ((uint32) i);
+				}
+		}
+
+	/* Keep the table at most half full so that the probes stay short */
+	while (table_size < 2 * mbs_hash_starts.size ())
+		{
+			table_size <<= 1;
+		}
+
+	mbs_table_hashes.assign (table_size, 0);
+	mbs_table_indexes.assign (table_size, 0);
+
+	for (size_t i = 0; i < mbs_hash_starts.size (); ++ i)
+		{
+			const uint64 hash = mbs_minimizers [mbs_hash_starts [i]].mm_hash;
+			size_t slot = (size_t) (hash & (table_size - 1));
+
+			while (mbs_table_indexes [slot] != 0)
+				{
+					slot = (slot + 1) & (table_size - 1);
+				}
+
+			mbs_table_hashes [slot] = hash;
+			mbs_table_indexes [slot] = (uint32) (i + 1);
+		}
+
+	mbs_hash_starts.push_back ((uint32) mbs_minimizers.size ());
+}
+
+
+uint32 MarkerBatchScanner :: GetOverlap () const
+{
+	return mbs_k + mbs_w;
+}
+
+
+void MarkerBatchScanner :: ScanRegion (const char *bases_s, size_t length, uint64 bases_start, uint32 contig, uint64 start, uint64 end, MarkerScanHits &hits_r) const
+{
+	const int64 k = (int64) mbs_k;
+
+	auto add_anchors = [&] (const MinimizerSeed &seed_r)
+		{
+			const uint64 target_pos = bases_start + seed_r.ms_position;
+
+			/* The minimizers in the overlaps belong to the neighbouring parts of the contig */
+			if ((target_pos >= start) && (target_pos < end))
+				{
+					const uint32 hash_index = FindHash (seed_r.ms_hash);
+
+					if (hash_index != S_NO_HASH)
+						{
+							uint32 &count_r = hits_r.msh_counts [hash_index];
+
+							/* Once a minimizer is a repeat there's no need to keep any more of its anchors */
+							if (count_r <= mbs_max_occurrences)
+								{
+									++ count_r;
+
+									for (uint32 i = mbs_hash_starts [hash_index]; i < mbs_hash_starts [hash_index + 1]; ++ i)
+										{
+											const MarkerMinimizer &minimizer_r = mbs_minimizers [i];
+											MarkerAnchor anchor;
+
+											anchor.ma_marker = minimizer_r.mm_marker;
+											anchor.ma_hash_index = hash_index;
+											anchor.ma_anchor.sa_contig = contig;
+											anchor.ma_anchor.sa_strand = seed_r.ms_strand ^ minimizer_r.mm_strand;
+											anchor.ma_anchor.sa_diagonal = (anchor.ma_anchor.sa_strand == 0) ? (int64) target_pos - (int64) minimizer_r.mm_position : (int64) target_pos + (int64) minimizer_r.mm_position + k;
+
+											hits_r.msh_anchors.push_back (anchor);
+										}
+								}
+						}
+				}
+		};
+
+	if (hits_r.msh_counts.empty ())
+		{
+			hits_r.msh_counts.assign (mbs_hash_starts.size (), 0);
+		}
+
+	SketchMinimizers (bases_s, length, mbs_k, mbs_w, add_anchors);
+}
+
+
+void MarkerBatchScanner :: FindWindows (std :: vector <MarkerScanHits> &hits_r, uint32 margin, const std :: function <void (uint32 contig, SeedWindow &window_r)> &set_contig_r, std :: vector <std :: vector <SeedWindow> > &windows_r) const
+{
+	std :: vector <uint64> totals (mbs_hash_starts.size (), 0);
+	std :: vector <std :: vector <SeedAnchor> > anchors (mbs_marker_lengths.size ());
+
+	for (std :: vector <MarkerScanHits> :: const_iterator hits_itr = hits_r.begin (); hits_itr != hits_r.end (); ++ hits_itr)
+		{
+			for (size_t i = 0; i < hits_itr -> msh_counts.size (); ++ i)
+				{
+					totals [i] += hits_itr -> msh_counts [i];
+				}
+		}
+
+	for (std :: vector <MarkerScanHits> :: iterator hits_itr = hits_r.begin (); hits_itr != hits_r.end (); ++ hits_itr)
+		{
+			for (std :: vector <MarkerAnchor> :: const_iterator anchor_itr = hits_itr -> msh_anchors.begin (); anchor_itr != hits_itr -> msh_anchors.end (); ++ anchor_itr)
+				{
+					if (totals [anchor_itr -> ma_hash_index] <= mbs_max_occurrences)
+						{
+							anchors [anchor_itr -> ma_marker].push_back (anchor_itr -> ma_anchor);
+						}
+				}
+
+			std :: vector <MarkerAnchor> ().swap (hits_itr -> msh_anchors);
+		}
+
+	windows_r.assign (mbs_marker_lengths.size (), std :: vector <SeedWindow> ());
+
+	for (size_t i = 0; i < anchors.size (); ++ i)
+		{
+			if (! anchors [i].empty ())
+				{
+					MinimizerIndex :: ChainAnchors (anchors [i], mbs_marker_lengths [i], margin, set_contig_r, windows_r [i]);
+				}
+		}
+}
+
+
+uint32 MarkerBatchScanner :: FindHash (uint64 hash) const
+{
+	const size_t mask = mbs_table_hashes.size () - 1;
+	size_t slot = (size_t) (hash & mask);
+
+	while (mbs_table_indexes [slot] != 0)
+		{
+			if (mbs_table_hashes [slot] == hash)
+				{
+					return mbs_table_indexes [slot] - 1;
+				}
+
+			slot = (slot + 1) & mask;
+		}
+
+	return S_NO_HASH;
+}
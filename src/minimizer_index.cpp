@@ -0,0 +1,344 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * minimizer_index.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "minimizer_index.hpp"
+
+#include "streams.h"
+
+
+/*
+ * Anchors whose diagonals are at most this far apart are taken
+ * to be from the same alignment, allowing for small indels.
+ */
+static const int64 S_MAX_DIAGONAL_GAP = 64;
+
+/* The number of anchors that a window needs */
+static const uint32 S_MIN_SEEDS = 2;
+
+/* The most windows kept for each query */
+static const size_t S_MAX_WINDOWS = 32;
+
+
+static bool CompareAnchors (const SeedAnchor &a_r, const SeedAnchor &b_r);
+
+
+MinimizerIndex :: MinimizerIndex (const char *filename_s)
+	: mi_filename (filename_s),
+		mi_data_p (0),
+		mi_data_size (0),
+		mi_header_p (0),
+		mi_contigs_p (0),
+		mi_entries_p (0),
+		mi_names_s (0)
+{
+}
+
+
+MinimizerIndex :: ~MinimizerIndex ()
+{
+	if (mi_data_p)
+		{
+			munmap ((void *) mi_data_p, mi_data_size);
+		}
+}
+
+
+const char *MinimizerIndex :: GetFilename () const
+{
+	return mi_filename.c_str ();
+}
+
+
+std :: shared_ptr <const MinimizerIndex> MinimizerIndex :: GetShared (const char *filename_s)
+{
+	static std :: mutex s_shared_mutex;
+	static std :: map <std :: string, std :: shared_ptr <const MinimizerIndex> > s_shared_indexes;
+
+	std :: lock_guard <std :: mutex> lock (s_shared_mutex);
+	std :: map <std :: string, std :: shared_ptr <const MinimizerIndex> > :: const_iterator itr = s_shared_indexes.find (filename_s);
+
+	if (itr != s_shared_indexes.end ())
+		{
+			return itr -> second;
+		}
+	else
+		{
+			std :: shared_ptr <MinimizerIndex> index_p (new MinimizerIndex (filename_s));
+
+			if (index_p -> Load ())
+				{
+					s_shared_indexes [filename_s] = index_p;
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Mapped \"%s\" with " UINT64_FMT " minimizers, k=" UINT32_FMT " w=" UINT32_FMT, filename_s, index_p -> mi_header_p -> mih_num_entries, index_p -> mi_header_p -> mih_k, index_p -> mi_header_p -> mih_w);
+
+					return index_p;
+				}
+		}
+
+	return std :: shared_ptr <const MinimizerIndex> ();
+}
+
+
+bool MinimizerIndex :: Load ()
+{
+	bool success_flag = false;
+	int fd = open (mi_filename.c_str (), O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size >= (off_t) sizeof (MinimizerIndexHeader)))
+				{
+					void *data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+					if (data_p != MAP_FAILED)
+						{
+							mi_data_p = (const uint8 *) data_p;
+							mi_data_size = (size_t) st.st_size;
+
+							/* Each lookup is a binary search so don't read ahead */
+							madvise (data_p, mi_data_size, MADV_RANDOM);
+
+							success_flag = CheckLayout ();
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map minimizer index \"%s\", %s", mi_filename.c_str (), strerror (errno));
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is too small to be a minimizer index", mi_filename.c_str ());
+				}
+
+			close (fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open minimizer index \"%s\"", mi_filename.c_str ());
+		}
+
+	return success_flag;
+}
+
+
+size_t MinimizerIndex :: FindWindows (const std :: string &query_r, uint32 max_occurrences, uint32 margin, std :: vector <SeedWindow> &windows_r) const
+{
+	const MinimizerEntry * const entries_end_p = mi_entries_p + mi_header_p -> mih_num_entries;
+	const int64 k = (int64) mi_header_p -> mih_k;
+	std :: vector <SeedAnchor> anchors;
+
+	auto add_anchors = [&] (const MinimizerSeed &seed_r)
+		{
+			const MinimizerEntry *first_p = std :: lower_bound (mi_entries_p, entries_end_p, seed_r.ms_hash, [] (const MinimizerEntry &entry_r, uint64 hash) { return entry_r.me_hash < hash; });
+			const MinimizerEntry *last_p = first_p;
+
+			while ((last_p < entries_end_p) && (last_p -> me_hash == seed_r.ms_hash) && ((size_t) (last_p - first_p) <= max_occurrences))
+				{
+					++ last_p;
+				}
+
+			if ((size_t) (last_p - first_p) <= max_occurrences)
+				{
+					for ( ; first_p < last_p; ++ first_p)
+						{
+							const int64 target_pos = (int64) (first_p -> me_position_strand >> 1);
+							SeedAnchor anchor;
+
+							/* The entries aren't all checked when the file is loaded as that would read all of it */
+							if (first_p -> me_contig >= mi_header_p -> mih_num_contigs)
+								{
+									continue;
+								}
+
+							anchor.sa_contig = first_p -> me_contig;
+							anchor.sa_strand = (first_p -> me_position_strand & 1) ^ seed_r.ms_strand;
+							anchor.sa_diagonal = (anchor.sa_strand == 0) ? target_pos - (int64) seed_r.ms_position : target_pos + (int64) seed_r.ms_position + k;
+
+							anchors.push_back (anchor);
+						}
+				}
+		};
+
+	SketchMinimizers (query_r.data (), query_r.size (), mi_header_p -> mih_k, mi_header_p -> mih_w, add_anchors);
+
+	return ChainAnchors (anchors, (uint64) query_r.size (), margin, [this] (uint32 contig, SeedWindow &window_r)
+		{
+			const MinimizerContig *contig_p = mi_contigs_p + contig;
+
+			window_r.sw_contig = mi_names_s + contig_p -> mc_name_offset;
+			window_r.sw_contig_length = contig_p -> mc_length;
+		}, windows_r);
+}
+
+
+size_t MinimizerIndex :: ChainAnchors (std :: vector <SeedAnchor> &anchors_r, uint64 query_length, uint32 margin, const std :: function <void (uint32 contig, SeedWindow &window_r)> &set_contig_r, std :: vector <SeedWindow> &windows_r)
+{
+	std :: vector <SeedWindow> windows;
+
+	std :: sort (anchors_r.begin (), anchors_r.end (), CompareAnchors);
+
+	/* Chain the anchors on nearby diagonals into windows */
+	for (size_t i = 0; i < anchors_r.size (); )
+		{
+			const SeedAnchor &first_r = anchors_r [i];
+			int64 max_diagonal = first_r.sa_diagonal;
+			size_t j = i + 1;
+
+			while ((j < anchors_r.size ()) && (anchors_r [j].sa_contig == first_r.sa_contig) && (anchors_r [j].sa_strand == first_r.sa_strand) && (anchors_r [j].sa_diagonal - max_diagonal <= S_MAX_DIAGONAL_GAP))
+				{
+					max_diagonal = anchors_r [j].sa_diagonal;
+					++ j;
+				}
+
+			if (j - i >= S_MIN_SEEDS)
+				{
+					int64 start = first_r.sa_diagonal - (int64) margin;
+					int64 end = max_diagonal + (int64) margin;
+					SeedWindow window;
+
+					/* The diagonals are where the query starts on the forward strand and where it ends on the reverse */
+					if (first_r.sa_strand == 0)
+						{
+							end += (int64) query_length;
+						}
+					else
+						{
+							start -= (int64) query_length;
+						}
+
+					set_contig_r (first_r.sa_contig, window);
+
+					window.sw_start = (start > 0) ? (uint64) start : 0;
+					window.sw_end = std :: min ((uint64) std :: max (end, (int64) 0), window.sw_contig_length);
+					window.sw_num_seeds = (uint32) (j - i);
+
+					if (window.sw_start < window.sw_end)
+						{
+							windows.push_back (window);
+						}
+				}
+
+			i = j;
+		}
+
+	if (windows.size () > S_MAX_WINDOWS)
+		{
+			std :: partial_sort (windows.begin (), windows.begin () + S_MAX_WINDOWS, windows.end (), [] (const SeedWindow &a_r, const SeedWindow &b_r) { return a_r.sw_num_seeds > b_r.sw_num_seeds; });
+			windows.resize (S_MAX_WINDOWS);
+		}
+
+	windows_r.insert (windows_r.end (), windows.begin (), windows.end ());
+
+	return windows.size ();
+}
+
+
+/*
+ * Check that every offset in the file lies within it so that
+ * a lookup can never read past the end of the mapping.
+ */
+bool MinimizerIndex :: CheckLayout ()
+{
+	const MinimizerIndexHeader *header_p = (const MinimizerIndexHeader *) mi_data_p;
+	const uint64 file_size = (uint64) mi_data_size;
+
+	if (memcmp (header_p -> mih_magic_s, MINIMIZER_INDEX_MAGIC_S, sizeof (MINIMIZER_INDEX_MAGIC_S)) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is not a minimizer index", mi_filename.c_str ());
+			return false;
+		}
+
+	if (header_p -> mih_version != MINIMIZER_INDEX_VERSION)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has version " UINT32_FMT " but only version %d is supported", mi_filename.c_str (), header_p -> mih_version, MINIMIZER_INDEX_VERSION);
+			return false;
+		}
+
+	if ((header_p -> mih_k == 0) || (header_p -> mih_k > MINIMIZER_MAX_K) || (header_p -> mih_w == 0)
+		|| (header_p -> mih_file_size != file_size)
+		|| (header_p -> mih_contigs_offset > header_p -> mih_entries_offset)
+		|| (header_p -> mih_entries_offset > header_p -> mih_names_offset)
+		|| (header_p -> mih_names_offset >= file_size)
+		|| ((header_p -> mih_contigs_offset % sizeof (uint64)) != 0)
+		|| ((header_p -> mih_entries_offset % sizeof (uint64)) != 0)
+		|| (header_p -> mih_num_contigs > (header_p -> mih_entries_offset - header_p -> mih_contigs_offset) / sizeof (MinimizerContig))
+		|| (header_p -> mih_num_entries > (header_p -> mih_names_offset - header_p -> mih_entries_offset) / sizeof (MinimizerEntry))
+		|| (mi_data_p [file_size - 1] != '\0'))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is truncated or corrupt", mi_filename.c_str ());
+			return false;
+		}
+
+	mi_header_p = header_p;
+	mi_contigs_p = (const MinimizerContig *) (mi_data_p + header_p -> mih_contigs_offset);
+	mi_entries_p = (const MinimizerEntry *) (mi_data_p + header_p -> mih_entries_offset);
+	mi_names_s = (const char *) (mi_data_p + header_p -> mih_names_offset);
+
+	for (uint64 i = 0; i < header_p -> mih_num_contigs; ++ i)
+		{
+			if (mi_contigs_p [i].mc_name_offset >= file_size - header_p -> mih_names_offset)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Contig " UINT64_FMT " in \"%s\" is corrupt", i, mi_filename.c_str ());
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+bool LoadSharedMinimizerIndex (const char *filename_s)
+{
+	return (MinimizerIndex :: GetShared (filename_s) != 0);
+}
+
+
+static bool CompareAnchors (const SeedAnchor &a_r, const SeedAnchor &b_r)
+{
+	if (a_r.sa_contig != b_r.sa_contig)
+		{
+			return a_r.sa_contig < b_r.sa_contig;
+		}
+
+	if (a_r.sa_strand != b_r.sa_strand)
+		{
+			return a_r.sa_strand < b_r.sa_strand;
+		}
+
+	return a_r.sa_diagonal < b_r.sa_diagonal;
+}
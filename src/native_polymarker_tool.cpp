@@ -0,0 +1,407 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * native_polymarker_tool.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "native_polymarker_tool.hpp"
+#include "polymarker_checkpoint.hpp"
+#include "polymarker_service_job.h"
+#include "polymarker_utils.h"
+#include "polymarker_shared_inputs.h"
+
+#include "string_utils.h"
+#include "jobs_manager.h"
+#include "json_util.h"
+#include "streams.h"
+
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define NATIVE_POLYMARKER_TOOL_DEBUG (STM_LEVEL_FINE)
+#else
+	#define NATIVE_POLYMARKER_TOOL_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+static void *RunNativePolymarkerPipeline (void *data_p);
+
+
+NativePolymarkerTool :: NativePolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p)
+	: PolymarkerTool (job_p, seq_p, data_p),
+		nt_prefs_p (0),
+		nt_task_p (0),
+		nt_cancelled_flag (false),
+		nt_checkpoint_p (0)
+{
+	Init (data_p);
+}
+
+
+NativePolymarkerTool :: NativePolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p, const json_t *root_p)
+	: PolymarkerTool (job_p, seq_p, data_p, root_p),
+		nt_prefs_p (0),
+		nt_task_p (0),
+		nt_cancelled_flag (false),
+		nt_checkpoint_p (0)
+{
+	Init (data_p);
+}
+
+
+void NativePolymarkerTool :: Init (const PolymarkerServiceData *data_p)
+{
+	bool alloc_flag = false;
+
+	PolymarkerPipeline :: SetPipelineConfig (&nt_config, data_p -> psd_base_data.sd_config_p);
+
+	nt_prefs_p = AllocatePrimer3Prefs (data_p);
+
+	if (nt_prefs_p)
+		{
+			nt_task_p = AllocateAsyncTask ("NativePolymarkerTool", data_p -> psd_task_manager_p, true);
+
+			if (nt_task_p)
+				{
+					if (SetAsyncTaskRunData (nt_task_p, RunNativePolymarkerPipeline, this))
+						{
+							alloc_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set run data for NativePolymarkerTool");
+						}
+
+					if (!alloc_flag)
+						{
+							FreeAsyncTask (nt_task_p);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate AsyncTask for NativePolymarkerTool");
+				}
+
+			if (!alloc_flag)
+				{
+					FreePrimer3Prefs (nt_prefs_p);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate Primer3Prefs for NativePolymarkerTool");
+		}
+
+	if (!alloc_flag)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+NativePolymarkerTool :: ~NativePolymarkerTool ()
+{
+	if (nt_checkpoint_p)
+		{
+			delete nt_checkpoint_p;
+		}
+
+	if (nt_task_p)
+		{
+			FreeAsyncTask (nt_task_p);
+		}
+
+	if (nt_prefs_p)
+		{
+			FreePrimer3Prefs (nt_prefs_p);
+		}
+}
+
+
+PolymarkerToolType NativePolymarkerTool :: GetToolType () const
+{
+	return PTT_NATIVE;
+}
+
+
+bool NativePolymarkerTool :: ParseParameters (const ParameterSet * const param_set_p)
+{
+	bool success_flag = false;
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (pt_service_job_p -> psj_base_job.sj_id, uuid_s);
+
+	if (pt_job_dir_s)
+		{
+			FreeCopiedString (pt_job_dir_s);
+		}
+
+	pt_job_dir_s = MakeFilename (pt_service_data_p -> psd_working_dir_s, uuid_s);
+
+	if (pt_job_dir_s)
+		{
+			if (EnsureDirectoryExists (pt_job_dir_s))
+				{
+					if (pt_shared_inputs_p)
+						{
+							/*
+							 * The markers have already been parsed for the whole request
+							 */
+							char *markers_filename_s = LinkPolymarkerSharedInput (pt_shared_inputs_p -> psi_markers_filename_s, pt_job_dir_s, PolymarkerPipeline :: PP_MARKERS_LIST_S);
+
+							if (markers_filename_s)
+								{
+									ParsePrimer3PrefsParameters (param_set_p, nt_prefs_p);
+									success_flag = true;
+
+									FreeCopiedString (markers_filename_s);
+								}
+						}
+					else
+						{
+							char *markers_filename_s = MakeFilename (pt_job_dir_s, PolymarkerPipeline :: PP_MARKERS_LIST_S);
+
+							if (markers_filename_s)
+								{
+									if (CreateMarkerListFile (markers_filename_s, param_set_p, false))
+										{
+											ParsePrimer3PrefsParameters (param_set_p, nt_prefs_p);
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "CreateMarkerListFile failed for \"%s\" for job %s", markers_filename_s, uuid_s);
+										}
+
+									FreeCopiedString (markers_filename_s);
+								}		/* if (markers_filename_s) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "MakeFilename failed for \"%s\" and \"%s\" for job %s", pt_job_dir_s, PolymarkerPipeline :: PP_MARKERS_LIST_S, uuid_s);
+								}
+						}
+
+				}		/* if (EnsureDirectoryExists (pt_job_dir_s)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to make sure directory \"%s\" exists", pt_job_dir_s);
+				}
+
+		}		/* if (pt_job_dir_s) */
+
+	return success_flag;
+}
+
+
+bool NativePolymarkerTool :: PreRun ()
+{
+	bool success_flag = PolymarkerTool :: PreRun ();
+
+	SetServiceJobStatus (& (pt_service_job_p -> psj_base_job), success_flag ? OS_STARTED : OS_FAILED_TO_START);
+
+	return success_flag;
+}
+
+
+bool NativePolymarkerTool :: PostRun ()
+{
+	return true;
+}
+
+
+OperationStatus NativePolymarkerTool :: Run ()
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+	ServiceJob *base_job_p = & (pt_service_job_p -> psj_base_job);
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (base_job_p -> sj_service_p);
+	JobsManager *manager_p = GetJobsManager (grassroots_p);
+
+	ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+
+	if (AddServiceJobToJobsManager (manager_p, base_job_p -> sj_id, base_job_p))
+		{
+			SetServiceJobStatus (base_job_p, OS_PENDING);
+
+			if (RunAsyncTask (nt_task_p))
+				{
+					/*
+					 * The ServiceJob should now only be writeable by the AsyncTask that it is running under.
+					 */
+					status = OS_STARTED;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run async task for uuid %s", uuid_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add Polymarker Service Job \"%s\" to jobs manager", uuid_s);
+		}
+
+	if (status == OS_FAILED_TO_START)
+		{
+			SetServiceJobStatus (base_job_p, status);
+		}
+
+	return status;
+}
+
+
+void NativePolymarkerTool :: RunPipeline ()
+{
+	ServiceJob *base_job_p = & (pt_service_job_p -> psj_base_job);
+	PolymarkerPipeline pipeline (pt_job_dir_s, pt_seq_p, &nt_config, nt_prefs_p);
+
+	if (nt_checkpoint_p)
+		{
+			pipeline.SetCheckpoint (nt_checkpoint_p, true);
+		}
+	else
+		{
+			/*
+			 * Record each stage as it completes so that the job can be
+			 * resumed if the server stops before it has finished.
+			 */
+			try
+				{
+					nt_checkpoint_p = new PolymarkerCheckpoint (pt_job_dir_s);
+
+					if ((nt_checkpoint_p -> Lock ()) && (nt_checkpoint_p -> Start (pt_seq_p -> ps_fasta_filename_s, nt_prefs_p)))
+						{
+							pipeline.SetCheckpoint (nt_checkpoint_p, false);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create checkpoint in \"%s\", the job will not be resumable", pt_job_dir_s);
+
+							delete nt_checkpoint_p;
+							nt_checkpoint_p = 0;
+						}
+				}
+			catch (std :: bad_alloc &ex_r)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate PolymarkerCheckpoint, \"%s\"", ex_r.what ());
+				}
+		}
+
+	pipeline.SetCancelFlag (&nt_cancelled_flag);
+	SetServiceJobStatus (base_job_p, OS_STARTED);
+
+	if (pipeline.Run ())
+		{
+			SetServiceJobStatus (base_job_p, OS_SUCCEEDED);
+		}
+	else
+		{
+			nt_error = pipeline.GetErrorMessage ();
+
+			SetServiceJobStatus (base_job_p, OS_FAILED);
+
+			if (!AddGeneralErrorMessageToServiceJob (base_job_p, nt_error.c_str ()))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", nt_error.c_str ());
+				}
+		}
+
+	PolymarkerServiceJobCompleted (base_job_p);
+
+	/* Release the job's lock now that it has finished */
+	if (nt_checkpoint_p)
+		{
+			delete nt_checkpoint_p;
+			nt_checkpoint_p = 0;
+		}
+}
+
+
+bool NativePolymarkerTool :: Cancel ()
+{
+	nt_cancelled_flag = true;
+
+	return true;
+}
+
+
+bool NativePolymarkerTool :: Resume (PolymarkerCheckpoint *checkpoint_p)
+{
+	bool success_flag = false;
+
+	checkpoint_p -> GetPrimer3Prefs (nt_prefs_p);
+	nt_checkpoint_p = checkpoint_p;
+
+	if (RunPolymarkerTool (this) == OS_STARTED)
+		{
+			success_flag = true;
+		}
+	else
+		{
+			/* Leave the checkpoint with the caller */
+			nt_checkpoint_p = 0;
+		}
+
+	return success_flag;
+}
+
+
+bool NativePolymarkerTool :: RunInDirectory (const char *dir_s, char **error_ss)
+{
+	PolymarkerPipeline pipeline (dir_s, pt_seq_p, &nt_config, nt_prefs_p);
+	bool success_flag = pipeline.Run ();
+
+	if ((!success_flag) && error_ss)
+		{
+			*error_ss = CopyToNewString (pipeline.GetErrorMessage (), 0, false);
+		}
+
+	return success_flag;
+}
+
+
+OperationStatus NativePolymarkerTool :: GetStatus (bool update_flag)
+{
+	return GetCachedServiceJobStatus (& (pt_service_job_p -> psj_base_job));
+}
+
+
+char *NativePolymarkerTool :: GetResults (PolymarkerFormatter *formatter_p)
+{
+	return 0;
+}
+
+
+char *NativePolymarkerTool :: GetLog ()
+{
+	return nt_error.empty () ? 0 : CopyToNewString (nt_error.c_str (), 0, false);
+}
+
+
+static void *RunNativePolymarkerPipeline (void *data_p)
+{
+	NativePolymarkerTool *tool_p = static_cast <NativePolymarkerTool *> (data_p);
+
+	tool_p -> RunPipeline ();
+
+	return NULL;
+}
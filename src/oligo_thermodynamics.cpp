@@ -0,0 +1,620 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * oligo_thermodynamics.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "oligo_thermodynamics.hpp"
+#include "oligo_thermodynamics_kernel.hpp"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+/* The number of stacks that each block has room for */
+static const uint32 S_MAX_STACKS = OligoBatch :: OB_MAX_LENGTH - 1;
+
+/* The code of any base that is not one of A, C, G or T */
+static const uint8 S_UNKNOWN_BASE = 4;
+
+/*
+ * SantaLucia's 1998 unified parameters for each stack, coded as
+ * 4 * first base + second base, in the units that primer3 uses:
+ * enthalpies in -100 cal/mol, entropies in -0.1 cal/K/mol and free
+ * energies at 37C in -10 cal/mol.
+ */
+static const int32 S_ENTHALPIES [NN_NUM_STACKS] =
+{
+	79, 84, 78, 72,
+	85, 80, 106, 78,
+	82, 98, 80, 84,
+	72, 82, 85, 79
+};
+
+static const int32 S_ENTROPIES [NN_NUM_STACKS] =
+{
+	222, 224, 210, 204,
+	227, 199, 272, 210,
+	222, 244, 199, 224,
+	213, 222, 227, 222
+};
+
+static const int32 S_FREE_ENERGIES [NN_NUM_STACKS] =
+{
+	100, 144, 128, 88,
+	145, 184, 217, 128,
+	130, 224, 184, 144,
+	58, 130, 145, 100
+};
+
+/* The smallest value in each table, which the kernels' tables are relative to */
+static const int32 S_MIN_ENTHALPY = 72;
+static const int32 S_MIN_ENTROPY = 199;
+static const int32 S_MIN_FREE_ENERGY = 58;
+
+/* The initiation terms for each end of the duplex, in the same units */
+static const int32 S_TERMINAL_AT_ENTHALPY = -23;
+static const int32 S_TERMINAL_AT_ENTROPY = -41;
+static const int32 S_TERMINAL_GC_ENTHALPY = -1;
+static const int32 S_TERMINAL_GC_ENTROPY = 28;
+static const int32 S_SYMMETRY_ENTROPY = 14;
+
+static const int32 S_INITIATION_FREE_ENERGY = -196;
+static const int32 S_TERMINAL_AT_FREE_ENERGY = -5;
+
+/* The number of bases at the 3' end whose free energy is primer3's end stability */
+static const uint32 S_END_STABILITY_LENGTH = 5;
+
+/*
+ * SantaLucia and Hicks' 2004 hairpin loop penalties at 37C in kcal/mol,
+ * for the loop lengths in S_HAIRPIN_LOOP_LENGTHS. The loops of other
+ * lengths use the Jacobson-Stockmayer extrapolation from the next
+ * shortest length.
+ */
+static const uint32 S_HAIRPIN_LOOP_LENGTHS [] = { 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30 };
+
+static const double S_HAIRPIN_LOOP_FREE_ENERGIES [] = { 3.5, 3.5, 3.3, 4.0, 4.2, 4.3, 4.5, 4.6, 5.0, 5.1, 5.3, 5.5, 5.7, 6.1, 6.3 };
+
+static const uint32 S_MIN_HAIRPIN_LOOP_LENGTH = 3;
+
+/* 2.44 RT at 37C in kcal/mol, the Jacobson-Stockmayer coefficient */
+static const double S_JACOBSON_STOCKMAYER_FACTOR = 2.44 * 0.0019872 * 310.15;
+
+static const double S_GAS_CONSTANT = 1.987;
+
+static const double S_KELVIN = 273.15;
+
+
+typedef void (*NearestNeighbourKernel) (const NearestNeighbourInput *input_p);
+
+
+struct NearestNeighbourKernelChoice
+{
+	NearestNeighbourKernel nnkc_kernel_fn;
+	const char *nnkc_name_s;
+};
+
+
+/*
+ * The scalar summing pass, which is used when the CPU has no suitable
+ * vector instructions.
+ */
+struct ScalarOps
+{
+	typedef const uint8 *Table;
+	typedef uint8 Codes;
+	typedef uint16 Sums;
+
+	static const uint32 WIDTH = 1;
+
+	static inline Table LoadTable (const uint8 *table_p) { return table_p; }
+	static inline Codes LoadCodes (const uint8 *codes_p) { return *codes_p; }
+	static inline Sums Zero () { return 0; }
+	static inline Codes Lookup (Table table, Codes code) { return (code & NN_STACK_PADDING) ? 0 : table [code]; }
+	static inline void Accumulate (Codes value, Sums &low_r, Sums & UNUSED_PARAM (high_r)) { low_r += value; }
+	static inline void StoreSums (uint16 *sums_p, Sums low, Sums UNUSED_PARAM (high)) { *sums_p = low; }
+};
+
+
+/* The tables that the kernels look the stacks up in */
+struct NearestNeighbourTables
+{
+	uint8 nnt_enthalpies [NN_NUM_STACKS];
+	uint8 nnt_entropies [NN_NUM_STACKS];
+	uint8 nnt_free_energies [NN_NUM_STACKS];
+
+	NearestNeighbourTables ();
+};
+
+
+static void SumNearestNeighbourScalar (const NearestNeighbourInput *input_p);
+
+static const NearestNeighbourKernelChoice &GetKernel ();
+
+static uint8 GetBaseCode (const char c);
+
+static inline bool IsWeakBase (const uint8 code);
+
+static inline bool IsPair (const uint8 code_a, const uint8 code_b);
+
+static double GetHairpinLoopFreeEnergy (const uint32 length);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+OligoConditions :: OligoConditions ()
+	: oc_dna_conc (50.0),
+		oc_monovalent_conc (50.0),
+		oc_divalent_conc (1.5),
+		oc_dntp_conc (0.6)
+{
+}
+
+
+OligoBatch :: OligoBatch ()
+{
+}
+
+
+void OligoBatch :: Clear ()
+{
+	ob_stacks.clear ();
+	ob_block_max_stacks.clear ();
+	ob_lengths.clear ();
+	ob_first_bases.clear ();
+	ob_last_bases.clear ();
+	ob_symmetric.clear ();
+}
+
+
+size_t OligoBatch :: Add (const char *oligo_s, size_t length)
+{
+	const size_t index = ob_lengths.size ();
+	const size_t lane = index % OB_BLOCK_SIZE;
+	uint8 *stacks_p;
+	bool valid_flag = (length >= 2) && (length <= OB_MAX_LENGTH);
+	bool symmetric_flag = ((length & 1) == 0);
+
+	if (lane == 0)
+		{
+			ob_stacks.resize (ob_stacks.size () + S_MAX_STACKS * OB_BLOCK_SIZE, NN_STACK_PADDING);
+			ob_block_max_stacks.push_back (0);
+		}
+
+	stacks_p = ob_stacks.data () + (ob_block_max_stacks.size () - 1) * S_MAX_STACKS * OB_BLOCK_SIZE + lane;
+
+	if (valid_flag)
+		{
+			uint8 previous = GetBaseCode (oligo_s [0]);
+
+			valid_flag = (previous != S_UNKNOWN_BASE);
+
+			for (size_t i = 1; valid_flag && (i < length); ++ i)
+				{
+					const uint8 code = GetBaseCode (oligo_s [i]);
+
+					if (code != S_UNKNOWN_BASE)
+						{
+							stacks_p [(i - 1) * OB_BLOCK_SIZE] = (uint8) (previous * 4 + code);
+							previous = code;
+						}
+					else
+						{
+							valid_flag = false;
+						}
+				}
+
+			/* An oligo is its own complement if each base pairs with its mirror, i.e. the codes sum to 3 */
+			for (size_t i = 0; valid_flag && symmetric_flag && (i < length / 2); ++ i)
+				{
+					symmetric_flag = (GetBaseCode (oligo_s [i]) + GetBaseCode (oligo_s [length - 1 - i]) == 3);
+				}
+		}
+
+	if (valid_flag)
+		{
+			uint8 &max_stacks_r = ob_block_max_stacks.back ();
+
+			max_stacks_r = std :: max <uint8> (max_stacks_r, (uint8) (length - 1));
+
+			ob_lengths.push_back ((uint8) length);
+			ob_first_bases.push_back (GetBaseCode (oligo_s [0]));
+			ob_last_bases.push_back (GetBaseCode (oligo_s [length - 1]));
+			ob_symmetric.push_back (symmetric_flag ? 1 : 0);
+		}
+	else
+		{
+			/* Clear anything that was written before the invalid base so that the lane adds nothing */
+			for (size_t i = 0; i < S_MAX_STACKS; ++ i)
+				{
+					stacks_p [i * OB_BLOCK_SIZE] = NN_STACK_PADDING;
+				}
+
+			ob_lengths.push_back (0);
+			ob_first_bases.push_back (S_UNKNOWN_BASE);
+			ob_last_bases.push_back (S_UNKNOWN_BASE);
+			ob_symmetric.push_back (0);
+		}
+
+	return index;
+}
+
+
+size_t OligoBatch :: GetNumOligos () const
+{
+	return ob_lengths.size ();
+}
+
+
+OligoThermodynamicsCalculator :: OligoThermodynamicsCalculator (const OligoConditions &conditions_r)
+{
+	/* primer3 converts the divalent cations that aren't bound to the dNTPs into monovalent ones */
+	double monovalent_conc = conditions_r.oc_monovalent_conc;
+
+	if ((conditions_r.oc_divalent_conc > 0.0) && (conditions_r.oc_divalent_conc > conditions_r.oc_dntp_conc))
+		{
+			monovalent_conc += 120.0 * sqrt (conditions_r.oc_divalent_conc - conditions_r.oc_dntp_conc);
+		}
+
+	otc_salt_correction = 0.368 * log (monovalent_conc / 1000.0);
+	otc_concentration_term = S_GAS_CONSTANT * log (conditions_r.oc_dna_conc / 4000000000.0);
+	otc_symmetric_concentration_term = S_GAS_CONSTANT * log (conditions_r.oc_dna_conc / 1000000000.0);
+}
+
+
+void OligoThermodynamicsCalculator :: Calculate (const OligoBatch &batch_r, std :: vector <OligoThermodynamics> &values_r) const
+{
+	static const NearestNeighbourTables tables;
+	const NearestNeighbourKernelChoice &kernel_r = GetKernel ();
+	const size_t num_oligos = batch_r.GetNumOligos ();
+	uint16 enthalpy_sums [OligoBatch :: OB_BLOCK_SIZE];
+	uint16 entropy_sums [OligoBatch :: OB_BLOCK_SIZE];
+	uint16 free_energy_sums [OligoBatch :: OB_BLOCK_SIZE];
+	NearestNeighbourInput input;
+
+	values_r.resize (num_oligos);
+
+	input.nni_num_oligos = OligoBatch :: OB_BLOCK_SIZE;
+	input.nni_stride = OligoBatch :: OB_BLOCK_SIZE;
+	input.nni_enthalpy_table_p = tables.nnt_enthalpies;
+	input.nni_entropy_table_p = tables.nnt_entropies;
+	input.nni_free_energy_table_p = tables.nnt_free_energies;
+	input.nni_enthalpy_sums_p = enthalpy_sums;
+	input.nni_entropy_sums_p = entropy_sums;
+	input.nni_free_energy_sums_p = free_energy_sums;
+
+	for (size_t block = 0; block < batch_r.ob_block_max_stacks.size (); ++ block)
+		{
+			const uint8 *block_stacks_p = batch_r.ob_stacks.data () + block * S_MAX_STACKS * OligoBatch :: OB_BLOCK_SIZE;
+			const size_t first_oligo = block * OligoBatch :: OB_BLOCK_SIZE;
+			const size_t last_oligo = std :: min <size_t> (first_oligo + OligoBatch :: OB_BLOCK_SIZE, num_oligos);
+
+			input.nni_stacks_p = block_stacks_p;
+			input.nni_max_stacks = batch_r.ob_block_max_stacks [block];
+
+			kernel_r.nnkc_kernel_fn (&input);
+
+			for (size_t i = first_oligo; i < last_oligo; ++ i)
+				{
+					const size_t lane = i - first_oligo;
+					const int32 length = batch_r.ob_lengths [i];
+					OligoThermodynamics &oligo_r = values_r [i];
+
+					if (length > 0)
+						{
+							const int32 num_stacks = length - 1;
+							const bool symmetric_flag = (batch_r.ob_symmetric [i] != 0);
+							const uint32 end_length = std :: min <uint32> ((uint32) length, S_END_STABILITY_LENGTH);
+							int32 enthalpy = enthalpy_sums [lane] + S_MIN_ENTHALPY * num_stacks;
+							int32 entropy = entropy_sums [lane] + S_MIN_ENTROPY * num_stacks;
+							int32 free_energy = free_energy_sums [lane] + S_MIN_FREE_ENERGY * num_stacks + S_INITIATION_FREE_ENERGY;
+							int32 end_free_energy = S_INITIATION_FREE_ENERGY;
+							uint8 end_first_base = batch_r.ob_first_bases [i];
+							double delta_h;
+							double delta_s;
+
+							/* The initiation terms for each end */
+							const uint8 ends [2] = { batch_r.ob_first_bases [i], batch_r.ob_last_bases [i] };
+
+							for (int j = 0; j < 2; ++ j)
+								{
+									if (IsWeakBase (ends [j]))
+										{
+											enthalpy += S_TERMINAL_AT_ENTHALPY;
+											entropy += S_TERMINAL_AT_ENTROPY;
+											free_energy += S_TERMINAL_AT_FREE_ENERGY;
+										}
+									else
+										{
+											enthalpy += S_TERMINAL_GC_ENTHALPY;
+											entropy += S_TERMINAL_GC_ENTROPY;
+										}
+								}
+
+							if (symmetric_flag)
+								{
+									entropy += S_SYMMETRY_ENTROPY;
+								}
+
+							/* The stacks of the 3' end are the last ones of the oligo */
+							for (int32 p = length - (int32) end_length; p < num_stacks; ++ p)
+								{
+									const uint8 code = block_stacks_p [p * OligoBatch :: OB_BLOCK_SIZE + lane];
+
+									if (p == length - (int32) end_length)
+										{
+											end_first_base = code >> 2;
+										}
+
+									end_free_energy += S_FREE_ENERGIES [code];
+								}
+
+							if (IsWeakBase (end_first_base))
+								{
+									end_free_energy += S_TERMINAL_AT_FREE_ENERGY;
+								}
+
+							if (IsWeakBase (batch_r.ob_last_bases [i]))
+								{
+									end_free_energy += S_TERMINAL_AT_FREE_ENERGY;
+								}
+
+							delta_h = enthalpy * -100.0;
+							delta_s = entropy * -0.1 + otc_salt_correction * num_stacks;
+
+							oligo_r.ot_tm = delta_h / (delta_s + (symmetric_flag ? otc_symmetric_concentration_term : otc_concentration_term)) - S_KELVIN;
+							oligo_r.ot_delta_g = free_energy / -100.0;
+							oligo_r.ot_end_stability = end_free_energy / 100.0;
+							oligo_r.ot_valid_flag = true;
+						}
+					else
+						{
+							oligo_r.ot_tm = 0.0;
+							oligo_r.ot_delta_g = 0.0;
+							oligo_r.ot_end_stability = 0.0;
+							oligo_r.ot_valid_flag = false;
+						}
+				}
+		}
+}
+
+
+double OligoThermodynamicsCalculator :: GetHairpinDeltaG (const char *oligo_s, size_t length)
+{
+	std :: vector <uint8> codes (length);
+	double best = 0.0;
+
+	for (size_t i = 0; i < length; ++ i)
+		{
+			codes [i] = GetBaseCode (oligo_s [i]);
+		}
+
+	/*
+	 * Base i closes the loop by pairing with base j and the stem runs
+	 * outwards from there for as long as the bases keep pairing, as each
+	 * extra stack only makes the hairpin more stable.
+	 */
+	for (size_t j = S_MIN_HAIRPIN_LOOP_LENGTH + 1; j < length; ++ j)
+		{
+			for (size_t i = 0; i + S_MIN_HAIRPIN_LOOP_LENGTH < j; ++ i)
+				{
+					if (IsPair (codes [i], codes [j]))
+						{
+							int32 stacks = 0;
+							size_t k = 1;
+
+							while ((k <= i) && (j + k < length) && IsPair (codes [i - k], codes [j + k]))
+								{
+									stacks += S_FREE_ENERGIES [codes [i - k] * 4 + codes [i - k + 1]];
+									++ k;
+								}
+
+							if (k > 1)
+								{
+									double free_energy = stacks / -100.0 + GetHairpinLoopFreeEnergy ((uint32) (j - i - 1));
+
+									if (IsWeakBase (codes [i + 1 - k]))
+										{
+											free_energy += S_TERMINAL_AT_FREE_ENERGY / -100.0;
+										}
+
+									if (free_energy < best)
+										{
+											best = free_energy;
+										}
+								}
+						}
+				}
+		}
+
+	return best;
+}
+
+
+double OligoThermodynamicsCalculator :: GetDimerDeltaG (const char *oligo_a_s, size_t length_a, const char *oligo_b_s, size_t length_b)
+{
+	int32 best = 0;
+
+	if ((length_a == 0) || (length_b == 0))
+		{
+			return 0.0;
+		}
+
+	/*
+	 * Base i of a pairs with base j of b in the antiparallel alignments
+	 * where i + j is the same, so each value of i + j is one alignment.
+	 * The free energies are summed in primer3's units, where the larger
+	 * the value the more stable the duplex.
+	 */
+	for (size_t diagonal = 0; diagonal < length_a + length_b - 1; ++ diagonal)
+		{
+			const size_t first_i = (diagonal >= length_b) ? diagonal - (length_b - 1) : 0;
+			const size_t last_i = std :: min (diagonal, length_a - 1);
+			uint8 previous = S_UNKNOWN_BASE;
+			int32 free_energy = 0;
+			size_t run_length = 0;
+
+			for (size_t i = first_i; i <= last_i; ++ i)
+				{
+					const uint8 code = GetBaseCode (oligo_a_s [i]);
+
+					if (IsPair (code, GetBaseCode (oligo_b_s [diagonal - i])))
+						{
+							if (run_length == 0)
+								{
+									free_energy = S_INITIATION_FREE_ENERGY + (IsWeakBase (code) ? S_TERMINAL_AT_FREE_ENERGY : 0);
+								}
+							else
+								{
+									free_energy += S_FREE_ENERGIES [previous * 4 + code];
+								}
+
+							++ run_length;
+
+							/* The run could end at this pair */
+							if (run_length > 1)
+								{
+									const int32 duplex_free_energy = free_energy + (IsWeakBase (code) ? S_TERMINAL_AT_FREE_ENERGY : 0);
+
+									if (duplex_free_energy > best)
+										{
+											best = duplex_free_energy;
+										}
+								}
+						}
+					else
+						{
+							run_length = 0;
+						}
+
+					previous = code;
+				}
+		}
+
+	return (best > 0) ? best / -100.0 : 0.0;
+}
+
+
+const char *OligoThermodynamicsCalculator :: GetKernelName ()
+{
+	return GetKernel ().nnkc_name_s;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+NearestNeighbourTables :: NearestNeighbourTables ()
+{
+	for (uint32 i = 0; i < NN_NUM_STACKS; ++ i)
+		{
+			nnt_enthalpies [i] = (uint8) (S_ENTHALPIES [i] - S_MIN_ENTHALPY);
+			nnt_entropies [i] = (uint8) (S_ENTROPIES [i] - S_MIN_ENTROPY);
+			nnt_free_energies [i] = (uint8) (S_FREE_ENERGIES [i] - S_MIN_FREE_ENERGY);
+		}
+}
+
+
+static void SumNearestNeighbourScalar (const NearestNeighbourInput *input_p)
+{
+	SumNearestNeighbourKernel <ScalarOps> (input_p);
+}
+
+
+static const NearestNeighbourKernelChoice &GetKernel ()
+{
+	static const NearestNeighbourKernelChoice choice = [] ()
+		{
+			NearestNeighbourKernelChoice c = { SumNearestNeighbourScalar, "scalar" };
+
+			#ifdef NN_HAVE_X86_KERNELS
+			__builtin_cpu_init ();
+
+			if (__builtin_cpu_supports ("avx2"))
+				{
+					c.nnkc_kernel_fn = SumNearestNeighbourAVX2;
+					c.nnkc_name_s = "avx2";
+				}
+			else if (__builtin_cpu_supports ("sse4.1"))
+				{
+					c.nnkc_kernel_fn = SumNearestNeighbourSSE41;
+					c.nnkc_name_s = "sse4.1";
+				}
+			#endif
+
+			return c;
+		} ();
+
+	return choice;
+}
+
+
+static uint8 GetBaseCode (const char c)
+{
+	switch (c)
+		{
+			case 'A': case 'a': return 0;
+			case 'C': case 'c': return 1;
+			case 'G': case 'g': return 2;
+			case 'T': case 't': return 3;
+			default: return S_UNKNOWN_BASE;
+		}
+}
+
+
+static inline bool IsPair (const uint8 code_a, const uint8 code_b)
+{
+	/* A pairs with T and C with G, whose codes sum to 3 */
+	return ((code_a != S_UNKNOWN_BASE) && (code_b != S_UNKNOWN_BASE) && (code_a + code_b == 3));
+}
+
+
+static double GetHairpinLoopFreeEnergy (const uint32 length)
+{
+	const size_t num_lengths = sizeof (S_HAIRPIN_LOOP_LENGTHS) / sizeof (S_HAIRPIN_LOOP_LENGTHS [0]);
+	size_t i = 0;
+
+	while ((i + 1 < num_lengths) && (S_HAIRPIN_LOOP_LENGTHS [i + 1] <= length))
+		{
+			++ i;
+		}
+
+	if (S_HAIRPIN_LOOP_LENGTHS [i] == length)
+		{
+			return S_HAIRPIN_LOOP_FREE_ENERGIES [i];
+		}
+
+	return S_HAIRPIN_LOOP_FREE_ENERGIES [i] + S_JACOBSON_STOCKMAYER_FACTOR * log ((double) length / (double) S_HAIRPIN_LOOP_LENGTHS [i]);
+}
+
+
+static inline bool IsWeakBase (const uint8 code)
+{
+	return ((code == 0) || (code == 3));
+}
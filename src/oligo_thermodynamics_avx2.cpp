@@ -0,0 +1,77 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * oligo_thermodynamics_avx2.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "typedefs.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+
+#include <immintrin.h>
+
+/*
+ * Everything from here on is compiled for AVX2. The calculator only calls
+ * into this file once it has checked that the CPU supports it.
+ */
+#pragma GCC target ("avx2")
+
+#include "oligo_thermodynamics_kernel.hpp"
+
+
+namespace
+{
+	struct AVX2Ops
+	{
+		typedef __m256i Table;
+		typedef __m256i Codes;
+		typedef __m256i Sums;
+
+		static const uint32 WIDTH = 32;
+
+		/* vpshufb looks up within each 128-bit lane so the table is needed in both */
+		static inline Table LoadTable (const uint8 *table_p) { return _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) table_p)); }
+		static inline Codes LoadCodes (const uint8 *codes_p) { return _mm256_loadu_si256 ((const __m256i *) codes_p); }
+		static inline Sums Zero () { return _mm256_setzero_si256 (); }
+		static inline Codes Lookup (Table table, Codes codes) { return _mm256_shuffle_epi8 (table, codes); }
+
+		static inline void Accumulate (Codes values, Sums &low_r, Sums &high_r)
+		{
+			low_r = _mm256_add_epi16 (low_r, _mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (values)));
+			high_r = _mm256_add_epi16 (high_r, _mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (values, 1)));
+		}
+
+		static inline void StoreSums (uint16 *sums_p, Sums low, Sums high)
+		{
+			_mm256_storeu_si256 ((__m256i *) sums_p, low);
+			_mm256_storeu_si256 ((__m256i *) (sums_p + 16), high);
+		}
+	};
+}
+
+
+void SumNearestNeighbourAVX2 (const NearestNeighbourInput *input_p)
+{
+	SumNearestNeighbourKernel <AVX2Ops> (input_p);
+}
+
+#endif
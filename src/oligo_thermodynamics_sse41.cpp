@@ -0,0 +1,78 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * oligo_thermodynamics_sse41.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "typedefs.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+
+#include <smmintrin.h>
+
+/*
+ * Everything from here on is compiled for SSE4.1. The calculator only calls
+ * into this file once it has checked that the CPU supports it.
+ */
+#pragma GCC target ("sse4.1")
+
+#include "oligo_thermodynamics_kernel.hpp"
+
+
+namespace
+{
+	struct SSE41Ops
+	{
+		typedef __m128i Table;
+		typedef __m128i Codes;
+		typedef __m128i Sums;
+
+		static const uint32 WIDTH = 16;
+
+		static inline Table LoadTable (const uint8 *table_p) { return _mm_loadu_si128 ((const __m128i *) table_p); }
+		static inline Codes LoadCodes (const uint8 *codes_p) { return _mm_loadu_si128 ((const __m128i *) codes_p); }
+		static inline Sums Zero () { return _mm_setzero_si128 (); }
+
+		/* pshufb gives 0 for any code with its top bit set, which is how the padding is skipped */
+		static inline Codes Lookup (Table table, Codes codes) { return _mm_shuffle_epi8 (table, codes); }
+
+		static inline void Accumulate (Codes values, Sums &low_r, Sums &high_r)
+		{
+			low_r = _mm_add_epi16 (low_r, _mm_cvtepu8_epi16 (values));
+			high_r = _mm_add_epi16 (high_r, _mm_unpackhi_epi8 (values, _mm_setzero_si128 ()));
+		}
+
+		static inline void StoreSums (uint16 *sums_p, Sums low, Sums high)
+		{
+			_mm_storeu_si128 ((__m128i *) sums_p, low);
+			_mm_storeu_si128 ((__m128i *) (sums_p + 8), high);
+		}
+	};
+}
+
+
+void SumNearestNeighbourSSE41 (const NearestNeighbourInput *input_p)
+{
+	SumNearestNeighbourKernel <SSE41Ops> (input_p);
+}
+
+#endif
@@ -0,0 +1,285 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * packed_sequence_file.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "packed_sequence_file.hpp"
+
+#include "streams.h"
+
+
+PackedSequenceFile :: PackedSequenceFile (const char *filename_s)
+	: psf_filename (filename_s),
+		psf_data_p (0),
+		psf_data_size (0),
+		psf_header_p (0),
+		psf_contigs_p (0),
+		psf_n_runs_p (0)
+{
+}
+
+
+PackedSequenceFile :: ~PackedSequenceFile ()
+{
+	if (psf_data_p)
+		{
+			munmap ((void *) psf_data_p, psf_data_size);
+		}
+}
+
+
+const char *PackedSequenceFile :: GetFilename () const
+{
+	return psf_filename.c_str ();
+}
+
+
+size_t PackedSequenceFile :: GetNumContigs () const
+{
+	return (size_t) (psf_header_p -> psh_num_contigs);
+}
+
+
+const char *PackedSequenceFile :: GetContigName (size_t index) const
+{
+	return (const char *) (psf_data_p + psf_header_p -> psh_names_offset + psf_contigs_p [index].pc_name_offset);
+}
+
+
+uint64 PackedSequenceFile :: GetContigLength (size_t index) const
+{
+	return psf_contigs_p [index].pc_length;
+}
+
+
+std :: shared_ptr <const PackedSequenceFile> PackedSequenceFile :: GetShared (const char *filename_s)
+{
+	static std :: mutex s_shared_mutex;
+	static std :: map <std :: string, std :: shared_ptr <const PackedSequenceFile> > s_shared_files;
+
+	std :: lock_guard <std :: mutex> lock (s_shared_mutex);
+	std :: map <std :: string, std :: shared_ptr <const PackedSequenceFile> > :: const_iterator itr = s_shared_files.find (filename_s);
+
+	if (itr != s_shared_files.end ())
+		{
+			return itr -> second;
+		}
+	else
+		{
+			std :: shared_ptr <PackedSequenceFile> file_p (new PackedSequenceFile (filename_s));
+
+			if (file_p -> Load ())
+				{
+					s_shared_files [filename_s] = file_p;
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Mapped \"%s\" with " UINT64_FMT " contigs", filename_s, file_p -> psf_header_p -> psh_num_contigs);
+
+					return file_p;
+				}
+		}
+
+	return std :: shared_ptr <const PackedSequenceFile> ();
+}
+
+
+bool PackedSequenceFile :: Load ()
+{
+	bool success_flag = false;
+	int fd = open (psf_filename.c_str (), O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size >= (off_t) sizeof (PackedSequenceHeader)))
+				{
+					void *data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+					if (data_p != MAP_FAILED)
+						{
+							psf_data_p = (const uint8 *) data_p;
+							psf_data_size = (size_t) st.st_size;
+
+							madvise (data_p, psf_data_size, MADV_RANDOM);
+
+							success_flag = CheckLayout ();
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to map packed sequence file \"%s\", %s", psf_filename.c_str (), strerror (errno));
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is too small to be a packed sequence file", psf_filename.c_str ());
+				}
+
+			close (fd);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open packed sequence file \"%s\"", psf_filename.c_str ());
+		}
+
+	return success_flag;
+}
+
+
+const PackedContig *PackedSequenceFile :: GetContig (const char *contig_s) const
+{
+	std :: unordered_map <std :: string, size_t> :: const_iterator itr = psf_contigs_map.find (contig_s);
+
+	return (itr != psf_contigs_map.end ()) ? psf_contigs_p + itr -> second : 0;
+}
+
+
+bool PackedSequenceFile :: GetRegion (const char *contig_s, uint64 start, uint64 end, FastaRegion &region_r) const
+{
+	const PackedContig *contig_p = GetContig (contig_s);
+
+	if (contig_p)
+		{
+			const PackedNRun *runs_p = psf_n_runs_p + contig_p -> pc_first_n_run;
+			const PackedNRun *runs_end_p = runs_p + contig_p -> pc_num_n_runs;
+			const PackedNRun *first_p;
+			const PackedNRun *last_p;
+
+			if (end > contig_p -> pc_length)
+				{
+					end = contig_p -> pc_length;
+				}
+
+			if (start > end)
+				{
+					start = end;
+				}
+
+			/*
+			 * The runs are in order and don't overlap so find the ones
+			 * that end after the region starts and start before it ends.
+			 */
+			first_p = std :: upper_bound (runs_p, runs_end_p, start, [] (uint64 pos, const PackedNRun &run_r) { return pos < run_r.pnr_start + run_r.pnr_length; });
+
+			last_p = first_p;
+
+			while ((last_p < runs_end_p) && (last_p -> pnr_start < end))
+				{
+					++ last_p;
+				}
+
+			region_r.fr_data_s = 0;
+			region_r.fr_entry_p = 0;
+			region_r.fr_packed_p = psf_data_p + psf_header_p -> psh_bases_offset + contig_p -> pc_bases_offset;
+			region_r.fr_n_runs_p = first_p;
+			region_r.fr_num_n_runs = (uint64) (last_p - first_p);
+			region_r.fr_start = start;
+			region_r.fr_end = end;
+			region_r.fr_decoded_p.reset ();
+
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Entry \"%s\" not found in \"%s\"", contig_s, psf_filename.c_str ());
+
+	return false;
+}
+
+
+/*
+ * Check that every offset in the file lies within it so that
+ * fetching a region can never read past the end of the mapping.
+ */
+bool PackedSequenceFile :: CheckLayout ()
+{
+	const PackedSequenceHeader *header_p = (const PackedSequenceHeader *) psf_data_p;
+	const uint64 file_size = (uint64) psf_data_size;
+
+	if (memcmp (header_p -> psh_magic_s, PACKED_SEQUENCE_MAGIC_S, sizeof (PACKED_SEQUENCE_MAGIC_S)) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is not a packed sequence file", psf_filename.c_str ());
+			return false;
+		}
+
+	if (header_p -> psh_version != PACKED_SEQUENCE_VERSION)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has version " UINT32_FMT " but only version %d is supported", psf_filename.c_str (), header_p -> psh_version, PACKED_SEQUENCE_VERSION);
+			return false;
+		}
+
+	if ((header_p -> psh_file_size != file_size)
+		|| (header_p -> psh_bases_offset > header_p -> psh_n_runs_offset)
+		|| (header_p -> psh_n_runs_offset > header_p -> psh_contigs_offset)
+		|| (header_p -> psh_contigs_offset > header_p -> psh_names_offset)
+		|| (header_p -> psh_names_offset > file_size)
+		|| ((header_p -> psh_n_runs_offset % sizeof (uint64)) != 0)
+		|| ((header_p -> psh_contigs_offset % sizeof (uint64)) != 0)
+		|| (header_p -> psh_num_n_runs > (header_p -> psh_contigs_offset - header_p -> psh_n_runs_offset) / sizeof (PackedNRun))
+		|| (header_p -> psh_num_contigs > (header_p -> psh_names_offset - header_p -> psh_contigs_offset) / sizeof (PackedContig)))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is truncated or corrupt", psf_filename.c_str ());
+			return false;
+		}
+
+	psf_header_p = header_p;
+	psf_n_runs_p = (const PackedNRun *) (psf_data_p + header_p -> psh_n_runs_offset);
+	psf_contigs_p = (const PackedContig *) (psf_data_p + header_p -> psh_contigs_offset);
+
+	for (uint64 i = 0; i < header_p -> psh_num_contigs; ++ i)
+		{
+			const PackedContig *contig_p = psf_contigs_p + i;
+			const uint64 names_size = file_size - header_p -> psh_names_offset;
+			const char *name_s = (const char *) (psf_data_p + header_p -> psh_names_offset + contig_p -> pc_name_offset);
+
+			if ((contig_p -> pc_name_offset >= names_size)
+				|| (! memchr (name_s, '\0', (size_t) (names_size - contig_p -> pc_name_offset)))
+				|| (contig_p -> pc_bases_offset > header_p -> psh_n_runs_offset - header_p -> psh_bases_offset)
+				|| ((contig_p -> pc_length + 3) / 4 > header_p -> psh_n_runs_offset - header_p -> psh_bases_offset - contig_p -> pc_bases_offset)
+				|| (contig_p -> pc_first_n_run > header_p -> psh_num_n_runs)
+				|| (contig_p -> pc_num_n_runs > header_p -> psh_num_n_runs - contig_p -> pc_first_n_run))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Contig " UINT64_FMT " in \"%s\" is corrupt", i, psf_filename.c_str ());
+					return false;
+				}
+
+			psf_contigs_map [name_s] = (size_t) i;
+		}
+
+	return true;
+}
+
+
+bool LoadSharedPackedSequenceFile (const char *filename_s)
+{
+	return (PackedSequenceFile :: GetShared (filename_s) != 0);
+}
@@ -0,0 +1,375 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_batch_files.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "polymarker_batch_files.hpp"
+
+#include "string_utils.h"
+#include "streams.h"
+
+
+const char * const PolymarkerBatchFiles :: PBF_MARKERS_LIST_S = "markers_list";
+
+const char * const PolymarkerBatchFiles :: PBF_PRIMERS_S = "primers.csv";
+
+const char * const PolymarkerBatchFiles :: PBF_PRIMERS_TO_ORDER_S = "primers_to_order.csv";
+
+const char * const PolymarkerBatchFiles :: PBF_EXONS_S = "exons_genes_and_contigs.fa";
+
+const char * const PolymarkerBatchFiles :: PBF_STATUS_S = "status.txt";
+
+
+static FILE *OpenJobFile (const char *job_dir_s, const char *filename_s, const char *mode_s);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerBatchFiles :: PolymarkerBatchFiles (const char *batch_dir_s)
+	: pbf_batch_dir (batch_dir_s)
+{
+}
+
+
+void PolymarkerBatchFiles :: AddJobDirectory (const char *job_dir_s)
+{
+	pbf_job_dirs.push_back (job_dir_s);
+}
+
+
+std :: string PolymarkerBatchFiles :: GetMarkerPrefix (size_t index)
+{
+	std :: string prefix ("job");
+
+	prefix.append (std :: to_string (index));
+	prefix.push_back ('_');
+
+	return prefix;
+}
+
+
+bool PolymarkerBatchFiles :: WriteMarkers () const
+{
+	bool success_flag = false;
+	char *markers_filename_s = MakeFilename (pbf_batch_dir.c_str (), PBF_MARKERS_LIST_S);
+
+	if (markers_filename_s)
+		{
+			FILE *markers_f = fopen (markers_filename_s, "w");
+
+			if (markers_f)
+				{
+					success_flag = true;
+
+					for (size_t i = 0; success_flag && (i < pbf_job_dirs.size ()); ++ i)
+						{
+							std :: vector <std :: string> lines;
+							const std :: string prefix = GetMarkerPrefix (i);
+
+							if (ReadLines (pbf_job_dirs [i].c_str (), PBF_MARKERS_LIST_S, lines))
+								{
+									std :: vector <std :: string> :: const_iterator itr;
+
+									for (itr = lines.begin (); itr != lines.end (); ++ itr)
+										{
+											std :: vector <std :: string> fields;
+
+											SplitMarkerLine (*itr, fields);
+
+											if (fields.size () == 3)
+												{
+													/* A chromosome that is the same as the gene means that there is no chromosome */
+													const bool no_chromosome_flag = (fields [1] == fields [0]);
+
+													fprintf (markers_f, "%s%s,%s%s,%s\n", prefix.c_str (), fields [0].c_str (), no_chromosome_flag ? prefix.c_str () : "", fields [1].c_str (), fields [2].c_str ());
+												}
+											else if (fields.size () == 2)
+												{
+													fprintf (markers_f, "%s%s,%s\n", prefix.c_str (), fields [0].c_str (), fields [1].c_str ());
+												}
+										}
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+
+					if (fclose (markers_f) != 0)
+						{
+							success_flag = false;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\"", markers_filename_s);
+				}
+
+			FreeCopiedString (markers_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerBatchFiles :: SplitResults () const
+{
+	const char *batch_dir_s = pbf_batch_dir.c_str ();
+	std :: vector <std :: string> primers;
+	std :: vector <std :: string> exons;
+	std :: vector <std :: string> status;
+	std :: vector <std :: string> order;
+	bool success_flag = true;
+
+	if (! (ReadLines (batch_dir_s, PBF_PRIMERS_S, primers) && (!primers.empty ()) && ReadLines (batch_dir_s, PBF_EXONS_S, exons)))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read the results in \"%s\"", batch_dir_s);
+			return false;
+		}
+
+	ReadLines (batch_dir_s, PBF_STATUS_S, status);
+
+	/* The oligos to order are split too if the pipeline wrote them */
+	ReadLines (batch_dir_s, PBF_PRIMERS_TO_ORDER_S, order);
+
+	for (size_t i = 0; i < pbf_job_dirs.size (); ++ i)
+		{
+			const char *job_dir_s = pbf_job_dirs [i].c_str ();
+			const std :: string prefix = GetMarkerPrefix (i);
+			FILE *primers_f = OpenJobFile (job_dir_s, PBF_PRIMERS_S, "w");
+			FILE *exons_f = OpenJobFile (job_dir_s, PBF_EXONS_S, "w");
+			FILE *status_f = OpenJobFile (job_dir_s, PBF_STATUS_S, "a");
+
+			if (primers_f && exons_f)
+				{
+					std :: vector <std :: string> :: const_iterator itr = primers.begin ();
+					bool in_section_flag = false;
+
+					/* the header */
+					fprintf (primers_f, "%s\n", itr -> c_str ());
+
+					for (++ itr; itr != primers.end (); ++ itr)
+						{
+							if (itr -> compare (0, prefix.size (), prefix) == 0)
+								{
+									fprintf (primers_f, "%s\n", itr -> c_str () + prefix.size ());
+								}
+						}
+
+					/*
+					 * Each marker's section of the exons file starts with a header
+					 * for the marker and runs until the next marker's header.
+					 */
+					for (itr = exons.begin (); itr != exons.end (); ++ itr)
+						{
+							const std :: string &line_r = *itr;
+
+							if ((!line_r.empty ()) && (line_r [0] == '>'))
+								{
+									std :: string name = line_r.substr (1);
+									size_t pos = name.find_first_of (" \t");
+
+									if (pos != std :: string :: npos)
+										{
+											name.erase (pos);
+										}
+
+									if (name.compare (0, 3, "job") == 0)
+										{
+											in_section_flag = (name.compare (0, prefix.size (), prefix) == 0);
+										}
+
+									if (in_section_flag)
+										{
+											std :: string header (line_r);
+
+											while ((pos = header.find (prefix)) != std :: string :: npos)
+												{
+													header.erase (pos, prefix.size ());
+												}
+
+											fprintf (exons_f, "%s\n", header.c_str ());
+										}
+								}
+							else if (in_section_flag)
+								{
+									fprintf (exons_f, "%s\n", line_r.c_str ());
+								}
+						}
+				}
+			else
+				{
+					success_flag = false;
+				}
+
+			if (!order.empty ())
+				{
+					FILE *order_f = OpenJobFile (job_dir_s, PBF_PRIMERS_TO_ORDER_S, "w");
+
+					if (order_f)
+						{
+							std :: vector <std :: string> :: const_iterator itr = order.begin ();
+
+							/* the header */
+							fprintf (order_f, "%s\n", itr -> c_str ());
+
+							for (++ itr; itr != order.end (); ++ itr)
+								{
+									if (itr -> compare (0, prefix.size (), prefix) == 0)
+										{
+											/* The oligo names start with the marker too */
+											std :: string line (*itr);
+											size_t pos;
+
+											while ((pos = line.find (prefix)) != std :: string :: npos)
+												{
+													line.erase (pos, prefix.size ());
+												}
+
+											fprintf (order_f, "%s\n", line.c_str ());
+										}
+								}
+
+							fclose (order_f);
+						}
+					else
+						{
+							success_flag = false;
+						}
+				}
+
+			if (status_f)
+				{
+					std :: vector <std :: string> :: const_iterator itr;
+
+					for (itr = status.begin (); itr != status.end (); ++ itr)
+						{
+							fprintf (status_f, "%s\n", itr -> c_str ());
+						}
+
+					fclose (status_f);
+				}
+
+			if (primers_f)
+				{
+					fclose (primers_f);
+				}
+
+			if (exons_f)
+				{
+					fclose (exons_f);
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerBatchFiles :: ReadLines (const char *dir_s, const char *filename_s, std :: vector <std :: string> &lines_r)
+{
+	bool success_flag = false;
+	char *full_filename_s = MakeFilename (dir_s, filename_s);
+
+	if (full_filename_s)
+		{
+			FILE *in_f = fopen (full_filename_s, "r");
+
+			if (in_f)
+				{
+					char *line_s = NULL;
+					size_t line_buffer_size = 0;
+					ssize_t line_length;
+
+					while ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1)
+						{
+							while ((line_length > 0) && ((line_s [line_length - 1] == '\n') || (line_s [line_length - 1] == '\r')))
+								{
+									line_s [-- line_length] = '\0';
+								}
+
+							if (line_length > 0)
+								{
+									lines_r.push_back (line_s);
+								}
+						}
+
+					free (line_s);
+					fclose (in_f);
+
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\"", full_filename_s);
+				}
+
+			FreeCopiedString (full_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+void PolymarkerBatchFiles :: SplitMarkerLine (const std :: string &line_r, std :: vector <std :: string> &fields_r)
+{
+	size_t start = 0;
+	size_t comma;
+
+	while (((comma = line_r.find (',', start)) != std :: string :: npos) && (fields_r.size () < 2))
+		{
+			fields_r.push_back (line_r.substr (start, comma - start));
+			start = comma + 1;
+		}
+
+	fields_r.push_back (line_r.substr (start));
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static FILE *OpenJobFile (const char *job_dir_s, const char *filename_s, const char *mode_s)
+{
+	FILE *f = NULL;
+	char *full_filename_s = MakeFilename (job_dir_s, filename_s);
+
+	if (full_filename_s)
+		{
+			f = fopen (full_filename_s, mode_s);
+
+			if (!f)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\"", full_filename_s);
+				}
+
+			FreeCopiedString (full_filename_s);
+		}
+
+	return f;
+}
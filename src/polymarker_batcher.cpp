@@ -0,0 +1,855 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_batcher.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <ftw.h>
+
+#include "polymarker_batcher.hpp"
+#include "polymarker_batch_files.hpp"
+#include "polymarker_scheduler.hpp"
+#include "polymarker_service_job.h"
+#include "primer3_prefs.h"
+
+#include "jobs_manager.h"
+#include "json_util.h"
+#include "string_utils.h"
+#include "streams.h"
+
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_BATCHER_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_BATCHER_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+static const char * const S_BATCH_WINDOW_KEY_S = "batch_window_ms";
+
+static const char * const S_MAX_BATCH_SIZE_KEY_S = "max_batch_size";
+
+static const uint32 S_DEFAULT_MAX_BATCH_SIZE = 32;
+
+
+/*
+ * Each request gets its own Service so the batcher is shared by all of
+ * them, allowing jobs from different requests to be merged. It is freed
+ * once the last service using it has been freed.
+ */
+static std :: mutex s_shared_batcher_mutex;
+
+static PolymarkerBatcher *s_shared_batcher_p = 0;
+
+static uint32 s_num_shared_batcher_users = 0;
+
+
+static void *RunPolymarkerBatch (void *data_p);
+
+static bool StartPolymarkerBatch (void *data_p);
+
+static void *RunHoldTask (void *data_p);
+
+static bool IsAnyAsyncTaskRunning (const std :: vector <AsyncTask *> &tasks_r);
+
+static bool RemoveBatchDirectory (const char *dir_s);
+
+static int RemoveBatchEntry (const char *path_s, const struct stat *stat_p, int type, struct FTW *ftw_p);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerBatcher *GetSharedPolymarkerBatcher (const PolymarkerServiceData *data_p)
+{
+	PolymarkerBatcher *batcher_p = 0;
+	const json_t *config_p = data_p -> psd_base_data.sd_config_p;
+	json_int_t window_ms = 0;
+	std :: lock_guard <std :: mutex> lock (s_shared_batcher_mutex);
+
+	if (s_shared_batcher_p)
+		{
+			batcher_p = s_shared_batcher_p;
+		}
+	else if (config_p && GetJSONInteger (config_p, S_BATCH_WINDOW_KEY_S, &window_ms) && (window_ms > 0))
+		{
+			json_int_t max_batch_size = S_DEFAULT_MAX_BATCH_SIZE;
+
+			if (GetJSONInteger (config_p, S_MAX_BATCH_SIZE_KEY_S, &max_batch_size) && (max_batch_size < 1))
+				{
+					max_batch_size = 1;
+				}
+
+			try
+				{
+					batcher_p = new PolymarkerBatcher ((uint32) window_ms, (uint32) max_batch_size);
+					s_shared_batcher_p = batcher_p;
+				}
+			catch (std :: bad_alloc &ex_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate PolymarkerBatcher, \"%s\"", ex_r.what ());
+				}
+			catch (std :: system_error &ex_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start PolymarkerBatcher timer, \"%s\"", ex_r.what ());
+				}
+		}
+
+	if (batcher_p)
+		{
+			++ s_num_shared_batcher_users;
+		}
+
+	return batcher_p;
+}
+
+
+void ReleaseSharedPolymarkerBatcher (PolymarkerBatcher *batcher_p, const PolymarkerServiceData *data_p)
+{
+	bool free_flag = false;
+
+	batcher_p -> ReleaseServiceData (data_p);
+
+	{
+		std :: lock_guard <std :: mutex> lock (s_shared_batcher_mutex);
+
+		if (-- s_num_shared_batcher_users == 0)
+			{
+				s_shared_batcher_p = 0;
+				free_flag = true;
+			}
+	}
+
+	if (free_flag)
+		{
+			delete batcher_p;
+		}
+}
+
+
+bool AddJobToPolymarkerBatcher (PolymarkerBatcher *batcher_p, PolymarkerServiceJob *job_p, const ParameterSet *param_set_p)
+{
+	return batcher_p -> AddJob (job_p, param_set_p);
+}
+
+
+PolymarkerBatcher :: PolymarkerBatcher (uint32 window_ms, uint32 max_batch_size)
+	: pb_window_ms (window_ms),
+		pb_max_batch_size (max_batch_size),
+		pb_stopped_flag (false)
+{
+	pb_timer_thread = std :: thread (&PolymarkerBatcher :: RunTimer, this);
+}
+
+
+PolymarkerBatcher :: ~PolymarkerBatcher ()
+{
+	std :: list <PolymarkerBatch *> :: iterator itr;
+
+	Stop ();
+
+	for (itr = pb_batches.begin (); itr != pb_batches.end (); ++ itr)
+		{
+			std :: vector <AsyncTask *> :: iterator task_itr;
+
+			for (task_itr = (*itr) -> pb_hold_tasks.begin (); task_itr != (*itr) -> pb_hold_tasks.end (); ++ task_itr)
+				{
+					if (*task_itr)
+						{
+							FreeAsyncTask (*task_itr);
+						}
+				}
+
+			FreeAsyncTask ((*itr) -> pb_task_p);
+			delete *itr;
+		}
+}
+
+
+bool PolymarkerBatcher :: AddJob (PolymarkerServiceJob *job_p, const ParameterSet *param_set_p)
+{
+	bool success_flag = false;
+	ServiceJob *base_job_p = & (job_p -> psj_base_job);
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+	std :: string key;
+
+	ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+
+	ReapFinishedBatches ();
+
+	if (GetBatchKey (job_p, param_set_p, key))
+		{
+			if (job_p -> psj_tool_p -> PreRun ())
+				{
+					GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (base_job_p -> sj_service_p);
+					JobsManager *manager_p = GetJobsManager (grassroots_p);
+
+					if (AddServiceJobToJobsManager (manager_p, base_job_p -> sj_id, base_job_p))
+						{
+							PolymarkerBatch *full_batch_p = 0;
+
+							SetServiceJobStatus (base_job_p, OS_PENDING);
+
+							{
+								std :: lock_guard <std :: mutex> lock (pb_mutex);
+								std :: map <std :: string, PolymarkerBatch *> :: iterator itr = pb_open_batches.find (key);
+								PolymarkerBatch *batch_p = 0;
+
+								if (itr != pb_open_batches.end ())
+									{
+										batch_p = itr -> second;
+									}
+								else if (pb_stopped_flag)
+									{
+										PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to batch job %s as the service is stopping", uuid_s);
+									}
+								else
+									{
+										/*
+										 * The batch is run by the first job's service, which
+										 * is kept until the batch's task has finished.
+										 */
+										const PolymarkerServiceData *data_p = job_p -> psj_tool_p -> GetServiceData ();
+										AsyncTask *task_p = AllocateAsyncTask ("PolymarkerBatch", data_p -> psd_task_manager_p, true);
+
+										if (task_p)
+											{
+												batch_p = new PolymarkerBatch;
+
+												batch_p -> pb_key = key;
+												batch_p -> pb_deadline = std :: chrono :: steady_clock :: now () + std :: chrono :: milliseconds (pb_window_ms);
+												batch_p -> pb_closed_flag = false;
+												batch_p -> pb_finished_flag = false;
+												batch_p -> pb_released_flag = false;
+												batch_p -> pb_task_p = task_p;
+												batch_p -> pb_data_p = data_p;
+												batch_p -> pb_batcher_p = this;
+
+												if (SetAsyncTaskRunData (task_p, RunPolymarkerBatch, batch_p))
+													{
+														pb_open_batches [key] = batch_p;
+														pb_batches.push_back (batch_p);
+
+														/* Let the timer know about the new batch's deadline */
+														pb_timer_cond.notify_all ();
+													}
+												else
+													{
+														PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set batch task data for job %s", uuid_s);
+														FreeAsyncTask (task_p);
+														delete batch_p;
+														batch_p = 0;
+													}
+											}
+										else
+											{
+												PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate batch task for job %s", uuid_s);
+											}
+									}
+
+								if (batch_p)
+									{
+										const PolymarkerServiceData *data_p = job_p -> psj_tool_p -> GetServiceData ();
+										AsyncTask *hold_task_p = 0;
+
+										/* A job from another request's service needs to keep its own service */
+										if (data_p != batch_p -> pb_data_p)
+											{
+												hold_task_p = AllocateAsyncTask ("PolymarkerBatchJob", data_p -> psd_task_manager_p, true);
+
+												if (hold_task_p && !SetAsyncTaskRunData (hold_task_p, RunHoldTask, NULL))
+													{
+														FreeAsyncTask (hold_task_p);
+														hold_task_p = 0;
+													}
+
+												if (!hold_task_p)
+													{
+														PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate batch task for job %s", uuid_s);
+
+														/* The batch is left as it is */
+														batch_p = 0;
+													}
+											}
+
+										if (batch_p)
+											{
+												batch_p -> pb_jobs.push_back (job_p);
+												batch_p -> pb_hold_tasks.push_back (hold_task_p);
+
+												if (batch_p -> pb_jobs.size () >= pb_max_batch_size)
+													{
+														/* The batch is full so run it straight away */
+														batch_p -> pb_closed_flag = true;
+														pb_open_batches.erase (key);
+														full_batch_p = batch_p;
+													}
+
+												success_flag = true;
+											}
+									}
+							}
+
+							if (full_batch_p)
+								{
+									DispatchBatch (full_batch_p);
+								}
+
+						}		/* if (AddServiceJobToJobsManager (manager_p, base_job_p -> sj_id, base_job_p)) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add Polymarker Service Job \"%s\" to jobs manager", uuid_s);
+						}
+
+				}		/* if (job_p -> psj_tool_p -> PreRun ()) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to prepare job %s for batching", uuid_s);
+				}
+
+		}		/* if (GetBatchKey (job_p, param_set_p, key)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get batch key for job %s", uuid_s);
+		}
+
+	return success_flag;
+}
+
+
+void PolymarkerBatcher :: RunBatch (PolymarkerBatch *batch_p)
+{
+	std :: vector <PolymarkerServiceJob *> :: iterator itr;
+	PolymarkerTool *leader_p = batch_p -> pb_jobs.front () -> psj_tool_p;
+	char *error_s = NULL;
+	bool success_flag = false;
+
+	for (itr = batch_p -> pb_jobs.begin (); itr != batch_p -> pb_jobs.end (); ++ itr)
+		{
+			SetServiceJobStatus (& ((*itr) -> psj_base_job), OS_STARTED);
+		}
+
+	#if POLYMARKER_BATCHER_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Running batch of " SIZET_FMT " jobs for \"%s\"", batch_p -> pb_jobs.size (), batch_p -> pb_key.c_str ());
+	#endif
+
+	if (batch_p -> pb_jobs.size () == 1)
+		{
+			/* There is nothing to merge so run the job in its own directory */
+			success_flag = leader_p -> RunInDirectory (leader_p -> GetJobDirectory (), &error_s);
+		}
+	else
+		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+			std :: string batch_name ("batch_");
+			char *batch_dir_s;
+
+			ConvertUUIDToString (batch_p -> pb_jobs.front () -> psj_base_job.sj_id, uuid_s);
+			batch_name.append (uuid_s);
+
+			batch_dir_s = MakeFilename (batch_p -> pb_data_p -> psd_working_dir_s, batch_name.c_str ());
+
+			if (batch_dir_s)
+				{
+					if (EnsureDirectoryExists (batch_dir_s))
+						{
+							PolymarkerBatchFiles files (batch_dir_s);
+
+							for (itr = batch_p -> pb_jobs.begin (); itr != batch_p -> pb_jobs.end (); ++ itr)
+								{
+									files.AddJobDirectory ((*itr) -> psj_tool_p -> GetJobDirectory ());
+								}
+
+							if (files.WriteMarkers ())
+								{
+									if (leader_p -> RunInDirectory (batch_dir_s, &error_s))
+										{
+											success_flag = files.SplitResults ();
+
+											if (!success_flag)
+												{
+													error_s = CopyToNewString ("Failed to split the batch results", 0, false);
+												}
+										}
+								}
+							else
+								{
+									error_s = CopyToNewString ("Failed to write the batch markers", 0, false);
+								}
+
+							/* Each job now has its own copy of its results */
+							if (!RemoveBatchDirectory (batch_dir_s))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove batch directory \"%s\"", batch_dir_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to make sure directory \"%s\" exists", batch_dir_s);
+						}
+
+					FreeCopiedString (batch_dir_s);
+				}
+		}
+
+	for (itr = batch_p -> pb_jobs.begin (); itr != batch_p -> pb_jobs.end (); ++ itr)
+		{
+			ServiceJob *base_job_p = & ((*itr) -> psj_base_job);
+
+			if (success_flag)
+				{
+					SetServiceJobStatus (base_job_p, OS_SUCCEEDED);
+				}
+			else
+				{
+					SetServiceJobStatus (base_job_p, OS_FAILED);
+
+					if (!AddGeneralErrorMessageToServiceJob (base_job_p, error_s ? error_s : "The batch failed to run"))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error to service job");
+						}
+				}
+
+			PolymarkerServiceJobCompleted (base_job_p);
+		}
+
+	if (error_s)
+		{
+			FreeCopiedString (error_s);
+		}
+
+	RunHoldTasks (batch_p);
+}
+
+
+bool PolymarkerBatcher :: StartBatch (PolymarkerBatch *batch_p)
+{
+	bool can_run_flag;
+
+	{
+		std :: lock_guard <std :: mutex> lock (pb_mutex);
+
+		can_run_flag = ! (pb_stopped_flag || (batch_p -> pb_released_flag));
+	}
+
+	if (can_run_flag)
+		{
+			if (RunAsyncTask (batch_p -> pb_task_p))
+				{
+					return true;
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run batch task for \"%s\"", batch_p -> pb_key.c_str ());
+			FailBatch (batch_p, "Failed to start the batch");
+		}
+	else
+		{
+			FailBatch (batch_p, "The service stopped before the batch ran");
+		}
+
+	return false;
+}
+
+
+void PolymarkerBatcher :: ReleaseServiceData (const PolymarkerServiceData *data_p)
+{
+	std :: vector <PolymarkerBatch *> open_batches;
+	std :: vector <PolymarkerBatch *> :: iterator open_itr;
+
+	{
+		std :: lock_guard <std :: mutex> lock (pb_mutex);
+		std :: list <PolymarkerBatch *> :: iterator itr;
+
+		for (itr = pb_batches.begin (); itr != pb_batches.end (); ++ itr)
+			{
+				PolymarkerBatch *batch_p = *itr;
+
+				if (batch_p -> pb_data_p == data_p)
+					{
+						batch_p -> pb_released_flag = true;
+
+						if (!batch_p -> pb_closed_flag)
+							{
+								batch_p -> pb_closed_flag = true;
+								pb_open_batches.erase (batch_p -> pb_key);
+								open_batches.push_back (batch_p);
+							}
+					}
+
+				for (size_t i = 0; i < batch_p -> pb_jobs.size (); ++ i)
+					{
+						AsyncTask *task_p = batch_p -> pb_hold_tasks [i];
+
+						if (task_p && (batch_p -> pb_jobs [i] -> psj_tool_p -> GetServiceData () == data_p))
+							{
+								FreeAsyncTask (task_p);
+								batch_p -> pb_hold_tasks [i] = 0;
+							}
+					}
+			}
+	}
+
+	for (open_itr = open_batches.begin (); open_itr != open_batches.end (); ++ open_itr)
+		{
+			FailBatch (*open_itr, "The service stopped before the batch ran");
+		}
+}
+
+
+void PolymarkerBatcher :: Stop ()
+{
+	std :: vector <PolymarkerBatch *> open_batches;
+	std :: vector <PolymarkerBatch *> :: iterator itr;
+
+	{
+		std :: lock_guard <std :: mutex> lock (pb_mutex);
+		std :: map <std :: string, PolymarkerBatch *> :: iterator open_itr;
+
+		if (pb_stopped_flag)
+			{
+				return;
+			}
+
+		pb_stopped_flag = true;
+
+		for (open_itr = pb_open_batches.begin (); open_itr != pb_open_batches.end (); ++ open_itr)
+			{
+				open_itr -> second -> pb_closed_flag = true;
+				open_batches.push_back (open_itr -> second);
+			}
+
+		pb_open_batches.clear ();
+		pb_timer_cond.notify_all ();
+	}
+
+	if (pb_timer_thread.joinable ())
+		{
+			pb_timer_thread.join ();
+		}
+
+	for (itr = open_batches.begin (); itr != open_batches.end (); ++ itr)
+		{
+			FailBatch (*itr, "The service stopped before the batch ran");
+		}
+}
+
+
+/*
+ * Close each batch once its window has elapsed, sleeping until the
+ * earliest deadline of the batches that are still open.
+ */
+void PolymarkerBatcher :: RunTimer ()
+{
+	std :: unique_lock <std :: mutex> lock (pb_mutex);
+
+	while (!pb_stopped_flag)
+		{
+			const std :: chrono :: steady_clock :: time_point now = std :: chrono :: steady_clock :: now ();
+			std :: chrono :: steady_clock :: time_point next_deadline = std :: chrono :: steady_clock :: time_point :: max ();
+			std :: map <std :: string, PolymarkerBatch *> :: iterator itr = pb_open_batches.begin ();
+			std :: vector <PolymarkerBatch *> due_batches;
+
+			while (itr != pb_open_batches.end ())
+				{
+					PolymarkerBatch *batch_p = itr -> second;
+
+					if (batch_p -> pb_deadline <= now)
+						{
+							batch_p -> pb_closed_flag = true;
+							due_batches.push_back (batch_p);
+							itr = pb_open_batches.erase (itr);
+						}
+					else
+						{
+							if (batch_p -> pb_deadline < next_deadline)
+								{
+									next_deadline = batch_p -> pb_deadline;
+								}
+
+							++ itr;
+						}
+				}
+
+			if (!due_batches.empty ())
+				{
+					std :: vector <PolymarkerBatch *> :: iterator due_itr;
+
+					lock.unlock ();
+
+					for (due_itr = due_batches.begin (); due_itr != due_batches.end (); ++ due_itr)
+						{
+							DispatchBatch (*due_itr);
+						}
+
+					lock.lock ();
+				}
+			else if (next_deadline == std :: chrono :: steady_clock :: time_point :: max ())
+				{
+					pb_timer_cond.wait (lock);
+				}
+			else
+				{
+					pb_timer_cond.wait_until (lock, next_deadline);
+				}
+		}
+}
+
+
+/*
+ * Start a closed batch or, if the number of concurrent pipelines is
+ * limited, queue it to wait for its turn as a single run.
+ */
+void PolymarkerBatcher :: DispatchBatch (PolymarkerBatch *batch_p)
+{
+	PolymarkerScheduler *scheduler_p = batch_p -> pb_data_p -> psd_scheduler_p;
+
+	if (scheduler_p)
+		{
+			const PolymarkerTool *leader_p = batch_p -> pb_jobs.front () -> psj_tool_p;
+
+			/* If the batch fails to start, the scheduler completes its jobs */
+			if (!scheduler_p -> Submit (batch_p -> pb_jobs, leader_p -> GetPolymarkerSequence (), StartPolymarkerBatch, batch_p, batch_p -> pb_data_p))
+				{
+					FailBatch (batch_p, "Failed to queue the batch");
+				}
+		}
+	else
+		{
+			/* If the batch fails to start, its jobs have been failed */
+			StartBatch (batch_p);
+		}
+}
+
+
+void PolymarkerBatcher :: FailBatch (PolymarkerBatch *batch_p, const char *error_s)
+{
+	std :: vector <PolymarkerServiceJob *> :: iterator itr;
+
+	for (itr = batch_p -> pb_jobs.begin (); itr != batch_p -> pb_jobs.end (); ++ itr)
+		{
+			ServiceJob *base_job_p = & ((*itr) -> psj_base_job);
+
+			SetServiceJobStatus (base_job_p, OS_FAILED_TO_START);
+
+			if (!AddGeneralErrorMessageToServiceJob (base_job_p, error_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error to service job");
+				}
+
+			PolymarkerServiceJobCompleted (base_job_p);
+		}
+
+	RunHoldTasks (batch_p);
+}
+
+
+/*
+ * Let the services of a batch's completed jobs be freed and mark the
+ * batch as finished.
+ */
+void PolymarkerBatcher :: RunHoldTasks (PolymarkerBatch *batch_p)
+{
+	std :: lock_guard <std :: mutex> lock (pb_mutex);
+	std :: vector <AsyncTask *> :: iterator itr;
+
+	for (itr = batch_p -> pb_hold_tasks.begin (); itr != batch_p -> pb_hold_tasks.end (); ++ itr)
+		{
+			if ((*itr) && (!RunAsyncTask (*itr)))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run hold task for batch \"%s\"", batch_p -> pb_key.c_str ());
+				}
+		}
+
+	batch_p -> pb_finished_flag = true;
+}
+
+
+/*
+ * Jobs can only share a pipeline run if they use the same
+ * database, aligner, primer3 settings, arm selection and priority.
+ */
+bool PolymarkerBatcher :: GetBatchKey (PolymarkerServiceJob *job_p, const ParameterSet *param_set_p, std :: string &key_r) const
+{
+	bool success_flag = false;
+	const PolymarkerTool *tool_p = job_p -> psj_tool_p;
+	const PolymarkerSequence *seq_p = tool_p -> GetPolymarkerSequence ();
+	const PolymarkerServiceData *data_p = tool_p -> GetServiceData ();
+	Primer3Prefs *prefs_p = AllocatePrimer3Prefs (data_p);
+
+	if (prefs_p)
+		{
+			std :: vector <std :: string> lines;
+
+			if (PolymarkerBatchFiles :: ReadLines (tool_p -> GetJobDirectory (), PolymarkerBatchFiles :: PBF_MARKERS_LIST_S, lines))
+				{
+					bool has_chromosome_flag = false;
+					std :: vector <std :: string> :: const_iterator itr;
+					char prefs_s [256];
+
+					for (itr = lines.begin (); itr != lines.end (); ++ itr)
+						{
+							std :: vector <std :: string> fields;
+
+							PolymarkerBatchFiles :: SplitMarkerLine (*itr, fields);
+
+							if ((fields.size () == 3) && (fields [1] != fields [0]))
+								{
+									has_chromosome_flag = true;
+								}
+						}
+
+					ParsePrimer3PrefsParameters (param_set_p, prefs_p);
+
+					snprintf (prefs_s, sizeof (prefs_s), UINT32_FMT "-" UINT32_FMT "," UINT32_FMT ",%d,%d," UINT32_FMT ",%d",
+						prefs_p -> pp_product_size_range_min, prefs_p -> pp_product_size_range_max, prefs_p -> pp_max_size,
+						prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0, prefs_p -> pp_liberal_base ? 1 : 0,
+						prefs_p -> pp_num_return, prefs_p -> pp_explain_flag ? 1 : 0);
+
+					key_r.assign (seq_p -> ps_fasta_filename_s);
+					key_r.push_back ('\t');
+					key_r.append (data_p -> psd_aligner_s ? data_p -> psd_aligner_s : "");
+					key_r.push_back ('\t');
+					key_r.append (prefs_s);
+					key_r.push_back ('\t');
+					key_r.append (has_chromosome_flag ? "chromosome" : "first_two");
+					key_r.push_back ('\t');
+					key_r.append (std :: to_string ((int) (job_p -> psj_priority)));
+
+					success_flag = true;
+				}
+
+			FreePrimer3Prefs (prefs_p);
+		}
+
+	return success_flag;
+}
+
+
+void PolymarkerBatcher :: ReapFinishedBatches ()
+{
+	std :: lock_guard <std :: mutex> lock (pb_mutex);
+	std :: list <PolymarkerBatch *> :: iterator itr = pb_batches.begin ();
+
+	while (itr != pb_batches.end ())
+		{
+			PolymarkerBatch *batch_p = *itr;
+
+			if ((batch_p -> pb_finished_flag) && (!IsAsyncTaskRunning (batch_p -> pb_task_p)) && (!IsAnyAsyncTaskRunning (batch_p -> pb_hold_tasks)))
+				{
+					std :: vector <AsyncTask *> :: iterator task_itr;
+
+					for (task_itr = batch_p -> pb_hold_tasks.begin (); task_itr != batch_p -> pb_hold_tasks.end (); ++ task_itr)
+						{
+							if (*task_itr)
+								{
+									FreeAsyncTask (*task_itr);
+								}
+						}
+
+					FreeAsyncTask (batch_p -> pb_task_p);
+					delete batch_p;
+					itr = pb_batches.erase (itr);
+				}
+			else
+				{
+					++ itr;
+				}
+		}
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static void *RunPolymarkerBatch (void *data_p)
+{
+	PolymarkerBatch *batch_p = static_cast <PolymarkerBatch *> (data_p);
+
+	batch_p -> pb_batcher_p -> RunBatch (batch_p);
+
+	return NULL;
+}
+
+
+/*
+ * A batch that fails to start completes its own jobs, so this always
+ * tells the PolymarkerScheduler that it started.
+ */
+static bool StartPolymarkerBatch (void *data_p)
+{
+	PolymarkerBatch *batch_p = static_cast <PolymarkerBatch *> (data_p);
+
+	batch_p -> pb_batcher_p -> StartBatch (batch_p);
+
+	return true;
+}
+
+
+/*
+ * A hold task does nothing, it just has to finish for its service to
+ * be freed.
+ */
+static void *RunHoldTask (void * UNUSED_PARAM (data_p))
+{
+	return NULL;
+}
+
+
+static bool IsAnyAsyncTaskRunning (const std :: vector <AsyncTask *> &tasks_r)
+{
+	std :: vector <AsyncTask *> :: const_iterator itr;
+
+	for (itr = tasks_r.begin (); itr != tasks_r.end (); ++ itr)
+		{
+			if ((*itr) && IsAsyncTaskRunning (*itr))
+				{
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+/*
+ * Remove a batch's working directory and everything in it.
+ */
+static bool RemoveBatchDirectory (const char *dir_s)
+{
+	return (nftw (dir_s, RemoveBatchEntry, 16, FTW_DEPTH | FTW_PHYS) == 0);
+}
+
+
+static int RemoveBatchEntry (const char *path_s, const struct stat * UNUSED_PARAM (stat_p), int UNUSED_PARAM (type), struct FTW * UNUSED_PARAM (ftw_p))
+{
+	return remove (path_s);
+}
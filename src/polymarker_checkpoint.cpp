@@ -0,0 +1,407 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_checkpoint.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "polymarker_checkpoint.hpp"
+
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_CHECKPOINT_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_CHECKPOINT_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+const char * const PolymarkerCheckpoint :: PC_SEQUENCES_S = "sequences";
+const char * const PolymarkerCheckpoint :: PC_ALIGNMENT_S = "alignment";
+const char * const PolymarkerCheckpoint :: PC_PRIMER3_INPUT_S = "primer3_input";
+const char * const PolymarkerCheckpoint :: PC_PRIMER3_OUTPUT_S = "primer3_output";
+
+const char * const PolymarkerCheckpoint :: PC_FILENAME_S = "checkpoint.json";
+const char * const PolymarkerCheckpoint :: PC_LOCK_FILENAME_S = "checkpoint.lock";
+
+
+/*
+ * The keys used in checkpoint.json
+ */
+static const char * const S_FASTA_S = "fasta";
+static const char * const S_PRIMER3_S = "primer3";
+static const char * const S_STAGES_S = "stages";
+static const char * const S_FILE_S = "file";
+static const char * const S_SIZE_S = "size";
+static const char * const S_FINISHED_S = "finished";
+
+static const char * const S_PRODUCT_SIZE_MIN_S = "product_size_range_min";
+static const char * const S_PRODUCT_SIZE_MAX_S = "product_size_range_max";
+static const char * const S_MAX_SIZE_S = "max_size";
+static const char * const S_LIB_AMBIGUITY_CODES_CONSENSUS_S = "lib_ambiguity_codes_consensus";
+static const char * const S_LIBERAL_BASE_S = "liberal_base";
+static const char * const S_NUM_RETURN_S = "num_return";
+static const char * const S_EXPLAIN_S = "explain_flag";
+
+
+PolymarkerCheckpoint :: PolymarkerCheckpoint (const char *job_dir_s)
+	: pc_job_dir (job_dir_s),
+		pc_manifest_p (0),
+		pc_lock_fd (-1)
+{
+}
+
+
+PolymarkerCheckpoint :: ~PolymarkerCheckpoint ()
+{
+	if (pc_manifest_p)
+		{
+			json_decref (pc_manifest_p);
+		}
+
+	if (pc_lock_fd != -1)
+		{
+			/* Closing the file releases the lock */
+			close (pc_lock_fd);
+		}
+}
+
+
+bool PolymarkerCheckpoint :: Lock ()
+{
+	if (pc_lock_fd == -1)
+		{
+			std :: string filename = GetFilename (PC_LOCK_FILENAME_S);
+			int fd = open (filename.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+			if (fd != -1)
+				{
+					if (flock (fd, LOCK_EX | LOCK_NB) == 0)
+						{
+							pc_lock_fd = fd;
+						}
+					else
+						{
+							if (errno != EWOULDBLOCK)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to lock \"%s\", %s", filename.c_str (), strerror (errno));
+								}
+
+							close (fd);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\", %s", filename.c_str (), strerror (errno));
+				}
+		}
+
+	return (pc_lock_fd != -1);
+}
+
+
+bool PolymarkerCheckpoint :: Load ()
+{
+	std :: string filename = GetFilename (PC_FILENAME_S);
+	json_error_t err;
+	json_t *manifest_p = json_load_file (filename.c_str (), 0, &err);
+
+	if (manifest_p)
+		{
+			if (json_is_object (json_object_get (manifest_p, S_STAGES_S)))
+				{
+					if (pc_manifest_p)
+						{
+							json_decref (pc_manifest_p);
+						}
+
+					pc_manifest_p = manifest_p;
+
+					return true;
+				}
+
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" has no stages", filename.c_str ());
+			json_decref (manifest_p);
+		}
+
+	return false;
+}
+
+
+bool PolymarkerCheckpoint :: Start (const char *fasta_filename_s, const Primer3Prefs *prefs_p)
+{
+	json_t *manifest_p = json_object ();
+
+	if (manifest_p)
+		{
+			json_t *stages_p = json_object ();
+
+			if (stages_p)
+				{
+					if (json_object_set_new (manifest_p, S_STAGES_S, stages_p) == 0)
+						{
+							json_t *primer3_p = json_object ();
+
+							if (primer3_p)
+								{
+									if (json_object_set_new (manifest_p, S_PRIMER3_S, primer3_p) == 0)
+										{
+											if (SetJSONInteger (primer3_p, S_PRODUCT_SIZE_MIN_S, prefs_p -> pp_product_size_range_min) &&
+												SetJSONInteger (primer3_p, S_PRODUCT_SIZE_MAX_S, prefs_p -> pp_product_size_range_max) &&
+												SetJSONInteger (primer3_p, S_MAX_SIZE_S, prefs_p -> pp_max_size) &&
+												SetJSONBoolean (primer3_p, S_LIB_AMBIGUITY_CODES_CONSENSUS_S, prefs_p -> pp_lib_ambiguity_codes_consensus) &&
+												SetJSONBoolean (primer3_p, S_LIBERAL_BASE_S, prefs_p -> pp_liberal_base) &&
+												SetJSONInteger (primer3_p, S_NUM_RETURN_S, prefs_p -> pp_num_return) &&
+												SetJSONBoolean (primer3_p, S_EXPLAIN_S, prefs_p -> pp_explain_flag) &&
+												SetJSONString (manifest_p, S_FASTA_S, fasta_filename_s))
+												{
+													if (pc_manifest_p)
+														{
+															json_decref (pc_manifest_p);
+														}
+
+													pc_manifest_p = manifest_p;
+
+													return Save ();
+												}
+										}
+									else
+										{
+											json_decref (primer3_p);
+										}
+								}
+						}
+					else
+						{
+							json_decref (stages_p);
+						}
+				}
+
+			json_decref (manifest_p);
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create checkpoint for \"%s\"", pc_job_dir.c_str ());
+
+	return false;
+}
+
+
+bool PolymarkerCheckpoint :: IsStageComplete (const char *stage_s) const
+{
+	bool complete_flag = false;
+
+	if (pc_manifest_p)
+		{
+			const json_t *stage_p = json_object_get (json_object_get (pc_manifest_p, S_STAGES_S), stage_s);
+
+			if (stage_p)
+				{
+					const char *filename_s = GetJSONString (stage_p, S_FILE_S);
+					json_int_t size;
+
+					if (filename_s && GetJSONInteger (stage_p, S_SIZE_S, &size))
+						{
+							std :: string full_filename = GetFilename (filename_s);
+							struct stat st;
+
+							if ((stat (full_filename.c_str (), &st) == 0) && (st.st_size == (off_t) size))
+								{
+									complete_flag = true;
+								}
+						}
+				}
+		}
+
+	return complete_flag;
+}
+
+
+bool PolymarkerCheckpoint :: CompleteStage (const char *stage_s, const char *filename_s)
+{
+	bool success_flag = false;
+
+	if (pc_manifest_p)
+		{
+			struct stat st;
+
+			if (stat (filename_s, &st) == 0)
+				{
+					const char *name_s = strrchr (filename_s, '/');
+					json_t *stage_p;
+
+					name_s = name_s ? name_s + 1 : filename_s;
+
+					stage_p = json_object ();
+
+					if (stage_p)
+						{
+							if (SetJSONString (stage_p, S_FILE_S, name_s) && SetJSONInteger (stage_p, S_SIZE_S, (json_int_t) (st.st_size)))
+								{
+									if (json_object_set_new (json_object_get (pc_manifest_p, S_STAGES_S), stage_s, stage_p) == 0)
+										{
+											success_flag = Save ();
+										}
+								}
+							else
+								{
+									json_decref (stage_p);
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get size of \"%s\", %s", filename_s, strerror (errno));
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerCheckpoint :: Finish ()
+{
+	bool success_flag = false;
+
+	if (pc_manifest_p)
+		{
+			if (SetJSONBoolean (pc_manifest_p, S_FINISHED_S, true))
+				{
+					success_flag = Save ();
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerCheckpoint :: IsFinished () const
+{
+	bool finished_flag = false;
+
+	if (pc_manifest_p)
+		{
+			GetJSONBoolean (pc_manifest_p, S_FINISHED_S, &finished_flag);
+		}
+
+	return finished_flag;
+}
+
+
+const char *PolymarkerCheckpoint :: GetFastaFilename () const
+{
+	return pc_manifest_p ? GetJSONString (pc_manifest_p, S_FASTA_S) : 0;
+}
+
+
+void PolymarkerCheckpoint :: GetPrimer3Prefs (Primer3Prefs *prefs_p) const
+{
+	const json_t *primer3_p = pc_manifest_p ? json_object_get (pc_manifest_p, S_PRIMER3_S) : 0;
+
+	if (primer3_p)
+		{
+			json_int_t i;
+
+			if (GetJSONInteger (primer3_p, S_PRODUCT_SIZE_MIN_S, &i))
+				{
+					prefs_p -> pp_product_size_range_min = (uint32) i;
+				}
+
+			if (GetJSONInteger (primer3_p, S_PRODUCT_SIZE_MAX_S, &i))
+				{
+					prefs_p -> pp_product_size_range_max = (uint32) i;
+				}
+
+			if (GetJSONInteger (primer3_p, S_MAX_SIZE_S, &i))
+				{
+					prefs_p -> pp_max_size = (uint32) i;
+				}
+
+			if (GetJSONInteger (primer3_p, S_NUM_RETURN_S, &i))
+				{
+					prefs_p -> pp_num_return = (uint32) i;
+				}
+
+			GetJSONBoolean (primer3_p, S_LIB_AMBIGUITY_CODES_CONSENSUS_S, & (prefs_p -> pp_lib_ambiguity_codes_consensus));
+			GetJSONBoolean (primer3_p, S_LIBERAL_BASE_S, & (prefs_p -> pp_liberal_base));
+			GetJSONBoolean (primer3_p, S_EXPLAIN_S, & (prefs_p -> pp_explain_flag));
+		}
+}
+
+
+/*
+ * Write to a temporary file and rename it so that an interrupted
+ * write never leaves a truncated manifest behind.
+ */
+bool PolymarkerCheckpoint :: Save ()
+{
+	bool success_flag = false;
+	std :: string filename = GetFilename (PC_FILENAME_S);
+	std :: string temp_filename (filename);
+
+	temp_filename.append (".tmp");
+
+	if (json_dump_file (pc_manifest_p, temp_filename.c_str (), JSON_INDENT (2)) == 0)
+		{
+			if (rename (temp_filename.c_str (), filename.c_str ()) == 0)
+				{
+					success_flag = true;
+
+					#if POLYMARKER_CHECKPOINT_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Saved checkpoint \"%s\"", filename.c_str ());
+					#endif
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to rename \"%s\" to \"%s\", %s", temp_filename.c_str (), filename.c_str (), strerror (errno));
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write \"%s\"", temp_filename.c_str ());
+		}
+
+	return success_flag;
+}
+
+
+std :: string PolymarkerCheckpoint :: GetFilename (const char *filename_s) const
+{
+	std :: string filename (pc_job_dir);
+
+	if ((!filename.empty ()) && (filename [filename.size () - 1] != '/'))
+		{
+			filename.push_back ('/');
+		}
+
+	filename.append (filename_s);
+
+	return filename;
+}
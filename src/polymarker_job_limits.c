@@ -0,0 +1,324 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * polymarker_job_limits.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "polymarker_job_limits.h"
+
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_JOB_TIMEOUT_S = "job_timeout";
+
+static const char * const S_JOB_CPU_LIMIT_S = "job_cpu_limit";
+
+static const char * const S_CGROUP_DIRECTORY_S = "cgroup_directory";
+
+static const char * const S_CGROUP_MEMORY_MAX_S = "cgroup_memory_max";
+
+static const char * const S_CGROUP_CPU_MAX_S = "cgroup_cpu_max";
+
+
+/*
+ * The extra seconds of CPU time a process has between SIGXCPU and SIGKILL.
+ */
+static const rlim_t S_CPU_LIMIT_GRACE = 5;
+
+
+static bool WriteCgroupFile (const char *cgroup_dir_s, const char *name_s, const char *value_s);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerJobLimits *AllocatePolymarkerJobLimits (const json_t *config_p)
+{
+	json_int_t wall_clock_limit = 0;
+	json_int_t cpu_limit = 0;
+	const char *cgroup_dir_s = GetJSONString (config_p, S_CGROUP_DIRECTORY_S);
+
+	GetJSONInteger (config_p, S_JOB_TIMEOUT_S, &wall_clock_limit);
+	GetJSONInteger (config_p, S_JOB_CPU_LIMIT_S, &cpu_limit);
+
+	if ((wall_clock_limit > 0) || (cpu_limit > 0) || cgroup_dir_s)
+		{
+			PolymarkerJobLimits *limits_p = (PolymarkerJobLimits *) AllocMemory (sizeof (PolymarkerJobLimits));
+
+			if (limits_p)
+				{
+					limits_p -> pjl_wall_clock_limit = (wall_clock_limit > 0) ? (uint32) wall_clock_limit : 0;
+					limits_p -> pjl_cpu_limit = (cpu_limit > 0) ? (uint32) cpu_limit : 0;
+					limits_p -> pjl_cgroup_dir_s = cgroup_dir_s;
+					limits_p -> pjl_memory_max_s = NULL;
+					limits_p -> pjl_cpu_max_s = NULL;
+
+					if (cgroup_dir_s)
+						{
+							limits_p -> pjl_memory_max_s = GetJSONString (config_p, S_CGROUP_MEMORY_MAX_S);
+							limits_p -> pjl_cpu_max_s = GetJSONString (config_p, S_CGROUP_CPU_MAX_S);
+						}
+
+					return limits_p;
+				}
+		}
+
+	return NULL;
+}
+
+
+void FreePolymarkerJobLimits (PolymarkerJobLimits *limits_p)
+{
+	FreeMemory (limits_p);
+}
+
+
+char *CreatePolymarkerJobCgroup (const PolymarkerJobLimits *limits_p, const char *name_s)
+{
+	if (limits_p -> pjl_cgroup_dir_s)
+		{
+			char *cgroup_dir_s = MakeFilename (limits_p -> pjl_cgroup_dir_s, name_s);
+
+			if (cgroup_dir_s)
+				{
+					if ((mkdir (cgroup_dir_s, S_IRWXU) == 0) || (errno == EEXIST))
+						{
+							bool success_flag = true;
+
+							if (limits_p -> pjl_memory_max_s)
+								{
+									success_flag = WriteCgroupFile (cgroup_dir_s, "memory.max", limits_p -> pjl_memory_max_s);
+								}
+
+							if (success_flag && (limits_p -> pjl_cpu_max_s))
+								{
+									success_flag = WriteCgroupFile (cgroup_dir_s, "cpu.max", limits_p -> pjl_cpu_max_s);
+								}
+
+							if (success_flag)
+								{
+									return cgroup_dir_s;
+								}
+
+							rmdir (cgroup_dir_s);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create cgroup \"%s\", %s", cgroup_dir_s, strerror (errno));
+						}
+
+					FreeCopiedString (cgroup_dir_s);
+				}		/* if (cgroup_dir_s) */
+		}
+
+	return NULL;
+}
+
+
+void RemovePolymarkerJobCgroup (const char *cgroup_dir_s)
+{
+	/*
+	 * cgroup.kill needs Linux 5.14 or later. If it isn't available, the
+	 * process group will already have been signalled.
+	 */
+	WriteCgroupFile (cgroup_dir_s, "cgroup.kill", "1");
+
+	if (rmdir (cgroup_dir_s) != 0)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove cgroup \"%s\", %s", cgroup_dir_s, strerror (errno));
+		}
+}
+
+
+bool GetPolymarkerJobCgroupCpuUsage (const char *cgroup_dir_s, uint64 *usage_usec_p)
+{
+	bool success_flag = false;
+	char *filename_s = MakeFilename (cgroup_dir_s, "cpu.stat");
+
+	if (filename_s)
+		{
+			FILE *stat_f = fopen (filename_s, "r");
+
+			if (stat_f)
+				{
+					char key_s [64];
+					unsigned long long value;
+
+					/* Each line is "<key> <value>" and usage_usec is always present */
+					while (!success_flag && (fscanf (stat_f, "%63s %llu", key_s, &value) == 2))
+						{
+							if (strcmp (key_s, "usage_usec") == 0)
+								{
+									*usage_usec_p = (uint64) value;
+									success_flag = true;
+								}
+						}
+
+					fclose (stat_f);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\", %s", filename_s, strerror (errno));
+				}
+
+			FreeCopiedString (filename_s);
+		}
+
+	return success_flag;
+}
+
+
+pid_t SpawnPolymarkerProcess (const char *command_s, const PolymarkerJobLimits *limits_p, const char *cgroup_dir_s)
+{
+	pid_t pid;
+	int procs_fd = -1;
+
+	/*
+	 * Open the cgroup's process list now as only async-signal-safe
+	 * functions can be called in the child.
+	 */
+	if (cgroup_dir_s)
+		{
+			char *procs_filename_s = MakeFilename (cgroup_dir_s, "cgroup.procs");
+
+			if (procs_filename_s)
+				{
+					procs_fd = open (procs_filename_s, O_WRONLY | O_CLOEXEC);
+
+					if (procs_fd == -1)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\", %s", procs_filename_s, strerror (errno));
+						}
+
+					FreeCopiedString (procs_filename_s);
+				}
+		}
+
+	pid = fork ();
+
+	if (pid == 0)
+		{
+			/* Put the pipeline and everything it runs into its own process group */
+			setpgid (0, 0);
+
+			if (procs_fd != -1)
+				{
+					/* Writing 0 moves the writing process */
+					if (write (procs_fd, "0", 1) != 1)
+						{
+							_exit (126);
+						}
+				}
+
+			/* Without a cgroup, the job's CPU time can't be totalled so limit each process instead */
+			if (limits_p && (limits_p -> pjl_cpu_limit > 0) && !cgroup_dir_s)
+				{
+					struct rlimit limit;
+
+					limit.rlim_cur = (rlim_t) (limits_p -> pjl_cpu_limit);
+					limit.rlim_max = limit.rlim_cur + S_CPU_LIMIT_GRACE;
+
+					setrlimit (RLIMIT_CPU, &limit);
+				}
+
+			execl ("/bin/sh", "sh", "-c", command_s, (char *) NULL);
+			_exit (127);
+		}
+	else if (pid > 0)
+		{
+			/* Also set it here so that there is no race with SignalPolymarkerProcess */
+			setpgid (pid, pid);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to fork for \"%s\", %s", command_s, strerror (errno));
+		}
+
+	if (procs_fd != -1)
+		{
+			close (procs_fd);
+		}
+
+	return pid;
+}
+
+
+void SignalPolymarkerProcess (pid_t pid, int sig)
+{
+	if (pid > 0)
+		{
+			if (kill (-pid, sig) != 0)
+				{
+					kill (pid, sig);
+				}
+		}
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static bool WriteCgroupFile (const char *cgroup_dir_s, const char *name_s, const char *value_s)
+{
+	bool success_flag = false;
+	char *filename_s = MakeFilename (cgroup_dir_s, name_s);
+
+	if (filename_s)
+		{
+			int fd = open (filename_s, O_WRONLY | O_CLOEXEC);
+
+			if (fd != -1)
+				{
+					const size_t length = strlen (value_s);
+
+					if (write (fd, value_s, length) == (ssize_t) length)
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write \"%s\" to \"%s\", %s", value_s, filename_s, strerror (errno));
+						}
+
+					close (fd);
+				}
+
+			FreeCopiedString (filename_s);
+		}
+
+	return success_flag;
+}
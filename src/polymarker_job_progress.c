@@ -0,0 +1,480 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * polymarker_job_progress.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "polymarker_job_progress.h"
+
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_STATUS_FILENAME_S = "status.txt";
+
+static const char * const S_PROGRESS_S = "progress";
+static const char * const S_STAGE_S = "stage";
+static const char * const S_FRACTION_S = "fraction";
+static const char * const S_ELAPSED_S = "elapsed";
+static const char * const S_STAGES_S = "stages";
+static const char * const S_STARTED_S = "started";
+static const char * const S_ERROR_S = "error";
+
+
+/*
+ * The names of each PolymarkerJobStage as they appear in the JSON.
+ */
+static const char * const S_STAGE_NAMES_SS [PJS_NUM_STAGES] =
+{
+	"Not started",
+	"Loading reference",
+	"Reading SNPs",
+	"Writing sequences to align",
+	"Searching markers in genome",
+	"Reading alignments",
+	"Running primer3",
+	"Selecting best primers",
+	"Done",
+	"Error"
+};
+
+
+/*
+ * The fraction of a typical run that has been completed when each stage
+ * starts. Searching the genome dominates the run time.
+ */
+static const double S_STAGE_FRACTIONS [PJS_NUM_STAGES] =
+{
+	0.0,
+	0.02,
+	0.05,
+	0.08,
+	0.1,
+	0.7,
+	0.75,
+	0.95,
+	1.0,
+	1.0
+};
+
+
+/*
+ * The status.txt lines, after the timestamp, that start each stage.
+ */
+typedef struct StatusLineStage
+{
+	const char *sls_prefix_s;
+	PolymarkerJobStage sls_stage;
+} StatusLineStage;
+
+
+static const StatusLineStage S_STATUS_LINE_STAGES [] =
+{
+	{ "Loading Reference", PJS_LOADING_REFERENCE },
+	{ "Reading SNPs", PJS_READING_SNPS },
+	{ "Writing sequences to align", PJS_WRITING_SEQUENCES },
+	{ "Searching markers in genome", PJS_SEARCHING_MARKERS },
+	{ "Starting loading fasta indices", PJS_SEARCHING_MARKERS },
+	{ "Finished loading fasta indices", PJS_SEARCHING_MARKERS },
+	{ "Reading best alignment on each chromosome", PJS_READING_ALIGNMENTS },
+	{ "Running primer3", PJS_RUNNING_PRIMER3 },
+	{ "Ran primer3", PJS_RUNNING_PRIMER3 },
+	{ "Selecting best primers", PJS_SELECTING_PRIMERS },
+	{ "DONE", PJS_DONE },
+	{ "ERROR", PJS_ERROR },
+	{ NULL, PJS_NUM_STAGES }
+};
+
+
+static void ParseStatusLine (void *data_p, const char *line_s);
+
+static time_t ParseStatusTime (const char *time_s, const size_t length);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerJobProgress *AllocatePolymarkerJobProgress (void)
+{
+	PolymarkerJobProgress *progress_p = (PolymarkerJobProgress *) AllocMemory (sizeof (PolymarkerJobProgress));
+
+	if (progress_p)
+		{
+			uint32 i;
+
+			progress_p -> pjp_status_filename_s = NULL;
+			progress_p -> pjp_offset = 0;
+			progress_p -> pjp_stage = PJS_NOT_STARTED;
+			progress_p -> pjp_error_s = NULL;
+
+			for (i = 0; i < PJS_NUM_STAGES; ++ i)
+				{
+					progress_p -> pjp_stage_times [i] = 0;
+				}
+
+			pthread_mutex_init (& (progress_p -> pjp_mutex), NULL);
+		}
+
+	return progress_p;
+}
+
+
+void FreePolymarkerJobProgress (PolymarkerJobProgress *progress_p)
+{
+	if (progress_p -> pjp_status_filename_s)
+		{
+			FreeCopiedString (progress_p -> pjp_status_filename_s);
+		}
+
+	if (progress_p -> pjp_error_s)
+		{
+			FreeCopiedString (progress_p -> pjp_error_s);
+		}
+
+	pthread_mutex_destroy (& (progress_p -> pjp_mutex));
+
+	FreeMemory (progress_p);
+}
+
+
+bool UpdatePolymarkerJobProgress (PolymarkerJobProgress *progress_p, const char *job_dir_s)
+{
+	bool success_flag = false;
+
+	pthread_mutex_lock (& (progress_p -> pjp_mutex));
+
+	if (! (progress_p -> pjp_status_filename_s))
+		{
+			progress_p -> pjp_status_filename_s = MakeFilename (job_dir_s, S_STATUS_FILENAME_S);
+		}
+
+	if (progress_p -> pjp_status_filename_s)
+		{
+			/* Once the run has finished, nothing more will be written */
+			if ((progress_p -> pjp_stage == PJS_DONE) || (progress_p -> pjp_stage == PJS_ERROR))
+				{
+					success_flag = true;
+				}
+			else
+				{
+					success_flag = ReadNewPolymarkerStatusLines (progress_p -> pjp_status_filename_s, & (progress_p -> pjp_offset), ParseStatusLine, progress_p);
+				}
+		}
+
+	pthread_mutex_unlock (& (progress_p -> pjp_mutex));
+
+	return success_flag;
+}
+
+
+void AddPolymarkerJobStatusLine (PolymarkerJobProgress *progress_p, const char *line_s)
+{
+	pthread_mutex_lock (& (progress_p -> pjp_mutex));
+	ParseStatusLine (progress_p, line_s);
+	pthread_mutex_unlock (& (progress_p -> pjp_mutex));
+}
+
+
+bool AddPolymarkerJobProgressToJSON (PolymarkerJobProgress *progress_p, json_t *json_p)
+{
+	bool success_flag = false;
+	json_t *progress_json_p = json_object ();
+
+	if (progress_json_p)
+		{
+			json_t *stages_json_p = json_array ();
+
+			if (stages_json_p)
+				{
+					const time_t now = time (NULL);
+					time_t first_time = 0;
+					uint32 i;
+
+					success_flag = true;
+
+					pthread_mutex_lock (& (progress_p -> pjp_mutex));
+
+					/*
+					 * Each stage lasts until the next one that was reached starts
+					 */
+					for (i = PJS_LOADING_REFERENCE; (i < PJS_DONE) && success_flag; ++ i)
+						{
+							const time_t started = progress_p -> pjp_stage_times [i];
+
+							if (started)
+								{
+									json_t *stage_json_p = json_object ();
+
+									if (first_time == 0)
+										{
+											first_time = started;
+										}
+
+									if (stage_json_p)
+										{
+											time_t finished = now;
+											uint32 j;
+
+											for (j = i + 1; j < PJS_NUM_STAGES; ++ j)
+												{
+													if (progress_p -> pjp_stage_times [j])
+														{
+															finished = progress_p -> pjp_stage_times [j];
+															break;
+														}
+												}
+
+											if ((json_object_set_new (stage_json_p, S_STAGE_S, json_string (S_STAGE_NAMES_SS [i])) != 0) ||
+													(json_object_set_new (stage_json_p, S_STARTED_S, json_integer ((json_int_t) started)) != 0) ||
+													(json_object_set_new (stage_json_p, S_ELAPSED_S, json_integer ((json_int_t) (finished - started))) != 0))
+												{
+													success_flag = false;
+												}
+
+											if (json_array_append_new (stages_json_p, stage_json_p) != 0)
+												{
+													json_decref (stage_json_p);
+													success_flag = false;
+												}
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (success_flag)
+						{
+							const PolymarkerJobStage stage = progress_p -> pjp_stage;
+							time_t finished = now;
+
+							if ((stage == PJS_DONE) || (stage == PJS_ERROR))
+								{
+									finished = progress_p -> pjp_stage_times [stage];
+								}
+
+							if ((json_object_set_new (progress_json_p, S_STAGE_S, json_string (S_STAGE_NAMES_SS [stage])) != 0) ||
+									(json_object_set_new (progress_json_p, S_FRACTION_S, json_real (S_STAGE_FRACTIONS [stage])) != 0) ||
+									(json_object_set_new (progress_json_p, S_ELAPSED_S, json_integer ((json_int_t) (first_time ? finished - first_time : 0))) != 0))
+								{
+									success_flag = false;
+								}
+
+							if (success_flag && (progress_p -> pjp_error_s))
+								{
+									if (json_object_set_new (progress_json_p, S_ERROR_S, json_string (progress_p -> pjp_error_s)) != 0)
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					pthread_mutex_unlock (& (progress_p -> pjp_mutex));
+
+					if (success_flag)
+						{
+							if (json_object_set_new (progress_json_p, S_STAGES_S, stages_json_p) != 0)
+								{
+									json_decref (stages_json_p);
+									success_flag = false;
+								}
+						}
+					else
+						{
+							json_decref (stages_json_p);
+						}
+				}		/* if (stages_json_p) */
+
+			if (success_flag)
+				{
+					if (json_object_set_new (json_p, S_PROGRESS_S, progress_json_p) != 0)
+						{
+							json_decref (progress_json_p);
+							success_flag = false;
+						}
+				}
+			else
+				{
+					json_decref (progress_json_p);
+				}
+
+		}		/* if (progress_json_p) */
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add progress to JSON");
+		}
+
+	return success_flag;
+}
+
+
+bool ReadNewPolymarkerStatusLines (const char *filename_s, off_t *offset_p, PolymarkerStatusLineCallback line_fn, void *data_p)
+{
+	int fd = open (filename_s, O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			char buffer [4096];
+			ssize_t length;
+
+			while ((length = pread (fd, buffer, sizeof (buffer) - 1, *offset_p)) > 0)
+				{
+					char *line_s = buffer;
+					char *newline_s;
+
+					buffer [length] = '\0';
+
+					while ((newline_s = strchr (line_s, '\n')) != NULL)
+						{
+							*newline_s = '\0';
+
+							if (newline_s > line_s)
+								{
+									line_fn (data_p, line_s);
+								}
+
+							line_s = newline_s + 1;
+						}
+
+					/* Leave any partial line until the rest of it has been written */
+					if (line_s == buffer)
+						{
+							break;
+						}
+
+					*offset_p += (line_s - buffer);
+				}
+
+			close (fd);
+
+			return (length != -1);
+		}
+
+	/* The pipeline might not have written anything yet */
+	return (errno == ENOENT);
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+/*
+ * Each line is "<time>,<status>" where the time is in the same format
+ * as ruby's Time.to_s, e.g. "2019-03-18 10:22:41 +0000".
+ */
+static void ParseStatusLine (void *data_p, const char *line_s)
+{
+	PolymarkerJobProgress *progress_p = (PolymarkerJobProgress *) data_p;
+	const char *status_s = strchr (line_s, ',');
+	time_t line_time;
+	const StatusLineStage *stage_p = S_STATUS_LINE_STAGES;
+
+	if (status_s)
+		{
+			line_time = ParseStatusTime (line_s, status_s - line_s);
+			++ status_s;
+		}
+	else
+		{
+			line_time = time (NULL);
+			status_s = line_s;
+		}
+
+	while (stage_p -> sls_prefix_s)
+		{
+			if (strncmp (status_s, stage_p -> sls_prefix_s, strlen (stage_p -> sls_prefix_s)) == 0)
+				{
+					const PolymarkerJobStage stage = stage_p -> sls_stage;
+
+					/* Several lines can belong to the same stage so keep when it first started */
+					if (progress_p -> pjp_stage_times [stage] == 0)
+						{
+							progress_p -> pjp_stage_times [stage] = line_time;
+						}
+
+					/* The same line can arrive from more than one source so never go back a stage */
+					if (stage > progress_p -> pjp_stage)
+						{
+							progress_p -> pjp_stage = stage;
+						}
+
+					if ((stage == PJS_ERROR) && (! (progress_p -> pjp_error_s)))
+						{
+							const char *error_s = status_s + strlen (stage_p -> sls_prefix_s);
+
+							while ((*error_s == '\t') || (*error_s == ' '))
+								{
+									++ error_s;
+								}
+
+							progress_p -> pjp_error_s = CopyToNewString (error_s, 0, false);
+						}
+
+					return;
+				}
+
+			++ stage_p;
+		}
+}
+
+
+static time_t ParseStatusTime (const char *time_s, const size_t length)
+{
+	time_t t = 0;
+	char buffer [64];
+
+	if (length < sizeof (buffer))
+		{
+			struct tm line_tm;
+			const char *end_s;
+
+			memcpy (buffer, time_s, length);
+			buffer [length] = '\0';
+
+			memset (&line_tm, 0, sizeof (line_tm));
+			end_s = strptime (buffer, "%Y-%m-%d %H:%M:%S %z", &line_tm);
+
+			if (end_s)
+				{
+					t = timegm (&line_tm) - line_tm.tm_gmtoff;
+				}
+		}
+
+	if (t <= 0)
+		{
+			t = time (NULL);
+		}
+
+	return t;
+}
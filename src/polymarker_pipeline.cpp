@@ -0,0 +1,2643 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_pipeline.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "polymarker_pipeline.hpp"
+#include "polymarker_checkpoint.hpp"
+#include "polymarker_task_pool.hpp"
+#include "fasta_file.hpp"
+#include "packed_sequence_file.hpp"
+#include "minimizer_index.hpp"
+#include "marker_batch_scanner.hpp"
+#include "homoeolog_index.hpp"
+#include "smith_waterman.hpp"
+#include "region_cache.hpp"
+#include "primer3_cache.hpp"
+#include "primer3_engine.hpp"
+#include "kasp_selector.hpp"
+#include "oligo_thermodynamics.hpp"
+
+#include "json_util.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_PIPELINE_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_PIPELINE_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+const char * const PolymarkerPipeline :: PP_MARKERS_LIST_S = "markers_list";
+const char * const PolymarkerPipeline :: PP_TO_ALIGN_S = "to_align.fa";
+const char * const PolymarkerPipeline :: PP_CONTIGS_S = "contigs_tmp.fa";
+const char * const PolymarkerPipeline :: PP_EXONERATE_S = "exonerate_tmp.tab";
+const char * const PolymarkerPipeline :: PP_SEEDED_TO_ALIGN_S = "to_align_seeded.fa";
+const char * const PolymarkerPipeline :: PP_UNSEEDED_TO_ALIGN_S = "to_align_unseeded.fa";
+const char * const PolymarkerPipeline :: PP_SEED_WINDOWS_S = "seed_windows.fa";
+const char * const PolymarkerPipeline :: PP_PRIMER3_INPUT_S = "primer_3_input_temp";
+const char * const PolymarkerPipeline :: PP_PRIMER3_OUTPUT_S = "primer_3_output_temp";
+const char * const PolymarkerPipeline :: PP_EXONS_S = "exons_genes_and_contigs.fa";
+const char * const PolymarkerPipeline :: PP_PRIMERS_S = "primers.csv";
+const char * const PolymarkerPipeline :: PP_PRIMERS_TO_ORDER_S = "primers_to_order.csv";
+const char * const PolymarkerPipeline :: PP_STATUS_S = "status.txt";
+
+
+/*
+ * The mask characters used for each position of a marker's template
+ */
+static const char S_MASK_SNP_C = '&';
+static const char S_MASK_NO_DATA_C = '-';
+static const char S_MASK_SAME_C = '.';
+static const char S_MASK_SEMISPECIFIC_C = 'x';
+static const char S_MASK_SPECIFIC_C = 'X';
+
+
+/*
+ * The maximum number of positions to try for the 3' end of the
+ * common primer for each orientation.
+ */
+static const uint32 S_MAX_COMMON_PRIMER_POSITIONS = 5;
+
+/*
+ * primer3's default PRIMER_MIN_SIZE, PRIMER_MIN_TM and PRIMER_MAX_TM, which
+ * are used as the primer3 input doesn't set them.
+ */
+static const uint32 S_PRIMER3_MIN_SIZE = 18;
+static const double S_PRIMER3_MIN_TM = 57.0;
+static const double S_PRIMER3_MAX_TM = 63.0;
+
+/* How far outside primer3's range a Tm can be before its records are left out */
+static const double S_PREFILTER_TM_MARGIN = 0.5;
+
+/* The longest oligo that primer3 uses the nearest-neighbour model for */
+static const uint32 S_PRIMER3_MAX_NN_LENGTH = 36;
+
+
+/* The number of shards that the genome is split into for each search thread so that the threads can balance the work */
+static const uint32 S_SHARDS_PER_THREAD = 4;
+
+/* The k-mer length and window size of the minimizers used to scan the genome, the same as polymarker_build_minimizers' defaults */
+static const uint32 S_SCAN_K = 15;
+static const uint32 S_SCAN_W = 10;
+
+/* Contigs longer than this are split into parts that are scanned on different threads */
+static const uint64 S_SCAN_CHUNK_SIZE = 4 << 20;
+
+
+static std :: string QuoteArgument (const std :: string &arg_r);
+
+static char GetAmbiguityCode (char a, char b);
+
+static char Complement (char c);
+
+static void MergeSeedWindows (std :: vector <SeedWindow> &windows_r);
+
+static bool MoveHitToContig (ExonerateHitTable &hits_r, size_t row, const std :: vector <SeedWindow> &windows_r);
+
+
+
+/*
+ * The hits found in one shard of the genome. These are kept until every
+ * shard has been searched and then written out in shard order, so the
+ * output doesn't depend on which thread searched which shard.
+ */
+struct PolymarkerPipeline :: SearchShard
+{
+	ExonerateHitTable ss_hits;
+
+	/* The aligner's line for each hit or an empty string if it is to be written from the hit's values */
+	std :: vector <std :: string> ss_lines;
+
+	std :: string ss_error;
+};
+
+
+/*
+ * A marker and one of the windows that it was located in.
+ */
+struct SeedTarget
+{
+	size_t st_marker_index;
+	SeedWindow st_window;
+};
+
+
+void PolymarkerPipeline :: SetPipelineConfig (PolymarkerPipelineConfig *config_p, const json_t *service_config_p)
+{
+	const char *value_s;
+	json_int_t i;
+
+	config_p -> ppc_exonerate_executable = "exonerate";
+	config_p -> ppc_model = "est2genome";
+	config_p -> ppc_primer3_executable = "primer3_core";
+	config_p -> ppc_min_identity = 90.0;
+	config_p -> ppc_genomes_count = 3;
+	config_p -> ppc_extract_found_contigs = false;
+	config_p -> ppc_seed_max_occurrences = 1000;
+	config_p -> ppc_seed_window_margin = 500;
+	config_p -> ppc_smith_waterman_flag = false;
+	config_p -> ppc_batch_search_flag = false;
+	config_p -> ppc_primer3_library_flag = true;
+	config_p -> ppc_primer3_threads = 1;
+	config_p -> ppc_primer3_prefilter_flag = false;
+
+	if (service_config_p)
+		{
+			if ((value_s = GetJSONString (service_config_p, "exonerate_executable")) != NULL)
+				{
+					config_p -> ppc_exonerate_executable = value_s;
+				}
+
+			if ((value_s = GetJSONString (service_config_p, "exonerate_model")) != NULL)
+				{
+					config_p -> ppc_model = value_s;
+				}
+
+			if ((value_s = GetJSONString (service_config_p, "primer3_executable")) != NULL)
+				{
+					config_p -> ppc_primer3_executable = value_s;
+				}
+
+			if (GetJSONInteger (service_config_p, "min_identity", &i))
+				{
+					config_p -> ppc_min_identity = (double) i;
+				}
+
+			if (GetJSONInteger (service_config_p, "genomes_count", &i))
+				{
+					if (i > 0)
+						{
+							config_p -> ppc_genomes_count = (uint32) i;
+						}
+				}
+
+			GetJSONBoolean (service_config_p, "extract_found_contigs", & (config_p -> ppc_extract_found_contigs));
+
+			if (GetJSONInteger (service_config_p, "seed_max_occurrences", &i) && (i > 0))
+				{
+					config_p -> ppc_seed_max_occurrences = (uint32) i;
+				}
+
+			if (GetJSONInteger (service_config_p, "seed_window_margin", &i) && (i >= 0))
+				{
+					config_p -> ppc_seed_window_margin = (uint32) i;
+				}
+
+			if ((value_s = GetJSONString (service_config_p, "seed_aligner")) != NULL)
+				{
+					config_p -> ppc_smith_waterman_flag = (strcmp (value_s, "smith_waterman") == 0);
+				}
+
+			GetJSONBoolean (service_config_p, "batch_search", & (config_p -> ppc_batch_search_flag));
+			GetJSONBoolean (service_config_p, "primer3_library", & (config_p -> ppc_primer3_library_flag));
+			GetJSONBoolean (service_config_p, "primer3_prefilter", & (config_p -> ppc_primer3_prefilter_flag));
+
+			if (GetJSONInteger (service_config_p, "primer3_threads", &i))
+				{
+					if (i > 0)
+						{
+							config_p -> ppc_primer3_threads = (uint32) i;
+						}
+					else if (i == 0)
+						{
+							/* Use all of the online CPUs */
+							long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+							if (num_cpus > 0)
+								{
+									config_p -> ppc_primer3_threads = (uint32) num_cpus;
+								}
+						}
+				}
+		}
+}
+
+
+PolymarkerPipeline :: PolymarkerPipeline (const char *job_dir_s, const PolymarkerSequence *seq_p, const PolymarkerPipelineConfig *config_p, const Primer3Prefs *prefs_p)
+	: pp_job_dir (job_dir_s),
+		pp_seq_p (seq_p),
+		pp_config_p (config_p),
+		pp_prefs_p (prefs_p),
+		pp_contigs (),
+		pp_packed_contigs (),
+		pp_seed_index (),
+		pp_scanned_windows (),
+		pp_scanned_flag (false),
+		pp_homoeolog_index (),
+		pp_arm_selector (),
+		pp_first_two_arm_selector (),
+		pp_search_pool (seq_p -> ps_search_threads),
+		pp_primer3_engine (),
+		pp_primer3_pool (config_p -> ppc_primer3_threads),
+		pp_primer3_inputs (),
+		pp_primer3_cache_keys (),
+		pp_cached_primer3_results (),
+		pp_kasp_selector (),
+		pp_num_primer3_records (0),
+		pp_cancel_p (0),
+		pp_checkpoint_p (0),
+		pp_resume_flag (false)
+{
+	/* The rule has already been checked when the service's configuration was read */
+	if (seq_p -> ps_arm_selection_s)
+		{
+			pp_arm_selector.SetRule (seq_p -> ps_arm_selection_s);
+		}
+
+	pp_first_two_arm_selector.SetRule (ArmSelector :: AS_FIRST_TWO_S);
+
+	/* As with the arm selection, the scores have already been checked */
+	if (seq_p -> ps_kasp_scores_p)
+		{
+			KASPScores scores;
+
+			scores.SetFromJSON (seq_p -> ps_kasp_scores_p);
+			pp_kasp_selector.SetScores (scores);
+		}
+	pp_hits.SetArmSelector (&pp_arm_selector);
+}
+
+
+PolymarkerPipeline :: ~PolymarkerPipeline ()
+{
+}
+
+
+const char *PolymarkerPipeline :: GetErrorMessage () const
+{
+	return pp_error.c_str ();
+}
+
+
+bool PolymarkerPipeline :: Run ()
+{
+	bool success_flag = false;
+
+	WriteStatus ("Loading Reference");
+
+	if ((!IsCancelled ()) && LoadMarkers ())
+		{
+			if ((!IsCancelled ()) && WriteSequencesToAlign ())
+				{
+					if ((!IsCancelled ()) && SearchMarkers ())
+						{
+							if ((!IsCancelled ()) && WritePrimer3Input ())
+								{
+									if ((!IsCancelled ()) && RunPrimer3 ())
+										{
+											if ((!IsCancelled ()) && SelectPrimers ())
+												{
+													success_flag = true;
+												}
+										}
+								}
+						}
+				}
+		}
+
+	if (success_flag)
+		{
+			WriteStatus ("DONE");
+		}
+	else
+		{
+			std :: string status ("ERROR\t");
+
+			status.append (pp_error);
+			WriteStatus (status.c_str ());
+		}
+
+	/* The run has ended rather than being interrupted so it mustn't be resumed */
+	if (pp_checkpoint_p)
+		{
+			pp_checkpoint_p -> Finish ();
+		}
+
+	return success_flag;
+}
+
+
+std :: string PolymarkerPipeline :: GetJobFilename (const char *filename_s) const
+{
+	std :: string filename (pp_job_dir);
+
+	if ((!filename.empty ()) && (filename [filename.size () - 1] != '/'))
+		{
+			filename.push_back ('/');
+		}
+
+	filename.append (filename_s);
+
+	return filename;
+}
+
+
+void PolymarkerPipeline :: WriteStatus (const char *status_s)
+{
+	std :: string filename = GetJobFilename (PP_STATUS_S);
+	FILE *status_f = fopen (filename.c_str (), "a");
+
+	if (status_f)
+		{
+			/* Use the same format as ruby's Time.to_s */
+			char time_s [64];
+			time_t now = time (NULL);
+			struct tm now_tm;
+
+			localtime_r (&now, &now_tm);
+			strftime (time_s, sizeof (time_s), "%Y-%m-%d %H:%M:%S %z", &now_tm);
+
+			fprintf (status_f, "%s,%s\n", time_s, status_s);
+			fclose (status_f);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\" to write status \"%s\"", filename.c_str (), status_s);
+		}
+}
+
+
+void PolymarkerPipeline :: SetCancelFlag (const std :: atomic <bool> *cancel_p)
+{
+	pp_cancel_p = cancel_p;
+}
+
+
+bool PolymarkerPipeline :: IsCancelled ()
+{
+	if (pp_cancel_p && (pp_cancel_p -> load ()))
+		{
+			pp_error = "The job was cancelled";
+			return true;
+		}
+
+	return false;
+}
+
+
+void PolymarkerPipeline :: SetCheckpoint (PolymarkerCheckpoint *checkpoint_p, bool resume_flag)
+{
+	pp_checkpoint_p = checkpoint_p;
+	pp_resume_flag = (checkpoint_p != 0) && resume_flag;
+}
+
+
+/*
+ * A stage can only be skipped if all of the stages before it were too,
+ * as each stage's file depends on the ones before it.
+ */
+bool PolymarkerPipeline :: CanSkipStage (const char *stage_s)
+{
+	if (pp_resume_flag)
+		{
+			if (pp_checkpoint_p -> IsStageComplete (stage_s))
+				{
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Reusing the %s stage in \"%s\"", stage_s, pp_job_dir.c_str ());
+					return true;
+				}
+
+			pp_resume_flag = false;
+		}
+
+	return false;
+}
+
+
+/*
+ * For a stage whose file is remade even when resuming, stop resuming if
+ * the new file differs from the checkpointed one so that the stages
+ * after it are run again.
+ */
+void PolymarkerPipeline :: CheckRemadeStage (const char *stage_s)
+{
+	if (pp_resume_flag && (!pp_checkpoint_p -> IsStageComplete (stage_s)))
+		{
+			PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "The %s stage in \"%s\" has changed so the stages after it will be run again", stage_s, pp_job_dir.c_str ());
+			pp_resume_flag = false;
+		}
+}
+
+
+void PolymarkerPipeline :: CheckpointStage (const char *stage_s, const std :: string &filename_r)
+{
+	if (pp_checkpoint_p)
+		{
+			if (!pp_checkpoint_p -> CompleteStage (stage_s, filename_r.c_str ()))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to checkpoint the %s stage in \"%s\"", stage_s, pp_job_dir.c_str ());
+				}
+		}
+}
+
+
+bool PolymarkerPipeline :: SetError (const char *message_s)
+{
+	pp_error = message_s;
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Polymarker pipeline in \"%s\" failed: %s", pp_job_dir.c_str (), message_s);
+
+	return false;
+}
+
+
+bool PolymarkerPipeline :: LoadMarkers ()
+{
+	bool success_flag = false;
+	std :: string filename = GetJobFilename (PP_MARKERS_LIST_S);
+	FILE *markers_f;
+
+	WriteStatus ("Reading SNPs");
+
+	markers_f = fopen (filename.c_str (), "r");
+
+	if (markers_f)
+		{
+			char *line_s = NULL;
+			size_t line_buffer_size = 0;
+
+			while (getline (&line_s, &line_buffer_size, markers_f) != -1)
+				{
+					PolymarkerMarker marker;
+
+					if (ParseMarkerLine (line_s, marker))
+						{
+							pp_markers.push_back (marker);
+						}
+				}
+
+			free (line_s);
+			fclose (markers_f);
+
+			if (!pp_markers.empty ())
+				{
+					success_flag = true;
+				}
+			else
+				{
+					SetError ("No markers with a SNP were found");
+				}
+		}
+	else
+		{
+			SetError ("Failed to open markers list");
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The lines are of the form
+ *
+ * 	gene,chromosome,sequence
+ *
+ * or
+ *
+ * 	gene,sequence
+ *
+ * where each SNP in the sequence is of the form [A/T]. When the service
+ * has no chromosome for a marker it writes the gene name in its place.
+ */
+bool PolymarkerPipeline :: ParseMarkerLine (const char *line_s, PolymarkerMarker &marker_r)
+{
+	std :: vector <std :: string> fields;
+	std :: string line (line_s);
+	size_t start = 0;
+	size_t comma;
+
+	while ((!line.empty ()) && ((line [line.size () - 1] == '\n') || (line [line.size () - 1] == '\r')))
+		{
+			line.erase (line.size () - 1);
+		}
+
+	if (line.empty ())
+		{
+			return false;
+		}
+
+	while ((comma = line.find (',', start)) != std :: string :: npos)
+		{
+			fields.push_back (line.substr (start, comma - start));
+			start = comma + 1;
+		}
+
+	fields.push_back (line.substr (start));
+
+	if (fields.size () == 3)
+		{
+			marker_r.pm_gene = fields [0];
+
+			if (fields [1] != fields [0])
+				{
+					marker_r.pm_chromosome = fields [1];
+				}
+		}
+	else if (fields.size () == 2)
+		{
+			marker_r.pm_gene = fields [0];
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Need two or three fields to parse, and got " SIZET_FMT " in \"%s\"", fields.size (), line.c_str ());
+			return false;
+		}
+
+	const std :: string &sequence_r = fields.back ();
+	bool found_snp_flag = false;
+
+	marker_r.pm_template.clear ();
+	marker_r.pm_template.reserve (sequence_r.size ());
+	marker_r.pm_total_contigs = 0;
+
+	for (size_t i = 0; i < sequence_r.size (); ++ i)
+		{
+			const char c = sequence_r [i];
+
+			if ((c == '[') && (i + 4 < sequence_r.size ()) && (sequence_r [i + 2] == '/') && (sequence_r [i + 4] == ']'))
+				{
+					const char original_c = toupper (sequence_r [i + 1]);
+					const char snp_c = toupper (sequence_r [i + 3]);
+
+					/* As with the ruby version, the last SNP is the one that primers are designed for */
+					marker_r.pm_snp_position = (uint32) marker_r.pm_template.size ();
+					marker_r.pm_original = original_c;
+					marker_r.pm_snp = snp_c;
+					marker_r.pm_template.push_back (GetAmbiguityCode (original_c, snp_c));
+
+					found_snp_flag = true;
+					i += 4;
+				}
+			else if (!isspace (c))
+				{
+					marker_r.pm_template.push_back (toupper (c));
+				}
+		}
+
+	if (!found_snp_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "%s doesn't contain a SNP", marker_r.pm_gene.c_str ());
+		}
+
+	return found_snp_flag;
+}
+
+
+bool PolymarkerPipeline :: WriteSequencesToAlign ()
+{
+	bool success_flag = false;
+	std :: string filename = GetJobFilename (PP_TO_ALIGN_S);
+	FILE *out_f;
+
+	WriteStatus ("Writing sequences to align");
+
+	if (CanSkipStage (PolymarkerCheckpoint :: PC_SEQUENCES_S))
+		{
+			return true;
+		}
+
+	out_f = fopen (filename.c_str (), "w");
+
+	if (out_f)
+		{
+			std :: set <std :: string> written_genes;
+			std :: vector <PolymarkerMarker> :: const_iterator itr;
+
+			success_flag = true;
+
+			for (itr = pp_markers.begin (); success_flag && (itr != pp_markers.end ()); ++ itr)
+				{
+					if (written_genes.insert (itr -> pm_gene).second)
+						{
+							if (fprintf (out_f, ">%s\n%s\n", itr -> pm_gene.c_str (), itr -> pm_template.c_str ()) < 0)
+								{
+									success_flag = SetError ("Failed to write sequences to align");
+								}
+						}
+				}
+
+			if (fclose (out_f) != 0)
+				{
+					success_flag = SetError ("Failed to close sequences to align");
+				}
+		}
+	else
+		{
+			SetError ("Failed to open file for sequences to align");
+		}
+
+	if (success_flag)
+		{
+			CheckpointStage (PolymarkerCheckpoint :: PC_SEQUENCES_S, filename);
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerPipeline :: SearchMarkers ()
+{
+	bool success_flag = false;
+	std :: string exonerate_filename = GetJobFilename (PP_EXONERATE_S);
+	FILE *exonerate_f;
+
+	WriteStatus ("Searching markers in genome");
+
+	WriteStatus ("Starting loading fasta indices");
+
+	if (pp_seq_p -> ps_packed_filename_s)
+		{
+			pp_packed_contigs = PackedSequenceFile :: GetShared (pp_seq_p -> ps_packed_filename_s);
+		}
+
+	if (! pp_packed_contigs)
+		{
+			pp_contigs = FastaFile :: GetShared (pp_seq_p -> ps_fasta_filename_s);
+		}
+
+	if (! (pp_packed_contigs || pp_contigs))
+		{
+			return SetError ("Failed to load fasta index");
+		}
+
+	if (pp_seq_p -> ps_minimizer_index_filename_s)
+		{
+			pp_seed_index = MinimizerIndex :: GetShared (pp_seq_p -> ps_minimizer_index_filename_s);
+
+			if (! pp_seed_index)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", aligning against the whole of \"%s\"", pp_seq_p -> ps_minimizer_index_filename_s, pp_seq_p -> ps_fasta_filename_s);
+				}
+		}
+
+	WriteStatus ("Finished loading fasta indices");
+
+	if (CanSkipStage (PolymarkerCheckpoint :: PC_ALIGNMENT_S))
+		{
+			return ReadHits (exonerate_filename);
+		}
+
+	exonerate_f = fopen (exonerate_filename.c_str (), "w");
+
+	if (exonerate_f)
+		{
+			FILE *contigs_f = NULL;
+			std :: set <std :: string> found_contigs;
+
+			if (pp_config_p -> ppc_extract_found_contigs)
+				{
+					contigs_f = fopen (GetJobFilename (PP_CONTIGS_S).c_str (), "w");
+				}
+
+			success_flag = true;
+
+			if ((! pp_seed_index) && (pp_config_p -> ppc_batch_search_flag))
+				{
+					success_flag = ScanGenome ();
+				}
+
+			if (! success_flag)
+				{
+					/* ScanGenome has already set the error */
+				}
+			else if (pp_seed_index || pp_scanned_flag)
+				{
+					std :: vector <SeedWindow> windows;
+					bool seeded_flag = false;
+					bool unseeded_flag = false;
+
+					/*
+					 * Only align the markers against the windows that their minimizers
+					 * place them in and fall back to the whole genome for any that
+					 * couldn't be placed
+					 */
+					if (pp_config_p -> ppc_smith_waterman_flag)
+						{
+							success_flag = AlignToSeedWindows (exonerate_f, contigs_f, found_contigs, unseeded_flag);
+						}
+					else
+						{
+							success_flag = LocateMarkers (windows, seeded_flag, unseeded_flag);
+
+							if (success_flag && seeded_flag)
+								{
+									success_flag = RunAligner (GetJobFilename (PP_SEEDED_TO_ALIGN_S), GetJobFilename (PP_SEED_WINDOWS_S), &windows, exonerate_f, contigs_f, found_contigs);
+								}
+						}
+
+					if (success_flag && unseeded_flag)
+						{
+							success_flag = RunAligner (GetJobFilename (PP_UNSEEDED_TO_ALIGN_S), pp_seq_p -> ps_fasta_filename_s, 0, exonerate_f, contigs_f, found_contigs);
+						}
+				}
+			else
+				{
+					success_flag = RunAligner (GetJobFilename (PP_TO_ALIGN_S), pp_seq_p -> ps_fasta_filename_s, 0, exonerate_f, contigs_f, found_contigs);
+				}
+
+			if (contigs_f)
+				{
+					fclose (contigs_f);
+				}
+
+			fclose (exonerate_f);
+		}
+	else
+		{
+			SetError ("Failed to open aligner output file");
+		}
+
+	if (success_flag)
+		{
+			CheckpointStage (PolymarkerCheckpoint :: PC_ALIGNMENT_S, exonerate_filename);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Find the windows of every marker with a single pass over the genome.
+ * The minimizers of all of the markers are put into one hash table and
+ * the contigs, split into parts of at most S_SCAN_CHUNK_SIZE bases, are
+ * read on the search threads with each of their minimizers looked up
+ * in it, so reading the genome costs the same however many markers
+ * the job has.
+ */
+bool PolymarkerPipeline :: ScanGenome ()
+{
+	MarkerBatchScanner scanner (S_SCAN_K, S_SCAN_W, pp_config_p -> ppc_seed_max_occurrences);
+	const size_t num_contigs = pp_packed_contigs ? pp_packed_contigs -> GetNumContigs () : pp_contigs -> GetNumContigs ();
+	const uint64 overlap = scanner.GetOverlap ();
+	std :: vector <std :: pair <uint32, uint64> > chunks;
+	std :: vector <MarkerScanHits> hits (pp_search_pool.GetNumThreads ());
+	std :: vector <std :: string> buffers (pp_search_pool.GetNumThreads ());
+
+	auto get_contig_name = [this] (size_t contig) { return pp_packed_contigs ? pp_packed_contigs -> GetContigName (contig) : pp_contigs -> GetContigName (contig); };
+	auto get_contig_length = [this] (size_t contig) { return pp_packed_contigs ? pp_packed_contigs -> GetContigLength (contig) : pp_contigs -> GetContigLength (contig); };
+
+	WriteStatus ("Scanning genome for markers");
+
+	for (std :: vector <PolymarkerMarker> :: const_iterator itr = pp_markers.begin (); itr != pp_markers.end (); ++ itr)
+		{
+			scanner.AddMarker (itr -> pm_template);
+		}
+
+	scanner.Prepare ();
+
+	/* Each chunk is a contig and the position of its first base */
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			const uint64 length = get_contig_length (i);
+
+			for (uint64 start = 0; start < length; start += S_SCAN_CHUNK_SIZE)
+				{
+					chunks.push_back (std :: make_pair ((uint32) i, start));
+				}
+		}
+
+	#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Scanning " SIZET_FMT " contigs in " SIZET_FMT " chunks for " SIZET_FMT " markers", num_contigs, chunks.size (), pp_markers.size ());
+	#endif
+
+	if (! pp_search_pool.Run (chunks.size (), [&] (size_t chunk_index, uint32 thread_index)
+		{
+			const uint32 contig = chunks [chunk_index].first;
+			const uint64 start = chunks [chunk_index].second;
+			const uint64 length = get_contig_length (contig);
+			const uint64 end = std :: min (start + S_SCAN_CHUNK_SIZE, length);
+			const uint64 from = (start > overlap) ? start - overlap : 0;
+			std :: string &bases_r = buffers [thread_index];
+			FastaRegion region;
+
+			if (pp_cancel_p && (pp_cancel_p -> load ()))
+				{
+					return false;
+				}
+
+			/* The region cache is bypassed as nothing read here is likely to be read again */
+			if (! GetMappedContigRegion (get_contig_name (contig), from, std :: min (end + overlap, length), region))
+				{
+					return false;
+				}
+
+			bases_r.clear ();
+			region.AppendTo (bases_r);
+
+			scanner.ScanRegion (bases_r.data (), bases_r.size (), from, contig, start, end, hits [thread_index]);
+
+			return true;
+		}))
+		{
+			if (! IsCancelled ())
+				{
+					SetError ("Failed to scan the genome for the markers");
+				}
+
+			return false;
+		}
+
+	scanner.FindWindows (hits, pp_config_p -> ppc_seed_window_margin, [&] (uint32 contig, SeedWindow &window_r)
+		{
+			window_r.sw_contig = get_contig_name (contig);
+			window_r.sw_contig_length = get_contig_length (contig);
+		}, pp_scanned_windows);
+
+	pp_scanned_flag = true;
+
+	WriteStatus ("Finished scanning genome for markers");
+
+	return true;
+}
+
+
+/*
+ * Get the windows of a marker from the minimizer index or, if the
+ * database doesn't have one, from ScanGenome.
+ */
+size_t PolymarkerPipeline :: FindMarkerWindows (size_t marker_index, std :: vector <SeedWindow> &windows_r) const
+{
+	if (pp_seed_index)
+		{
+			return pp_seed_index -> FindWindows (pp_markers [marker_index].pm_template, pp_config_p -> ppc_seed_max_occurrences, pp_config_p -> ppc_seed_window_margin, windows_r);
+		}
+
+	const std :: vector <SeedWindow> &scanned_windows_r = pp_scanned_windows [marker_index];
+
+	windows_r.insert (windows_r.end (), scanned_windows_r.begin (), scanned_windows_r.end ());
+
+	return scanned_windows_r.size ();
+}
+
+
+/*
+ * Look each marker up in the minimizer index. The markers that were
+ * placed are written to one file to be aligned against the windows,
+ * which are merged where they overlap, and the rest to another to be
+ * aligned against the whole genome.
+ */
+bool PolymarkerPipeline :: LocateMarkers (std :: vector <SeedWindow> &windows_r, bool &seeded_flag_r, bool &unseeded_flag_r)
+{
+	bool success_flag = false;
+	FILE *seeded_f = fopen (GetJobFilename (PP_SEEDED_TO_ALIGN_S).c_str (), "w");
+	FILE *unseeded_f = fopen (GetJobFilename (PP_UNSEEDED_TO_ALIGN_S).c_str (), "w");
+	FILE *windows_f = fopen (GetJobFilename (PP_SEED_WINDOWS_S).c_str (), "w");
+
+	if (seeded_f && unseeded_f && windows_f)
+		{
+			std :: set <std :: string> located_genes;
+
+			success_flag = true;
+
+			for (size_t i = 0; success_flag && (i < pp_markers.size ()); ++ i)
+				{
+					const PolymarkerMarker &marker_r = pp_markers [i];
+
+					if (located_genes.insert (marker_r.pm_gene).second)
+						{
+							const bool seeded_flag = (FindMarkerWindows (i, windows_r) > 0);
+
+							if (fprintf (seeded_flag ? seeded_f : unseeded_f, ">%s\n%s\n", marker_r.pm_gene.c_str (), marker_r.pm_template.c_str ()) < 0)
+								{
+									success_flag = SetError ("Failed to write sequences to align");
+								}
+
+							if (seeded_flag)
+								{
+									seeded_flag_r = true;
+								}
+							else
+								{
+									unseeded_flag_r = true;
+								}
+						}
+				}
+
+			MergeSeedWindows (windows_r);
+
+			/* The windows are named by their index so that the hits can be mapped back to their contigs */
+			for (size_t i = 0; success_flag && (i < windows_r.size ()); ++ i)
+				{
+					FastaRegion window;
+
+					if (GetContigRegion (windows_r [i].sw_contig, windows_r [i].sw_start, windows_r [i].sw_end, window))
+						{
+							if ((fprintf (windows_f, ">" SIZET_FMT "\n", i) < 0) || (!window.Write (windows_f)) || (fputc ('\n', windows_f) == EOF))
+								{
+									success_flag = SetError ("Failed to write the windows to align against");
+								}
+						}
+					else
+						{
+							std :: string message ("The minimizer index doesn't match the database for ");
+
+							message.append (windows_r [i].sw_contig);
+							success_flag = SetError (message.c_str ());
+						}
+				}
+
+			#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Located %s markers in " SIZET_FMT " windows", seeded_flag_r ? "some" : "no", windows_r.size ());
+			#endif
+		}
+	else
+		{
+			SetError ("Failed to open the files for the located markers");
+		}
+
+	if (seeded_f)
+		{
+			if (fclose (seeded_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	if (unseeded_f)
+		{
+			if (fclose (unseeded_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	if (windows_f)
+		{
+			if (fclose (windows_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Align the sequences in one file against another. If windows_p is set,
+ * the targets are the windows from LocateMarkers and the hits are
+ * converted back to the coordinates of the whole contigs before they
+ * are kept.
+ *
+ * When there is more than one search thread, the targets are split into
+ * shards, using exonerate's target chunks, which are aligned against in
+ * parallel. Otherwise the hits are kept as the aligner writes them.
+ */
+bool PolymarkerPipeline :: RunAligner (const std :: string &queries_r, const std :: string &targets_r, const std :: vector <SeedWindow> *windows_p, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r)
+{
+	const uint32 num_shards = (pp_search_pool.GetNumThreads () > 1) ? pp_search_pool.GetNumThreads () * S_SHARDS_PER_THREAD : 1;
+	std :: vector <SearchShard> shards (num_shards);
+	std :: string command (QuoteArgument (pp_config_p -> ppc_exonerate_executable));
+
+	command.append (" --showalignment false --showvulgar false --ryo 'RESULT:\\t%S\\t%pi\\t%ql\\t%tl\\t%g\\t%V\\n' ");
+	command.append (QuoteArgument (queries_r));
+	command.push_back (' ');
+	command.append (QuoteArgument (targets_r));
+	command.append (" --model ");
+	command.append (QuoteArgument (pp_config_p -> ppc_model));
+
+	#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Running \"%s\" in " UINT32_FMT " shards", command.c_str (), num_shards);
+	#endif
+
+	if (num_shards == 1)
+		{
+			return StreamAligner (command, windows_p, exonerate_f, contigs_f, found_contigs_r);
+		}
+
+	pp_search_pool.Run (num_shards, [&] (size_t shard_index, uint32 UNUSED_PARAM (thread_index))
+		{
+			const std :: string shard_command = command + " --targetchunkid " + std :: to_string (shard_index + 1) + " --targetchunktotal " + std :: to_string (num_shards);
+
+			return RunAlignerShard (shard_command, windows_p, shards [shard_index]);
+		});
+
+	return KeepShardHits (shards, exonerate_f, contigs_f, found_contigs_r);
+}
+
+
+/*
+ * Run the aligner over a single shard and store the hits that pass
+ * the identity threshold. This is called from the search threads so
+ * it only changes the given SearchShard.
+ */
+bool PolymarkerPipeline :: RunAlignerShard (const std :: string &command_r, const std :: vector <SeedWindow> *windows_p, SearchShard &shard_r)
+{
+	bool success_flag = false;
+	FILE *aligner_f = popen (command_r.c_str (), "r");
+
+	if (aligner_f)
+		{
+			ExonerateParser parser (shard_r.ss_hits);
+			bool parsed_flag;
+			int res;
+
+			parser.SetMinIdentity (pp_config_p -> ppc_min_identity);
+			parser.SetCallback ([&] (size_t row, const char *line_s, size_t line_length)
+				{
+					if (windows_p)
+						{
+							if (! MoveHitToContig (shard_r.ss_hits, row, *windows_p))
+								{
+									shard_r.ss_error = "The aligner returned a hit against an unknown window";
+									return false;
+								}
+
+							shard_r.ss_lines.push_back (std :: string ());
+						}
+					else
+						{
+							shard_r.ss_lines.push_back (std :: string (line_s, line_length));
+						}
+
+					return true;
+				});
+
+			parsed_flag = parser.ParseStream (aligner_f);
+
+			res = pclose (aligner_f);
+
+			if (! shard_r.ss_error.empty ())
+				{
+					/* The callback has already given the reason */
+				}
+			else if (! parsed_flag)
+				{
+					shard_r.ss_error = "Failed to read the aligner's output";
+				}
+			else if ((res != -1) && (WIFEXITED (res)) && (WEXITSTATUS (res) == 0))
+				{
+					success_flag = true;
+				}
+			else
+				{
+					shard_r.ss_error = "The aligner failed";
+				}
+		}
+	else
+		{
+			shard_r.ss_error = "Failed to run the aligner";
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Run the aligner over all of the targets and keep each hit that passes
+ * the identity threshold as soon as the aligner has written it, so the
+ * contigs that are hit are being extracted while the aligner is still
+ * running.
+ */
+bool PolymarkerPipeline :: StreamAligner (const std :: string &command_r, const std :: vector <SeedWindow> *windows_p, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r)
+{
+	bool success_flag = false;
+	FILE *aligner_f = popen (command_r.c_str (), "r");
+
+	if (aligner_f)
+		{
+			ExonerateParser parser (pp_hits);
+			bool kept_flag = true;
+			bool parsed_flag;
+			int res;
+
+			parser.SetMinIdentity (pp_config_p -> ppc_min_identity);
+			parser.SetCallback ([&] (size_t row, const char *line_s, size_t line_length)
+				{
+					if (windows_p)
+						{
+							if (! MoveHitToContig (pp_hits, row, *windows_p))
+								{
+									kept_flag = SetError ("The aligner returned a hit against an unknown window");
+								}
+							else
+								{
+									kept_flag = KeepHit (row, NULL, 0, exonerate_f, contigs_f, found_contigs_r);
+								}
+						}
+					else
+						{
+							kept_flag = KeepHit (row, line_s, line_length, exonerate_f, contigs_f, found_contigs_r);
+						}
+
+					return kept_flag;
+				});
+
+			parsed_flag = parser.ParseStream (aligner_f);
+			res = pclose (aligner_f);
+
+			if (! kept_flag)
+				{
+					/* KeepHit has already set the error */
+				}
+			else if (! parsed_flag)
+				{
+					SetError ("Failed to read the aligner's output");
+				}
+			else if ((res != -1) && (WIFEXITED (res)) && (WEXITSTATUS (res) == 0))
+				{
+					success_flag = true;
+				}
+			else
+				{
+					SetError ("The aligner failed");
+				}
+		}
+	else
+		{
+			SetError ("Failed to run the aligner");
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Align each marker that can be located in the minimizer index against
+ * its own windows, on both strands, with the Smith-Waterman aligner. The
+ * markers that couldn't be located are written out to be aligned against
+ * the whole genome.
+ *
+ * The windows of all of the markers are sorted by contig and split into
+ * shards of roughly equal numbers of cells to align, which are then
+ * aligned against on the search threads, each with its own aligner.
+ */
+bool PolymarkerPipeline :: AlignToSeedWindows (FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r, bool &unseeded_flag_r)
+{
+	bool success_flag = false;
+	FILE *unseeded_f = fopen (GetJobFilename (PP_UNSEEDED_TO_ALIGN_S).c_str (), "w");
+
+	if (unseeded_f)
+		{
+			SmithWatermanParameters params;
+			std :: set <std :: string> located_genes;
+			std :: vector <SeedTarget> targets;
+			std :: vector <SeedWindow> windows;
+			std :: vector <size_t> shard_starts;
+			std :: vector <SearchShard> shards;
+			std :: vector <std :: unique_ptr <SmithWatermanAligner> > aligners;
+			uint64 total_cells = 0;
+			uint64 cells = 0;
+
+			params.swp_min_identity = pp_config_p -> ppc_min_identity;
+
+			#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Aligning against the seed windows using the %s kernel", SmithWatermanAligner :: GetKernelName ());
+			#endif
+
+			success_flag = true;
+
+			for (size_t i = 0; success_flag && (i < pp_markers.size ()); ++ i)
+				{
+					const PolymarkerMarker &marker_r = pp_markers [i];
+
+					if (! located_genes.insert (marker_r.pm_gene).second)
+						{
+							continue;
+						}
+
+					windows.clear ();
+
+					if (FindMarkerWindows (i, windows) > 0)
+						{
+							MergeSeedWindows (windows);
+
+							for (std :: vector <SeedWindow> :: const_iterator window_itr = windows.begin (); window_itr != windows.end (); ++ window_itr)
+								{
+									SeedTarget target;
+
+									target.st_marker_index = i;
+									target.st_window = *window_itr;
+									targets.push_back (target);
+
+									total_cells += marker_r.pm_template.size () * (window_itr -> sw_end - window_itr -> sw_start);
+								}
+						}
+					else
+						{
+							if (fprintf (unseeded_f, ">%s\n%s\n", marker_r.pm_gene.c_str (), marker_r.pm_template.c_str ()) < 0)
+								{
+									success_flag = SetError ("Failed to write sequences to align");
+								}
+
+							unseeded_flag_r = true;
+						}
+				}
+
+			std :: sort (targets.begin (), targets.end (), [] (const SeedTarget &a_r, const SeedTarget &b_r) { return (a_r.st_window.sw_contig != b_r.st_window.sw_contig) ? (a_r.st_window.sw_contig < b_r.st_window.sw_contig) : ((a_r.st_window.sw_start != b_r.st_window.sw_start) ? (a_r.st_window.sw_start < b_r.st_window.sw_start) : (a_r.st_marker_index < b_r.st_marker_index)); });
+
+			/* Start a new shard each time another share of the cells has been reached */
+			const uint64 num_shards = (pp_search_pool.GetNumThreads () > 1) ? pp_search_pool.GetNumThreads () * S_SHARDS_PER_THREAD : 1;
+
+			for (size_t i = 0; i < targets.size (); ++ i)
+				{
+					if (cells * num_shards >= total_cells * shard_starts.size ())
+						{
+							shard_starts.push_back (i);
+						}
+
+					cells += pp_markers [targets [i].st_marker_index].pm_template.size () * (targets [i].st_window.sw_end - targets [i].st_window.sw_start);
+				}
+
+			shard_starts.push_back (targets.size ());
+			shards.resize (shard_starts.size () - 1);
+
+			for (uint32 i = 0; i < pp_search_pool.GetNumThreads (); ++ i)
+				{
+					aligners.emplace_back (new SmithWatermanAligner (params));
+				}
+
+			if (success_flag)
+				{
+					pp_search_pool.Run (shards.size (), [&] (size_t shard_index, uint32 thread_index)
+						{
+							SmithWatermanAligner &aligner_r = * (aligners [thread_index]);
+							SearchShard &shard_r = shards [shard_index];
+							std :: string target;
+
+							for (size_t i = shard_starts [shard_index]; i < shard_starts [shard_index + 1]; ++ i)
+								{
+									const PolymarkerMarker &marker_r = pp_markers [targets [i].st_marker_index];
+									const SeedWindow &window_r = targets [i].st_window;
+									FastaRegion window;
+
+									if (! GetContigRegion (window_r.sw_contig, window_r.sw_start, window_r.sw_end, window))
+										{
+											shard_r.ss_error = "The minimizer index doesn't match the database for " + window_r.sw_contig;
+											return false;
+										}
+
+									target.clear ();
+									window.AppendTo (target);
+									aligner_r.SetQuery (marker_r.pm_template.data (), marker_r.pm_template.size ());
+
+									for (int strand = 0; strand < 2; ++ strand)
+										{
+											const bool reverse_flag = (strand == 1);
+											SmithWatermanAlignment alignment;
+
+											if (aligner_r.Align (target.data (), target.size (), reverse_flag, alignment))
+												{
+													PolymarkerHit hit;
+
+													hit.ph_query_id = marker_r.pm_gene;
+													hit.ph_query_start = alignment.swa_query_start;
+													hit.ph_query_end = alignment.swa_query_end;
+													hit.ph_query_strand = '+';
+													hit.ph_target_id = window_r.sw_contig;
+
+													/* Hits on the reverse strand run from the higher coordinate to the lower, as exonerate gives them */
+													if (reverse_flag)
+														{
+															hit.ph_target_start = window_r.sw_start + target.size () - alignment.swa_target_start;
+															hit.ph_target_end = window_r.sw_start + target.size () - alignment.swa_target_end;
+															hit.ph_target_strand = '-';
+														}
+													else
+														{
+															hit.ph_target_start = window_r.sw_start + alignment.swa_target_start;
+															hit.ph_target_end = window_r.sw_start + alignment.swa_target_end;
+															hit.ph_target_strand = '+';
+														}
+
+													hit.ph_score = alignment.swa_score;
+													hit.ph_identity = alignment.swa_identity;
+													hit.ph_query_length = (uint32) (marker_r.pm_template.size ());
+													hit.ph_target_length = window_r.sw_contig_length;
+													hit.ph_gene_orientation = ".";
+													hit.ph_vulgar = "\t" + alignment.swa_vulgar;
+
+													shard_r.ss_hits.AddHit (hit);
+													shard_r.ss_lines.push_back (std :: string ());
+												}
+										}
+								}
+
+							return true;
+						});
+
+					success_flag = KeepShardHits (shards, exonerate_f, contigs_f, found_contigs_r);
+				}
+		}
+	else
+		{
+			SetError ("Failed to open the file for the unlocated markers");
+		}
+
+	if (unseeded_f)
+		{
+			if (fclose (unseeded_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Keep the hits of each shard in turn, stopping at the first shard
+ * that failed.
+ */
+bool PolymarkerPipeline :: KeepShardHits (std :: vector <SearchShard> &shards_r, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r)
+{
+	for (std :: vector <SearchShard> :: const_iterator shard_itr = shards_r.begin (); shard_itr != shards_r.end (); ++ shard_itr)
+		{
+			if (! shard_itr -> ss_error.empty ())
+				{
+					return SetError (shard_itr -> ss_error.c_str ());
+				}
+
+			for (size_t i = 0; i < shard_itr -> ss_hits.GetNumHits (); ++ i)
+				{
+					const std :: string &line_r = shard_itr -> ss_lines [i];
+					const size_t row = pp_hits.AddHit (shard_itr -> ss_hits, i);
+
+					if (! KeepHit (row, line_r.empty () ? NULL : line_r.data (), line_r.size (), exonerate_f, contigs_f, found_contigs_r))
+						{
+							return false;
+						}
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * Write a hit that has been added to pp_hits to exonerate_tmp.tab,
+ * either as the line that the aligner gave for it or, if line_s is
+ * NULL, in the same format, and save the region of the contig that it
+ * covers if contigs_f is set.
+ */
+bool PolymarkerPipeline :: KeepHit (size_t row, const char *line_s, size_t line_length, FILE *exonerate_f, FILE *contigs_f, std :: set <std :: string> &found_contigs_r)
+{
+	bool success_flag = true;
+	PolymarkerHit hit;
+
+	pp_hits.GetHit (row, hit);
+
+	if (line_s)
+		{
+			fwrite (line_s, 1, line_length, exonerate_f);
+		}
+	else
+		{
+			fprintf (exonerate_f, "RESULT:\t%s " UINT32_FMT " " UINT32_FMT " %c %s " UINT64_FMT " " UINT64_FMT " %c " INT32_FMT "\t%.2f\t" UINT32_FMT "\t" UINT64_FMT "\t%s%s\n",
+				hit.ph_query_id.c_str (), hit.ph_query_start, hit.ph_query_end, hit.ph_query_strand,
+				hit.ph_target_id.c_str (), hit.ph_target_start, hit.ph_target_end, hit.ph_target_strand, hit.ph_score,
+				hit.ph_identity, hit.ph_query_length, hit.ph_target_length, hit.ph_gene_orientation.c_str (), hit.ph_vulgar.c_str ());
+		}
+
+	/*
+	 * Only the hit's own window is fetched, which ProjectHit will then find
+	 * in the RegionCache, rather than the whole of what may be a chromosome
+	 */
+	if (contigs_f)
+		{
+			const uint64 region_start = std :: min (hit.ph_target_start, hit.ph_target_end);
+			const uint64 region_end = std :: max (hit.ph_target_start, hit.ph_target_end);
+			std :: string region_name (hit.ph_target_id);
+
+			region_name.append (":");
+			region_name.append (std :: to_string (region_start + 1));
+			region_name.push_back ('-');
+			region_name.append (std :: to_string (region_end));
+
+			if (found_contigs_r.insert (region_name).second)
+				{
+					FastaRegion region;
+
+					if (GetContigRegion (hit.ph_target_id, region_start, region_end, region))
+						{
+							fprintf (contigs_f, ">%s\n", region_name.c_str ());
+							region.Write (contigs_f);
+							fputc ('\n', contigs_f);
+						}
+					else
+						{
+							std :: string message ("Entry not found! ");
+
+							message.append (hit.ph_target_id);
+							message.append (". Make sure that the .fai was generated properly.");
+
+							success_flag = SetError (message.c_str ());
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Read the hits that were kept from an earlier run of the aligner.
+ */
+bool PolymarkerPipeline :: ReadHits (const std :: string &filename_r)
+{
+	ExonerateParser parser (pp_hits);
+
+	if (parser.ParseFile (filename_r.c_str ()))
+		{
+			return true;
+		}
+
+	return SetError ("Failed to read aligner output file");
+}
+
+
+/*
+ * Get the bases of the target sequence that are aligned to each
+ * position of the query, using '-' where there is no aligned base.
+ */
+bool PolymarkerPipeline :: ProjectHit (const PolymarkerHit &hit_r, uint32 query_length, std :: string &projection_r)
+{
+	bool success_flag = false;
+	const bool target_forward_flag = (hit_r.ph_target_strand != '-');
+	const uint64 region_start = target_forward_flag ? hit_r.ph_target_start : hit_r.ph_target_end;
+	const uint64 region_end = target_forward_flag ? hit_r.ph_target_end : hit_r.ph_target_start;
+	FastaRegion target;
+
+	projection_r.assign (query_length, S_MASK_NO_DATA_C);
+
+	/*
+	 * The target bases are read straight from the mapped fasta file,
+	 * from the far end of the region when the hit is on the reverse strand.
+	 */
+	if (GetContigRegion (hit_r.ph_target_id, region_start, region_end, target))
+		{
+			const size_t target_length = target.size ();
+			std :: istringstream vulgar_stream (hit_r.ph_vulgar);
+			const bool query_forward_flag = (hit_r.ph_query_strand != '-');
+			int64 q = query_forward_flag ? (int64) hit_r.ph_query_start : ((int64) hit_r.ph_query_start) - 1;
+			const int64 q_step = query_forward_flag ? 1 : -1;
+			size_t t = 0;
+			char op;
+			uint32 query_op_length;
+			uint32 target_op_length;
+
+			while (vulgar_stream >> op >> query_op_length >> target_op_length)
+				{
+					switch (op)
+						{
+							case 'M':
+							case 'C':
+							case 'S':
+							case 'N':
+								{
+									const uint32 n = std :: min (query_op_length, target_op_length);
+
+									for (uint32 i = 0; i < n; ++ i, q += q_step, ++ t)
+										{
+											if ((q >= 0) && (q < (int64) query_length) && (t < target_length))
+												{
+													const char base = target_forward_flag ? target [t] : Complement (target [target_length - 1 - t]);
+
+													projection_r [q] = query_forward_flag ? base : Complement (base);
+												}
+										}
+
+									q += q_step * (int64) (query_op_length - n);
+									t += target_op_length - n;
+								}
+								break;
+
+							default:
+								/* gaps, introns, splice sites and frameshifts */
+								q += q_step * (int64) query_op_length;
+								t += target_op_length;
+								break;
+						}
+				}
+
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Get a region of a contig from the RegionCache shared by every job or,
+ * if it isn't there, from whichever form of the database has been loaded
+ * and then add it to the cache.
+ */
+bool PolymarkerPipeline :: GetContigRegion (const std :: string &contig_r, uint64 start, uint64 end, FastaRegion &region_r) const
+{
+	RegionCache &cache_r = RegionCache :: GetShared ();
+
+	if (cache_r.IsEnabled ())
+		{
+			const std :: string key (RegionCache :: MakeKey (pp_seq_p -> ps_fasta_filename_s, contig_r, start, end));
+			std :: shared_ptr <const std :: string> seq_p = cache_r.Get (key);
+
+			if (seq_p)
+				{
+					region_r = FastaRegion (seq_p);
+					return true;
+				}
+
+			if (GetMappedContigRegion (contig_r, start, end, region_r))
+				{
+					if (cache_r.CanStore (region_r.size ()))
+						{
+							std :: shared_ptr <std :: string> decoded_p (new std :: string);
+
+							region_r.AppendTo (*decoded_p);
+							region_r = FastaRegion (cache_r.Put (key, decoded_p));
+						}
+
+					return true;
+				}
+
+			return false;
+		}
+
+	return GetMappedContigRegion (contig_r, start, end, region_r);
+}
+
+
+/*
+ * Get a region of a contig from whichever form of the database
+ * has been loaded.
+ */
+bool PolymarkerPipeline :: GetMappedContigRegion (const std :: string &contig_r, uint64 start, uint64 end, FastaRegion &region_r) const
+{
+	if (pp_packed_contigs)
+		{
+			return pp_packed_contigs -> GetRegion (contig_r.c_str (), start, end, region_r);
+		}
+
+	return pp_contigs -> GetRegion (contig_r.c_str (), start, end, region_r);
+}
+
+
+/*
+ * Build the mask of informative positions for a marker by comparing
+ * its best hit on the target chromosome with the best hits on each of
+ * the other chromosomes. If the database has a homoeolog index that
+ * groups the target contig, its homoeologs are taken from there and
+ * the marker's best hits on those contigs are used instead.
+ */
+bool PolymarkerPipeline :: BuildMask (size_t marker_index, FILE *exons_f)
+{
+	PolymarkerMarker &marker_r = pp_markers [marker_index];
+	const uint32 query_length = (uint32) marker_r.pm_template.size ();
+	const std :: vector <uint32> &rows_r = pp_hits.GetQueryHits (marker_r.pm_gene);
+	std :: vector <PolymarkerHit> hits (rows_r.size ());
+	std :: map <std :: string, const PolymarkerHit *> best_hits;
+	std :: map <std :: string, const PolymarkerHit *> best_contig_hits;
+	std :: vector <const PolymarkerHit *> homoeologs;
+	const PolymarkerHit *target_hit_p = 0;
+	std :: vector <PolymarkerHit> :: iterator itr;
+	std :: set <std :: string> contigs;
+
+	marker_r.pm_mask.clear ();
+
+	for (size_t i = 0; i < rows_r.size (); ++ i)
+		{
+			pp_hits.GetHit (rows_r [i], hits [i]);
+		}
+
+	for (itr = hits.begin (); itr != hits.end (); ++ itr)
+		{
+			const PolymarkerHit *best_p;
+			const HomoeologContig *indexed_p = pp_homoeolog_index ? pp_homoeolog_index -> FindContig (itr -> ph_target_id) : 0;
+
+			/* GetHit has already given each hit the arm from pp_arm_selector */
+			if (indexed_p)
+				{
+					itr -> ph_chromosome.assign (indexed_p -> hc_arm_s);
+				}
+			else if (marker_r.pm_chromosome.empty ())
+				{
+					pp_first_two_arm_selector.Select (itr -> ph_target_id, itr -> ph_chromosome);
+				}
+
+			contigs.insert (itr -> ph_target_id);
+
+			if (indexed_p)
+				{
+					best_p = best_contig_hits [itr -> ph_target_id];
+
+					if ((!best_p) || (best_p -> ph_score < itr -> ph_score))
+						{
+							best_contig_hits [itr -> ph_target_id] = & (*itr);
+						}
+				}
+
+			best_p = best_hits [itr -> ph_chromosome];
+
+			if ((!best_p) || (best_p -> ph_score < itr -> ph_score))
+				{
+					best_hits [itr -> ph_chromosome] = & (*itr);
+				}
+		}
+
+	marker_r.pm_total_contigs = (uint32) contigs.size ();
+
+	if (fprintf (exons_f, ">%s\n%s\n", marker_r.pm_gene.c_str (), marker_r.pm_template.c_str ()) < 0)
+		{
+			return SetError ("Failed to write exons file");
+		}
+
+	if (best_hits.empty ())
+		{
+			return true;
+		}
+
+	/* Find the hit on the target chromosome */
+	if (marker_r.pm_chromosome.empty ())
+		{
+			std :: map <std :: string, const PolymarkerHit *> :: const_iterator hit_itr;
+
+			for (hit_itr = best_hits.begin (); hit_itr != best_hits.end (); ++ hit_itr)
+				{
+					if ((!target_hit_p) || (target_hit_p -> ph_score < hit_itr -> second -> ph_score))
+						{
+							target_hit_p = hit_itr -> second;
+						}
+				}
+		}
+	else
+		{
+			std :: map <std :: string, const PolymarkerHit *> :: const_iterator hit_itr;
+
+			for (hit_itr = best_hits.begin (); hit_itr != best_hits.end (); ++ hit_itr)
+				{
+					const std :: string &chr_r = hit_itr -> first;
+
+					if ((!chr_r.empty ()) && (marker_r.pm_chromosome.compare (0, chr_r.size (), chr_r) == 0))
+						{
+							if ((!target_hit_p) || (target_hit_p -> ph_score < hit_itr -> second -> ph_score))
+								{
+									target_hit_p = hit_itr -> second;
+								}
+						}
+				}
+		}
+
+	if (!target_hit_p)
+		{
+			return true;
+		}
+
+	marker_r.pm_target_chromosome = target_hit_p -> ph_chromosome;
+
+	/* The best hits from the other chromosomes are the homoeologs */
+	{
+		std :: map <std :: string, const PolymarkerHit *> :: const_iterator hit_itr;
+		std :: vector <const char *> homoeolog_contigs;
+		const HomoeologContig *indexed_p = pp_homoeolog_index ? pp_homoeolog_index -> FindContig (target_hit_p -> ph_target_id) : 0;
+
+		if (indexed_p && (pp_homoeolog_index -> GetHomoeologs (indexed_p, homoeolog_contigs) > 0))
+			{
+				for (size_t i = 0; i < homoeolog_contigs.size (); ++ i)
+					{
+						hit_itr = best_contig_hits.find (homoeolog_contigs [i]);
+
+						if (hit_itr != best_contig_hits.end ())
+							{
+								homoeologs.push_back (hit_itr -> second);
+							}
+					}
+			}
+		else
+			{
+				for (hit_itr = best_hits.begin (); hit_itr != best_hits.end (); ++ hit_itr)
+					{
+						if (hit_itr -> second != target_hit_p)
+							{
+								homoeologs.push_back (hit_itr -> second);
+							}
+					}
+			}
+
+		std :: sort (homoeologs.begin (), homoeologs.end (), [] (const PolymarkerHit *a_p, const PolymarkerHit *b_p) { return a_p -> ph_score > b_p -> ph_score; });
+
+		if (homoeologs.size () + 1 > pp_config_p -> ppc_genomes_count)
+			{
+				homoeologs.resize (pp_config_p -> ppc_genomes_count - 1);
+			}
+	}
+
+	std :: string target_projection;
+	std :: vector <std :: string> homoeolog_projections (homoeologs.size ());
+
+	if (!ProjectHit (*target_hit_p, query_length, target_projection))
+		{
+			return SetError ("Failed to get target region");
+		}
+
+	fprintf (exons_f, ">%s %s\n%s\n", target_hit_p -> ph_target_id.c_str (), target_hit_p -> ph_chromosome.c_str (), target_projection.c_str ());
+
+	marker_r.pm_contig_regions.clear ();
+	marker_r.pm_contig_regions.append (target_hit_p -> ph_target_id).append (":").append (std :: to_string (std :: min (target_hit_p -> ph_target_start, target_hit_p -> ph_target_end) + 1)).append ("-").append (std :: to_string (std :: max (target_hit_p -> ph_target_start, target_hit_p -> ph_target_end)));
+
+	for (size_t i = 0; i < homoeologs.size (); ++ i)
+		{
+			const PolymarkerHit *hit_p = homoeologs [i];
+
+			if (!ProjectHit (*hit_p, query_length, homoeolog_projections [i]))
+				{
+					return SetError ("Failed to get homoeolog region");
+				}
+
+			fprintf (exons_f, ">%s %s\n%s\n", hit_p -> ph_target_id.c_str (), hit_p -> ph_chromosome.c_str (), homoeolog_projections [i].c_str ());
+
+			marker_r.pm_contig_regions.append (" ").append (hit_p -> ph_target_id).append (":").append (std :: to_string (std :: min (hit_p -> ph_target_start, hit_p -> ph_target_end) + 1)).append ("-").append (std :: to_string (std :: max (hit_p -> ph_target_start, hit_p -> ph_target_end)));
+		}
+
+	marker_r.pm_mask.assign (query_length, S_MASK_NO_DATA_C);
+	marker_r.pm_snp_type = "non-homoeologous";
+
+	for (uint32 i = 0; i < query_length; ++ i)
+		{
+			const char target_c = toupper (target_projection [i]);
+
+			if (i == marker_r.pm_snp_position)
+				{
+					marker_r.pm_mask [i] = S_MASK_SNP_C;
+
+					for (size_t j = 0; j < homoeolog_projections.size (); ++ j)
+						{
+							const char c = toupper (homoeolog_projections [j][i]);
+
+							if ((c == marker_r.pm_original) || (c == marker_r.pm_snp))
+								{
+									marker_r.pm_snp_type = "homoeologous";
+								}
+						}
+				}
+			else if ((target_c != S_MASK_NO_DATA_C) && (!homoeolog_projections.empty ()))
+				{
+					size_t num_differences = 0;
+
+					for (size_t j = 0; j < homoeolog_projections.size (); ++ j)
+						{
+							if (toupper (homoeolog_projections [j][i]) != target_c)
+								{
+									++ num_differences;
+								}
+						}
+
+					if (num_differences == homoeolog_projections.size ())
+						{
+							marker_r.pm_mask [i] = S_MASK_SPECIFIC_C;
+						}
+					else if (num_differences > 0)
+						{
+							marker_r.pm_mask [i] = S_MASK_SEMISPECIFIC_C;
+						}
+					else
+						{
+							marker_r.pm_mask [i] = S_MASK_SAME_C;
+						}
+				}
+			else if (target_c != S_MASK_NO_DATA_C)
+				{
+					marker_r.pm_mask [i] = S_MASK_SAME_C;
+				}
+		}
+
+	if (fprintf (exons_f, ">MASK %s\n%s\n", marker_r.pm_gene.c_str (), marker_r.pm_mask.c_str ()) < 0)
+		{
+			return SetError ("Failed to write exons file");
+		}
+
+	return true;
+}
+
+
+bool PolymarkerPipeline :: WritePrimer3Input ()
+{
+	bool success_flag = false;
+	std :: string exons_filename = GetJobFilename (PP_EXONS_S);
+	FILE *exons_f;
+
+	WriteStatus ("Reading best alignment on each chromosome");
+
+	if (pp_seq_p -> ps_homoeolog_index_filename_s)
+		{
+			pp_homoeolog_index = HomoeologIndex :: GetShared (pp_seq_p -> ps_homoeolog_index_filename_s);
+
+			if (! pp_homoeolog_index)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", finding the homoeologs from the alignments", pp_seq_p -> ps_homoeolog_index_filename_s);
+				}
+		}
+
+	exons_f = fopen (exons_filename.c_str (), "w");
+
+	if (exons_f)
+		{
+			success_flag = true;
+
+			for (size_t i = 0; success_flag && (i < pp_markers.size ()); ++ i)
+				{
+					success_flag = BuildMask (i, exons_f);
+				}
+
+			fclose (exons_f);
+		}
+	else
+		{
+			SetError ("Failed to open exons file");
+		}
+
+	if (success_flag)
+		{
+			WriteStatus ("Running primer3");
+
+			/*
+			 * The library's state is global so it can only design one record at a
+			 * time, whereas separate primer3_core processes can run side by side.
+			 */
+			if (pp_config_p -> ppc_primer3_library_flag && (pp_primer3_pool.GetNumThreads () == 1) && (pp_prefs_p -> pp_thermodynamic_parameters_path_s) && (Primer3Engine :: IsAvailable ()))
+				{
+					pp_primer3_engine = Primer3Engine :: GetShared (pp_prefs_p -> pp_thermodynamic_parameters_path_s);
+
+					if (! pp_primer3_engine)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load primer3, running \"%s\" instead", pp_config_p -> ppc_primer3_executable.c_str ());
+						}
+				}
+
+			AddPrimer3Inputs ();
+
+			if (pp_config_p -> ppc_primer3_prefilter_flag)
+				{
+					FilterPrimer3Inputs ();
+				}
+
+			UseCachedPrimer3Results ();
+
+			pp_num_primer3_records = (uint32) pp_primer3_inputs.size ();
+
+			/* primer3_core reads its records from a file, the library takes them directly */
+			if (! pp_primer3_engine)
+				{
+					success_flag = WritePrimer3File ();
+				}
+		}
+
+	return success_flag;
+}
+
+
+void PolymarkerPipeline :: AddPrimer3Inputs ()
+{
+	const uint32 max_size = pp_prefs_p -> pp_max_size;
+
+	pp_primer3_inputs.clear ();
+
+	for (size_t i = 0; i < pp_markers.size (); ++ i)
+		{
+			const PolymarkerMarker &marker_r = pp_markers [i];
+
+			if (!marker_r.pm_mask.empty ())
+				{
+					const int32 snp = (int32) marker_r.pm_snp_position;
+					const int32 length = (int32) marker_r.pm_template.size ();
+					const int32 min_distance = std :: max <int32> (1, ((int32) pp_prefs_p -> pp_product_size_range_min) - ((int32) max_size));
+					const int32 max_distance = (int32) pp_prefs_p -> pp_product_size_range_max;
+
+					for (int orientation = 0; orientation < 2; ++ orientation)
+						{
+							const bool forward_flag = (orientation == 0);
+							const int32 step = forward_flag ? 1 : -1;
+							std :: vector <int32> specific_positions;
+							std :: vector <int32> semispecific_positions;
+							std :: vector <int32> *positions_p = 0;
+							char type_c = KASPSelector :: KS_TYPE_NONSPECIFIC_C;
+
+							for (int32 distance = min_distance; distance <= max_distance; ++ distance)
+								{
+									const int32 pos = snp + step * distance;
+
+									if ((pos < 0) || (pos >= length))
+										{
+											break;
+										}
+
+									if ((marker_r.pm_mask [pos] == S_MASK_SPECIFIC_C) && (specific_positions.size () < S_MAX_COMMON_PRIMER_POSITIONS))
+										{
+											specific_positions.push_back (pos);
+										}
+									else if ((marker_r.pm_mask [pos] == S_MASK_SEMISPECIFIC_C) && (semispecific_positions.size () < S_MAX_COMMON_PRIMER_POSITIONS))
+										{
+											semispecific_positions.push_back (pos);
+										}
+								}
+
+							if (!specific_positions.empty ())
+								{
+									positions_p = &specific_positions;
+									type_c = KASPSelector :: KS_TYPE_SPECIFIC_C;
+								}
+							else if (!semispecific_positions.empty ())
+								{
+									positions_p = &semispecific_positions;
+									type_c = KASPSelector :: KS_TYPE_SEMISPECIFIC_C;
+								}
+							else
+								{
+									/* A single position of -1 means that the common primer isn't forced */
+									semispecific_positions.assign (1, -1);
+									positions_p = &semispecific_positions;
+								}
+
+							for (size_t j = 0; j < positions_p -> size (); ++ j)
+								{
+									const int32 common_pos = (*positions_p) [j];
+
+									for (int allele = 0; allele < 2; ++ allele)
+										{
+											Primer3Input input;
+
+											input.pi_id = KASPSelector :: MakeId (i, forward_flag, type_c, (allele == 0), common_pos);
+											input.pi_template = marker_r.pm_template;
+											input.pi_template [snp] = (allele == 0) ? marker_r.pm_original : marker_r.pm_snp;
+
+											if (forward_flag)
+												{
+													input.pi_force_left_end = snp;
+													input.pi_force_right_end = common_pos;
+												}
+											else
+												{
+													input.pi_force_left_end = common_pos;
+													input.pi_force_right_end = snp;
+												}
+
+											pp_primer3_inputs.push_back (input);
+										}
+								}
+						}
+				}
+		}
+}
+
+
+/*
+ * Leave out the primer3 records that primer3 would not find any primers
+ * for as none of the primers that could end at one of the record's forced
+ * positions has a melting temperature in primer3's range. The melting
+ * temperatures are worked out in the same way as primer3 does, so this
+ * doesn't change which primers are chosen.
+ */
+void PolymarkerPipeline :: FilterPrimer3Inputs ()
+{
+	const uint32 max_size = pp_prefs_p -> pp_max_size;
+	const uint32 min_size = std :: min <uint32> (S_PRIMER3_MIN_SIZE, max_size);
+	const OligoThermodynamicsCalculator calculator ((OligoConditions ()));
+	OligoBatch batch;
+	std :: vector <OligoThermodynamics> values;
+	std :: vector <size_t> first_oligos;
+	size_t num_kept = 0;
+
+	/* primer3 uses a different formula for any longer primers */
+	if (max_size > S_PRIMER3_MAX_NN_LENGTH)
+		{
+			return;
+		}
+
+	/* The oligos of input i are from first_oligos [2 * i] with the right primers from first_oligos [2 * i + 1] */
+	for (std :: vector <Primer3Input> :: const_iterator itr = pp_primer3_inputs.begin (); itr != pp_primer3_inputs.end (); ++ itr)
+		{
+			const int32 length = (int32) itr -> pi_template.size ();
+
+			first_oligos.push_back (batch.GetNumOligos ());
+
+			if (itr -> pi_force_left_end >= 0)
+				{
+					for (int32 size = (int32) min_size; (size <= (int32) max_size) && (size <= itr -> pi_force_left_end + 1); ++ size)
+						{
+							batch.Add (itr -> pi_template.c_str () + (itr -> pi_force_left_end + 1 - size), size);
+						}
+				}
+
+			first_oligos.push_back (batch.GetNumOligos ());
+
+			if (itr -> pi_force_right_end >= 0)
+				{
+					/* The 3' end of a right primer is the start of the template region that it is the complement of */
+					for (int32 size = (int32) min_size; (size <= (int32) max_size) && (itr -> pi_force_right_end + size <= length); ++ size)
+						{
+							batch.Add (itr -> pi_template.c_str () + itr -> pi_force_right_end, size);
+						}
+				}
+		}
+
+	first_oligos.push_back (batch.GetNumOligos ());
+
+	calculator.Calculate (batch, values);
+
+	for (size_t i = 0; i < pp_primer3_inputs.size (); ++ i)
+		{
+			const int32 force_ends [2] = { pp_primer3_inputs [i].pi_force_left_end, pp_primer3_inputs [i].pi_force_right_end };
+			bool keep_flag = true;
+
+			for (size_t side = 0; keep_flag && (side < 2); ++ side)
+				{
+					if (force_ends [side] >= 0)
+						{
+							keep_flag = false;
+
+							for (size_t j = first_oligos [2 * i + side]; (!keep_flag) && (j < first_oligos [2 * i + side + 1]); ++ j)
+								{
+									/* Oligos that can't be worked out, e.g. with ambiguity codes, are left to primer3 */
+									keep_flag = (!values [j].ot_valid_flag) || ((values [j].ot_tm >= S_PRIMER3_MIN_TM - S_PREFILTER_TM_MARGIN) && (values [j].ot_tm <= S_PRIMER3_MAX_TM + S_PREFILTER_TM_MARGIN));
+								}
+						}
+				}
+
+			if (keep_flag)
+				{
+					if (num_kept != i)
+						{
+							pp_primer3_inputs [num_kept] = std :: move (pp_primer3_inputs [i]);
+						}
+
+					++ num_kept;
+				}
+		}
+
+	#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Kept " SIZET_FMT " of " SIZET_FMT " primer3 records using the %s Tm kernel", num_kept, pp_primer3_inputs.size (), OligoThermodynamicsCalculator :: GetKernelName ());
+	#endif
+
+	pp_primer3_inputs.resize (num_kept);
+}
+
+
+/*
+ * Take the primer3 records whose results were stored by an earlier job
+ * out of pp_primer3_inputs so that primer3 is only run on the rest.
+ */
+void PolymarkerPipeline :: UseCachedPrimer3Results ()
+{
+	Primer3Cache &cache_r = Primer3Cache :: GetShared ();
+
+	pp_primer3_cache_keys.clear ();
+	pp_cached_primer3_results.clear ();
+
+	if (cache_r.IsEnabled ())
+		{
+			const size_t num_inputs = pp_primer3_inputs.size ();
+			size_t num_kept = 0;
+
+			for (size_t i = 0; i < num_inputs; ++ i)
+				{
+					std :: string key (Primer3Cache :: MakeKey (pp_prefs_p, pp_primer3_inputs [i]));
+					Primer3Result result;
+
+					if (cache_r.Get (key, result))
+						{
+							result.pr_id = pp_primer3_inputs [i].pi_id;
+							pp_cached_primer3_results.push_back (std :: move (result));
+						}
+					else
+						{
+							if (num_kept != i)
+								{
+									pp_primer3_inputs [num_kept] = std :: move (pp_primer3_inputs [i]);
+								}
+
+							pp_primer3_cache_keys [pp_primer3_inputs [num_kept].pi_id] = std :: move (key);
+							++ num_kept;
+						}
+				}
+
+			pp_primer3_inputs.resize (num_kept);
+
+			PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Found " SIZET_FMT " of " SIZET_FMT " primer3 records in the primer3 cache for \"%s\"", pp_cached_primer3_results.size (), num_inputs, pp_job_dir.c_str ());
+		}
+}
+
+
+/*
+ * Pass a result that primer3 has just designed to the KASPSelector,
+ * storing it in the primer3 cache first if that is being used.
+ */
+void PolymarkerPipeline :: AddPrimer3Result (Primer3Result &result_r)
+{
+	if (!pp_primer3_cache_keys.empty ())
+		{
+			const std :: unordered_map <std :: string, std :: string> :: const_iterator itr = pp_primer3_cache_keys.find (result_r.pr_id);
+
+			if (itr != pp_primer3_cache_keys.end ())
+				{
+					Primer3Cache :: GetShared ().Put (itr -> second, result_r);
+				}
+		}
+
+	pp_kasp_selector.AddResult (result_r);
+}
+
+
+bool PolymarkerPipeline :: WritePrimer3File ()
+{
+	std :: string primer3_filename = GetJobFilename (PP_PRIMER3_INPUT_S);
+
+	if (WritePrimer3Records (primer3_filename, 0, pp_primer3_inputs.size ()))
+		{
+			/*
+			 * The input is always remade as it needs the masks but primer3
+			 * only needs to be run again if it has changed.
+			 */
+			CheckRemadeStage (PolymarkerCheckpoint :: PC_PRIMER3_INPUT_S);
+			CheckpointStage (PolymarkerCheckpoint :: PC_PRIMER3_INPUT_S, primer3_filename);
+
+			return true;
+		}
+
+	return SetError ("Failed to write primer3 input file");
+}
+
+
+/*
+ * Write a block of the primer3 records, along with the global settings
+ * that they inherit, to a file for primer3_core. This is called from
+ * the primer3 threads so it doesn't set the pipeline's error.
+ */
+bool PolymarkerPipeline :: WritePrimer3Records (const std :: string &filename_r, size_t first_record, size_t last_record) const
+{
+	bool success_flag = false;
+	FILE *primer3_f = fopen (filename_r.c_str (), "w");
+
+	if (primer3_f)
+		{
+			const uint32 max_size = pp_prefs_p -> pp_max_size;
+
+			/* The global settings that the following records will inherit */
+			fprintf (primer3_f, "PRIMER_PRODUCT_SIZE_RANGE=" UINT32_FMT "-" UINT32_FMT "\n", pp_prefs_p -> pp_product_size_range_min, pp_prefs_p -> pp_product_size_range_max);
+			fprintf (primer3_f, "PRIMER_MAX_SIZE=" UINT32_FMT "\n", max_size);
+
+			if (max_size < 20)
+				{
+					fprintf (primer3_f, "PRIMER_OPT_SIZE=" UINT32_FMT "\nPRIMER_MIN_SIZE=" UINT32_FMT "\n", max_size, std :: min <uint32> (18, max_size));
+				}
+
+			fprintf (primer3_f, "PRIMER_LIB_AMBIGUITY_CODES_CONSENSUS=%d\n", pp_prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0);
+			fprintf (primer3_f, "PRIMER_LIBERAL_BASE=%d\n", pp_prefs_p -> pp_liberal_base ? 1 : 0);
+			fprintf (primer3_f, "PRIMER_NUM_RETURN=" UINT32_FMT "\n", pp_prefs_p -> pp_num_return);
+			fprintf (primer3_f, "PRIMER_EXPLAIN_FLAG=%d\n", pp_prefs_p -> pp_explain_flag ? 1 : 0);
+
+			if (pp_prefs_p -> pp_thermodynamic_parameters_path_s)
+				{
+					fprintf (primer3_f, "PRIMER_THERMODYNAMIC_PARAMETERS_PATH=%s\n", pp_prefs_p -> pp_thermodynamic_parameters_path_s);
+				}
+
+			for (size_t i = first_record; i < last_record; ++ i)
+				{
+					const Primer3Input &input_r = pp_primer3_inputs [i];
+
+					fprintf (primer3_f, "SEQUENCE_ID=%s\nSEQUENCE_TEMPLATE=%s\n", input_r.pi_id.c_str (), input_r.pi_template.c_str ());
+
+					if (input_r.pi_force_left_end >= 0)
+						{
+							fprintf (primer3_f, "SEQUENCE_FORCE_LEFT_END=%d\n", input_r.pi_force_left_end);
+						}
+
+					if (input_r.pi_force_right_end >= 0)
+						{
+							fprintf (primer3_f, "SEQUENCE_FORCE_RIGHT_END=%d\n", input_r.pi_force_right_end);
+						}
+
+					fprintf (primer3_f, "=\n");
+				}
+
+			if (fclose (primer3_f) == 0)
+				{
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerPipeline :: RunPrimer3 ()
+{
+	bool success_flag = true;
+
+	pp_kasp_selector.Reset (pp_markers.size ());
+
+	if (pp_num_primer3_records > 0)
+		{
+			if (pp_primer3_engine)
+				{
+					std :: vector <Primer3Result> results;
+
+					if (pp_primer3_engine -> Design (pp_prefs_p, pp_primer3_inputs, results))
+						{
+							for (std :: vector <Primer3Result> :: iterator itr = results.begin (); itr != results.end (); ++ itr)
+								{
+									AddPrimer3Result (*itr);
+								}
+						}
+					else
+						{
+							success_flag = SetError ("primer3 failed");
+						}
+				}
+			else
+				{
+					if (!CanSkipStage (PolymarkerCheckpoint :: PC_PRIMER3_OUTPUT_S))
+						{
+							const std :: string input_filename = GetJobFilename (PP_PRIMER3_INPUT_S);
+							const std :: string output_filename = GetJobFilename (PP_PRIMER3_OUTPUT_S);
+
+							if ((pp_primer3_pool.GetNumThreads () > 1) && (pp_num_primer3_records > 1))
+								{
+									success_flag = RunPrimer3Shards (input_filename, output_filename);
+								}
+							else
+								{
+									success_flag = RunPrimer3Process (input_filename, output_filename);
+								}
+
+							if (success_flag)
+								{
+									CheckpointStage (PolymarkerCheckpoint :: PC_PRIMER3_OUTPUT_S, output_filename);
+								}
+							else
+								{
+									SetError ("primer3 failed");
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = ReadPrimer3Output ();
+						}
+				}
+		}
+
+	if (success_flag)
+		{
+			for (std :: vector <Primer3Result> :: iterator itr = pp_cached_primer3_results.begin (); itr != pp_cached_primer3_results.end (); ++ itr)
+				{
+					pp_kasp_selector.AddResult (*itr);
+				}
+		}
+
+	pp_primer3_cache_keys.clear ();
+	pp_cached_primer3_results.clear ();
+
+	WriteStatus ("Ran primer3");
+
+	return success_flag;
+}
+
+
+/*
+ * Run primer3_core over a file of records. This is called from the
+ * primer3 threads so it doesn't set the pipeline's error.
+ */
+bool PolymarkerPipeline :: RunPrimer3Process (const std :: string &input_filename_r, const std :: string &output_filename_r) const
+{
+	std :: string command (QuoteArgument (pp_config_p -> ppc_primer3_executable));
+	int res;
+
+	command.append (" < ");
+	command.append (QuoteArgument (input_filename_r));
+	command.append (" > ");
+	command.append (QuoteArgument (output_filename_r));
+
+	res = system (command.c_str ());
+
+	return ((res != -1) && (WIFEXITED (res)) && (WEXITSTATUS (res) == 0));
+}
+
+
+/*
+ * Split the primer3 records into contiguous shards and run a separate
+ * primer3_core over each of them on the primer3 threads. Each record is
+ * designed independently of the others, so joining the outputs back
+ * together in shard order gives the same file as a single primer3_core
+ * run over every record would.
+ */
+bool PolymarkerPipeline :: RunPrimer3Shards (const std :: string &input_filename_r, const std :: string &output_filename_r)
+{
+	const size_t num_records = pp_primer3_inputs.size ();
+	const size_t num_shards = std :: min <size_t> (pp_primer3_pool.GetNumThreads () * S_SHARDS_PER_THREAD, num_records);
+	bool success_flag;
+
+	#if POLYMARKER_PIPELINE_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Running primer3 over " SIZET_FMT " records in " SIZET_FMT " shards", num_records, num_shards);
+	#endif
+
+	success_flag = pp_primer3_pool.Run (num_shards, [&] (size_t shard_index, uint32 UNUSED_PARAM (thread_index))
+		{
+			const std :: string suffix ("." + std :: to_string (shard_index));
+
+			return (WritePrimer3Records (input_filename_r + suffix, (num_records * shard_index) / num_shards, (num_records * (shard_index + 1)) / num_shards)
+				&& RunPrimer3Process (input_filename_r + suffix, output_filename_r + suffix));
+		});
+
+	if (success_flag)
+		{
+			FILE *out_f = fopen (output_filename_r.c_str (), "w");
+
+			if (out_f)
+				{
+					char buffer [65536];
+
+					for (size_t i = 0; success_flag && (i < num_shards); ++ i)
+						{
+							FILE *in_f = fopen ((output_filename_r + "." + std :: to_string (i)).c_str (), "r");
+
+							if (in_f)
+								{
+									size_t n;
+
+									while (success_flag && ((n = fread (buffer, 1, sizeof (buffer), in_f)) > 0))
+										{
+											success_flag = (fwrite (buffer, 1, n, out_f) == n);
+										}
+
+									if (ferror (in_f))
+										{
+											success_flag = false;
+										}
+
+									fclose (in_f);
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+
+					if (fclose (out_f) != 0)
+						{
+							success_flag = false;
+						}
+				}
+			else
+				{
+					success_flag = false;
+				}
+		}
+
+	for (size_t i = 0; i < num_shards; ++ i)
+		{
+			const std :: string suffix ("." + std :: to_string (i));
+
+			remove ((input_filename_r + suffix).c_str ());
+			remove ((output_filename_r + suffix).c_str ());
+		}
+
+	return success_flag;
+}
+
+
+bool PolymarkerPipeline :: ReadPrimer3Output ()
+{
+	FILE *in_f = fopen (GetJobFilename (PP_PRIMER3_OUTPUT_S).c_str (), "r");
+
+	if (in_f)
+		{
+			char *line_s = NULL;
+			size_t line_buffer_size = 0;
+			ssize_t line_length;
+			std :: string id;
+			Primer3Result result;
+
+			while ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1)
+				{
+					char *value_s;
+
+					while ((line_length > 0) && ((line_s [line_length - 1] == '\n') || (line_s [line_length - 1] == '\r')))
+						{
+							line_s [-- line_length] = '\0';
+						}
+
+					if (strcmp (line_s, "=") == 0)
+						{
+							if (!id.empty ())
+								{
+									result.pr_id.swap (id);
+									AddPrimer3Result (result);
+								}
+
+							id.clear ();
+							result = Primer3Result ();
+						}
+					else if ((value_s = strchr (line_s, '=')) != NULL)
+						{
+							*value_s = '\0';
+							++ value_s;
+
+							if (strcmp (line_s, "SEQUENCE_ID") == 0)
+								{
+									id = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_PAIR_NUM_RETURNED") == 0)
+								{
+									result.pr_num_returned = (uint32) atoi (value_s);
+								}
+							else if (strcmp (line_s, "PRIMER_LEFT_0_SEQUENCE") == 0)
+								{
+									result.pr_left = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_RIGHT_0_SEQUENCE") == 0)
+								{
+									result.pr_right = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_LEFT_0_TM") == 0)
+								{
+									result.pr_left_tm = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_RIGHT_0_TM") == 0)
+								{
+									result.pr_right_tm = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_PAIR_0_PRODUCT_SIZE") == 0)
+								{
+									result.pr_product_size = value_s;
+								}
+							else if (strcmp (line_s, "PRIMER_ERROR") == 0)
+								{
+									result.pr_error = value_s;
+								}
+						}
+				}
+
+			free (line_s);
+			fclose (in_f);
+
+			return true;
+		}
+
+	return SetError ("Failed to open primer3 output");
+}
+
+
+/*
+ * The best pair of each marker has been chosen as the primer3 results
+ * were read, so this only needs to write them out.
+ */
+bool PolymarkerPipeline :: SelectPrimers ()
+{
+	WriteStatus ("Selecting best primers");
+
+	if (pp_kasp_selector.Write (pp_markers, GetJobFilename (PP_PRIMERS_S), GetJobFilename (PP_PRIMERS_TO_ORDER_S)))
+		{
+			return true;
+		}
+
+	return SetError ("Failed to write primers file");
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static std :: string QuoteArgument (const std :: string &arg_r)
+{
+	std :: string quoted ("'");
+
+	for (std :: string :: const_iterator itr = arg_r.begin (); itr != arg_r.end (); ++ itr)
+		{
+			if (*itr == '\'')
+				{
+					quoted.append ("'\\''");
+				}
+			else
+				{
+					quoted.push_back (*itr);
+				}
+		}
+
+	quoted.push_back ('\'');
+
+	return quoted;
+}
+
+
+static char GetAmbiguityCode (char a, char b)
+{
+	char code_c = 'N';
+	const int bits = ((a == 'A' || b == 'A') ? 1 : 0) | ((a == 'C' || b == 'C') ? 2 : 0) | ((a == 'G' || b == 'G') ? 4 : 0) | ((a == 'T' || b == 'T') ? 8 : 0);
+
+	switch (bits)
+		{
+			case 1: code_c = 'A'; break;
+			case 2: code_c = 'C'; break;
+			case 4: code_c = 'G'; break;
+			case 8: code_c = 'T'; break;
+			case 1 | 4: code_c = 'R'; break;
+			case 2 | 8: code_c = 'Y'; break;
+			case 2 | 4: code_c = 'S'; break;
+			case 1 | 8: code_c = 'W'; break;
+			case 4 | 8: code_c = 'K'; break;
+			case 1 | 2: code_c = 'M'; break;
+			default: break;
+		}
+
+	return code_c;
+}
+
+
+static char Complement (char c)
+{
+	switch (c)
+		{
+			case 'A': return 'T';
+			case 'C': return 'G';
+			case 'G': return 'C';
+			case 'T': return 'A';
+			case 'a': return 't';
+			case 'c': return 'g';
+			case 'g': return 'c';
+			case 't': return 'a';
+			default: return c;
+		}
+}
+
+
+/*
+ * Sort the windows and merge any on the same contig that overlap.
+ */
+static void MergeSeedWindows (std :: vector <SeedWindow> &windows_r)
+{
+	std :: vector <SeedWindow> merged_windows;
+
+	std :: sort (windows_r.begin (), windows_r.end (), [] (const SeedWindow &a_r, const SeedWindow &b_r) { return (a_r.sw_contig != b_r.sw_contig) ? (a_r.sw_contig < b_r.sw_contig) : (a_r.sw_start < b_r.sw_start); });
+
+	for (std :: vector <SeedWindow> :: const_iterator window_itr = windows_r.begin (); window_itr != windows_r.end (); ++ window_itr)
+		{
+			if ((!merged_windows.empty ()) && (merged_windows.back ().sw_contig == window_itr -> sw_contig) && (window_itr -> sw_start <= merged_windows.back ().sw_end))
+				{
+					merged_windows.back ().sw_end = std :: max (merged_windows.back ().sw_end, window_itr -> sw_end);
+					merged_windows.back ().sw_num_seeds += window_itr -> sw_num_seeds;
+				}
+			else
+				{
+					merged_windows.push_back (*window_itr);
+				}
+		}
+
+	windows_r.swap (merged_windows);
+}
+
+
+/*
+ * The targets of a hit against the windows from LocateMarkers are the
+ * indexes of the windows, so convert the hit back to the coordinates
+ * of the window's contig.
+ */
+static bool MoveHitToContig (ExonerateHitTable &hits_r, size_t row, const std :: vector <SeedWindow> &windows_r)
+{
+	const std :: string &target_id_r = hits_r.GetTargetId (row);
+	char *end_s;
+	const size_t window_index = (size_t) strtoul (target_id_r.c_str (), &end_s, 10);
+
+	if ((*end_s == '\0') && (end_s != target_id_r.c_str ()) && (window_index < windows_r.size ()))
+		{
+			const SeedWindow &window_r = windows_r [window_index];
+
+			hits_r.MoveTarget (row, window_r.sw_contig, window_r.sw_start, window_r.sw_contig_length);
+			return true;
+		}
+
+	return false;
+}
@@ -0,0 +1,467 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * polymarker_process_monitor.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "polymarker_process_monitor.h"
+#include "polymarker_job_progress.h"
+
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_PROCESS_MONITOR_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_PROCESS_MONITOR_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+#ifndef SYS_pidfd_open
+	#define SYS_pidfd_open (434)
+#endif
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_STATUS_FILENAME_S = "status.txt";
+
+static const int S_MAX_EVENTS = 16;
+
+
+static int OpenPidfd (pid_t pid);
+
+static void *RunPolymarkerProcessMonitor (void *data_p);
+
+static void ReadInotifyEvents (PolymarkerProcessMonitor *monitor_p);
+
+static void ReadNewStatusLines (MonitoredProcess *process_p);
+
+static void ReapMonitoredProcess (PolymarkerProcessMonitor *monitor_p, MonitoredProcess *process_p);
+
+static void RemoveMonitoredProcess (PolymarkerProcessMonitor *monitor_p, MonitoredProcess *process_p);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerProcessMonitor *AllocatePolymarkerProcessMonitor (void)
+{
+	int fd = OpenPidfd (getpid ());
+
+	if (fd != -1)
+		{
+			PolymarkerProcessMonitor *monitor_p = (PolymarkerProcessMonitor *) AllocMemory (sizeof (PolymarkerProcessMonitor));
+
+			close (fd);
+
+			if (monitor_p)
+				{
+					monitor_p -> ppm_processes_p = NULL;
+					monitor_p -> ppm_epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+					if (monitor_p -> ppm_epoll_fd != -1)
+						{
+							monitor_p -> ppm_inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+							if (monitor_p -> ppm_inotify_fd != -1)
+								{
+									monitor_p -> ppm_stop_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+									if (monitor_p -> ppm_stop_fd != -1)
+										{
+											struct epoll_event event;
+
+											memset (&event, 0, sizeof (event));
+											event.events = EPOLLIN;
+
+											event.data.ptr = & (monitor_p -> ppm_inotify_fd);
+
+											if (epoll_ctl (monitor_p -> ppm_epoll_fd, EPOLL_CTL_ADD, monitor_p -> ppm_inotify_fd, &event) == 0)
+												{
+													event.data.ptr = & (monitor_p -> ppm_stop_fd);
+
+													if (epoll_ctl (monitor_p -> ppm_epoll_fd, EPOLL_CTL_ADD, monitor_p -> ppm_stop_fd, &event) == 0)
+														{
+															pthread_mutex_init (& (monitor_p -> ppm_mutex), NULL);
+
+															if (pthread_create (& (monitor_p -> ppm_thread), NULL, RunPolymarkerProcessMonitor, monitor_p) == 0)
+																{
+																	return monitor_p;
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start process monitor thread");
+																}
+
+															pthread_mutex_destroy (& (monitor_p -> ppm_mutex));
+														}
+												}
+
+											close (monitor_p -> ppm_stop_fd);
+										}
+
+									close (monitor_p -> ppm_inotify_fd);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "inotify_init1 failed, %s", strerror (errno));
+								}
+
+							close (monitor_p -> ppm_epoll_fd);
+						}
+
+					FreeMemory (monitor_p);
+				}		/* if (monitor_p) */
+
+		}		/* if (fd != -1) */
+	else
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "pidfds are not supported, %s", strerror (errno));
+		}
+
+	return NULL;
+}
+
+
+void FreePolymarkerProcessMonitor (PolymarkerProcessMonitor *monitor_p)
+{
+	uint64_t value = 1;
+
+	if (write (monitor_p -> ppm_stop_fd, &value, sizeof (value)) == sizeof (value))
+		{
+			pthread_join (monitor_p -> ppm_thread, NULL);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to stop process monitor thread, %s", strerror (errno));
+			pthread_cancel (monitor_p -> ppm_thread);
+			pthread_join (monitor_p -> ppm_thread, NULL);
+		}
+
+	/*
+	 * Let anything still waiting on a process know that it will
+	 * not hear any more about it.
+	 */
+	while (monitor_p -> ppm_processes_p)
+		{
+			MonitoredProcess *process_p = monitor_p -> ppm_processes_p;
+
+			RemoveMonitoredProcess (monitor_p, process_p);
+			process_p -> mp_exit_fn (process_p -> mp_data_p, false, 0);
+
+			FreeCopiedString (process_p -> mp_status_filename_s);
+			FreeMemory (process_p);
+		}
+
+	pthread_mutex_destroy (& (monitor_p -> ppm_mutex));
+
+	close (monitor_p -> ppm_stop_fd);
+	close (monitor_p -> ppm_inotify_fd);
+	close (monitor_p -> ppm_epoll_fd);
+
+	FreeMemory (monitor_p);
+}
+
+
+bool MonitorPolymarkerProcess (PolymarkerProcessMonitor *monitor_p, pid_t pid, const char *job_dir_s, PolymarkerStatusCallback status_fn, PolymarkerExitCallback exit_fn, void *data_p)
+{
+	int pidfd = OpenPidfd (pid);
+
+	if (pidfd != -1)
+		{
+			MonitoredProcess *process_p = (MonitoredProcess *) AllocMemory (sizeof (MonitoredProcess));
+
+			if (process_p)
+				{
+					process_p -> mp_status_filename_s = MakeFilename (job_dir_s, S_STATUS_FILENAME_S);
+
+					if (process_p -> mp_status_filename_s)
+						{
+							struct epoll_event event;
+
+							process_p -> mp_pid = pid;
+							process_p -> mp_pidfd = pidfd;
+							process_p -> mp_status_offset = 0;
+							process_p -> mp_status_fn = status_fn;
+							process_p -> mp_exit_fn = exit_fn;
+							process_p -> mp_data_p = data_p;
+
+							/*
+							 * Watch the directory rather than status.txt itself as
+							 * the file might not have been created yet.
+							 */
+							process_p -> mp_watch = status_fn ? inotify_add_watch (monitor_p -> ppm_inotify_fd, job_dir_s, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+
+							if ((process_p -> mp_watch == -1) && status_fn)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to watch \"%s\", %s", job_dir_s, strerror (errno));
+								}
+
+							pthread_mutex_lock (& (monitor_p -> ppm_mutex));
+							process_p -> mp_next_p = monitor_p -> ppm_processes_p;
+							monitor_p -> ppm_processes_p = process_p;
+							pthread_mutex_unlock (& (monitor_p -> ppm_mutex));
+
+							memset (&event, 0, sizeof (event));
+							event.events = EPOLLIN;
+							event.data.ptr = process_p;
+
+							if (epoll_ctl (monitor_p -> ppm_epoll_fd, EPOLL_CTL_ADD, pidfd, &event) == 0)
+								{
+									#if POLYMARKER_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+									PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Monitoring process %d in \"%s\"", (int) pid, job_dir_s);
+									#endif
+
+									return true;
+								}
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add pidfd for %d to epoll, %s", (int) pid, strerror (errno));
+
+							RemoveMonitoredProcess (monitor_p, process_p);
+							FreeCopiedString (process_p -> mp_status_filename_s);
+
+							/* RemoveMonitoredProcess has closed the pidfd */
+							pidfd = -1;
+						}
+
+					FreeMemory (process_p);
+				}
+
+			if (pidfd != -1)
+				{
+					close (pidfd);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open pidfd for %d, %s", (int) pid, strerror (errno));
+		}
+
+	return false;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static int OpenPidfd (pid_t pid)
+{
+	return (int) syscall (SYS_pidfd_open, pid, 0);
+}
+
+
+static void *RunPolymarkerProcessMonitor (void *data_p)
+{
+	PolymarkerProcessMonitor *monitor_p = (PolymarkerProcessMonitor *) data_p;
+	bool running_flag = true;
+
+	while (running_flag)
+		{
+			struct epoll_event events [S_MAX_EVENTS];
+			int num_events = epoll_wait (monitor_p -> ppm_epoll_fd, events, S_MAX_EVENTS, -1);
+			int i;
+
+			if (num_events == -1)
+				{
+					if (errno != EINTR)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "epoll_wait failed, %s", strerror (errno));
+							running_flag = false;
+						}
+				}
+
+			for (i = 0; i < num_events; ++ i)
+				{
+					void *ptr = events [i].data.ptr;
+
+					if (ptr == & (monitor_p -> ppm_stop_fd))
+						{
+							running_flag = false;
+						}
+					else if (ptr == & (monitor_p -> ppm_inotify_fd))
+						{
+							ReadInotifyEvents (monitor_p);
+						}
+					else
+						{
+							ReapMonitoredProcess (monitor_p, (MonitoredProcess *) ptr);
+						}
+				}
+		}
+
+	return NULL;
+}
+
+
+static void ReadInotifyEvents (PolymarkerProcessMonitor *monitor_p)
+{
+	char buffer [4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	ssize_t length;
+
+	while ((length = read (monitor_p -> ppm_inotify_fd, buffer, sizeof (buffer))) > 0)
+		{
+			const char *ptr = buffer;
+
+			while (ptr < buffer + length)
+				{
+					const struct inotify_event *event_p = (const struct inotify_event *) ptr;
+
+					if ((event_p -> len > 0) && (strcmp (event_p -> name, S_STATUS_FILENAME_S) == 0))
+						{
+							MonitoredProcess *process_p;
+
+							/*
+							 * Processes are only ever removed by this thread so they
+							 * are safe to use once we've released the lock.
+							 */
+							pthread_mutex_lock (& (monitor_p -> ppm_mutex));
+							process_p = monitor_p -> ppm_processes_p;
+
+							while (process_p && (process_p -> mp_watch != event_p -> wd))
+								{
+									process_p = process_p -> mp_next_p;
+								}
+
+							pthread_mutex_unlock (& (monitor_p -> ppm_mutex));
+
+							if (process_p)
+								{
+									ReadNewStatusLines (process_p);
+								}
+						}
+
+					ptr += sizeof (struct inotify_event) + event_p -> len;
+				}
+		}
+}
+
+
+static void ReadNewStatusLines (MonitoredProcess *process_p)
+{
+	if (process_p -> mp_status_fn)
+		{
+			ReadNewPolymarkerStatusLines (process_p -> mp_status_filename_s, & (process_p -> mp_status_offset), process_p -> mp_status_fn, process_p -> mp_data_p);
+		}
+}
+
+
+static void ReapMonitoredProcess (PolymarkerProcessMonitor *monitor_p, MonitoredProcess *process_p)
+{
+	int status = 0;
+	bool exited_flag = false;
+	int exit_code = 0;
+	pid_t res = waitpid (process_p -> mp_pid, &status, WNOHANG);
+
+	if (res == 0)
+		{
+			/* The process is still running */
+			return;
+		}
+
+	if (res == process_p -> mp_pid)
+		{
+			if (WIFEXITED (status))
+				{
+					exited_flag = true;
+					exit_code = WEXITSTATUS (status);
+				}
+			else if (WIFSIGNALED (status))
+				{
+					/* Use the same exit code as the shell would */
+					exited_flag = true;
+					exit_code = 128 + WTERMSIG (status);
+				}
+		}
+	else if (res == -1)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get exit status of %d, %s", (int) (process_p -> mp_pid), strerror (errno));
+		}
+
+	/* Pick up anything written just before the process exited */
+	ReadNewStatusLines (process_p);
+
+	RemoveMonitoredProcess (monitor_p, process_p);
+
+	#if POLYMARKER_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Process %d exited with %d", (int) (process_p -> mp_pid), exit_code);
+	#endif
+
+	process_p -> mp_exit_fn (process_p -> mp_data_p, exited_flag, exit_code);
+
+	FreeCopiedString (process_p -> mp_status_filename_s);
+	FreeMemory (process_p);
+}
+
+
+static void RemoveMonitoredProcess (PolymarkerProcessMonitor *monitor_p, MonitoredProcess *process_p)
+{
+	MonitoredProcess **process_pp = & (monitor_p -> ppm_processes_p);
+	bool shared_watch_flag = false;
+
+	epoll_ctl (monitor_p -> ppm_epoll_fd, EPOLL_CTL_DEL, process_p -> mp_pidfd, NULL);
+	close (process_p -> mp_pidfd);
+
+	pthread_mutex_lock (& (monitor_p -> ppm_mutex));
+
+	while (*process_pp)
+		{
+			if (*process_pp == process_p)
+				{
+					*process_pp = process_p -> mp_next_p;
+				}
+			else
+				{
+					/* The same directory gives the same watch, so keep it if it's still in use */
+					if ((process_p -> mp_watch != -1) && ((*process_pp) -> mp_watch == process_p -> mp_watch))
+						{
+							shared_watch_flag = true;
+						}
+
+					process_pp = & ((*process_pp) -> mp_next_p);
+				}
+		}
+
+	pthread_mutex_unlock (& (monitor_p -> ppm_mutex));
+
+	if ((process_p -> mp_watch != -1) && (!shared_watch_flag))
+		{
+			inotify_rm_watch (monitor_p -> ppm_inotify_fd, process_p -> mp_watch);
+		}
+}
@@ -0,0 +1,561 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_scheduler.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <set>
+
+#include "polymarker_scheduler.hpp"
+#include "polymarker_tool.hpp"
+
+#include "jobs_manager.h"
+#include "json_util.h"
+#include "streams.h"
+
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_SCHEDULER_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_SCHEDULER_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+static const char * const S_MAX_CONCURRENT_JOBS_S = "max_concurrent_jobs";
+
+static const char * const S_MAX_CONCURRENT_JOBS_PER_DB_S = "max_concurrent_jobs_per_database";
+
+
+/*
+ * Each request gets its own Service so the scheduler is shared by all of
+ * them, otherwise the limits would only apply to the jobs of a single
+ * request. It is freed once the last service using it has been freed.
+ */
+static std :: mutex s_shared_scheduler_mutex;
+
+static PolymarkerScheduler *s_shared_scheduler_p = 0;
+
+static uint32 s_num_shared_scheduler_users = 0;
+
+
+static bool StartPolymarkerServiceJob (void *data_p);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerScheduler *GetSharedPolymarkerScheduler (const PolymarkerServiceData *data_p)
+{
+	PolymarkerScheduler *scheduler_p = 0;
+	const json_t *config_p = data_p -> psd_base_data.sd_config_p;
+	json_int_t max_runs = 0;
+	json_int_t max_runs_per_db = 0;
+	bool limited_flag = false;
+	std :: lock_guard <std :: mutex> lock (s_shared_scheduler_mutex);
+
+	if (s_shared_scheduler_p)
+		{
+			++ s_num_shared_scheduler_users;
+			return s_shared_scheduler_p;
+		}
+
+	if (config_p)
+		{
+			if (GetJSONInteger (config_p, S_MAX_CONCURRENT_JOBS_S, &max_runs) && (max_runs > 0))
+				{
+					limited_flag = true;
+				}
+			else
+				{
+					max_runs = 0;
+				}
+
+			if (GetJSONInteger (config_p, S_MAX_CONCURRENT_JOBS_PER_DB_S, &max_runs_per_db) && (max_runs_per_db > 0))
+				{
+					limited_flag = true;
+				}
+			else
+				{
+					max_runs_per_db = 0;
+				}
+		}
+
+	for (size_t i = 0; (!limited_flag) && (i < data_p -> psd_index_data_size); ++ i)
+		{
+			if ((data_p -> psd_index_data_p [i].ps_max_concurrent_jobs > 0) || (data_p -> psd_index_data_p [i].ps_priority != PJP_NORMAL))
+				{
+					limited_flag = true;
+				}
+		}
+
+	if (limited_flag)
+		{
+			try
+				{
+					scheduler_p = new PolymarkerScheduler ((uint32) max_runs, (uint32) max_runs_per_db);
+
+					s_shared_scheduler_p = scheduler_p;
+					++ s_num_shared_scheduler_users;
+				}
+			catch (std :: bad_alloc &ex_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate PolymarkerScheduler, \"%s\"", ex_r.what ());
+				}
+		}
+
+	return scheduler_p;
+}
+
+
+void ReleaseSharedPolymarkerScheduler (PolymarkerScheduler *scheduler_p, const PolymarkerServiceData *data_p)
+{
+	bool free_flag = false;
+
+	scheduler_p -> ReleaseServiceData (data_p);
+
+	{
+		std :: lock_guard <std :: mutex> lock (s_shared_scheduler_mutex);
+
+		if (-- s_num_shared_scheduler_users == 0)
+			{
+				s_shared_scheduler_p = 0;
+				free_flag = true;
+			}
+	}
+
+	if (free_flag)
+		{
+			delete scheduler_p;
+		}
+}
+
+
+bool SchedulePolymarkerServiceJob (PolymarkerScheduler *scheduler_p, PolymarkerServiceJob *job_p)
+{
+	bool success_flag = false;
+	ServiceJob *base_job_p = & (job_p -> psj_base_job);
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (base_job_p -> sj_service_p);
+	JobsManager *manager_p = GetJobsManager (grassroots_p);
+
+	/*
+	 * Add the job now so that its status can be queried while it is queued.
+	 * Its PolymarkerTool will add it again when the job is started.
+	 */
+	if (AddServiceJobToJobsManager (manager_p, base_job_p -> sj_id, base_job_p))
+		{
+			std :: vector <PolymarkerServiceJob *> jobs (1, job_p);
+
+			SetServiceJobStatus (base_job_p, OS_PENDING);
+
+			success_flag = scheduler_p -> Submit (jobs, job_p -> psj_tool_p -> GetPolymarkerSequence (), StartPolymarkerServiceJob, job_p, job_p -> psj_tool_p -> GetServiceData ());
+		}
+	else
+		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+			ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add Polymarker Service Job \"%s\" to jobs manager", uuid_s);
+		}
+
+	return success_flag;
+}
+
+
+void PolymarkerScheduledJobCompleted (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p)
+{
+	scheduler_p -> JobCompleted (job_p);
+}
+
+
+uint32 GetPolymarkerServiceJobQueuePosition (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p)
+{
+	return scheduler_p -> GetQueuePosition (job_p);
+}
+
+
+bool RemoveQueuedPolymarkerServiceJob (PolymarkerScheduler *scheduler_p, const PolymarkerServiceJob *job_p)
+{
+	return scheduler_p -> RemoveQueuedJob (job_p);
+}
+
+
+PolymarkerScheduler :: PolymarkerScheduler (uint32 max_runs, uint32 max_runs_per_db)
+	: ps_max_runs (max_runs),
+		ps_max_runs_per_db (max_runs_per_db),
+		ps_num_running (0)
+{
+}
+
+
+PolymarkerScheduler :: ~PolymarkerScheduler ()
+{
+	std :: set <PolymarkerScheduledRun *> runs;
+	std :: map <const PolymarkerServiceJob *, PolymarkerScheduledRun *> :: iterator job_itr;
+
+	for (int i = 0; i < PJP_NUM_PRIORITIES; ++ i)
+		{
+			runs.insert (ps_queues [i].begin (), ps_queues [i].end ());
+		}
+
+	/* A running run is referenced by each of its unfinished jobs */
+	for (job_itr = ps_running_jobs.begin (); job_itr != ps_running_jobs.end (); ++ job_itr)
+		{
+			runs.insert (job_itr -> second);
+		}
+
+	for (std :: set <PolymarkerScheduledRun *> :: iterator itr = runs.begin (); itr != runs.end (); ++ itr)
+		{
+			delete *itr;
+		}
+}
+
+
+bool PolymarkerScheduler :: Submit (const std :: vector <PolymarkerServiceJob *> &jobs, const PolymarkerSequence *seq_p, PolymarkerRunStarter start_fn, void *start_data_p, const PolymarkerServiceData *data_p)
+{
+	PolymarkerScheduledRun *run_p = 0;
+
+	try
+		{
+			run_p = new PolymarkerScheduledRun;
+		}
+	catch (std :: bad_alloc &ex_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate PolymarkerScheduledRun, \"%s\"", ex_r.what ());
+			return false;
+		}
+
+	run_p -> psr_jobs = jobs;
+	run_p -> psr_seq_p = seq_p;
+	run_p -> psr_data_p = data_p;
+
+	if (seq_p && (seq_p -> ps_fasta_filename_s))
+		{
+			run_p -> psr_database.assign (seq_p -> ps_fasta_filename_s);
+		}
+	run_p -> psr_start_fn = start_fn;
+	run_p -> psr_start_data_p = start_data_p;
+	run_p -> psr_num_unfinished_jobs = jobs.size ();
+
+	{
+		std :: lock_guard <std :: mutex> lock (ps_mutex);
+		PolymarkerJobPriority priority = PJP_NUM_PRIORITIES;
+
+		/* A run goes in the queue of its most urgent job */
+		for (std :: vector <PolymarkerServiceJob *> :: const_iterator itr = jobs.begin (); itr != jobs.end (); ++ itr)
+			{
+				if ((*itr) -> psj_priority < priority)
+					{
+						priority = (*itr) -> psj_priority;
+					}
+			}
+
+		if (priority == PJP_NUM_PRIORITIES)
+			{
+				priority = seq_p ? seq_p -> ps_priority : PJP_NORMAL;
+			}
+
+		ps_queues [priority].push_back (run_p);
+	}
+
+	StartQueuedRuns ();
+
+	return true;
+}
+
+
+void PolymarkerScheduler :: JobCompleted (const PolymarkerServiceJob *job_p)
+{
+	bool freed_flag = false;
+
+	{
+		std :: lock_guard <std :: mutex> lock (ps_mutex);
+		std :: map <const PolymarkerServiceJob *, PolymarkerScheduledRun *> :: iterator itr = ps_running_jobs.find (job_p);
+
+		if (itr != ps_running_jobs.end ())
+			{
+				PolymarkerScheduledRun *run_p = itr -> second;
+
+				ps_running_jobs.erase (itr);
+
+				if (-- (run_p -> psr_num_unfinished_jobs) == 0)
+					{
+						MarkAsFinished (run_p);
+						delete run_p;
+						freed_flag = true;
+					}
+			}
+	}
+
+	if (freed_flag)
+		{
+			StartQueuedRuns ();
+		}
+}
+
+
+bool PolymarkerScheduler :: RemoveQueuedJob (const PolymarkerServiceJob *job_p)
+{
+	std :: lock_guard <std :: mutex> lock (ps_mutex);
+
+	for (int i = 0; i < PJP_NUM_PRIORITIES; ++ i)
+		{
+			std :: deque <PolymarkerScheduledRun *> :: iterator itr;
+
+			for (itr = ps_queues [i].begin (); itr != ps_queues [i].end (); ++ itr)
+				{
+					PolymarkerScheduledRun *run_p = *itr;
+
+					/* A batch's jobs share a run so one of them can't be taken out on its own */
+					if ((run_p -> psr_start_fn == StartPolymarkerServiceJob) && (run_p -> psr_jobs.size () == 1) && (run_p -> psr_jobs [0] == job_p))
+						{
+							ps_queues [i].erase (itr);
+							delete run_p;
+
+							return true;
+						}
+				}
+		}
+
+	return false;
+}
+
+
+void PolymarkerScheduler :: ReleaseServiceData (const PolymarkerServiceData *data_p)
+{
+	std :: lock_guard <std :: mutex> lock (ps_mutex);
+
+	for (int i = 0; i < PJP_NUM_PRIORITIES; ++ i)
+		{
+			std :: deque <PolymarkerScheduledRun *> :: iterator itr = ps_queues [i].begin ();
+
+			while (itr != ps_queues [i].end ())
+				{
+					PolymarkerScheduledRun *run_p = *itr;
+
+					if ((run_p -> psr_start_fn == StartPolymarkerServiceJob) && (run_p -> psr_data_p == data_p))
+						{
+							itr = ps_queues [i].erase (itr);
+							delete run_p;
+						}
+					else
+						{
+							++ itr;
+						}
+				}
+		}
+}
+
+
+uint32 PolymarkerScheduler :: GetQueuePosition (const PolymarkerServiceJob *job_p)
+{
+	std :: lock_guard <std :: mutex> lock (ps_mutex);
+	uint32 position = 0;
+
+	for (int i = 0; i < PJP_NUM_PRIORITIES; ++ i)
+		{
+			std :: deque <PolymarkerScheduledRun *> :: const_iterator itr;
+
+			for (itr = ps_queues [i].begin (); itr != ps_queues [i].end (); ++ itr)
+				{
+					const std :: vector <PolymarkerServiceJob *> &jobs = (*itr) -> psr_jobs;
+
+					++ position;
+
+					for (std :: vector <PolymarkerServiceJob *> :: const_iterator job_itr = jobs.begin (); job_itr != jobs.end (); ++ job_itr)
+						{
+							if (*job_itr == job_p)
+								{
+									return position;
+								}
+						}
+				}
+		}
+
+	return 0;
+}
+
+
+/*
+ * Start as many queued runs as the limits allow. The highest priority
+ * queue is checked first and within each queue the runs are checked in
+ * order, so a run against a busy database does not hold up the runs
+ * behind it against other databases.
+ */
+void PolymarkerScheduler :: StartQueuedRuns ()
+{
+	bool started_flag = true;
+
+	while (started_flag)
+		{
+			std :: vector <PolymarkerScheduledRun *> runs;
+			std :: vector <PolymarkerScheduledRun *> :: iterator itr;
+
+			started_flag = false;
+
+			{
+				std :: lock_guard <std :: mutex> lock (ps_mutex);
+
+				for (int i = 0; i < PJP_NUM_PRIORITIES; ++ i)
+					{
+						std :: deque <PolymarkerScheduledRun *> &queue_r = ps_queues [i];
+						std :: deque <PolymarkerScheduledRun *> :: iterator queue_itr = queue_r.begin ();
+
+						while (queue_itr != queue_r.end ())
+							{
+								if (CanStart (*queue_itr))
+									{
+										MarkAsRunning (*queue_itr);
+										runs.push_back (*queue_itr);
+										queue_itr = queue_r.erase (queue_itr);
+									}
+								else
+									{
+										++ queue_itr;
+									}
+							}
+					}
+			}
+
+			/*
+			 * The runs are started without holding the lock as a run that
+			 * starts successfully may complete its jobs, and so be freed,
+			 * before its start function has even returned.
+			 */
+			for (itr = runs.begin (); itr != runs.end (); ++ itr)
+				{
+					PolymarkerScheduledRun *run_p = *itr;
+					const std :: vector <PolymarkerServiceJob *> jobs (run_p -> psr_jobs);
+
+					if (! (run_p -> psr_start_fn (run_p -> psr_start_data_p)))
+						{
+							std :: vector <PolymarkerServiceJob *> :: const_iterator job_itr;
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start run of " SIZET_FMT " jobs", jobs.size ());
+
+							/*
+							 * A start function that fails has not completed any of its
+							 * jobs, so they are all completed here. The last one frees
+							 * the run and its slot.
+							 */
+							for (job_itr = jobs.begin (); job_itr != jobs.end (); ++ job_itr)
+								{
+									ServiceJob *base_job_p = & ((*job_itr) -> psj_base_job);
+
+									SetServiceJobStatus (base_job_p, OS_FAILED_TO_START);
+									PolymarkerServiceJobCompleted (base_job_p);
+								}
+
+							/* The run's slot is free again so try the rest of the queue */
+							started_flag = true;
+						}
+				}
+		}
+}
+
+
+bool PolymarkerScheduler :: CanStart (const PolymarkerScheduledRun *run_p) const
+{
+	if ((ps_max_runs > 0) && (ps_num_running >= ps_max_runs))
+		{
+			return false;
+		}
+
+	if (run_p -> psr_seq_p)
+		{
+			const uint32 limit = (run_p -> psr_seq_p -> ps_max_concurrent_jobs > 0) ? run_p -> psr_seq_p -> ps_max_concurrent_jobs : ps_max_runs_per_db;
+
+			if (limit > 0)
+				{
+					std :: map <std :: string, uint32> :: const_iterator itr = ps_num_running_per_db.find (run_p -> psr_database);
+
+					if ((itr != ps_num_running_per_db.end ()) && (itr -> second >= limit))
+						{
+							return false;
+						}
+				}
+		}
+
+	return true;
+}
+
+
+void PolymarkerScheduler :: MarkAsRunning (PolymarkerScheduledRun *run_p)
+{
+	std :: vector <PolymarkerServiceJob *> :: const_iterator itr;
+
+	++ ps_num_running;
+	++ ps_num_running_per_db [run_p -> psr_database];
+
+	for (itr = run_p -> psr_jobs.begin (); itr != run_p -> psr_jobs.end (); ++ itr)
+		{
+			ps_running_jobs [*itr] = run_p;
+		}
+
+	#if POLYMARKER_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Starting run of " SIZET_FMT " jobs, " UINT32_FMT " running", run_p -> psr_jobs.size (), ps_num_running);
+	#endif
+}
+
+
+void PolymarkerScheduler :: MarkAsFinished (PolymarkerScheduledRun *run_p)
+{
+	std :: map <std :: string, uint32> :: iterator itr = ps_num_running_per_db.find (run_p -> psr_database);
+
+	-- ps_num_running;
+
+	if (itr != ps_num_running_per_db.end ())
+		{
+			if (-- (itr -> second) == 0)
+				{
+					ps_num_running_per_db.erase (itr);
+				}
+		}
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static bool StartPolymarkerServiceJob (void *data_p)
+{
+	PolymarkerServiceJob *job_p = static_cast <PolymarkerServiceJob *> (data_p);
+	OperationStatus status = RunPolymarkerTool (job_p -> psj_tool_p);
+
+	switch (status)
+		{
+			case OS_STARTED:
+			case OS_PENDING:
+			case OS_FINISHED:
+			case OS_PARTIALLY_SUCCEEDED:
+			case OS_SUCCEEDED:
+				return true;
+
+			default:
+				break;
+		}
+
+	return false;
+}
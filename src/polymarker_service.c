@@ -15,6 +15,8 @@
 */
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 #define ALLOCATE_POLYMARKER_TAGS (1)
@@ -31,6 +33,21 @@
 #include "polymarker_utils.h"
 #include "polymarker_tool.hpp"
 #include "primer3_prefs.h"
+#include "polymarker_worker_pool.h"
+#include "polymarker_process_monitor.h"
+#include "polymarker_job_limits.h"
+#include "polymarker_batcher.hpp"
+#include "polymarker_scheduler.hpp"
+#include "polymarker_shared_inputs.h"
+#include "fasta_file.hpp"
+#include "packed_sequence_file.hpp"
+#include "minimizer_index.hpp"
+#include "homoeolog_index.hpp"
+#include "arm_selection.hpp"
+#include "region_cache.hpp"
+#include "primer3_engine.hpp"
+#include "primer3_cache.hpp"
+#include "kasp_selector.hpp"
 
 #include "string_parameter.h"
 #include "boolean_parameter.h"
@@ -53,12 +70,68 @@
 
 static const char * const PS_SEQUENCE_NAME_S = "sequence";
 static const char * const PS_FASTA_FILENAME_S = "fasta";
+
+static const char * const S_PACKED_FILENAME_S = "packed_sequence";
+
+static const char * const S_MINIMIZER_INDEX_FILENAME_S = "minimizer_index";
+
+static const char * const S_HOMOEOLOG_INDEX_FILENAME_S = "homoeolog_index";
+
+static const char * const S_ARM_SELECTION_S = "arm_selection";
+
+static const char * const S_KASP_SCORES_S = "kasp_scores";
 static const char * const PS_DATABASE_GROUP_NAME_S = "Available contigs";
 
 static const char * const S_DB_SEP_S = " -> ";
 
 static const char * const S_INDEX_FILES_S = "index_files";
 
+static const char * const S_EXECUTABLE_S = "executable";
+
+static const char * const S_WORKER_POOL_SIZE_S = "worker_pool_size";
+
+static const char * const S_MAX_CONCURRENT_JOBS_S = "max_concurrent_jobs";
+
+static const char * const S_SEARCH_THREADS_S = "search_threads";
+
+static const char * const S_PRIORITY_S = "priority";
+
+static const char * const S_PREPARATION_THREADS_S = "preparation_threads";
+
+static const char * const S_REGION_CACHE_SIZE_S = "region_cache_size";
+
+static const char * const S_PRIMER3_LIBRARY_S = "primer3_library";
+
+static const char * const S_PRIMER3_THREADS_S = "primer3_threads";
+
+static const char * const S_PRIMER3_CACHE_DIRECTORY_S = "primer3_cache_directory";
+
+static const char * const S_PRIMER3_CACHE_SIZE_S = "primer3_cache_size";
+
+/* The number of megabytes that the primer3 cache uses if primer3_cache_size isn't set */
+static const json_int_t S_DEFAULT_PRIMER3_CACHE_SIZE = 1024;
+
+
+/*
+ * The jobs from a single request that are being prepared and started
+ * by a set of threads.
+ */
+typedef struct JobPreparationQueue
+{
+	PolymarkerServiceJob **jpq_jobs_pp;
+	size_t jpq_num_jobs;
+
+	/* The index of the next job to prepare, protected by jpq_mutex */
+	size_t jpq_next_job;
+	pthread_mutex_t jpq_mutex;
+
+	ParameterSet *jpq_param_set_p;
+	PolymarkerServiceData *jpq_data_p;
+
+	/* The inputs written once for all of the jobs, may be NULL */
+	const PolymarkerSharedInputs *jpq_inputs_p;
+} JobPreparationQueue;
+
 
 /*
  * STATIC PROTOTYPES
@@ -102,6 +175,12 @@ static void PreparePolymarkerServiceJobs (const ParameterSet * const param_set_p
 
 static bool RunPolymarkerJob (PolymarkerServiceJob *job_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p);
 
+static void PrepareAndStartPolymarkerServiceJobs (ServiceJobSet *jobs_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p);
+
+static void *PrepareAndStartQueuedJobs (void *data_p);
+
+static void PrepareAndStartPolymarkerServiceJob (PolymarkerServiceJob *job_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p, const PolymarkerSharedInputs *inputs_p);
+
 
 static char *CreateGroupName (const char *server_s);
 
@@ -119,6 +198,8 @@ static bool PreRunJobs (PolymarkerServiceData *data_p);
 
 static void SetPolymarkerSequenceConfig (PolymarkerSequence *seq_p, const json_t *config_p);
 
+static bool GetPolymarkerJobPriority (const char *value_s, PolymarkerJobPriority *priority_p);
+
 static ServiceMetadata *GetPolymarkerServiceMetadata (Service *service_p);
 
 
@@ -230,6 +311,17 @@ static json_t *GetPolymarkerIndexingData (struct Service *service_p)
 										}
 								}		/* if (database_p) */
 
+							/* The native tool's region cache is shared by every job so report its counters here */
+							if (success_flag && (data_p -> psd_tool_type == PTT_NATIVE))
+								{
+									success_flag = AddSharedRegionCacheStatsToJSON (res_p);
+								}
+
+							if (success_flag && (data_p -> psd_tool_type == PTT_NATIVE))
+								{
+									success_flag = AddSharedPrimer3CacheStatsToJSON (res_p);
+								}
+
 							if (success_flag)
 								{
 									return res_p;
@@ -292,6 +384,7 @@ static bool GetPolymarkerServiceConfig (PolymarkerServiceData *data_p, Grassroot
 	if (polymarker_config_p)
 		{
 			json_t *index_files_p;
+			json_int_t num_threads;
 			const char * const WORKING_DIRECTORY_KEY_S = "working_directory";
 			const char * const ALIGNER_KEY_S = "aligner";
 			const char *config_value_s = GetJSONString (polymarker_config_p, PS_TOOL_S);
@@ -310,9 +403,13 @@ static bool GetPolymarkerServiceConfig (PolymarkerServiceData *data_p, Grassroot
 						{
 							data_p -> psd_tool_type = PTT_SYSTEM;
 						}
+					else if (strcmp (config_value_s, PS_TOOL_NATIVE_S) == 0)
+						{
+							data_p -> psd_tool_type = PTT_NATIVE;
+						}
 				}
 
-			if (data_p -> psd_tool_type == PTT_SYSTEM)
+			if ((data_p -> psd_tool_type == PTT_SYSTEM) || (data_p -> psd_tool_type == PTT_NATIVE))
 				{
 					Service *service_p = data_p -> psd_base_data.sd_service_p;
 
@@ -331,6 +428,67 @@ static bool GetPolymarkerServiceConfig (PolymarkerServiceData *data_p, Grassroot
 						}
 				}
 
+			/*
+			 * Start any persistent workers for the system-based tool
+			 */
+			if (data_p -> psd_tool_type == PTT_SYSTEM)
+				{
+					json_int_t pool_size;
+
+					if (GetJSONInteger (polymarker_config_p, S_WORKER_POOL_SIZE_S, &pool_size) && (pool_size > 0))
+						{
+							const char *executable_s = GetJSONString (polymarker_config_p, S_EXECUTABLE_S);
+
+							if (executable_s)
+								{
+									data_p -> psd_worker_pool_p = GetSharedPolymarkerWorkerPool (executable_s, (uint32) pool_size);
+
+									if (! (data_p -> psd_worker_pool_p))
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start " UINT32_FMT " workers for \"%s\", each job will start its own process", (uint32) pool_size, executable_s);
+										}
+								}
+						}
+
+					/*
+					 * Watch each job's process rather than waiting to be polled
+					 */
+					if (! (data_p -> psd_worker_pool_p))
+						{
+							data_p -> psd_process_monitor_p = AllocatePolymarkerProcessMonitor ();
+
+							if (! (data_p -> psd_process_monitor_p))
+								{
+									PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Process monitoring is not available, jobs will be checked when they are polled");
+								}
+						}
+				}
+
+			/*
+			 * The time and resource limits for the processes started for each job
+			 */
+			if (data_p -> psd_tool_type == PTT_SYSTEM)
+				{
+					data_p -> psd_job_limits_p = AllocatePolymarkerJobLimits (polymarker_config_p);
+				}
+
+			/*
+			 * The number of threads used to prepare the jobs for a request
+			 */
+			if (GetJSONInteger (polymarker_config_p, S_PREPARATION_THREADS_S, &num_threads) && (num_threads > 0))
+				{
+					data_p -> psd_num_preparation_threads = (uint32) num_threads;
+				}
+
+			/*
+			 * Jobs against the same database can be merged into a single run,
+			 * even when they come from different requests
+			 */
+			if ((data_p -> psd_task_manager_p) && ((data_p -> psd_tool_type == PTT_SYSTEM) || (data_p -> psd_tool_type == PTT_NATIVE)))
+				{
+					data_p -> psd_batcher_p = GetSharedPolymarkerBatcher (data_p);
+				}
+
 			config_value_s = GetJSONString (polymarker_config_p, WORKING_DIRECTORY_KEY_S);
 			if (config_value_s)
 				{
@@ -413,6 +571,116 @@ static bool GetPolymarkerServiceConfig (PolymarkerServiceData *data_p, Grassroot
 
 				}		/* if (index_files_p) */
 
+			/*
+			 * Map the databases once for the whole process so that the native
+			 * pipelines can share them rather than each loading its own copy
+			 */
+			if (success_flag && (data_p -> psd_tool_type == PTT_NATIVE))
+				{
+					json_int_t cache_size = 0;
+					bool primer3_library_flag = true;
+					json_int_t primer3_threads = 1;
+					const char *primer3_cache_dir_s = GetJSONString (polymarker_config_p, S_PRIMER3_CACHE_DIRECTORY_S);
+					size_t i;
+
+					/*
+					 * The regions of the contigs that the jobs fetch are cached for
+					 * the whole process, the size is given in megabytes
+					 */
+					if (GetJSONInteger (polymarker_config_p, S_REGION_CACHE_SIZE_S, &cache_size) && (cache_size >= 0))
+						{
+							SetSharedRegionCacheCapacity (((size_t) cache_size) << 20);
+						}
+
+					/*
+					 * The primer3 results are kept on disk so that every job, including
+					 * those after a restart, can reuse them, the size is given in megabytes
+					 */
+					if (primer3_cache_dir_s)
+						{
+							json_int_t primer3_cache_size = S_DEFAULT_PRIMER3_CACHE_SIZE;
+
+							if (GetJSONInteger (polymarker_config_p, S_PRIMER3_CACHE_SIZE_S, &primer3_cache_size) && (primer3_cache_size < 0))
+								{
+									primer3_cache_size = 0;
+								}
+
+							if (!OpenSharedPrimer3Cache (primer3_cache_dir_s, ((size_t) primer3_cache_size) << 20))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open the primer3 cache \"%s\", jobs will run primer3 on every record", primer3_cache_dir_s);
+								}
+						}
+
+					/*
+					 * primer3's thermodynamic tables are global so load them once
+					 * rather than each job's primer3_core reading them again
+					 */
+					GetJSONBoolean (polymarker_config_p, S_PRIMER3_LIBRARY_S, &primer3_library_flag);
+
+					/*
+					 * The library can only design one record at a time, so the jobs run
+					 * primer3_core instead when they split their records between threads
+					 */
+					if (GetJSONInteger (polymarker_config_p, S_PRIMER3_THREADS_S, &primer3_threads) && (primer3_threads == 0))
+						{
+							primer3_threads = sysconf (_SC_NPROCESSORS_ONLN);
+						}
+
+					if (primer3_library_flag && (primer3_threads > 1))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "%s is " UINT32_FMT " so primer3 will not be used as a library, set it to 1 to use the library", S_PRIMER3_THREADS_S, (uint32) primer3_threads);
+							primer3_library_flag = false;
+						}
+
+					if (primer3_library_flag && (data_p -> psd_thermodynamic_parameters_path_s) && IsPrimer3LibraryAvailable ())
+						{
+							if (!LoadSharedPrimer3Engine (data_p -> psd_thermodynamic_parameters_path_s))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load the primer3 parameters from \"%s\", jobs will run primer3_core instead", data_p -> psd_thermodynamic_parameters_path_s);
+								}
+						}
+
+					for (i = 0; i < data_p -> psd_index_data_size; ++ i)
+						{
+							const PolymarkerSequence *seq_p = data_p -> psd_index_data_p + i;
+							bool loaded_flag = false;
+
+							if (seq_p -> ps_packed_filename_s)
+								{
+									loaded_flag = LoadSharedPackedSequenceFile (seq_p -> ps_packed_filename_s);
+
+									if (!loaded_flag)
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", using \"%s\" instead", seq_p -> ps_packed_filename_s, seq_p -> ps_fasta_filename_s);
+										}
+								}
+
+							if ((!loaded_flag) && (seq_p -> ps_fasta_filename_s) && (!LoadSharedFastaFile (seq_p -> ps_fasta_filename_s)))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", jobs against it will fail", seq_p -> ps_fasta_filename_s);
+								}
+
+							if ((seq_p -> ps_minimizer_index_filename_s) && (!LoadSharedMinimizerIndex (seq_p -> ps_minimizer_index_filename_s)))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", markers will be aligned against the whole of \"%s\"", seq_p -> ps_minimizer_index_filename_s, seq_p -> ps_fasta_filename_s);
+								}
+
+							if ((seq_p -> ps_homoeolog_index_filename_s) && (!LoadSharedHomoeologIndex (seq_p -> ps_homoeolog_index_filename_s)))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load \"%s\", the homoeologs of each marker will be found from its alignments", seq_p -> ps_homoeolog_index_filename_s);
+								}
+						}
+				}
+
+			/*
+			 * Queue the jobs, along with those of every other request, if the
+			 * number of concurrent pipelines is limited
+			 */
+			if (success_flag && (data_p -> psd_task_manager_p))
+				{
+					data_p -> psd_scheduler_p = GetSharedPolymarkerScheduler (data_p);
+				}
+
 		}		/* if (polymarker_config_p) */
 
 	return success_flag;
@@ -421,10 +689,89 @@ static bool GetPolymarkerServiceConfig (PolymarkerServiceData *data_p, Grassroot
 
 static void SetPolymarkerSequenceConfig (PolymarkerSequence *seq_p, const json_t *config_p)
 {
+	const char *value_s;
+	json_int_t max_jobs;
+	json_int_t num_threads;
+
 	seq_p -> ps_name_s = GetJSONString (config_p, PS_SEQUENCE_NAME_S);
 	seq_p -> ps_fasta_filename_s = GetJSONString (config_p, PS_FASTA_FILENAME_S);
+	seq_p -> ps_packed_filename_s = GetJSONString (config_p, S_PACKED_FILENAME_S);
+	seq_p -> ps_minimizer_index_filename_s = GetJSONString (config_p, S_MINIMIZER_INDEX_FILENAME_S);
+	seq_p -> ps_homoeolog_index_filename_s = GetJSONString (config_p, S_HOMOEOLOG_INDEX_FILENAME_S);
+	seq_p -> ps_arm_selection_s = GetJSONString (config_p, S_ARM_SELECTION_S);
+
+	/* The rule is passed to the system tool on its command line so it can't contain quotes */
+	if ((seq_p -> ps_arm_selection_s) && ((!IsValidArmSelection (seq_p -> ps_arm_selection_s)) || (strchr (seq_p -> ps_arm_selection_s, '\'') != NULL)))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid arm selection \"%s\" for \"%s\", using arm_selection_embl", seq_p -> ps_arm_selection_s, seq_p -> ps_fasta_filename_s);
+			seq_p -> ps_arm_selection_s = NULL;
+		}
+
+	seq_p -> ps_kasp_scores_p = json_object_get (config_p, S_KASP_SCORES_S);
+
+	if ((seq_p -> ps_kasp_scores_p) && (!IsValidKASPScores (seq_p -> ps_kasp_scores_p)))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid KASP scores for \"%s\", using genome_specific", seq_p -> ps_fasta_filename_s);
+			seq_p -> ps_kasp_scores_p = NULL;
+		}
 
 	GetJSONBoolean (config_p, "active", & (seq_p -> ps_active_flag));
+
+	seq_p -> ps_priority = PJP_NORMAL;
+	seq_p -> ps_max_concurrent_jobs = 0;
+	seq_p -> ps_search_threads = 1;
+
+	value_s = GetJSONString (config_p, S_PRIORITY_S);
+	if ((value_s) && (!GetPolymarkerJobPriority (value_s, & (seq_p -> ps_priority))))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Unknown priority \"%s\" for \"%s\", using normal", value_s, seq_p -> ps_name_s);
+		}
+
+	if (GetJSONInteger (config_p, S_MAX_CONCURRENT_JOBS_S, &max_jobs) && (max_jobs > 0))
+		{
+			seq_p -> ps_max_concurrent_jobs = (uint32) max_jobs;
+		}
+
+	if (GetJSONInteger (config_p, S_SEARCH_THREADS_S, &num_threads))
+		{
+			if (num_threads > 0)
+				{
+					seq_p -> ps_search_threads = (uint32) num_threads;
+				}
+			else if (num_threads == 0)
+				{
+					/* Use all of the online CPUs */
+					long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+					if (num_cpus > 0)
+						{
+							seq_p -> ps_search_threads = (uint32) num_cpus;
+						}
+				}
+		}
+}
+
+
+static bool GetPolymarkerJobPriority (const char *value_s, PolymarkerJobPriority *priority_p)
+{
+	if (strcmp (value_s, "high") == 0)
+		{
+			*priority_p = PJP_HIGH;
+		}
+	else if (strcmp (value_s, "normal") == 0)
+		{
+			*priority_p = PJP_NORMAL;
+		}
+	else if (strcmp (value_s, "low") == 0)
+		{
+			*priority_p = PJP_LOW;
+		}
+	else
+		{
+			return false;
+		}
+
+	return true;
 }
 
 
@@ -439,6 +786,12 @@ static PolymarkerServiceData *AllocatePolymarkerServiceData (Service * UNUSED_PA
 	data_p -> psd_index_data_size = 0;
 	data_p -> psd_working_dir_s = NULL;
 	data_p -> psd_task_manager_p = NULL;
+	data_p -> psd_worker_pool_p = NULL;
+	data_p -> psd_process_monitor_p = NULL;
+	data_p -> psd_batcher_p = NULL;
+	data_p -> psd_scheduler_p = NULL;
+	data_p -> psd_num_preparation_threads = 0;
+	data_p -> psd_job_limits_p = NULL;
 	data_p -> psd_tool_type = PTT_NUM_TYPES;
 
 	return data_p;
@@ -452,11 +805,35 @@ static void FreePolymarkerServiceData (PolymarkerServiceData *data_p)
 			FreeMemory (data_p -> psd_index_data_p);
 		}
 
+	/*
+	 * Stop the batcher from starting any more of this service's tasks
+	 * and then stop the tasks before freeing what they use.
+	 */
+	if (data_p -> psd_batcher_p)
+		{
+			ReleaseSharedPolymarkerBatcher (data_p -> psd_batcher_p, data_p);
+		}
+
 	if (data_p -> psd_task_manager_p)
 		{
 			FreeAsyncTasksManager (data_p -> psd_task_manager_p);
 		}
 
+	if (data_p -> psd_scheduler_p)
+		{
+			ReleaseSharedPolymarkerScheduler (data_p -> psd_scheduler_p, data_p);
+		}
+
+	if (data_p -> psd_process_monitor_p)
+		{
+			FreePolymarkerProcessMonitor (data_p -> psd_process_monitor_p);
+		}
+
+	if (data_p -> psd_job_limits_p)
+		{
+			FreePolymarkerJobLimits (data_p -> psd_job_limits_p);
+		}
+
 	FreeMemory (data_p);
 }
 
@@ -511,7 +888,9 @@ static ParameterSet *GetPolymarkerServiceParameters (Service *service_p, DataRes
 					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create Polymarker service Sequence parameters group");
 				}
 
-			if ((param_p = EasyCreateAndAddStringParameterToParameterSet (service_p -> se_data_p, param_set_p, NULL, PS_JOB_IDS.npt_type, PS_JOB_IDS.npt_name_s, "Previous job ids", "The ids for previous sets of results", NULL, PL_ALL)) != NULL)
+			if (((param_p = EasyCreateAndAddStringParameterToParameterSet (service_p -> se_data_p, param_set_p, NULL, PS_JOB_IDS.npt_type, PS_JOB_IDS.npt_name_s, "Previous job ids", "The ids for previous sets of results", NULL, PL_ALL)) != NULL) &&
+					((param_p = EasyCreateAndAddStringParameterToParameterSet (service_p -> se_data_p, param_set_p, NULL, PS_CANCEL_JOB_IDS.npt_type, PS_CANCEL_JOB_IDS.npt_name_s, "Cancel jobs", "The ids of queued or running jobs to cancel", NULL, PL_ADVANCED)) != NULL) &&
+					((param_p = EasyCreateAndAddStringParameterToParameterSet (service_p -> se_data_p, param_set_p, NULL, PS_JOB_PRIORITY.npt_type, PS_JOB_PRIORITY.npt_name_s, "Priority", "The priority that the jobs are queued with, one of high, normal or low. If this is not set, each job uses the priority of its database", NULL, PL_ADVANCED)) != NULL))
 				{
 					if ((param_p = EasyCreateAndAddStringParameterToParameterSet (service_p -> se_data_p, param_set_p, group_p, PS_GENE_ID.npt_type, PS_GENE_ID.npt_name_s, "Gene ID", "An unique identifier for the assay", NULL, PL_ALL)) != NULL)
 						{
@@ -555,6 +934,14 @@ static bool GetPolymarkerServiceParameterTypesForNamedParameters (const Service
 				{
 					*pt_p = PS_JOB_IDS.npt_type;
 				}
+			else if (strcmp (param_name_s, PS_CANCEL_JOB_IDS.npt_name_s) == 0)
+				{
+					*pt_p = PS_CANCEL_JOB_IDS.npt_type;
+				}
+			else if (strcmp (param_name_s, PS_JOB_PRIORITY.npt_name_s) == 0)
+				{
+					*pt_p = PS_JOB_PRIORITY.npt_type;
+				}
 			else if (strcmp (param_name_s, PS_GENE_ID.npt_name_s) == 0)
 				{
 					*pt_p = PS_GENE_ID.npt_type;
@@ -581,9 +968,25 @@ static ServiceJobSet *RunPolymarkerService (Service *service_p, ParameterSet *pa
 {
 	PolymarkerServiceData *data_p = (PolymarkerServiceData *) (service_p -> se_data_p);
 	const char *job_ids_s = NULL;
+	const char *cancel_ids_s = NULL;
 
+	if (GetCurrentStringParameterValueFromParameterSet (param_set_p, PS_CANCEL_JOB_IDS.npt_name_s, &cancel_ids_s) && (!IsStringEmpty (cancel_ids_s)))
+		{
+			LinkedList *uuids_p = GetUUIDSList (cancel_ids_s);
+
+			if (uuids_p)
+				{
+					CancelPolymarkerServiceJobs (uuids_p);
+					FreeLinkedList (uuids_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse \"%s\" for ids", cancel_ids_s);
+				}
 
-	if (GetCurrentStringParameterValueFromParameterSet (param_set_p, PS_JOB_IDS.npt_name_s, &job_ids_s))
+			service_p -> se_jobs_p = AllocateServiceJobSet (service_p);
+		}
+	else if (GetCurrentStringParameterValueFromParameterSet (param_set_p, PS_JOB_IDS.npt_name_s, &job_ids_s))
 		{
 			if (!IsStringEmpty (job_ids_s))
 				{
@@ -618,31 +1021,7 @@ static ServiceJobSet *RunPolymarkerService (Service *service_p, ParameterSet *pa
 						{
 							if (PreRunJobs (data_p))
 								{
-									ServiceJobSetIterator iterator;
-									PolymarkerServiceJob *job_p = NULL;
-
-									InitServiceJobSetIterator (&iterator, service_p -> se_jobs_p);
-
-									job_p = (PolymarkerServiceJob *) GetNextServiceJobFromServiceJobSetIterator (&iterator);
-
-									while (job_p)
-										{
-											if (job_p -> psj_tool_p -> ParseParameters (param_set_p))
-												{
-													if (!RunPolymarkerJob (job_p, param_set_p, data_p))
-														{
-
-														}
-
-												}
-											else
-												{
-													SetServiceJobStatus (& (job_p -> psj_base_job), OS_FAILED_TO_START);
-												}
-
-											job_p = (PolymarkerServiceJob *) GetNextServiceJobFromServiceJobSetIterator (&iterator);
-										}
-
+									PrepareAndStartPolymarkerServiceJobs (service_p -> se_jobs_p, param_set_p, data_p);
 								}
 
 						}		/* if (GetServiceJobSetSize (service_p -> se_jobs_p) > 0) */
@@ -795,6 +1174,212 @@ static ServiceMetadata *GetPolymarkerServiceMetadata (Service *service_p)
 }
 
 
+/*
+ * Each job's ParseParameters creates its own directory, marker list and
+ * primer3 config, so the jobs for the selected databases can be prepared
+ * at the same time. Each job is started as soon as it is ready rather
+ * than waiting for the others.
+ */
+static void PrepareAndStartPolymarkerServiceJobs (ServiceJobSet *jobs_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p)
+{
+	JobPreparationQueue queue;
+	const uint32 num_jobs = GetServiceJobSetSize (jobs_p);
+	uint32 num_threads = data_p -> psd_num_preparation_threads;
+
+	if (num_threads == 0)
+		{
+			long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+			num_threads = (num_cpus > 0) ? (uint32) num_cpus : 1;
+		}
+
+	if (num_threads > num_jobs)
+		{
+			num_threads = num_jobs;
+		}
+
+	queue.jpq_jobs_pp = (PolymarkerServiceJob **) AllocMemoryArray (sizeof (PolymarkerServiceJob *), num_jobs);
+
+	if (queue.jpq_jobs_pp)
+		{
+			ServiceJobSetIterator iterator;
+			PolymarkerServiceJob *job_p = NULL;
+			pthread_t *threads_p = NULL;
+			PolymarkerSharedInputs *shared_inputs_p = NULL;
+			uint32 num_started_threads = 0;
+			uint32 i;
+
+			InitServiceJobSetIterator (&iterator, jobs_p);
+
+			queue.jpq_num_jobs = 0;
+
+			while ((job_p = (PolymarkerServiceJob *) GetNextServiceJobFromServiceJobSetIterator (&iterator)) != NULL)
+				{
+					* ((queue.jpq_jobs_pp) + (queue.jpq_num_jobs)) = job_p;
+					++ (queue.jpq_num_jobs);
+				}
+
+			queue.jpq_next_job = 0;
+			queue.jpq_param_set_p = param_set_p;
+			queue.jpq_data_p = data_p;
+			queue.jpq_inputs_p = NULL;
+
+			/*
+			 * Every job uses the same markers and primer3 preferences, so parse and
+			 * write them once and let each job link to them.
+			 */
+			if (queue.jpq_num_jobs > 1)
+				{
+					shared_inputs_p = AllocatePolymarkerSharedInputs (param_set_p, data_p);
+
+					if (shared_inputs_p)
+						{
+							queue.jpq_inputs_p = shared_inputs_p;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write the shared inputs, each job will write its own");
+						}
+				}
+			pthread_mutex_init (& (queue.jpq_mutex), NULL);
+
+			/*
+			 * The calling thread takes jobs from the queue too, so we only
+			 * need to start the extra ones.
+			 */
+			if (num_threads > 1)
+				{
+					threads_p = (pthread_t *) AllocMemoryArray (sizeof (pthread_t), num_threads - 1);
+
+					if (threads_p)
+						{
+							for (i = 0; i < num_threads - 1; ++ i)
+								{
+									if (pthread_create (threads_p + num_started_threads, NULL, PrepareAndStartQueuedJobs, &queue) == 0)
+										{
+											++ num_started_threads;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start job preparation thread " UINT32_FMT, i);
+										}
+								}
+						}
+				}
+
+			PrepareAndStartQueuedJobs (&queue);
+
+			for (i = 0; i < num_started_threads; ++ i)
+				{
+					pthread_join (* (threads_p + i), NULL);
+				}
+
+			if (threads_p)
+				{
+					FreeMemory (threads_p);
+				}
+
+			pthread_mutex_destroy (& (queue.jpq_mutex));
+
+			if (shared_inputs_p)
+				{
+					FreePolymarkerSharedInputs (shared_inputs_p);
+				}
+
+			FreeMemory (queue.jpq_jobs_pp);
+		}		/* if (queue.jpq_jobs_pp) */
+	else
+		{
+			ServiceJobSetIterator iterator;
+			PolymarkerServiceJob *job_p = NULL;
+
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate job preparation queue for " UINT32_FMT " jobs, preparing them one at a time", num_jobs);
+
+			InitServiceJobSetIterator (&iterator, jobs_p);
+
+			while ((job_p = (PolymarkerServiceJob *) GetNextServiceJobFromServiceJobSetIterator (&iterator)) != NULL)
+				{
+					PrepareAndStartPolymarkerServiceJob (job_p, param_set_p, data_p, NULL);
+				}
+		}
+}
+
+
+static void *PrepareAndStartQueuedJobs (void *data_p)
+{
+	JobPreparationQueue *queue_p = (JobPreparationQueue *) data_p;
+	bool loop_flag = true;
+
+	while (loop_flag)
+		{
+			PolymarkerServiceJob *job_p = NULL;
+
+			pthread_mutex_lock (& (queue_p -> jpq_mutex));
+
+			if (queue_p -> jpq_next_job < queue_p -> jpq_num_jobs)
+				{
+					job_p = * ((queue_p -> jpq_jobs_pp) + (queue_p -> jpq_next_job));
+					++ (queue_p -> jpq_next_job);
+				}
+
+			pthread_mutex_unlock (& (queue_p -> jpq_mutex));
+
+			if (job_p)
+				{
+					PrepareAndStartPolymarkerServiceJob (job_p, queue_p -> jpq_param_set_p, queue_p -> jpq_data_p, queue_p -> jpq_inputs_p);
+				}
+			else
+				{
+					loop_flag = false;
+				}
+		}
+
+	return NULL;
+}
+
+
+static void PrepareAndStartPolymarkerServiceJob (PolymarkerServiceJob *job_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p, const PolymarkerSharedInputs *inputs_p)
+{
+	bool parsed_flag;
+
+	job_p -> psj_tool_p -> SetSharedInputs (inputs_p);
+	parsed_flag = job_p -> psj_tool_p -> ParseParameters (param_set_p);
+	job_p -> psj_tool_p -> SetSharedInputs (NULL);
+
+	if (parsed_flag)
+		{
+			/* Register the job before it starts so that it can always be cancelled */
+			AddRunningPolymarkerServiceJob (job_p);
+
+			if (data_p -> psd_batcher_p)
+				{
+					if (!AddJobToPolymarkerBatcher (data_p -> psd_batcher_p, job_p, param_set_p))
+						{
+							SetServiceJobStatus (& (job_p -> psj_base_job), OS_FAILED_TO_START);
+						}
+				}
+			else if (data_p -> psd_scheduler_p)
+				{
+					if (!SchedulePolymarkerServiceJob (data_p -> psd_scheduler_p, job_p))
+						{
+							SetServiceJobStatus (& (job_p -> psj_base_job), OS_FAILED_TO_START);
+						}
+				}
+			else if (!RunPolymarkerJob (job_p, param_set_p, data_p))
+				{
+					char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+					ConvertUUIDToString (job_p -> psj_base_job.sj_id, uuid_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run job %s", uuid_s);
+				}
+		}
+	else
+		{
+			SetServiceJobStatus (& (job_p -> psj_base_job), OS_FAILED_TO_START);
+		}
+}
+
+
 static bool RunPolymarkerJob (PolymarkerServiceJob *job_p, ParameterSet *param_set_p, PolymarkerServiceData *data_p)
 {
 	bool success_flag = false;
@@ -842,6 +1427,22 @@ static void PreparePolymarkerServiceJobs (const ParameterSet * const param_set_p
 	size_t i = 0;
 	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
 	char *group_s = GetLocalDatabaseGroupName (grassroots_p);
+	const char *priority_s = NULL;
+	PolymarkerJobPriority priority = PJP_NORMAL;
+	bool has_priority_flag = false;
+
+	/* A priority given in the request overrides those of the databases */
+	if (GetCurrentStringParameterValueFromParameterSet (param_set_p, PS_JOB_PRIORITY.npt_name_s, &priority_s) && (!IsStringEmpty (priority_s)))
+		{
+			if (GetPolymarkerJobPriority (priority_s, &priority))
+				{
+					has_priority_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Unknown priority \"%s\", using those of the databases", priority_s);
+				}
+		}
 
 	for (i = data_p -> psd_index_data_size; i > 0; -- i, ++ db_p)
 		{
@@ -859,6 +1460,11 @@ static void PreparePolymarkerServiceJobs (const ParameterSet * const param_set_p
 
 									if (job_p)
 										{
+											if (has_priority_flag)
+												{
+													job_p -> psj_priority = priority;
+												}
+
 											if (!AddServiceJobToService (service_p, (ServiceJob *) job_p))
 												{
 													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add ServiceJob to the ServiceJobSet for \"%s\"", db_s);
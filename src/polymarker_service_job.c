@@ -6,12 +6,15 @@
  */
 
 
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 
 
 #define ALLOCATE_POLYMARKER_SERVICE_JOB_TAGS (1)
 #include "polymarker_service_job.h"
 #include "polymarker_tool.hpp"
+#include "polymarker_scheduler.hpp"
 
 #include "string_utils.h"
 
@@ -23,10 +26,27 @@
 
 static const char * const PSJ_JOB_S = "job";
 static const char * const PSJ_PROCESS_ID_S = "process_id";
+static const char * const PSJ_QUEUE_POSITION_S = "queue_position";
+
+
+/*
+ * The jobs that have been started and not yet completed. Each request
+ * gets its own Service so these are shared by all of them, allowing a
+ * job to be cancelled from any later request.
+ */
+static PolymarkerServiceJob *s_running_jobs_p = NULL;
+
+static pthread_mutex_t s_running_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 static bool CalculatePolymarkerServiceJobResults (ServiceJob *job_p);
 
+static void FinishPolymarkerServiceJob (PolymarkerServiceJob *job_p);
+
+static void RemoveRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p);
+
+static void UnlinkRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p);
+
 
 
 PolymarkerServiceJob *AllocatePolymarkerServiceJob (Service *service_p, const PolymarkerSequence *db_p, PolymarkerServiceData *data_p)
@@ -40,6 +60,10 @@ PolymarkerServiceJob *AllocatePolymarkerServiceJob (Service *service_p, const Po
 			const char *name_s = NULL;
 			const char *description_s = NULL;
 
+			poly_job_p -> psj_next_running_p = NULL;
+			poly_job_p -> psj_running_flag = false;
+			poly_job_p -> psj_priority = db_p ? db_p -> ps_priority : PJP_NORMAL;
+
 			if (db_p)
 				{
 					name_s = db_p -> ps_name_s;
@@ -67,6 +91,11 @@ void FreePolymarkerServiceJob (ServiceJob *job_p)
 {
 	PolymarkerServiceJob *poly_job_p = (PolymarkerServiceJob *) job_p;
 
+	if (poly_job_p -> psj_running_flag)
+		{
+			RemoveRunningPolymarkerServiceJob (poly_job_p);
+		}
+
 	if (poly_job_p -> psj_tool_p)
 		{
 			FreePolymarkerTool (poly_job_p -> psj_tool_p);
@@ -107,6 +136,8 @@ ServiceJob *GetPolymarkerServiceJobFromJSON (struct Service *service_p, const js
 					GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
 
 					polymarker_job_p -> psj_tool_p = NULL;
+					polymarker_job_p -> psj_next_running_p = NULL;
+					polymarker_job_p -> psj_running_flag = false;
 
 					if (InitServiceJobFromJSON (& (polymarker_job_p -> psj_base_job), job_json_p, service_p, grassroots_p))
 						{
@@ -125,6 +156,10 @@ ServiceJob *GetPolymarkerServiceJobFromJSON (struct Service *service_p, const js
 										{
 											tool_type = PTT_WEB;
 										}
+									else if (strcmp (tool_type_s, PS_TOOL_NATIVE_S) == 0)
+										{
+											tool_type = PTT_NATIVE;
+										}
 
 									if (tool_type != PTT_NUM_TYPES)
 										{
@@ -208,6 +243,10 @@ json_t *ConvertPolymarkerServiceJobToJSON (Service * UNUSED_PARAM (service_p), S
 										tool_type_s = PS_TOOL_WEB_S;
 										break;
 
+									case PTT_NATIVE:
+										tool_type_s = PS_TOOL_NATIVE_S;
+										break;
+
 									default:
 										break;
 								}
@@ -216,6 +255,29 @@ json_t *ConvertPolymarkerServiceJobToJSON (Service * UNUSED_PARAM (service_p), S
 								{
 									if (json_object_set_new (base_job_json_p, PS_TOOL_S, json_string (tool_type_s)) == 0)
 										{
+											PolymarkerServiceData *data_p = (PolymarkerServiceData *) (service_job_p -> sj_service_p -> se_data_p);
+
+											if (data_p -> psd_scheduler_p)
+												{
+													const uint32 position = GetPolymarkerServiceJobQueuePosition (data_p -> psd_scheduler_p, polymarker_job_p);
+
+													if (position > 0)
+														{
+															if (json_object_set_new (base_job_json_p, PSJ_QUEUE_POSITION_S, json_integer (position)) != 0)
+																{
+																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add %s " UINT32_FMT " for %s", PSJ_QUEUE_POSITION_S, position, uuid_s);
+																}
+														}
+												}
+
+											/*
+											 * Let clients see how far a running job has got
+											 */
+											if (GetCachedServiceJobStatus (service_job_p) == OS_STARTED)
+												{
+													polymarker_job_p -> psj_tool_p -> AddProgressToJSON (base_job_json_p);
+												}
+
 											if (json_object_set_new (polymarker_job_json_p, PSJ_JOB_S, base_job_json_p) == 0)
 												{
 													return polymarker_job_json_p;
@@ -255,19 +317,78 @@ json_t *ConvertPolymarkerServiceJobToJSON (Service * UNUSED_PARAM (service_p), S
 
 void PolymarkerServiceJobCompleted (ServiceJob *job_p)
 {
-	if (job_p -> sj_result_p == NULL)
+	PolymarkerServiceJob *polymarker_job_p = (PolymarkerServiceJob *) job_p;
+
+	FinishPolymarkerServiceJob (polymarker_job_p);
+	RemoveRunningPolymarkerServiceJob (polymarker_job_p);
+}
+
+
+void AddRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p)
+{
+	pthread_mutex_lock (&s_running_jobs_mutex);
+
+	if (! (job_p -> psj_running_flag))
 		{
-			PolymarkerServiceJob *polymarker_job_p = (PolymarkerServiceJob *) job_p;
+			job_p -> psj_next_running_p = s_running_jobs_p;
+			s_running_jobs_p = job_p;
+			job_p -> psj_running_flag = true;
+		}
+
+	pthread_mutex_unlock (&s_running_jobs_mutex);
+}
+
+
+bool CancelPolymarkerServiceJob (const uuid_t job_id)
+{
+	bool cancelled_flag = false;
+	PolymarkerServiceJob *job_p;
+
+	/*
+	 * Keep the lock while cancelling so that the job can't be freed
+	 * from under us, as FreePolymarkerServiceJob waits for it to be
+	 * taken out of the running jobs.
+	 */
+	pthread_mutex_lock (&s_running_jobs_mutex);
 
-			if (!DeterminePolymarkerResult (polymarker_job_p))
+	job_p = s_running_jobs_p;
+
+	while (job_p && (uuid_compare (job_p -> psj_base_job.sj_id, job_id) != 0))
+		{
+			job_p = job_p -> psj_next_running_p;
+		}
+
+	if (job_p)
+		{
+			/* The job is queued by the scheduler of the Service that started it */
+			PolymarkerServiceData *data_p = (PolymarkerServiceData *) (job_p -> psj_base_job.sj_service_p -> se_data_p);
+
+			if ((data_p -> psd_scheduler_p) && (RemoveQueuedPolymarkerServiceJob (data_p -> psd_scheduler_p, job_p)))
 				{
-					char uuid_s [UUID_STRING_BUFFER_SIZE];
+					ServiceJob *base_job_p = & (job_p -> psj_base_job);
 
-					ConvertUUIDToString (job_p -> sj_id, uuid_s);
+					/*
+					 * A queued job never started so complete it here, before the
+					 * lock is released. A running job is completed by its task
+					 * once its process has stopped.
+					 */
+					AddGeneralErrorMessageToServiceJob (base_job_p, "The job was cancelled before it started");
+					SetServiceJobStatus (base_job_p, OS_FAILED);
 
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__,  "Failed to get result for \"%s\"", uuid_s);
+					FinishPolymarkerServiceJob (job_p);
+					UnlinkRunningPolymarkerServiceJob (job_p);
+
+					cancelled_flag = true;
+				}
+			else
+				{
+					cancelled_flag = job_p -> psj_tool_p -> Cancel ();
 				}
 		}
+
+	pthread_mutex_unlock (&s_running_jobs_mutex);
+
+	return cancelled_flag;
 }
 
 
@@ -286,7 +407,24 @@ bool AddPolymarkerResult (PolymarkerServiceJob *polymarker_job_p, const char *uu
 				{
 					if (tool_p -> AddSectionToResult (result_json_p, "exons_genes_and_contigs.fa", "exons_genes_and_contigs", 0))
 						{
-							json_t *polymarker_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, uuid_s, result_json_p);
+							char *order_filename_s = MakeFilename (tool_p -> GetJobDirectory (), "primers_to_order.csv");
+							json_t *polymarker_result_json_p;
+
+							/*
+							 * Both the native tool and polymarker_grassroots.rb write the oligos
+							 * to order, but other scripts run by the system tool might not
+							 */
+							if (order_filename_s)
+								{
+									if (access (order_filename_s, R_OK) == 0)
+										{
+											tool_p -> AddSectionToResult (result_json_p, "primers_to_order.csv", "primers_to_order", 0);
+										}
+
+									FreeCopiedString (order_filename_s);
+								}
+
+							polymarker_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, uuid_s, result_json_p);
 
 							if (polymarker_result_json_p)
 								{
@@ -360,3 +498,65 @@ static bool CalculatePolymarkerServiceJobResults (ServiceJob *job_p)
 {
 	return DeterminePolymarkerResult ((PolymarkerServiceJob *) job_p);
 }
+
+
+/*
+ * Get the result of a job that has finished and free up its slot so
+ * that any queued jobs can start.
+ */
+static void FinishPolymarkerServiceJob (PolymarkerServiceJob *job_p)
+{
+	ServiceJob *base_job_p = & (job_p -> psj_base_job);
+	PolymarkerServiceData *data_p = (PolymarkerServiceData *) (base_job_p -> sj_service_p -> se_data_p);
+
+	if (base_job_p -> sj_result_p == NULL)
+		{
+			if (!DeterminePolymarkerResult (job_p))
+				{
+					char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+					ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__,  "Failed to get result for \"%s\"", uuid_s);
+				}
+		}
+
+	if (data_p -> psd_scheduler_p)
+		{
+			PolymarkerScheduledJobCompleted (data_p -> psd_scheduler_p, job_p);
+		}
+}
+
+
+static void RemoveRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p)
+{
+	pthread_mutex_lock (&s_running_jobs_mutex);
+	UnlinkRunningPolymarkerServiceJob (job_p);
+	pthread_mutex_unlock (&s_running_jobs_mutex);
+}
+
+
+/*
+ * Take a job out of the running jobs. s_running_jobs_mutex must be held.
+ */
+static void UnlinkRunningPolymarkerServiceJob (PolymarkerServiceJob *job_p)
+{
+	if (job_p -> psj_running_flag)
+		{
+			PolymarkerServiceJob **job_pp = &s_running_jobs_p;
+
+			while (*job_pp)
+				{
+					if (*job_pp == job_p)
+						{
+							*job_pp = job_p -> psj_next_running_p;
+							break;
+						}
+
+					job_pp = & ((*job_pp) -> psj_next_running_p);
+				}
+
+			job_p -> psj_next_running_p = NULL;
+			job_p -> psj_running_flag = false;
+		}
+}
@@ -0,0 +1,413 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * polymarker_shared_inputs.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "polymarker_shared_inputs.h"
+#include "polymarker_utils.h"
+#include "primer3_prefs.h"
+
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_SHARED_INPUTS_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_SHARED_INPUTS_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_SHARED_DIR_S = "shared";
+
+static const char * const S_MARKERS_SUFFIX_S = ".markers_list";
+
+static const char * const S_PRIMER3_PREFS_SUFFIX_S = ".primer3.prefs";
+
+
+/* Files that are no longer linked from any job directory are removed after a day */
+static const time_t S_UNUSED_SHARED_INPUT_AGE = 24 * 60 * 60;
+
+static const time_t S_SHARED_INPUTS_CHECK_INTERVAL = 60 * 60;
+
+static pthread_mutex_t s_shared_dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t s_last_shared_inputs_check_time = 0;
+
+
+static char *StoreSharedInput (const char *data_s, const size_t data_length, const char *working_dir_s, const char *suffix_s);
+
+static char *WriteSharedInput (const char *data_s, const size_t data_length, const char *shared_dir_s, const char *suffix_s);
+
+static void RemoveUnusedSharedInputs (const char *shared_dir_s);
+
+static void GetContentHash (const char *data_s, const size_t data_length, char *hash_s);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerSharedInputs *AllocatePolymarkerSharedInputs (const ParameterSet *param_set_p, const PolymarkerServiceData *data_p)
+{
+	PolymarkerSharedInputs *inputs_p = (PolymarkerSharedInputs *) AllocMemory (sizeof (PolymarkerSharedInputs));
+
+	if (inputs_p)
+		{
+			char *buffer_s = NULL;
+			size_t buffer_length = 0;
+			FILE *buffer_f;
+
+			inputs_p -> psi_markers_filename_s = NULL;
+			inputs_p -> psi_has_chromosome_flag = false;
+			inputs_p -> psi_primer3_prefs_filename_s = NULL;
+
+			/*
+			 * Parse the markers into memory so that they can be hashed
+			 */
+			buffer_f = open_memstream (&buffer_s, &buffer_length);
+
+			if (buffer_f)
+				{
+					bool written_flag = WriteMarkerList (param_set_p, buffer_f, & (inputs_p -> psi_has_chromosome_flag));
+
+					fclose (buffer_f);
+
+					if (written_flag)
+						{
+							inputs_p -> psi_markers_filename_s = StoreSharedInput (buffer_s, buffer_length, data_p -> psd_working_dir_s, S_MARKERS_SUFFIX_S);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse the markers");
+						}
+
+					free (buffer_s);
+				}
+
+			if (inputs_p -> psi_markers_filename_s)
+				{
+					Primer3Prefs *prefs_p = AllocatePrimer3Prefs (data_p);
+
+					if (prefs_p)
+						{
+							ParsePrimer3PrefsParameters (param_set_p, prefs_p);
+
+							buffer_s = NULL;
+							buffer_length = 0;
+							buffer_f = open_memstream (&buffer_s, &buffer_length);
+
+							if (buffer_f)
+								{
+									bool written_flag = WritePrimer3Prefs (prefs_p, buffer_f);
+
+									fclose (buffer_f);
+
+									/*
+									 * As with WritePrimer3Config, if the preferences can't be
+									 * written the default primer3 configuration is used.
+									 */
+									if (written_flag)
+										{
+											inputs_p -> psi_primer3_prefs_filename_s = StoreSharedInput (buffer_s, buffer_length, data_p -> psd_working_dir_s, S_PRIMER3_PREFS_SUFFIX_S);
+										}
+
+									free (buffer_s);
+								}
+
+							FreePrimer3Prefs (prefs_p);
+						}
+
+					return inputs_p;
+				}		/* if (inputs_p -> psi_markers_filename_s) */
+
+			FreePolymarkerSharedInputs (inputs_p);
+		}		/* if (inputs_p) */
+
+	return NULL;
+}
+
+
+void FreePolymarkerSharedInputs (PolymarkerSharedInputs *inputs_p)
+{
+	if (inputs_p -> psi_markers_filename_s)
+		{
+			FreeCopiedString (inputs_p -> psi_markers_filename_s);
+		}
+
+	if (inputs_p -> psi_primer3_prefs_filename_s)
+		{
+			FreeCopiedString (inputs_p -> psi_primer3_prefs_filename_s);
+		}
+
+	FreeMemory (inputs_p);
+}
+
+
+char *LinkPolymarkerSharedInput (const char *shared_filename_s, const char *job_dir_s, const char *name_s)
+{
+	char *filename_s = MakeFilename (job_dir_s, name_s);
+
+	if (filename_s)
+		{
+			/* Replace any file left from a previous attempt */
+			if ((unlink (filename_s) == 0) || (errno == ENOENT))
+				{
+					if ((link (shared_filename_s, filename_s) == 0) || (symlink (shared_filename_s, filename_s) == 0))
+						{
+							return filename_s;
+						}
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to link \"%s\" to \"%s\", %s", filename_s, shared_filename_s, strerror (errno));
+			FreeCopiedString (filename_s);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+/*
+ * Write the data to <working dir>/shared/<hash><suffix> unless it is
+ * already there, first removing any files that are no longer used.
+ * s_shared_dir_mutex is held throughout so that a file can't be removed
+ * between being found and being marked as in use.
+ */
+static char *StoreSharedInput (const char *data_s, const size_t data_length, const char *working_dir_s, const char *suffix_s)
+{
+	char *filename_s = NULL;
+	char *shared_dir_s = MakeFilename (working_dir_s, S_SHARED_DIR_S);
+
+	if (shared_dir_s)
+		{
+			if (EnsureDirectoryExists (shared_dir_s))
+				{
+					pthread_mutex_lock (&s_shared_dir_mutex);
+
+					RemoveUnusedSharedInputs (shared_dir_s);
+					filename_s = WriteSharedInput (data_s, data_length, shared_dir_s, suffix_s);
+
+					pthread_mutex_unlock (&s_shared_dir_mutex);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to make sure directory \"%s\" exists", shared_dir_s);
+				}
+
+			FreeCopiedString (shared_dir_s);
+		}		/* if (shared_dir_s) */
+
+	return filename_s;
+}
+
+
+/*
+ * Write the data to <shared dir>/<hash><suffix> unless it is already
+ * there. The data is written to a temporary file first and then renamed
+ * so that a partially-written file is never linked to.
+ */
+static char *WriteSharedInput (const char *data_s, const size_t data_length, const char *shared_dir_s, const char *suffix_s)
+{
+	char hash_s [33];
+	char *name_s;
+
+	GetContentHash (data_s, data_length, hash_s);
+
+	name_s = ConcatenateVarargsStrings (hash_s, suffix_s, NULL);
+
+	if (name_s)
+		{
+			char *filename_s = MakeFilename (shared_dir_s, name_s);
+
+			FreeCopiedString (name_s);
+
+			if (filename_s)
+				{
+					if (access (filename_s, R_OK) == 0)
+						{
+							/*
+							 * Update its change time so that RemoveUnusedSharedInputs
+							 * leaves it alone until the job has linked to it.
+							 */
+							if (utimensat (AT_FDCWD, filename_s, NULL, 0) == 0)
+								{
+									#if POLYMARKER_SHARED_INPUTS_DEBUG >= STM_LEVEL_FINE
+									PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Reusing \"%s\"", filename_s);
+									#endif
+
+									return filename_s;
+								}
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to update \"%s\", %s", filename_s, strerror (errno));
+						}
+					else
+						{
+							char *temp_filename_s = ConcatenateVarargsStrings (filename_s, ".XXXXXX", NULL);
+
+							if (temp_filename_s)
+								{
+									int fd = mkstemp (temp_filename_s);
+
+									if (fd != -1)
+										{
+											bool success_flag = false;
+											FILE *out_f = fdopen (fd, "w");
+
+											if (out_f)
+												{
+													if (fwrite (data_s, 1, data_length, out_f) == data_length)
+														{
+															success_flag = true;
+														}
+
+													if (fclose (out_f) != 0)
+														{
+															success_flag = false;
+														}
+												}
+											else
+												{
+													close (fd);
+												}
+
+											if (success_flag)
+												{
+													if ((chmod (temp_filename_s, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0) && (rename (temp_filename_s, filename_s) == 0))
+														{
+															FreeCopiedString (temp_filename_s);
+															return filename_s;
+														}
+												}
+
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write \"%s\", %s", filename_s, strerror (errno));
+											unlink (temp_filename_s);
+										}		/* if (fd != -1) */
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create temporary file \"%s\", %s", temp_filename_s, strerror (errno));
+										}
+
+									FreeCopiedString (temp_filename_s);
+								}		/* if (temp_filename_s) */
+
+						}
+
+					FreeCopiedString (filename_s);
+				}		/* if (filename_s) */
+
+		}		/* if (name_s) */
+
+	return NULL;
+}
+
+
+/*
+ * Each job hard links to the shared files that it uses, so once all of
+ * the job directories that use a file have been removed its link count
+ * drops back to 1 and it can be removed too. Since linking a file, or
+ * reusing it in WriteSharedInput, updates its change time, only files
+ * that haven't changed for S_UNUSED_SHARED_INPUT_AGE are removed. This
+ * also covers the few jobs that could only make symbolic links, which
+ * don't add to the link count, as their markers will long since have
+ * been read. The directory is checked at most once every
+ * S_SHARED_INPUTS_CHECK_INTERVAL. s_shared_dir_mutex must be held.
+ */
+static void RemoveUnusedSharedInputs (const char *shared_dir_s)
+{
+	const time_t now = time (NULL);
+
+	if (now - s_last_shared_inputs_check_time >= S_SHARED_INPUTS_CHECK_INTERVAL)
+		{
+			DIR *dir_p = opendir (shared_dir_s);
+
+			s_last_shared_inputs_check_time = now;
+
+			if (dir_p)
+				{
+					struct dirent *entry_p;
+
+					while ((entry_p = readdir (dir_p)) != NULL)
+						{
+							struct stat st;
+
+							/* This includes any temporary files left by a failed write */
+							if ((fstatat (dirfd (dir_p), entry_p -> d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) && (S_ISREG (st.st_mode)) && (st.st_nlink == 1) && (now - st.st_ctime >= S_UNUSED_SHARED_INPUT_AGE))
+								{
+									if (unlinkat (dirfd (dir_p), entry_p -> d_name, 0) == 0)
+										{
+											#if POLYMARKER_SHARED_INPUTS_DEBUG >= STM_LEVEL_FINE
+											PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Removed unused \"%s\" from \"%s\"", entry_p -> d_name, shared_dir_s);
+											#endif
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove \"%s\" from \"%s\", %s", entry_p -> d_name, shared_dir_s, strerror (errno));
+										}
+								}
+						}
+
+					closedir (dir_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\", %s", shared_dir_s, strerror (errno));
+				}
+		}
+}
+
+
+/*
+ * The 128-bit FNV-1a hash of the data as 32 hex digits.
+ */
+static void GetContentHash (const char *data_s, const size_t data_length, char *hash_s)
+{
+	const unsigned __int128 prime = (((unsigned __int128) 0x0000000001000000ULL) << 64) | 0x000000000000013BULL;
+	unsigned __int128 hash = (((unsigned __int128) 0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL;
+	size_t i;
+
+	for (i = 0; i < data_length; ++ i)
+		{
+			hash ^= (unsigned char) data_s [i];
+			hash *= prime;
+		}
+
+	sprintf (hash_s, "%016llx%016llx", (unsigned long long) (hash >> 64), (unsigned long long) hash);
+}
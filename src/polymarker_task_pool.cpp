@@ -0,0 +1,243 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_task_pool.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <system_error>
+
+#include "polymarker_task_pool.hpp"
+
+#include "streams.h"
+
+
+PolymarkerTaskPool :: PolymarkerTaskPool (uint32 num_threads)
+	: ptp_num_threads ((num_threads > 0) ? num_threads : 1),
+		ptp_batch (0),
+		ptp_num_batch_threads (0),
+		ptp_num_busy_threads (0),
+		ptp_stop_flag (false),
+		ptp_task_fn_p (0),
+		ptp_failed (false)
+{
+}
+
+
+PolymarkerTaskPool :: ~PolymarkerTaskPool ()
+{
+	{
+		std :: lock_guard <std :: mutex> lock (ptp_mutex);
+
+		ptp_stop_flag = true;
+		ptp_start_cond.notify_all ();
+	}
+
+	for (std :: vector <std :: thread> :: iterator itr = ptp_threads.begin (); itr != ptp_threads.end (); ++ itr)
+		{
+			itr -> join ();
+		}
+}
+
+
+uint32 PolymarkerTaskPool :: GetNumThreads () const
+{
+	return ptp_num_threads;
+}
+
+
+bool PolymarkerTaskPool :: Run (size_t num_tasks, const PolymarkerTask &task_fn)
+{
+	const uint32 num_threads = (num_tasks < ptp_num_threads) ? (uint32) num_tasks : ptp_num_threads;
+
+	if (num_threads <= 1)
+		{
+			for (size_t i = 0; i < num_tasks; ++ i)
+				{
+					if (! task_fn (i, 0))
+						{
+							return false;
+						}
+				}
+
+			return true;
+		}
+
+	StartThreads ();
+
+	ptp_queues.clear ();
+	ptp_failed = false;
+	ptp_task_fn_p = &task_fn;
+
+	/* Give each thread a contiguous block so neighbouring tasks tend to run on the same thread */
+	for (uint32 i = 0; i < num_threads; ++ i)
+		{
+			const size_t first_task = (num_tasks * i) / num_threads;
+			const size_t last_task = (num_tasks * (i + 1)) / num_threads;
+
+			ptp_queues.emplace_back (new TaskQueue);
+
+			for (size_t j = first_task; j < last_task; ++ j)
+				{
+					ptp_queues.back () -> tq_tasks.push_back (j);
+				}
+		}
+
+	{
+		std :: lock_guard <std :: mutex> lock (ptp_mutex);
+
+		/* If any of the threads failed to start, the others steal the tasks from their queues */
+		ptp_num_batch_threads = num_threads;
+		ptp_num_busy_threads = std :: min <uint32> (num_threads - 1, (uint32) ptp_threads.size ());
+		++ ptp_batch;
+
+		ptp_start_cond.notify_all ();
+	}
+
+	/* The calling thread is worker 0 */
+	RunWorker (0);
+
+	{
+		std :: unique_lock <std :: mutex> lock (ptp_mutex);
+
+		ptp_done_cond.wait (lock, [this] () { return (ptp_num_busy_threads == 0); });
+	}
+
+	ptp_task_fn_p = 0;
+	ptp_queues.clear ();
+
+	return ! ptp_failed.load ();
+}
+
+
+void PolymarkerTaskPool :: StartThreads ()
+{
+	while (ptp_threads.size () + 1 < ptp_num_threads)
+		{
+			const uint32 thread_index = (uint32) (ptp_threads.size () + 1);
+
+			try
+				{
+					ptp_threads.emplace_back (&PolymarkerTaskPool :: WaitForBatches, this, thread_index, ptp_batch);
+				}
+			catch (std :: system_error &ex_r)
+				{
+					/* The tasks that would have been on this thread's queue will be stolen by the others */
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start task thread " UINT32_FMT " of " UINT32_FMT ", %s", thread_index, ptp_num_threads, ex_r.what ());
+
+					/* Don't try again for every batch */
+					ptp_num_threads = thread_index;
+				}
+		}
+}
+
+
+/*
+ * The loop run by each of the pool's own threads, which waits for each
+ * batch after last_batch in turn and works on it if it has enough tasks
+ * to need the thread. last_batch is passed in rather than read here as
+ * the batch that the thread was started for may already have begun.
+ */
+void PolymarkerTaskPool :: WaitForBatches (uint32 thread_index, uint64 last_batch)
+{
+	std :: unique_lock <std :: mutex> lock (ptp_mutex);
+
+	while (true)
+		{
+			ptp_start_cond.wait (lock, [this, last_batch] () { return (ptp_stop_flag || (ptp_batch != last_batch)); });
+
+			if (ptp_stop_flag)
+				{
+					break;
+				}
+
+			last_batch = ptp_batch;
+
+			if (thread_index < ptp_num_batch_threads)
+				{
+					lock.unlock ();
+					RunWorker (thread_index);
+					lock.lock ();
+
+					if (-- ptp_num_busy_threads == 0)
+						{
+							ptp_done_cond.notify_one ();
+						}
+				}
+		}
+}
+
+
+void PolymarkerTaskPool :: RunWorker (uint32 thread_index)
+{
+	const uint32 num_queues = (uint32) ptp_queues.size ();
+
+	/*
+	 * As no tasks are added once the batch has started, a thread can stop
+	 * as soon as it finds every queue empty.
+	 */
+	while (! ptp_failed.load ())
+		{
+			size_t task;
+			bool found_flag = GetTask (* (ptp_queues [thread_index]), true, task);
+
+			for (uint32 i = 1; (!found_flag) && (i < num_queues); ++ i)
+				{
+					found_flag = GetTask (* (ptp_queues [(thread_index + i) % num_queues]), false, task);
+				}
+
+			if (!found_flag)
+				{
+					break;
+				}
+
+			if (! (*ptp_task_fn_p) (task, thread_index))
+				{
+					ptp_failed = true;
+				}
+		}
+}
+
+
+bool PolymarkerTaskPool :: GetTask (TaskQueue &queue_r, bool own_flag, size_t &task_r)
+{
+	std :: lock_guard <std :: mutex> lock (queue_r.tq_mutex);
+
+	if (queue_r.tq_tasks.empty ())
+		{
+			return false;
+		}
+
+	/* Thieves take from the other end to the owner */
+	if (own_flag)
+		{
+			task_r = queue_r.tq_tasks.front ();
+			queue_r.tq_tasks.pop_front ();
+		}
+	else
+		{
+			task_r = queue_r.tq_tasks.back ();
+			queue_r.tq_tasks.pop_back ();
+		}
+
+	return true;
+}
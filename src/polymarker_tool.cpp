@@ -23,8 +23,13 @@
  * @brief
  */
 
+#include <cstring>
+
 #include "polymarker_tool.hpp"
 #include "async_system_polymarker_tool.hpp"
+#include "native_polymarker_tool.hpp"
+#include "polymarker_job_progress.h"
+#include "polymarker_checkpoint.hpp"
 #include "streams.h"
 #include "string_utils.h"
 
@@ -35,6 +40,11 @@ const char * const PolymarkerTool :: PT_JOB_DIR_S = "job_dir";
 const char * const PolymarkerTool :: PT_METADATA_FILENAME_S = "metadata";
 
 
+static void ResumeInterruptedJob (const PolymarkerServiceJob *job_p, PolymarkerServiceData *data_p, const char *job_dir_s);
+
+static const PolymarkerSequence *GetPolymarkerSequenceForFasta (const PolymarkerServiceData *data_p, const char *fasta_filename_s);
+
+
 PolymarkerTool *CreatePolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerSequence *seq_p, PolymarkerServiceData *data_p)
 {
 	PolymarkerTool *tool_p = 0;
@@ -52,6 +62,17 @@ PolymarkerTool *CreatePolymarkerTool (PolymarkerServiceJob *job_p, const Polymar
 					}
 				break;
 
+			case PTT_NATIVE:
+				try
+					{
+						tool_p = new NativePolymarkerTool (job_p, seq_p, data_p);
+					}
+				catch (std :: bad_alloc &ex_r)
+					{
+						PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate NativePolymarkerTool, \"%s\"", ex_r.what ());
+					}
+				break;
+
 			case PTT_WEB:
 			default:
 				break;
@@ -79,6 +100,26 @@ PolymarkerTool *CreatePolymarkerToolFromJSON (PolymarkerServiceJob *job_p, const
 					}
 				break;
 
+			case PTT_NATIVE:
+				try
+					{
+						tool_p = new NativePolymarkerTool (job_p, seq_p, data_p, service_job_json_p);
+					}
+				catch (std :: bad_alloc &ex_r)
+					{
+						PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate NativePolymarkerTool, \"%s\"", ex_r.what ());
+					}
+
+				/*
+				 * If the server stopped while the job was running, nothing
+				 * will ever finish it so carry on from where it got to.
+				 */
+				if (tool_p)
+					{
+						ResumeInterruptedJob (job_p, data_p, tool_p -> GetJobDirectory ());
+					}
+				break;
+
 			case PTT_WEB:
 			default:
 				break;
@@ -121,6 +162,13 @@ PolymarkerTool :: PolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerS
 {
 	job_p -> psj_tool_p = this;
 	pt_job_dir_s = nullptr;
+	pt_shared_inputs_p = nullptr;
+	pt_progress_p = AllocatePolymarkerJobProgress ();
+
+	if (!pt_progress_p)
+		{
+			throw std :: bad_alloc ();
+		}
 }
 
 
@@ -134,7 +182,13 @@ PolymarkerTool :: PolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerS
 	pt_service_job_p = job_p;
 
 	pt_job_dir_s = nullptr;
+	pt_shared_inputs_p = nullptr;
+	pt_progress_p = AllocatePolymarkerJobProgress ();
 
+	if (!pt_progress_p)
+		{
+			throw std :: bad_alloc ();
+		}
 
 	if (value_s)
 		{
@@ -151,6 +205,7 @@ PolymarkerTool :: PolymarkerTool (PolymarkerServiceJob *job_p, const PolymarkerS
 
 			if (!pt_job_dir_s)
 				{
+					FreePolymarkerJobProgress (pt_progress_p);
 					throw std :: bad_alloc ();
 				}
 		}
@@ -165,6 +220,8 @@ PolymarkerTool :: ~PolymarkerTool ()
 		{
 			FreeCopiedString (pt_job_dir_s);
 		}
+
+	FreePolymarkerJobProgress (pt_progress_p);
 }
 
 
@@ -226,12 +283,78 @@ bool PolymarkerTool :: AddSectionToResult (json_t *result_p, const char * const
 }
 
 
+void PolymarkerTool :: UpdateProgress ()
+{
+	if (pt_job_dir_s)
+		{
+			UpdatePolymarkerJobProgress (pt_progress_p, pt_job_dir_s);
+		}
+}
+
+
+bool PolymarkerTool :: AddProgressToJSON (json_t *json_p)
+{
+	UpdateProgress ();
+
+	return AddPolymarkerJobProgressToJSON (pt_progress_p, json_p);
+}
+
+
 void PolymarkerTool :: SetPolymarkerSequence (const PolymarkerSequence *seq_p)
 {
 	pt_seq_p = seq_p;
 }
 
 
+const PolymarkerSequence *PolymarkerTool :: GetPolymarkerSequence () const
+{
+	return pt_seq_p;
+}
+
+
+const char *PolymarkerTool :: GetJobDirectory () const
+{
+	return pt_job_dir_s;
+}
+
+
+const PolymarkerServiceData *PolymarkerTool :: GetServiceData () const
+{
+	return pt_service_data_p;
+}
+
+
+void PolymarkerTool :: SetSharedInputs (const PolymarkerSharedInputs *inputs_p)
+{
+	pt_shared_inputs_p = inputs_p;
+}
+
+
+bool PolymarkerTool :: Cancel ()
+{
+	return false;
+}
+
+
+bool PolymarkerTool :: Resume (PolymarkerCheckpoint * UNUSED_PARAM (checkpoint_p))
+{
+	return false;
+}
+
+
+bool PolymarkerTool :: RunInDirectory (const char *dir_s, char **error_ss)
+{
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "PolymarkerTool %s cannot run in \"%s\"", GetName (), dir_s);
+
+	if (error_ss)
+		{
+			*error_ss = CopyToNewString ("This tool cannot run batched jobs", 0, false);
+		}
+
+	return false;
+}
+
+
 bool PolymarkerTool ::  PreRun ()
 {
 	return SaveJobMetadata ();
@@ -349,3 +472,102 @@ bool PolymarkerTool :: SetJobUUID (const uuid_t id)
 	return success_flag;
 }
 
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+/*
+ * The job that has been read back in is only used for the current
+ * request, so the run is resumed by a new job, with the same id, that
+ * belongs to the Service until the run finishes.
+ */
+static void ResumeInterruptedJob (const PolymarkerServiceJob *job_p, PolymarkerServiceData *data_p, const char *job_dir_s)
+{
+	const ServiceJob *base_job_p = & (job_p -> psj_base_job);
+	const OperationStatus status = GetCachedServiceJobStatus (base_job_p);
+
+	if (((status == OS_PENDING) || (status == OS_STARTED)) && job_dir_s)
+		{
+			PolymarkerCheckpoint *checkpoint_p = 0;
+
+			try
+				{
+					checkpoint_p = new PolymarkerCheckpoint (job_dir_s);
+				}
+			catch (std :: bad_alloc &ex_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate PolymarkerCheckpoint, \"%s\"", ex_r.what ());
+					return;
+				}
+
+			/*
+			 * If the lock is held, the job is still running. If there is no
+			 * checkpoint, the job never started so there is nothing to resume.
+			 */
+			if ((checkpoint_p -> Lock ()) && (checkpoint_p -> Load ()) && (!checkpoint_p -> IsFinished ()))
+				{
+					const PolymarkerSequence *seq_p = GetPolymarkerSequenceForFasta (data_p, checkpoint_p -> GetFastaFilename ());
+					char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+					ConvertUUIDToString (base_job_p -> sj_id, uuid_s);
+
+					if (seq_p)
+						{
+							Service *service_p = base_job_p -> sj_service_p;
+							PolymarkerServiceJob *resumed_job_p = AllocatePolymarkerServiceJob (service_p, seq_p, data_p);
+
+							if (resumed_job_p)
+								{
+									if ((resumed_job_p -> psj_tool_p -> SetJobUUID (base_job_p -> sj_id)) && (AddServiceJobToService (service_p, & (resumed_job_p -> psj_base_job))))
+										{
+											AddRunningPolymarkerServiceJob (resumed_job_p);
+
+											if (resumed_job_p -> psj_tool_p -> Resume (checkpoint_p))
+												{
+													PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Resumed interrupted job %s", uuid_s);
+													checkpoint_p = 0;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to resume job %s", uuid_s);
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up resumed job %s", uuid_s);
+											FreeServiceJob (& (resumed_job_p -> psj_base_job));
+										}
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Cannot resume job %s as \"%s\" is no longer available", uuid_s, checkpoint_p -> GetFastaFilename ());
+						}
+				}
+
+			if (checkpoint_p)
+				{
+					delete checkpoint_p;
+				}
+		}
+}
+
+
+static const PolymarkerSequence *GetPolymarkerSequenceForFasta (const PolymarkerServiceData *data_p, const char *fasta_filename_s)
+{
+	if (fasta_filename_s)
+		{
+			for (size_t i = 0; i < data_p -> psd_index_data_size; ++ i)
+				{
+					const PolymarkerSequence *seq_p = data_p -> psd_index_data_p + i;
+
+					if (strcmp (seq_p -> ps_fasta_filename_s, fasta_filename_s) == 0)
+						{
+							return seq_p;
+						}
+				}
+		}
+
+	return 0;
+}
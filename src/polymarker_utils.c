@@ -65,7 +65,7 @@ const char *GetSequenceParametersGroupName (void)
 }
 
 
-bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, ByteBuffer *buffer_p)
+bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, const char *arm_selection_s, ByteBuffer *buffer_p)
 {
 	bool success_flag = false;
 	FILE *marker_f = fopen (marker_file_s, "w");
@@ -85,6 +85,13 @@ bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *
 									success_flag = true;
 								}
 						}
+					else if (arm_selection_s)
+						{
+							if (AppendStringsToByteBuffer (buffer_p, " --arm_selection '", arm_selection_s, "' --marker_list ", marker_file_s, NULL))
+								{
+									success_flag = true;
+								}
+						}
 					else
 						{
 							if (AppendStringsToByteBuffer (buffer_p, " --marker_list ", marker_file_s, NULL))
@@ -100,6 +107,12 @@ bool CreateAndAddMarkerListFile (const char *marker_file_s, const ParameterSet *
 	return success_flag;
 }
 
+bool WriteMarkerList (const ParameterSet *param_set_p, FILE *marker_f, bool *has_chromosome_flag_p)
+{
+	return WriteParameterValues (param_set_p, 0, marker_f, has_chromosome_flag_p);
+}
+
+
 bool CreateMarkerListFile (const char *marker_file_s, const ParameterSet *param_set_p, bool has_chromosome_param_flag)
 {
 	bool success_flag = false;
@@ -503,6 +516,41 @@ ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, PolymarkerServiceData *
 
 
 
+uint32 CancelPolymarkerServiceJobs (LinkedList *ids_p)
+{
+	StringListNode *node_p = (StringListNode *) (ids_p -> ll_head_p);
+	uint32 num_cancelled_jobs = 0;
+
+	while (node_p)
+		{
+			uuid_t job_id;
+			const char * const job_id_s = node_p -> sln_string_s;
+
+			if (uuid_parse (job_id_s, job_id) == 0)
+				{
+					if (CancelPolymarkerServiceJob (job_id))
+						{
+							PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Cancelled job \"%s\"", job_id_s);
+							++ num_cancelled_jobs;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to cancel job \"%s\", it is not queued or running", job_id_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse job id \"%s\"", job_id_s);
+				}
+
+			node_p = (StringListNode *) (node_p -> sln_node.ln_next_p);
+		}		/* while (node_p) */
+
+	return num_cancelled_jobs;
+}
+
+
+
 static char *ParseSequence (const char * const value_s)
 {
 	char *parsed_sequence_s = NULL;
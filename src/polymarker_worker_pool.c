@@ -0,0 +1,479 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * polymarker_worker_pool.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "polymarker_worker_pool.h"
+
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define POLYMARKER_WORKER_POOL_DEBUG (STM_LEVEL_FINE)
+#else
+	#define POLYMARKER_WORKER_POOL_DEBUG (STM_LEVEL_NONE)
+#endif
+
+
+static const char * const S_WORKER_ARG_S = "--worker";
+
+static const char * const S_STATUS_PREFIX_S = "STATUS\t";
+
+static const char * const S_ERROR_PREFIX_S = "ERROR\t";
+
+static const char * const S_DONE_S = "DONE";
+
+/* How long a worker has to exit after its socket is closed before it is killed */
+static const uint32 S_WORKER_EXIT_TIMEOUT_MS = 5000;
+
+/* How often to check whether a stopping worker has exited */
+static const uint32 S_WORKER_EXIT_POLL_MS = 20;
+
+
+/* The pool shared by every request, see GetSharedPolymarkerWorkerPool */
+static PolymarkerWorkerPool *s_shared_pool_p = NULL;
+
+static pthread_mutex_t s_shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool StartPolymarkerWorker (PolymarkerWorker *worker_p, const char *executable_s);
+
+static void StopPolymarkerWorker (PolymarkerWorker *worker_p);
+
+static PolymarkerWorker *AcquirePolymarkerWorker (PolymarkerWorkerPool *pool_p);
+
+static void ReleasePolymarkerWorker (PolymarkerWorkerPool *pool_p, PolymarkerWorker *worker_p);
+
+static bool WriteToPolymarkerWorker (PolymarkerWorker *worker_p, const char *data_s, size_t length);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+PolymarkerWorkerPool *AllocatePolymarkerWorkerPool (const char *executable_s, const uint32 num_workers)
+{
+	char *copied_executable_s = CopyToNewString (executable_s, 0, false);
+
+	if (copied_executable_s)
+		{
+			PolymarkerWorker *workers_p = (PolymarkerWorker *) AllocMemoryArray (sizeof (PolymarkerWorker), num_workers);
+
+			if (workers_p)
+				{
+					PolymarkerWorkerPool *pool_p = (PolymarkerWorkerPool *) AllocMemory (sizeof (PolymarkerWorkerPool));
+
+					if (pool_p)
+						{
+							uint32 i;
+							uint32 num_started = 0;
+
+							pool_p -> pwp_executable_s = copied_executable_s;
+							pool_p -> pwp_workers_p = workers_p;
+							pool_p -> pwp_num_workers = num_workers;
+
+							pthread_mutex_init (& (pool_p -> pwp_mutex), NULL);
+							pthread_cond_init (& (pool_p -> pwp_free_worker_cond), NULL);
+
+							for (i = 0; i < num_workers; ++ i)
+								{
+									workers_p [i].pw_busy_flag = false;
+									workers_p [i].pw_num_jobs = 0;
+
+									if (StartPolymarkerWorker (workers_p + i, copied_executable_s))
+										{
+											++ num_started;
+										}
+								}
+
+							if (num_started > 0)
+								{
+									#if POLYMARKER_WORKER_POOL_DEBUG >= STM_LEVEL_FINE
+									PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Started " UINT32_FMT " of " UINT32_FMT " workers for \"%s\"", num_started, num_workers, copied_executable_s);
+									#endif
+
+									return pool_p;
+								}
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start any workers for \"%s\"", copied_executable_s);
+
+							pthread_cond_destroy (& (pool_p -> pwp_free_worker_cond));
+							pthread_mutex_destroy (& (pool_p -> pwp_mutex));
+							FreeMemory (pool_p);
+						}		/* if (pool_p) */
+
+					FreeMemory (workers_p);
+				}		/* if (workers_p) */
+
+			FreeCopiedString (copied_executable_s);
+		}		/* if (copied_executable_s) */
+
+	return NULL;
+}
+
+
+PolymarkerWorkerPool *GetSharedPolymarkerWorkerPool (const char *executable_s, const uint32 num_workers)
+{
+	PolymarkerWorkerPool *pool_p = NULL;
+
+	pthread_mutex_lock (&s_shared_pool_mutex);
+
+	if (!s_shared_pool_p)
+		{
+			s_shared_pool_p = AllocatePolymarkerWorkerPool (executable_s, num_workers);
+		}
+
+	if (s_shared_pool_p)
+		{
+			if (strcmp (s_shared_pool_p -> pwp_executable_s, executable_s) == 0)
+				{
+					pool_p = s_shared_pool_p;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "The shared workers are running \"%s\" rather than \"%s\"", s_shared_pool_p -> pwp_executable_s, executable_s);
+				}
+		}
+
+	pthread_mutex_unlock (&s_shared_pool_mutex);
+
+	return pool_p;
+}
+
+
+void FreePolymarkerWorkerPool (PolymarkerWorkerPool *pool_p)
+{
+	uint32 i;
+
+	for (i = 0; i < pool_p -> pwp_num_workers; ++ i)
+		{
+			StopPolymarkerWorker ((pool_p -> pwp_workers_p) + i);
+		}
+
+	pthread_cond_destroy (& (pool_p -> pwp_free_worker_cond));
+	pthread_mutex_destroy (& (pool_p -> pwp_mutex));
+
+	FreeMemory (pool_p -> pwp_workers_p);
+	FreeCopiedString (pool_p -> pwp_executable_s);
+	FreeMemory (pool_p);
+}
+
+
+bool RunJobOnPolymarkerWorkerPool (PolymarkerWorkerPool *pool_p, const char *args_s, PolymarkerStatusLineCallback status_fn, void *status_data_p, char **error_ss)
+{
+	bool success_flag = false;
+	const char *error_s = "Failed to send job to worker";
+	char *reply_error_s = NULL;
+	PolymarkerWorker *worker_p = AcquirePolymarkerWorker (pool_p);
+
+	if (WriteToPolymarkerWorker (worker_p, args_s, strlen (args_s)) && WriteToPolymarkerWorker (worker_p, "\n", 1))
+		{
+			/*
+			 * Read the replies using a stream on a duplicate of the descriptor
+			 * so that closing the stream leaves the worker's socket open.
+			 */
+			int fd = dup (worker_p -> pw_fd);
+			FILE *in_f = (fd != -1) ? fdopen (fd, "r") : NULL;
+
+			error_s = "Worker exited before finishing the job";
+
+			if (in_f)
+				{
+					char *line_s = NULL;
+					size_t line_buffer_size = 0;
+					ssize_t line_length;
+					bool loop_flag = true;
+
+					while (loop_flag && ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1))
+						{
+							while ((line_length > 0) && ((line_s [line_length - 1] == '\n') || (line_s [line_length - 1] == '\r')))
+								{
+									line_s [-- line_length] = '\0';
+								}
+
+							if (strcmp (line_s, S_DONE_S) == 0)
+								{
+									success_flag = true;
+									loop_flag = false;
+								}
+							else if (strncmp (line_s, S_ERROR_PREFIX_S, strlen (S_ERROR_PREFIX_S)) == 0)
+								{
+									reply_error_s = CopyToNewString (line_s + strlen (S_ERROR_PREFIX_S), 0, false);
+									loop_flag = false;
+								}
+							else if (strncmp (line_s, S_STATUS_PREFIX_S, strlen (S_STATUS_PREFIX_S)) == 0)
+								{
+									#if POLYMARKER_WORKER_POOL_DEBUG >= STM_LEVEL_FINE
+									PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Worker %d: %s", (int) (worker_p -> pw_pid), line_s + strlen (S_STATUS_PREFIX_S));
+									#endif
+
+									if (status_fn)
+										{
+											status_fn (status_data_p, line_s + strlen (S_STATUS_PREFIX_S));
+										}
+								}
+						}
+
+					free (line_s);
+					fclose (in_f);
+
+					if (loop_flag)
+						{
+							/* The worker has gone so start a new one in its place */
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Worker %d exited, restarting it", (int) (worker_p -> pw_pid));
+
+							StopPolymarkerWorker (worker_p);
+							StartPolymarkerWorker (worker_p, pool_p -> pwp_executable_s);
+						}
+				}
+			else if (fd != -1)
+				{
+					close (fd);
+				}
+		}
+	else
+		{
+			StopPolymarkerWorker (worker_p);
+			StartPolymarkerWorker (worker_p, pool_p -> pwp_executable_s);
+		}
+
+	++ (worker_p -> pw_num_jobs);
+
+	ReleasePolymarkerWorker (pool_p, worker_p);
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Worker job \"%s\" failed: %s", args_s, reply_error_s ? reply_error_s : error_s);
+
+			if (error_ss)
+				{
+					*error_ss = reply_error_s ? reply_error_s : CopyToNewString (error_s, 0, false);
+					reply_error_s = NULL;
+				}
+		}
+
+	if (reply_error_s)
+		{
+			FreeCopiedString (reply_error_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static bool StartPolymarkerWorker (PolymarkerWorker *worker_p, const char *executable_s)
+{
+	int fds [2];
+
+	worker_p -> pw_pid = -1;
+	worker_p -> pw_fd = -1;
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0)
+		{
+			pid_t pid = fork ();
+
+			if (pid == 0)
+				{
+					/* The child uses its end of the socket as stdin and stdout */
+					if ((dup2 (fds [1], STDIN_FILENO) != -1) && (dup2 (fds [1], STDOUT_FILENO) != -1))
+						{
+							execlp (executable_s, executable_s, S_WORKER_ARG_S, (char *) NULL);
+						}
+
+					_exit (127);
+				}
+			else if (pid > 0)
+				{
+					close (fds [1]);
+
+					worker_p -> pw_pid = pid;
+					worker_p -> pw_fd = fds [0];
+
+					return true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to fork worker for \"%s\", %s", executable_s, strerror (errno));
+				}
+
+			close (fds [0]);
+			close (fds [1]);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create socket for worker for \"%s\", %s", executable_s, strerror (errno));
+		}
+
+	return false;
+}
+
+
+static void StopPolymarkerWorker (PolymarkerWorker *worker_p)
+{
+	if (worker_p -> pw_fd != -1)
+		{
+			/* The worker exits when it reads the end of its input */
+			close (worker_p -> pw_fd);
+			worker_p -> pw_fd = -1;
+		}
+
+	if (worker_p -> pw_pid > 0)
+		{
+			uint32 waited = 0;
+			pid_t res;
+
+			/*
+			 * Give the worker a chance to exit cleanly, but don't let a hung
+			 * one block the server from shutting down or restarting it.
+			 */
+			while (((res = waitpid (worker_p -> pw_pid, NULL, WNOHANG)) == 0) && (waited < S_WORKER_EXIT_TIMEOUT_MS))
+				{
+					usleep (S_WORKER_EXIT_POLL_MS * 1000);
+					waited += S_WORKER_EXIT_POLL_MS;
+				}
+
+			if (res == 0)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Worker %d didn't exit within " UINT32_FMT " ms, killing it", (int) (worker_p -> pw_pid), S_WORKER_EXIT_TIMEOUT_MS);
+
+					kill (worker_p -> pw_pid, SIGKILL);
+
+					while ((waitpid (worker_p -> pw_pid, NULL, 0) == -1) && (errno == EINTR))
+						{
+						}
+				}
+
+			worker_p -> pw_pid = -1;
+		}
+}
+
+
+static PolymarkerWorker *AcquirePolymarkerWorker (PolymarkerWorkerPool *pool_p)
+{
+	PolymarkerWorker *worker_p = NULL;
+
+	pthread_mutex_lock (& (pool_p -> pwp_mutex));
+
+	while (!worker_p)
+		{
+			uint32 i;
+
+			for (i = 0; i < pool_p -> pwp_num_workers; ++ i)
+				{
+					PolymarkerWorker *w_p = (pool_p -> pwp_workers_p) + i;
+
+					if (! (w_p -> pw_busy_flag))
+						{
+							/*
+							 * Prefer a running worker but fall back to one that failed
+							 * to start so that it gets restarted.
+							 */
+							if ((w_p -> pw_fd != -1) || (!worker_p))
+								{
+									worker_p = w_p;
+
+									if (w_p -> pw_fd != -1)
+										{
+											break;
+										}
+								}
+						}
+				}
+
+			if (!worker_p)
+				{
+					pthread_cond_wait (& (pool_p -> pwp_free_worker_cond), & (pool_p -> pwp_mutex));
+				}
+		}
+
+	worker_p -> pw_busy_flag = true;
+
+	pthread_mutex_unlock (& (pool_p -> pwp_mutex));
+
+	if (worker_p -> pw_fd == -1)
+		{
+			StartPolymarkerWorker (worker_p, pool_p -> pwp_executable_s);
+		}
+
+	return worker_p;
+}
+
+
+static void ReleasePolymarkerWorker (PolymarkerWorkerPool *pool_p, PolymarkerWorker *worker_p)
+{
+	pthread_mutex_lock (& (pool_p -> pwp_mutex));
+
+	worker_p -> pw_busy_flag = false;
+	pthread_cond_signal (& (pool_p -> pwp_free_worker_cond));
+
+	pthread_mutex_unlock (& (pool_p -> pwp_mutex));
+}
+
+
+static bool WriteToPolymarkerWorker (PolymarkerWorker *worker_p, const char *data_s, size_t length)
+{
+	if (worker_p -> pw_fd == -1)
+		{
+			return false;
+		}
+
+	while (length > 0)
+		{
+			/*
+			 * MSG_NOSIGNAL makes writing to a worker that has died fail with
+			 * EPIPE rather than raising SIGPIPE and killing the server.
+			 */
+			ssize_t res = send (worker_p -> pw_fd, data_s, length, MSG_NOSIGNAL);
+
+			if (res > 0)
+				{
+					data_s += res;
+					length -= (size_t) res;
+				}
+			else if ((res == -1) && (errno == EINTR))
+				{
+					continue;
+				}
+			else
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
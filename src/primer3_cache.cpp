@@ -0,0 +1,636 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * primer3_cache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "primer3_cache.hpp"
+
+#include "streams.h"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_PRIMER3_CACHE_S = "primer3_cache";
+
+/*
+ * The first line of every key. This should be changed whenever the
+ * results that are stored, or the way that they are designed, change
+ * so that the existing entries are no longer used.
+ */
+static const char * const S_KEY_VERSION_S = "POLYMARKER_PRIMER3_CACHE=1\n";
+
+/* The length of the hex digits of a key's hash */
+static const size_t S_HASH_LENGTH = 32;
+
+/* The number of leading digits of the hash used as the entry's subdirectory */
+static const size_t S_SUBDIRECTORY_LENGTH = 2;
+
+/* st_blocks is always in units of 512 bytes */
+static const size_t S_STAT_BLOCK_SIZE = 512;
+
+
+static size_t GetFileSize (const struct stat &st_r);
+
+static bool IsHash (const char *name_s, size_t length);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+Primer3Cache :: Primer3Cache ()
+	: pc_capacity (0),
+		pc_size (0),
+		pc_hits (0),
+		pc_misses (0),
+		pc_evictions (0)
+{
+}
+
+
+bool Primer3Cache :: Open (const char *directory_s, size_t capacity)
+{
+	std :: lock_guard <std :: mutex> lock (pc_mutex);
+
+	pc_entries.clear ();
+	pc_index.clear ();
+	pc_size = 0;
+	pc_capacity = 0;
+	pc_directory.assign (directory_s);
+
+	if (capacity > 0)
+		{
+			if ((mkdir (directory_s, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == 0) || (errno == EEXIST))
+				{
+					pc_capacity = capacity;
+					Load ();
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Opened primer3 cache \"%s\" with " SIZET_FMT " entries using " SIZET_FMT " bytes", directory_s, pc_entries.size (), pc_size);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create primer3 cache directory \"%s\", %s", directory_s, strerror (errno));
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+bool Primer3Cache :: IsEnabled () const
+{
+	std :: lock_guard <std :: mutex> lock (pc_mutex);
+
+	return (pc_capacity > 0);
+}
+
+
+bool Primer3Cache :: Get (const std :: string &key_r, Primer3Result &result_r)
+{
+	std :: lock_guard <std :: mutex> lock (pc_mutex);
+
+	if (pc_capacity > 0)
+		{
+			const std :: string hash (GetHash (key_r));
+			const std :: string filename (GetEntryFilename (hash));
+
+			if (ReadEntry (filename, key_r, result_r))
+				{
+					struct stat st;
+
+					++ pc_hits;
+
+					/* Record the use on disk so that it survives a restart */
+					utimensat (AT_FDCWD, filename.c_str (), NULL, 0);
+
+					/* The entry may have been written by another process */
+					if (stat (filename.c_str (), &st) == 0)
+						{
+							Touch (hash, GetFileSize (st));
+							Evict (pc_capacity);
+						}
+
+					return true;
+				}
+
+			++ pc_misses;
+		}
+
+	return false;
+}
+
+
+bool Primer3Cache :: Put (const std :: string &key_r, const Primer3Result &result_r)
+{
+	std :: lock_guard <std :: mutex> lock (pc_mutex);
+
+	if (pc_capacity > 0)
+		{
+			const std :: string hash (GetHash (key_r));
+			size_t size = 0;
+
+			if (WriteEntry (GetEntryFilename (hash), key_r, result_r, size))
+				{
+					Touch (hash, size);
+					Evict (pc_capacity);
+
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+Primer3CacheStats Primer3Cache :: GetStats () const
+{
+	std :: lock_guard <std :: mutex> lock (pc_mutex);
+	Primer3CacheStats stats;
+
+	stats.pcs_hits = pc_hits;
+	stats.pcs_misses = pc_misses;
+	stats.pcs_evictions = pc_evictions;
+	stats.pcs_num_entries = pc_entries.size ();
+	stats.pcs_size = pc_size;
+	stats.pcs_capacity = pc_capacity;
+
+	return stats;
+}
+
+
+std :: string Primer3Cache :: MakeKey (const Primer3Prefs *prefs_p, const Primer3Input &input_r)
+{
+	std :: string key (S_KEY_VERSION_S);
+	char buffer_s [256];
+
+	/* PRIMER_OPT_SIZE and PRIMER_MIN_SIZE are set from PRIMER_MAX_SIZE so they don't need adding */
+	snprintf (buffer_s, sizeof (buffer_s), "PRIMER_PRODUCT_SIZE_RANGE=" UINT32_FMT "-" UINT32_FMT "\nPRIMER_MAX_SIZE=" UINT32_FMT "\nPRIMER_LIB_AMBIGUITY_CODES_CONSENSUS=%d\nPRIMER_LIBERAL_BASE=%d\nPRIMER_NUM_RETURN=" UINT32_FMT "\n",
+		prefs_p -> pp_product_size_range_min, prefs_p -> pp_product_size_range_max, prefs_p -> pp_max_size,
+		prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0, prefs_p -> pp_liberal_base ? 1 : 0, prefs_p -> pp_num_return);
+	key.append (buffer_s);
+
+	if (prefs_p -> pp_thermodynamic_parameters_path_s)
+		{
+			key.append ("PRIMER_THERMODYNAMIC_PARAMETERS_PATH=");
+			key.append (prefs_p -> pp_thermodynamic_parameters_path_s);
+			key.push_back ('\n');
+		}
+
+	key.append ("SEQUENCE_TEMPLATE=");
+	key.append (input_r.pi_template);
+	key.push_back ('\n');
+
+	if (input_r.pi_force_left_end >= 0)
+		{
+			snprintf (buffer_s, sizeof (buffer_s), "SEQUENCE_FORCE_LEFT_END=%d\n", input_r.pi_force_left_end);
+			key.append (buffer_s);
+		}
+
+	if (input_r.pi_force_right_end >= 0)
+		{
+			snprintf (buffer_s, sizeof (buffer_s), "SEQUENCE_FORCE_RIGHT_END=%d\n", input_r.pi_force_right_end);
+			key.append (buffer_s);
+		}
+
+	return key;
+}
+
+
+Primer3Cache &Primer3Cache :: GetShared ()
+{
+	static Primer3Cache s_shared_cache;
+
+	return s_shared_cache;
+}
+
+
+/*
+ * Read the entries that are already in the directory, with the most
+ * recently modified at the front. The mutex must already be held.
+ */
+void Primer3Cache :: Load ()
+{
+	struct DiskEntry
+	{
+		struct timespec de_time;
+		std :: string de_hash;
+		size_t de_size;
+	};
+
+	std :: vector <DiskEntry> disk_entries;
+	DIR *dir_p = opendir (pc_directory.c_str ());
+
+	if (dir_p)
+		{
+			struct dirent *dir_entry_p;
+
+			while ((dir_entry_p = readdir (dir_p)) != NULL)
+				{
+					if (IsHash (dir_entry_p -> d_name, S_SUBDIRECTORY_LENGTH))
+						{
+							const std :: string subdirectory (pc_directory + '/' + dir_entry_p -> d_name);
+							DIR *subdir_p = opendir (subdirectory.c_str ());
+
+							if (subdir_p)
+								{
+									struct dirent *entry_p;
+
+									while ((entry_p = readdir (subdir_p)) != NULL)
+										{
+											const std :: string filename (subdirectory + '/' + entry_p -> d_name);
+											struct stat st;
+
+											if (IsHash (entry_p -> d_name, S_HASH_LENGTH))
+												{
+													if (stat (filename.c_str (), &st) == 0)
+														{
+															DiskEntry disk_entry;
+
+															disk_entry.de_time = st.st_mtim;
+															disk_entry.de_hash.assign (entry_p -> d_name);
+															disk_entry.de_size = GetFileSize (st);
+
+															disk_entries.push_back (disk_entry);
+														}
+												}
+											else if (strchr (entry_p -> d_name, '.') && (* (entry_p -> d_name) != '.'))
+												{
+													/* A temporary file left by a write that didn't finish */
+													unlink (filename.c_str ());
+												}
+										}
+
+									closedir (subdir_p);
+								}
+						}
+				}
+
+			closedir (dir_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read primer3 cache directory \"%s\", %s", pc_directory.c_str (), strerror (errno));
+		}
+
+	std :: sort (disk_entries.begin (), disk_entries.end (), [] (const DiskEntry &a_r, const DiskEntry &b_r)
+		{
+			if (a_r.de_time.tv_sec != b_r.de_time.tv_sec)
+				{
+					return (a_r.de_time.tv_sec > b_r.de_time.tv_sec);
+				}
+
+			return (a_r.de_time.tv_nsec > b_r.de_time.tv_nsec);
+		});
+
+	for (std :: vector <DiskEntry> :: const_iterator itr = disk_entries.begin (); itr != disk_entries.end (); ++ itr)
+		{
+			pc_entries.emplace_back (itr -> de_hash, itr -> de_size);
+			pc_index [itr -> de_hash] = std :: prev (pc_entries.end ());
+			pc_size += itr -> de_size;
+		}
+
+	Evict (pc_capacity);
+}
+
+
+/*
+ * Remove the least recently used entries until the rest fit in the given
+ * number of bytes. The mutex must already be held.
+ */
+void Primer3Cache :: Evict (size_t capacity)
+{
+	while ((pc_size > capacity) && (!pc_entries.empty ()))
+		{
+			const EntryList :: iterator last_itr = std :: prev (pc_entries.end ());
+			const std :: string filename (GetEntryFilename (last_itr -> first));
+
+			if ((unlink (filename.c_str ()) != 0) && (errno != ENOENT))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove primer3 cache entry \"%s\", %s", filename.c_str (), strerror (errno));
+				}
+
+			pc_size -= last_itr -> second;
+			pc_index.erase (last_itr -> first);
+			pc_entries.erase (last_itr);
+
+			++ pc_evictions;
+		}
+}
+
+
+/*
+ * Mark an entry as the most recently used, adding it if it isn't
+ * already known. The mutex must already be held.
+ */
+void Primer3Cache :: Touch (const std :: string &hash_r, size_t size)
+{
+	std :: unordered_map <std :: string, EntryList :: iterator> :: iterator itr = pc_index.find (hash_r);
+
+	if (itr != pc_index.end ())
+		{
+			pc_size -= itr -> second -> second;
+			itr -> second -> second = size;
+			pc_entries.splice (pc_entries.begin (), pc_entries, itr -> second);
+		}
+	else
+		{
+			pc_entries.emplace_front (hash_r, size);
+			pc_index [hash_r] = pc_entries.begin ();
+		}
+
+	pc_size += size;
+}
+
+
+std :: string Primer3Cache :: GetEntryFilename (const std :: string &hash_r) const
+{
+	std :: string filename (pc_directory);
+
+	filename.push_back ('/');
+	filename.append (hash_r, 0, S_SUBDIRECTORY_LENGTH);
+	filename.push_back ('/');
+	filename.append (hash_r);
+
+	return filename;
+}
+
+
+/*
+ * Read an entry, checking that it was stored for the given key rather
+ * than for another key with the same hash.
+ */
+bool Primer3Cache :: ReadEntry (const std :: string &filename_r, const std :: string &key_r, Primer3Result &result_r)
+{
+	bool success_flag = false;
+	FILE *in_f = fopen (filename_r.c_str (), "r");
+
+	if (in_f)
+		{
+			std :: string contents;
+			char buffer_s [4096];
+			size_t length;
+
+			while ((length = fread (buffer_s, 1, sizeof (buffer_s), in_f)) > 0)
+				{
+					contents.append (buffer_s, length);
+				}
+
+			if ((!ferror (in_f)) && (contents.compare (0, key_r.size (), key_r) == 0))
+				{
+					size_t start = key_r.size ();
+					size_t end;
+
+					result_r = Primer3Result ();
+
+					while ((!success_flag) && ((end = contents.find ('\n', start)) != std :: string :: npos))
+						{
+							const size_t sep = contents.find ('=', start);
+
+							if ((sep != std :: string :: npos) && (sep < end))
+								{
+									const std :: string tag (contents, start, sep - start);
+									const std :: string value (contents, sep + 1, end - sep - 1);
+
+									if (tag.empty ())
+										{
+											/* The record's terminator, so the whole entry was written */
+											success_flag = true;
+										}
+									else if (tag == "PRIMER_PAIR_NUM_RETURNED")
+										{
+											result_r.pr_num_returned = (uint32) strtoul (value.c_str (), NULL, 10);
+										}
+									else if (tag == "PRIMER_LEFT_0_SEQUENCE")
+										{
+											result_r.pr_left = value;
+										}
+									else if (tag == "PRIMER_RIGHT_0_SEQUENCE")
+										{
+											result_r.pr_right = value;
+										}
+									else if (tag == "PRIMER_LEFT_0_TM")
+										{
+											result_r.pr_left_tm = value;
+										}
+									else if (tag == "PRIMER_RIGHT_0_TM")
+										{
+											result_r.pr_right_tm = value;
+										}
+									else if (tag == "PRIMER_PAIR_0_PRODUCT_SIZE")
+										{
+											result_r.pr_product_size = value;
+										}
+									else if (tag == "PRIMER_ERROR")
+										{
+											result_r.pr_error = value;
+										}
+								}
+
+							start = end + 1;
+						}
+				}
+
+			fclose (in_f);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Write an entry to a temporary file and then move it into place so
+ * that a reader never sees a partly-written entry.
+ */
+bool Primer3Cache :: WriteEntry (const std :: string &filename_r, const std :: string &key_r, const Primer3Result &result_r, size_t &size_r)
+{
+	bool success_flag = false;
+	const std :: string subdirectory (filename_r, 0, filename_r.rfind ('/'));
+
+	if ((mkdir (subdirectory.c_str (), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == 0) || (errno == EEXIST))
+		{
+			std :: vector <char> temp_filename (filename_r.begin (), filename_r.end ());
+			const char * const suffix_s = ".XXXXXX";
+			int fd;
+
+			temp_filename.insert (temp_filename.end (), suffix_s, suffix_s + strlen (suffix_s) + 1);
+			fd = mkstemp (temp_filename.data ());
+
+			if (fd != -1)
+				{
+					FILE *out_f = fdopen (fd, "w");
+
+					if (out_f)
+						{
+							struct stat st;
+
+							fputs (key_r.c_str (), out_f);
+							fprintf (out_f, "PRIMER_PAIR_NUM_RETURNED=" UINT32_FMT "\n", result_r.pr_num_returned);
+
+							if (result_r.pr_num_returned > 0)
+								{
+									fprintf (out_f, "PRIMER_LEFT_0_SEQUENCE=%s\nPRIMER_RIGHT_0_SEQUENCE=%s\nPRIMER_LEFT_0_TM=%s\nPRIMER_RIGHT_0_TM=%s\nPRIMER_PAIR_0_PRODUCT_SIZE=%s\n",
+										result_r.pr_left.c_str (), result_r.pr_right.c_str (), result_r.pr_left_tm.c_str (), result_r.pr_right_tm.c_str (), result_r.pr_product_size.c_str ());
+								}
+
+							if (!result_r.pr_error.empty ())
+								{
+									fprintf (out_f, "PRIMER_ERROR=%s\n", result_r.pr_error.c_str ());
+								}
+
+							fputs ("=\n", out_f);
+
+							if ((fclose (out_f) == 0) && (stat (temp_filename.data (), &st) == 0))
+								{
+									if ((chmod (temp_filename.data (), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0) && (rename (temp_filename.data (), filename_r.c_str ()) == 0))
+										{
+											size_r = GetFileSize (st);
+											success_flag = true;
+										}
+								}
+						}
+					else
+						{
+							close (fd);
+						}
+
+					if (!success_flag)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write primer3 cache entry \"%s\", %s", filename_r.c_str (), strerror (errno));
+							unlink (temp_filename.data ());
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create temporary file for \"%s\", %s", filename_r.c_str (), strerror (errno));
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create primer3 cache directory \"%s\", %s", subdirectory.c_str (), strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The 128-bit FNV-1a hash of a key as hex digits, the same as is used
+ * for the shared job inputs.
+ */
+std :: string Primer3Cache :: GetHash (const std :: string &key_r)
+{
+	const unsigned __int128 prime = (((unsigned __int128) 0x0000000001000000ULL) << 64) | 0x000000000000013BULL;
+	unsigned __int128 hash = (((unsigned __int128) 0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL;
+	char hash_s [S_HASH_LENGTH + 1];
+
+	for (std :: string :: const_iterator itr = key_r.begin (); itr != key_r.end (); ++ itr)
+		{
+			hash ^= (unsigned char) *itr;
+			hash *= prime;
+		}
+
+	sprintf (hash_s, "%016llx%016llx", (unsigned long long) (hash >> 64), (unsigned long long) hash);
+
+	return std :: string (hash_s);
+}
+
+
+bool OpenSharedPrimer3Cache (const char *directory_s, size_t capacity)
+{
+	return Primer3Cache :: GetShared ().Open (directory_s, capacity);
+}
+
+
+bool AddSharedPrimer3CacheStatsToJSON (json_t *json_p)
+{
+	json_t *cache_json_p = json_object ();
+
+	if (cache_json_p)
+		{
+			const Primer3CacheStats stats = Primer3Cache :: GetShared ().GetStats ();
+
+			if ((json_object_set_new (cache_json_p, "hits", json_integer ((json_int_t) stats.pcs_hits)) == 0) &&
+					(json_object_set_new (cache_json_p, "misses", json_integer ((json_int_t) stats.pcs_misses)) == 0) &&
+					(json_object_set_new (cache_json_p, "evictions", json_integer ((json_int_t) stats.pcs_evictions)) == 0) &&
+					(json_object_set_new (cache_json_p, "entries", json_integer ((json_int_t) stats.pcs_num_entries)) == 0) &&
+					(json_object_set_new (cache_json_p, "size", json_integer ((json_int_t) stats.pcs_size)) == 0) &&
+					(json_object_set_new (cache_json_p, "capacity", json_integer ((json_int_t) stats.pcs_capacity)) == 0))
+				{
+					if (json_object_set_new (json_p, S_PRIMER3_CACHE_S, cache_json_p) == 0)
+						{
+							return true;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add the primer3 cache counters to JSON");
+				}
+
+			json_decref (cache_json_p);
+		}
+
+	return false;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static size_t GetFileSize (const struct stat &st_r)
+{
+	return ((size_t) st_r.st_blocks) * S_STAT_BLOCK_SIZE;
+}
+
+
+static bool IsHash (const char *name_s, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; ++ i)
+		{
+			if (!isxdigit ((unsigned char) name_s [i]))
+				{
+					return false;
+				}
+		}
+
+	return (name_s [length] == '\0');
+}
@@ -0,0 +1,314 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * primer3_engine.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "primer3_engine.hpp"
+
+#include "streams.h"
+
+#ifdef HAVE_LIBPRIMER3
+#include "libprimer3.h"
+#include "thal.h"
+#endif
+
+
+std :: mutex Primer3Engine :: pe_primer3_mutex;
+
+
+Primer3Engine :: Primer3Engine (const char *thermodynamic_parameters_path_s)
+	: pe_thermodynamic_parameters_path (GetDirectory (thermodynamic_parameters_path_s)),
+		pe_loaded_flag (false)
+{
+}
+
+
+Primer3Engine :: ~Primer3Engine ()
+{
+	#ifdef HAVE_LIBPRIMER3
+	if (pe_loaded_flag)
+		{
+			std :: lock_guard <std :: mutex> lock (pe_primer3_mutex);
+
+			destroy_thal_structures ();
+		}
+	#endif
+}
+
+
+const char *Primer3Engine :: GetThermodynamicParametersPath () const
+{
+	return pe_thermodynamic_parameters_path.c_str ();
+}
+
+
+bool Primer3Engine :: IsAvailable ()
+{
+	#ifdef HAVE_LIBPRIMER3
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+
+std :: shared_ptr <const Primer3Engine> Primer3Engine :: GetShared (const char *thermodynamic_parameters_path_s)
+{
+	static std :: mutex s_shared_mutex;
+	static std :: shared_ptr <const Primer3Engine> s_shared_engine;
+
+	std :: lock_guard <std :: mutex> lock (s_shared_mutex);
+
+	if ((! IsAvailable ()) || (! thermodynamic_parameters_path_s))
+		{
+			return std :: shared_ptr <const Primer3Engine> ();
+		}
+
+	if (s_shared_engine)
+		{
+			const std :: string path (GetDirectory (thermodynamic_parameters_path_s));
+
+			if (path == s_shared_engine -> GetThermodynamicParametersPath ())
+				{
+					return s_shared_engine;
+				}
+
+			/* The tables are global to primer3 so only one set can be loaded */
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "primer3's thermodynamic parameters have already been loaded from \"%s\" so \"%s\" can't be used", s_shared_engine -> GetThermodynamicParametersPath (), path.c_str ());
+		}
+	else
+		{
+			std :: shared_ptr <Primer3Engine> engine_p (new Primer3Engine (thermodynamic_parameters_path_s));
+
+			if (engine_p -> Load ())
+				{
+					s_shared_engine = engine_p;
+
+					PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Loaded primer3's thermodynamic parameters from \"%s\"", engine_p -> GetThermodynamicParametersPath ());
+
+					return s_shared_engine;
+				}
+		}
+
+	return std :: shared_ptr <const Primer3Engine> ();
+}
+
+
+/*
+ * primer3 expects the directory to end with a separator.
+ */
+std :: string Primer3Engine :: GetDirectory (const char *path_s)
+{
+	std :: string directory (path_s);
+
+	if (directory.empty () || (directory.back () != '/'))
+		{
+			directory.push_back ('/');
+		}
+
+	return directory;
+}
+
+
+#ifdef HAVE_LIBPRIMER3
+
+
+bool Primer3Engine :: Load ()
+{
+	std :: lock_guard <std :: mutex> lock (pe_primer3_mutex);
+	thal_parameters params;
+	thal_results results;
+
+	thal_set_null_parameters (&params);
+
+	if (thal_load_parameters (pe_thermodynamic_parameters_path.c_str (), &params, &results) != -1)
+		{
+			if (get_thermodynamic_values (&params, &results) == 0)
+				{
+					pe_loaded_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set primer3's thermodynamic parameters from \"%s\", %s", pe_thermodynamic_parameters_path.c_str (), results.msg);
+				}
+
+			thal_free_parameters (&params);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read primer3's thermodynamic parameters from \"%s\", %s", pe_thermodynamic_parameters_path.c_str (), results.msg);
+		}
+
+	return pe_loaded_flag;
+}
+
+
+bool Primer3Engine :: Design (const Primer3Prefs *prefs_p, const std :: vector <Primer3Input> &inputs_r, std :: vector <Primer3Result> &results_r) const
+{
+	bool success_flag = false;
+	p3_global_settings *settings_p = p3_create_global_settings ();
+
+	if (settings_p)
+		{
+			const int max_size = (int) (prefs_p -> pp_max_size);
+
+			/* The same settings that are written at the top of primer_3_input_temp */
+			settings_p -> pr_min [0] = (int) (prefs_p -> pp_product_size_range_min);
+			settings_p -> pr_max [0] = (int) (prefs_p -> pp_product_size_range_max);
+			settings_p -> num_intervals = 1;
+			settings_p -> p_args.max_size = max_size;
+
+			if (max_size < 20)
+				{
+					settings_p -> p_args.opt_size = max_size;
+					settings_p -> p_args.min_size = (max_size < 18) ? max_size : 18;
+				}
+
+			settings_p -> lib_ambiguity_codes_consensus = prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0;
+			settings_p -> liberal_base = prefs_p -> pp_liberal_base ? 1 : 0;
+			settings_p -> num_return = (int) (prefs_p -> pp_num_return);
+
+			success_flag = true;
+
+			for (std :: vector <Primer3Input> :: const_iterator itr = inputs_r.begin (); success_flag && (itr != inputs_r.end ()); ++ itr)
+				{
+					seq_args *args_p = create_seq_arg ();
+
+					if (args_p)
+						{
+							Primer3Result result;
+
+							result.pr_id = itr -> pi_id;
+
+							p3_set_sa_sequence_name (args_p, itr -> pi_id.c_str ());
+							p3_set_sa_sequence (args_p, itr -> pi_template.c_str ());
+
+							if (itr -> pi_force_left_end >= 0)
+								{
+									args_p -> force_left_end = itr -> pi_force_left_end;
+								}
+
+							if (itr -> pi_force_right_end >= 0)
+								{
+									args_p -> force_right_end = itr -> pi_force_right_end;
+								}
+
+							std :: lock_guard <std :: mutex> lock (pe_primer3_mutex);
+							p3retval *retval_p = choose_primers (settings_p, args_p);
+
+							if (retval_p)
+								{
+									if (retval_p -> glob_err.data)
+										{
+											result.pr_error = retval_p -> glob_err.data;
+										}
+
+									if (retval_p -> per_sequence_err.data)
+										{
+											if (! result.pr_error.empty ())
+												{
+													result.pr_error.push_back (';');
+												}
+
+											result.pr_error.append (retval_p -> per_sequence_err.data);
+										}
+
+									result.pr_num_returned = (uint32) (retval_p -> best_pairs.num_pairs);
+
+									if (result.pr_num_returned > 0)
+										{
+											const primer_pair *pair_p = retval_p -> best_pairs.pairs;
+											char buffer_s [32];
+
+											/* pr_oligo_sequence uses a static buffer so each one is copied straight away */
+											result.pr_left = pr_oligo_sequence (args_p, pair_p -> left);
+											result.pr_right = pr_oligo_rev_c_sequence (args_p, pair_p -> right);
+
+											/* These are formatted as primer3_core writes them */
+											snprintf (buffer_s, sizeof (buffer_s), "%.3f", pair_p -> left -> temp);
+											result.pr_left_tm = buffer_s;
+
+											snprintf (buffer_s, sizeof (buffer_s), "%.3f", pair_p -> right -> temp);
+											result.pr_right_tm = buffer_s;
+
+											result.pr_product_size = std :: to_string (pair_p -> product_size);
+										}
+
+									destroy_p3retval (retval_p);
+
+									results_r.push_back (result);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "primer3 failed for \"%s\"", itr -> pi_id.c_str ());
+									success_flag = false;
+								}
+
+							destroy_seq_args (args_p);
+						}
+					else
+						{
+							success_flag = false;
+						}
+				}
+
+			p3_destroy_global_settings (settings_p);
+		}
+
+	return success_flag;
+}
+
+
+#else
+
+
+bool Primer3Engine :: Load ()
+{
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The service was built without primer3 as a library");
+
+	return false;
+}
+
+
+bool Primer3Engine :: Design (const Primer3Prefs * UNUSED_PARAM (prefs_p), const std :: vector <Primer3Input> & UNUSED_PARAM (inputs_r), std :: vector <Primer3Result> & UNUSED_PARAM (results_r)) const
+{
+	return false;
+}
+
+
+#endif		/* #ifdef HAVE_LIBPRIMER3 */
+
+
+bool LoadSharedPrimer3Engine (const char *thermodynamic_parameters_path_s)
+{
+	return (Primer3Engine :: GetShared (thermodynamic_parameters_path_s) != 0);
+}
+
+
+bool IsPrimer3LibraryAvailable (void)
+{
+	return Primer3Engine :: IsAvailable ();
+}
@@ -105,42 +105,7 @@ char *SavePrimer3Prefs (Primer3Prefs *prefs_p, const char *path_s)
 
 			if (out_f)
 				{
-					char *range_s = GetProductSizeRangeAsString (prefs_p -> pp_product_size_range_min, prefs_p -> pp_product_size_range_max);
-
-					if (range_s)
-						{
-							if (WriteKeyValuePairForString ("primer_product_size_range", range_s, out_f))
-								{
-									if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f))
-										{
-											if (WriteKeyValuePairForUnsignedInt ("primer_lib_ambiguity_codes_consensus", prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0, out_f))
-												{
-													if (WriteKeyValuePairForUnsignedInt ("primer_liberal_base", prefs_p -> pp_liberal_base ? 1 : 0, out_f))
-														{
-															if (WriteKeyValuePairForUnsignedInt ("primer_num_return", prefs_p -> pp_num_return, out_f))
-																{
-																	if (WriteKeyValuePairForUnsignedInt ("primer_explain_flag", prefs_p -> pp_explain_flag ? 1 : 0, out_f))
-																		{
-																			if (WriteKeyValuePairForString ("primer_thermodynamic_parameters_path", prefs_p -> pp_thermodynamic_parameters_path_s, out_f))
-																				{
-																					success_flag = true;
-																				}		/* if (WriteKeyValuePairForString ("primer_max_size", primer_config_path_s, out_f)) */
-
-																		}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_explain_flag ? 1 : 0, out_f)) */
-
-																}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
-
-														}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
-
-												}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
-
-										}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
-
-								}		/* if (WriteKeyValuePairForString ("primer_product_size_range", range_s, out_f)) */
-
-							FreeCopiedString (range_s);
-						}		/* if (range_s) */
-
+					success_flag = WritePrimer3Prefs (prefs_p, out_f);
 
 					if (fclose (out_f) != 0)
 						{
@@ -161,6 +126,49 @@ char *SavePrimer3Prefs (Primer3Prefs *prefs_p, const char *path_s)
 }
 
 
+bool WritePrimer3Prefs (const Primer3Prefs *prefs_p, FILE *out_f)
+{
+	bool success_flag = false;
+	char *range_s = GetProductSizeRangeAsString (prefs_p -> pp_product_size_range_min, prefs_p -> pp_product_size_range_max);
+
+	if (range_s)
+		{
+			if (WriteKeyValuePairForString ("primer_product_size_range", range_s, out_f))
+				{
+					if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f))
+						{
+							if (WriteKeyValuePairForUnsignedInt ("primer_lib_ambiguity_codes_consensus", prefs_p -> pp_lib_ambiguity_codes_consensus ? 1 : 0, out_f))
+								{
+									if (WriteKeyValuePairForUnsignedInt ("primer_liberal_base", prefs_p -> pp_liberal_base ? 1 : 0, out_f))
+										{
+											if (WriteKeyValuePairForUnsignedInt ("primer_num_return", prefs_p -> pp_num_return, out_f))
+												{
+													if (WriteKeyValuePairForUnsignedInt ("primer_explain_flag", prefs_p -> pp_explain_flag ? 1 : 0, out_f))
+														{
+															if (WriteKeyValuePairForString ("primer_thermodynamic_parameters_path", prefs_p -> pp_thermodynamic_parameters_path_s, out_f))
+																{
+																	success_flag = true;
+																}		/* if (WriteKeyValuePairForString ("primer_max_size", primer_config_path_s, out_f)) */
+
+														}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_explain_flag ? 1 : 0, out_f)) */
+
+												}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
+
+										}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
+
+								}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
+
+						}		/* if (WriteKeyValuePairForUnsignedInt ("primer_max_size", prefs_p -> pp_max_size, out_f)) */
+
+				}		/* if (WriteKeyValuePairForString ("primer_product_size_range", range_s, out_f)) */
+
+			FreeCopiedString (range_s);
+		}		/* if (range_s) */
+
+	return success_flag;
+}
+
+
 bool AddPrimer3PrefsParameters (ParameterSet *params_p, PolymarkerServiceData *data_p)
 {
 	bool success_flag = false;
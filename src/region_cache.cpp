@@ -0,0 +1,229 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * region_cache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "region_cache.hpp"
+
+#include "streams.h"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const char * const S_REGION_CACHE_S = "region_cache";
+
+/* An estimate of the bytes used by the list node, hash table node and string headers of each entry */
+static const size_t S_ENTRY_OVERHEAD = 160;
+
+/* Regions larger than this fraction of the capacity aren't cached */
+static const size_t S_MAX_ENTRY_FRACTION = 8;
+
+
+/*
+ * API DEFINITIONS
+ */
+
+RegionCache :: RegionCache ()
+	: rc_capacity (0),
+		rc_size (0),
+		rc_hits (0),
+		rc_misses (0),
+		rc_evictions (0)
+{
+}
+
+
+void RegionCache :: SetCapacity (size_t capacity)
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+
+	rc_capacity = capacity;
+	Evict (capacity);
+}
+
+
+bool RegionCache :: IsEnabled () const
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+
+	return (rc_capacity > 0);
+}
+
+
+bool RegionCache :: CanStore (size_t length) const
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+
+	return (length <= rc_capacity / S_MAX_ENTRY_FRACTION);
+}
+
+
+std :: shared_ptr <const std :: string> RegionCache :: Get (const std :: string &key_r)
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+	std :: unordered_map <std :: string, EntryList :: iterator> :: iterator itr = rc_index.find (key_r);
+
+	if (itr != rc_index.end ())
+		{
+			++ rc_hits;
+			rc_entries.splice (rc_entries.begin (), rc_entries, itr -> second);
+
+			return itr -> second -> second;
+		}
+
+	++ rc_misses;
+
+	return std :: shared_ptr <const std :: string> ();
+}
+
+
+std :: shared_ptr <const std :: string> RegionCache :: Put (const std :: string &key_r, const std :: shared_ptr <const std :: string> &seq_p)
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+	std :: unordered_map <std :: string, EntryList :: iterator> :: iterator itr = rc_index.find (key_r);
+	const size_t entry_size = GetEntrySize (key_r, *seq_p);
+
+	if (itr != rc_index.end ())
+		{
+			rc_entries.splice (rc_entries.begin (), rc_entries, itr -> second);
+
+			return itr -> second -> second;
+		}
+
+	if (entry_size <= rc_capacity / S_MAX_ENTRY_FRACTION)
+		{
+			Evict (rc_capacity - entry_size);
+
+			rc_entries.emplace_front (key_r, seq_p);
+			rc_index [key_r] = rc_entries.begin ();
+			rc_size += entry_size;
+		}
+
+	return seq_p;
+}
+
+
+RegionCacheStats RegionCache :: GetStats () const
+{
+	std :: lock_guard <std :: mutex> lock (rc_mutex);
+	RegionCacheStats stats;
+
+	stats.rcs_hits = rc_hits;
+	stats.rcs_misses = rc_misses;
+	stats.rcs_evictions = rc_evictions;
+	stats.rcs_num_entries = rc_entries.size ();
+	stats.rcs_size = rc_size;
+	stats.rcs_capacity = rc_capacity;
+
+	return stats;
+}
+
+
+std :: string RegionCache :: MakeKey (const char *database_s, const std :: string &contig_r, uint64 start, uint64 end)
+{
+	std :: string key (database_s);
+
+	/* Neither filenames nor contig names can contain a nul */
+	key.push_back ('\0');
+	key.append (contig_r);
+	key.push_back ('\0');
+	key.append (std :: to_string (start));
+	key.push_back ('-');
+	key.append (std :: to_string (end));
+
+	return key;
+}
+
+
+RegionCache &RegionCache :: GetShared ()
+{
+	static RegionCache s_shared_cache;
+
+	return s_shared_cache;
+}
+
+
+/*
+ * Remove the least recently used entries until the rest fit in the given
+ * number of bytes. The mutex must already be held.
+ */
+void RegionCache :: Evict (size_t capacity)
+{
+	while ((rc_size > capacity) && (!rc_entries.empty ()))
+		{
+			const EntryList :: iterator last_itr = std :: prev (rc_entries.end ());
+
+			rc_size -= GetEntrySize (last_itr -> first, * (last_itr -> second));
+			rc_index.erase (last_itr -> first);
+			rc_entries.erase (last_itr);
+
+			++ rc_evictions;
+		}
+}
+
+
+size_t RegionCache :: GetEntrySize (const std :: string &key_r, const std :: string &seq_r)
+{
+	/* The key is stored in both the list and the index */
+	return seq_r.size () + 2 * key_r.size () + S_ENTRY_OVERHEAD;
+}
+
+
+void SetSharedRegionCacheCapacity (size_t capacity)
+{
+	RegionCache :: GetShared ().SetCapacity (capacity);
+}
+
+
+bool AddSharedRegionCacheStatsToJSON (json_t *json_p)
+{
+	json_t *cache_json_p = json_object ();
+
+	if (cache_json_p)
+		{
+			const RegionCacheStats stats = RegionCache :: GetShared ().GetStats ();
+
+			if ((json_object_set_new (cache_json_p, "hits", json_integer ((json_int_t) stats.rcs_hits)) == 0) &&
+					(json_object_set_new (cache_json_p, "misses", json_integer ((json_int_t) stats.rcs_misses)) == 0) &&
+					(json_object_set_new (cache_json_p, "evictions", json_integer ((json_int_t) stats.rcs_evictions)) == 0) &&
+					(json_object_set_new (cache_json_p, "entries", json_integer ((json_int_t) stats.rcs_num_entries)) == 0) &&
+					(json_object_set_new (cache_json_p, "size", json_integer ((json_int_t) stats.rcs_size)) == 0) &&
+					(json_object_set_new (cache_json_p, "capacity", json_integer ((json_int_t) stats.rcs_capacity)) == 0))
+				{
+					if (json_object_set_new (json_p, S_REGION_CACHE_S, cache_json_p) == 0)
+						{
+							return true;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add the region cache counters to JSON");
+				}
+
+			json_decref (cache_json_p);
+		}
+
+	return false;
+}
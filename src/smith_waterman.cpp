@@ -0,0 +1,506 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * smith_waterman.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include <algorithm>
+
+#include "smith_waterman.hpp"
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+/* The width of the widest vector kernel, which all of the arrays are padded by */
+static const uint32 S_MAX_WIDTH = 16;
+
+/* The 16-bit kernels are only used when no score, count or length can overflow */
+static const uint32 S_MAX_NARROW_VALUE = 16000;
+
+/* Each traceback move holds where the H score came from and whether E and F were extended */
+static const uint8 S_MOVE_ZERO = 0;
+static const uint8 S_MOVE_DIAGONAL = 1;
+static const uint8 S_MOVE_E = 2;
+static const uint8 S_MOVE_F = 3;
+static const uint8 S_MOVE_H_MASK = 3;
+static const uint8 S_MOVE_E_EXTENDED = 4;
+static const uint8 S_MOVE_F_EXTENDED = 8;
+
+
+typedef void (*SmithWatermanKernel) (const SmithWatermanInput *input_p, SmithWatermanScore *score_p);
+
+
+struct SmithWatermanKernelChoice
+{
+	SmithWatermanKernel swkc_kernel_fn;
+	const char *swkc_name_s;
+};
+
+
+/*
+ * The scalar scoring pass, which is used when the CPU has no suitable
+ * vector instructions or the values would not fit in 16 bits.
+ */
+struct ScalarOps
+{
+	typedef int32 Element;
+	typedef int32 Vector;
+
+	static const uint32 WIDTH = 1;
+	static const int32 NEGATIVE = -(1 << 29);
+
+	static inline Vector Load (const int32 *p_p) { return *p_p; }
+	static inline void Store (int32 *p_p, Vector v) { *p_p = v; }
+	static inline Vector Set (int32 x) { return x; }
+	static inline Vector Add (Vector a, Vector b) { return a + b; }
+	static inline Vector AddSaturated (Vector a, Vector b) { return a + b; }
+	static inline Vector SubtractSaturated (Vector a, Vector b) { return a - b; }
+	static inline Vector Max (Vector a, Vector b) { return (a > b) ? a : b; }
+	static inline Vector Equal (Vector a, Vector b) { return (a == b) ? -1 : 0; }
+	static inline Vector Greater (Vector a, Vector b) { return (a > b) ? -1 : 0; }
+	static inline Vector And (Vector a, Vector b) { return a & b; }
+	static inline Vector Or (Vector a, Vector b) { return a | b; }
+	static inline Vector Select (Vector mask, Vector a, Vector b) { return mask ? a : b; }
+	static inline bool Any (Vector mask) { return (mask != 0); }
+};
+
+
+static void ScoreSmithWatermanScalar (const SmithWatermanInput *input_p, SmithWatermanScore *score_p);
+
+static const SmithWatermanKernelChoice &GetKernel ();
+
+static int32 GetBaseCode (const char c, const int32 unknown);
+
+
+/*
+ * API DEFINITIONS
+ */
+
+SmithWatermanParameters :: SmithWatermanParameters ()
+	: swp_match (5),
+		swp_mismatch (4),
+		swp_gap_open (12),
+		swp_gap_extend (4),
+		swp_min_score (100),
+		swp_min_identity (0.0)
+{
+}
+
+
+SmithWatermanAligner :: SmithWatermanAligner (const SmithWatermanParameters &params_r)
+	: swa_params (params_r),
+		swa_query_length (0),
+		swa_target_length (0)
+{
+	/* Choose the kernel now rather than during the first alignment */
+	GetKernel ();
+}
+
+
+const char *SmithWatermanAligner :: GetKernelName ()
+{
+	return GetKernel ().swkc_name_s;
+}
+
+
+void SmithWatermanAligner :: SetQuery (const char *query_s, size_t query_length)
+{
+	swa_query_length = (uint32) query_length;
+
+	swa_wide_query_codes.assign (swa_query_length + 1 + S_MAX_WIDTH, SW_QUERY_PADDING);
+
+	for (uint32 i = 0; i < swa_query_length; ++ i)
+		{
+			swa_wide_query_codes [i + 1] = GetBaseCode (query_s [i], SW_QUERY_UNKNOWN);
+		}
+
+	swa_query_codes.assign (swa_wide_query_codes.begin (), swa_wide_query_codes.end ());
+}
+
+
+bool SmithWatermanAligner :: Align (const char *target_s, size_t target_length, bool reverse_flag, SmithWatermanAlignment &alignment_r)
+{
+	SmithWatermanScore score;
+
+	if ((swa_query_length == 0) || (target_length == 0) || (target_length > INT32_MAX - 2 * (size_t) swa_query_length - S_MAX_WIDTH))
+		{
+			return false;
+		}
+
+	EncodeTarget (target_s, target_length, reverse_flag);
+
+	if (Score (score))
+		{
+			/* Reject the alignment before doing any traceback if it can't be kept */
+			if ((score.sws_score >= swa_params.swp_min_score) && (score.sws_length > 0) && ((100.0 * score.sws_matches) / score.sws_length > swa_params.swp_min_identity))
+				{
+					return TraceBack (score, alignment_r);
+				}
+		}
+
+	return false;
+}
+
+
+/*
+ * The target is stored reversed, with padding on both sides, so that
+ * the target positions along each anti-diagonal are consecutive.
+ */
+void SmithWatermanAligner :: EncodeTarget (const char *target_s, size_t target_length, bool reverse_flag)
+{
+	const uint32 qlen = swa_query_length;
+	const uint32 tlen = (uint32) target_length;
+
+	swa_target_length = tlen;
+	swa_wide_target_codes.assign (2 * qlen + tlen + S_MAX_WIDTH, SW_TARGET_PADDING);
+
+	for (uint32 j = 1; j <= tlen; ++ j)
+		{
+			int32 code;
+
+			if (reverse_flag)
+				{
+					code = GetBaseCode (target_s [tlen - j], SW_TARGET_UNKNOWN);
+
+					if (code < SW_QUERY_UNKNOWN)
+						{
+							code = 3 - code;
+						}
+				}
+			else
+				{
+					code = GetBaseCode (target_s [j - 1], SW_TARGET_UNKNOWN);
+				}
+
+			swa_wide_target_codes [qlen + tlen - j] = code;
+		}
+}
+
+
+bool SmithWatermanAligner :: Score (SmithWatermanScore &score_r)
+{
+	const SmithWatermanKernelChoice &kernel_r = GetKernel ();
+	const uint32 stride = swa_query_length + 1 + S_MAX_WIDTH;
+	SmithWatermanInput input;
+
+	input.swi_query_length = swa_query_length;
+	input.swi_target_length = swa_target_length;
+	input.swi_stride = stride;
+	input.swi_match = swa_params.swp_match;
+	input.swi_mismatch = swa_params.swp_mismatch;
+	input.swi_gap_open = swa_params.swp_gap_open;
+	input.swi_gap_extend = swa_params.swp_gap_extend;
+
+	if ((kernel_r.swkc_kernel_fn != ScoreSmithWatermanScalar) &&
+		(swa_query_length + swa_target_length < S_MAX_NARROW_VALUE) &&
+		((uint32) swa_params.swp_match * swa_query_length < S_MAX_NARROW_VALUE) &&
+		((uint32) (swa_params.swp_mismatch + swa_params.swp_gap_open + swa_params.swp_gap_extend) < S_MAX_NARROW_VALUE))
+		{
+			swa_target_codes.assign (swa_wide_target_codes.begin (), swa_wide_target_codes.end ());
+			swa_buffers.resize (SW_NUM_BUFFERS * stride);
+
+			input.swi_query_p = swa_query_codes.data ();
+			input.swi_target_p = swa_target_codes.data ();
+			input.swi_buffers_p = swa_buffers.data ();
+
+			kernel_r.swkc_kernel_fn (&input, &score_r);
+		}
+	else
+		{
+			swa_wide_buffers.resize (SW_NUM_BUFFERS * stride);
+
+			input.swi_query_p = swa_wide_query_codes.data ();
+			input.swi_target_p = swa_wide_target_codes.data ();
+			input.swi_buffers_p = swa_wide_buffers.data ();
+
+			ScoreSmithWatermanScalar (&input, &score_r);
+		}
+
+	return (score_r.sws_score > 0);
+}
+
+
+/*
+ * The alignment can't be longer than the path that the scoring pass
+ * found for it, so the traceback only needs to fill in the square of
+ * that size that ends at the best cell. The same recurrence and order
+ * of preference are used as in the scoring pass.
+ */
+bool SmithWatermanAligner :: TraceBack (const SmithWatermanScore &score_r, SmithWatermanAlignment &alignment_r)
+{
+	const uint32 query_end = score_r.sws_query_end;
+	const uint32 target_end = score_r.sws_target_end;
+	const uint32 query_begin = (query_end > score_r.sws_length) ? query_end - score_r.sws_length + 1 : 1;
+	const uint32 target_begin = (target_end > score_r.sws_length) ? target_end - score_r.sws_length + 1 : 1;
+	const uint32 num_rows = query_end - query_begin + 1;
+	const uint32 num_cols = target_end - target_begin + 1;
+	const int32 negative = ScalarOps :: NEGATIVE;
+	const int32 *query_codes_p = swa_wide_query_codes.data ();
+	const int32 *target_codes_p = swa_wide_target_codes.data () + swa_query_length + swa_target_length;
+	int32 *h_p;
+	int32 *f_p;
+	std :: string ops;
+	uint32 i;
+	uint32 j;
+	uint8 state = S_MOVE_DIAGONAL;
+	uint32 matches = 0;
+
+	/* The H and F scores of the row above, with a boundary column at 0 */
+	swa_traceback_scores.assign (2 * (num_cols + 1), 0);
+	h_p = swa_traceback_scores.data ();
+	f_p = h_p + num_cols + 1;
+	std :: fill (f_p, f_p + num_cols + 1, negative);
+
+	swa_traceback_moves.resize ((size_t) num_rows * num_cols);
+
+	for (i = 1; i <= num_rows; ++ i)
+		{
+			const int32 q = query_codes_p [query_begin + i - 1];
+			uint8 *moves_p = swa_traceback_moves.data () + (size_t) (i - 1) * num_cols;
+			int32 diagonal = 0;
+			int32 left = 0;
+			int32 e = negative;
+
+			for (j = 1; j <= num_cols; ++ j)
+				{
+					const int32 t = * (target_codes_p - (target_begin + j - 1));
+					const int32 e_open = left - swa_params.swp_gap_open;
+					const int32 e_extend = e - swa_params.swp_gap_extend;
+					const int32 f_open = h_p [j] - swa_params.swp_gap_open;
+					const int32 f_extend = f_p [j] - swa_params.swp_gap_extend;
+					uint8 move = S_MOVE_DIAGONAL;
+					int32 h = diagonal + ((q == t) ? swa_params.swp_match : - swa_params.swp_mismatch);
+
+					if (e_extend > e_open)
+						{
+							e = e_extend;
+							move |= S_MOVE_E_EXTENDED;
+						}
+					else
+						{
+							e = e_open;
+						}
+
+					if (f_extend > f_open)
+						{
+							f_p [j] = f_extend;
+							move |= S_MOVE_F_EXTENDED;
+						}
+					else
+						{
+							f_p [j] = f_open;
+						}
+
+					if (e > h)
+						{
+							h = e;
+							move = (move & ~S_MOVE_H_MASK) | S_MOVE_E;
+						}
+
+					if (f_p [j] > h)
+						{
+							h = f_p [j];
+							move = (move & ~S_MOVE_H_MASK) | S_MOVE_F;
+						}
+
+					if (h < 1)
+						{
+							h = 0;
+							move &= ~S_MOVE_H_MASK;
+						}
+
+					diagonal = h_p [j];
+					h_p [j] = h;
+					left = h;
+					moves_p [j - 1] = move;
+				}
+		}
+
+	if (h_p [num_cols] != score_r.sws_score)
+		{
+			return false;
+		}
+
+	/* Follow the moves back from the best cell */
+	i = num_rows;
+	j = num_cols;
+
+	while ((i > 0) && (j > 0))
+		{
+			const uint8 move = swa_traceback_moves [(size_t) (i - 1) * num_cols + (j - 1)];
+
+			if (state == S_MOVE_DIAGONAL)
+				{
+					state = move & S_MOVE_H_MASK;
+
+					if (state == S_MOVE_ZERO)
+						{
+							break;
+						}
+					else if (state == S_MOVE_DIAGONAL)
+						{
+							if (query_codes_p [query_begin + i - 1] == * (target_codes_p - (target_begin + j - 1)))
+								{
+									++ matches;
+								}
+
+							ops.push_back ('M');
+							-- i;
+							-- j;
+						}
+				}
+			else if (state == S_MOVE_E)
+				{
+					ops.push_back ('D');
+
+					if (! (move & S_MOVE_E_EXTENDED))
+						{
+							state = S_MOVE_DIAGONAL;
+						}
+
+					-- j;
+				}
+			else
+				{
+					ops.push_back ('I');
+
+					if (! (move & S_MOVE_F_EXTENDED))
+						{
+							state = S_MOVE_DIAGONAL;
+						}
+
+					-- i;
+				}
+		}
+
+	if (ops.empty ())
+		{
+			return false;
+		}
+
+	std :: reverse (ops.begin (), ops.end ());
+
+	alignment_r.swa_score = score_r.sws_score;
+	alignment_r.swa_query_start = query_begin + i - 1;
+	alignment_r.swa_query_end = query_end;
+	alignment_r.swa_target_start = target_begin + j - 1;
+	alignment_r.swa_target_end = target_end;
+	alignment_r.swa_matches = matches;
+	alignment_r.swa_length = (uint32) ops.size ();
+	alignment_r.swa_identity = (100.0 * matches) / ops.size ();
+	alignment_r.swa_cigar.clear ();
+	alignment_r.swa_vulgar.clear ();
+
+	for (size_t k = 0; k < ops.size (); )
+		{
+			const char op = ops [k];
+			size_t n = 1;
+			std :: string count;
+
+			while ((k + n < ops.size ()) && (ops [k + n] == op))
+				{
+					++ n;
+				}
+
+			count = std :: to_string (n);
+
+			alignment_r.swa_cigar.append (count);
+			alignment_r.swa_cigar.push_back (op);
+
+			if (!alignment_r.swa_vulgar.empty ())
+				{
+					alignment_r.swa_vulgar.push_back (' ');
+				}
+
+			switch (op)
+				{
+					case 'M':
+						alignment_r.swa_vulgar.append ("M " + count + " " + count);
+						break;
+
+					case 'I':
+						alignment_r.swa_vulgar.append ("G " + count + " 0");
+						break;
+
+					default:
+						alignment_r.swa_vulgar.append ("G 0 " + count);
+						break;
+				}
+
+			k += n;
+		}
+
+	return (alignment_r.swa_identity > swa_params.swp_min_identity);
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static void ScoreSmithWatermanScalar (const SmithWatermanInput *input_p, SmithWatermanScore *score_p)
+{
+	ScoreSmithWatermanKernel <ScalarOps> (input_p, score_p);
+}
+
+
+static const SmithWatermanKernelChoice &GetKernel ()
+{
+	static const SmithWatermanKernelChoice choice = [] ()
+		{
+			SmithWatermanKernelChoice c = { ScoreSmithWatermanScalar, "scalar" };
+
+			#ifdef SW_HAVE_X86_KERNELS
+			__builtin_cpu_init ();
+
+			if (__builtin_cpu_supports ("avx2"))
+				{
+					c.swkc_kernel_fn = ScoreSmithWatermanAVX2;
+					c.swkc_name_s = "avx2";
+				}
+			else if (__builtin_cpu_supports ("sse4.1"))
+				{
+					c.swkc_kernel_fn = ScoreSmithWatermanSSE41;
+					c.swkc_name_s = "sse4.1";
+				}
+			#endif
+
+			return c;
+		} ();
+
+	return choice;
+}
+
+
+static int32 GetBaseCode (const char c, const int32 unknown)
+{
+	switch (c)
+		{
+			case 'A': case 'a': return 0;
+			case 'C': case 'c': return 1;
+			case 'G': case 'g': return 2;
+			case 'T': case 't': return 3;
+			default: return unknown;
+		}
+}
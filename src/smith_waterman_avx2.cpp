@@ -0,0 +1,76 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * smith_waterman_avx2.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "typedefs.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+
+#include <immintrin.h>
+
+/*
+ * Everything from here on is compiled for AVX2. The aligner only calls
+ * into this file once it has checked that the CPU supports it.
+ */
+#pragma GCC target ("avx2")
+
+#include "smith_waterman_kernel.hpp"
+
+
+namespace
+{
+	struct AVX2Ops
+	{
+		typedef int16 Element;
+		typedef __m256i Vector;
+
+		static const uint32 WIDTH = 16;
+		static const int16 NEGATIVE = -16384;
+
+		static inline Vector Load (const int16 *p_p) { return _mm256_loadu_si256 ((const __m256i *) p_p); }
+		static inline void Store (int16 *p_p, Vector v) { _mm256_storeu_si256 ((__m256i *) p_p, v); }
+		static inline Vector Set (int16 x) { return _mm256_set1_epi16 (x); }
+		static inline Vector Add (Vector a, Vector b) { return _mm256_add_epi16 (a, b); }
+		static inline Vector AddSaturated (Vector a, Vector b) { return _mm256_adds_epi16 (a, b); }
+		static inline Vector SubtractSaturated (Vector a, Vector b) { return _mm256_subs_epi16 (a, b); }
+		static inline Vector Max (Vector a, Vector b) { return _mm256_max_epi16 (a, b); }
+		static inline Vector Equal (Vector a, Vector b) { return _mm256_cmpeq_epi16 (a, b); }
+		static inline Vector Greater (Vector a, Vector b) { return _mm256_cmpgt_epi16 (a, b); }
+		static inline Vector And (Vector a, Vector b) { return _mm256_and_si256 (a, b); }
+		static inline Vector Or (Vector a, Vector b) { return _mm256_or_si256 (a, b); }
+
+		/* mask_v ? a : b for each lane */
+		static inline Vector Select (Vector mask_v, Vector a, Vector b) { return _mm256_blendv_epi8 (b, a, mask_v); }
+
+		static inline bool Any (Vector mask_v) { return (_mm256_movemask_epi8 (mask_v) != 0); }
+	};
+}
+
+
+void ScoreSmithWatermanAVX2 (const SmithWatermanInput *input_p, SmithWatermanScore *score_p)
+{
+	ScoreSmithWatermanKernel <AVX2Ops> (input_p, score_p);
+}
+
+#endif
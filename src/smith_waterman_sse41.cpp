@@ -0,0 +1,76 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * smith_waterman_sse41.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief
+ */
+
+#include "typedefs.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+
+#include <smmintrin.h>
+
+/*
+ * Everything from here on is compiled for SSE4.1. The aligner only calls
+ * into this file once it has checked that the CPU supports it.
+ */
+#pragma GCC target ("sse4.1")
+
+#include "smith_waterman_kernel.hpp"
+
+
+namespace
+{
+	struct SSE41Ops
+	{
+		typedef int16 Element;
+		typedef __m128i Vector;
+
+		static const uint32 WIDTH = 8;
+		static const int16 NEGATIVE = -16384;
+
+		static inline Vector Load (const int16 *p_p) { return _mm_loadu_si128 ((const __m128i *) p_p); }
+		static inline void Store (int16 *p_p, Vector v) { _mm_storeu_si128 ((__m128i *) p_p, v); }
+		static inline Vector Set (int16 x) { return _mm_set1_epi16 (x); }
+		static inline Vector Add (Vector a, Vector b) { return _mm_add_epi16 (a, b); }
+		static inline Vector AddSaturated (Vector a, Vector b) { return _mm_adds_epi16 (a, b); }
+		static inline Vector SubtractSaturated (Vector a, Vector b) { return _mm_subs_epi16 (a, b); }
+		static inline Vector Max (Vector a, Vector b) { return _mm_max_epi16 (a, b); }
+		static inline Vector Equal (Vector a, Vector b) { return _mm_cmpeq_epi16 (a, b); }
+		static inline Vector Greater (Vector a, Vector b) { return _mm_cmpgt_epi16 (a, b); }
+		static inline Vector And (Vector a, Vector b) { return _mm_and_si128 (a, b); }
+		static inline Vector Or (Vector a, Vector b) { return _mm_or_si128 (a, b); }
+
+		/* mask_v ? a : b for each lane */
+		static inline Vector Select (Vector mask_v, Vector a, Vector b) { return _mm_blendv_epi8 (b, a, mask_v); }
+
+		static inline bool Any (Vector mask_v) { return (_mm_movemask_epi8 (mask_v) != 0); }
+	};
+}
+
+
+void ScoreSmithWatermanSSE41 (const SmithWatermanInput *input_p, SmithWatermanScore *score_p)
+{
+	ScoreSmithWatermanKernel <SSE41Ops> (input_p, score_p);
+}
+
+#endif
@@ -0,0 +1,604 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_build_homoeologs.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Build a homoeolog index from a minimizer index.
+ *
+ * Usage: polymarker_build_homoeologs <minimizer index> <output file> <arm selection> [min shared]
+ *
+ * The arm of each contig is worked out from its name, using any of the
+ * rules that ArmSelector accepts, and then every
+ * minimizer that occurs only a few times in the genome is used to count
+ * how many minimizers each pair of contigs on different arms share.
+ * Two contigs are homoeologs if each is the other's best match on its
+ * arm and they share at least the given number of minimizers. These
+ * pairs are then joined into groups, strongest first, so that no group
+ * ever has more than one contig from each arm.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arm_selection.hpp"
+#include "minimizer_sketch.hpp"
+#include "homoeolog_index_format.hpp"
+
+
+/* The default number of minimizers that two contigs need to share to be homoeologs */
+static const uint32 S_DEFAULT_MIN_SHARED = 10;
+
+/*
+ * Minimizers that occur more often than this are repeats rather than
+ * being shared by a set of homoeologs so they are ignored.
+ */
+static const uint64 S_MAX_OCCURRENCES = 8;
+
+/*
+ * A pair of contigs that are each other's best match.
+ */
+struct HomoeologPair
+{
+	uint32 hp_a;
+	uint32 hp_b;
+	uint32 hp_num_shared;
+};
+
+
+/*
+ * The best match for a contig on one of the other arms.
+ */
+struct BestMatch
+{
+	uint32 bm_contig;
+	uint32 bm_num_shared;
+};
+
+
+static bool CountSharedMinimizers (const uint8 *data_p, size_t data_size, const std :: vector <uint32> &arms_r, std :: unordered_map <uint64, uint32> &counts_r);
+
+static void FindPairs (const std :: unordered_map <uint64, uint32> &counts_r, const std :: vector <uint32> &arms_r, uint32 min_shared, std :: vector <HomoeologPair> &pairs_r);
+
+static void GroupPairs (const std :: vector <HomoeologPair> &pairs_r, const std :: vector <uint32> &arms_r, std :: vector <uint32> &roots_r);
+
+static uint32 FindRoot (std :: vector <uint32> &parents_r, uint32 contig);
+
+static bool WriteIndex (FILE *out_f, const char *arm_selection_s, const std :: vector <std :: string> &names_r, const std :: vector <std :: string> &arm_names_r, const std :: vector <uint32> &arms_r, const std :: vector <uint32> &roots_r, size_t &num_groups_r);
+
+
+int main (int argc, char *argv [])
+{
+	int ret = EXIT_FAILURE;
+	uint32 min_shared = S_DEFAULT_MIN_SHARED;
+	ArmSelector arm_selector;
+
+	if (argc >= 5)
+		{
+			min_shared = (uint32) atoi (argv [4]);
+		}
+
+	if ((argc < 4) || (argc > 5))
+		{
+			fprintf (stderr, "Usage: %s <minimizer index> <output file> <arm selection> [min shared]\n", argv [0]);
+		}
+	else if ((strlen (argv [3]) >= HOMOEOLOG_RULE_SIZE) || (!arm_selector.SetRule (argv [3])))
+		{
+			fprintf (stderr, "\"%s\" is not a valid arm selection, it must be %s, %s, %s, %s or separator,field\n", argv [3], ArmSelector :: AS_EMBL_S, ArmSelector :: AS_FIRST_TWO_S, ArmSelector :: AS_MOREX_S, ArmSelector :: AS_SCAFFOLD_S);
+		}
+	else if (min_shared == 0)
+		{
+			fprintf (stderr, "min shared must be at least 1\n");
+		}
+	else
+		{
+			const char *index_filename_s = argv [1];
+			std :: string out_filename (argv [2]);
+			int fd = open (index_filename_s, O_RDONLY);
+
+			if (fd != -1)
+				{
+					struct stat st;
+					void *data_p = MAP_FAILED;
+
+					if ((fstat (fd, &st) == 0) && (st.st_size >= (off_t) sizeof (MinimizerIndexHeader)))
+						{
+							data_p = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+						}
+
+					close (fd);
+
+					if (data_p != MAP_FAILED)
+						{
+							const uint8 *index_p = (const uint8 *) data_p;
+							const size_t index_size = (size_t) st.st_size;
+							const MinimizerIndexHeader *header_p = (const MinimizerIndexHeader *) index_p;
+
+							if ((memcmp (header_p -> mih_magic_s, MINIMIZER_INDEX_MAGIC_S, sizeof (MINIMIZER_INDEX_MAGIC_S)) == 0)
+								&& (header_p -> mih_version == MINIMIZER_INDEX_VERSION)
+								&& (header_p -> mih_file_size == (uint64) index_size)
+								&& (header_p -> mih_names_offset < (uint64) index_size)
+								&& (header_p -> mih_contigs_offset + header_p -> mih_num_contigs * sizeof (MinimizerContig) <= header_p -> mih_entries_offset)
+								&& (header_p -> mih_entries_offset + header_p -> mih_num_entries * sizeof (MinimizerEntry) <= header_p -> mih_names_offset)
+								&& (index_p [index_size - 1] == '\0'))
+								{
+									const MinimizerContig *contigs_p = (const MinimizerContig *) (index_p + header_p -> mih_contigs_offset);
+									const char *index_names_s = (const char *) (index_p + header_p -> mih_names_offset);
+									std :: vector <std :: string> names;
+									std :: vector <std :: string> arm_names;
+									std :: vector <uint32> arms;
+									std :: map <std :: string, uint32> arm_ids;
+									bool success_flag = true;
+
+									std :: string arm;
+
+									/* Give each arm an id with the unknown arm always being 0 */
+									arm_names.push_back (ArmSelector :: AS_UNKNOWN_ARM_S);
+									arm_ids [ArmSelector :: AS_UNKNOWN_ARM_S] = 0;
+
+									for (uint64 i = 0; success_flag && (i < header_p -> mih_num_contigs); ++ i)
+										{
+											if (contigs_p [i].mc_name_offset < (uint64) index_size - header_p -> mih_names_offset)
+												{
+													const std :: string name (index_names_s + contigs_p [i].mc_name_offset);
+
+													arm_selector.Select (name, arm);
+
+													if (arm.size () < HOMOEOLOG_ARM_SIZE)
+														{
+															std :: map <std :: string, uint32> :: const_iterator itr = arm_ids.find (arm);
+
+															if (itr == arm_ids.end ())
+																{
+																	itr = arm_ids.insert (std :: make_pair (arm, (uint32) arm_names.size ())).first;
+																	arm_names.push_back (arm);
+																}
+
+															names.push_back (name);
+															arms.push_back (itr -> second);
+														}
+													else
+														{
+															fprintf (stderr, "The arm \"%s\" of \"%s\" is longer than %d characters\n", arm.c_str (), name.c_str (), HOMOEOLOG_ARM_SIZE - 1);
+															success_flag = false;
+														}
+												}
+											else
+												{
+													fprintf (stderr, "Contig " UINT64_FMT " in \"%s\" is corrupt\n", i, index_filename_s);
+													success_flag = false;
+												}
+										}
+
+									if (success_flag)
+										{
+											std :: unordered_map <uint64, uint32> counts;
+											std :: vector <HomoeologPair> pairs;
+											std :: vector <uint32> roots;
+
+											success_flag = CountSharedMinimizers (index_p, index_size, arms, counts);
+
+											if (success_flag)
+												{
+													std :: string tmp_filename (out_filename);
+													FILE *out_f;
+
+													FindPairs (counts, arms, min_shared, pairs);
+													counts.clear ();
+
+													GroupPairs (pairs, arms, roots);
+
+													tmp_filename.append (".tmp");
+													out_f = fopen (tmp_filename.c_str (), "wb");
+
+													if (out_f)
+														{
+															size_t num_groups = 0;
+
+															success_flag = WriteIndex (out_f, arm_selector.GetRule (), names, arm_names, arms, roots, num_groups);
+
+															if (fclose (out_f) != 0)
+																{
+																	success_flag = false;
+																}
+
+															if (success_flag && (rename (tmp_filename.c_str (), out_filename.c_str ()) == 0))
+																{
+																	printf ("Found " SIZET_FMT " homoeolog groups from " SIZET_FMT " pairs of the " SIZET_FMT " contigs on " SIZET_FMT " arms into \"%s\"\n", num_groups, pairs.size (), names.size (), arm_names.size () - 1, out_filename.c_str ());
+																	ret = EXIT_SUCCESS;
+																}
+															else
+																{
+																	fprintf (stderr, "Failed to write \"%s\", %s\n", out_filename.c_str (), strerror (errno));
+																	remove (tmp_filename.c_str ());
+																}
+														}
+													else
+														{
+															fprintf (stderr, "Failed to open \"%s\" for writing, %s\n", tmp_filename.c_str (), strerror (errno));
+														}
+												}
+											else
+												{
+													fprintf (stderr, "\"%s\" is corrupt\n", index_filename_s);
+												}
+										}
+								}
+							else
+								{
+									fprintf (stderr, "\"%s\" is not a valid minimizer index\n", index_filename_s);
+								}
+
+							munmap (data_p, index_size);
+						}
+					else
+						{
+							fprintf (stderr, "Failed to map \"%s\", %s\n", index_filename_s, strerror (errno));
+						}
+				}
+			else
+				{
+					fprintf (stderr, "Failed to open \"%s\", %s\n", index_filename_s, strerror (errno));
+				}
+		}
+
+	return ret;
+}
+
+
+/*
+ * The entries of the minimizer index are sorted by hash so the contigs
+ * that share each minimizer are next to each other. The count for each
+ * pair of contigs is keyed by the lower contig index in the upper 32 bits
+ * and the higher one in the lower 32 bits.
+ */
+static bool CountSharedMinimizers (const uint8 *data_p, size_t data_size, const std :: vector <uint32> &arms_r, std :: unordered_map <uint64, uint32> &counts_r)
+{
+	const MinimizerIndexHeader *header_p = (const MinimizerIndexHeader *) data_p;
+	const MinimizerEntry *entry_p = (const MinimizerEntry *) (data_p + header_p -> mih_entries_offset);
+	const MinimizerEntry * const entries_end_p = entry_p + header_p -> mih_num_entries;
+	std :: vector <uint32> contigs;
+
+	/* The entries are read once from start to end */
+	madvise ((void *) data_p, data_size, MADV_SEQUENTIAL);
+
+	while (entry_p < entries_end_p)
+		{
+			const MinimizerEntry *run_end_p = entry_p + 1;
+
+			while ((run_end_p < entries_end_p) && (run_end_p -> me_hash == entry_p -> me_hash))
+				{
+					++ run_end_p;
+				}
+
+			if ((run_end_p - entry_p >= 2) && ((uint64) (run_end_p - entry_p) <= S_MAX_OCCURRENCES))
+				{
+					contigs.clear ();
+
+					for ( ; entry_p < run_end_p; ++ entry_p)
+						{
+							if (entry_p -> me_contig >= arms_r.size ())
+								{
+									return false;
+								}
+
+							/* Contigs on an unknown arm can't be told apart from their homoeologs */
+							if (arms_r [entry_p -> me_contig] != 0)
+								{
+									contigs.push_back (entry_p -> me_contig);
+								}
+						}
+
+					std :: sort (contigs.begin (), contigs.end ());
+					contigs.erase (std :: unique (contigs.begin (), contigs.end ()), contigs.end ());
+
+					for (size_t i = 0; i < contigs.size (); ++ i)
+						{
+							for (size_t j = i + 1; j < contigs.size (); ++ j)
+								{
+									if (arms_r [contigs [i]] != arms_r [contigs [j]])
+										{
+											++ counts_r [(((uint64) contigs [i]) << 32) | contigs [j]];
+										}
+								}
+						}
+				}
+
+			entry_p = run_end_p;
+		}
+
+	return true;
+}
+
+
+/*
+ * Keep the pairs of contigs where each contig is the other's best
+ * match on its arm.
+ */
+static void FindPairs (const std :: unordered_map <uint64, uint32> &counts_r, const std :: vector <uint32> &arms_r, uint32 min_shared, std :: vector <HomoeologPair> &pairs_r)
+{
+	std :: unordered_map <uint64, BestMatch> best_matches;
+	std :: unordered_map <uint64, uint32> :: const_iterator itr;
+
+	auto update_best = [&best_matches] (uint32 contig, uint32 other_arm, uint32 other_contig, uint32 num_shared)
+		{
+			BestMatch &best_r = best_matches [(((uint64) contig) << 32) | other_arm];
+
+			/* Ties go to the lower contig index so that the results don't depend on the order of the hash table */
+			if ((best_r.bm_num_shared < num_shared) || ((best_r.bm_num_shared == num_shared) && (other_contig < best_r.bm_contig)))
+				{
+					best_r.bm_contig = other_contig;
+					best_r.bm_num_shared = num_shared;
+				}
+		};
+
+	for (itr = counts_r.begin (); itr != counts_r.end (); ++ itr)
+		{
+			const uint32 a = (uint32) (itr -> first >> 32);
+			const uint32 b = (uint32) (itr -> first & 0xFFFFFFFF);
+
+			update_best (a, arms_r [b], b, itr -> second);
+			update_best (b, arms_r [a], a, itr -> second);
+		}
+
+	for (itr = counts_r.begin (); itr != counts_r.end (); ++ itr)
+		{
+			if (itr -> second >= min_shared)
+				{
+					const uint32 a = (uint32) (itr -> first >> 32);
+					const uint32 b = (uint32) (itr -> first & 0xFFFFFFFF);
+
+					if ((best_matches [(((uint64) a) << 32) | arms_r [b]].bm_contig == b) && (best_matches [(((uint64) b) << 32) | arms_r [a]].bm_contig == a))
+						{
+							HomoeologPair pair;
+
+							pair.hp_a = a;
+							pair.hp_b = b;
+							pair.hp_num_shared = itr -> second;
+
+							pairs_r.push_back (pair);
+						}
+				}
+		}
+
+	std :: sort (pairs_r.begin (), pairs_r.end (), [] (const HomoeologPair &p_r, const HomoeologPair &q_r)
+		{
+			if (p_r.hp_num_shared != q_r.hp_num_shared)
+				{
+					return p_r.hp_num_shared > q_r.hp_num_shared;
+				}
+
+			if (p_r.hp_a != q_r.hp_a)
+				{
+					return p_r.hp_a < q_r.hp_a;
+				}
+
+			return p_r.hp_b < q_r.hp_b;
+		});
+}
+
+
+/*
+ * Join the pairs into groups, strongest first, skipping any pair that
+ * would put two contigs from the same arm into a group. Once this has
+ * been called, roots_r holds the root contig of each contig's group.
+ */
+static void GroupPairs (const std :: vector <HomoeologPair> &pairs_r, const std :: vector <uint32> &arms_r, std :: vector <uint32> &roots_r)
+{
+	std :: vector <uint32> parents (arms_r.size ());
+	std :: map <uint32, std :: vector <uint32> > group_arms;
+
+	for (size_t i = 0; i < parents.size (); ++ i)
+		{
+			parents [i] = (uint32) i;
+		}
+
+	for (size_t i = 0; i < pairs_r.size (); ++ i)
+		{
+			uint32 root_a = FindRoot (parents, pairs_r [i].hp_a);
+			uint32 root_b = FindRoot (parents, pairs_r [i].hp_b);
+
+			if (root_a != root_b)
+				{
+					std :: vector <uint32> &arms_a_r = group_arms [root_a];
+					std :: vector <uint32> &arms_b_r = group_arms [root_b];
+					std :: vector <uint32> merged;
+
+					/* A contig that isn't in a group yet only has its own arm */
+					if (arms_a_r.empty ())
+						{
+							arms_a_r.push_back (arms_r [root_a]);
+						}
+
+					if (arms_b_r.empty ())
+						{
+							arms_b_r.push_back (arms_r [root_b]);
+						}
+
+					std :: set_union (arms_a_r.begin (), arms_a_r.end (), arms_b_r.begin (), arms_b_r.end (), std :: back_inserter (merged));
+
+					if (merged.size () == arms_a_r.size () + arms_b_r.size ())
+						{
+							if (arms_a_r.size () < arms_b_r.size ())
+								{
+									std :: swap (root_a, root_b);
+								}
+
+							parents [root_b] = root_a;
+							group_arms [root_a].swap (merged);
+							group_arms.erase (root_b);
+						}
+				}
+		}
+
+	roots_r.resize (parents.size ());
+
+	for (size_t i = 0; i < parents.size (); ++ i)
+		{
+			roots_r [i] = FindRoot (parents, (uint32) i);
+		}
+}
+
+
+static uint32 FindRoot (std :: vector <uint32> &parents_r, uint32 contig)
+{
+	uint32 root = contig;
+
+	while (parents_r [root] != root)
+		{
+			root = parents_r [root];
+		}
+
+	/* Point everything on the path straight at the root */
+	while (parents_r [contig] != root)
+		{
+			const uint32 parent = parents_r [contig];
+
+			parents_r [contig] = root;
+			contig = parent;
+		}
+
+	return root;
+}
+
+
+static bool WriteIndex (FILE *out_f, const char *arm_selection_s, const std :: vector <std :: string> &names_r, const std :: vector <std :: string> &arm_names_r, const std :: vector <uint32> &arms_r, const std :: vector <uint32> &roots_r, size_t &num_groups_r)
+{
+	const size_t num_contigs = names_r.size ();
+	std :: vector <uint32> order (num_contigs);
+	std :: vector <uint32> positions (num_contigs);
+	std :: vector <uint32> group_sizes (num_contigs, 0);
+	std :: vector <uint32> group_ids (num_contigs, HOMOEOLOG_NO_GROUP);
+	std :: vector <HomoeologContig> contigs (num_contigs);
+	std :: vector <HomoeologGroup> groups;
+	std :: vector <uint32> members;
+	std :: string names;
+	HomoeologIndexHeader header;
+
+	/* The contigs are stored sorted by name so that they can be binary searched */
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			order [i] = (uint32) i;
+			++ group_sizes [roots_r [i]];
+		}
+
+	std :: sort (order.begin (), order.end (), [&names_r] (uint32 a, uint32 b) { return names_r [a] < names_r [b]; });
+
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			positions [order [i]] = (uint32) i;
+		}
+
+	/* Number the groups in the order that their first contig appears */
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			const uint32 root = roots_r [order [i]];
+
+			if ((group_sizes [root] > 1) && (group_ids [root] == HOMOEOLOG_NO_GROUP))
+				{
+					HomoeologGroup group;
+
+					group.hg_first_member = 0;
+					group.hg_num_members = 0;
+
+					group_ids [root] = (uint32) groups.size ();
+					groups.push_back (group);
+				}
+		}
+
+	/* Each group's members follow on from the previous group's */
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			if (group_ids [i] != HOMOEOLOG_NO_GROUP)
+				{
+					groups [group_ids [i]].hg_num_members = group_sizes [i];
+				}
+		}
+
+	for (size_t i = 0, first_member = 0; i < groups.size (); ++ i)
+		{
+			groups [i].hg_first_member = (uint32) first_member;
+			first_member += groups [i].hg_num_members;
+			groups [i].hg_num_members = 0;
+		}
+
+	members.resize (num_contigs);
+
+	for (size_t i = 0; i < num_contigs; ++ i)
+		{
+			const uint32 contig = order [i];
+			const uint32 group = group_ids [roots_r [contig]];
+			HomoeologContig &contig_r = contigs [i];
+
+			memset (&contig_r, 0, sizeof (contig_r));
+
+			contig_r.hc_name_offset = names.size ();
+			contig_r.hc_group = group;
+			strncpy (contig_r.hc_arm_s, arm_names_r [arms_r [contig]].c_str (), HOMOEOLOG_ARM_SIZE - 1);
+
+			names.append (names_r [contig]);
+			names.push_back ('\0');
+
+			if (group != HOMOEOLOG_NO_GROUP)
+				{
+					HomoeologGroup &group_r = groups [group];
+
+					members [group_r.hg_first_member + group_r.hg_num_members] = (uint32) i;
+					++ group_r.hg_num_members;
+				}
+		}
+
+	members.resize (groups.empty () ? 0 : groups.back ().hg_first_member + groups.back ().hg_num_members);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.hih_magic_s, HOMOEOLOG_INDEX_MAGIC_S, sizeof (HOMOEOLOG_INDEX_MAGIC_S));
+
+	header.hih_version = HOMOEOLOG_INDEX_VERSION;
+	strncpy (header.hih_arm_selection_s, arm_selection_s, HOMOEOLOG_RULE_SIZE - 1);
+	header.hih_num_contigs = contigs.size ();
+	header.hih_num_groups = groups.size ();
+	header.hih_num_members = members.size ();
+
+	/* The header and contigs are multiples of 8 bytes and the groups and members are multiples of 4 so everything stays aligned */
+	header.hih_contigs_offset = sizeof (header);
+	header.hih_groups_offset = header.hih_contigs_offset + contigs.size () * sizeof (HomoeologContig);
+	header.hih_members_offset = header.hih_groups_offset + groups.size () * sizeof (HomoeologGroup);
+	header.hih_names_offset = header.hih_members_offset + members.size () * sizeof (uint32);
+	header.hih_file_size = header.hih_names_offset + names.size ();
+
+	num_groups_r = groups.size ();
+
+	return (fwrite (&header, sizeof (header), 1, out_f) == 1)
+		&& (contigs.empty () || (fwrite (contigs.data (), sizeof (HomoeologContig), contigs.size (), out_f) == contigs.size ()))
+		&& (groups.empty () || (fwrite (groups.data (), sizeof (HomoeologGroup), groups.size (), out_f) == groups.size ()))
+		&& (members.empty () || (fwrite (members.data (), sizeof (uint32), members.size (), out_f) == members.size ()))
+		&& (names.empty () || (fwrite (names.data (), 1, names.size (), out_f) == names.size ()));
+}
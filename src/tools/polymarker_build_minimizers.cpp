@@ -0,0 +1,279 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_build_minimizers.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Build a minimizer index from a fasta file.
+ *
+ * Usage: polymarker_build_minimizers <input fasta> <output file> [k] [w]
+ *
+ * Each contig is read into memory in turn and its minimizers are added
+ * to a table which is sorted by hash once every contig has been read,
+ * so this needs around 16 bytes of memory for every 2 / (w + 1) bases
+ * of the genome along with the largest contig.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "minimizer_sketch.hpp"
+
+
+/* The default k-mer length and window size, as used by minimap2 for genomic reads */
+static const uint32 S_DEFAULT_K = 15;
+
+static const uint32 S_DEFAULT_W = 10;
+
+
+/*
+ * Adds the minimizers of one contig to the table.
+ */
+struct MinimizerCollector
+{
+	std :: vector <MinimizerEntry> &mc_entries_r;
+
+	uint32 mc_contig;
+
+	MinimizerCollector (std :: vector <MinimizerEntry> &entries_r, uint32 contig)
+		: mc_entries_r (entries_r),
+			mc_contig (contig)
+	{
+	}
+
+	void operator () (const MinimizerSeed &seed_r)
+	{
+		MinimizerEntry entry;
+
+		entry.me_hash = seed_r.ms_hash;
+		entry.me_contig = mc_contig;
+		entry.me_position_strand = (uint32) ((seed_r.ms_position << 1) | seed_r.ms_strand);
+
+		mc_entries_r.push_back (entry);
+	}
+};
+
+
+static bool AddContig (const std :: string &name_r, const std :: string &seq_r, uint32 k, uint32 w, std :: vector <MinimizerContig> &contigs_r, std :: string &names_r, std :: vector <MinimizerEntry> &entries_r);
+
+static bool CompareEntries (const MinimizerEntry &a_r, const MinimizerEntry &b_r);
+
+static bool WriteIndex (FILE *out_f, uint32 k, uint32 w, const std :: vector <MinimizerContig> &contigs_r, const std :: string &names_r, const std :: vector <MinimizerEntry> &entries_r);
+
+
+int main (int argc, char *argv [])
+{
+	int ret = EXIT_FAILURE;
+	uint32 k = S_DEFAULT_K;
+	uint32 w = S_DEFAULT_W;
+
+	if (argc >= 4)
+		{
+			k = (uint32) atoi (argv [3]);
+		}
+
+	if (argc >= 5)
+		{
+			w = (uint32) atoi (argv [4]);
+		}
+
+	if ((argc < 3) || (argc > 5))
+		{
+			fprintf (stderr, "Usage: %s <input fasta> <output file> [k] [w]\n", argv [0]);
+		}
+	else if ((k == 0) || (k > MINIMIZER_MAX_K) || (w == 0))
+		{
+			fprintf (stderr, "k must be between 1 and %d and w must be at least 1\n", MINIMIZER_MAX_K);
+		}
+	else
+		{
+			const char *fasta_filename_s = argv [1];
+			std :: string out_filename (argv [2]);
+			FILE *in_f = fopen (fasta_filename_s, "r");
+
+			if (in_f)
+				{
+					std :: vector <MinimizerContig> contigs;
+					std :: vector <MinimizerEntry> entries;
+					std :: string names;
+					std :: string name;
+					std :: string seq;
+					char *line_s = NULL;
+					size_t line_buffer_size = 0;
+					ssize_t line_length;
+					bool in_contig_flag = false;
+					bool success_flag = true;
+
+					while (success_flag && ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1))
+						{
+							while ((line_length > 0) && ((line_s [line_length - 1] == '\n') || (line_s [line_length - 1] == '\r')))
+								{
+									-- line_length;
+								}
+
+							if (*line_s == '>')
+								{
+									if (in_contig_flag)
+										{
+											success_flag = AddContig (name, seq, k, w, contigs, names, entries);
+										}
+
+									name.assign (line_s + 1, strcspn (line_s + 1, " \t\r\n"));
+									seq.clear ();
+									in_contig_flag = true;
+								}
+							else if (in_contig_flag)
+								{
+									seq.append (line_s, (size_t) line_length);
+								}
+						}
+
+					free (line_s);
+
+					if (success_flag && in_contig_flag)
+						{
+							success_flag = AddContig (name, seq, k, w, contigs, names, entries);
+						}
+
+					if (success_flag && ferror (in_f))
+						{
+							fprintf (stderr, "Failed to read \"%s\"\n", fasta_filename_s);
+							success_flag = false;
+						}
+
+					fclose (in_f);
+
+					if (success_flag)
+						{
+							std :: string tmp_filename (out_filename);
+							FILE *out_f;
+
+							tmp_filename.append (".tmp");
+
+							std :: sort (entries.begin (), entries.end (), CompareEntries);
+
+							out_f = fopen (tmp_filename.c_str (), "wb");
+
+							if (out_f)
+								{
+									success_flag = WriteIndex (out_f, k, w, contigs, names, entries);
+
+									if (fclose (out_f) != 0)
+										{
+											success_flag = false;
+										}
+
+									if (success_flag && (rename (tmp_filename.c_str (), out_filename.c_str ()) == 0))
+										{
+											printf ("Indexed " SIZET_FMT " minimizers from " SIZET_FMT " contigs with k=" UINT32_FMT " w=" UINT32_FMT " into \"%s\"\n", entries.size (), contigs.size (), k, w, out_filename.c_str ());
+											ret = EXIT_SUCCESS;
+										}
+									else
+										{
+											fprintf (stderr, "Failed to write \"%s\", %s\n", out_filename.c_str (), strerror (errno));
+											remove (tmp_filename.c_str ());
+										}
+								}
+							else
+								{
+									fprintf (stderr, "Failed to open \"%s\" for writing, %s\n", tmp_filename.c_str (), strerror (errno));
+								}
+						}
+				}
+			else
+				{
+					fprintf (stderr, "Failed to open \"%s\", %s\n", fasta_filename_s, strerror (errno));
+				}
+		}
+
+	return ret;
+}
+
+
+static bool AddContig (const std :: string &name_r, const std :: string &seq_r, uint32 k, uint32 w, std :: vector <MinimizerContig> &contigs_r, std :: string &names_r, std :: vector <MinimizerEntry> &entries_r)
+{
+	MinimizerContig contig;
+
+	if (seq_r.size () > MINIMIZER_MAX_POSITION)
+		{
+			fprintf (stderr, "\"%s\" has " SIZET_FMT " bases but at most %u can be indexed\n", name_r.c_str (), seq_r.size (), MINIMIZER_MAX_POSITION);
+			return false;
+		}
+
+	contig.mc_name_offset = names_r.size ();
+	contig.mc_length = seq_r.size ();
+
+	names_r.append (name_r);
+	names_r.push_back ('\0');
+
+	MinimizerCollector collector (entries_r, (uint32) contigs_r.size ());
+
+	SketchMinimizers (seq_r.data (), seq_r.size (), k, w, collector);
+
+	contigs_r.push_back (contig);
+
+	return true;
+}
+
+
+static bool CompareEntries (const MinimizerEntry &a_r, const MinimizerEntry &b_r)
+{
+	if (a_r.me_hash != b_r.me_hash)
+		{
+			return a_r.me_hash < b_r.me_hash;
+		}
+
+	if (a_r.me_contig != b_r.me_contig)
+		{
+			return a_r.me_contig < b_r.me_contig;
+		}
+
+	return a_r.me_position_strand < b_r.me_position_strand;
+}
+
+
+static bool WriteIndex (FILE *out_f, uint32 k, uint32 w, const std :: vector <MinimizerContig> &contigs_r, const std :: string &names_r, const std :: vector <MinimizerEntry> &entries_r)
+{
+	MinimizerIndexHeader header;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.mih_magic_s, MINIMIZER_INDEX_MAGIC_S, sizeof (MINIMIZER_INDEX_MAGIC_S));
+
+	header.mih_version = MINIMIZER_INDEX_VERSION;
+	header.mih_k = k;
+	header.mih_w = w;
+	header.mih_num_contigs = contigs_r.size ();
+	header.mih_num_entries = entries_r.size ();
+
+	/* The header, contigs and entries are all multiples of 8 bytes so everything stays aligned */
+	header.mih_contigs_offset = sizeof (header);
+	header.mih_entries_offset = header.mih_contigs_offset + contigs_r.size () * sizeof (MinimizerContig);
+	header.mih_names_offset = header.mih_entries_offset + entries_r.size () * sizeof (MinimizerEntry);
+	header.mih_file_size = header.mih_names_offset + names_r.size ();
+
+	return (fwrite (&header, sizeof (header), 1, out_f) == 1)
+		&& (contigs_r.empty () || (fwrite (contigs_r.data (), sizeof (MinimizerContig), contigs_r.size (), out_f) == contigs_r.size ()))
+		&& (entries_r.empty () || (fwrite (entries_r.data (), sizeof (MinimizerEntry), entries_r.size (), out_f) == entries_r.size ()))
+		&& (names_r.empty () || (fwrite (names_r.data (), 1, names_r.size (), out_f) == names_r.size ()));
+}
@@ -0,0 +1,334 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_check_tm.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the melting temperatures and end stabilities calculated
+ * by OligoThermodynamicsCalculator against those in a primer3 output file.
+ *
+ * Usage: polymarker_check_tm <primer3 output> [max length]
+ *
+ * Every primer and internal oligo in the primer3_core output, such as a
+ * job's primer_3_output_temp, of up to the given length, which defaults to
+ * 35, is recalculated using the reaction conditions given in the file, or
+ * primer3's defaults where it doesn't give them. As primer3 rounds the
+ * values that it writes, a value matches if it is within half of the
+ * last decimal place that primer3 wrote.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "oligo_thermodynamics.hpp"
+
+
+/* The default longest oligo to check, which is the longest pp_max_size that is used */
+static const uint32 S_DEFAULT_MAX_LENGTH = 35;
+
+/* The number of differences that are printed */
+static const size_t S_MAX_REPORTED = 10;
+
+
+/*
+ * An oligo's values as primer3 wrote them.
+ */
+struct Primer3Oligo
+{
+	std :: string po_sequence;
+	std :: string po_tm;
+	std :: string po_end_stability;
+};
+
+
+/*
+ * The oligos that are checked together as they share the same conditions.
+ */
+struct OligoCheck
+{
+	OligoConditions oc_conditions;
+	std :: vector <Primer3Oligo> oc_oligos;
+	size_t oc_num_checked;
+	size_t oc_num_tm_differences;
+	size_t oc_num_end_stability_differences;
+	double oc_max_tm_difference;
+	double oc_max_end_stability_difference;
+};
+
+
+static void CheckOligos (OligoCheck &check_r);
+
+static bool CompareValue (const char *name_s, const std :: string &sequence_r, const std :: string &primer3_value_r, double value, size_t &num_differences_r, double &max_difference_r);
+
+static bool SetConditions (const char *tag_s, const char *value_s, OligoConditions &conditions_r, bool &supported_r);
+
+
+int main (int argc, char *argv [])
+{
+	int ret = EXIT_FAILURE;
+	uint32 max_length = S_DEFAULT_MAX_LENGTH;
+
+	if (argc >= 3)
+		{
+			max_length = (uint32) atoi (argv [2]);
+		}
+
+	if ((argc < 2) || (argc > 3))
+		{
+			fprintf (stderr, "Usage: %s <primer3 output> [max length]\n", argv [0]);
+		}
+	else if ((max_length < 2) || (max_length > OligoBatch :: OB_MAX_LENGTH))
+		{
+			fprintf (stderr, "max length must be between 2 and " UINT32_FMT "\n", OligoBatch :: OB_MAX_LENGTH);
+		}
+	else
+		{
+			FILE *in_f = fopen (argv [1], "r");
+
+			if (in_f)
+				{
+					OligoCheck check;
+					std :: map <std :: string, Primer3Oligo> record_oligos;
+					char *line_s = NULL;
+					size_t line_buffer_size = 0;
+					ssize_t line_length;
+					size_t num_skipped = 0;
+					bool supported_flag = true;
+
+					check.oc_num_checked = 0;
+					check.oc_num_tm_differences = 0;
+					check.oc_num_end_stability_differences = 0;
+					check.oc_max_tm_difference = 0.0;
+					check.oc_max_end_stability_difference = 0.0;
+
+					while (supported_flag && ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1))
+						{
+							char *value_s;
+
+							while ((line_length > 0) && ((line_s [line_length - 1] == '\n') || (line_s [line_length - 1] == '\r')))
+								{
+									line_s [-- line_length] = '\0';
+								}
+
+							if (strcmp (line_s, "=") == 0)
+								{
+									for (std :: map <std :: string, Primer3Oligo> :: const_iterator itr = record_oligos.begin (); itr != record_oligos.end (); ++ itr)
+										{
+											if ((itr -> second.po_sequence.empty ()) || (itr -> second.po_tm.empty ()))
+												{
+													/* Not an oligo, e.g. PRIMER_MAX_TM */
+												}
+											else if (itr -> second.po_sequence.size () <= max_length)
+												{
+													check.oc_oligos.push_back (itr -> second);
+												}
+											else
+												{
+													++ num_skipped;
+												}
+										}
+
+									record_oligos.clear ();
+								}
+							else if ((value_s = strchr (line_s, '=')) != NULL)
+								{
+									OligoConditions conditions (check.oc_conditions);
+
+									*value_s = '\0';
+									++ value_s;
+
+									if (SetConditions (line_s, value_s, conditions, supported_flag))
+										{
+											/* The oligos so far were designed with the old conditions */
+											CheckOligos (check);
+											check.oc_conditions = conditions;
+										}
+									else if ((strncmp (line_s, "PRIMER_LEFT_", 12) == 0) || (strncmp (line_s, "PRIMER_RIGHT_", 13) == 0) || (strncmp (line_s, "PRIMER_INTERNAL_", 16) == 0))
+										{
+											char *suffix_s = strrchr (line_s, '_');
+
+											/* END_STABILITY has an underscore of its own */
+											if (strcmp (suffix_s, "_STABILITY") == 0)
+												{
+													*suffix_s = '\0';
+													suffix_s = strrchr (line_s, '_');
+
+													if (strcmp (suffix_s, "_END") == 0)
+														{
+															*suffix_s = '\0';
+															record_oligos [line_s + 7].po_end_stability = value_s;
+														}
+												}
+											else if (strcmp (suffix_s, "_SEQUENCE") == 0)
+												{
+													*suffix_s = '\0';
+													record_oligos [line_s + 7].po_sequence = value_s;
+												}
+											else if (strcmp (suffix_s, "_TM") == 0)
+												{
+													*suffix_s = '\0';
+													record_oligos [line_s + 7].po_tm = value_s;
+												}
+										}
+								}
+						}
+
+					free (line_s);
+					fclose (in_f);
+
+					if (supported_flag)
+						{
+							CheckOligos (check);
+
+							printf ("Checked " SIZET_FMT " oligos of up to " UINT32_FMT " bases using the %s kernel, skipping " SIZET_FMT " longer ones\n", check.oc_num_checked, max_length, OligoThermodynamicsCalculator :: GetKernelName (), num_skipped);
+							printf ("Tm: " SIZET_FMT " differ, the largest difference is %f\n", check.oc_num_tm_differences, check.oc_max_tm_difference);
+							printf ("End stability: " SIZET_FMT " differ, the largest difference is %f\n", check.oc_num_end_stability_differences, check.oc_max_end_stability_difference);
+
+							if ((check.oc_num_checked > 0) && (check.oc_num_tm_differences == 0) && (check.oc_num_end_stability_differences == 0))
+								{
+									ret = EXIT_SUCCESS;
+								}
+						}
+				}
+			else
+				{
+					fprintf (stderr, "Failed to open \"%s\"\n", argv [1]);
+				}
+		}
+
+	return ret;
+}
+
+
+/*
+ * Calculate the values of the oligos that have been read so far and
+ * compare them with primer3's.
+ */
+static void CheckOligos (OligoCheck &check_r)
+{
+	if (! check_r.oc_oligos.empty ())
+		{
+			OligoThermodynamicsCalculator calculator (check_r.oc_conditions);
+			OligoBatch batch;
+			std :: vector <OligoThermodynamics> values;
+
+			for (size_t i = 0; i < check_r.oc_oligos.size (); ++ i)
+				{
+					batch.Add (check_r.oc_oligos [i].po_sequence.c_str (), check_r.oc_oligos [i].po_sequence.size ());
+				}
+
+			calculator.Calculate (batch, values);
+
+			for (size_t i = 0; i < check_r.oc_oligos.size (); ++ i)
+				{
+					const Primer3Oligo &oligo_r = check_r.oc_oligos [i];
+
+					if (values [i].ot_valid_flag)
+						{
+							CompareValue ("Tm", oligo_r.po_sequence, oligo_r.po_tm, values [i].ot_tm, check_r.oc_num_tm_differences, check_r.oc_max_tm_difference);
+
+							if (! oligo_r.po_end_stability.empty ())
+								{
+									CompareValue ("End stability", oligo_r.po_sequence, oligo_r.po_end_stability, values [i].ot_end_stability, check_r.oc_num_end_stability_differences, check_r.oc_max_end_stability_difference);
+								}
+
+							++ (check_r.oc_num_checked);
+						}
+				}
+
+			check_r.oc_oligos.clear ();
+		}
+}
+
+
+static bool CompareValue (const char *name_s, const std :: string &sequence_r, const std :: string &primer3_value_r, double value, size_t &num_differences_r, double &max_difference_r)
+{
+	const double primer3_value = atof (primer3_value_r.c_str ());
+	const double difference = fabs (value - primer3_value);
+	const char *point_s = strchr (primer3_value_r.c_str (), '.');
+	double tolerance = 0.5;
+
+	/* Allow for primer3's rounding to the number of decimal places that it wrote */
+	if (point_s)
+		{
+			tolerance *= pow (10.0, - (double) strlen (point_s + 1));
+		}
+
+	if (difference > max_difference_r)
+		{
+			max_difference_r = difference;
+		}
+
+	if (difference > tolerance + 1e-9)
+		{
+			if (num_differences_r < S_MAX_REPORTED)
+				{
+					printf ("%s of %s is %f but primer3 gives %s\n", name_s, sequence_r.c_str (), value, primer3_value_r.c_str ());
+				}
+
+			++ num_differences_r;
+
+			return false;
+		}
+
+	return true;
+}
+
+
+/*
+ * Update the conditions if the tag is one of the settings that they
+ * come from.
+ */
+static bool SetConditions (const char *tag_s, const char *value_s, OligoConditions &conditions_r, bool &supported_r)
+{
+	if (strcmp (tag_s, "PRIMER_DNA_CONC") == 0)
+		{
+			conditions_r.oc_dna_conc = atof (value_s);
+		}
+	else if (strcmp (tag_s, "PRIMER_SALT_MONOVALENT") == 0)
+		{
+			conditions_r.oc_monovalent_conc = atof (value_s);
+		}
+	else if (strcmp (tag_s, "PRIMER_SALT_DIVALENT") == 0)
+		{
+			conditions_r.oc_divalent_conc = atof (value_s);
+		}
+	else if (strcmp (tag_s, "PRIMER_DNTP_CONC") == 0)
+		{
+			conditions_r.oc_dntp_conc = atof (value_s);
+		}
+	else
+		{
+			/* Only SantaLucia's parameters and salt correction are calculated */
+			if (((strcmp (tag_s, "PRIMER_TM_FORMULA") == 0) || (strcmp (tag_s, "PRIMER_SALT_CORRECTIONS") == 0)) && (atoi (value_s) != 1))
+				{
+					fprintf (stderr, "%s=%s is not supported, only 1 is\n", tag_s, value_s);
+					supported_r = false;
+				}
+
+			return false;
+		}
+
+	return true;
+}
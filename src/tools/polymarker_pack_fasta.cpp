@@ -0,0 +1,326 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * polymarker_pack_fasta.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Build a packed sequence file from a fasta file.
+ *
+ * Usage: polymarker_pack_fasta <input fasta> <output file>
+ *
+ * The fasta file is read once, a line at a time, so only the contig
+ * offset table and the runs of Ns are held in memory. The output is
+ * written to a temporary file that is renamed once it is complete.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "packed_sequence_format.h"
+
+
+/*
+ * A contig that has been read from the fasta file.
+ */
+struct PackingContig
+{
+	std :: string pc_name;
+
+	PackedContig pc_entry;
+};
+
+
+/*
+ * The 2-bit codes for each byte, with 4 used for any
+ * byte that is not a base.
+ */
+static uint8 s_codes [256];
+
+
+static void InitCodes ();
+
+static bool WriteBlock (FILE *out_f, const void *data_p, size_t size, uint64 &offset_r);
+
+static bool PadTo8 (FILE *out_f, uint64 &offset_r);
+
+
+int main (int argc, char *argv [])
+{
+	int ret = EXIT_FAILURE;
+
+	if (argc == 3)
+		{
+			const char *fasta_filename_s = argv [1];
+			std :: string out_filename (argv [2]);
+			std :: string tmp_filename (out_filename);
+			FILE *in_f = fopen (fasta_filename_s, "r");
+
+			tmp_filename.append (".tmp");
+
+			if (in_f)
+				{
+					FILE *out_f = fopen (tmp_filename.c_str (), "wb");
+
+					if (out_f)
+						{
+							PackedSequenceHeader header;
+							std :: vector <PackingContig> contigs;
+							std :: vector <PackedNRun> n_runs;
+							uint64 offset = 0;
+							uint64 bases_size = 0;
+							uint8 current_byte = 0;
+							uint32 bases_in_byte = 0;
+							PackingContig *contig_p = 0;
+							char *line_s = NULL;
+							size_t line_buffer_size = 0;
+							ssize_t line_length;
+							bool success_flag = true;
+
+							InitCodes ();
+
+							memset (&header, 0, sizeof (header));
+							memcpy (header.psh_magic_s, PACKED_SEQUENCE_MAGIC_S, sizeof (PACKED_SEQUENCE_MAGIC_S));
+							header.psh_version = PACKED_SEQUENCE_VERSION;
+
+							/* Reserve the space for the header, it is rewritten at the end */
+							success_flag = WriteBlock (out_f, &header, sizeof (header), offset);
+							header.psh_bases_offset = offset;
+
+							while (success_flag && ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1))
+								{
+									if (*line_s == '>')
+										{
+											char *name_end_s = line_s + 1;
+
+											/* Each contig starts on a new byte */
+											if (bases_in_byte > 0)
+												{
+													current_byte <<= (2 * (4 - bases_in_byte));
+													success_flag = WriteBlock (out_f, &current_byte, 1, offset);
+													++ bases_size;
+													current_byte = 0;
+													bases_in_byte = 0;
+												}
+
+											while ((*name_end_s != '\0') && (*name_end_s != ' ') && (*name_end_s != '\t') && (*name_end_s != '\n') && (*name_end_s != '\r'))
+												{
+													++ name_end_s;
+												}
+
+											contigs.push_back (PackingContig ());
+											contig_p = & (contigs.back ());
+
+											contig_p -> pc_name.assign (line_s + 1, name_end_s);
+											contig_p -> pc_entry.pc_name_offset = 0;
+											contig_p -> pc_entry.pc_length = 0;
+											contig_p -> pc_entry.pc_bases_offset = bases_size;
+											contig_p -> pc_entry.pc_first_n_run = n_runs.size ();
+											contig_p -> pc_entry.pc_num_n_runs = 0;
+										}
+									else if (contig_p)
+										{
+											for (ssize_t i = 0; success_flag && (i < line_length); ++ i)
+												{
+													const uint8 c = (uint8) line_s [i];
+
+													if ((c != '\n') && (c != '\r'))
+														{
+															const uint64 pos = contig_p -> pc_entry.pc_length;
+															uint8 code = s_codes [c];
+
+															if (code > 3)
+																{
+																	/* Extend the current run of Ns or start a new one */
+																	if ((contig_p -> pc_entry.pc_num_n_runs > 0) && (n_runs.back ().pnr_start + n_runs.back ().pnr_length == pos))
+																		{
+																			++ (n_runs.back ().pnr_length);
+																		}
+																	else
+																		{
+																			PackedNRun run;
+
+																			run.pnr_start = pos;
+																			run.pnr_length = 1;
+																			n_runs.push_back (run);
+
+																			++ (contig_p -> pc_entry.pc_num_n_runs);
+																		}
+
+																	code = 0;
+																}
+
+															current_byte = (uint8) ((current_byte << 2) | code);
+															++ (contig_p -> pc_entry.pc_length);
+
+															if (++ bases_in_byte == 4)
+																{
+																	success_flag = WriteBlock (out_f, &current_byte, 1, offset);
+																	++ bases_size;
+																	current_byte = 0;
+																	bases_in_byte = 0;
+																}
+														}
+												}
+										}
+								}
+
+							free (line_s);
+
+							if (success_flag && (bases_in_byte > 0))
+								{
+									current_byte <<= (2 * (4 - bases_in_byte));
+									success_flag = WriteBlock (out_f, &current_byte, 1, offset);
+								}
+
+							/* The runs of Ns */
+							if (success_flag && PadTo8 (out_f, offset))
+								{
+									header.psh_n_runs_offset = offset;
+									header.psh_num_n_runs = n_runs.size ();
+
+									success_flag = n_runs.empty () || WriteBlock (out_f, n_runs.data (), n_runs.size () * sizeof (PackedNRun), offset);
+								}
+							else
+								{
+									success_flag = false;
+								}
+
+							/* The contig offset table */
+							if (success_flag)
+								{
+									uint64 name_offset = 0;
+
+									header.psh_contigs_offset = offset;
+									header.psh_num_contigs = contigs.size ();
+
+									for (size_t i = 0; success_flag && (i < contigs.size ()); ++ i)
+										{
+											contigs [i].pc_entry.pc_name_offset = name_offset;
+											name_offset += contigs [i].pc_name.size () + 1;
+
+											success_flag = WriteBlock (out_f, & (contigs [i].pc_entry), sizeof (PackedContig), offset);
+										}
+								}
+
+							/* The contig names */
+							if (success_flag)
+								{
+									header.psh_names_offset = offset;
+
+									for (size_t i = 0; success_flag && (i < contigs.size ()); ++ i)
+										{
+											success_flag = WriteBlock (out_f, contigs [i].pc_name.c_str (), contigs [i].pc_name.size () + 1, offset);
+										}
+								}
+
+							if (success_flag)
+								{
+									header.psh_file_size = offset;
+
+									success_flag = (fseek (out_f, 0, SEEK_SET) == 0) && (fwrite (&header, sizeof (header), 1, out_f) == 1);
+								}
+
+							if (fclose (out_f) != 0)
+								{
+									success_flag = false;
+								}
+
+							if (success_flag && ferror (in_f))
+								{
+									fprintf (stderr, "Failed to read \"%s\"\n", fasta_filename_s);
+									success_flag = false;
+								}
+
+							if (success_flag)
+								{
+									if (rename (tmp_filename.c_str (), out_filename.c_str ()) == 0)
+										{
+											printf ("Packed " SIZET_FMT " contigs with " UINT64_FMT " runs of Ns into \"%s\"\n", contigs.size (), header.psh_num_n_runs, out_filename.c_str ());
+											ret = EXIT_SUCCESS;
+										}
+									else
+										{
+											fprintf (stderr, "Failed to rename \"%s\" to \"%s\", %s\n", tmp_filename.c_str (), out_filename.c_str (), strerror (errno));
+										}
+								}
+							else
+								{
+									fprintf (stderr, "Failed to write \"%s\"\n", tmp_filename.c_str ());
+								}
+
+							if (ret != EXIT_SUCCESS)
+								{
+									remove (tmp_filename.c_str ());
+								}
+						}
+					else
+						{
+							fprintf (stderr, "Failed to open \"%s\" for writing, %s\n", tmp_filename.c_str (), strerror (errno));
+						}
+
+					fclose (in_f);
+				}
+			else
+				{
+					fprintf (stderr, "Failed to open \"%s\", %s\n", fasta_filename_s, strerror (errno));
+				}
+		}
+	else
+		{
+			fprintf (stderr, "Usage: %s <input fasta> <output file>\n", argv [0]);
+		}
+
+	return ret;
+}
+
+
+static void InitCodes ()
+{
+	memset (s_codes, 4, sizeof (s_codes));
+
+	s_codes ['A'] = s_codes ['a'] = 0;
+	s_codes ['C'] = s_codes ['c'] = 1;
+	s_codes ['G'] = s_codes ['g'] = 2;
+	s_codes ['T'] = s_codes ['t'] = 3;
+}
+
+
+static bool WriteBlock (FILE *out_f, const void *data_p, size_t size, uint64 &offset_r)
+{
+	if (fwrite (data_p, 1, size, out_f) == size)
+		{
+			offset_r += size;
+			return true;
+		}
+
+	return false;
+}
+
+
+static bool PadTo8 (FILE *out_f, uint64 &offset_r)
+{
+	const uint8 padding [8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	const size_t num_bytes = (size_t) ((8 - (offset_r % 8)) % 8);
+
+	return (num_bytes == 0) || WriteBlock (out_f, padding, num_bytes, offset_r);
+}
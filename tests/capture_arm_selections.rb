@@ -0,0 +1,53 @@
+#!/usr/bin/env ruby
+#
+# Write the arm that each of polymarker_grassroots.rb's arm selection
+# functions, and its "separator,field" rule, gives for a set of contig
+# names, for test_arm_selection to check ArmSelector against.
+#
+# Usage: ruby tests/capture_arm_selections.rb > tests/data/arm_selections.tsv
+#
+# The functions are taken from the script itself so that they aren't
+# copied here. A function that returns nil is written as "U", which is
+# what ArmSelector gives for an arm that it can't find, and any that
+# raise an error are left out.
+
+script = File.read(File.expand_path('../scripts/polymarker_grassroots.rb', File.dirname(__FILE__)))
+eval(script[/ARM_SELECTION_FUNCTIONS = Hash.new;.*?(?=def validate_files)/m])
+
+# The same as the lambda made by the script's --arm_selection option
+def custom_arm_selection(rule)
+  arr = rule.split(",")
+  lambda do |contig_name|
+    separator, field = arr
+    field = field.to_i
+    ret = contig_name.split(separator)[field]
+    return ret
+  end
+end
+
+NAMES = [
+  "IWGSC_CSS_1AL_scaff_110", "1A", "1A_", "chr1A", "v443_x_", "v443_1234",
+  "v443__", "a_b_", "a_b__c", "_1A", "", "___", "IWGSC_CSS_1AL_",
+  "morex_1H:1-100", "x:y_z", "a_b_c:d_e", "chr3B|part2||", "a.b.c.d"
+]
+
+RULES = [
+  "arm_selection_embl", "arm_selection_first_two", "arm_selection_morex", "scaffold",
+  "_,0", "_,1", "_,2", "_,-1", "_,-2", "_,-5", "_,5", "|,1", "|,-1", ".,-1", ".,3", "::,0"
+]
+
+puts "# rule\tcontig\tarm"
+
+RULES.each do |rule|
+  fn = ARM_SELECTION_FUNCTIONS[rule.to_sym] || custom_arm_selection(rule)
+
+  NAMES.each do |name|
+    begin
+      arm = fn.call(name)
+    rescue StandardError
+      next
+    end
+
+    puts "#{rule}\t#{name}\t#{arm.nil? ? 'U' : arm}"
+  end
+end
@@ -0,0 +1,79 @@
+#!/usr/bin/env ruby
+#
+# Write primer3_core input that checks oligos of every length from 18 to
+# 35 bases as left and right primers, under the reaction conditions that
+# OligoThermodynamicsCalculator supports, so that primer3's Tm and end
+# stability for each of them can be captured for test_oligo_thermodynamics
+# to check against with polymarker_check_tm.
+#
+# Usage: ruby tests/capture_primer3_oligos.rb | primer3_core > tests/data/primer3_oligos.txt
+#
+# The oligos are random, with a fixed seed so that the same ones are
+# written each time, plus GC-rich, AT-rich and self-complementary ones.
+# Each record sets every limit wide enough that primer3 reports the
+# oligos whatever their values.
+
+MIN_LENGTH = 18
+MAX_LENGTH = 35
+
+# PRIMER_DNA_CONC, PRIMER_SALT_MONOVALENT, PRIMER_SALT_DIVALENT and PRIMER_DNTP_CONC
+CONDITIONS = [
+  [50.0, 50.0, 1.5, 0.6],
+  [50.0, 50.0, 0.0, 0.0],
+  [250.0, 100.0, 3.0, 0.8]
+]
+
+COMPLEMENTS = { "A" => "T", "C" => "G", "G" => "C", "T" => "A" }
+
+def reverse_complement(oligo)
+  oligo.reverse.chars.map { |c| COMPLEMENTS[c] }.join
+end
+
+def random_oligo(random, length, bases)
+  Array.new(length) { bases[random.rand(bases.size)] }.join
+end
+
+random = Random.new(0x5eed0023)
+oligos = []
+
+(MIN_LENGTH..MAX_LENGTH).each do |length|
+  3.times { oligos << random_oligo(random, length, "ACGT") }
+  oligos << random_oligo(random, length, "CGCGCGA")
+  oligos << random_oligo(random, length, "ATATATC")
+
+  half = random_oligo(random, length / 2, "ACGT")
+  oligos << half + (length.odd? ? "A" : "") + reverse_complement(half)
+end
+
+CONDITIONS.each do |dna_conc, monovalent_conc, divalent_conc, dntp_conc|
+  oligos.each_slice(2) do |left, right|
+    puts "SEQUENCE_ID=oligos_#{left.size}_#{right.size}"
+    puts "SEQUENCE_PRIMER=#{left}"
+    puts "SEQUENCE_PRIMER_REVCOMP=#{right}"
+    puts "PRIMER_TASK=check_primers"
+    puts "PRIMER_PICK_ANYWAY=1"
+    puts "PRIMER_PICK_INTERNAL_OLIGO=0"
+    puts "PRIMER_TM_FORMULA=1"
+    puts "PRIMER_SALT_CORRECTIONS=1"
+    puts "PRIMER_THERMODYNAMIC_OLIGO_ALIGNMENT=0"
+    puts "PRIMER_DNA_CONC=#{dna_conc}"
+    puts "PRIMER_SALT_MONOVALENT=#{monovalent_conc}"
+    puts "PRIMER_SALT_DIVALENT=#{divalent_conc}"
+    puts "PRIMER_DNTP_CONC=#{dntp_conc}"
+    puts "PRIMER_MIN_SIZE=#{MIN_LENGTH}"
+    puts "PRIMER_OPT_SIZE=#{MIN_LENGTH}"
+    puts "PRIMER_MAX_SIZE=#{MAX_LENGTH}"
+    puts "PRIMER_MIN_TM=0"
+    puts "PRIMER_MAX_TM=100"
+    puts "PRIMER_PAIR_MAX_DIFF_TM=100"
+    puts "PRIMER_MIN_GC=0"
+    puts "PRIMER_MAX_GC=100"
+    puts "PRIMER_MAX_POLY_X=#{MAX_LENGTH}"
+    puts "PRIMER_MAX_SELF_ANY=100"
+    puts "PRIMER_MAX_SELF_END=100"
+    puts "PRIMER_PAIR_MAX_COMPL_ANY=100"
+    puts "PRIMER_PAIR_MAX_COMPL_END=100"
+    puts "PRIMER_MAX_END_STABILITY=100"
+    puts "="
+  end
+end
@@ -0,0 +1,173 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_arm_selection.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that the ArmSelector gives the same arms as the arm
+ * selection functions of polymarker_grassroots.rb.
+ *
+ * Usage: test_arm_selection
+ *
+ * The arms are in data/arm_selections.tsv, whose directory is given
+ * by POLYMARKER_TEST_DATA_DIR when this is compiled. It was written by
+ * capture_arm_selections.rb from the script's own functions.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "arm_selection.hpp"
+
+#include "test_utils.hpp"
+
+
+#ifndef POLYMARKER_TEST_DATA_DIR
+#define POLYMARKER_TEST_DATA_DIR "data"
+#endif
+
+
+static const char * const S_ARMS_FILENAME_S = POLYMARKER_TEST_DATA_DIR "/arm_selections.tsv";
+
+/* The fewest lines that the file has, so that a truncated one is noticed */
+static const size_t S_MIN_NUM_ARMS = 250;
+
+
+static void TestRules ();
+
+static void TestArms ();
+
+
+int main ()
+{
+	const char * const TEST_S = "test_arm_selection";
+
+	TestRules ();
+	TestArms ();
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestRules ()
+{
+	ArmSelector selector;
+	const char * const valid_rules_ss [] = { "arm_selection_embl", "arm_selection_first_two", "arm_selection_morex", "scaffold", "_,0", "_,-1", "::,12", "|,+2" };
+	const char * const invalid_rules_ss [] = { "", "embl", "_", ",1", "_,", "_,x", "_,1x", "_,1,2", "_,99999999999" };
+
+	/* arm_selection_embl is the default, as in polymarker_grassroots.rb */
+	CHECK (strcmp (selector.GetRule (), ArmSelector :: AS_EMBL_S) == 0);
+
+	for (size_t i = 0; i < sizeof (valid_rules_ss) / sizeof (valid_rules_ss [0]); ++ i)
+		{
+			CHECK (selector.SetRule (valid_rules_ss [i]));
+			CHECK (strcmp (selector.GetRule (), valid_rules_ss [i]) == 0);
+			CHECK (IsValidArmSelection (valid_rules_ss [i]));
+		}
+
+	for (size_t i = 0; i < sizeof (invalid_rules_ss) / sizeof (invalid_rules_ss [0]); ++ i)
+		{
+			/* The previous rule is kept */
+			CHECK (!selector.SetRule (invalid_rules_ss [i]));
+			CHECK (strcmp (selector.GetRule (), "|,+2") == 0);
+			CHECK (!IsValidArmSelection (invalid_rules_ss [i]));
+		}
+}
+
+
+/*
+ * Each line of the file is "<rule>\t<contig>\t<arm>"
+ */
+static void TestArms ()
+{
+	FILE *in_f = fopen (S_ARMS_FILENAME_S, "r");
+	size_t num_arms = 0;
+
+	CHECK (in_f != NULL);
+
+	if (in_f)
+		{
+			ArmSelector selector;
+			std :: string arm;
+			char *line_s = NULL;
+			size_t line_buffer_size = 0;
+			ssize_t line_length;
+
+			while ((line_length = getline (&line_s, &line_buffer_size, in_f)) != -1)
+				{
+					char *contig_s;
+					char *expected_arm_s;
+
+					if (line_s [0] == '#')
+						{
+							continue;
+						}
+
+					if ((line_length > 0) && (line_s [line_length - 1] == '\n'))
+						{
+							line_s [-- line_length] = '\0';
+						}
+
+					contig_s = strchr (line_s, '\t');
+					expected_arm_s = contig_s ? strchr (contig_s + 1, '\t') : NULL;
+
+					CHECK (expected_arm_s != NULL);
+
+					if (expected_arm_s)
+						{
+							const char *arm_s = NULL;
+							size_t arm_length;
+							std :: string padded_contig;
+
+							*contig_s = '\0';
+							++ contig_s;
+							*expected_arm_s = '\0';
+							++ expected_arm_s;
+
+							CHECK (selector.SetRule (line_s));
+
+							selector.Select (contig_s, arm);
+
+							if (arm != expected_arm_s)
+								{
+									fprintf (stderr, "%s gives \"%s\" for \"%s\" rather than \"%s\"\n", line_s, arm.c_str (), contig_s, expected_arm_s);
+								}
+
+							CHECK (arm == expected_arm_s);
+
+							/* The name doesn't need to be terminated, e.g. when it is within a line of exonerate's output */
+							padded_contig.assign (contig_s);
+							padded_contig.append ("\t_x_y_z:");
+
+							arm_length = selector.Select (padded_contig.data (), strlen (contig_s), &arm_s);
+
+							CHECK ((arm_length == strlen (expected_arm_s)) && (strncmp (arm_s, expected_arm_s, arm_length) == 0));
+
+							++ num_arms;
+						}
+				}
+
+			free (line_s);
+			fclose (in_f);
+		}
+
+	CHECK (num_arms >= S_MIN_NUM_ARMS);
+}
@@ -0,0 +1,336 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_exonerate_parser.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the hits that the ExonerateParser reads from exonerate's
+ * output, whether it is given as a file, a pipe or in blocks of any size.
+ *
+ * Usage: test_exonerate_parser
+ *
+ * The output is in data/exonerate_output.txt, whose directory is given
+ * by POLYMARKER_TEST_DATA_DIR when this is compiled.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "exonerate_parser.hpp"
+
+#include "test_utils.hpp"
+
+
+#ifndef POLYMARKER_TEST_DATA_DIR
+#define POLYMARKER_TEST_DATA_DIR "data"
+#endif
+
+
+static const char * const S_OUTPUT_FILENAME_S = POLYMARKER_TEST_DATA_DIR "/exonerate_output.txt";
+
+
+/** The hits in the output file, in order. */
+static const PolymarkerHit S_EXPECTED_HITS [] =
+{
+	{ "BS00068396_51", 0, 101, '+', "IWGSC_CSS_1AL_scaff_1455974", 1343, 1444, '+', 505, 100.00, 101, 4154, ".", "\t M 101 101", "1A" },
+	{ "BS00068396_51", 0, 101, '+', "IWGSC_CSS_1BL_scaff_3810460", 2044, 1943, '-', 469, 97.03, 101, 5230, ".", "\t M 101 101", "1B" },
+	{ "BS00068396_51", 0, 101, '+', "IWGSC_CSS_1DL_scaff_2262734", 712, 815, '+', 449, 96.15, 101, 3078, ".", "\t M 35 35 G 0 2 M 66 66", "1D" },
+	{ "BS00020051_51", 3, 98, '+', "IWGSC_CSS_3B_scaff_10398512", 15112, 15207, '+', 430, 98.95, 101, 28710, ".", "\t M 95 95", "3B" },
+	{ "BS00020051_51", 0, 101, '+', "IWGSC_CSS_3AS_scaff_3290393", 9001, 8900, '-', 385, 92.08, 101, 11482, ".", "\t M 101 101", "3A" }
+};
+
+static const size_t S_NUM_EXPECTED_HITS = sizeof (S_EXPECTED_HITS) / sizeof (S_EXPECTED_HITS [0]);
+
+
+static bool ReadOutput (std :: string &output_r);
+
+static void CheckHits (const ExonerateHitTable &table_r, double min_identity);
+
+static void TestFile (const ArmSelector &selector_r);
+
+static void TestBlocks (const std :: string &output_r, const ArmSelector &selector_r);
+
+static void TestStream (const ArmSelector &selector_r);
+
+static void TestCallback (const std :: string &output_r);
+
+static void TestTable ();
+
+
+int main ()
+{
+	const char * const TEST_S = "test_exonerate_parser";
+	ArmSelector selector;
+	std :: string output;
+
+	CHECK (selector.SetRule (ArmSelector :: AS_EMBL_S));
+	CHECK (ReadOutput (output));
+
+	TestFile (selector);
+	TestBlocks (output, selector);
+	TestStream (selector);
+	TestCallback (output);
+	TestTable ();
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestFile (const ArmSelector &selector_r)
+{
+	ExonerateHitTable table;
+	ExonerateParser parser (table);
+
+	table.SetArmSelector (&selector_r);
+
+	CHECK (parser.ParseFile (S_OUTPUT_FILENAME_S));
+	CHECK (parser.GetNumHitLines () == S_NUM_EXPECTED_HITS);
+	CheckHits (table, 0.0);
+
+	/* The rows of each marker are in the order they were read */
+	CHECK (table.GetQueryHits ("BS00068396_51") == std :: vector <uint32> ({ 0, 1, 2 }));
+	CHECK (table.GetQueryHits ("BS00020051_51") == std :: vector <uint32> ({ 3, 4 }));
+	CHECK (table.GetQueryHits ("BS00000000_00").empty ());
+
+	/* Hits at or below the minimum identity are counted but not kept */
+	table.Clear ();
+	CHECK (table.GetNumHits () == 0);
+
+	ExonerateParser filtered_parser (table);
+
+	filtered_parser.SetMinIdentity (96.15);
+	CHECK (filtered_parser.ParseFile (S_OUTPUT_FILENAME_S));
+	CHECK (filtered_parser.GetNumHitLines () == S_NUM_EXPECTED_HITS);
+	CheckHits (table, 96.15);
+}
+
+
+/*
+ * A hit can be split across the blocks of output anywhere, including
+ * in the middle of a field or between a carriage return and its newline.
+ */
+static void TestBlocks (const std :: string &output_r, const ArmSelector &selector_r)
+{
+	std :: string crlf_output;
+
+	for (char c : output_r)
+		{
+			if (c == '\n')
+				{
+					crlf_output.push_back ('\r');
+				}
+
+			crlf_output.push_back (c);
+		}
+
+	for (size_t block_size = 1; block_size <= output_r.size (); block_size += (block_size < 100) ? 1 : 97)
+		{
+			for (int crlf = 0; crlf < 2; ++ crlf)
+				{
+					const std :: string &data_r = crlf ? crlf_output : output_r;
+					ExonerateHitTable table;
+					ExonerateParser parser (table);
+
+					table.SetArmSelector (&selector_r);
+
+					for (size_t i = 0; i < data_r.size (); i += block_size)
+						{
+							CHECK (parser.Parse (data_r.data () + i, std :: min (block_size, data_r.size () - i)));
+						}
+
+					CHECK (parser.Finish ());
+					CheckHits (table, 0.0);
+				}
+		}
+
+	/* The last line doesn't need a newline */
+	{
+		const size_t end = output_r.rfind ("\nRESULT:\tBS00020051_51 0 101 + IWGSC_CSS_3DS");
+		ExonerateHitTable table;
+		ExonerateParser parser (table);
+
+		table.SetArmSelector (&selector_r);
+
+		CHECK (parser.Parse (output_r.data (), end));
+		CHECK (table.GetNumHits () == S_NUM_EXPECTED_HITS - 1);
+		CHECK (parser.Finish ());
+		CheckHits (table, 0.0);
+	}
+}
+
+
+static void TestStream (const ArmSelector &selector_r)
+{
+	const std :: string command (std :: string ("cat ") + S_OUTPUT_FILENAME_S);
+	FILE *in_f = popen (command.c_str (), "r");
+
+	CHECK (in_f != 0);
+
+	if (in_f)
+		{
+			ExonerateHitTable table;
+			ExonerateParser parser (table);
+
+			table.SetArmSelector (&selector_r);
+
+			CHECK (parser.ParseStream (in_f));
+			CHECK (pclose (in_f) == 0);
+			CheckHits (table, 0.0);
+		}
+}
+
+
+static void TestCallback (const std :: string &output_r)
+{
+	ExonerateHitTable table;
+	ExonerateParser parser (table);
+	std :: vector <std :: string> lines;
+
+	parser.SetCallback ([&lines] (size_t row, const char *line_s, size_t line_length)
+		{
+			CHECK (row == lines.size ());
+			lines.push_back (std :: string (line_s, line_length));
+
+			/* Stop after the second hit */
+			return (lines.size () < 2);
+		});
+
+	CHECK (!parser.Parse (output_r.data (), output_r.size ()));
+	CHECK (lines.size () == 2);
+	CHECK (table.GetNumHits () == 2);
+
+	if (lines.size () == 2)
+		{
+			CHECK (lines [1] == "RESULT:\tBS00068396_51 0 101 + IWGSC_CSS_1BL_scaff_3810460 2044 1943 - 469\t97.03\t101\t5230\t.\t M 101 101\n");
+		}
+
+	/* Without an ArmSelector, there are no arms */
+	CHECK (table.GetArm (0).empty ());
+}
+
+
+static void TestTable ()
+{
+	ExonerateHitTable table;
+	ExonerateHitTable copy;
+	PolymarkerHit hit;
+	size_t row;
+
+	/* The hits made by the native aligner go through the same table */
+	row = table.AddHit (S_EXPECTED_HITS [2]);
+	CHECK (row == 0);
+	CHECK (table.GetQueryId (row) == "BS00068396_51");
+	CHECK (table.GetTargetId (row) == "IWGSC_CSS_1DL_scaff_2262734");
+
+	/* Move a hit from a window of a contig to the contig */
+	table.MoveTarget (row, "IWGSC_CSS_1DL_scaff_2262734_full", 10000, 50000);
+	table.GetHit (row, hit);
+	CHECK (hit.ph_target_id == "IWGSC_CSS_1DL_scaff_2262734_full");
+	CHECK (hit.ph_target_start == 10712);
+	CHECK (hit.ph_target_end == 10815);
+	CHECK (hit.ph_target_length == 50000);
+	CHECK (hit.ph_vulgar == S_EXPECTED_HITS [2].ph_vulgar);
+
+	/* Copy a hit between tables */
+	row = copy.AddHit (table, row);
+	copy.GetHit (row, hit);
+	CHECK (hit.ph_query_id == "BS00068396_51");
+	CHECK (hit.ph_target_id == "IWGSC_CSS_1DL_scaff_2262734_full");
+	CHECK (hit.ph_target_start == 10712);
+	CHECK (hit.ph_score == 449);
+}
+
+
+static void CheckHits (const ExonerateHitTable &table_r, double min_identity)
+{
+	size_t row = 0;
+
+	for (size_t i = 0; i < S_NUM_EXPECTED_HITS; ++ i)
+		{
+			const PolymarkerHit &expected_r = S_EXPECTED_HITS [i];
+
+			if (expected_r.ph_identity > min_identity)
+				{
+					PolymarkerHit hit;
+
+					CHECK (row < table_r.GetNumHits ());
+
+					if (row >= table_r.GetNumHits ())
+						{
+							return;
+						}
+
+					table_r.GetHit (row, hit);
+
+					CHECK (hit.ph_query_id == expected_r.ph_query_id);
+					CHECK (hit.ph_query_start == expected_r.ph_query_start);
+					CHECK (hit.ph_query_end == expected_r.ph_query_end);
+					CHECK (hit.ph_query_strand == expected_r.ph_query_strand);
+					CHECK (hit.ph_target_id == expected_r.ph_target_id);
+					CHECK (hit.ph_target_start == expected_r.ph_target_start);
+					CHECK (hit.ph_target_end == expected_r.ph_target_end);
+					CHECK (hit.ph_target_strand == expected_r.ph_target_strand);
+					CHECK (hit.ph_score == expected_r.ph_score);
+					CHECK (fabs (hit.ph_identity - expected_r.ph_identity) < 0.001);
+					CHECK (hit.ph_query_length == expected_r.ph_query_length);
+					CHECK (hit.ph_target_length == expected_r.ph_target_length);
+					CHECK (hit.ph_gene_orientation == expected_r.ph_gene_orientation);
+					CHECK (hit.ph_vulgar == expected_r.ph_vulgar);
+
+					if (table_r.GetArm (row).empty ())
+						{
+							CHECK (hit.ph_chromosome.empty ());
+						}
+					else
+						{
+							CHECK (hit.ph_chromosome == expected_r.ph_chromosome);
+							CHECK (table_r.GetArm (row) == expected_r.ph_chromosome);
+						}
+
+					++ row;
+				}
+		}
+
+	CHECK (row == table_r.GetNumHits ());
+}
+
+
+static bool ReadOutput (std :: string &output_r)
+{
+	FILE *in_f = fopen (S_OUTPUT_FILENAME_S, "r");
+
+	if (in_f)
+		{
+			char buffer [4096];
+			size_t num_read;
+
+			while ((num_read = fread (buffer, 1, sizeof (buffer), in_f)) > 0)
+				{
+					output_r.append (buffer, num_read);
+				}
+
+			fclose (in_f);
+			return !output_r.empty ();
+		}
+
+	fprintf (stderr, "Failed to open %s\n", S_OUTPUT_FILENAME_S);
+	return false;
+}
@@ -0,0 +1,358 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_kasp_selector.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the KASP scoring tables against the values in
+ * polymarker.rb and that the KASPSelector chooses and writes the same
+ * pairs whatever order the primer3 results arrive in.
+ *
+ * Usage: test_kasp_selector
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "kasp_selector.hpp"
+#include "polymarker_pipeline.hpp"
+
+#include "test_utils.hpp"
+
+
+static bool IsSameScores (const KASPScores &scores_r, int32 specific, int32 semispecific, int32 nonspecific, int32 product_size);
+
+static Primer3Result MakeResult (size_t marker_index, bool forward_flag, char type_c, bool first_allele_flag, const char *product_size_s);
+
+static PolymarkerMarker MakeMarker (const char *gene_s);
+
+static bool ReadFile (const std :: string &filename_r, std :: string &contents_r);
+
+static void TestTables ();
+
+static void TestJSON ();
+
+static void TestSelection (const std :: string &dir_r);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_kasp_selector";
+	const std :: string dir (MakeTestDirectory (TEST_S));
+
+	CHECK (!dir.empty ());
+
+	TestTables ();
+	TestJSON ();
+
+	if (!dir.empty ())
+		{
+			TestSelection (dir);
+
+			RemoveTestDirectory (dir);
+		}
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestTables ()
+{
+	KASPScores scores;
+
+	/* polymarker.rb's :genome_specific scores are the default */
+	CHECK (IsSameScores (scores, 1000, 100, 0, 0));
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_SPECIFIC_C) == 1000);
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_SEMISPECIFIC_C) == 100);
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_NONSPECIFIC_C) == 0);
+
+	/* and its :het_dels scores */
+	CHECK (scores.SetTable ("het_dels"));
+	CHECK (IsSameScores (scores, 0, 1000, 100, 0));
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_SPECIFIC_C) == 0);
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_SEMISPECIFIC_C) == 1000);
+	CHECK (scores.GetTypeScore (KASPSelector :: KS_TYPE_NONSPECIFIC_C) == 100);
+
+	/* An unknown table keeps the current scores */
+	CHECK (!scores.SetTable ("het_snps"));
+	CHECK (IsSameScores (scores, 0, 1000, 100, 0));
+
+	CHECK (scores.SetTable ("genome_specific"));
+	CHECK (IsSameScores (scores, 1000, 100, 0, 0));
+}
+
+
+static void TestJSON ()
+{
+	KASPScores scores;
+	json_t *value_p = json_string ("het_dels");
+
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (IsValidKASPScores (value_p));
+			CHECK (scores.SetFromJSON (value_p));
+			CHECK (IsSameScores (scores, 0, 1000, 100, 0));
+
+			json_decref (value_p);
+		}
+
+	value_p = json_string ("unknown");
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (!IsValidKASPScores (value_p));
+			CHECK (!scores.SetFromJSON (value_p));
+			CHECK (IsSameScores (scores, 0, 1000, 100, 0));
+
+			json_decref (value_p);
+		}
+
+	value_p = json_integer (1000);
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (!IsValidKASPScores (value_p));
+
+			json_decref (value_p);
+		}
+
+	/* An object starts from its table and overrides individual scores */
+	value_p = json_object ();
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (json_object_set_new (value_p, "table", json_string ("genome_specific")) == 0);
+			CHECK (json_object_set_new (value_p, "product_size", json_integer (-1)) == 0);
+
+			CHECK (scores.SetFromJSON (value_p));
+			CHECK (IsSameScores (scores, 1000, 100, 0, -1));
+
+			json_decref (value_p);
+		}
+
+	/* Without a table, the overrides apply to the current scores */
+	value_p = json_object ();
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (json_object_set_new (value_p, "chromosome_nonspecific", json_integer (50)) == 0);
+
+			CHECK (scores.SetFromJSON (value_p));
+			CHECK (IsSameScores (scores, 1000, 100, 50, -1));
+
+			json_decref (value_p);
+		}
+
+	/* and an unknown table leaves them all as they were */
+	value_p = json_object ();
+	CHECK (value_p != 0);
+
+	if (value_p)
+		{
+			CHECK (json_object_set_new (value_p, "table", json_string ("unknown")) == 0);
+			CHECK (json_object_set_new (value_p, "chromosome_specific", json_integer (1)) == 0);
+
+			CHECK (!IsValidKASPScores (value_p));
+			CHECK (!scores.SetFromJSON (value_p));
+			CHECK (IsSameScores (scores, 1000, 100, 50, -1));
+
+			json_decref (value_p);
+		}
+}
+
+
+static void TestSelection (const std :: string &dir_r)
+{
+	const char S = KASPSelector :: KS_TYPE_SPECIFIC_C;
+	const char s = KASPSelector :: KS_TYPE_SEMISPECIFIC_C;
+	const char n = KASPSelector :: KS_TYPE_NONSPECIFIC_C;
+	std :: vector <PolymarkerMarker> markers;
+	std :: vector <Primer3Result> results;
+	std :: string first_primers;
+	std :: string first_order;
+
+	markers.push_back (MakeMarker ("m0"));
+	markers.push_back (MakeMarker ("m1"));
+	markers.push_back (MakeMarker ("m2"));
+	markers.push_back (MakeMarker ("m3"));
+
+	/* Marker 0: the specific pair beats the shorter semispecific one */
+	results.push_back (MakeResult (0, true, s, true, "60"));
+	results.push_back (MakeResult (0, true, s, false, "60"));
+	results.push_back (MakeResult (0, false, S, true, "90"));
+	results.push_back (MakeResult (0, false, S, false, "90"));
+
+	/* Marker 1: of two specific pairs the shorter product is chosen */
+	results.push_back (MakeResult (1, true, S, true, "120"));
+	results.push_back (MakeResult (1, true, S, false, "120"));
+	results.push_back (MakeResult (1, false, S, true, "80"));
+	results.push_back (MakeResult (1, false, S, false, "80"));
+
+	/* Marker 2: a pair with only one allele's result isn't chosen */
+	results.push_back (MakeResult (2, true, S, true, "70"));
+	results.push_back (MakeResult (2, true, n, true, "75"));
+	results.push_back (MakeResult (2, true, n, false, "75"));
+
+	/* Marker 3: primer3 found nothing for one of the alleles */
+	results.push_back (MakeResult (3, true, S, true, "70"));
+	results.push_back (MakeResult (3, true, S, false, "70"));
+	results.back ().pr_num_returned = 0;
+
+	for (int pass = 0; pass < 2; ++ pass)
+		{
+			const std :: string primers_filename (dir_r + "/primers_" + std :: to_string (pass) + ".csv");
+			const std :: string order_filename (dir_r + "/primers_to_order_" + std :: to_string (pass) + ".csv");
+			KASPSelector selector;
+			std :: string primers;
+			std :: string order;
+
+			selector.Reset (markers.size ());
+
+			/* The results are copied as AddResult moves from them */
+			if (pass == 0)
+				{
+					for (size_t i = 0; i < results.size (); ++ i)
+						{
+							Primer3Result result (results [i]);
+							selector.AddResult (result);
+						}
+				}
+			else
+				{
+					for (size_t i = results.size (); i > 0; -- i)
+						{
+							Primer3Result result (results [i - 1]);
+							selector.AddResult (result);
+						}
+				}
+
+			CHECK (selector.Write (markers, primers_filename, order_filename));
+			CHECK (ReadFile (primers_filename, primers));
+			CHECK (ReadFile (order_filename, order));
+
+			if (pass == 0)
+				{
+					CHECK (primers.find ("m0,A11G,20,1A,3,,homoeologous,") != std :: string :: npos);
+					CHECK (primers.find ("R0SA,R0SB,L0SA,chromosome_specific,reverse,") != std :: string :: npos);
+					CHECK (primers.find (",exon,90,\n") != std :: string :: npos);
+
+					CHECK (primers.find ("L1SA,L1SB,R1SA,chromosome_specific,forward,") == std :: string :: npos);
+					CHECK (primers.find ("R1SA,R1SB,L1SA,chromosome_specific,reverse,") != std :: string :: npos);
+					CHECK (primers.find (",exon,80,\n") != std :: string :: npos);
+
+					CHECK (primers.find ("L2nA,L2nB,R2nA,chromosome_nonspecific,forward,") != std :: string :: npos);
+
+					CHECK (primers.find ("m3,A11G,20,1A,3,,homoeologous,,,,,,,,,,,primer3 didn't find a primer pair\n") != std :: string :: npos);
+
+					/* The FAM and HEX tails go on the first and second alleles */
+					CHECK (order.find ("Marker,SNP,Oligo,Sequence\n") == 0);
+					CHECK (order.find ("m0,A11G,m0_A,GAAGGTGACCAAGTTCATGCTR0SA\n") != std :: string :: npos);
+					CHECK (order.find ("m0,A11G,m0_G,GAAGGTCGGAGTCAACGGATTR0SB\n") != std :: string :: npos);
+					CHECK (order.find ("m0,A11G,m0_common,L0SA\n") != std :: string :: npos);
+					CHECK (order.find ("m3,") == std :: string :: npos);
+
+					first_primers = primers;
+					first_order = order;
+				}
+			else
+				{
+					CHECK (primers == first_primers);
+					CHECK (order == first_order);
+				}
+		}
+}
+
+
+static bool IsSameScores (const KASPScores &scores_r, int32 specific, int32 semispecific, int32 nonspecific, int32 product_size)
+{
+	return ((scores_r.ks_chromosome_specific == specific) &&
+		(scores_r.ks_chromosome_semispecific == semispecific) &&
+		(scores_r.ks_chromosome_nonspecific == nonspecific) &&
+		(scores_r.ks_product_size == product_size));
+}
+
+
+/*
+ * The primers are named after their side, marker, type and allele so that
+ * the columns they end up in can be checked.
+ */
+static Primer3Result MakeResult (size_t marker_index, bool forward_flag, char type_c, bool first_allele_flag, const char *product_size_s)
+{
+	Primer3Result result;
+	const std :: string suffix = std :: to_string (marker_index) + type_c + (first_allele_flag ? 'A' : 'B');
+
+	result.pr_id = KASPSelector :: MakeId (marker_index, forward_flag, type_c, first_allele_flag, -1);
+	result.pr_num_returned = 1;
+	result.pr_left = "L" + suffix;
+	result.pr_right = "R" + suffix;
+	result.pr_left_tm = "60.1";
+	result.pr_right_tm = "59.9";
+	result.pr_product_size = product_size_s;
+
+	return result;
+}
+
+
+static PolymarkerMarker MakeMarker (const char *gene_s)
+{
+	PolymarkerMarker marker;
+
+	marker.pm_gene = gene_s;
+	marker.pm_chromosome = "1A";
+	marker.pm_template = "ACGTACGTACRTACGTACGT";
+	marker.pm_snp_position = 10;
+	marker.pm_original = 'A';
+	marker.pm_snp = 'G';
+	marker.pm_target_chromosome = "1A";
+	marker.pm_total_contigs = 3;
+	marker.pm_snp_type = "homoeologous";
+	marker.pm_mask = "--------:-----------";
+
+	return marker;
+}
+
+
+static bool ReadFile (const std :: string &filename_r, std :: string &contents_r)
+{
+	FILE *in_f = fopen (filename_r.c_str (), "r");
+
+	if (in_f)
+		{
+			char buffer [4096];
+			size_t num_read;
+
+			while ((num_read = fread (buffer, 1, sizeof (buffer), in_f)) > 0)
+				{
+					contents_r.append (buffer, num_read);
+				}
+
+			fclose (in_f);
+			return !contents_r.empty ();
+		}
+
+	fprintf (stderr, "Failed to open %s\n", filename_r.c_str ());
+	return false;
+}
@@ -0,0 +1,266 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_marker_batch_scanner.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that scanning a genome with a MarkerBatchScanner finds
+ * the same windows for each marker as looking it up in a minimizer index
+ * of the same genome, however the genome is split between the threads.
+ *
+ * Usage: test_marker_batch_scanner <build directory>
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "marker_batch_scanner.hpp"
+#include "minimizer_index.hpp"
+
+#include "test_utils.hpp"
+
+
+/* The same k and w as the pipeline's ScanGenome and polymarker_build_minimizers */
+static const uint32 S_K = 15;
+
+static const uint32 S_W = 10;
+
+static const uint32 S_MAX_OCCURRENCES = 8;
+
+static const uint32 S_MARGIN = 50;
+
+static const size_t S_NUM_THREADS = 3;
+
+
+static void ScanGenome (const MarkerBatchScanner &scanner, const std :: vector <std :: string> &contigs_r, const char * const *names_ss, uint64 chunk_size, std :: vector <std :: vector <SeedWindow> > &windows_r);
+
+static bool IsSameWindows (std :: vector <SeedWindow> scanned, std :: vector <SeedWindow> indexed);
+
+static bool CompareWindows (const SeedWindow &a_r, const SeedWindow &b_r);
+
+static std :: string ReverseComplement (const std :: string &seq_r);
+
+
+int main (int argc, char *argv [])
+{
+	const char * const TEST_S = "test_marker_batch_scanner";
+	TestRandom random (0x5eed0020);
+	const std :: string dir (MakeTestDirectory (TEST_S));
+
+	if (argc != 2)
+		{
+			fprintf (stderr, "Usage: %s <build directory>\n", argv [0]);
+			return EXIT_FAILURE;
+		}
+
+	CHECK (!dir.empty ());
+
+	if (!dir.empty ())
+		{
+			const std :: string fasta_filename (dir + "/genome.fa");
+			const std :: string index_filename (dir + "/genome.minimizers");
+			const char * const names_ss [3] = { "chr1A", "chr1B", "chr1D" };
+			const size_t lengths [3] = { 20000, 9000, 31000 };
+			const std :: string repeat (random.Sequence (300));
+			std :: vector <std :: string> contigs;
+			std :: vector <std :: string> markers;
+			std :: string fasta;
+
+			for (int i = 0; i < 3; ++ i)
+				{
+					contigs.push_back (random.Sequence (lengths [i]));
+				}
+
+			/* A repeat whose minimizers occur more than S_MAX_OCCURRENCES times */
+			for (int i = 0; i < 6; ++ i)
+				{
+					contigs [0].replace (1000 + i * 2500, repeat.size (), repeat);
+					contigs [2].replace (3000 + i * 4000, repeat.size (), repeat);
+				}
+
+			/* Ambiguous bases restart the minimizer windows */
+			contigs [1].replace (4000, 40, 40, 'N');
+
+			for (int i = 0; i < 3; ++ i)
+				{
+					fasta.append (">").append (names_ss [i]).append ("\n").append (contigs [i]).append ("\n");
+				}
+
+			CHECK (WriteTestFile (fasta_filename, fasta));
+			CHECK (RunTestTool (argv [1], "polymarker_build_minimizers", fasta_filename + " " + index_filename));
+
+			/* Markers on both strands, with a SNP in the middle */
+			for (int i = 0; i < 30; ++ i)
+				{
+					const size_t contig = random.Below (3);
+					std :: string marker (contigs [contig].substr (random.Below ((unsigned int) (lengths [contig] - 200)), 200));
+
+					marker [100] = (marker [100] == 'A') ? 'C' : 'A';
+
+					markers.push_back ((i % 2 == 0) ? marker : ReverseComplement (marker));
+				}
+
+			/* Markers that are mostly the repeat, that span the ambiguous bases and that aren't in the genome */
+			markers.push_back (contigs [0].substr (950, 400));
+			markers.push_back (repeat);
+			markers.push_back (contigs [1].substr (3900, 240));
+			markers.push_back (random.Sequence (200));
+
+			MinimizerIndex index (index_filename.c_str ());
+
+			CHECK (index.Load ());
+
+			if (index.Load ())
+				{
+					MarkerBatchScanner scanner (S_K, S_W, S_MAX_OCCURRENCES);
+					const uint64 chunk_sizes [3] = { 777, 4096, 1 << 20 };
+					size_t num_placed = 0;
+
+					for (std :: vector <std :: string> :: const_iterator itr = markers.begin (); itr != markers.end (); ++ itr)
+						{
+							scanner.AddMarker (*itr);
+						}
+
+					scanner.Prepare ();
+
+					for (int i = 0; i < 3; ++ i)
+						{
+							std :: vector <std :: vector <SeedWindow> > scanned_windows;
+
+							ScanGenome (scanner, contigs, names_ss, chunk_sizes [i], scanned_windows);
+
+							CHECK (scanned_windows.size () == markers.size ());
+
+							for (size_t j = 0; (j < markers.size ()) && (j < scanned_windows.size ()); ++ j)
+								{
+									std :: vector <SeedWindow> indexed_windows;
+
+									index.FindWindows (markers [j], S_MAX_OCCURRENCES, S_MARGIN, indexed_windows);
+
+									if (!IsSameWindows (scanned_windows [j], indexed_windows))
+										{
+											fprintf (stderr, "marker " SIZET_FMT " has " SIZET_FMT " windows when scanned in chunks of " UINT64_FMT " and " SIZET_FMT " from the index\n", j, scanned_windows [j].size (), chunk_sizes [i], indexed_windows.size ());
+											CHECK (false);
+										}
+
+									if (!indexed_windows.empty ())
+										{
+											++ num_placed;
+										}
+								}
+						}
+
+					/* Make sure that the comparison isn't between two sets of nothing */
+					CHECK (num_placed >= 3 * 30);
+				}
+
+			RemoveTestDirectory (dir);
+		}
+
+	return FinishTest (TEST_S);
+}
+
+
+/*
+ * Scan the genome in the same way as PolymarkerPipeline::ScanGenome,
+ * with the chunks shared out between the threads' hits.
+ */
+static void ScanGenome (const MarkerBatchScanner &scanner, const std :: vector <std :: string> &contigs_r, const char * const *names_ss, uint64 chunk_size, std :: vector <std :: vector <SeedWindow> > &windows_r)
+{
+	const uint64 overlap = scanner.GetOverlap ();
+	std :: vector <MarkerScanHits> hits (S_NUM_THREADS);
+	size_t chunk_index = 0;
+
+	for (uint32 contig = 0; contig < contigs_r.size (); ++ contig)
+		{
+			const uint64 length = contigs_r [contig].size ();
+
+			for (uint64 start = 0; start < length; start += chunk_size, ++ chunk_index)
+				{
+					const uint64 end = std :: min (start + chunk_size, length);
+					const uint64 from = (start > overlap) ? start - overlap : 0;
+					const std :: string bases (contigs_r [contig].substr (from, std :: min (end + overlap, length) - from));
+
+					scanner.ScanRegion (bases.data (), bases.size (), from, contig, start, end, hits [chunk_index % S_NUM_THREADS]);
+				}
+		}
+
+	scanner.FindWindows (hits, S_MARGIN, [&] (uint32 contig, SeedWindow &window_r)
+		{
+			window_r.sw_contig = names_ss [contig];
+			window_r.sw_contig_length = contigs_r [contig].size ();
+		}, windows_r);
+}
+
+
+static bool IsSameWindows (std :: vector <SeedWindow> scanned, std :: vector <SeedWindow> indexed)
+{
+	if (scanned.size () != indexed.size ())
+		{
+			return false;
+		}
+
+	std :: sort (scanned.begin (), scanned.end (), CompareWindows);
+	std :: sort (indexed.begin (), indexed.end (), CompareWindows);
+
+	for (size_t i = 0; i < scanned.size (); ++ i)
+		{
+			const SeedWindow &a_r = scanned [i];
+			const SeedWindow &b_r = indexed [i];
+
+			if ((a_r.sw_contig != b_r.sw_contig) || (a_r.sw_contig_length != b_r.sw_contig_length) || (a_r.sw_start != b_r.sw_start) || (a_r.sw_end != b_r.sw_end) || (a_r.sw_num_seeds != b_r.sw_num_seeds))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+static bool CompareWindows (const SeedWindow &a_r, const SeedWindow &b_r)
+{
+	if (a_r.sw_contig != b_r.sw_contig)
+		{
+			return (a_r.sw_contig < b_r.sw_contig);
+		}
+
+	return (a_r.sw_start != b_r.sw_start) ? (a_r.sw_start < b_r.sw_start) : (a_r.sw_end < b_r.sw_end);
+}
+
+
+static std :: string ReverseComplement (const std :: string &seq_r)
+{
+	std :: string rc (seq_r.rbegin (), seq_r.rend ());
+
+	for (char &c : rc)
+		{
+			switch (c)
+				{
+					case 'A': c = 'T'; break;
+					case 'C': c = 'G'; break;
+					case 'G': c = 'C'; break;
+					case 'T': c = 'A'; break;
+					default: break;
+				}
+		}
+
+	return rc;
+}
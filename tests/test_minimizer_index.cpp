@@ -0,0 +1,363 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_minimizer_index.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the minimizer sketching against a brute-force version, the
+ * chaining of anchors into windows and the windows found for markers
+ * in an index built by polymarker_build_minimizers.
+ *
+ * Usage: test_minimizer_index <build directory>
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "minimizer_index.hpp"
+
+#include "test_utils.hpp"
+
+
+static const uint32 S_K = 15;
+
+static const uint32 S_W = 10;
+
+
+static std :: vector <MinimizerSeed> GetMinimizers (const std :: string &seq_r);
+
+static std :: vector <MinimizerSeed> GetMinimizersByBruteForce (const std :: string &seq_r);
+
+static std :: string ReverseComplement (const std :: string &seq_r);
+
+static void TestSketch (TestRandom &random_r);
+
+static void TestChainAnchors ();
+
+static void TestFindWindows (const char *build_dir_s, TestRandom &random_r);
+
+static const SeedWindow *FindWindow (const std :: vector <SeedWindow> &windows_r, const char *contig_s, uint64 start, uint64 end);
+
+
+int main (int argc, char *argv [])
+{
+	const char * const TEST_S = "test_minimizer_index";
+	TestRandom random (0x5eed0002);
+
+	if (argc != 2)
+		{
+			fprintf (stderr, "Usage: %s <build directory>\n", argv [0]);
+			return EXIT_FAILURE;
+		}
+
+	TestSketch (random);
+	TestChainAnchors ();
+	TestFindWindows (argv [1], random);
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestSketch (TestRandom &random_r)
+{
+	for (int i = 0; i < 20; ++ i)
+		{
+			std :: string seq (random_r.Sequence (500 + random_r.Below (2000)));
+			std :: vector <MinimizerSeed> forward;
+			std :: vector <MinimizerSeed> reverse;
+			std :: vector <MinimizerSeed> expected;
+
+			/* Ambiguous bases restart the windows */
+			if (i % 2 == 1)
+				{
+					seq [random_r.Below ((unsigned int) seq.size ())] = 'N';
+					seq [random_r.Below ((unsigned int) seq.size ())] = 'n';
+				}
+
+			forward = GetMinimizers (seq);
+			expected = GetMinimizersByBruteForce (seq);
+
+			CHECK (!forward.empty ());
+			CHECK (forward.size () == expected.size ());
+
+			if (forward.size () == expected.size ())
+				{
+					for (size_t j = 0; j < forward.size (); ++ j)
+						{
+							CHECK (forward [j].ms_hash == expected [j].ms_hash);
+							CHECK (forward [j].ms_position == expected [j].ms_position);
+							CHECK (forward [j].ms_strand == expected [j].ms_strand);
+						}
+				}
+
+			/* The same k-mers are chosen on the other strand, at the mirrored positions and with the opposite strand */
+			reverse = GetMinimizers (ReverseComplement (seq));
+
+			CHECK (forward.size () == reverse.size ());
+
+			if (forward.size () == reverse.size ())
+				{
+					for (size_t j = 0; j < forward.size (); ++ j)
+						{
+							const MinimizerSeed &rev_r = reverse [reverse.size () - 1 - j];
+
+							CHECK (forward [j].ms_hash == rev_r.ms_hash);
+							CHECK (forward [j].ms_position == seq.size () - S_K - rev_r.ms_position);
+							CHECK (forward [j].ms_strand != rev_r.ms_strand);
+						}
+				}
+		}
+}
+
+
+static void TestChainAnchors ()
+{
+	const uint64 contig_lengths [2] = { 5020, 10000 };
+	auto set_contig = [&contig_lengths] (uint32 contig, SeedWindow &window_r)
+		{
+			window_r.sw_contig = (contig == 0) ? "contig_0" : "contig_1";
+			window_r.sw_contig_length = contig_lengths [contig];
+		};
+	std :: vector <SeedAnchor> anchors;
+	std :: vector <SeedWindow> windows;
+	const SeedWindow *window_p;
+
+	/* 3 anchors up to 64 apart chain together, but the one 130 further on is on its own and is dropped */
+	anchors.push_back ({ 0, 0, 1070 });
+	anchors.push_back ({ 0, 0, 1000 });
+	anchors.push_back ({ 0, 0, 1010 });
+	anchors.push_back ({ 0, 0, 1200 });
+
+	/* On the reverse strand the window extends back by the query length and is clipped to the contig */
+	anchors.push_back ({ 0, 1, 5001 });
+	anchors.push_back ({ 0, 1, 5000 });
+
+	/* This is clipped to the start of the contig */
+	anchors.push_back ({ 1, 0, -20 });
+	anchors.push_back ({ 1, 0, 10 });
+
+	/* An anchor on the other strand at the same diagonal doesn't chain */
+	anchors.push_back ({ 1, 1, 10 });
+
+	CHECK (MinimizerIndex :: ChainAnchors (anchors, 100, 50, set_contig, windows) == 3);
+	CHECK (windows.size () == 3);
+
+	window_p = FindWindow (windows, "contig_0", 950, 1220);
+	CHECK (window_p != 0);
+	CHECK (window_p && (window_p -> sw_num_seeds == 3));
+
+	window_p = FindWindow (windows, "contig_0", 4850, 5020);
+	CHECK (window_p != 0);
+	CHECK (window_p && (window_p -> sw_num_seeds == 2));
+	CHECK (window_p && (window_p -> sw_contig_length == 5020));
+
+	window_p = FindWindow (windows, "contig_1", 0, 160);
+	CHECK (window_p != 0);
+
+	/* When there are too many chains, those with the most anchors are kept */
+	anchors.clear ();
+	windows.clear ();
+
+	for (int64 i = 0; i < 40; ++ i)
+		{
+			anchors.push_back ({ 1, 0, i * 200 });
+			anchors.push_back ({ 1, 0, i * 200 + 1 });
+		}
+
+	for (int64 i = 0; i < 5; ++ i)
+		{
+			anchors.push_back ({ 0, 0, 2000 + i });
+		}
+
+	CHECK (MinimizerIndex :: ChainAnchors (anchors, 100, 0, set_contig, windows) == 32);
+	CHECK (windows.size () == 32);
+	CHECK (FindWindow (windows, "contig_0", 2000, 2104) != 0);
+}
+
+
+static void TestFindWindows (const char *build_dir_s, TestRandom &random_r)
+{
+	const std :: string dir (MakeTestDirectory ("test_minimizer_index"));
+
+	CHECK (!dir.empty ());
+
+	if (!dir.empty ())
+		{
+			const std :: string fasta_filename (dir + "/genome.fa");
+			const std :: string index_filename (dir + "/genome.minimizers");
+			const char *names_ss [3] = { "chr1A", "chr1B", "chr1D" };
+			std :: vector <std :: string> contigs;
+			std :: string fasta;
+
+			for (int i = 0; i < 3; ++ i)
+				{
+					contigs.push_back (random_r.Sequence (20000));
+					fasta.append (">").append (names_ss [i]).append ("\n").append (contigs.back ()).append ("\n");
+				}
+
+			CHECK (WriteTestFile (fasta_filename, fasta));
+			CHECK (RunTestTool (build_dir_s, "polymarker_build_minimizers", fasta_filename + " " + index_filename));
+
+			MinimizerIndex index (index_filename.c_str ());
+
+			CHECK (index.Load ());
+
+			if (index.Load ())
+				{
+					std :: vector <SeedWindow> windows;
+					std :: string marker (contigs [1].substr (12000, 200));
+
+					/* A marker with a SNP in the middle is still placed */
+					marker [100] = (marker [100] == 'A') ? 'C' : 'A';
+
+					CHECK (index.FindWindows (marker, 100, 50, windows) == 1);
+					CHECK (FindWindow (windows, "chr1B", 11950, 12250) != 0);
+
+					/* and so is one from the reverse strand */
+					windows.clear ();
+					marker = ReverseComplement (contigs [2].substr (300, 200));
+
+					CHECK (index.FindWindows (marker, 100, 50, windows) == 1);
+					CHECK (FindWindow (windows, "chr1D", 250, 550) != 0);
+
+					/* A sequence that isn't in the genome isn't placed */
+					windows.clear ();
+					CHECK (index.FindWindows (random_r.Sequence (200), 100, 50, windows) == 0);
+				}
+
+			/* A file that isn't a minimizer index must be rejected */
+			MinimizerIndex not_index (fasta_filename.c_str ());
+			CHECK (!not_index.Load ());
+
+			RemoveTestDirectory (dir);
+		}
+}
+
+
+static std :: vector <MinimizerSeed> GetMinimizers (const std :: string &seq_r)
+{
+	std :: vector <MinimizerSeed> seeds;
+	auto add_seed = [&seeds] (const MinimizerSeed &seed_r)
+		{
+			seeds.push_back (seed_r);
+		};
+
+	SketchMinimizers (seq_r.data (), seq_r.size (), S_K, S_W, add_seed);
+
+	return seeds;
+}
+
+
+/*
+ * Hash every k-mer on its own and take the smallest of each window of
+ * S_W consecutive k-mers, within each stretch of unambiguous bases.
+ * S_K is odd so none of the k-mers are palindromes.
+ */
+static std :: vector <MinimizerSeed> GetMinimizersByBruteForce (const std :: string &seq_r)
+{
+	const uint64 mask = (((uint64) 1) << (2 * S_K)) - 1;
+	std :: vector <MinimizerSeed> seeds;
+	std :: vector <MinimizerSeed> kmers;
+	size_t run_start = 0;
+
+	for (size_t i = 0; i <= seq_r.size (); ++ i)
+		{
+			if ((i < seq_r.size ()) && (GetMinimizerBaseCode (seq_r [i]) < 4))
+				{
+					continue;
+				}
+
+			kmers.clear ();
+
+			for (size_t pos = run_start; pos + S_K <= i; ++ pos)
+				{
+					uint64 forward = 0;
+					uint64 reverse = 0;
+					MinimizerSeed kmer;
+
+					for (size_t j = 0; j < S_K; ++ j)
+						{
+							forward = (forward << 2) | GetMinimizerBaseCode (seq_r [pos + j]);
+							reverse = (reverse << 2) | (3 - GetMinimizerBaseCode (seq_r [pos + S_K - 1 - j]));
+						}
+
+					kmer.ms_strand = (forward < reverse) ? 0 : 1;
+					kmer.ms_hash = HashMinimizerKmer (kmer.ms_strand ? reverse : forward, mask);
+					kmer.ms_position = pos;
+					kmers.push_back (kmer);
+				}
+
+			for (size_t first = 0; first + S_W <= kmers.size (); ++ first)
+				{
+					const MinimizerSeed *min_p = &kmers [first];
+
+					for (size_t j = first + 1; j < first + S_W; ++ j)
+						{
+							if (kmers [j].ms_hash < min_p -> ms_hash)
+								{
+									min_p = &kmers [j];
+								}
+						}
+
+					if (seeds.empty () || (seeds.back ().ms_position != min_p -> ms_position))
+						{
+							seeds.push_back (*min_p);
+						}
+				}
+
+			run_start = i + 1;
+		}
+
+	return seeds;
+}
+
+
+static std :: string ReverseComplement (const std :: string &seq_r)
+{
+	std :: string rc (seq_r.rbegin (), seq_r.rend ());
+
+	for (char &c : rc)
+		{
+			switch (c)
+				{
+					case 'A': c = 'T'; break;
+					case 'C': c = 'G'; break;
+					case 'G': c = 'C'; break;
+					case 'T': c = 'A'; break;
+					default: break;
+				}
+		}
+
+	return rc;
+}
+
+
+static const SeedWindow *FindWindow (const std :: vector <SeedWindow> &windows_r, const char *contig_s, uint64 start, uint64 end)
+{
+	for (const SeedWindow &window_r : windows_r)
+		{
+			if ((window_r.sw_contig == contig_s) && (window_r.sw_start == start) && (window_r.sw_end == end))
+				{
+					return &window_r;
+				}
+		}
+
+	return 0;
+}
@@ -0,0 +1,547 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_oligo_thermodynamics.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the SSE4.1 and AVX2 nearest-neighbour sums against a
+ * scalar version, the melting temperatures and free energies against
+ * a plain version of primer3's formulae, the hairpin and dimer free
+ * energies and, with polymarker_check_tm, the melting temperatures and
+ * end stabilities against those that primer3_core gave.
+ *
+ * Usage: test_oligo_thermodynamics <build directory>
+ *
+ * The primer3_core output is read from the directory given by
+ * POLYMARKER_TEST_DATA_DIR when this is compiled. It was written by
+ * running primer3_core on the output of capture_primer3_oligos.rb.
+ */
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "oligo_thermodynamics.hpp"
+#include "oligo_thermodynamics_kernel.hpp"
+
+#include "test_utils.hpp"
+
+
+#ifndef POLYMARKER_TEST_DATA_DIR
+#define POLYMARKER_TEST_DATA_DIR "data"
+#endif
+
+
+static const char * const S_PRIMER3_OUTPUT_FILENAME_S = POLYMARKER_TEST_DATA_DIR "/primer3_oligos.txt";
+
+/* The shortest and longest oligos that the primer3_core output has */
+static const size_t S_PRIMER3_MIN_LENGTH = 18;
+
+static const size_t S_PRIMER3_MAX_LENGTH = 35;
+
+/* The widest vector of the summing kernels, in oligos */
+static const uint32 S_MAX_WIDTH = 32;
+
+static const uint32 S_MAX_STACKS = OligoBatch :: OB_MAX_LENGTH - 1;
+
+
+static void TestKernels (TestRandom &random_r);
+
+static void TestCalculator (TestRandom &random_r);
+
+static void TestFreeEnergies (TestRandom &random_r);
+
+static void TestPrimer3Output (const char *build_dir_s);
+
+static void SumByReference (const NearestNeighbourInput *input_p);
+
+static bool GetReferenceValues (const std :: string &oligo_r, const OligoConditions &conditions_r, OligoThermodynamics &values_r);
+
+static double GetReferenceFreeEnergy (const std :: string &oligo_r);
+
+static int GetStack (const int table [4][4], const char *dinucleotide_s);
+
+
+int main (int argc, char *argv [])
+{
+	const char * const TEST_S = "test_oligo_thermodynamics";
+	TestRandom random (0x5eed0005);
+
+	if (argc != 2)
+		{
+			fprintf (stderr, "Usage: %s <build directory>\n", argv [0]);
+			return EXIT_FAILURE;
+		}
+
+	CHECK (OligoThermodynamicsCalculator :: GetKernelName () != 0);
+
+	TestKernels (random);
+	TestCalculator (random);
+	TestFreeEnergies (random);
+	TestPrimer3Output (argv [1]);
+
+	return FinishTest (TEST_S);
+}
+
+
+/*
+ * Random stacks and tables, with oligos of every length up to the
+ * longest and padding after each one, summed by each kernel.
+ */
+static void TestKernels (TestRandom &random_r)
+{
+	#ifdef NN_HAVE_X86_KERNELS
+	bool sse41_flag;
+	bool avx2_flag;
+
+	__builtin_cpu_init ();
+	sse41_flag = __builtin_cpu_supports ("sse4.1");
+	avx2_flag = __builtin_cpu_supports ("avx2");
+
+	if (!sse41_flag)
+		{
+			printf ("skipping the SSE4.1 kernel as the CPU doesn't support it\n");
+		}
+
+	if (!avx2_flag)
+		{
+			printf ("skipping the AVX2 kernel as the CPU doesn't support it\n");
+		}
+
+	for (int i = 0; i < 50; ++ i)
+		{
+			const uint32 num_oligos = S_MAX_WIDTH * (1 + random_r.Below (4));
+			const uint32 stride = num_oligos + S_MAX_WIDTH * random_r.Below (2);
+			const uint32 max_stacks = 1 + random_r.Below (S_MAX_STACKS);
+			std :: vector <uint8> stacks (max_stacks * stride, NN_STACK_PADDING);
+			uint8 tables [3][NN_NUM_STACKS];
+			std :: vector <uint16> expected (3 * stride, 0);
+			NearestNeighbourInput input;
+
+			for (uint32 t = 0; t < 3; ++ t)
+				{
+					for (uint32 j = 0; j < NN_NUM_STACKS; ++ j)
+						{
+							tables [t][j] = (uint8) random_r.Below (256);
+						}
+				}
+
+			for (uint32 oligo = 0; oligo < num_oligos; ++ oligo)
+				{
+					const uint32 num_stacks = random_r.Below (max_stacks + 1);
+
+					for (uint32 p = 0; p < num_stacks; ++ p)
+						{
+							stacks [p * stride + oligo] = (uint8) random_r.Below (NN_NUM_STACKS);
+						}
+				}
+
+			input.nni_stacks_p = stacks.data ();
+			input.nni_num_oligos = num_oligos;
+			input.nni_stride = stride;
+			input.nni_max_stacks = max_stacks;
+			input.nni_enthalpy_table_p = tables [0];
+			input.nni_entropy_table_p = tables [1];
+			input.nni_free_energy_table_p = tables [2];
+			input.nni_enthalpy_sums_p = expected.data ();
+			input.nni_entropy_sums_p = expected.data () + stride;
+			input.nni_free_energy_sums_p = expected.data () + 2 * stride;
+
+			SumByReference (&input);
+
+			for (int k = 0; k < 2; ++ k)
+				{
+					if (k == 0 ? sse41_flag : avx2_flag)
+						{
+							std :: vector <uint16> sums (3 * stride, 0);
+
+							input.nni_enthalpy_sums_p = sums.data ();
+							input.nni_entropy_sums_p = sums.data () + stride;
+							input.nni_free_energy_sums_p = sums.data () + 2 * stride;
+
+							if (k == 0)
+								{
+									SumNearestNeighbourSSE41 (&input);
+								}
+							else
+								{
+									SumNearestNeighbourAVX2 (&input);
+								}
+
+							CHECK (sums == expected);
+						}
+				}
+		}
+	#else
+	printf ("skipping the vector kernels as there are none for this platform\n");
+	#endif
+}
+
+
+static void TestCalculator (TestRandom &random_r)
+{
+	std :: vector <std :: string> oligos;
+	std :: vector <OligoConditions> conditions (3);
+	OligoBatch batch;
+
+	/* Every length that can be used and some that can't */
+	for (uint32 length = 1; length <= OligoBatch :: OB_MAX_LENGTH + 1; ++ length)
+		{
+			for (int i = 0; i < 5; ++ i)
+				{
+					oligos.push_back (random_r.Sequence (length));
+				}
+		}
+
+	/* Oligos that are their own reverse complement */
+	oligos.push_back ("ACGT");
+	oligos.push_back ("GAATTC");
+	oligos.push_back ("ACGTACGTACGTACGTACGT");
+
+	/* Soft-masked and ambiguous bases */
+	oligos.push_back ("acgtacgtacgtaCGTACGG");
+	oligos.push_back ("ACGTNACGTACGTACGTA");
+	oligos.push_back ("ACGTACGTACGTACGTAR");
+	oligos.push_back ("");
+
+	/* No divalent cations, and more divalent cations than dNTPs */
+	conditions [1].oc_divalent_conc = 0.0;
+	conditions [2].oc_divalent_conc = 3.0;
+	conditions [2].oc_dntp_conc = 0.8;
+	conditions [2].oc_monovalent_conc = 100.0;
+	conditions [2].oc_dna_conc = 250.0;
+
+	for (const OligoConditions &conditions_r : conditions)
+		{
+			OligoThermodynamicsCalculator calculator (conditions_r);
+			std :: vector <OligoThermodynamics> values;
+
+			/* Reuse the batch each time, as the pipeline does */
+			batch.Clear ();
+
+			for (size_t i = 0; i < oligos.size (); ++ i)
+				{
+					CHECK (batch.Add (oligos [i].data (), oligos [i].size ()) == i);
+				}
+
+			CHECK (batch.GetNumOligos () == oligos.size ());
+
+			calculator.Calculate (batch, values);
+			CHECK (values.size () == oligos.size ());
+
+			for (size_t i = 0; i < values.size () && i < oligos.size (); ++ i)
+				{
+					OligoThermodynamics expected;
+
+					CHECK (values [i].ot_valid_flag == GetReferenceValues (oligos [i], conditions_r, expected));
+
+					if (values [i].ot_valid_flag && expected.ot_valid_flag)
+						{
+							CHECK (fabs (values [i].ot_tm - expected.ot_tm) < 1e-6);
+							CHECK (fabs (values [i].ot_delta_g - expected.ot_delta_g) < 1e-6);
+							CHECK (fabs (values [i].ot_end_stability - expected.ot_end_stability) < 1e-6);
+						}
+				}
+		}
+}
+
+
+static void TestFreeEnergies (TestRandom &random_r)
+{
+	const char * const COMPLEMENTS_S = "TGCA";
+
+	/* An oligo and its reverse complement form the duplex that ot_delta_g is for */
+	for (uint32 length = 2; length <= 40; ++ length)
+		{
+			const std :: string oligo (random_r.Sequence (length));
+			std :: string complement;
+			OligoThermodynamics expected;
+
+			for (std :: string :: const_reverse_iterator itr = oligo.rbegin (); itr != oligo.rend (); ++ itr)
+				{
+					complement.push_back (COMPLEMENTS_S [strchr ("ACGT", *itr) - "ACGT"]);
+				}
+
+			if (GetReferenceValues (oligo, OligoConditions (), expected))
+				{
+					const double delta_g = OligoThermodynamicsCalculator :: GetDimerDeltaG (oligo.data (), oligo.size (), complement.data (), complement.size ());
+
+					/* Another alignment of them could only be more stable */
+					CHECK (delta_g <= std :: min (expected.ot_delta_g, 0.0) + 1e-9);
+
+					/* but as every stack adds more than an AT end costs, none of them is */
+					if (expected.ot_delta_g < 0.0)
+						{
+							CHECK (fabs (delta_g - expected.ot_delta_g) < 1e-9);
+						}
+
+					/* Which way round they are makes no difference */
+					CHECK (fabs (OligoThermodynamicsCalculator :: GetDimerDeltaG (complement.data (), complement.size (), oligo.data (), oligo.size ()) - delta_g) < 1e-9);
+				}
+		}
+
+	/* A self-complementary oligo's self dimer */
+	{
+		const std :: string oligo ("ACGTACGTACGTACGTACGT");
+		OligoThermodynamics expected;
+
+		CHECK (GetReferenceValues (oligo, OligoConditions (), expected));
+		CHECK (fabs (OligoThermodynamicsCalculator :: GetDimerDeltaG (oligo.data (), oligo.size (), oligo.data (), oligo.size ()) - expected.ot_delta_g) < 1e-9);
+	}
+
+	/* Oligos that can't pair with each other */
+	CHECK (OligoThermodynamicsCalculator :: GetDimerDeltaG ("AAAAAAAA", 8, "AAAAAAAA", 8) == 0.0);
+	CHECK (OligoThermodynamicsCalculator :: GetDimerDeltaG ("ACNNGT", 6, "TTTTTT", 6) == 0.0);
+	CHECK (OligoThermodynamicsCalculator :: GetDimerDeltaG ("ACGT", 4, "", 0) == 0.0);
+
+	/*
+	 * Just the CCGG in the middle of the self dimer pairs: initiation
+	 * 1.96, CC -1.84, CG -2.17 and GG -1.84.
+	 */
+	CHECK (fabs (OligoThermodynamicsCalculator :: GetDimerDeltaG ("AACCGGAA", 8, "AACCGGAA", 8) - -3.89) < 1e-9);
+
+	/*
+	 * A stem of GCGC closing a loop of 4: the stacks GC -2.24, CG -2.17
+	 * and GC -2.24 with the loop's 3.5.
+	 */
+	CHECK (fabs (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCAAAAGCGC", 12) - -3.15) < 1e-9);
+
+	/* The same with an AT pair at the open end of the stem, AG -1.28 and 0.05 */
+	CHECK (fabs (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("AGCGCAAAAGCGCT", 14) - -4.38) < 1e-9);
+
+	/* A loop of 3 is the shortest, so a loop of 2 leaves the stem one pair shorter, GC -2.24 and CG -2.17 */
+	CHECK (fabs (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCTTTGCGC", 11) - -3.15) < 1e-9);
+	CHECK (fabs (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCAAGCGC", 10) - -0.91) < 1e-9);
+
+	/* Stems too weak to make up for the loop and oligos that can't fold */
+	CHECK (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("ATAAAAAAAT", 10) == 0.0);
+	CHECK (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("AAAAAAAAAAAAAAAAAAAA", 20) == 0.0);
+	CHECK (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("", 0) == 0.0);
+
+	/* Longer loops cost more */
+	CHECK (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCGCAAAAAAAAAAAGCGCGC", 23) > OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCGCAAAAGCGCGC", 16));
+	CHECK (OligoThermodynamicsCalculator :: GetHairpinDeltaG ("GCGCGCAAAAGCGCGC", 16) < 0.0);
+}
+
+
+/*
+ * Check the values that primer3_core gave for oligos of each length
+ * that the pipeline designs, using polymarker_check_tm so that the tool
+ * is run as well.
+ */
+static void TestPrimer3Output (const char *build_dir_s)
+{
+	FILE *in_f = fopen (S_PRIMER3_OUTPUT_FILENAME_S, "r");
+
+	if (in_f)
+		{
+			std :: set <size_t> lengths;
+			char line_s [1024];
+
+			while (fgets (line_s, sizeof (line_s), in_f))
+				{
+					const char *value_s = strchr (line_s, '=');
+
+					if (value_s && (strncmp (line_s, "PRIMER_LEFT_", 12) == 0 || strncmp (line_s, "PRIMER_RIGHT_", 13) == 0) && strstr (line_s, "_SEQUENCE="))
+						{
+							lengths.insert (strcspn (value_s + 1, "\r\n"));
+						}
+				}
+
+			fclose (in_f);
+
+			for (size_t length = S_PRIMER3_MIN_LENGTH; length <= S_PRIMER3_MAX_LENGTH; ++ length)
+				{
+					CHECK (lengths.count (length) == 1);
+				}
+
+			CHECK (RunTestTool (build_dir_s, "polymarker_check_tm", std :: string (S_PRIMER3_OUTPUT_FILENAME_S) + " " + std :: to_string (S_PRIMER3_MAX_LENGTH)));
+		}
+	else
+		{
+			printf ("skipping the primer3_core values as there is no \"%s\", see capture_primer3_oligos.rb\n", S_PRIMER3_OUTPUT_FILENAME_S);
+		}
+}
+
+
+static void SumByReference (const NearestNeighbourInput *input_p)
+{
+	for (uint32 i = 0; i < input_p -> nni_num_oligos; ++ i)
+		{
+			uint32 enthalpy = 0;
+			uint32 entropy = 0;
+			uint32 free_energy = 0;
+
+			for (uint32 p = 0; p < input_p -> nni_max_stacks; ++ p)
+				{
+					const uint8 code = input_p -> nni_stacks_p [p * input_p -> nni_stride + i];
+
+					if (code != NN_STACK_PADDING)
+						{
+							enthalpy += input_p -> nni_enthalpy_table_p [code];
+							entropy += input_p -> nni_entropy_table_p [code];
+							free_energy += input_p -> nni_free_energy_table_p [code];
+						}
+				}
+
+			input_p -> nni_enthalpy_sums_p [i] = (uint16) enthalpy;
+			input_p -> nni_entropy_sums_p [i] = (uint16) entropy;
+			input_p -> nni_free_energy_sums_p [i] = (uint16) free_energy;
+		}
+}
+
+
+/*
+ * SantaLucia's 1998 unified parameters, as primer3 stores them: the
+ * negatives of the enthalpies in 100 cal/mol, of the entropies in
+ * 0.1 cal/K/mol and of the free energies in 10 cal/mol. Row i, column j
+ * is the stack of base i followed by base j, in the order A, C, G, T.
+ */
+static const int S_ENTHALPIES [4][4] = { { 79, 84, 78, 72 }, { 85, 80, 106, 78 }, { 82, 98, 80, 84 }, { 72, 82, 85, 79 } };
+static const int S_ENTROPIES [4][4] = { { 222, 224, 210, 204 }, { 227, 199, 272, 210 }, { 222, 244, 199, 224 }, { 213, 222, 227, 222 } };
+static const int S_FREE_ENERGIES [4][4] = { { 100, 144, 128, 88 }, { 145, 184, 217, 128 }, { 130, 224, 184, 144 }, { 58, 130, 145, 100 } };
+
+
+/*
+ * A plain version of primer3's oligotm () and oligodg () with the
+ * SantaLucia method and salt correction, done in the same order.
+ */
+static bool GetReferenceValues (const std :: string &oligo_r, const OligoConditions &conditions_r, OligoThermodynamics &values_r)
+{
+	std :: string oligo (oligo_r);
+	double monovalent_conc = conditions_r.oc_monovalent_conc;
+	double divalent_conc = conditions_r.oc_divalent_conc;
+	double dntp_conc = conditions_r.oc_dntp_conc;
+	bool symmetric_flag = ((oligo.size () & 1) == 0);
+	int dh = 0;
+	int ds = 0;
+	double enthalpy;
+	double entropy;
+
+	values_r.ot_valid_flag = false;
+
+	for (char &c : oligo)
+		{
+			c = (char) toupper (c);
+
+			if ((c != 'A') && (c != 'C') && (c != 'G') && (c != 'T'))
+				{
+					return false;
+				}
+		}
+
+	if ((oligo.size () < 2) || (oligo.size () > OligoBatch :: OB_MAX_LENGTH))
+		{
+			return false;
+		}
+
+	for (size_t i = 0; symmetric_flag && (i < oligo.size () / 2); ++ i)
+		{
+			const char c = oligo [oligo.size () - 1 - i];
+
+			symmetric_flag = (oligo [i] == ((c == 'A') ? 'T' : (c == 'C') ? 'G' : (c == 'G') ? 'C' : 'A'));
+		}
+
+	if (divalent_conc == 0.0)
+		{
+			dntp_conc = 0.0;
+		}
+
+	if (divalent_conc < dntp_conc)
+		{
+			divalent_conc = dntp_conc;
+		}
+
+	monovalent_conc += 120.0 * sqrt (divalent_conc - dntp_conc);
+
+	if (symmetric_flag)
+		{
+			ds += 14;
+		}
+
+	/* The initiation at each end */
+	for (const char end : { oligo.front (), oligo.back () })
+		{
+			if ((end == 'A') || (end == 'T'))
+				{
+					ds += -41;
+					dh += -23;
+				}
+			else
+				{
+					ds += 28;
+					dh += -1;
+				}
+		}
+
+	for (size_t i = 0; i + 1 < oligo.size (); ++ i)
+		{
+			dh += GetStack (S_ENTHALPIES, oligo.c_str () + i);
+			ds += GetStack (S_ENTROPIES, oligo.c_str () + i);
+		}
+
+	enthalpy = dh * -100.0;
+	entropy = ds * -0.1;
+	entropy += 0.368 * (oligo.size () - 1) * log (monovalent_conc / 1000.0);
+
+	values_r.ot_tm = enthalpy / (entropy + 1.987 * log (conditions_r.oc_dna_conc / (symmetric_flag ? 1000000000.0 : 4000000000.0))) - 273.15;
+	values_r.ot_delta_g = - GetReferenceFreeEnergy (oligo);
+	values_r.ot_end_stability = GetReferenceFreeEnergy (oligo.size () > 5 ? oligo.substr (oligo.size () - 5) : oligo);
+	values_r.ot_valid_flag = true;
+
+	return true;
+}
+
+
+/*
+ * The negative of the free energy in kcal/mol, including the initiation.
+ */
+static double GetReferenceFreeEnergy (const std :: string &oligo_r)
+{
+	int dg = -196;
+
+	if ((oligo_r.front () == 'A') || (oligo_r.front () == 'T'))
+		{
+			dg += -5;
+		}
+
+	if ((oligo_r.back () == 'A') || (oligo_r.back () == 'T'))
+		{
+			dg += -5;
+		}
+
+	for (size_t i = 0; i + 1 < oligo_r.size (); ++ i)
+		{
+			dg += GetStack (S_FREE_ENERGIES, oligo_r.c_str () + i);
+		}
+
+	return dg / 100.0;
+}
+
+
+static int GetStack (const int table [4][4], const char *dinucleotide_s)
+{
+	const char * const BASES_S = "ACGT";
+
+	return table [strchr (BASES_S, dinucleotide_s [0]) - BASES_S][strchr (BASES_S, dinucleotide_s [1]) - BASES_S];
+}
@@ -0,0 +1,235 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_packed_sequence_file.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that the regions fetched from a packed sequence file,
+ * built by polymarker_pack_fasta, match those from the fasta file.
+ *
+ * Usage: test_packed_sequence_file <build directory>
+ */
+
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "fasta_file.hpp"
+#include "packed_sequence_file.hpp"
+
+#include "test_utils.hpp"
+
+
+struct TestContig
+{
+	std :: string tc_name;
+	std :: string tc_seq;
+};
+
+
+static std :: vector <TestContig> MakeContigs (TestRandom &random_r);
+
+static std :: string MakeFasta (const std :: vector <TestContig> &contigs_r, size_t line_length);
+
+static std :: string GetExpectedBases (const std :: string &seq_r, size_t start, size_t end);
+
+static std :: string GetRegionBases (const FastaRegion &region_r);
+
+
+int main (int argc, char *argv [])
+{
+	const char * const TEST_S = "test_packed_sequence_file";
+	TestRandom random (0x5eed0001);
+	std :: vector <TestContig> contigs (MakeContigs (random));
+	std :: string dir;
+
+	if (argc != 2)
+		{
+			fprintf (stderr, "Usage: %s <build directory>\n", argv [0]);
+			return EXIT_FAILURE;
+		}
+
+	dir = MakeTestDirectory (TEST_S);
+	CHECK (!dir.empty ());
+
+	if (!dir.empty ())
+		{
+			const std :: string fasta_filename (dir + "/genome.fa");
+			const std :: string packed_filename (dir + "/genome.packed");
+
+			CHECK (WriteTestFile (fasta_filename, MakeFasta (contigs, 60)));
+			CHECK (RunTestTool (argv [1], "polymarker_pack_fasta", fasta_filename + " " + packed_filename));
+
+			FastaFile fasta (fasta_filename.c_str ());
+			PackedSequenceFile packed (packed_filename.c_str ());
+
+			CHECK (fasta.Load ());
+			CHECK (packed.Load ());
+			CHECK (packed.GetNumContigs () == contigs.size ());
+			CHECK (fasta.GetNumContigs () == contigs.size ());
+
+			if ((packed.GetNumContigs () == contigs.size ()) && (fasta.GetNumContigs () == contigs.size ()))
+				{
+					FastaRegion region;
+
+					for (size_t i = 0; i < contigs.size (); ++ i)
+						{
+							const TestContig &contig_r = contigs [i];
+							const char *name_s = contig_r.tc_name.c_str ();
+							const size_t length = contig_r.tc_seq.size ();
+
+							CHECK (contig_r.tc_name == packed.GetContigName (i));
+							CHECK (packed.GetContigLength (i) == length);
+							CHECK (fasta.GetContigLength (i) == length);
+
+							/* The whole contig */
+							CHECK (packed.GetRegion (name_s, 0, length, region));
+							CHECK (GetRegionBases (region) == GetExpectedBases (contig_r.tc_seq, 0, length));
+
+							/* The end is clipped to the length of the contig */
+							CHECK (packed.GetRegion (name_s, length - 1, length + 100, region));
+							CHECK (region.size () == 1);
+
+							/* Random regions, including ones that start or end part way through a byte or a run of Ns */
+							for (int j = 0; j < 200; ++ j)
+								{
+									const size_t start = random.Below ((unsigned int) length);
+									const size_t end = start + random.Below ((unsigned int) (length - start)) + 1;
+									const std :: string expected (GetExpectedBases (contig_r.tc_seq, start, end));
+									std :: string seq;
+
+									CHECK (packed.GetRegion (name_s, start, end, region));
+									CHECK (GetRegionBases (region) == expected);
+
+									/* The decoded bases should be the same whether they come one at a time or in bulk */
+									seq.clear ();
+									region.AppendTo (seq);
+									CHECK (seq == expected);
+
+									CHECK (fasta.GetRegion (name_s, start, end, region));
+									CHECK (GetExpectedBases (GetRegionBases (region), 0, end - start) == expected);
+								}
+						}
+
+					CHECK (!packed.GetRegion ("not_a_contig", 0, 10, region));
+					CHECK (packed.GetContig ("not_a_contig") == 0);
+				}
+
+			/* A file that isn't a packed sequence file must be rejected */
+			PackedSequenceFile not_packed (fasta_filename.c_str ());
+			CHECK (!not_packed.Load ());
+
+			RemoveTestDirectory (dir);
+		}
+
+	return FinishTest (TEST_S);
+}
+
+
+/*
+ * The contigs have runs of Ns at the start and end, runs that cross
+ * line and byte boundaries, soft-masked bases and IUPAC codes so that
+ * every case of the packing is covered.
+ */
+static std :: vector <TestContig> MakeContigs (TestRandom &random_r)
+{
+	std :: vector <TestContig> contigs;
+	TestContig contig;
+
+	contig.tc_name = "chr1A_part1";
+	contig.tc_seq = std :: string (7, 'N') + random_r.Sequence (1000) + std :: string (61, 'N') + random_r.Sequence (333) + std :: string (3, 'N');
+	contigs.push_back (contig);
+
+	contig.tc_name = "chr1B_part1";
+	contig.tc_seq = random_r.Sequence (2049);
+
+	for (size_t i = 100; i < 200; ++ i)
+		{
+			contig.tc_seq [i] = (char) tolower (contig.tc_seq [i]);
+		}
+
+	contig.tc_seq [500] = 'R';
+	contig.tc_seq [501] = 'y';
+	contig.tc_seq [1024] = 'n';
+	contigs.push_back (contig);
+
+	/* A contig shorter than a byte of packed bases */
+	contig.tc_name = "chr1D_part1";
+	contig.tc_seq = "GAT";
+	contigs.push_back (contig);
+
+	contig.tc_name = "chrUn";
+	contig.tc_seq = random_r.Sequence (129);
+	contigs.push_back (contig);
+
+	return contigs;
+}
+
+
+static std :: string MakeFasta (const std :: vector <TestContig> &contigs_r, size_t line_length)
+{
+	std :: string fasta;
+
+	for (const TestContig &contig_r : contigs_r)
+		{
+			fasta.append (">").append (contig_r.tc_name).append (" test contig\n");
+
+			for (size_t i = 0; i < contig_r.tc_seq.size (); i += line_length)
+				{
+					fasta.append (contig_r.tc_seq, i, line_length).append ("\n");
+				}
+		}
+
+	return fasta;
+}
+
+
+/*
+ * A packed sequence file has no soft-masking and has N for any base
+ * other than A, C, G or T.
+ */
+static std :: string GetExpectedBases (const std :: string &seq_r, size_t start, size_t end)
+{
+	std :: string expected (seq_r, start, end - start);
+
+	for (char &c : expected)
+		{
+			c = (char) toupper (c);
+
+			if ((c != 'A') && (c != 'C') && (c != 'G') && (c != 'T'))
+				{
+					c = 'N';
+				}
+		}
+
+	return expected;
+}
+
+
+static std :: string GetRegionBases (const FastaRegion &region_r)
+{
+	std :: string seq;
+
+	for (size_t i = 0; i < region_r.size (); ++ i)
+		{
+			seq.push_back (region_r [i]);
+		}
+
+	return seq;
+}
@@ -0,0 +1,146 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_polymarker_batch_files.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that the markers of two requests against the same database
+ * are merged into a single markers_list and that the results of the one
+ * run are split back so each job gets only its own rows of primers.csv,
+ * primers_to_order.csv and the exons file.
+ *
+ * Usage: test_polymarker_batch_files
+ *
+ * The PolymarkerBatcher itself needs a Grassroots server to run its jobs,
+ * so this checks the files that it writes and splits for a batch.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "polymarker_batch_files.hpp"
+
+#include "test_utils.hpp"
+
+
+static std :: string ReadFile (const std :: string &filename_r);
+
+static bool MakeDirectory (const std :: string &dir_r);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_polymarker_batch_files";
+	const std :: string dir (MakeTestDirectory (TEST_S));
+
+	CHECK (!dir.empty ());
+
+	if (!dir.empty ())
+		{
+			const std :: string batch_dir (dir + "/batch");
+			const std :: string job_dirs [2] = { dir + "/request_a", dir + "/request_b" };
+			const std :: string header ("Marker,SNP,RegionSize,chromosome,total_contigs,contig_regions,SNP_type,A,B,common,primer_type,orientation,A_TM,B_TM,common_TM,selected_from,product_size,errors,is_repetitive,hit_count\n");
+			PolymarkerBatchFiles files (batch_dir.c_str ());
+
+			CHECK (MakeDirectory (batch_dir));
+
+			for (int i = 0; i < 2; ++ i)
+				{
+					CHECK (MakeDirectory (job_dirs [i]));
+					files.AddJobDirectory (job_dirs [i].c_str ());
+				}
+
+			/* Both requests use the same marker name, one with a chromosome and one without */
+			CHECK (WriteTestFile (job_dirs [0] + "/markers_list", "IWB1,1A,ACGTACGT[A/G]TTGACCA\nIWB2,IWB2,GGGCCCAA[C/T]AAATTTGG\n"));
+			CHECK (WriteTestFile (job_dirs [1] + "/markers_list", "IWB1,3B,TTTTACGT[G/T]CCCCAAAA\n"));
+
+			CHECK (files.WriteMarkers ());
+			CHECK (ReadFile (batch_dir + "/markers_list") == "job0_IWB1,1A,ACGTACGT[A/G]TTGACCA\njob0_IWB2,job0_IWB2,GGGCCCAA[C/T]AAATTTGG\njob1_IWB1,3B,TTTTACGT[G/T]CCCCAAAA\n");
+
+			/* The outputs of the single run, in the order that the pipeline wrote them */
+			CHECK (WriteTestFile (batch_dir + "/primers.csv", header +
+				"job1_IWB1,G/T,200,3B,3,3,homoeologous,a1,b1,c1,chromosome_specific,forward,60.1,60.2,59.9,exon,101,,false,1\n"
+				"job0_IWB1,A/G,200,1A,3,3,homoeologous,a2,b2,c2,chromosome_specific,reverse,61.1,61.2,60.9,exon,99,,false,1\n"
+				"job0_IWB2,C/T,200,,1,1,non-homoeologous,a3,b3,c3,chromosome_semispecific,forward,58.1,58.2,58.3,exon,120,,false,1\n"));
+			CHECK (WriteTestFile (batch_dir + "/exons_genes_and_contigs.fa",
+				">job0_IWB1\nACGTACGTATTGACCA\n>1A_contig job0_IWB1\nACGTACGTGTTGACCA\n"
+				">job1_IWB1\nTTTTACGTGCCCCAAAA\n"
+				">job0_IWB2\nGGGCCCAACAAATTTGG\n>MASK job0_IWB2\n---------**------\n"));
+			CHECK (WriteTestFile (batch_dir + "/primers_to_order.csv", "Marker,Primer,Sequence\njob0_IWB1,job0_IWB1_A,GTACGTA\njob1_IWB1,job1_IWB1_B,ACGTG\n"));
+			CHECK (WriteTestFile (batch_dir + "/status.txt", "Primers found\n"));
+
+			/* A job's status file already has its own lines */
+			CHECK (WriteTestFile (job_dirs [1] + "/status.txt", "Preparing\n"));
+
+			CHECK (files.SplitResults ());
+
+			CHECK (ReadFile (job_dirs [0] + "/primers.csv") == header +
+				"IWB1,A/G,200,1A,3,3,homoeologous,a2,b2,c2,chromosome_specific,reverse,61.1,61.2,60.9,exon,99,,false,1\n"
+				"IWB2,C/T,200,,1,1,non-homoeologous,a3,b3,c3,chromosome_semispecific,forward,58.1,58.2,58.3,exon,120,,false,1\n");
+			CHECK (ReadFile (job_dirs [1] + "/primers.csv") == header +
+				"IWB1,G/T,200,3B,3,3,homoeologous,a1,b1,c1,chromosome_specific,forward,60.1,60.2,59.9,exon,101,,false,1\n");
+
+			CHECK (ReadFile (job_dirs [0] + "/exons_genes_and_contigs.fa") == ">IWB1\nACGTACGTATTGACCA\n>1A_contig IWB1\nACGTACGTGTTGACCA\n>IWB2\nGGGCCCAACAAATTTGG\n>MASK IWB2\n---------**------\n");
+			CHECK (ReadFile (job_dirs [1] + "/exons_genes_and_contigs.fa") == ">IWB1\nTTTTACGTGCCCCAAAA\n");
+
+			CHECK (ReadFile (job_dirs [0] + "/primers_to_order.csv") == "Marker,Primer,Sequence\nIWB1,IWB1_A,GTACGTA\n");
+			CHECK (ReadFile (job_dirs [1] + "/primers_to_order.csv") == "Marker,Primer,Sequence\nIWB1,IWB1_B,ACGTG\n");
+
+			CHECK (ReadFile (job_dirs [0] + "/status.txt") == "Primers found\n");
+			CHECK (ReadFile (job_dirs [1] + "/status.txt") == "Preparing\nPrimers found\n");
+
+			/* A run that wrote no primers can't be split */
+			CHECK (WriteTestFile (batch_dir + "/primers.csv", ""));
+			CHECK (!files.SplitResults ());
+
+			RemoveTestDirectory (dir);
+		}
+
+	return FinishTest (TEST_S);
+}
+
+
+static std :: string ReadFile (const std :: string &filename_r)
+{
+	std :: string contents;
+	FILE *in_f = fopen (filename_r.c_str (), "r");
+
+	if (in_f)
+		{
+			char buffer [4096];
+			size_t num_read;
+
+			while ((num_read = fread (buffer, 1, sizeof (buffer), in_f)) > 0)
+				{
+					contents.append (buffer, num_read);
+				}
+
+			fclose (in_f);
+		}
+
+	return contents;
+}
+
+
+static bool MakeDirectory (const std :: string &dir_r)
+{
+	return (mkdir (dir_r.c_str (), S_IRWXU) == 0);
+}
@@ -0,0 +1,382 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_polymarker_scheduler.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that a PolymarkerScheduler keeps to its overall and
+ * per-database limits, even for the PolymarkerSequences of different
+ * services, and starts the queued runs in priority order, first in first
+ * out within each priority, reporting the queue position of each job.
+ *
+ * Usage: test_polymarker_scheduler
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "polymarker_scheduler.hpp"
+#include "polymarker_tool.hpp"
+
+#include "test_utils.hpp"
+
+
+/** A run that the test submits, which records when it is started. */
+struct TestRun
+{
+	std :: vector <PolymarkerServiceJob *> tr_jobs;
+	std :: vector <const TestRun *> *tr_started_p;
+};
+
+
+/** A pair of services, each with their own copy of the same two databases. */
+struct TestServices
+{
+	PolymarkerServiceData ts_data [2];
+	PolymarkerSequence ts_seqs [2][2];
+	std :: string ts_fasta_filenames [2][2];
+};
+
+
+static void TestLimits ();
+
+static void TestPerDatabaseLimits ();
+
+static void TestPriorities ();
+
+static void SetUpServices (TestServices &services_r);
+
+static PolymarkerServiceJob *MakeJob (std :: vector <PolymarkerServiceJob *> &jobs_r, PolymarkerJobPriority priority);
+
+static bool Submit (PolymarkerScheduler &scheduler_r, TestRun &run_r, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p, std :: vector <const TestRun *> &started_r);
+
+static void CompleteRun (PolymarkerScheduler &scheduler_r, const TestRun &run_r);
+
+static void FreeJobs (std :: vector <PolymarkerServiceJob *> &jobs_r);
+
+static bool StartTestRun (void *data_p);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_polymarker_scheduler";
+
+	TestLimits ();
+	TestPerDatabaseLimits ();
+	TestPriorities ();
+
+	return FinishTest (TEST_S);
+}
+
+
+/*
+ * Only two runs may go at once. A batch's run only frees its slot once
+ * all of its jobs have completed.
+ */
+static void TestLimits ()
+{
+	PolymarkerScheduler scheduler (2, 0);
+	TestServices services;
+	std :: vector <PolymarkerServiceJob *> jobs;
+	std :: vector <const TestRun *> started;
+	TestRun runs [4];
+
+	SetUpServices (services);
+
+	for (int i = 0; i < 4; ++ i)
+		{
+			runs [i].tr_jobs.push_back (MakeJob (jobs, PJP_NORMAL));
+		}
+
+	/* The first run is a batch of three jobs */
+	runs [0].tr_jobs.push_back (MakeJob (jobs, PJP_NORMAL));
+	runs [0].tr_jobs.push_back (MakeJob (jobs, PJP_NORMAL));
+
+	for (int i = 0; i < 4; ++ i)
+		{
+			CHECK (Submit (scheduler, runs [i], &services.ts_seqs [i % 2][i / 2], &services.ts_data [i % 2], started));
+		}
+
+	CHECK (started.size () == 2);
+	CHECK ((started.size () == 2) && (started [0] == &runs [0]) && (started [1] == &runs [1]));
+
+	for (int i = 0; i < 3; ++ i)
+		{
+			CHECK (scheduler.GetQueuePosition (runs [0].tr_jobs [i]) == 0);
+		}
+
+	CHECK (scheduler.GetQueuePosition (runs [2].tr_jobs [0]) == 1);
+	CHECK (scheduler.GetQueuePosition (runs [3].tr_jobs [0]) == 2);
+
+	/* Completing some of the batch's jobs doesn't free its slot */
+	scheduler.JobCompleted (runs [0].tr_jobs [0]);
+	scheduler.JobCompleted (runs [0].tr_jobs [1]);
+	CHECK (started.size () == 2);
+
+	/* and completing one twice, or a job that isn't running, does nothing */
+	scheduler.JobCompleted (runs [0].tr_jobs [1]);
+	scheduler.JobCompleted (runs [3].tr_jobs [0]);
+	CHECK (started.size () == 2);
+	CHECK (scheduler.GetQueuePosition (runs [3].tr_jobs [0]) == 2);
+
+	scheduler.JobCompleted (runs [0].tr_jobs [2]);
+	CHECK ((started.size () == 3) && (started [2] == &runs [2]));
+	CHECK (scheduler.GetQueuePosition (runs [3].tr_jobs [0]) == 1);
+
+	CompleteRun (scheduler, runs [1]);
+	CHECK ((started.size () == 4) && (started [3] == &runs [3]));
+	CHECK (scheduler.GetQueuePosition (runs [3].tr_jobs [0]) == 0);
+
+	/* A run that wasn't started by the scheduler's own start function can't be removed from the queue */
+	CHECK (!scheduler.RemoveQueuedJob (runs [3].tr_jobs [0]));
+
+	CompleteRun (scheduler, runs [2]);
+	CompleteRun (scheduler, runs [3]);
+
+	FreeJobs (jobs);
+}
+
+
+/*
+ * Each service has its own PolymarkerSequence for a database, so the
+ * runs from two services against the same FASTA file must share that
+ * database's limit, while a database's own limit overrides the default.
+ */
+static void TestPerDatabaseLimits ()
+{
+	PolymarkerScheduler scheduler (0, 1);
+	TestServices services;
+	std :: vector <PolymarkerServiceJob *> jobs;
+	std :: vector <const TestRun *> started;
+	TestRun runs [6];
+
+	SetUpServices (services);
+
+	/* The second database allows two runs at once */
+	services.ts_seqs [0][1].ps_max_concurrent_jobs = 2;
+	services.ts_seqs [1][1].ps_max_concurrent_jobs = 2;
+
+	for (int i = 0; i < 6; ++ i)
+		{
+			runs [i].tr_jobs.push_back (MakeJob (jobs, PJP_NORMAL));
+		}
+
+	/* The first database from each service */
+	CHECK (Submit (scheduler, runs [0], &services.ts_seqs [0][0], &services.ts_data [0], started));
+	CHECK (Submit (scheduler, runs [1], &services.ts_seqs [1][0], &services.ts_data [1], started));
+
+	CHECK ((started.size () == 1) && (started [0] == &runs [0]));
+	CHECK (scheduler.GetQueuePosition (runs [1].tr_jobs [0]) == 1);
+
+	/* A run against another database isn't held up by the one waiting in front of it */
+	CHECK (Submit (scheduler, runs [2], &services.ts_seqs [1][1], &services.ts_data [1], started));
+	CHECK (Submit (scheduler, runs [3], &services.ts_seqs [0][1], &services.ts_data [0], started));
+	CHECK (Submit (scheduler, runs [4], &services.ts_seqs [1][1], &services.ts_data [1], started));
+
+	CHECK ((started.size () == 3) && (started [1] == &runs [2]) && (started [2] == &runs [3]));
+	CHECK (scheduler.GetQueuePosition (runs [1].tr_jobs [0]) == 1);
+	CHECK (scheduler.GetQueuePosition (runs [4].tr_jobs [0]) == 2);
+
+	CompleteRun (scheduler, runs [0]);
+	CHECK ((started.size () == 4) && (started [3] == &runs [1]));
+	CHECK (scheduler.GetQueuePosition (runs [4].tr_jobs [0]) == 1);
+
+	CompleteRun (scheduler, runs [3]);
+	CHECK ((started.size () == 5) && (started [4] == &runs [4]));
+
+	/* Once a database's runs have all finished, its count starts again */
+	CompleteRun (scheduler, runs [1]);
+	CHECK (Submit (scheduler, runs [5], &services.ts_seqs [0][0], &services.ts_data [0], started));
+	CHECK ((started.size () == 6) && (started [5] == &runs [5]));
+
+	CompleteRun (scheduler, runs [2]);
+	CompleteRun (scheduler, runs [4]);
+	CompleteRun (scheduler, runs [5]);
+
+	FreeJobs (jobs);
+}
+
+
+/*
+ * With one slot, which is taken, the queued runs start from the highest
+ * priority queue first and in the order that they were submitted within
+ * each. A batch is queued at the priority of its most urgent job.
+ */
+static void TestPriorities ()
+{
+	const PolymarkerJobPriority priorities [] = { PJP_LOW, PJP_NORMAL, PJP_HIGH, PJP_NORMAL, PJP_LOW, PJP_HIGH };
+	const size_t num_queued = sizeof (priorities) / sizeof (priorities [0]);
+	/* The runs' indices in the order that they should start, the batch being the third high priority run */
+	const size_t expected_order [] = { 3, 6, 7, 2, 4, 1, 5 };
+	const size_t num_runs = sizeof (expected_order) / sizeof (expected_order [0]);
+	PolymarkerScheduler scheduler (1, 0);
+	TestServices services;
+	std :: vector <PolymarkerServiceJob *> jobs;
+	std :: vector <const TestRun *> started;
+	TestRun runs [num_queued + 2];
+
+	SetUpServices (services);
+
+	runs [0].tr_jobs.push_back (MakeJob (jobs, PJP_LOW));
+	CHECK (Submit (scheduler, runs [0], &services.ts_seqs [0][0], &services.ts_data [0], started));
+	CHECK (started.size () == 1);
+
+	for (size_t i = 0; i < num_queued; ++ i)
+		{
+			runs [i + 1].tr_jobs.push_back (MakeJob (jobs, priorities [i]));
+			CHECK (Submit (scheduler, runs [i + 1], &services.ts_seqs [i % 2][0], &services.ts_data [i % 2], started));
+		}
+
+	/* A batch of a normal and a high priority job goes in behind the other high priority runs */
+	runs [num_queued + 1].tr_jobs.push_back (MakeJob (jobs, PJP_NORMAL));
+	runs [num_queued + 1].tr_jobs.push_back (MakeJob (jobs, PJP_HIGH));
+	CHECK (Submit (scheduler, runs [num_queued + 1], &services.ts_seqs [1][1], &services.ts_data [1], started));
+
+	CHECK (started.size () == 1);
+
+	for (size_t i = 0; i < num_runs; ++ i)
+		{
+			const TestRun &run_r = runs [expected_order [i]];
+
+			for (size_t j = 0; j < run_r.tr_jobs.size (); ++ j)
+				{
+					CHECK (scheduler.GetQueuePosition (run_r.tr_jobs [j]) == i + 1);
+				}
+		}
+
+	for (size_t i = 0; i < num_runs; ++ i)
+		{
+			CompleteRun (scheduler, * (started.back ()));
+
+			CHECK ((started.size () == i + 2) && (started.back () == &runs [expected_order [i]]));
+			CHECK (scheduler.GetQueuePosition (runs [expected_order [i]].tr_jobs [0]) == 0);
+
+			/* The runs behind it have all moved up one */
+			for (size_t j = i + 1; j < num_runs; ++ j)
+				{
+					CHECK (scheduler.GetQueuePosition (runs [expected_order [j]].tr_jobs [0]) == j - i);
+				}
+		}
+
+	CompleteRun (scheduler, * (started.back ()));
+
+	FreeJobs (jobs);
+}
+
+
+static void SetUpServices (TestServices &services_r)
+{
+	const char * const fasta_filenames_ss [2] = { "/data/iwgsc_refseqv1.0.fa", "/data/Triticum_aestivum.IWGSC.dna.toplevel.fa" };
+
+	memset (services_r.ts_data, 0, sizeof (services_r.ts_data));
+	memset (services_r.ts_seqs, 0, sizeof (services_r.ts_seqs));
+
+	for (int i = 0; i < 2; ++ i)
+		{
+			for (int j = 0; j < 2; ++ j)
+				{
+					PolymarkerSequence *seq_p = &services_r.ts_seqs [i][j];
+
+					/* Each service has its own copy of the filename, read from its own configuration */
+					services_r.ts_fasta_filenames [i][j].assign (fasta_filenames_ss [j]);
+					seq_p -> ps_fasta_filename_s = services_r.ts_fasta_filenames [i][j].c_str ();
+					seq_p -> ps_priority = PJP_NORMAL;
+				}
+		}
+}
+
+
+static PolymarkerServiceJob *MakeJob (std :: vector <PolymarkerServiceJob *> &jobs_r, PolymarkerJobPriority priority)
+{
+	PolymarkerServiceJob *job_p = new PolymarkerServiceJob;
+
+	memset (job_p, 0, sizeof (*job_p));
+	job_p -> psj_priority = priority;
+	jobs_r.push_back (job_p);
+
+	return job_p;
+}
+
+
+static bool Submit (PolymarkerScheduler &scheduler_r, TestRun &run_r, const PolymarkerSequence *seq_p, const PolymarkerServiceData *data_p, std :: vector <const TestRun *> &started_r)
+{
+	run_r.tr_started_p = &started_r;
+
+	return scheduler_r.Submit (run_r.tr_jobs, seq_p, StartTestRun, &run_r, data_p);
+}
+
+
+static void CompleteRun (PolymarkerScheduler &scheduler_r, const TestRun &run_r)
+{
+	for (size_t i = 0; i < run_r.tr_jobs.size (); ++ i)
+		{
+			scheduler_r.JobCompleted (run_r.tr_jobs [i]);
+		}
+}
+
+
+static void FreeJobs (std :: vector <PolymarkerServiceJob *> &jobs_r)
+{
+	for (size_t i = 0; i < jobs_r.size (); ++ i)
+		{
+			delete jobs_r [i];
+		}
+
+	jobs_r.clear ();
+}
+
+
+static bool StartTestRun (void *data_p)
+{
+	TestRun *run_p = static_cast <TestRun *> (data_p);
+
+	run_p -> tr_started_p -> push_back (run_p);
+
+	return true;
+}
+
+
+/*
+ * The scheduler's C functions for queueing a single job call into the
+ * rest of the service, which isn't linked into this test. None of them
+ * are used here so these just stand in for them.
+ */
+
+OperationStatus RunPolymarkerTool (PolymarkerTool * UNUSED_PARAM (tool_p))
+{
+	return OS_FAILED_TO_START;
+}
+
+
+void PolymarkerServiceJobCompleted (ServiceJob * UNUSED_PARAM (job_p))
+{
+}
+
+
+const PolymarkerSequence *PolymarkerTool :: GetPolymarkerSequence () const
+{
+	return pt_seq_p;
+}
+
+
+const PolymarkerServiceData *PolymarkerTool :: GetServiceData () const
+{
+	return pt_service_data_p;
+}
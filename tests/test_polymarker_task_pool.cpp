@@ -0,0 +1,262 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_polymarker_task_pool.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check that a PolymarkerTaskPool runs every task once, stops
+ * starting tasks once one has failed and that results merged by task
+ * index, as the pipeline merges its shards, are the same whatever the
+ * number of threads.
+ *
+ * Usage: test_polymarker_task_pool
+ */
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "polymarker_task_pool.hpp"
+
+#include "test_utils.hpp"
+
+
+static void TestEveryTaskRuns ();
+
+static void TestMergeOrder ();
+
+static void TestFailure ();
+
+static std :: string RunShards (PolymarkerTaskPool &pool_r, size_t num_shards);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_polymarker_task_pool";
+
+	TestEveryTaskRuns ();
+	TestMergeOrder ();
+	TestFailure ();
+
+	return FinishTest (TEST_S);
+}
+
+
+/*
+ * Run batches of different sizes on the same pools so that the threads
+ * are reused, checking that each task runs exactly once and that no two
+ * tasks are run with the same thread index at the same time.
+ */
+static void TestEveryTaskRuns ()
+{
+	const uint32 thread_counts [] = { 1, 2, 3, 4, 8 };
+	const size_t task_counts [] = { 0, 1, 2, 7, 100, 1000, 3 };
+
+	for (uint32 num_threads : thread_counts)
+		{
+			PolymarkerTaskPool pool (num_threads);
+
+			CHECK (pool.GetNumThreads () == num_threads);
+
+			for (size_t num_tasks : task_counts)
+				{
+					std :: vector <std :: atomic <uint32> > runs (num_tasks);
+					std :: vector <std :: atomic <bool> > busy_threads (num_threads);
+					std :: atomic <uint32> num_clashes (0);
+					std :: atomic <uint32> num_bad_threads (0);
+
+					for (size_t i = 0; i < num_tasks; ++ i)
+						{
+							runs [i] = 0;
+						}
+
+					for (uint32 i = 0; i < num_threads; ++ i)
+						{
+							busy_threads [i] = false;
+						}
+
+					CHECK (pool.Run (num_tasks, [&] (size_t task_index, uint32 thread_index)
+						{
+							if (thread_index >= num_threads)
+								{
+									++ num_bad_threads;
+									return true;
+								}
+
+							if (busy_threads [thread_index].exchange (true))
+								{
+									++ num_clashes;
+								}
+
+							++ runs [task_index];
+
+							/* Make some tasks take long enough for the others to be stolen */
+							if (task_index % 17 == 0)
+								{
+									usleep (200);
+								}
+
+							busy_threads [thread_index] = false;
+
+							return true;
+						}));
+
+					CHECK (num_bad_threads.load () == 0);
+					CHECK (num_clashes.load () == 0);
+
+					for (size_t i = 0; i < num_tasks; ++ i)
+						{
+							CHECK (runs [i].load () == 1);
+						}
+				}
+		}
+
+	/* A pool given no threads still runs its tasks on the calling thread */
+	PolymarkerTaskPool pool (0);
+	size_t num_run = 0;
+
+	CHECK (pool.GetNumThreads () == 1);
+	CHECK (pool.Run (5, [&num_run] (size_t UNUSED_PARAM (task_index), uint32 UNUSED_PARAM (thread_index)) { ++ num_run; return true; }));
+	CHECK (num_run == 5);
+}
+
+
+/*
+ * The tasks finish in a different order each time, so merging their
+ * results in the order that they finished would differ, but merging
+ * them by task index must not.
+ */
+static void TestMergeOrder ()
+{
+	PolymarkerTaskPool single_pool (1);
+	const std :: string expected (RunShards (single_pool, 64));
+
+	CHECK (!expected.empty ());
+
+	for (uint32 num_threads = 2; num_threads <= 6; ++ num_threads)
+		{
+			PolymarkerTaskPool pool (num_threads);
+
+			for (int i = 0; i < 3; ++ i)
+				{
+					CHECK (RunShards (pool, 64) == expected);
+				}
+		}
+}
+
+
+static void TestFailure ()
+{
+	/* On a single thread, nothing after the failed task is run */
+	{
+		PolymarkerTaskPool pool (1);
+		std :: vector <size_t> run_tasks;
+
+		CHECK (!pool.Run (100, [&run_tasks] (size_t task_index, uint32 UNUSED_PARAM (thread_index))
+			{
+				run_tasks.push_back (task_index);
+				return (task_index != 10);
+			}));
+
+		CHECK (run_tasks.size () == 11);
+		CHECK (run_tasks.back () == 10);
+	}
+
+	/*
+	 * With several threads, the ones that are part way through a task
+	 * finish it and each can have taken at most one more before seeing
+	 * the failure, so only a few of the rest are started.
+	 */
+	for (uint32 num_threads = 2; num_threads <= 8; num_threads *= 2)
+		{
+			PolymarkerTaskPool pool (num_threads);
+			const size_t num_tasks = 2000;
+			std :: atomic <bool> failed (false);
+			std :: atomic <uint32> num_started (0);
+			std :: atomic <uint32> num_started_after_failure (0);
+			std :: atomic <size_t> num_run (0);
+
+			CHECK (!pool.Run (num_tasks, [&] (size_t task_index, uint32 UNUSED_PARAM (thread_index))
+				{
+					++ num_started;
+
+					if (failed.load ())
+						{
+							++ num_started_after_failure;
+						}
+
+					/* The first task of thread 0's queue fails */
+					if (task_index == 0)
+						{
+							failed = true;
+							return false;
+						}
+
+					usleep (500);
+
+					return true;
+				}));
+
+			CHECK (num_started_after_failure.load () <= 2 * num_threads);
+			CHECK (num_started.load () < num_tasks / 10);
+
+			/* A failed batch doesn't stop the next one */
+			CHECK (pool.Run (num_tasks, [&num_run] (size_t UNUSED_PARAM (task_index), uint32 UNUSED_PARAM (thread_index)) { ++ num_run; return true; }));
+			CHECK (num_run.load () == num_tasks);
+
+			/* and one that fails at its very last task is still reported */
+			CHECK (!pool.Run (num_tasks, [num_tasks] (size_t task_index, uint32 UNUSED_PARAM (thread_index)) { return (task_index != num_tasks - 1); }));
+		}
+}
+
+
+/*
+ * Run shards that each make their own part of the output, taking
+ * different times, and merge them in shard order as the pipeline's
+ * KeepShardHits does.
+ */
+static std :: string RunShards (PolymarkerTaskPool &pool_r, size_t num_shards)
+{
+	std :: vector <std :: string> outputs (num_shards);
+	std :: string merged;
+
+	if (pool_r.Run (num_shards, [&outputs] (size_t shard_index, uint32 UNUSED_PARAM (thread_index))
+		{
+			std :: string &output_r = outputs [shard_index];
+
+			usleep ((useconds_t) (((shard_index * 7919) % 13) * 100));
+
+			for (size_t i = 0; i < 5; ++ i)
+				{
+					output_r.append ("shard ").append (std :: to_string (shard_index)).append (" hit ").append (std :: to_string (i)).append ("\n");
+				}
+
+			return true;
+		}))
+		{
+			for (size_t i = 0; i < num_shards; ++ i)
+				{
+					merged.append (outputs [i]);
+				}
+		}
+
+	return merged;
+}
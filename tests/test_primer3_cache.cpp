@@ -0,0 +1,451 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_primer3_cache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the storing, keys, least-recently-used eviction and
+ * reloading of the Primer3Cache.
+ *
+ * Usage: test_primer3_cache
+ */
+
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#include "primer3_cache.hpp"
+
+#include "test_utils.hpp"
+
+
+static Primer3Prefs MakePrefs ();
+
+static Primer3Result MakeResult (uint32 i);
+
+static bool IsSameResult (const Primer3Result &a_r, const Primer3Result &b_r);
+
+static std :: vector <std :: string> ListCacheFiles (const std :: string &dir_r);
+
+static void TestDisabled (const std :: string &dir_r);
+
+static void TestKeys ();
+
+static void TestStore (const std :: string &dir_r);
+
+static void TestEvictionAndReload (const std :: string &dir_r);
+
+static void TestStatsJSON (const std :: string &dir_r);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_primer3_cache";
+	const std :: string dir (MakeTestDirectory (TEST_S));
+
+	CHECK (!dir.empty ());
+
+	if (!dir.empty ())
+		{
+			TestDisabled (dir);
+			TestKeys ();
+			TestStore (dir + "/store");
+			TestEvictionAndReload (dir + "/evict");
+			TestStatsJSON (dir + "/shared");
+
+			RemoveTestDirectory (dir);
+		}
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestDisabled (const std :: string &dir_r)
+{
+	const Primer3Prefs prefs (MakePrefs ());
+	Primer3Cache cache;
+	Primer3Input input;
+	Primer3Result result;
+	std :: string key;
+
+	input.pi_template = "ACGTACGTACGT";
+	key = Primer3Cache :: MakeKey (&prefs, input);
+
+	/* Nothing is stored until a directory is opened with a capacity */
+	CHECK (!cache.IsEnabled ());
+	CHECK (!cache.Put (key, MakeResult (0)));
+	CHECK (!cache.Get (key, result));
+
+	CHECK (cache.Open ((dir_r + "/disabled").c_str (), 0));
+	CHECK (!cache.IsEnabled ());
+	CHECK (!cache.Put (key, MakeResult (0)));
+	CHECK (cache.GetStats ().pcs_misses == 0);
+
+	/* A directory that can't be made */
+	CHECK (!cache.Open ((dir_r + "/missing/cache").c_str (), 1 << 20));
+	CHECK (!cache.IsEnabled ());
+}
+
+
+static void TestKeys ()
+{
+	Primer3Prefs prefs (MakePrefs ());
+	Primer3Input input;
+	std :: vector <std :: string> keys;
+
+	input.pi_id = "BS00068396_51:A2B";
+	input.pi_template = "ACGTACGTACGTNNACGT";
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	/* The id isn't part of the key as it doesn't change the primers */
+	input.pi_id = "BS00020051_51:A2B";
+	CHECK (Primer3Cache :: MakeKey (&prefs, input) == keys.front ());
+
+	input.pi_template = "ACGTACGTACGTNNACGG";
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	input.pi_force_left_end = 3;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	input.pi_force_right_end = 3;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	input.pi_force_left_end = -1;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_max_size = 30;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_product_size_range_max = 200;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_num_return = 10;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_liberal_base = !prefs.pp_liberal_base;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_lib_ambiguity_codes_consensus = !prefs.pp_lib_ambiguity_codes_consensus;
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	prefs.pp_thermodynamic_parameters_path_s = "/opt/primer3/primer3_config/";
+	keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+
+	for (size_t i = 0; i < keys.size (); ++ i)
+		{
+			for (size_t j = i + 1; j < keys.size (); ++ j)
+				{
+					CHECK (keys [i] != keys [j]);
+				}
+		}
+}
+
+
+static void TestStore (const std :: string &dir_r)
+{
+	const Primer3Prefs prefs (MakePrefs ());
+	Primer3Cache cache;
+	Primer3Input input;
+	Primer3Result result;
+	std :: vector <std :: string> files;
+	std :: string key;
+
+	CHECK (cache.Open (dir_r.c_str (), 1 << 20));
+	CHECK (cache.IsEnabled ());
+
+	input.pi_template = "ACGTACGTACGTACGTACGTACGTACGTACGT";
+	input.pi_force_left_end = 12;
+	key = Primer3Cache :: MakeKey (&prefs, input);
+
+	CHECK (!cache.Get (key, result));
+	CHECK (cache.Put (key, MakeResult (1)));
+	CHECK (cache.Get (key, result));
+	CHECK (IsSameResult (result, MakeResult (1)));
+
+	/* A record where primer3 found nothing */
+	{
+		Primer3Result failed;
+		std :: string failed_key;
+
+		input.pi_force_left_end = 13;
+		failed_key = Primer3Cache :: MakeKey (&prefs, input);
+		failed.pr_error = "SEQUENCE_FORCE_LEFT_END beyond end of sequence";
+
+		CHECK (cache.Put (failed_key, failed));
+		CHECK (cache.Get (failed_key, result));
+		CHECK (IsSameResult (result, failed));
+	}
+
+	/* Storing the same key again replaces its result */
+	CHECK (cache.Put (key, MakeResult (2)));
+	CHECK (cache.Get (key, result));
+	CHECK (IsSameResult (result, MakeResult (2)));
+	CHECK (cache.GetStats ().pcs_num_entries == 2);
+
+	files = ListCacheFiles (dir_r);
+	CHECK (files.size () == 2);
+
+	/* An entry that wasn't completely written isn't used */
+	for (const std :: string &file_r : files)
+		{
+			FILE *in_f = fopen (file_r.c_str (), "r");
+			std :: string contents;
+
+			if (in_f)
+				{
+					char buffer_s [4096];
+					size_t length;
+
+					while ((length = fread (buffer_s, 1, sizeof (buffer_s), in_f)) > 0)
+						{
+							contents.append (buffer_s, length);
+						}
+
+					fclose (in_f);
+				}
+
+			if (contents.compare (0, key.size (), key) == 0)
+				{
+					/* Cut off the record's terminator */
+					CHECK (WriteTestFile (file_r, contents.substr (0, contents.size () - 2)));
+				}
+		}
+
+	CHECK (!cache.Get (key, result));
+
+	CHECK (cache.GetStats ().pcs_hits == 3);
+	CHECK (cache.GetStats ().pcs_misses == 2);
+}
+
+
+static void TestEvictionAndReload (const std :: string &dir_r)
+{
+	const Primer3Prefs prefs (MakePrefs ());
+	std :: vector <std :: string> keys;
+	Primer3Result result;
+	Primer3CacheStats stats;
+	uint64 entry_size;
+
+	for (uint32 i = 0; i < 4; ++ i)
+		{
+			Primer3Input input;
+
+			input.pi_template = "ACGTACGTACGTACGTACGTACGTACGTACGT";
+			input.pi_force_right_end = (int32) (20 + i);
+
+			keys.push_back (Primer3Cache :: MakeKey (&prefs, input));
+		}
+
+	/* Find how much space each entry uses on disk, then make room for 3 of them */
+	{
+		Primer3Cache cache;
+
+		CHECK (cache.Open (dir_r.c_str (), 1 << 20));
+		CHECK (cache.Put (keys [0], MakeResult (0)));
+
+		entry_size = cache.GetStats ().pcs_size;
+		CHECK (entry_size > 0);
+	}
+
+	{
+		Primer3Cache cache;
+
+		CHECK (cache.Open (dir_r.c_str (), 3 * entry_size));
+		CHECK (cache.GetStats ().pcs_num_entries == 1);
+
+		CHECK (cache.Put (keys [1], MakeResult (1)));
+		CHECK (cache.Put (keys [2], MakeResult (2)));
+
+		/* Use the first so that the second has gone unused for the longest */
+		CHECK (cache.Get (keys [0], result));
+		CHECK (IsSameResult (result, MakeResult (0)));
+
+		CHECK (cache.Put (keys [3], MakeResult (3)));
+
+		stats = cache.GetStats ();
+		CHECK (stats.pcs_num_entries == 3);
+		CHECK (stats.pcs_evictions == 1);
+		CHECK (stats.pcs_size == 3 * entry_size);
+		CHECK (stats.pcs_capacity == 3 * entry_size);
+
+		/* and its file has gone */
+		CHECK (!cache.Get (keys [1], result));
+		CHECK (ListCacheFiles (dir_r).size () == 3);
+	}
+
+	/* A write that didn't finish leaves a temporary file, which is removed when the cache is next opened */
+	{
+		const std :: vector <std :: string> files (ListCacheFiles (dir_r));
+
+		if (!files.empty ())
+			{
+				CHECK (WriteTestFile (files.front ().substr (0, files.front ().rfind ('/')) + "/0123.tmp", "PRIMER_"));
+				CHECK (ListCacheFiles (dir_r).size () == 4);
+			}
+	}
+
+	/*
+	 * The order in which the results were used survives a restart, so
+	 * reopening with room for 2 removes the third, which was used longest ago
+	 */
+	{
+		Primer3Cache cache;
+
+		CHECK (cache.Open (dir_r.c_str (), 2 * entry_size));
+
+		stats = cache.GetStats ();
+		CHECK (stats.pcs_num_entries == 2);
+		CHECK (stats.pcs_evictions == 1);
+		CHECK (ListCacheFiles (dir_r).size () == 2);
+
+		CHECK (!cache.Get (keys [2], result));
+		CHECK (cache.Get (keys [0], result));
+		CHECK (IsSameResult (result, MakeResult (0)));
+		CHECK (cache.Get (keys [3], result));
+		CHECK (IsSameResult (result, MakeResult (3)));
+	}
+}
+
+
+static void TestStatsJSON (const std :: string &dir_r)
+{
+	json_t *json_p = json_object ();
+
+	CHECK (json_p != 0);
+
+	if (json_p)
+		{
+			const Primer3Prefs prefs (MakePrefs ());
+			Primer3Input input;
+			Primer3Result result;
+			std :: string key;
+			const json_t *stats_json_p;
+
+			input.pi_template = "ACGTACGTACGT";
+			key = Primer3Cache :: MakeKey (&prefs, input);
+
+			CHECK (OpenSharedPrimer3Cache (dir_r.c_str (), 1 << 20));
+			CHECK (Primer3Cache :: GetShared ().Put (key, MakeResult (5)));
+			CHECK (Primer3Cache :: GetShared ().Get (key, result));
+
+			CHECK (AddSharedPrimer3CacheStatsToJSON (json_p));
+
+			stats_json_p = json_object_get (json_p, "primer3_cache");
+			CHECK (stats_json_p != 0);
+
+			if (stats_json_p)
+				{
+					CHECK (json_integer_value (json_object_get (stats_json_p, "hits")) == 1);
+					CHECK (json_integer_value (json_object_get (stats_json_p, "entries")) == 1);
+					CHECK (json_integer_value (json_object_get (stats_json_p, "capacity")) == (1 << 20));
+				}
+
+			CHECK (OpenSharedPrimer3Cache (dir_r.c_str (), 0));
+			json_decref (json_p);
+		}
+}
+
+
+static Primer3Prefs MakePrefs ()
+{
+	Primer3Prefs prefs;
+
+	prefs.pp_product_size_range_min = 50;
+	prefs.pp_product_size_range_max = 150;
+	prefs.pp_max_size = 25;
+	prefs.pp_lib_ambiguity_codes_consensus = false;
+	prefs.pp_liberal_base = true;
+	prefs.pp_num_return = 5;
+	prefs.pp_explain_flag = false;
+	prefs.pp_thermodynamic_parameters_path_s = NULL;
+
+	return prefs;
+}
+
+
+static Primer3Result MakeResult (uint32 i)
+{
+	Primer3Result result;
+	const std :: string suffix (std :: to_string (i));
+
+	result.pr_num_returned = 1 + i;
+	result.pr_left = "GCTCACAGACTCCCAGATG" + suffix;
+	result.pr_right = "ACGTACGTACGTACGTACG" + suffix;
+	result.pr_left_tm = "59.09" + suffix;
+	result.pr_right_tm = "60.1" + suffix;
+	result.pr_product_size = "10" + suffix;
+
+	return result;
+}
+
+
+static bool IsSameResult (const Primer3Result &a_r, const Primer3Result &b_r)
+{
+	return ((a_r.pr_num_returned == b_r.pr_num_returned) &&
+		(a_r.pr_left == b_r.pr_left) &&
+		(a_r.pr_right == b_r.pr_right) &&
+		(a_r.pr_left_tm == b_r.pr_left_tm) &&
+		(a_r.pr_right_tm == b_r.pr_right_tm) &&
+		(a_r.pr_product_size == b_r.pr_product_size) &&
+		(a_r.pr_error == b_r.pr_error));
+}
+
+
+/*
+ * Get the files in each of the cache's subdirectories.
+ */
+static std :: vector <std :: string> ListCacheFiles (const std :: string &dir_r)
+{
+	std :: vector <std :: string> files;
+	DIR *dir_p = opendir (dir_r.c_str ());
+
+	if (dir_p)
+		{
+			struct dirent *entry_p;
+
+			while ((entry_p = readdir (dir_p)) != NULL)
+				{
+					if (*entry_p -> d_name != '.')
+						{
+							const std :: string subdirectory (dir_r + '/' + entry_p -> d_name);
+							DIR *subdir_p = opendir (subdirectory.c_str ());
+
+							if (subdir_p)
+								{
+									struct dirent *file_p;
+
+									while ((file_p = readdir (subdir_p)) != NULL)
+										{
+											if (*file_p -> d_name != '.')
+												{
+													files.push_back (subdirectory + '/' + file_p -> d_name);
+												}
+										}
+
+									closedir (subdir_p);
+								}
+						}
+				}
+
+			closedir (dir_p);
+		}
+
+	return files;
+}
@@ -0,0 +1,288 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_region_cache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the storing, least-recently-used eviction and counters
+ * of the RegionCache.
+ *
+ * Usage: test_region_cache
+ */
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "region_cache.hpp"
+
+#include "test_utils.hpp"
+
+
+typedef std :: shared_ptr <const std :: string> Region;
+
+
+static Region MakeRegion (size_t length, char base);
+
+static void TestDisabled ();
+
+static void TestEviction ();
+
+static void TestKeys ();
+
+static void TestThreads ();
+
+static void TestStatsJSON ();
+
+
+int main ()
+{
+	const char * const TEST_S = "test_region_cache";
+
+	TestDisabled ();
+	TestEviction ();
+	TestKeys ();
+	TestThreads ();
+	TestStatsJSON ();
+
+	return FinishTest (TEST_S);
+}
+
+
+static void TestDisabled ()
+{
+	RegionCache cache;
+	const std :: string key (RegionCache :: MakeKey ("genome.fa", "chr1A", 0, 100));
+	const Region region_p (MakeRegion (100, 'A'));
+
+	/* Nothing is stored until the cache has a capacity */
+	CHECK (!cache.IsEnabled ());
+	CHECK (!cache.CanStore (1));
+	CHECK (cache.Put (key, region_p) == region_p);
+	CHECK (!cache.Get (key));
+	CHECK (cache.GetStats ().rcs_num_entries == 0);
+	CHECK (cache.GetStats ().rcs_misses == 1);
+
+	/* Regions over an eighth of the capacity aren't stored */
+	cache.SetCapacity (80000);
+	CHECK (cache.IsEnabled ());
+	CHECK (cache.CanStore (10000));
+	CHECK (!cache.CanStore (10001));
+
+	CHECK (cache.Put (key, MakeRegion (20000, 'C')) != 0);
+	CHECK (!cache.Get (key));
+	CHECK (cache.GetStats ().rcs_num_entries == 0);
+}
+
+
+static void TestEviction ()
+{
+	/* As no region can use more than an eighth of the capacity, the smallest cache that evicts holds 8 */
+	const size_t num_regions = 8;
+	RegionCache cache;
+	std :: vector <std :: string> keys;
+	std :: vector <Region> regions;
+	const std :: string extra_key (RegionCache :: MakeKey ("genome.fa", "ctg8", 0, 1000));
+	const Region extra_p (MakeRegion (1000, 'N'));
+	RegionCacheStats stats;
+	uint64 entry_size;
+
+	for (size_t i = 0; i < num_regions; ++ i)
+		{
+			keys.push_back (RegionCache :: MakeKey ("genome.fa", "ctg" + std :: to_string (i), 0, 1000));
+			regions.push_back (MakeRegion (1000, "ACGT" [i % 4]));
+		}
+
+	/* Find the size of each entry, which includes its key and bookkeeping */
+	cache.SetCapacity (1 << 20);
+	cache.Put (keys [0], regions [0]);
+	entry_size = cache.GetStats ().rcs_size;
+	cache.SetCapacity (0);
+
+	CHECK (cache.GetStats ().rcs_num_entries == 0);
+	CHECK (cache.GetStats ().rcs_size == 0);
+	CHECK (cache.GetStats ().rcs_evictions == 1);
+	CHECK (entry_size > 1000);
+
+	cache.SetCapacity (num_regions * entry_size);
+
+	for (size_t i = 0; i < num_regions; ++ i)
+		{
+			CHECK (cache.Put (keys [i], regions [i]) == regions [i]);
+		}
+
+	stats = cache.GetStats ();
+	CHECK (stats.rcs_num_entries == num_regions);
+	CHECK (stats.rcs_size == num_regions * entry_size);
+	CHECK (stats.rcs_evictions == 1);
+
+	/* Storing the same region again keeps the one already there */
+	CHECK (cache.Put (keys [0], MakeRegion (1000, 'A')) == regions [0]);
+	CHECK (cache.GetStats ().rcs_num_entries == num_regions);
+
+	/* Use all but the second region, so it has gone unused for the longest */
+	for (size_t i = 0; i < num_regions; ++ i)
+		{
+			if (i != 1)
+				{
+					CHECK (cache.Get (keys [i]) == regions [i]);
+				}
+		}
+
+	/* so it is the one to go, although a job that is still using it can carry on */
+	{
+		Region in_use_p (regions [1]);
+
+		regions [1].reset ();
+		CHECK (cache.Put (extra_key, extra_p) == extra_p);
+
+		CHECK (!cache.Get (keys [1]));
+		CHECK (*in_use_p == std :: string (1000, 'C'));
+	}
+
+	CHECK (cache.Get (extra_key) == extra_p);
+	CHECK (cache.Get (keys [0]) == regions [0]);
+
+	stats = cache.GetStats ();
+	CHECK (stats.rcs_num_entries == num_regions);
+	CHECK (stats.rcs_evictions == 2);
+	CHECK (stats.rcs_hits == num_regions - 1 + 2);
+	CHECK (stats.rcs_misses == 1);
+	CHECK (stats.rcs_capacity == num_regions * entry_size);
+
+	/* Shrinking the cache removes the least recently used first */
+	cache.SetCapacity (2 * entry_size);
+	CHECK (cache.GetStats ().rcs_num_entries == 2);
+	CHECK (cache.Get (keys [0]) == regions [0]);
+	CHECK (cache.Get (extra_key) == extra_p);
+
+	cache.SetCapacity (0);
+	CHECK (!cache.IsEnabled ());
+	CHECK (cache.GetStats ().rcs_num_entries == 0);
+	CHECK (cache.GetStats ().rcs_size == 0);
+}
+
+
+static void TestKeys ()
+{
+	/* The parts of a key can't run into each other */
+	CHECK (RegionCache :: MakeKey ("a", "bc", 1, 2) != RegionCache :: MakeKey ("ab", "c", 1, 2));
+	CHECK (RegionCache :: MakeKey ("a", "b", 1, 23) != RegionCache :: MakeKey ("a", "b", 12, 3));
+	CHECK (RegionCache :: MakeKey ("a", "b", 1, 2) != RegionCache :: MakeKey ("a", "b", 1, 3));
+	CHECK (RegionCache :: MakeKey ("a", "b", 1, 2) == RegionCache :: MakeKey ("a", "b", 1, 2));
+}
+
+
+/*
+ * Many threads storing and looking up overlapping regions must keep
+ * the cache within its capacity and get back the regions they stored.
+ */
+static void TestThreads ()
+{
+	const size_t capacity = 40000;
+	const int num_threads = 8;
+	RegionCache cache;
+	std :: vector <std :: thread> threads;
+	std :: vector <int> failures (num_threads, 0);
+	RegionCacheStats stats;
+
+	cache.SetCapacity (capacity);
+
+	for (int t = 0; t < num_threads; ++ t)
+		{
+			threads.emplace_back ([&cache, &failures, t] ()
+				{
+					TestRandom random (0x5eed0004 + t);
+
+					for (int i = 0; i < 5000; ++ i)
+						{
+							const uint64 start = random.Below (64) * 1000;
+							const std :: string key (RegionCache :: MakeKey ("genome.fa", "chr1A", start, start + 1000));
+							const char base = "ACGT" [start % 4];
+							Region region_p (cache.Get (key));
+
+							if (!region_p)
+								{
+									region_p = cache.Put (key, MakeRegion (1000, base));
+								}
+
+							if (!region_p || (region_p -> size () != 1000) || ((*region_p) [999] != base))
+								{
+									++ failures [t];
+								}
+						}
+				});
+		}
+
+	for (std :: thread &thread_r : threads)
+		{
+			thread_r.join ();
+		}
+
+	for (int t = 0; t < num_threads; ++ t)
+		{
+			CHECK (failures [t] == 0);
+		}
+
+	stats = cache.GetStats ();
+	CHECK (stats.rcs_size <= capacity);
+	CHECK (stats.rcs_hits + stats.rcs_misses == (uint64) num_threads * 5000);
+	CHECK (stats.rcs_hits > 0);
+	CHECK (stats.rcs_evictions > 0);
+}
+
+
+static void TestStatsJSON ()
+{
+	json_t *json_p = json_object ();
+
+	CHECK (json_p != 0);
+
+	if (json_p)
+		{
+			const std :: string key (RegionCache :: MakeKey ("genome.fa", "chr1A", 0, 100));
+			const json_t *stats_json_p;
+
+			SetSharedRegionCacheCapacity (1 << 20);
+			RegionCache :: GetShared ().Put (key, MakeRegion (100, 'A'));
+			RegionCache :: GetShared ().Get (key);
+
+			CHECK (AddSharedRegionCacheStatsToJSON (json_p));
+
+			stats_json_p = json_object_get (json_p, "region_cache");
+			CHECK (stats_json_p != 0);
+
+			if (stats_json_p)
+				{
+					CHECK (json_integer_value (json_object_get (stats_json_p, "hits")) == 1);
+					CHECK (json_integer_value (json_object_get (stats_json_p, "entries")) == 1);
+					CHECK (json_integer_value (json_object_get (stats_json_p, "capacity")) == (1 << 20));
+				}
+
+			SetSharedRegionCacheCapacity (0);
+			json_decref (json_p);
+		}
+}
+
+
+static Region MakeRegion (size_t length, char base)
+{
+	return std :: make_shared <const std :: string> (length, base);
+}
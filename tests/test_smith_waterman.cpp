@@ -0,0 +1,472 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_smith_waterman.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief Check the SSE4.1 and AVX2 scoring passes of the Smith-Waterman
+ * aligner against a plain scalar version and the alignments that the
+ * aligner makes.
+ *
+ * Usage: test_smith_waterman
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "smith_waterman.hpp"
+
+#include "test_utils.hpp"
+
+
+/* The padding that the kernels need past the end of each array, the width of the widest vector */
+static const uint32 S_PADDING = 16;
+
+static const int32 S_NEGATIVE = -(1 << 29);
+
+
+/**
+ * The encoded sequences for the vector kernels, laid out as
+ * SmithWatermanInput describes.
+ */
+struct KernelInput
+{
+	std :: vector <int16> ki_query;
+	std :: vector <int16> ki_target;
+	std :: vector <int16> ki_buffers;
+	SmithWatermanInput ki_input;
+
+	KernelInput (const std :: string &query_r, const std :: string &target_r, const SmithWatermanParameters &params_r);
+};
+
+
+static int16 GetCode (char c, int16 unknown);
+
+static SmithWatermanScore ScoreByReference (const std :: string &query_r, const std :: string &target_r, const SmithWatermanParameters &params_r);
+
+static bool IsSameScore (const SmithWatermanScore &a_r, const SmithWatermanScore &b_r);
+
+static std :: string Mutate (const std :: string &seq_r, TestRandom &random_r, uint32 num_edits);
+
+static std :: string ReverseComplement (const std :: string &seq_r);
+
+static void TestKernels (TestRandom &random_r);
+
+static void TestAligner (TestRandom &random_r);
+
+
+int main ()
+{
+	const char * const TEST_S = "test_smith_waterman";
+	TestRandom random (0x5eed0003);
+
+	TestKernels (random);
+	TestAligner (random);
+
+	return FinishTest (TEST_S);
+}
+
+
+KernelInput :: KernelInput (const std :: string &query_r, const std :: string &target_r, const SmithWatermanParameters &params_r)
+{
+	const uint32 qlen = (uint32) query_r.size ();
+	const uint32 tlen = (uint32) target_r.size ();
+
+	ki_query.assign (qlen + 1 + S_PADDING, SW_QUERY_PADDING);
+
+	for (uint32 i = 0; i < qlen; ++ i)
+		{
+			ki_query [i + 1] = GetCode (query_r [i], SW_QUERY_UNKNOWN);
+		}
+
+	ki_target.assign (2 * qlen + tlen + S_PADDING, SW_TARGET_PADDING);
+
+	for (uint32 j = 1; j <= tlen; ++ j)
+		{
+			ki_target [qlen + tlen - j] = GetCode (target_r [j - 1], SW_TARGET_UNKNOWN);
+		}
+
+	ki_input.swi_query_p = ki_query.data ();
+	ki_input.swi_target_p = ki_target.data ();
+	ki_input.swi_query_length = qlen;
+	ki_input.swi_target_length = tlen;
+	ki_input.swi_stride = qlen + 1 + S_PADDING;
+	ki_input.swi_match = params_r.swp_match;
+	ki_input.swi_mismatch = params_r.swp_mismatch;
+	ki_input.swi_gap_open = params_r.swp_gap_open;
+	ki_input.swi_gap_extend = params_r.swp_gap_extend;
+
+	/* Fill the buffers with rubbish to check that the kernels set everything they read */
+	ki_buffers.assign (SW_NUM_BUFFERS * ki_input.swi_stride, 12345);
+	ki_input.swi_buffers_p = ki_buffers.data ();
+}
+
+
+static void TestKernels (TestRandom &random_r)
+{
+	#ifdef SW_HAVE_X86_KERNELS
+	SmithWatermanParameters params;
+	bool sse41_flag;
+	bool avx2_flag;
+
+	__builtin_cpu_init ();
+	sse41_flag = __builtin_cpu_supports ("sse4.1");
+	avx2_flag = __builtin_cpu_supports ("avx2");
+
+	if (!sse41_flag)
+		{
+			printf ("skipping the SSE4.1 kernel as the CPU doesn't support it\n");
+		}
+
+	if (!avx2_flag)
+		{
+			printf ("skipping the AVX2 kernel as the CPU doesn't support it\n");
+		}
+
+	for (int i = 0; i < 300; ++ i)
+		{
+			/* Lengths that aren't multiples of the vector widths, down to a single base */
+			const std :: string query (random_r.Sequence (1 + random_r.Below (250)));
+			std :: string target;
+			SmithWatermanScore expected;
+
+			switch (i % 4)
+				{
+					/* The query with some edits, somewhere in a longer target */
+					case 0:
+					case 1:
+						target = random_r.Sequence (random_r.Below (300)) + Mutate (query, random_r, 1 + random_r.Below (10)) + random_r.Sequence (random_r.Below (300));
+						break;
+
+					/* Unrelated sequences, so only short local alignments */
+					case 2:
+						target = random_r.Sequence (1 + random_r.Below (600));
+						break;
+
+					/* Ambiguous bases never match, not even each other */
+					default:
+						target = Mutate (query, random_r, 3);
+
+						for (int j = 0; j < 5; ++ j)
+							{
+								target [random_r.Below ((unsigned int) target.size ())] = 'N';
+							}
+
+						break;
+				}
+
+			if (i % 5 == 0)
+				{
+					params.swp_gap_open = 2 + random_r.Below (20);
+					params.swp_gap_extend = 1 + random_r.Below (params.swp_gap_open);
+					params.swp_mismatch = 1 + random_r.Below (10);
+				}
+
+			expected = ScoreByReference (query, target, params);
+
+			if (sse41_flag)
+				{
+					KernelInput input (query, target, params);
+					SmithWatermanScore score;
+
+					ScoreSmithWatermanSSE41 (&input.ki_input, &score);
+					CHECK (IsSameScore (score, expected));
+				}
+
+			if (avx2_flag)
+				{
+					KernelInput input (query, target, params);
+					SmithWatermanScore score;
+
+					ScoreSmithWatermanAVX2 (&input.ki_input, &score);
+					CHECK (IsSameScore (score, expected));
+				}
+		}
+	#else
+	printf ("skipping the vector kernels as there are none for this platform\n");
+	#endif
+}
+
+
+static void TestAligner (TestRandom &random_r)
+{
+	SmithWatermanParameters params;
+	SmithWatermanAligner aligner (params);
+	SmithWatermanAlignment alignment;
+	const std :: string target (random_r.Sequence (3000));
+	std :: string query;
+	uint32 length = 0;
+	size_t pos;
+
+	CHECK (SmithWatermanAligner :: GetKernelName () != 0);
+
+	/* The query is missing 2 bases of the target */
+	query = target.substr (1000, 60) + target.substr (1062, 78);
+	aligner.SetQuery (query.data (), query.size ());
+
+	CHECK (aligner.Align (target.data (), target.size (), false, alignment));
+	CHECK (alignment.swa_score == 138 * params.swp_match - params.swp_gap_open - params.swp_gap_extend);
+	CHECK (alignment.swa_query_start == 0);
+	CHECK (alignment.swa_query_end == 138);
+	CHECK (alignment.swa_target_start == 1000);
+	CHECK (alignment.swa_target_end == 1140);
+	CHECK (alignment.swa_matches == 138);
+	CHECK (alignment.swa_length == 140);
+
+	/* The gap may be placed anywhere that it scores the same */
+	pos = alignment.swa_cigar.find ("M2D");
+	CHECK (pos != std :: string :: npos);
+
+	if (pos != std :: string :: npos)
+		{
+			length = (uint32) atoi (alignment.swa_cigar.c_str ()) + (uint32) atoi (alignment.swa_cigar.c_str () + pos + 3);
+			CHECK (length == 138);
+			CHECK (alignment.swa_cigar.back () == 'M');
+			CHECK (alignment.swa_vulgar == "M " + alignment.swa_cigar.substr (0, pos) + " " + alignment.swa_cigar.substr (0, pos) + " G 0 2 M " + std :: to_string (138 - atoi (alignment.swa_cigar.c_str ())) + " " + std :: to_string (138 - atoi (alignment.swa_cigar.c_str ())));
+		}
+
+	/* A query from the other strand, with the coordinates on that strand */
+	query = ReverseComplement (target.substr (500, 100));
+	aligner.SetQuery (query.data (), query.size ());
+
+	CHECK (aligner.Align (target.data (), target.size (), true, alignment));
+	CHECK (alignment.swa_target_start == 3000 - 600);
+	CHECK (alignment.swa_target_end == 3000 - 500);
+	CHECK (alignment.swa_cigar == "100M");
+	CHECK (alignment.swa_identity == 100.0);
+
+	/* and which doesn't align to the forward strand */
+	CHECK (!aligner.Align (target.data (), target.size (), false, alignment));
+
+	/* Alignments below the minimum score are rejected */
+	query = target.substr (2000, 15);
+	aligner.SetQuery (query.data (), query.size ());
+	CHECK (!aligner.Align (target.data (), target.size (), false, alignment));
+
+	/* The alignments made by the aligner's kernel agree with the scalar reference */
+	for (int i = 0; i < 50; ++ i)
+		{
+			SmithWatermanScore expected;
+
+			query = Mutate (target.substr (random_r.Below (2800), 150), random_r, 5);
+			expected = ScoreByReference (query, target, params);
+			aligner.SetQuery (query.data (), query.size ());
+
+			CHECK (aligner.Align (target.data (), target.size (), false, alignment));
+			CHECK (alignment.swa_score == expected.sws_score);
+			CHECK (alignment.swa_query_end == expected.sws_query_end);
+			CHECK (alignment.swa_target_end == expected.sws_target_end);
+			CHECK (alignment.swa_matches == expected.sws_matches);
+			CHECK (alignment.swa_length == expected.sws_length);
+		}
+}
+
+
+/*
+ * The full matrices are filled in a row at a time, with the same scores
+ * and the same order of preference between equal scores as the kernels.
+ * The best cell is then chosen in the order that the kernels visit the
+ * cells, an anti-diagonal at a time, so that ties are broken the same way.
+ */
+static SmithWatermanScore ScoreByReference (const std :: string &query_r, const std :: string &target_r, const SmithWatermanParameters &params_r)
+{
+	const size_t qlen = query_r.size ();
+	const size_t tlen = target_r.size ();
+	const size_t num_cols = tlen + 1;
+	std :: vector <int32> h ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> hm ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> hl ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> e ((qlen + 1) * num_cols, S_NEGATIVE);
+	std :: vector <int32> em ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> el ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> f ((qlen + 1) * num_cols, S_NEGATIVE);
+	std :: vector <int32> fm ((qlen + 1) * num_cols, 0);
+	std :: vector <int32> fl ((qlen + 1) * num_cols, 0);
+	SmithWatermanScore score;
+
+	for (size_t i = 1; i <= qlen; ++ i)
+		{
+			for (size_t j = 1; j <= tlen; ++ j)
+				{
+					const size_t cell = i * num_cols + j;
+					const size_t up = cell - num_cols;
+					const size_t left = cell - 1;
+					const size_t diagonal = up - 1;
+					const int16 q = GetCode (query_r [i - 1], SW_QUERY_UNKNOWN);
+					const int16 t = GetCode (target_r [j - 1], SW_TARGET_UNKNOWN);
+					int32 best;
+
+					best = h [diagonal] + ((q == t) ? params_r.swp_match : - params_r.swp_mismatch);
+					h [cell] = best;
+					hm [cell] = hm [diagonal] + ((q == t) ? 1 : 0);
+					hl [cell] = hl [diagonal] + 1;
+
+					if (e [left] - params_r.swp_gap_extend > h [left] - params_r.swp_gap_open)
+						{
+							e [cell] = e [left] - params_r.swp_gap_extend;
+							em [cell] = em [left];
+							el [cell] = el [left] + 1;
+						}
+					else
+						{
+							e [cell] = h [left] - params_r.swp_gap_open;
+							em [cell] = hm [left];
+							el [cell] = hl [left] + 1;
+						}
+
+					if (f [up] - params_r.swp_gap_extend > h [up] - params_r.swp_gap_open)
+						{
+							f [cell] = f [up] - params_r.swp_gap_extend;
+							fm [cell] = fm [up];
+							fl [cell] = fl [up] + 1;
+						}
+					else
+						{
+							f [cell] = h [up] - params_r.swp_gap_open;
+							fm [cell] = hm [up];
+							fl [cell] = hl [up] + 1;
+						}
+
+					if (e [cell] > best)
+						{
+							best = e [cell];
+							hm [cell] = em [cell];
+							hl [cell] = el [cell];
+						}
+
+					if (f [cell] > best)
+						{
+							best = f [cell];
+							hm [cell] = fm [cell];
+							hl [cell] = fl [cell];
+						}
+
+					if (best < 1)
+						{
+							best = 0;
+							hm [cell] = 0;
+							hl [cell] = 0;
+						}
+
+					h [cell] = best;
+				}
+		}
+
+	memset (&score, 0, sizeof (score));
+
+	for (size_t d = 2; d <= qlen + tlen; ++ d)
+		{
+			for (size_t i = 1; i <= qlen; ++ i)
+				{
+					if ((d > i) && (d - i <= tlen))
+						{
+							const size_t cell = i * num_cols + (d - i);
+
+							if (h [cell] > score.sws_score)
+								{
+									score.sws_score = h [cell];
+									score.sws_query_end = (uint32) i;
+									score.sws_target_end = (uint32) (d - i);
+									score.sws_matches = (uint32) hm [cell];
+									score.sws_length = (uint32) hl [cell];
+								}
+						}
+				}
+		}
+
+	return score;
+}
+
+
+static bool IsSameScore (const SmithWatermanScore &a_r, const SmithWatermanScore &b_r)
+{
+	return ((a_r.sws_score == b_r.sws_score) &&
+		(a_r.sws_query_end == b_r.sws_query_end) &&
+		(a_r.sws_target_end == b_r.sws_target_end) &&
+		(a_r.sws_matches == b_r.sws_matches) &&
+		(a_r.sws_length == b_r.sws_length));
+}
+
+
+static int16 GetCode (char c, int16 unknown)
+{
+	switch (c)
+		{
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			case 'T': return 3;
+			default: return unknown;
+		}
+}
+
+
+/*
+ * Make random substitutions, insertions and deletions.
+ */
+static std :: string Mutate (const std :: string &seq_r, TestRandom &random_r, uint32 num_edits)
+{
+	std :: string mutated (seq_r);
+
+	for (uint32 i = 0; i < num_edits; ++ i)
+		{
+			const size_t pos = random_r.Below ((unsigned int) mutated.size ());
+
+			switch (random_r.Below (3))
+				{
+					case 0:
+						mutated [pos] = "ACGT" [random_r.Below (4)];
+						break;
+
+					case 1:
+						mutated.insert (pos, random_r.Sequence (1 + random_r.Below (4)));
+						break;
+
+					default:
+						if (mutated.size () > 5)
+							{
+								mutated.erase (pos, 1 + random_r.Below (4));
+							}
+						break;
+				}
+		}
+
+	return mutated;
+}
+
+
+static std :: string ReverseComplement (const std :: string &seq_r)
+{
+	std :: string rc (seq_r.rbegin (), seq_r.rend ());
+
+	for (char &c : rc)
+		{
+			switch (c)
+				{
+					case 'A': c = 'T'; break;
+					case 'C': c = 'G'; break;
+					case 'G': c = 'C'; break;
+					case 'T': c = 'A'; break;
+					default: break;
+				}
+		}
+
+	return rc;
+}
@@ -0,0 +1,214 @@
+/*
+** Copyright 2014-2019 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/**
+ * test_utils.hpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * @file
+ * @brief The checks and helpers shared by the tests of the native pipeline.
+ *
+ * Each test is a standalone program that is run by the "check" target of
+ * the makefile with the build directory as its only argument, so that it
+ * can run the offline tools that were built there. It prints each failed
+ * check and exits with a non-zero status if there were any.
+ */
+
+#ifndef SERVICES_POLYMARKER_SERVICE_TESTS_TEST_UTILS_HPP_
+#define SERVICES_POLYMARKER_SERVICE_TESTS_TEST_UTILS_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+
+/** The number of checks that have failed so far. */
+static int s_num_failures = 0;
+
+
+/**
+ * Check that a condition holds, printing the condition and where it is
+ * if it does not. The test carries on either way.
+ */
+#define CHECK(cond) \
+	do \
+		{ \
+			if (! (cond)) \
+				{ \
+					fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+					++ s_num_failures; \
+				} \
+		} \
+	while (0)
+
+
+/**
+ * Print the result of a test.
+ *
+ * @param test_s The name of the test.
+ * @return The exit status for the test program.
+ */
+inline int FinishTest (const char *test_s)
+{
+	if (s_num_failures == 0)
+		{
+			printf ("%s: passed\n", test_s);
+			return EXIT_SUCCESS;
+		}
+
+	printf ("%s: %d check(s) failed\n", test_s, s_num_failures);
+	return EXIT_FAILURE;
+}
+
+
+/**
+ * Make a temporary directory for a test's files.
+ *
+ * @param test_s The name of the test to use in the directory name.
+ * @return The path of the directory or an empty string upon error.
+ */
+inline std :: string MakeTestDirectory (const char *test_s)
+{
+	const char *tmp_s = getenv ("TMPDIR");
+	std :: string dir ((tmp_s && *tmp_s) ? tmp_s : "/tmp");
+
+	dir.append ("/").append (test_s).append ("_XXXXXX");
+
+	if (!mkdtemp (&dir [0]))
+		{
+			return std :: string ();
+		}
+
+	return dir;
+}
+
+
+/**
+ * Remove a temporary directory made by MakeTestDirectory along with its files.
+ *
+ * @param dir_r The directory to remove.
+ */
+inline void RemoveTestDirectory (const std :: string &dir_r)
+{
+	if (!dir_r.empty ())
+		{
+			const std :: string command ("rm -rf '" + dir_r + "'");
+
+			if (system (command.c_str ()) != 0)
+				{
+					fprintf (stderr, "failed to remove %s\n", dir_r.c_str ());
+				}
+		}
+}
+
+
+/**
+ * Write a string to a file.
+ *
+ * @param filename_r The file to write.
+ * @param contents_r The contents to write.
+ * @return <code>true</code> if the file was written successfully,
+ * <code>false</code> otherwise.
+ */
+inline bool WriteTestFile (const std :: string &filename_r, const std :: string &contents_r)
+{
+	bool success_flag = false;
+	FILE *out_f = fopen (filename_r.c_str (), "w");
+
+	if (out_f)
+		{
+			success_flag = (fwrite (contents_r.data (), 1, contents_r.size (), out_f) == contents_r.size ());
+
+			if (fclose (out_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/**
+ * Run one of the offline tools from the build directory.
+ *
+ * @param build_dir_s The build directory.
+ * @param tool_s The name of the tool.
+ * @param args_r The arguments for the tool, already quoted where needed.
+ * @return <code>true</code> if the tool ran and exited successfully,
+ * <code>false</code> otherwise.
+ */
+inline bool RunTestTool (const char *build_dir_s, const char *tool_s, const std :: string &args_r)
+{
+	const std :: string command (std :: string (build_dir_s) + "/" + tool_s + " " + args_r + " > /dev/null");
+
+	return (system (command.c_str ()) == 0);
+}
+
+
+/**
+ * A small xorshift generator so that the random sequences are
+ * the same on every platform and every run.
+ */
+class TestRandom
+{
+public:
+	explicit TestRandom (unsigned long long seed)
+		: tr_state (seed ? seed : 1)
+	{
+	}
+
+	unsigned long long Next ()
+	{
+		tr_state ^= tr_state << 13;
+		tr_state ^= tr_state >> 7;
+		tr_state ^= tr_state << 17;
+
+		return tr_state;
+	}
+
+	/**
+	 * Get a random number in [0, n).
+	 */
+	unsigned int Below (unsigned int n)
+	{
+		return (unsigned int) (Next () % n);
+	}
+
+	/**
+	 * Get a random sequence of A, C, G and T.
+	 */
+	std :: string Sequence (size_t length)
+	{
+		std :: string seq (length, 'A');
+
+		for (size_t i = 0; i < length; ++ i)
+			{
+				seq [i] = "ACGT" [Below (4)];
+			}
+
+		return seq;
+	}
+
+private:
+	unsigned long long tr_state;
+};
+
+
+#endif /* SERVICES_POLYMARKER_SERVICE_TESTS_TEST_UTILS_HPP_ */